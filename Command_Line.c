@@ -0,0 +1,356 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+
+#include "Command_Line.h"
+#include "Thread_Pool.h"
+
+typedef bool (*args_handler_t)(const char* option_value, droidcat_args_t* droidcat_args);
+
+struct args_option
+{
+    const char* option_name;
+
+    /* The option consumes a value */
+    bool option_valued;
+
+    args_handler_t option_handler;
+};
+
+static bool args_add_input(const char* input_file, size_t input_length, droidcat_args_t* droidcat_args)
+{
+    /* Inputs like "F-Droid.apk, LineageOS.zip" has spaces around the names */
+    while (input_length != 0 && isspace((unsigned char)*input_file))
+    {
+        input_file++;
+        input_length--;
+    }
+    while (input_length != 0 && isspace((unsigned char)input_file[input_length - 1]))
+    {
+        input_length--;
+    }
+    if (input_length == 0)
+    {
+        return true;
+    }
+
+    char** new_inputs = realloc(droidcat_args->input_files, (droidcat_args->inputs_count + 1) * sizeof(char*));
+    if (new_inputs == NULL)
+    {
+        return false;
+    }
+    droidcat_args->input_files = new_inputs;
+
+    char* new_input = (char*)malloc(input_length + 1);
+    if (new_input == NULL)
+    {
+        return false;
+    }
+    memcpy(new_input, input_file, input_length);
+    new_input[input_length] = '\0';
+
+    new_inputs[droidcat_args->inputs_count++] = new_input;
+
+    return true;
+}
+
+bool args_add_default(const char* input_file, droidcat_args_t* droidcat_args)
+{
+    return args_add_input(input_file, strlen(input_file), droidcat_args);
+}
+
+static bool args_inputs(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    const char* input_begin = option_value;
+
+    for (;;)
+    {
+        const char* input_end = strchr(input_begin, ',');
+        size_t input_length = input_end != NULL ? (size_t)(input_end - input_begin) : strlen(input_begin);
+
+        if (args_add_input(input_begin, input_length, droidcat_args) == false)
+        {
+            return false;
+        }
+        if (input_end == NULL)
+        {
+            return true;
+        }
+        input_begin = input_end + 1;
+    }
+}
+
+static bool args_output(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->output_dir = option_value;
+    return true;
+}
+
+static bool args_in_memory(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    (void)option_value;
+    droidcat_args->output_in_memory = true;
+    return true;
+}
+
+static bool args_max_memory(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    return args_parse_size(option_value, &droidcat_args->max_host_memory);
+}
+
+static bool args_max_thread(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    char* value_end;
+    long max_thread = strtol(option_value, &value_end, 10);
+
+    if (*value_end != '\0' || max_thread <= 0 || max_thread > TPOOL_WORKERS_MAX)
+    {
+        return false;
+    }
+    droidcat_args->max_thread = (int)max_thread;
+    return true;
+}
+
+static bool args_script(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->script_file = option_value;
+    return true;
+}
+
+static bool args_decode_settings(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->decode_settings = option_value;
+    return true;
+}
+
+static bool args_cache_dir(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->cache_dir = option_value;
+    return true;
+}
+
+static bool args_cache_size(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    return args_parse_size(option_value, &droidcat_args->cache_size) && droidcat_args->cache_size != 0;
+}
+
+static bool args_settings(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->settings_file = option_value;
+    return true;
+}
+
+static bool args_daemon(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    (void)option_value;
+    droidcat_args->daemon_mode = true;
+    return true;
+}
+
+static bool args_socket(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->socket_path = option_value;
+    return true;
+}
+
+static bool args_progress_mode(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    return progress_parse_mode(option_value, &droidcat_args->progress_mode);
+}
+
+static bool args_use_engine(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->scan_engine = option_value;
+    return *option_value != '\0';
+}
+
+static bool args_antifeatures(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    (void)option_value;
+    droidcat_args->test_antifeatures = true;
+    return true;
+}
+
+static bool args_select_name(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->select_name = option_value;
+    return true;
+}
+
+static bool args_select_mode(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    return index_parse_mode(option_value, &droidcat_args->select_mode);
+}
+
+static bool args_verify_signature(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    (void)option_value;
+    droidcat_args->verify_signature = true;
+    return true;
+}
+
+static bool args_build(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->build_dir = option_value;
+    return *option_value != '\0';
+}
+
+static bool args_startup_trace(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    (void)option_value;
+    droidcat_args->startup_trace = true;
+    return true;
+}
+
+static bool args_profile(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    droidcat_args->profile_file = option_value;
+    return *option_value != '\0';
+}
+
+/* In seconds, fractions are accepted */
+static bool args_time_limit(const char* option_value, droidcat_args_t* droidcat_args)
+{
+    char* value_end;
+    double time_limit = strtod(option_value, &value_end);
+
+    if (*value_end != '\0' || !(time_limit > 0) || time_limit > 1e6)
+    {
+        return false;
+    }
+    droidcat_args->time_limit = (uint64_t)(time_limit * 1e9);
+    return true;
+}
+
+static const struct args_option droidcat_options[] = {
+    { "in", true, args_inputs },
+    { "output", true, args_output },
+    { "output-dir", true, args_output },
+    { "output-in-memory", false, args_in_memory },
+    { "max-host-memory", true, args_max_memory },
+    { "max-thread", true, args_max_thread },
+    { "script", true, args_script },
+    { "decode-settings", true, args_decode_settings },
+    { "cache-dir", true, args_cache_dir },
+    { "cache-size", true, args_cache_size },
+    { "settings", true, args_settings },
+    { "daemon", false, args_daemon },
+    { "socket", true, args_socket },
+    { "progress-mode", true, args_progress_mode },
+    { "use-engine", true, args_use_engine },
+    { "test-for-antifeatures", false, args_antifeatures },
+    { "select-by-name", true, args_select_name },
+    { "mode-by-name", true, args_select_mode },
+    { "verify-signature", false, args_verify_signature },
+    { "build", true, args_build },
+    { "startup-trace", false, args_startup_trace },
+    { "profile", true, args_profile },
+    { "time-limit", true, args_time_limit },
+};
+
+static const struct args_option* args_find(const char* option_name, size_t name_length)
+{
+    for (size_t option_cur = 0; option_cur < sizeof(droidcat_options) / sizeof(*droidcat_options); option_cur++)
+    {
+        const char* known_name = droidcat_options[option_cur].option_name;
+        if (strncmp(known_name, option_name, name_length) == 0 && known_name[name_length] == '\0')
+        {
+            return &droidcat_options[option_cur];
+        }
+    }
+    return NULL;
+}
+
+bool args_parse(int argc, char** argv, droidcat_args_t* droidcat_args)
+{
+    memset(droidcat_args, 0, sizeof(*droidcat_args));
+
+    for (int arg_cur = 1; arg_cur < argc; arg_cur++)
+    {
+        const char* argument = argv[arg_cur];
+
+        if (argument[0] != '-' || argument[1] == '\0')
+        {
+            /* Positional arguments are inputs */
+            if (args_add_input(argument, strlen(argument), droidcat_args) == false)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        const char* option_name = argument + (argument[1] == '-' ? 2 : 1);
+        const char* option_value = strchr(option_name, '=');
+        size_t name_length = option_value != NULL ? (size_t)(option_value - option_name) : strlen(option_name);
+
+        const struct args_option* option = args_find(option_name, name_length);
+        if (option == NULL)
+        {
+            fprintf(stderr, "droidcat: unknown option %s, ignoring\n", argument);
+            continue;
+        }
+
+        if (option_value != NULL)
+        {
+            option_value++;
+        }
+        else if (option->option_valued)
+        {
+            if (arg_cur + 1 == argc)
+            {
+                fprintf(stderr, "droidcat: option %s requires a value\n", argument);
+                return false;
+            }
+            option_value = argv[++arg_cur];
+        }
+
+        if (option->option_handler(option_value, droidcat_args) == false)
+        {
+            fprintf(stderr, "droidcat: invalid value for %s\n", argument);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void args_release(droidcat_args_t* droidcat_args)
+{
+    for (size_t input_cur = 0; input_cur < droidcat_args->inputs_count; input_cur++)
+    {
+        free((void*)droidcat_args->input_files[input_cur]);
+    }
+    if (droidcat_args->input_files != NULL)
+    {
+        free((void*)droidcat_args->input_files);
+    }
+
+    memset(droidcat_args, 0, sizeof(*droidcat_args));
+}
+
+bool args_parse_size(const char* size_value, size_t* size_bytes)
+{
+    char* value_end;
+    unsigned long long size_number = strtoull(size_value, &value_end, 10);
+
+    if (value_end == size_value)
+    {
+        return false;
+    }
+
+    switch (tolower((unsigned char)*value_end))
+    {
+    case '\0': case 'b': break;
+    case 'k': size_number <<= 10; break;
+    case 'm': size_number <<= 20; break;
+    case 'g': size_number <<= 30; break;
+    default: return false;
+    }
+
+    *size_bytes = (size_t)size_number;
+
+    return true;
+}
+
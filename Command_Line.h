@@ -0,0 +1,93 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Progress_Report.h"
+#include "data/Name_Index.h"
+
+typedef struct droidcat_args
+{
+    /* All inputs, from the -in lists and from the positional arguments */
+    char** input_files;
+
+    size_t inputs_count;
+
+    const char* output_dir;
+
+    /* The output tree is kept in memory, see vfs/Memory_FS */
+    bool output_in_memory;
+
+    /* In bytes, 0 means unlimited */
+    size_t max_host_memory;
+
+    /* 0 when not specified in the command line */
+    int max_thread;
+
+    const char* script_file;
+
+    const char* decode_settings;
+
+    /* The decode cache is used only when a directory is given */
+    const char* cache_dir;
+
+    size_t cache_size;
+
+    /* NULL for the default settings.toml, that may not exist */
+    const char* settings_file;
+
+    /* -daemon serves the requests of the clients, see Daemon_Server */
+    bool daemon_mode;
+
+    /* NULL for the default daemon socket */
+    const char* socket_path;
+
+    /* -progress-mode, reported into the error output */
+    progress_mode_t progress_mode;
+
+    /* -use-engine, see scan/Scan_Engine */
+    const char* scan_engine;
+
+    /* Scans with the builtin antifeatures engine */
+    bool test_antifeatures;
+
+    /* -select-by-name, only the entries matching it (or DEX files with a matching class) are unpacked */
+    const char* select_name;
+
+    index_mode_t select_mode;
+
+    /* -verify-signature checks the APK Signature Scheme v2/v3 digests of each input */
+    bool verify_signature;
+
+    /* -build packs this directory into the -output archive instead of unpacking the inputs */
+    const char* build_dir;
+
+    /* --startup-trace reports the time of each startup phase into stderr */
+    bool startup_trace;
+
+    /* -profile samples the threads and writes their stacks into this file, see cpu/Sample_Profiler */
+    const char* profile_file;
+
+    /* -time-limit, in nanoseconds from the start of the batch, 0 without limit. The entries not
+     * started before it are skipped and the running decoders stop
+    */
+    uint64_t time_limit;
+
+} droidcat_args_t;
+
+/* Options are accepted as "-name=value" or "-name value", the values are not copied,
+ * they points to argv strings (except the input list)
+*/
+bool args_parse(int argc, char** argv, droidcat_args_t* droidcat_args);
+void args_release(droidcat_args_t* droidcat_args);
+
+/* Used when the command line has no inputs */
+bool args_add_default(const char* input_file, droidcat_args_t* droidcat_args);
+
+/* Parses sizes like "22Mb", "512Kb", "1G" or "4096" into bytes */
+bool args_parse_size(const char* size_value, size_t* size_bytes);
+
+#endif
+
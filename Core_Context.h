@@ -2,7 +2,15 @@
 #define CORE_CONTEXT_H
 
 #include "Thread_Pool.h"
+#include "Command_Line.h"
 #include "cpu/Hardware_Info.h"
+#include "vfs/Memory_FS.h"
+#include "storage/Decode_Cache.h"
+#include "script/Dsc_Compiler.h"
+#include "config/Settings.h"
+#include "log/Event_Log.h"
+#include "Progress_Report.h"
+#include "scan/Scan_Engine.h"
 
 typedef struct droidcat_ctx
 {
@@ -14,6 +22,33 @@ typedef struct droidcat_ctx
 
     physical_CPU_t* main_CPU;
 
+    droidcat_args_t* main_args;
+
+    /* Only exist when -output-in-memory is used, all outputs are written here instead of the disk */
+    memfs_t* output_tree;
+
+    /* Decoded outputs from previous runs, only exist when -cache-dir is used */
+    decode_cache_t* decode_cache;
+
+    /* Compiled scripts by content, the -script program is compiled once and runs for each input */
+    dsc_cache_t* script_cache;
+
+    dsc_program_t* main_script;
+
+    /* The settings.toml snapshot, see settings_acquire */
+    settings_store_t* main_settings;
+
+    /* [log] of the settings, NULL when the level is "off" */
+    event_log_t* main_log;
+
+    /* Only while a batch runs with -progress-mode */
+    progress_t* main_progress;
+
+    /* The engines of -use-engine and -test-for-antifeatures, only while a batch runs */
+    scan_engine_t* main_engines;
+
+    size_t engines_count;
+
 } droidcat_ctx_t;
 
 #endif
@@ -0,0 +1,707 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "Daemon_Server.h"
+#include "Input_Batch.h"
+#include "data/Memory_Arena.h"
+
+/* "DCRQ", followed by the request size, the client directory and the arguments, all NUL terminated */
+#define DAEMON_REQUEST_MAGIC 0x51524344
+#define DAEMON_REQUEST_MAX (1024 * 1024)
+#define DAEMON_ARGS_MAX 256
+
+#define DAEMON_FRAME_SIZE (16 * 1024)
+#define DAEMON_EVENTS_MAX 64
+
+/* Frames streamed back to the client: a type byte and a 32 bits length before the data */
+enum daemon_frame
+{
+    DAEMON_FRAME_OUTPUT = 'o',
+    DAEMON_FRAME_ERROR = 'e',
+    DAEMON_FRAME_EXIT = 'x'
+};
+
+struct daemon_server;
+
+struct daemon_client
+{
+    int client_fd;
+
+    /* The request task and the progress reporter both send frames */
+    pthread_mutex_t send_lock;
+
+    /* Growable, the whole request is read before it runs */
+    output_buffer_t client_request;
+
+    struct daemon_server* server;
+
+    /* The batch of the request runs into it, cancelled when a frame can't be sent: the client
+     * has left and nobody reads the output
+    */
+    tpool_scope_t request_scope;
+
+    /* Clients still sending their request, closed if the daemon stops */
+    struct daemon_client* client_next;
+
+    struct daemon_client* client_prev;
+};
+
+struct daemon_server
+{
+    droidcat_ctx_t* droidcat_ctx;
+
+    int listen_fd;
+
+    int epoll_fd;
+
+    int signal_fd;
+
+    /* The requests running in the pool */
+    tpool_group_t requests_group;
+
+    struct daemon_client* reading_clients;
+};
+
+void daemon_socket_path(char* socket_path, size_t path_size)
+{
+    const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    if (runtime_dir != NULL && runtime_dir[0] != '\0')
+    {
+        snprintf(socket_path, path_size, "%s/droidcat.sock", runtime_dir);
+    }
+    else
+    {
+        snprintf(socket_path, path_size, "/tmp/droidcat-%u.sock", (unsigned)getuid());
+    }
+}
+
+static void daemon_signal_set(sigset_t* signal_set)
+{
+    sigemptyset(signal_set);
+    sigaddset(signal_set, SIGINT);
+    sigaddset(signal_set, SIGTERM);
+    sigaddset(signal_set, SIGHUP);
+}
+
+bool daemon_block_signals(void)
+{
+    sigset_t signal_set;
+    daemon_signal_set(&signal_set);
+
+    return pthread_sigmask(SIG_BLOCK, &signal_set, NULL) == 0;
+}
+
+static bool daemon_address(const char* socket_path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        return false;
+    }
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+static bool daemon_write_all(int socket_fd, const void* data, size_t data_size)
+{
+    const uint8_t* data_cursor = (const uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t sent_size = send(socket_fd, data_cursor, data_size, MSG_NOSIGNAL);
+        if (sent_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent_size <= 0)
+        {
+            return false;
+        }
+        data_cursor += sent_size;
+        data_size -= (size_t)sent_size;
+    }
+    return true;
+}
+
+static bool daemon_read_all(int socket_fd, void* data, size_t data_size)
+{
+    uint8_t* data_cursor = (uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t read_size = read(socket_fd, data_cursor, data_size);
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_size <= 0)
+        {
+            return false;
+        }
+        data_cursor += read_size;
+        data_size -= (size_t)read_size;
+    }
+    return true;
+}
+
+/* The output buffers flush big appends whole, the client takes frames of DAEMON_FRAME_SIZE
+ * at most, the data is sent in as many frames as needed
+*/
+static bool daemon_send_frame(enum daemon_frame frame_type, const char* frame_data, size_t frame_size, struct daemon_client* client)
+{
+    bool send_ret = true;
+
+    pthread_mutex_lock(&client->send_lock);
+    do
+    {
+        size_t piece_size = frame_size < DAEMON_FRAME_SIZE ? frame_size : DAEMON_FRAME_SIZE;
+        uint8_t frame_header[5] = {
+            (uint8_t)frame_type, (uint8_t)piece_size, (uint8_t)(piece_size >> 8), (uint8_t)(piece_size >> 16), (uint8_t)(piece_size >> 24)
+        };
+
+        send_ret = daemon_write_all(client->client_fd, frame_header, sizeof(frame_header)) &&
+            daemon_write_all(client->client_fd, frame_data, piece_size);
+        frame_data += piece_size;
+        frame_size -= piece_size;
+    } while (send_ret && frame_size != 0);
+    pthread_mutex_unlock(&client->send_lock);
+
+    if (send_ret == false)
+    {
+        tpool_scope_cancel(&client->request_scope);
+    }
+
+    return send_ret;
+}
+
+static bool daemon_flush_output(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    return daemon_send_frame(DAEMON_FRAME_OUTPUT, flush_data, flush_size, (struct daemon_client*)flush_context);
+}
+
+static bool daemon_flush_error(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    return daemon_send_frame(DAEMON_FRAME_ERROR, flush_data, flush_size, (struct daemon_client*)flush_context);
+}
+
+/* The daemon doesn't share the client working directory */
+static const char* daemon_absolute(const char* path, const char* client_cwd, memory_arena_t* path_arena)
+{
+    if (path == NULL || path[0] == '/')
+    {
+        return path;
+    }
+
+    size_t path_size = strlen(client_cwd) + strlen(path) + 2;
+    char* absolute_path = arena_alloc(path_size, path_arena);
+    if (absolute_path != NULL)
+    {
+        snprintf(absolute_path, path_size, "%s/%s", client_cwd, path);
+    }
+    return absolute_path;
+}
+
+/* Without -output the batch writes into the default output of the settings, or into the working
+ * directory: both must be the client's, not the daemon's
+*/
+static const char* daemon_default_output(const char* client_cwd, settings_store_t* main_settings, memory_arena_t* path_arena)
+{
+    size_t settings_epoch;
+    const settings_t* settings = settings_acquire(&settings_epoch, main_settings);
+    const char* default_output = client_cwd;
+
+    if (settings->outputs_count != 0)
+    {
+        /* The snapshot is released below, the path is copied before */
+        const char* settings_output = settings->unknown_output[0];
+        char* output_copy = arena_strndup(settings_output, strlen(settings_output), path_arena);
+
+        default_output = output_copy != NULL ? daemon_absolute(output_copy, client_cwd, path_arena) : NULL;
+    }
+    settings_release(settings_epoch, main_settings);
+
+    return default_output;
+}
+
+static bool daemon_request_paths(const char* client_cwd, droidcat_args_t* request_args, settings_store_t* main_settings, memory_arena_t* path_arena)
+{
+    for (size_t input_cur = 0; input_cur < request_args->inputs_count; input_cur++)
+    {
+        const char* input_path = daemon_absolute(request_args->input_files[input_cur], client_cwd, path_arena);
+        char* owned_path = input_path != NULL ? strdup(input_path) : NULL;
+
+        if (owned_path == NULL)
+        {
+            return false;
+        }
+        free((void*)request_args->input_files[input_cur]);
+        request_args->input_files[input_cur] = owned_path;
+    }
+
+    const char* output_dir = request_args->output_dir;
+    const char* script_file = request_args->script_file;
+    const char* scan_engine = request_args->scan_engine;
+    const char* build_dir = request_args->build_dir;
+
+    request_args->output_dir = daemon_absolute(output_dir, client_cwd, path_arena);
+    /* -build names his archive after the directory when there's no -output */
+    if (output_dir == NULL && build_dir == NULL)
+    {
+        output_dir = request_args->output_dir = daemon_default_output(client_cwd, main_settings, path_arena);
+        if (output_dir == NULL)
+        {
+            return false;
+        }
+    }
+    request_args->script_file = daemon_absolute(script_file, client_cwd, path_arena);
+    request_args->build_dir = daemon_absolute(build_dir, client_cwd, path_arena);
+
+    /* Engine names without a path or an extension are searched in the daemon engines directory */
+    if (scan_engine != NULL && (strchr(scan_engine, '/') != NULL || strchr(scan_engine, '.') != NULL))
+    {
+        request_args->scan_engine = daemon_absolute(scan_engine, client_cwd, path_arena);
+    }
+
+    return (output_dir == NULL || request_args->output_dir != NULL) && (script_file == NULL || request_args->script_file != NULL) &&
+        (scan_engine == NULL || request_args->scan_engine != NULL) && (build_dir == NULL || request_args->build_dir != NULL);
+}
+
+static void daemon_client_free(struct daemon_client* client)
+{
+    close(client->client_fd);
+    pthread_mutex_destroy(&client->send_lock);
+    outbuf_deinit(&client->client_request);
+    free((void*)client);
+}
+
+/* Runs in the pool, the pool, caches and settings of the daemon are shared by all requests */
+static void* daemon_request_task(void* task_data)
+{
+    struct daemon_client* client = (struct daemon_client*)task_data;
+    const char* request_data = client->client_request.buffer_data + 8;
+    const char* request_end = client->client_request.buffer_data + outbuf_length(&client->client_request);
+
+    const char* client_cwd = request_data;
+    char* request_argv[DAEMON_ARGS_MAX + 1];
+    int request_argc = 0;
+
+    for (const char* argument = client_cwd + strlen(client_cwd) + 1; argument < request_end && request_argc < DAEMON_ARGS_MAX;
+        argument += strlen(argument) + 1)
+    {
+        request_argv[request_argc++] = (char*)argument;
+    }
+    request_argv[request_argc] = NULL;
+
+    output_buffer_t report_output;
+    output_buffer_t error_output;
+    outbuf_init(DAEMON_FRAME_SIZE, daemon_flush_output, client, &report_output);
+    outbuf_init(DAEMON_FRAME_SIZE, daemon_flush_error, client, &error_output);
+
+    droidcat_args_t request_args = { 0 };
+    memory_arena_t* path_arena = arena_create(4096);
+    int32_t exit_code = 1;
+
+    tpool_scope_init(0, &client->request_scope);
+    tpool_scope_t* previous_scope = tpool_scope_enter(&client->request_scope);
+
+    if (path_arena == NULL || args_parse(request_argc, request_argv, &request_args) == false || request_args.daemon_mode ||
+        daemon_request_paths(client_cwd, &request_args, client->server->droidcat_ctx->main_settings, path_arena) == false)
+    {
+        outbuf_puts("droidcat: the daemon has refused the command line\n", &error_output);
+        elog_write(client->server->droidcat_ctx->main_log, ELOG_WARN, "daemon", "refused a command line from %s", client_cwd);
+    }
+    else
+    {
+        droidcat_ctx_t request_ctx = *client->server->droidcat_ctx;
+        request_ctx.main_args = &request_args;
+
+        exit_code = batch_execute(&report_output, &error_output, &request_ctx) ? 0 : 1;
+        elog_write(request_ctx.main_log, ELOG_INFO, "daemon", "request with %d arguments from %s, exit %d", request_argc, client_cwd, (int)exit_code);
+    }
+
+    outbuf_flush(&report_output);
+    outbuf_flush(&error_output);
+    outbuf_deinit(&report_output);
+    outbuf_deinit(&error_output);
+
+    uint8_t exit_data[4] = { (uint8_t)exit_code, (uint8_t)(exit_code >> 8), (uint8_t)(exit_code >> 16), (uint8_t)(exit_code >> 24) };
+    daemon_send_frame(DAEMON_FRAME_EXIT, (const char*)exit_data, sizeof(exit_data), client);
+
+    tpool_scope_leave(previous_scope);
+
+    args_release(&request_args);
+    if (path_arena != NULL)
+    {
+        arena_destroy(path_arena);
+    }
+    daemon_client_free(client);
+
+    return NULL;
+}
+
+static void daemon_unlink_client(struct daemon_client* client, struct daemon_server* server)
+{
+    if (client->client_prev != NULL)
+    {
+        client->client_prev->client_next = client->client_next;
+    }
+    else
+    {
+        server->reading_clients = client->client_next;
+    }
+    if (client->client_next != NULL)
+    {
+        client->client_next->client_prev = client->client_prev;
+    }
+}
+
+static void daemon_accept(struct daemon_server* server)
+{
+    for (;;)
+    {
+        int client_fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd < 0)
+        {
+            return;
+        }
+
+        struct daemon_client* client = calloc(1, sizeof(struct daemon_client));
+        if (client == NULL)
+        {
+            close(client_fd);
+            continue;
+        }
+        client->client_fd = client_fd;
+        pthread_mutex_init(&client->send_lock, NULL);
+        client->server = server;
+        outbuf_init(0, NULL, NULL, &client->client_request);
+
+        struct epoll_event client_event = { .events = EPOLLIN, .data.ptr = client };
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_fd, &client_event) != 0)
+        {
+            daemon_client_free(client);
+            continue;
+        }
+
+        client->client_next = server->reading_clients;
+        if (server->reading_clients != NULL)
+        {
+            server->reading_clients->client_prev = client;
+        }
+        server->reading_clients = client;
+    }
+}
+
+/* Reads what is available, a complete request leaves the event loop for the pool */
+static void daemon_read_request(struct daemon_client* client, struct daemon_server* server)
+{
+    output_buffer_t* request = &client->client_request;
+    char read_buffer[4096];
+    ssize_t read_size;
+
+    while ((read_size = read(client->client_fd, read_buffer, sizeof(read_buffer))) > 0)
+    {
+        outbuf_append(read_buffer, (size_t)read_size, request);
+    }
+    bool client_closed = read_size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+
+    uint32_t request_header[2] = { 0, 0 };
+    if (outbuf_length(request) >= sizeof(request_header))
+    {
+        memcpy(request_header, request->buffer_data, sizeof(request_header));
+    }
+    size_t request_size = sizeof(request_header) + request_header[1];
+
+    bool request_invalid = request->buffer_failed || outbuf_length(request) > DAEMON_REQUEST_MAX ||
+        (outbuf_length(request) >= sizeof(request_header) && (request_header[0] != DAEMON_REQUEST_MAGIC ||
+        request_size > DAEMON_REQUEST_MAX || outbuf_length(request) > request_size));
+    bool request_complete = request_invalid == false && outbuf_length(request) >= sizeof(request_header) && outbuf_length(request) == request_size &&
+        request_header[1] != 0 && request->buffer_data[request_size - 1] == '\0';
+
+    if (request_complete == false && request_invalid == false && client_closed == false)
+    {
+        return;
+    }
+
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, client->client_fd, NULL);
+    daemon_unlink_client(client, server);
+
+    if (request_complete == false)
+    {
+        daemon_client_free(client);
+        return;
+    }
+
+    /* The request task writes the frames with blocking sends */
+    fcntl(client->client_fd, F_SETFL, fcntl(client->client_fd, F_GETFL) & ~O_NONBLOCK);
+    if (tpool_group_execute(daemon_request_task, client, &server->requests_group, server->droidcat_ctx->main_thread_pool) == false)
+    {
+        daemon_client_free(client);
+    }
+}
+
+/* SIGHUP swaps the settings snapshot, the running requests keep what they have read */
+static bool daemon_handle_signal(struct daemon_server* server)
+{
+    struct signalfd_siginfo signal_info;
+
+    if (read(server->signal_fd, &signal_info, sizeof(signal_info)) != sizeof(signal_info))
+    {
+        return true;
+    }
+    if (signal_info.ssi_signo != SIGHUP)
+    {
+        return false;
+    }
+
+    droidcat_args_t* main_args = server->droidcat_ctx->main_args;
+    const char* settings_file = main_args->settings_file != NULL ? main_args->settings_file : SETTINGS_DEFAULT_FILE;
+    settings_error_t settings_error;
+
+    if (settings_load(settings_file, &settings_error, server->droidcat_ctx->main_settings) == false)
+    {
+        fprintf(stderr, "%s:%zu: %s, keeping the current settings\n", settings_file, settings_error.error_line, settings_error.error_message);
+        elog_write(server->droidcat_ctx->main_log, ELOG_WARN, "daemon", "%s:%zu: %s, keeping the current settings", settings_file,
+            settings_error.error_line, settings_error.error_message);
+        return true;
+    }
+
+    /* The level follows the settings, the log file stays the one opened at startup */
+    size_t settings_epoch;
+    const settings_t* settings = settings_acquire(&settings_epoch, server->droidcat_ctx->main_settings);
+    enum elog_level log_level;
+
+    if (server->droidcat_ctx->main_log != NULL && elog_parse_level(settings->log_level, &log_level))
+    {
+        elog_set_level(log_level, server->droidcat_ctx->main_log);
+    }
+    elog_write(server->droidcat_ctx->main_log, ELOG_INFO, "daemon", "settings reloaded from %s, generation %llu", settings_file,
+        (unsigned long long)settings->settings_generation);
+    settings_release(settings_epoch, server->droidcat_ctx->main_settings);
+
+    return true;
+}
+
+static bool daemon_listen(const char* socket_path, struct daemon_server* server)
+{
+    struct sockaddr_un address;
+    if (daemon_address(socket_path, &address) == false)
+    {
+        fprintf(stderr, "The socket path %s is too long\n", socket_path);
+        return false;
+    }
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0)
+    {
+        return false;
+    }
+
+    /* A socket file without a daemon behind is a leftover from a crash */
+    if (connect(server->listen_fd, (struct sockaddr*)&address, sizeof(address)) == 0)
+    {
+        fprintf(stderr, "A daemon is already listening at %s\n", socket_path);
+        return false;
+    }
+    close(server->listen_fd);
+    unlink(socket_path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    mode_t old_mask = umask(0077);
+    bool listen_ret = server->listen_fd >= 0 && bind(server->listen_fd, (struct sockaddr*)&address, sizeof(address)) == 0 &&
+        listen(server->listen_fd, SOMAXCONN) == 0;
+    umask(old_mask);
+
+    if (listen_ret == false)
+    {
+        fprintf(stderr, "Can't listen at %s: %s\n", socket_path, strerror(errno));
+    }
+    return listen_ret;
+}
+
+bool daemon_serve(const char* socket_path, droidcat_ctx_t* droidcat_ctx)
+{
+    struct daemon_server server = { .droidcat_ctx = droidcat_ctx, .listen_fd = -1, .epoll_fd = -1, .signal_fd = -1 };
+    sigset_t signal_set;
+
+    daemon_signal_set(&signal_set);
+    tpool_group_init(&server.requests_group);
+
+    bool serve_ret = daemon_listen(socket_path, &server);
+    if (serve_ret)
+    {
+        server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        server.signal_fd = signalfd(-1, &signal_set, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        /* The listen and signal events are told apart by their pointers */
+        struct epoll_event listen_event = { .events = EPOLLIN, .data.ptr = &server.listen_fd };
+        struct epoll_event signal_event = { .events = EPOLLIN, .data.ptr = &server.signal_fd };
+
+        serve_ret = server.epoll_fd >= 0 && server.signal_fd >= 0 &&
+            epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event) == 0 &&
+            epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.signal_fd, &signal_event) == 0;
+    }
+
+    if (serve_ret)
+    {
+        fprintf(stderr, "droidcat: serving at %s\n", socket_path);
+    }
+
+    for (bool serve_running = serve_ret; serve_running; )
+    {
+        struct epoll_event events[DAEMON_EVENTS_MAX];
+        int events_count = epoll_wait(server.epoll_fd, events, DAEMON_EVENTS_MAX, -1);
+
+        if (events_count < 0 && errno != EINTR)
+        {
+            serve_ret = false;
+            break;
+        }
+
+        for (int event_cur = 0; event_cur < events_count; event_cur++)
+        {
+            void* event_source = events[event_cur].data.ptr;
+
+            if (event_source == &server.listen_fd)
+            {
+                daemon_accept(&server);
+            }
+            else if (event_source == &server.signal_fd)
+            {
+                serve_running &= daemon_handle_signal(&server);
+            }
+            else
+            {
+                daemon_read_request((struct daemon_client*)event_source, &server);
+            }
+        }
+    }
+
+    if (server.listen_fd >= 0)
+    {
+        close(server.listen_fd);
+        unlink(socket_path);
+    }
+    while (server.reading_clients != NULL)
+    {
+        struct daemon_client* client = server.reading_clients;
+        daemon_unlink_client(client, &server);
+        daemon_client_free(client);
+    }
+
+    /* The accepted requests are finished before leaving */
+    tpool_group_wait(&server.requests_group, droidcat_ctx->main_thread_pool);
+    tpool_group_destroy(&server.requests_group);
+
+    if (server.signal_fd >= 0)
+    {
+        close(server.signal_fd);
+    }
+    if (server.epoll_fd >= 0)
+    {
+        close(server.epoll_fd);
+    }
+
+    return serve_ret;
+}
+
+bool daemon_forward(int argc, char** argv, const char* socket_path, int* exit_code)
+{
+    struct sockaddr_un address;
+    int socket_fd = daemon_address(socket_path, &address) ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+
+    if (socket_fd < 0)
+    {
+        return false;
+    }
+    if (connect(socket_fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(socket_fd);
+        return false;
+    }
+
+    /* The directory and the arguments are sent only to a daemon of the same user, anyone can
+     * create the socket of /tmp before him
+    */
+    struct ucred peer_cred;
+    socklen_t cred_size = sizeof(peer_cred);
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_PEERCRED, &peer_cred, &cred_size) != 0 || peer_cred.uid != getuid())
+    {
+        fprintf(stderr, "droidcat: %s isn't served by this user, running without the daemon\n", socket_path);
+        close(socket_fd);
+        return false;
+    }
+
+    output_buffer_t request;
+    char client_cwd[4096];
+    uint32_t request_header[2] = { DAEMON_REQUEST_MAGIC, 0 };
+
+    outbuf_init(0, NULL, NULL, &request);
+    outbuf_append(request_header, sizeof(request_header), &request);
+    if (getcwd(client_cwd, sizeof(client_cwd)) == NULL)
+    {
+        strcpy(client_cwd, "/");
+    }
+    outbuf_append(client_cwd, strlen(client_cwd) + 1, &request);
+    for (int arg_cur = 0; arg_cur < argc; arg_cur++)
+    {
+        outbuf_append(argv[arg_cur], strlen(argv[arg_cur]) + 1, &request);
+    }
+
+    request_header[1] = (uint32_t)(outbuf_length(&request) - sizeof(request_header));
+    bool forward_ret = request.buffer_failed == false;
+    if (forward_ret)
+    {
+        memcpy(request.buffer_data, request_header, sizeof(request_header));
+        forward_ret = daemon_write_all(socket_fd, request.buffer_data, outbuf_length(&request));
+    }
+    outbuf_deinit(&request);
+
+    /* The daemon has accepted the connection, from here the result is its result */
+    *exit_code = 1;
+    char* frame_data = malloc(DAEMON_FRAME_SIZE);
+
+    while (forward_ret && frame_data != NULL)
+    {
+        uint8_t frame_header[5];
+        if (daemon_read_all(socket_fd, frame_header, sizeof(frame_header)) == false)
+        {
+            fprintf(stderr, "droidcat: the daemon has closed the connection\n");
+            break;
+        }
+
+        size_t frame_size = frame_header[1] | (size_t)frame_header[2] << 8 | (size_t)frame_header[3] << 16 | (size_t)frame_header[4] << 24;
+        if (frame_size > DAEMON_FRAME_SIZE || daemon_read_all(socket_fd, frame_data, frame_size) == false)
+        {
+            break;
+        }
+
+        if (frame_header[0] == DAEMON_FRAME_EXIT && frame_size == 4)
+        {
+            const uint8_t* exit_data = (const uint8_t*)frame_data;
+            *exit_code = (int)((uint32_t)exit_data[0] | (uint32_t)exit_data[1] << 8 | (uint32_t)exit_data[2] << 16 | (uint32_t)exit_data[3] << 24);
+            break;
+        }
+        fwrite(frame_data, 1, frame_size, frame_header[0] == DAEMON_FRAME_ERROR ? stderr : stdout);
+    }
+
+    free((void*)frame_data);
+    close(socket_fd);
+    fflush(stdout);
+
+    return true;
+}
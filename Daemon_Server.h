@@ -0,0 +1,24 @@
+#ifndef DAEMON_SERVER_H
+#define DAEMON_SERVER_H
+
+#include "Core_Context.h"
+
+/* The socket path when -socket isn't used: $XDG_RUNTIME_DIR/droidcat.sock or /tmp/droidcat-<uid>.sock */
+void daemon_socket_path(char* socket_path, size_t path_size);
+
+/* Must be called before the pool threads are created, the daemon receives SIGINT, SIGTERM
+ * (stop) and SIGHUP (reload the settings) from its event loop only
+*/
+bool daemon_block_signals(void);
+
+/* -daemon: serves the clients until a stop signal, each request is a command line that runs
+ * as a task in the main pool, with the shared decode cache, script cache and settings
+*/
+bool daemon_serve(const char* socket_path, droidcat_ctx_t* droidcat_ctx);
+
+/* Client side: forwards the command line to a running daemon and prints what it streams
+ * back, false without a daemon listening (the command line runs locally)
+*/
+bool daemon_forward(int argc, char** argv, const char* socket_path, int* exit_code);
+
+#endif
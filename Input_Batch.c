@@ -0,0 +1,1669 @@
+#include <malloc.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Input_Batch.h"
+#include "Script_Host.h"
+#include "Package_Build.h"
+#include "data/Content_Hash.h"
+#include "data/Memory_Arena.h"
+#include "decode/Binary_XML.h"
+#include "decode/Dex_Listing.h"
+#include "decode/Resource_Table.h"
+#include "decode/Resource_Value.h"
+#include "vfs/Output_File.h"
+#include "sign/Apk_Signature.h"
+#include "zip/Zip_Stream.h"
+#include "cpu/CPU_Time.h"
+#include "cpu/Sample_Profiler.h"
+
+#define BATCH_PATH_MAX 4096
+#define BATCH_DEDUP_STRIPES 64
+/* Entries submitted by worker at each wave */
+#define BATCH_WAVE_BY_WORKER 16
+#define BATCH_COPY_PIECE (64 * 1024)
+#define BATCH_OUTPUT_BUFFER (64 * 1024)
+/* Bigger DEX files aren't inflated for their class names */
+#define BATCH_DEX_INDEX_MAX (256 * 1024 * 1024)
+/* Streamed resources are kept whole for the decoders up to this size */
+#define BATCH_STREAM_DECODE_MAX (32 * 1024 * 1024)
+
+/* Bigger entries are inflated into the heap, the scratch memory of a worker would keep them */
+#define BATCH_SCRATCH_MAX (4 * 1024 * 1024)
+
+/* Two entries may be the same when all these fields matches, the hash is computed over
+ * the stored bytes, so we never inflate an entry just for compare it. The hash isn't
+ * collision resistant, a match is confirmed by comparing the stored bytes
+*/
+struct batch_key
+{
+    uint64_t content_hash;
+
+    uint64_t uncompressed_size;
+
+    uint64_t compressed_size;
+
+    uint32_t entry_crc32;
+
+    uint16_t compression_method;
+
+    /* The same bytes under a decoded name and a raw one have different outputs */
+    uint16_t decode_kind;
+};
+
+struct batch_slot
+{
+    struct batch_key slot_key;
+
+    bool slot_used;
+
+    batch_input_t* owner_input;
+
+    const zip_entry_t* owner_entry;
+};
+
+struct batch_stripe
+{
+    pthread_mutex_t stripe_lock;
+
+    struct batch_slot* slots;
+
+    size_t slots_mask;
+
+    size_t slots_used;
+};
+
+struct batch_duplicate
+{
+    batch_input_t* dup_input;
+
+    const zip_entry_t* dup_entry;
+
+    batch_input_t* owner_input;
+
+    const zip_entry_t* owner_entry;
+
+    struct batch_duplicate* dup_next;
+};
+
+struct input_batch
+{
+    droidcat_ctx_t* droidcat_ctx;
+
+    batch_input_t* inputs;
+
+    size_t inputs_count;
+
+    struct batch_stripe dedup_stripes[BATCH_DEDUP_STRIPES];
+
+    /* Pushed by the workers, resolved after all unique entries has been written */
+    _Atomic(struct batch_duplicate*) duplicates;
+
+    bool decode_resources;
+
+    const char* output_root;
+
+    /* From the settings when the command line has no output */
+    char default_output[SETTINGS_STRING_MAX];
+
+    /* The decoded UTF-16 strings of all inputs, the same resource names are converted once */
+    intern_table_t* shared_strings;
+};
+
+struct batch_entry_task
+{
+    struct input_batch* batch;
+
+    batch_input_t* input;
+
+    const zip_entry_t* entry;
+};
+
+static bool batch_setting_enabled(const char* decode_settings, const char* setting_name)
+{
+    size_t name_length = strlen(setting_name);
+
+    for (const char* setting = decode_settings; setting != NULL && *setting != '\0'; )
+    {
+        while (*setting == ' ' || *setting == ',') setting++;
+
+        if (strncmp(setting, setting_name, name_length) == 0 && setting[name_length] == '=')
+        {
+            return strncmp(setting + name_length + 1, "yes", 3) == 0;
+        }
+        setting = strchr(setting, ',');
+    }
+    return false;
+}
+
+/* Rejects names that could escape from the output directory */
+static bool batch_name_safe(const char* entry_name)
+{
+    if (entry_name[0] == '/' || entry_name[0] == '\0')
+    {
+        return false;
+    }
+
+    for (const char* component = entry_name; component != NULL; )
+    {
+        if (component[0] == '.' && component[1] == '.' && (component[2] == '/' || component[2] == '\0'))
+        {
+            return false;
+        }
+        component = strchr(component, '/');
+        if (component != NULL) component++;
+    }
+    return true;
+}
+
+static bool batch_output_path(const struct input_batch* batch, const batch_input_t* input, const char* entry_name, 
+    const char* suffix, char* path, size_t path_size)
+{
+    int path_length = snprintf(path, path_size, "%s%s%s/%s%s", 
+        batch->output_root != NULL ? batch->output_root : "", 
+        batch->output_root != NULL ? "/" : "",
+        input->input_name, entry_name, suffix != NULL ? suffix : "");
+
+    return path_length > 0 && (size_t)path_length < path_size;
+}
+
+static struct batch_stripe* batch_stripe_of(const struct batch_key* key, struct input_batch* batch)
+{
+    return &batch->dedup_stripes[key->content_hash % BATCH_DEDUP_STRIPES];
+}
+
+/* The stripe index used the low bits, the slot index uses the high ones */
+static size_t batch_slot_first(const struct batch_key* key, size_t slots_mask)
+{
+    return (size_t)(key->content_hash >> 32) & slots_mask;
+}
+
+/* Doubles the slots of a stripe, called with the stripe locked */
+static bool batch_stripe_grow(struct batch_stripe* stripe)
+{
+    size_t old_capacity = stripe->slots_mask + 1;
+    struct batch_slot* new_slots = calloc(old_capacity * 2, sizeof(struct batch_slot));
+    if (new_slots == NULL)
+    {
+        return false;
+    }
+
+    size_t new_mask = old_capacity * 2 - 1;
+    for (size_t slot_cur = 0; slot_cur < old_capacity; slot_cur++)
+    {
+        const struct batch_slot* old_slot = &stripe->slots[slot_cur];
+        if (old_slot->slot_used == false)
+        {
+            continue;
+        }
+
+        size_t slot_index = batch_slot_first(&old_slot->slot_key, new_mask);
+        while (new_slots[slot_index].slot_used)
+        {
+            slot_index = (slot_index + 1) & new_mask;
+        }
+        new_slots[slot_index] = *old_slot;
+    }
+
+    free((void*)stripe->slots);
+    stripe->slots = new_slots;
+    stripe->slots_mask = new_mask;
+
+    return true;
+}
+
+/* Gives in `found_slot` the slot that already has the key or stores the key as owned by the
+ * caller, `owner_found` is set when another entry was there first. Fails when the stripe is
+ * full and can't grow, the entry is then unpacked as unique
+*/
+static bool batch_dedup_claim(const struct batch_key* key, batch_input_t* input, const zip_entry_t* entry, 
+    bool* owner_found, struct batch_slot* found_slot, struct input_batch* batch)
+{
+    struct batch_stripe* stripe = batch_stripe_of(key, batch);
+    
+    pthread_mutex_lock(&stripe->stripe_lock);
+
+    /* Kept at most half full, the probe below always reaches a free slot. All the entries
+     * may have hashes of the same stripe, this one grows instead of being sized for them all
+    */
+    if ((stripe->slots_used + 1) * 2 > stripe->slots_mask + 1 && batch_stripe_grow(stripe) == false)
+    {
+        pthread_mutex_unlock(&stripe->stripe_lock);
+        return false;
+    }
+    
+    size_t slot_index = batch_slot_first(key, stripe->slots_mask);
+    struct batch_slot* slot;
+
+    for (;;)
+    {
+        slot = &stripe->slots[slot_index];
+        if (slot->slot_used == false || memcmp(&slot->slot_key, key, sizeof(*key)) == 0)
+        {
+            break;
+        }
+        slot_index = (slot_index + 1) & stripe->slots_mask;
+    }
+
+    *owner_found = slot->slot_used;
+    if (slot->slot_used == false)
+    {
+        slot->slot_key = *key;
+        slot->slot_used = true;
+        slot->owner_input = input;
+        slot->owner_entry = entry;
+        stripe->slots_used++;
+    }
+    *found_slot = *slot;
+
+    pthread_mutex_unlock(&stripe->stripe_lock);
+
+    return true;
+}
+
+static bool batch_dedup_init(size_t entries_total, struct input_batch* batch)
+{
+    /* Sized for the entries spread over the stripes at half load, a stripe that gets more grows */
+    size_t stripe_capacity = 16;
+    while (stripe_capacity < (entries_total * 2) / BATCH_DEDUP_STRIPES + 16)
+    {
+        stripe_capacity *= 2;
+    }
+
+    for (size_t stripe_cur = 0; stripe_cur < BATCH_DEDUP_STRIPES; stripe_cur++)
+    {
+        struct batch_stripe* stripe = &batch->dedup_stripes[stripe_cur];
+
+        pthread_mutex_init(&stripe->stripe_lock, NULL);
+        stripe->slots = calloc(stripe_capacity, sizeof(struct batch_slot));
+        stripe->slots_mask = stripe_capacity - 1;
+        stripe->slots_used = 0;
+
+        if (stripe->slots == NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void batch_dedup_deinit(struct input_batch* batch)
+{
+    for (size_t stripe_cur = 0; stripe_cur < BATCH_DEDUP_STRIPES; stripe_cur++)
+    {
+        struct batch_stripe* stripe = &batch->dedup_stripes[stripe_cur];
+        
+        if (stripe->slots != NULL)
+        {
+            free((void*)stripe->slots);
+        }
+        pthread_mutex_destroy(&stripe->stripe_lock);
+    }
+}
+
+static bool batch_is_decodable_xml(const char* entry_name)
+{
+    size_t name_length = strlen(entry_name);
+
+    if (strcmp(entry_name, "AndroidManifest.xml") == 0)
+    {
+        return true;
+    }
+    return strncmp(entry_name, "res/", 4) == 0 && name_length > 4 && strcmp(entry_name + name_length - 4, ".xml") == 0;
+}
+
+static bool batch_is_decoded(const char* entry_name, const struct input_batch* batch)
+{
+    return batch->decode_resources && (strcmp(entry_name, "resources.arsc") == 0 || batch_is_decodable_xml(entry_name));
+}
+
+/* 0 for a raw entry, 1 when the decoded text replaces it, 2 for the table and his side file */
+static uint16_t batch_decode_kind(const char* entry_name, const struct input_batch* batch)
+{
+    if (batch_is_decoded(entry_name, batch) == false)
+    {
+        return 0;
+    }
+    return strcmp(entry_name, "resources.arsc") == 0 ? 2 : 1;
+}
+
+/* For -progress-mode, each worker counts into his own shard */
+static void batch_progress(enum progress_stage stage, const zip_entry_t* entry, const struct input_batch* batch)
+{
+    progress_t* progress = batch->droidcat_ctx->main_progress;
+
+    progress_add(stage, PROGRESS_ENTRIES, 1, progress);
+    progress_add(stage, PROGRESS_BYTES, entry->uncompressed_size, progress);
+}
+
+/* A decoder output goes to the output file and, when the cache is used, also into the cache */
+struct batch_decode_output
+{
+    output_file_t* decode_file;
+
+    dcache_store_t* cache_store;
+};
+
+static bool batch_decode_flush(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    struct batch_decode_output* decode_output = (struct batch_decode_output*)flush_context;
+
+    if (decode_output->cache_store != NULL)
+    {
+        dcache_store_append(flush_data, flush_size, decode_output->cache_store);
+    }
+    return outfile_write((const uint8_t*)flush_data, flush_size, decode_output->decode_file);
+}
+
+static bool batch_write_cached(const uint8_t* cached_data, size_t cached_size, char* output_path, struct input_batch* batch)
+{
+    output_file_t output_file;
+
+    if (outfile_create(output_path, batch->droidcat_ctx->output_tree, &output_file) == false)
+    {
+        return false;
+    }
+    bool write_ret = outfile_write(cached_data, cached_size, &output_file);
+
+    return outfile_close(&output_file) && write_ret;
+}
+
+/* Writes the text of a binary XML or of the resource table into `output_path` */
+static bool batch_decode_data(const uint8_t* entry_data, size_t entry_size, bool is_table, char* output_path, dcache_store_t* store,
+    struct input_batch* batch)
+{
+    output_file_t output_file;
+    struct batch_decode_output decode_output = { .decode_file = &output_file, .cache_store = store };
+    output_buffer_t decoded_output;
+    bool decode_ret = false;
+
+    if (outfile_create(output_path, batch->droidcat_ctx->output_tree, &output_file))
+    {
+        outbuf_init(BATCH_OUTPUT_BUFFER, batch_decode_flush, &decode_output, &decoded_output);
+        
+        if (is_table)
+        {
+            CPU_TIMER_SCOPE(cpu_time_local(CPU_TIME_DECODE_TABLE));
+            PROF_STAGE_SCOPE("decode-table");
+            decode_ret = arsc_decode(entry_data, entry_size, batch->shared_strings, &decoded_output, batch->droidcat_ctx->main_thread_pool);
+        }
+        else
+        {
+            CPU_TIMER_SCOPE(cpu_time_local(CPU_TIME_DECODE_XML));
+            PROF_STAGE_SCOPE("decode-xml");
+            decode_ret = axml_decode(entry_data, entry_size, batch->shared_strings, &decoded_output);
+        }
+
+        decode_ret &= outbuf_flush(&decoded_output);
+        outbuf_deinit(&decoded_output);
+        decode_ret &= outfile_close(&output_file);
+    }
+    return decode_ret;
+}
+
+/* A whole inflated entry, on a worker it's taken from his scratch memory (local to his NUMA
+ * node, and reused by the next entries) rather than the heap
+*/
+struct batch_buffer
+{
+    uint8_t* buffer_data;
+
+    memory_arena_t* buffer_scratch;
+
+    arena_mark_t scratch_mark;
+};
+
+static uint8_t* batch_buffer_take(size_t buffer_size, struct batch_buffer* buffer)
+{
+    buffer->buffer_scratch = buffer_size <= BATCH_SCRATCH_MAX ? arena_scratch() : NULL;
+    buffer->buffer_data = NULL;
+
+    if (buffer->buffer_scratch != NULL)
+    {
+        buffer->scratch_mark = arena_mark(buffer->buffer_scratch);
+        buffer->buffer_data = (uint8_t*)arena_alloc(buffer_size, buffer->buffer_scratch);
+    }
+    if (buffer->buffer_data == NULL)
+    {
+        buffer->buffer_scratch = NULL;
+        buffer->buffer_data = (uint8_t*)malloc(buffer_size);
+    }
+    return buffer->buffer_data;
+}
+
+static void batch_buffer_release(struct batch_buffer* buffer)
+{
+    if (buffer->buffer_scratch != NULL)
+    {
+        arena_rewind_to(buffer->scratch_mark, buffer->buffer_scratch);
+    }
+    else
+    {
+        free((void*)buffer->buffer_data);
+    }
+    buffer->buffer_data = NULL;
+}
+
+/* Inflates the entry entirely and writes the decoded text, returns false when the entry 
+ * isn't in the binary format, in this case nothing has been written.
+ * With the decode cache, unchanged entries are neither inflated nor decoded
+*/
+static bool batch_decode_entry(const zip_entry_t* entry, char* output_path, struct batch_entry_task* entry_task, bool* decode_failed)
+{
+    struct input_batch* batch = entry_task->batch;
+    decode_cache_t* decode_cache = batch->droidcat_ctx->decode_cache;
+    const zip_archive_t* archive = &entry_task->input->input_archive;
+    bool is_table = strcmp(entry->entry_name, "resources.arsc") == 0;
+
+    *decode_failed = false;
+
+    if (batch_is_decoded(entry->entry_name, batch) == false)
+    {
+        return false;
+    }
+
+    char decoded_path[BATCH_PATH_MAX];
+
+    /* The table is kept as is, his text goes into a side file */
+    if (is_table)
+    {
+        if (batch_output_path(batch, entry_task->input, entry->entry_name, ".xml", decoded_path, sizeof(decoded_path)) == false)
+        {
+            *decode_failed = true;
+            return false;
+        }
+        output_path = decoded_path;
+    }
+
+    dcache_store_t cache_store;
+    dcache_store_t* store = NULL;
+
+    if (decode_cache != NULL)
+    {
+        const char* decode_settings = batch->droidcat_ctx->main_args->decode_settings;
+        char key_context[BATCH_PATH_MAX];
+        dcache_key_t cache_key;
+        const uint8_t* cached_data;
+        size_t cached_size;
+
+        snprintf(key_context, sizeof(key_context), "%s:%d:%s:%u:%08x:%llu", is_table ? "arsc" : "axml", RES_DECODER_VERSION,
+            decode_settings != NULL ? decode_settings : "", entry->compression_method, entry->entry_crc32, 
+            (unsigned long long)entry->uncompressed_size);
+        dcache_make_key(zip_entry_raw(entry, archive), entry->compressed_size, key_context, &cache_key);
+
+        if (dcache_lookup(&cache_key, &cached_data, &cached_size, decode_cache))
+        {
+            /* An empty output marks a text XML */
+            if (cached_size == 0)
+            {
+                return false;
+            }
+            *decode_failed = !batch_write_cached(cached_data, cached_size, output_path, batch);
+            return is_table == false;
+        }
+
+        dcache_store_begin(&cache_key, &cache_store, decode_cache);
+        store = &cache_store;
+    }
+
+    struct batch_buffer entry_buffer;
+    uint8_t* entry_data = batch_buffer_take(entry->uncompressed_size + 1, &entry_buffer);
+    cpu_timer_t inflate_timer = cpu_timer_start(cpu_time_local(CPU_TIME_INFLATE));
+    const char* previous_stage = prof_stage("inflate");
+    bool entry_inflated = entry_data != NULL && zip_entry_inflate(entry, entry_data, archive);
+
+    prof_stage(previous_stage);
+    cpu_timer_stop(&inflate_timer);
+    if (entry_inflated == false)
+    {
+        batch_buffer_release(&entry_buffer);
+        if (store != NULL)
+        {
+            dcache_store_abort(store);
+        }
+        *decode_failed = true;
+        return is_table == false;
+    }
+
+    /* Text XML files are copied as they're */
+    if (is_table == false && (entry->uncompressed_size < 8 || entry_data[0] != 0x03 || entry_data[1] != 0x00))
+    {
+        batch_buffer_release(&entry_buffer);
+        if (store != NULL)
+        {
+            dcache_store_commit(store, decode_cache);
+        }
+        return false;
+    }
+
+    bool decode_ret = batch_decode_data(entry_data, entry->uncompressed_size, is_table, output_path, store, batch);
+    batch_buffer_release(&entry_buffer);
+
+    if (store != NULL && decode_ret)
+    {
+        dcache_store_commit(store, decode_cache);
+    }
+    else if (store != NULL)
+    {
+        dcache_store_abort(store);
+    }
+
+    *decode_failed = !decode_ret;
+
+    /* The raw table must still be unpacked */
+    return is_table == false;
+}
+
+static void* batch_entry_task(void* task_data)
+{
+    struct batch_entry_task* entry_task = (struct batch_entry_task*)task_data;
+    struct input_batch* batch = entry_task->batch;
+    batch_input_t* input = entry_task->input;
+    const zip_entry_t* entry = entry_task->entry;
+    char output_path[BATCH_PATH_MAX];
+
+    bool entry_ok = false;
+
+    if (batch_name_safe(entry->entry_name) == false || 
+        batch_output_path(batch, input, entry->entry_name, NULL, output_path, sizeof(output_path)) == false)
+    {
+        goto entry_finished;
+    }
+
+    if (zip_entry_is_dir(entry))
+    {
+        entry_ok = batch->droidcat_ctx->output_tree != NULL || outfile_make_parents(output_path);
+        goto entry_finished;
+    }
+
+    const uint8_t* raw_data = zip_entry_raw(entry, &input->input_archive);
+    if (raw_data == NULL)
+    {
+        goto entry_finished;
+    }
+
+    struct batch_key entry_key = {
+        .content_hash = hash_content64(raw_data, entry->compressed_size, entry->compression_method),
+        .uncompressed_size = entry->uncompressed_size,
+        .compressed_size = entry->compressed_size,
+        .entry_crc32 = entry->entry_crc32,
+        .compression_method = entry->compression_method,
+        .decode_kind = batch_decode_kind(entry->entry_name, batch)
+    };
+
+    bool owner_found = false;
+    struct batch_slot owner_slot;
+    /* Without a slot the entry is unpacked as unique */
+    bool entry_claimed = batch_dedup_claim(&entry_key, input, entry, &owner_found, &owner_slot, batch);
+
+    /* The bytes come from the inputs, a crafted collision must not take the output of another entry */
+    if (entry_claimed && owner_found)
+    {
+        const uint8_t* owner_data = zip_entry_raw(owner_slot.owner_entry, &owner_slot.owner_input->input_archive);
+        owner_found = owner_data != NULL && memcmp(owner_data, raw_data, entry->compressed_size) == 0;
+    }
+
+    if (entry_claimed && owner_found)
+    {
+        struct batch_duplicate* duplicate = malloc(sizeof(*duplicate));
+        if (duplicate == NULL)
+        {
+            goto entry_finished;
+        }
+
+        duplicate->dup_input = input;
+        duplicate->dup_entry = entry;
+        duplicate->owner_input = owner_slot.owner_input;
+        duplicate->owner_entry = owner_slot.owner_entry;
+        duplicate->dup_next = atomic_load(&batch->duplicates);
+        while (!atomic_compare_exchange_weak(&batch->duplicates, &duplicate->dup_next, duplicate));
+
+        /* Counted as done when the copy is made */
+        return NULL;
+    }
+
+    bool decode_failed;
+    bool decode_only = batch_decode_entry(entry, output_path, entry_task, &decode_failed);
+
+    if (decode_failed == false && batch_is_decoded(entry->entry_name, batch))
+    {
+        batch_progress(PROGRESS_DECODE, entry, batch);
+    }
+    if (decode_only)
+    {
+        entry_ok = !decode_failed;
+        goto entry_finished;
+    }
+
+    output_file_t output_file;
+    if (outfile_create(output_path, batch->droidcat_ctx->output_tree, &output_file))
+    {
+        CPU_TIMER_SCOPE(cpu_time_local(CPU_TIME_UNPACK));
+        PROF_STAGE_SCOPE("unpack");
+
+        entry_ok = zip_entry_stream(entry, outfile_write, &output_file, &input->input_archive);
+        entry_ok &= outfile_close(&output_file);
+    }
+    /* The side output of the table failed */
+    entry_ok &= !decode_failed;
+
+entry_finished:
+    if (entry_ok == false)
+    {
+        input->entries_failed++;
+        elog_write(batch->droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: %s can't be extracted", input->input_path, entry->entry_name);
+    }
+    else
+    {
+        elog_write(batch->droidcat_ctx->main_log, ELOG_TRACE, "batch", "%s: %s extracted", input->input_path, entry->entry_name);
+    }
+    input->bytes_done += entry->uncompressed_size;
+    input->entries_done++;
+    batch_progress(PROGRESS_UNPACK, entry, batch);
+
+    return NULL;
+}
+
+static bool batch_materialize_file(const char* owner_path, char* dup_path, struct input_batch* batch)
+{
+    /* The same output already, unlinking it would remove the owner's file */
+    if (strcmp(owner_path, dup_path) == 0)
+    {
+        return true;
+    }
+
+    memfs_t* output_tree = batch->droidcat_ctx->output_tree;
+    if (output_tree != NULL)
+    {
+        /* The chunks are shared, no byte is copied */
+        return memfs_copy(owner_path, dup_path, output_tree);
+    }
+
+    if (outfile_make_parents(dup_path) == false)
+    {
+        return false;
+    }
+
+    unlink(dup_path);
+    if (link(owner_path, dup_path) == 0)
+    {
+        return true;
+    }
+
+    /* Hard links can't cross filesystems, copying the content */
+    int source_fd = open(owner_path, O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0)
+    {
+        return false;
+    }
+
+    output_file_t output_file;
+    bool copy_ret = outfile_create(dup_path, batch->droidcat_ctx->output_tree, &output_file);
+    uint8_t copy_piece[BATCH_COPY_PIECE];
+    ssize_t read_size;
+
+    while (copy_ret && (read_size = read(source_fd, copy_piece, sizeof(copy_piece))) > 0)
+    {
+        copy_ret = outfile_write(copy_piece, (size_t)read_size, &output_file);
+    }
+
+    close(source_fd);
+    return outfile_close(&output_file) && copy_ret;
+}
+
+/* Makes the output of a duplicated entry from the output of his first occurrence, the side
+ * file of the table too, both have the same decode kind
+*/
+static bool batch_materialize(struct batch_duplicate* duplicate, struct input_batch* batch)
+{
+    const char* const side_extensions[2] = { NULL, ".xml" };
+    size_t outputs_count = batch_decode_kind(duplicate->dup_entry->entry_name, batch) == 2 ? 2 : 1;
+
+    if (batch_name_safe(duplicate->dup_entry->entry_name) == false)
+    {
+        return false;
+    }
+
+    for (size_t output_cur = 0; output_cur < outputs_count; output_cur++)
+    {
+        char owner_path[BATCH_PATH_MAX];
+        char dup_path[BATCH_PATH_MAX];
+        const char* extension = side_extensions[output_cur];
+
+        if (batch_output_path(batch, duplicate->owner_input, duplicate->owner_entry->entry_name, extension, owner_path, sizeof(owner_path)) == false ||
+            batch_output_path(batch, duplicate->dup_input, duplicate->dup_entry->entry_name, extension, dup_path, sizeof(dup_path)) == false ||
+            batch_materialize_file(owner_path, dup_path, batch) == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void* batch_duplicate_task(void* task_data)
+{
+    struct batch_entry_task* entry_task = (struct batch_entry_task*)task_data;
+    struct batch_duplicate* duplicate = (struct batch_duplicate*)entry_task->entry;
+
+    batch_input_t* input = duplicate->dup_input;
+
+    if (batch_materialize(duplicate, entry_task->batch) == false)
+    {
+        input->entries_failed++;
+    }
+    else
+    {
+        if (batch_is_decoded(duplicate->dup_entry->entry_name, entry_task->batch))
+        {
+            batch_progress(PROGRESS_DECODE, duplicate->dup_entry, entry_task->batch);
+        }
+        input->entries_reused++;
+    }
+    input->bytes_done += duplicate->dup_entry->uncompressed_size;
+    input->entries_done++;
+    batch_progress(PROGRESS_UNPACK, duplicate->dup_entry, entry_task->batch);
+
+    return NULL;
+}
+
+/* The entry being streamed from a pipe, there's no archive to come back later */
+struct batch_stream
+{
+    struct input_batch* batch;
+
+    batch_input_t* input;
+
+    char output_path[BATCH_PATH_MAX];
+
+    output_file_t output_file;
+
+    bool file_opened;
+
+    bool entry_failed;
+
+    /* The whole entry, for the decoders */
+    bool entry_decoded;
+
+    output_buffer_t decode_data;
+};
+
+static bool batch_stream_begin(const zip_entry_t* entry, void* handler_data)
+{
+    struct batch_stream* stream = (struct batch_stream*)handler_data;
+    struct input_batch* batch = stream->batch;
+
+    stream->file_opened = stream->entry_decoded = false;
+    stream->entry_failed = batch_name_safe(entry->entry_name) == false ||
+        batch_output_path(batch, stream->input, entry->entry_name, NULL, stream->output_path, sizeof(stream->output_path)) == false;
+    stream->input->entries_total++;
+
+    if (stream->entry_failed)
+    {
+        return false;
+    }
+    if (zip_entry_is_dir(entry))
+    {
+        stream->entry_failed = batch->droidcat_ctx->output_tree == NULL && outfile_make_parents(stream->output_path) == false;
+        return false;
+    }
+
+    stream->file_opened = outfile_create(stream->output_path, batch->droidcat_ctx->output_tree, &stream->output_file);
+    stream->entry_failed = !stream->file_opened;
+    stream->entry_decoded = stream->file_opened && batch_is_decoded(entry->entry_name, batch) && entry->uncompressed_size <= BATCH_STREAM_DECODE_MAX;
+    outbuf_reset(&stream->decode_data);
+
+    return stream->file_opened;
+}
+
+static bool batch_stream_data(const uint8_t* data, size_t data_size, void* handler_data)
+{
+    struct batch_stream* stream = (struct batch_stream*)handler_data;
+
+    if (stream->entry_decoded)
+    {
+        stream->entry_decoded = outbuf_length(&stream->decode_data) + data_size <= BATCH_STREAM_DECODE_MAX &&
+            outbuf_append(data, data_size, &stream->decode_data);
+    }
+    stream->entry_failed = !outfile_write(data, data_size, &stream->output_file);
+
+    return !stream->entry_failed;
+}
+
+/* The raw entry is already written, the decoded text replaces it (or goes aside for the table) */
+static void batch_stream_end(const zip_entry_t* entry, bool entry_valid, void* handler_data)
+{
+    struct batch_stream* stream = (struct batch_stream*)handler_data;
+    struct input_batch* batch = stream->batch;
+    batch_input_t* input = stream->input;
+
+    if (stream->file_opened)
+    {
+        stream->entry_failed |= !outfile_close(&stream->output_file);
+    }
+    bool entry_ok = entry_valid && stream->entry_failed == false;
+
+    const uint8_t* entry_data = (const uint8_t*)stream->decode_data.buffer_data;
+    size_t entry_size = outbuf_length(&stream->decode_data);
+    bool is_table = strcmp(entry->entry_name, "resources.arsc") == 0;
+
+    if (entry_ok && stream->entry_decoded && (is_table || (entry_size >= 8 && entry_data[0] == 0x03 && entry_data[1] == 0x00)))
+    {
+        char* decoded_path = stream->output_path;
+        char table_path[BATCH_PATH_MAX];
+
+        if (is_table)
+        {
+            entry_ok = batch_output_path(batch, input, entry->entry_name, ".xml", table_path, sizeof(table_path));
+            decoded_path = table_path;
+        }
+        entry_ok = entry_ok && batch_decode_data(entry_data, entry_size, is_table, decoded_path, NULL, batch);
+        progress_expect(PROGRESS_DECODE, 1, entry->uncompressed_size, batch->droidcat_ctx->main_progress);
+        batch_progress(PROGRESS_DECODE, entry, batch);
+    }
+
+    if (entry_ok == false)
+    {
+        input->entries_failed++;
+        elog_write(batch->droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: %s can't be extracted", input->input_path, entry->entry_name);
+    }
+    input->bytes_total += entry->uncompressed_size;
+    input->bytes_done += entry->uncompressed_size;
+    input->entries_done++;
+    progress_expect(PROGRESS_UNPACK, 1, entry->uncompressed_size, batch->droidcat_ctx->main_progress);
+    batch_progress(PROGRESS_UNPACK, entry, batch);
+}
+
+/* Pipes and "-" (the standard input) are unpacked while they're read, in the calling thread */
+static void batch_stream_input(batch_input_t* input, struct input_batch* batch)
+{
+    struct batch_stream stream = { .batch = batch, .input = input };
+    zips_handler_t stream_handler = {
+        .entry_begin = batch_stream_begin,
+        .entry_data = batch_stream_data,
+        .entry_end = batch_stream_end,
+        .handler_data = &stream
+    };
+
+    int input_fd = strcmp(input->input_path, "-") == 0 ? STDIN_FILENO : open(input->input_path, O_RDONLY | O_CLOEXEC);
+    zips_report_t stream_report;
+
+    input->stream_failed = input_fd < 0 || outbuf_init(0, NULL, NULL, &stream.decode_data) == false ||
+        zips_read(input_fd, &stream_handler, &stream_report) == false;
+    input->central_mismatches = input->stream_failed ? 0 : stream_report.mismatched_count;
+
+    if (input->stream_failed)
+    {
+        elog_write(batch->droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: the stream ended before the central directory", input->input_path);
+    }
+    else if (input->central_mismatches != 0)
+    {
+        elog_write(batch->droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: %zu entries don't match the central directory", input->input_path,
+            input->central_mismatches);
+    }
+
+    outbuf_deinit(&stream.decode_data);
+    if (input_fd > STDIN_FILENO)
+    {
+        close(input_fd);
+    }
+}
+
+/* A named pipe or the standard input can't be mapped */
+static bool batch_is_stream(const char* input_path)
+{
+    struct stat input_stat;
+
+    return strcmp(input_path, "-") == 0 || (stat(input_path, &input_stat) == 0 && S_ISREG(input_stat.st_mode) == false);
+}
+
+static void batch_input_name(const char* input_path, char* input_name)
+{
+    if (strcmp(input_path, "-") == 0)
+    {
+        strcpy(input_name, "stdin");
+        return;
+    }
+
+    const char* base_name = strrchr(input_path, '/');
+    base_name = base_name != NULL ? base_name + 1 : input_path;
+
+    const char* extension = strrchr(base_name, '.');
+    size_t name_length = extension != NULL && extension != base_name ? (size_t)(extension - base_name) : strlen(base_name);
+
+    if (name_length >= BATCH_INPUT_NAME_MAX)
+    {
+        name_length = BATCH_INPUT_NAME_MAX - 1;
+    }
+    memcpy(input_name, base_name, name_length);
+    input_name[name_length] = '\0';
+}
+
+/* Inputs with the same name would write into the same directory, the later ones get their
+ * number after the name (t.apk twice gives "t" and "t-2")
+*/
+static void batch_input_unique(batch_input_t* inputs, size_t input_cur)
+{
+    char base_name[BATCH_INPUT_NAME_MAX];
+    size_t name_suffix = input_cur + 1;
+    bool name_taken = true;
+
+    memcpy(base_name, inputs[input_cur].input_name, sizeof(base_name));
+
+    while (name_taken)
+    {
+        name_taken = false;
+        for (size_t other_cur = 0; other_cur < input_cur; other_cur++)
+        {
+            if (strcmp(inputs[other_cur].input_name, inputs[input_cur].input_name) == 0)
+            {
+                name_taken = true;
+                break;
+            }
+        }
+
+        if (name_taken)
+        {
+            char suffix[24];
+            int suffix_length = snprintf(suffix, sizeof(suffix), "-%zu", name_suffix++);
+            int base_length = (int)strnlen(base_name, BATCH_INPUT_NAME_MAX - 1 - suffix_length);
+
+            snprintf(inputs[input_cur].input_name, BATCH_INPUT_NAME_MAX, "%.*s%s", base_length, base_name, suffix);
+        }
+    }
+}
+
+static const zip_entry_t* batch_entry_at(const batch_input_t* input, size_t entry_cur)
+{
+    return &input->input_archive.entries[input->selected_entries != NULL ? input->selected_entries[entry_cur] : entry_cur];
+}
+
+struct batch_classes
+{
+    index_builder_t* builder;
+
+    uint32_t entry_index;
+
+    char java_name[BATCH_PATH_MAX];
+};
+
+/* Each class is indexed as "Lcom/example/Name;" and as "com.example.Name" */
+static bool batch_index_class(const char* class_name, size_t name_length, void* class_data)
+{
+    struct batch_classes* classes = (struct batch_classes*)class_data;
+
+    if (index_builder_add(class_name, name_length, classes->entry_index, classes->builder) == false)
+    {
+        return false;
+    }
+    if (name_length < 3 || class_name[0] != 'L' || class_name[name_length - 1] != ';' || name_length - 2 >= BATCH_PATH_MAX)
+    {
+        return true;
+    }
+
+    for (size_t name_cur = 1; name_cur < name_length - 1; name_cur++)
+    {
+        classes->java_name[name_cur - 1] = class_name[name_cur] == '/' ? '.' : class_name[name_cur];
+    }
+    return index_builder_add(classes->java_name, name_length - 2, classes->entry_index, classes->builder);
+}
+
+static bool batch_select_entry(uint32_t key_index, uint32_t entry_index, void* select_data)
+{
+    (void)key_index;
+    ((uint8_t*)select_data)[entry_index] = 1;
+    return true;
+}
+
+/* Selects the entries matching -select-by-name, a class selects his DEX file */
+static bool batch_select_entries(const droidcat_args_t* main_args, batch_input_t* input)
+{
+    size_t entries_count = input->input_archive.entries_count;
+    uint8_t* entries_selected = calloc(entries_count + 1, 1);
+    uint32_t* selected_entries = malloc((entries_count + 1) * sizeof(uint32_t));
+    bool select_ret = entries_selected != NULL && selected_entries != NULL;
+
+    if (select_ret)
+    {
+        select_ret = index_query(main_args->select_name, main_args->select_mode, batch_select_entry, entries_selected, &input->input_index);
+    }
+
+    size_t selected_count = 0;
+    for (size_t entry_cur = 0; select_ret && entry_cur < entries_count; entry_cur++)
+    {
+        if (entries_selected[entry_cur])
+        {
+            selected_entries[selected_count++] = (uint32_t)entry_cur;
+        }
+    }
+
+    free((void*)entries_selected);
+    if (select_ret == false)
+    {
+        free((void*)selected_entries);
+        return false;
+    }
+    input->selected_entries = selected_entries;
+    input->entries_total = selected_count;
+
+    return true;
+}
+
+/* Built once by input, the selection and the script lookups are queries over it */
+static void* batch_index_task(void* task_data)
+{
+    struct batch_entry_task* index_task = (struct batch_entry_task*)task_data;
+    droidcat_ctx_t* droidcat_ctx = index_task->batch->droidcat_ctx;
+    batch_input_t* input = index_task->input;
+    const zip_archive_t* archive = &input->input_archive;
+    bool index_classes = droidcat_ctx->main_args->select_name != NULL;
+    index_builder_t builder;
+    bool index_ret = true;
+
+    index_builder_init(&builder);
+
+    for (size_t entry_cur = 0; index_ret && entry_cur < archive->entries_count; entry_cur++)
+    {
+        const zip_entry_t* entry = &archive->entries[entry_cur];
+        size_t name_length = strlen(entry->entry_name);
+
+        index_ret = index_builder_add(entry->entry_name, name_length, (uint32_t)entry_cur, &builder);
+
+        if (index_ret == false || index_classes == false || name_length < 4 || strcmp(entry->entry_name + name_length - 4, ".dex") != 0 ||
+            entry->uncompressed_size > BATCH_DEX_INDEX_MAX)
+        {
+            continue;
+        }
+
+        struct batch_buffer dex_buffer;
+        uint8_t* dex_data = batch_buffer_take(entry->uncompressed_size + 1, &dex_buffer);
+        struct batch_classes classes = { .builder = &builder, .entry_index = (uint32_t)entry_cur };
+
+        /* A DEX that can't be read is still selectable by his name */
+        if (dex_data != NULL && zip_entry_inflate(entry, dex_data, archive))
+        {
+            dex_class_names(dex_data, entry->uncompressed_size, batch_index_class, &classes);
+        }
+        batch_buffer_release(&dex_buffer);
+    }
+
+    /* The builder is released by the build, even when a name is missing */
+    input->index_built = index_build(&builder, &input->input_index);
+    if (input->index_built && index_ret == false)
+    {
+        index_release(&input->input_index);
+        input->index_built = false;
+    }
+    if (input->index_built == false)
+    {
+        elog_write(droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: the names index can't be built", input->input_path);
+    }
+    if (input->index_built && index_classes && batch_select_entries(droidcat_ctx->main_args, input) == false)
+    {
+        elog_write(droidcat_ctx->main_log, ELOG_WARN, "batch", "%s: the entries can't be selected", input->input_path);
+    }
+
+    return NULL;
+}
+
+static void batch_index_inputs(struct input_batch* batch)
+{
+    tpool_t* thread_pool = batch->droidcat_ctx->main_thread_pool;
+    struct batch_entry_task* index_tasks = calloc(batch->inputs_count, sizeof(*index_tasks));
+    tpool_group_t index_group;
+
+    if (index_tasks == NULL)
+    {
+        return;
+    }
+    tpool_group_init(&index_group);
+
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        if (batch->inputs[input_cur].input_opened == false)
+        {
+            continue;
+        }
+        index_tasks[input_cur].batch = batch;
+        index_tasks[input_cur].input = &batch->inputs[input_cur];
+        tpool_group_execute(batch_index_task, &index_tasks[input_cur], &index_group, thread_pool);
+    }
+
+    tpool_group_wait(&index_group, thread_pool);
+    tpool_group_destroy(&index_group);
+    free((void*)index_tasks);
+}
+
+/* Submits all entries, one from each input by time, in waves of few tasks by worker */
+static void batch_schedule_entries(struct input_batch* batch)
+{
+    size_t entries_total = 0;
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        entries_total += batch->inputs[input_cur].input_opened ? batch->inputs[input_cur].entries_total : 0;
+    }
+
+    /* A small package is unpacked before the workers would be ready */
+    tpool_t* thread_pool = tpool_for_tasks(entries_total, batch->droidcat_ctx->main_thread_pool);
+    size_t wave_capacity = (thread_pool != NULL ? tpool_workers(thread_pool) : 1) * BATCH_WAVE_BY_WORKER;
+
+    struct batch_entry_task* wave_tasks = calloc(wave_capacity, sizeof(*wave_tasks));
+    size_t* input_cursors = calloc(batch->inputs_count + 1, sizeof(size_t));
+    
+    if (wave_tasks == NULL || input_cursors == NULL)
+    {
+        goto schedule_finished;
+    }
+
+    size_t input_cur = 0;
+    size_t inputs_drained = 0;
+
+    /* A stopped batch doesn't submit more waves, the tasks queued in the last one are dropped */
+    while (inputs_drained < batch->inputs_count && tpool_should_stop() == false)
+    {
+        size_t wave_count = 0;
+        tpool_group_t wave_group;
+        tpool_group_init(&wave_group);
+
+        /* Stops when the wave is full or when a whole turn didn't find an entry */
+        for (inputs_drained = 0; wave_count < wave_capacity && inputs_drained < batch->inputs_count; )
+        {
+            batch_input_t* input = &batch->inputs[input_cur];
+            size_t* entry_cur = &input_cursors[input_cur];
+
+            input_cur = (input_cur + 1) % batch->inputs_count;
+
+            if (input->input_opened == false || *entry_cur >= input->entries_total)
+            {
+                inputs_drained++;
+                continue;
+            }
+            inputs_drained = 0;
+
+            struct batch_entry_task* entry_task = &wave_tasks[wave_count++];
+            entry_task->batch = batch;
+            entry_task->input = input;
+            entry_task->entry = batch_entry_at(input, (*entry_cur)++);
+        }
+
+        for (size_t task_cur = 0; task_cur < wave_count; task_cur++)
+        {
+            tpool_group_execute(batch_entry_task, &wave_tasks[task_cur], &wave_group, thread_pool);
+        }
+        tpool_group_wait(&wave_group, thread_pool);
+        tpool_group_destroy(&wave_group);
+    }
+
+schedule_finished:
+    free((void*)input_cursors);
+    free((void*)wave_tasks);
+}
+
+static void batch_resolve_duplicates(struct input_batch* batch)
+{
+    tpool_t* thread_pool = batch->droidcat_ctx->main_thread_pool;
+    struct batch_duplicate* duplicates = atomic_exchange(&batch->duplicates, NULL);
+    
+    size_t duplicates_count = 0;
+    for (struct batch_duplicate* dup_cur = duplicates; dup_cur != NULL; dup_cur = dup_cur->dup_next)
+    {
+        duplicates_count++;
+    }
+    if (duplicates_count == 0)
+    {
+        return;
+    }
+
+    struct batch_entry_task* copy_tasks = calloc(duplicates_count, sizeof(*copy_tasks));
+    tpool_group_t copy_group;
+    tpool_group_init(&copy_group);
+
+    size_t task_cur = 0;
+    for (struct batch_duplicate* dup_cur = duplicates; dup_cur != NULL; dup_cur = dup_cur->dup_next, task_cur++)
+    {
+        if (copy_tasks == NULL)
+        {
+            struct batch_entry_task inline_task = { .batch = batch, .entry = (const zip_entry_t*)dup_cur };
+            batch_duplicate_task(&inline_task);
+            continue;
+        }
+        copy_tasks[task_cur].batch = batch;
+        /* The entry field carries the duplicate record */
+        copy_tasks[task_cur].entry = (const zip_entry_t*)dup_cur;
+        tpool_group_execute(batch_duplicate_task, &copy_tasks[task_cur], &copy_group, thread_pool);
+    }
+    tpool_group_wait(&copy_group, thread_pool);
+    tpool_group_destroy(&copy_group);
+
+    free((void*)copy_tasks);
+
+    while (duplicates != NULL)
+    {
+        struct batch_duplicate* dup_next = duplicates->dup_next;
+        free((void*)duplicates);
+        duplicates = dup_next;
+    }
+}
+
+static void* batch_script_task(void* task_data)
+{
+    struct batch_entry_task* script_task = (struct batch_entry_task*)task_data;
+    struct input_batch* batch = script_task->batch;
+    batch_input_t* input = script_task->input;
+    char output_path[BATCH_PATH_MAX];
+
+    snprintf(output_path, sizeof(output_path), "%s%s%s", batch->output_root != NULL ? batch->output_root : "",
+        batch->output_root != NULL ? "/" : "", input->input_name);
+
+    script_run_t script_run = {
+        .droidcat_ctx = batch->droidcat_ctx,
+        .input_path = input->input_path,
+        .input_archive = &input->input_archive,
+        .input_index = input->index_built ? &input->input_index : NULL,
+        .output_path = output_path
+    };
+
+    input->script_failed = !dsc_execute(batch->droidcat_ctx->main_script, &script_run, &input->script_error,
+        batch->droidcat_ctx->main_thread_pool);
+
+    return NULL;
+}
+
+/* The script is compiled once, each input runs it in his own task */
+static void batch_run_scripts(struct input_batch* batch)
+{
+    tpool_t* thread_pool = batch->droidcat_ctx->main_thread_pool;
+    struct batch_entry_task* script_tasks = calloc(batch->inputs_count, sizeof(*script_tasks));
+    tpool_group_t script_group;
+
+    if (script_tasks == NULL)
+    {
+        return;
+    }
+    tpool_group_init(&script_group);
+
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        if (batch->inputs[input_cur].input_opened == false)
+        {
+            continue;
+        }
+        script_tasks[input_cur].batch = batch;
+        script_tasks[input_cur].input = &batch->inputs[input_cur];
+        tpool_group_execute(batch_script_task, &script_tasks[input_cur], &script_group, thread_pool);
+    }
+
+    tpool_group_wait(&script_group, thread_pool);
+    tpool_group_destroy(&script_group);
+    free((void*)script_tasks);
+}
+
+/* Each input is scanned by all workers, the entries and their segments are the tasks */
+static void batch_scan_inputs(output_buffer_t* report_output, struct input_batch* batch)
+{
+    droidcat_ctx_t* droidcat_ctx = batch->droidcat_ctx;
+
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+
+        if (input->input_opened)
+        {
+            input->scan_failed = !engine_scan_archive(input->input_path, &input->input_archive, droidcat_ctx->main_engines,
+                droidcat_ctx->engines_count, report_output, droidcat_ctx->main_thread_pool);
+        }
+        if (input->scan_failed)
+        {
+            elog_write(droidcat_ctx->main_log, ELOG_WARN, "scan", "%s can't be scanned", input->input_path);
+            outbuf_format(report_output, "%s: the scan failed\n", input->input_path);
+        }
+    }
+}
+
+/* The chunks of each input are hashed by all workers */
+static void batch_verify_inputs(output_buffer_t* report_output, struct input_batch* batch)
+{
+    droidcat_ctx_t* droidcat_ctx = batch->droidcat_ctx;
+
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+        apksig_report_t signature_report;
+
+        if (input->input_opened == false)
+        {
+            continue;
+        }
+        if (apksig_verify(&input->input_archive, &signature_report, droidcat_ctx->main_thread_pool) == false)
+        {
+            input->verify_failed = true;
+            outbuf_format(report_output, "%s: the signature can't be verified\n", input->input_path);
+            continue;
+        }
+        apksig_report(input->input_path, &signature_report, report_output);
+
+        for (size_t scheme_cur = 0; scheme_cur < 2; scheme_cur++)
+        {
+            input->verify_failed |= signature_report.scheme_status[scheme_cur] == APKSIG_MISMATCH ||
+                signature_report.scheme_status[scheme_cur] == APKSIG_MALFORMED;
+        }
+        if (input->verify_failed)
+        {
+            elog_write(droidcat_ctx->main_log, ELOG_WARN, "sign", "%s doesn't match his signature", input->input_path);
+        }
+    }
+}
+
+static void batch_report(output_buffer_t* report_output, struct input_batch* batch)
+{
+    size_t reused_total = 0;
+
+    for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+
+        if (input->input_opened == false && input->input_streamed == false)
+        {
+            outbuf_format(report_output, "%s: can't be opened as a ZIP archive\n", input->input_path);
+            continue;
+        }
+
+        outbuf_format(report_output, "%s: %zu/%zu entries, %zu reused, %zu failed, %llu bytes\n", 
+            input->input_path, (size_t)input->entries_done, input->entries_total, (size_t)input->entries_reused,
+            (size_t)input->entries_failed, (unsigned long long)input->bytes_done);
+        if (input->script_failed)
+        {
+            outbuf_format(report_output, "%s: script failed at line %zu: %s\n", input->input_path,
+                input->script_error.error_line, input->script_error.error_message);
+        }
+        if (input->input_stopped)
+        {
+            outbuf_format(report_output, "%s: stopped by the time limit, %zu entries weren't unpacked\n", input->input_path,
+                input->entries_total - (size_t)input->entries_done - (size_t)input->entries_failed);
+        }
+        if (input->input_streamed && input->stream_failed)
+        {
+            outbuf_format(report_output, "%s: the stream ended before the central directory\n", input->input_path);
+        }
+        else if (input->input_streamed && input->central_mismatches != 0)
+        {
+            outbuf_format(report_output, "%s: %zu entries don't match the central directory\n", input->input_path, input->central_mismatches);
+        }
+        reused_total += input->entries_reused;
+    }
+
+    if (batch->inputs_count > 1)
+    {
+        outbuf_format(report_output, "%zu inputs, %zu duplicated entries reused\n", batch->inputs_count, reused_total);
+    }
+
+    dsc_program_t* main_script = batch->droidcat_ctx->main_script;
+    if (main_script != NULL && main_script->runs_count != 0)
+    {
+        outbuf_format(report_output, "Script: compiled in %llu us, %llu runs, %llu us by input, %llu fan out tasks\n",
+            (unsigned long long)main_script->compile_nanos / 1000, (unsigned long long)main_script->runs_count,
+            (unsigned long long)(main_script->runs_nanos / main_script->runs_count / 1000),
+            (unsigned long long)main_script->fanout_tasks);
+    }
+
+    decode_cache_t* decode_cache = batch->droidcat_ctx->decode_cache;
+    if (decode_cache != NULL)
+    {
+        outbuf_format(report_output, "Decode cache: %zu hits, %zu misses, %zu stored\n", (size_t)decode_cache->cache_hits,
+            (size_t)decode_cache->cache_misses, (size_t)decode_cache->cache_stores);
+    }
+}
+
+bool batch_run(output_buffer_t* report_output, droidcat_ctx_t* droidcat_ctx)
+{
+    droidcat_args_t* main_args = droidcat_ctx->main_args;
+
+    struct input_batch* batch = calloc(1, sizeof(struct input_batch));
+    if (batch == NULL)
+    {
+        return false;
+    }
+
+    /* The groups of the batch are opened into his scope, it stops with -time-limit and with the
+     * daemon request that runs the batch
+    */
+    tpool_scope_t batch_scope;
+    tpool_scope_init(main_args->time_limit, &batch_scope);
+    tpool_scope_t* previous_scope = tpool_scope_enter(&batch_scope);
+    bool batch_scoped = true;
+
+    batch->droidcat_ctx = droidcat_ctx;
+    batch->inputs_count = main_args->inputs_count;
+    batch->inputs = calloc(batch->inputs_count + 1, sizeof(batch_input_t));
+    batch->decode_resources = batch_setting_enabled(main_args->decode_settings, "res");
+    batch->output_root = main_args->output_dir;
+
+    /* Without the table each string pool converts his own strings */
+    if (batch->decode_resources)
+    {
+        batch->shared_strings = intern_create();
+    }
+
+    if (batch->output_root == NULL)
+    {
+        size_t settings_epoch;
+        const settings_t* settings = settings_acquire(&settings_epoch, droidcat_ctx->main_settings);
+
+        if (settings->outputs_count != 0)
+        {
+            memcpy(batch->default_output, settings->unknown_output[0], sizeof(batch->default_output));
+            batch->output_root = batch->default_output;
+        }
+        settings_release(settings_epoch, droidcat_ctx->main_settings);
+    }
+
+    bool batch_ret = batch->inputs != NULL;
+    size_t entries_total = 0;
+
+    for (size_t input_cur = 0; batch_ret && input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+
+        input->input_path = main_args->input_files[input_cur];
+        batch_input_name(input->input_path, input->input_name);
+        batch_input_unique(batch->inputs, input_cur);
+
+        input->input_streamed = batch_is_stream(input->input_path);
+        if (input->input_streamed)
+        {
+            continue;
+        }
+        input->input_opened = zip_open(input->input_path, &input->input_archive);
+
+        if (input->input_opened == false)
+        {
+            elog_write(droidcat_ctx->main_log, ELOG_WARN, "batch", "%s can't be opened as a ZIP archive", input->input_path);
+            continue;
+        }
+        input->entries_total = input->input_archive.entries_count;
+    }
+
+    /* The selection changes the entries of each input */
+    if (batch_ret && (main_args->select_name != NULL || droidcat_ctx->main_script != NULL))
+    {
+        batch_index_inputs(batch);
+    }
+
+    for (size_t input_cur = 0; batch_ret && input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+
+        if (input->input_opened == false)
+        {
+            continue;
+        }
+
+        for (size_t entry_cur = 0; entry_cur < input->entries_total; entry_cur++)
+        {
+            const zip_entry_t* entry = batch_entry_at(input, entry_cur);
+
+            input->bytes_total += entry->uncompressed_size;
+            if (batch_is_decoded(entry->entry_name, batch))
+            {
+                progress_expect(PROGRESS_DECODE, 1, entry->uncompressed_size, droidcat_ctx->main_progress);
+            }
+        }
+        entries_total += input->entries_total;
+        progress_expect(PROGRESS_UNPACK, input->entries_total, input->bytes_total, droidcat_ctx->main_progress);
+    }
+
+    if (batch_ret)
+    {
+        batch_ret = batch_dedup_init(entries_total, batch);
+    }
+
+    if (batch_ret)
+    {
+        batch_schedule_entries(batch);
+        batch_resolve_duplicates(batch);
+
+        for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+        {
+            if (batch->inputs[input_cur].input_streamed)
+            {
+                batch_stream_input(&batch->inputs[input_cur], batch);
+            }
+        }
+
+        if (droidcat_ctx->main_script != NULL)
+        {
+            batch_run_scripts(batch);
+        }
+
+        for (size_t input_cur = 0; input_cur < batch->inputs_count; input_cur++)
+        {
+            batch_input_t* input = &batch->inputs[input_cur];
+            input->input_stopped = input->input_opened && tpool_scope_stopped(&batch_scope) &&
+                input->entries_done + input->entries_failed < input->entries_total;
+        }
+        tpool_scope_leave(previous_scope);
+        batch_scoped = false;
+
+        batch_report(report_output, batch);
+
+        if (droidcat_ctx->engines_count != 0)
+        {
+            batch_scan_inputs(report_output, batch);
+        }
+        if (main_args->verify_signature)
+        {
+            batch_verify_inputs(report_output, batch);
+        }
+    }
+
+    for (size_t input_cur = 0; batch->inputs != NULL && input_cur < batch->inputs_count; input_cur++)
+    {
+        batch_input_t* input = &batch->inputs[input_cur];
+
+        batch_ret &= (input->input_opened || (input->input_streamed && input->stream_failed == false && input->central_mismatches == 0)) &&
+            input->entries_failed == 0 && input->input_stopped == false && input->script_failed == false && input->scan_failed == false &&
+            input->verify_failed == false;
+        if (input->input_opened)
+        {
+            elog_write(droidcat_ctx->main_log, ELOG_INFO, "batch", "%s: %zu/%zu entries, %zu failed", input->input_path,
+                (size_t)input->entries_done, input->entries_total, (size_t)input->entries_failed);
+            zip_close(&input->input_archive);
+        }
+        if (input->index_built)
+        {
+            index_release(&input->input_index);
+        }
+        free((void*)input->selected_entries);
+    }
+
+    if (batch_scoped)
+    {
+        tpool_scope_leave(previous_scope);
+    }
+
+    batch_dedup_deinit(batch);
+    if (batch->shared_strings != NULL)
+    {
+        intern_destroy(batch->shared_strings);
+    }
+    free((void*)batch->inputs);
+    free((void*)batch);
+
+    return batch_ret;
+}
+
+bool batch_execute(output_buffer_t* report_output, output_buffer_t* error_output, droidcat_ctx_t* droidcat_ctx)
+{
+    droidcat_args_t* main_args = droidcat_ctx->main_args;
+    bool execute_ret = true;
+
+    if (main_args->output_in_memory)
+    {
+        droidcat_ctx->output_tree = memfs_create(main_args->max_host_memory, NULL);
+    }
+
+    if (main_args->script_file != NULL)
+    {
+        /* Scripts with errors are reported before any input is touched */
+        droidcat_ctx->main_script = script_load(main_args->script_file, error_output, droidcat_ctx->script_cache);
+        execute_ret = droidcat_ctx->main_script != NULL;
+    }
+
+    scan_engine_t engines[2];
+
+    if (execute_ret && main_args->test_antifeatures)
+    {
+        execute_ret = engine_open(SCAN_ANTIFEATURES_ENGINE, error_output, &engines[droidcat_ctx->engines_count]);
+        droidcat_ctx->engines_count += execute_ret;
+    }
+    if (execute_ret && main_args->scan_engine != NULL)
+    {
+        execute_ret = engine_open(main_args->scan_engine, error_output, &engines[droidcat_ctx->engines_count]);
+        droidcat_ctx->engines_count += execute_ret;
+    }
+    droidcat_ctx->main_engines = engines;
+
+    /* The reports are written where the errors go */
+    progress_t progress;
+    if (execute_ret && main_args->inputs_count != 0 && main_args->progress_mode != PROGRESS_NONE &&
+        progress_start(main_args->progress_mode, error_output->flush_callback, error_output->flush_context, &progress))
+    {
+        droidcat_ctx->main_progress = &progress;
+    }
+
+    if (execute_ret && main_args->build_dir != NULL)
+    {
+        execute_ret = package_build(report_output, error_output, droidcat_ctx);
+    }
+    else if (execute_ret && main_args->inputs_count != 0)
+    {
+        execute_ret = batch_run(report_output, droidcat_ctx);
+    }
+
+    if (droidcat_ctx->main_progress != NULL)
+    {
+        outbuf_flush(error_output);
+        progress_finish(droidcat_ctx->main_progress);
+        droidcat_ctx->main_progress = NULL;
+    }
+
+    for (size_t engine_cur = 0; engine_cur < droidcat_ctx->engines_count; engine_cur++)
+    {
+        engine_close(&engines[engine_cur]);
+    }
+    droidcat_ctx->main_engines = NULL;
+    droidcat_ctx->engines_count = 0;
+
+    /* The programs are owned by the script cache */
+    droidcat_ctx->main_script = NULL;
+
+    if (droidcat_ctx->output_tree != NULL)
+    {
+        memfs_destroy(droidcat_ctx->output_tree);
+        droidcat_ctx->output_tree = NULL;
+    }
+
+    return execute_ret;
+}
@@ -0,0 +1,89 @@
+#ifndef INPUT_BATCH_H
+#define INPUT_BATCH_H
+
+#include <stdatomic.h>
+
+#include "Core_Context.h"
+#include "data/Output_Buffer.h"
+#include "zip/Zip_Archive.h"
+#include "data/Name_Index.h"
+
+#define BATCH_INPUT_NAME_MAX 256
+
+typedef struct batch_input
+{
+    const char* input_path;
+
+    /* The output sub directory, is the input file name without extension */
+    char input_name[BATCH_INPUT_NAME_MAX];
+
+    zip_archive_t input_archive;
+
+    bool input_opened;
+
+    size_t entries_total;
+
+    uint64_t bytes_total;
+
+    /* Progress counters, updated by the workers */
+    _Atomic size_t entries_done;
+
+    _Atomic size_t entries_reused;
+
+    _Atomic size_t entries_failed;
+
+    _Atomic uint64_t bytes_done;
+
+    /* From the -script execution over the unpacked input */
+    bool script_failed;
+
+    dsc_error_t script_error;
+
+    /* An entry couldn't be read by the engines scan */
+    bool scan_failed;
+
+    /* Read from a pipe or the standard input ("-"), see zip/Zip_Stream. The archive isn't
+     * kept, so the script, the scan and the verification skip it
+    */
+    bool input_streamed;
+
+    bool stream_failed;
+
+    /* Local entries that differ from the central directory or aren't in it, and the opposite */
+    size_t central_mismatches;
+
+    /* The v2/v3 signed digest doesn't match the contents, or the signing block is malformed */
+    bool verify_failed;
+
+    /* The entry names and, with -select-by-name, the classes of the DEX entries. The ids are
+     * the indexes of the entries, built when a selection or a script needs it
+    */
+    name_index_t input_index;
+
+    bool index_built;
+
+    /* With -select-by-name, the entries to unpack in the archive order, entries_total of them */
+    uint32_t* selected_entries;
+
+    /* The batch has stopped (-time-limit, or the daemon client has left) before all entries */
+    bool input_stopped;
+
+} batch_input_t;
+
+/* Unpacks (and decodes when requested) all inputs from the command line at the same time,
+ * the entries of all inputs are interleaved into the main pool, so a big input doesn't 
+ * starve the others. Entries with the same content in any input are processed only once,
+ * the other copies reuse the first output. The -script program runs for each input after
+ * all entries are written, then the code of each input is scanned by the engines and the
+ * signatures are verified. A summary by input is written in `report_output`
+*/
+bool batch_run(output_buffer_t* report_output, droidcat_ctx_t* droidcat_ctx);
+
+/* One command line: creates the output tree and loads the script of its arguments, then runs
+ * the batch. The pool, the caches and the settings are the ones of the context, so the daemon
+ * runs many command lines at the same time with copies of its context
+*/
+bool batch_execute(output_buffer_t* report_output, output_buffer_t* error_output, droidcat_ctx_t* droidcat_ctx);
+
+#endif
+
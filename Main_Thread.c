@@ -1,14 +1,185 @@
 #include <stdio.h>
 #include <malloc.h>
+#include <unistd.h>
+#include <time.h>
 
 #include "Core_Context.h"
+#include "Input_Batch.h"
+#include "Daemon_Server.h"
+#include "cpu/CPU_Time.h"
+#include "cpu/Sample_Profiler.h"
 
-int main()
+#define DROIDCAT_DEFAULT_WORKERS 4
+#define DROIDCAT_DEFAULT_CACHE_SIZE ((size_t)512 * 1024 * 1024)
+
+/* --startup-trace, each phase is measured from the end of the previous one */
+struct startup_trace
+{
+    bool trace_enabled;
+
+    uint64_t trace_start;
+
+    uint64_t phase_start;
+
+    bool output_written;
+};
+
+static uint64_t main_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static void main_trace_phase(const char* phase_name, struct startup_trace* trace)
+{
+    if (trace->trace_enabled == false)
+    {
+        return;
+    }
+    uint64_t phase_end = main_monotonic_nanos();
+
+    fprintf(stderr, "startup: %-12s %8.3f ms, %8.3f ms since the start\n", phase_name,
+        (double)(phase_end - trace->phase_start) / 1e6, (double)(phase_end - trace->trace_start) / 1e6);
+    trace->phase_start = phase_end;
+}
+
+/* The report output, the first flush is the time to the first output */
+static bool main_flush_report(const char* flush_data, size_t flush_size, void* flush_context)
 {
+    struct startup_trace* trace = (struct startup_trace*)flush_context;
+
+    if (trace->output_written == false && flush_size != 0)
+    {
+        trace->output_written = true;
+        main_trace_phase("first output", trace);
+    }
+    return outbuf_flush_stdio(flush_data, flush_size, stdout);
+}
+
+int main(int argc, char** argv)
+{
+    struct startup_trace trace = { .trace_start = main_monotonic_nanos() };
+    trace.phase_start = trace.trace_start;
+
     droidcat_ctx_t* droidcat_main = (droidcat_ctx_t*) calloc(1, sizeof(droidcat_ctx_t));
 
     if (droidcat_main == NULL) {}
 
+    droidcat_main->main_args = (droidcat_args_t*) calloc(1, sizeof(droidcat_args_t));
+    droidcat_args_t* main_args = droidcat_main->main_args;
+
+    if (args_parse(argc, argv, main_args) == false)
+    {
+        args_release(main_args);
+        free((void*)main_args);
+        free((void*)droidcat_main);
+        return 1;
+    }
+    trace.trace_enabled = main_args->startup_trace;
+    main_trace_phase("arguments", &trace);
+
+    int main_ret = 0;
+
+    char socket_path[108];
+    if (main_args->socket_path != NULL)
+    {
+        snprintf(socket_path, sizeof(socket_path), "%s", main_args->socket_path);
+    }
+    else
+    {
+        daemon_socket_path(socket_path, sizeof(socket_path));
+    }
+
+    /* Without -daemon we are a client, a running daemon does the work with warm pools and caches.
+     * A profile is of this process, it's never forwarded
+    */
+    if (main_args->daemon_mode == false && main_args->profile_file == NULL && daemon_forward(argc, argv, socket_path, &main_ret))
+    {
+        main_trace_phase("forwarded", &trace);
+        args_release(main_args);
+        free((void*)main_args);
+        free((void*)droidcat_main);
+        return main_ret;
+    }
+
+    droidcat_main->main_settings = (settings_store_t*) calloc(1, sizeof(settings_store_t));
+    settings_store_t* main_settings = droidcat_main->main_settings;
+    settings_store_init(main_settings);
+
+    /* Only a settings file given in the command line must exist */
+    const char* settings_file = main_args->settings_file != NULL ? main_args->settings_file : SETTINGS_DEFAULT_FILE;
+    settings_error_t settings_error;
+
+    if ((main_args->settings_file != NULL || access(settings_file, F_OK) == 0) &&
+        settings_load(settings_file, &settings_error, main_settings) == false)
+    {
+        if (settings_error.error_line != 0)
+        {
+            fprintf(stderr, "%s:%zu: %s\n", settings_file, settings_error.error_line, settings_error.error_message);
+        }
+        else
+        {
+            fprintf(stderr, "%s: %s\n", settings_file, settings_error.error_message);
+        }
+        main_ret = 1;
+    }
+
+    size_t settings_epoch;
+    const settings_t* settings = settings_acquire(&settings_epoch, main_settings);
+
+    if (main_args->inputs_count == 0 && main_args->build_dir == NULL && settings->default_input[0] != '\0' && access(settings->default_input, F_OK) == 0)
+    {
+        args_add_default(settings->default_input, main_args);
+    }
+    int settings_threads = settings->max_thread;
+    bool use_max_cpu = settings->use_max_cpu;
+
+    enum elog_level log_level = ELOG_WARN;
+    if (elog_parse_level(settings->log_level, &log_level) == false)
+    {
+        fprintf(stderr, "%s: unknown log level %s, using warn\n", settings_file, settings->log_level);
+    }
+
+    if (log_level != ELOG_OFF && settings->log_filename[0] != '\0')
+    {
+        droidcat_main->main_log = (event_log_t*) calloc(1, sizeof(event_log_t));
+
+        if (droidcat_main->main_log != NULL && elog_open(settings->log_filename, log_level, droidcat_main->main_log) == false)
+        {
+            fprintf(stderr, "Can't log into %s, continuing without it\n", settings->log_filename);
+            free((void*)droidcat_main->main_log);
+            droidcat_main->main_log = NULL;
+        }
+    }
+
+    settings_release(settings_epoch, main_settings);
+    main_trace_phase("settings", &trace);
+
+    if (main_args->cache_dir != NULL)
+    {
+        droidcat_main->decode_cache = (decode_cache_t*) calloc(1, sizeof(decode_cache_t));
+        size_t cache_size = main_args->cache_size != 0 ? main_args->cache_size : DROIDCAT_DEFAULT_CACHE_SIZE;
+
+        if (droidcat_main->decode_cache != NULL && dcache_open(main_args->cache_dir, cache_size, droidcat_main->decode_cache) == false)
+        {
+            fprintf(stderr, "Can't open the decode cache at %s, continuing without it\n", main_args->cache_dir);
+            free((void*)droidcat_main->decode_cache);
+            droidcat_main->decode_cache = NULL;
+        }
+    }
+
+    /* Kept for the whole process, the daemon compiles each script only once */
+    droidcat_main->script_cache = (dsc_cache_t*) calloc(1, sizeof(dsc_cache_t));
+    dsc_cache_init(droidcat_main->script_cache);
+    main_trace_phase("caches", &trace);
+
+    if (main_args->daemon_mode)
+    {
+        daemon_block_signals();
+    }
+
     droidcat_main->main_thread_pool = (tpool_t*) calloc(1, sizeof(tpool_t));
     droidcat_main->main_CPU = (physical_CPU_t*) calloc(1, sizeof(physical_CPU_t));
 
@@ -16,18 +187,140 @@ int main()
     physical_CPU_t* main_CPU = droidcat_main->main_CPU;
 
     cpu_init(main_CPU);
+    elog_write(droidcat_main->main_log, ELOG_INFO, "cpu", "%s %s (family %u, model %u), features %#x", main_CPU->vendor_name,
+        main_CPU->model_name, (unsigned)main_CPU->cpu_family, (unsigned)main_CPU->cpu_model, (unsigned)main_CPU->cpu_features);
+
+    /* The command line wins over the settings, max_thread limits use_max_cpu */
+    int worker_count = settings_threads != 0 ? settings_threads : DROIDCAT_DEFAULT_WORKERS;
+    if (use_max_cpu)
+    {
+        int sched_cores = cpu_sched_cores(main_CPU);
+        /* Hosts with more cores than a pool takes */
+        if (sched_cores > TPOOL_WORKERS_MAX)
+        {
+            sched_cores = TPOOL_WORKERS_MAX;
+        }
+        worker_count = settings_threads != 0 && settings_threads < sched_cores ? settings_threads : sched_cores;
+    }
 
-    tpool_init(4, main_pool);
+    /* Before the workers exist, each one samples himself from his start */
+    bool main_profiled = main_args->profile_file != NULL && prof_start(PROF_DEFAULT_HZ);
+    if (main_profiled)
+    {
+        prof_thread_begin("main", -1);
+    }
+    else if (main_args->profile_file != NULL)
+    {
+        fprintf(stderr, "The profiler can't be started, continuing without it\n");
+    }
+
+    /* The workers are started by the first task, see tpool_for_tasks */
+    bool pool_ready = tpool_init(main_args->max_thread != 0 ? main_args->max_thread : worker_count, main_pool);
+    main_trace_phase("pool", &trace);
+    if (pool_ready == false)
+    {
+        fprintf(stderr, "The thread pool can't be created\n");
+        main_ret = 1;
+    }
+
+    if (main_ret == 0)
+    {
+        output_buffer_t report_output;
+        output_buffer_t error_output;
+        outbuf_init(0, main_flush_report, &trace, &report_output);
+        outbuf_init(0, outbuf_flush_stdio, stderr, &error_output);
+
+        /* The inputs given to -daemon are processed before serving */
+        if (batch_execute(&report_output, &error_output, droidcat_main) == false)
+        {
+            main_ret = 1;
+        }
+        outbuf_flush(&report_output);
+        outbuf_flush(&error_output);
+        outbuf_deinit(&report_output);
+        outbuf_deinit(&error_output);
+        main_trace_phase("batch", &trace);
+    }
+
+    if (trace.trace_enabled && tpool_started(main_pool))
+    {
+        fprintf(stderr, "startup: %zu workers started in %.3f ms\n", main_pool->workers_planned, (double)main_pool->spawn_nanos / 1e6);
+    }
+    else if (trace.trace_enabled)
+    {
+        fprintf(stderr, "startup: the workers weren't needed\n");
+    }
+
+    if (main_ret == 0 && main_args->daemon_mode && daemon_serve(socket_path, droidcat_main) == false)
+    {
+        main_ret = 1;
+    }
 
     /* Stopping the threads pool service 
      * TODO: Creates the tpool_resume function 
     */
-    tpool_stop(main_pool);
+    if (pool_ready)
+    {
+        tpool_stop(main_pool);
+
+        tpool_finalize(main_pool);
+    }
+    main_trace_phase("shutdown", &trace);
+
+    /* The workers have left, their stacks are complete */
+    if (main_profiled && prof_stop(main_args->profile_file) == false)
+    {
+        fprintf(stderr, "The profile can't be written into %s\n", main_args->profile_file);
+        main_ret = 1;
+    }
 
-    tpool_finalize(main_pool);
+    for (cpu_time_slot_t time_slot = 0; droidcat_main->main_log != NULL && time_slot < CPU_TIME_SLOTS; time_slot++)
+    {
+        cpu_time_stats_t slot_times;
+        cpu_time_collect(time_slot, &slot_times);
+
+        if (slot_times.samples_count != 0)
+        {
+            elog_write(droidcat_main->main_log, ELOG_INFO, "times", "%s: %lu samples, mean %lu us, p50 %lu us, p99 %lu us, max %lu us",
+                cpu_time_slot_name(time_slot), (unsigned long)slot_times.samples_count, (unsigned long)(cpu_time_mean(&slot_times) / 1000),
+                (unsigned long)(cpu_time_percentile(0.5, &slot_times) / 1000), (unsigned long)(cpu_time_percentile(0.99, &slot_times) / 1000),
+                (unsigned long)(cpu_ticks_to_nanos(slot_times.ticks_max) / 1000));
+        }
+    }
 
     cpu_finalize(main_CPU);
 
+    if (droidcat_main->script_cache != NULL)
+    {
+        /* The programs are owned by the cache */
+        dsc_cache_deinit(droidcat_main->script_cache);
+        free((void*)droidcat_main->script_cache);
+        droidcat_main->script_cache = NULL;
+    }
+
+    if (droidcat_main->decode_cache != NULL)
+    {
+        dcache_close(droidcat_main->decode_cache);
+        free((void*)droidcat_main->decode_cache);
+        droidcat_main->decode_cache = NULL;
+    }
+
+    /* Everything logged by the workers is written by now */
+    if (droidcat_main->main_log != NULL)
+    {
+        elog_close(droidcat_main->main_log);
+        free((void*)droidcat_main->main_log);
+        droidcat_main->main_log = NULL;
+    }
+
+    settings_store_deinit(main_settings);
+    free((void*)main_settings);
+    droidcat_main->main_settings = NULL;
+
+    args_release(main_args);
+    free((void*)droidcat_main->main_args);
+    droidcat_main->main_args = NULL;
+
     free((void*)droidcat_main->main_thread_pool);
     free((void*)droidcat_main->main_CPU);
 
@@ -36,5 +329,5 @@ int main()
 
     free((void*)droidcat_main);
 
-    return 0;
+    return main_ret;
 }
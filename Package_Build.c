@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include <zlib.h>
+
+#include "Package_Build.h"
+#include "zip/Zip_Writer.h"
+#include "data/Memory_Arena.h"
+
+#define PACKAGE_PATH_MAX 4096
+
+struct package_file
+{
+    /* Relative to the build directory, the entry name */
+    const char* file_name;
+
+    uint8_t* file_data;
+
+    size_t file_size;
+
+    /* The entry with the same name and size in the base archive */
+    const zip_entry_t* base_entry;
+
+    /* Same CRC as the base entry, its compressed bytes are reused */
+    bool file_unchanged;
+
+    bool file_added;
+};
+
+struct package_files
+{
+    /* struct package_file */
+    output_buffer_t files_list;
+
+    memory_arena_t* names_arena;
+};
+
+static uint64_t package_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/* `dir_path` is modified while walking, `relative_start` is where the entry names start on it */
+static bool package_walk(char* dir_path, size_t path_length, size_t relative_start, struct package_files* files)
+{
+    DIR* directory = opendir(dir_path);
+    if (directory == NULL)
+    {
+        return false;
+    }
+
+    bool walk_ret = true;
+    struct dirent* dir_entry;
+
+    while (walk_ret && (dir_entry = readdir(directory)) != NULL)
+    {
+        const char* file_name = dir_entry->d_name;
+        size_t name_length = strlen(file_name);
+
+        if (strcmp(file_name, ".") == 0 || strcmp(file_name, "..") == 0)
+        {
+            continue;
+        }
+        if (path_length + name_length + 2 > PACKAGE_PATH_MAX)
+        {
+            walk_ret = false;
+            break;
+        }
+
+        dir_path[path_length] = '/';
+        memcpy(dir_path + path_length + 1, file_name, name_length + 1);
+
+        struct stat file_stat;
+        if (stat(dir_path, &file_stat) != 0)
+        {
+            walk_ret = false;
+        }
+        else if (S_ISDIR(file_stat.st_mode))
+        {
+            walk_ret = package_walk(dir_path, path_length + 1 + name_length, relative_start, files);
+        }
+        else if (S_ISREG(file_stat.st_mode))
+        {
+            struct package_file file = {
+                .file_name = arena_strndup(dir_path + relative_start, path_length + 1 + name_length - relative_start, files->names_arena)
+            };
+            walk_ret = file.file_name != NULL && outbuf_append(&file, sizeof(file), &files->files_list);
+        }
+        dir_path[path_length] = '\0';
+    }
+
+    closedir(directory);
+    return walk_ret;
+}
+
+static int package_file_compare(const void* first, const void* second)
+{
+    return strcmp(((const struct package_file*)first)->file_name, ((const struct package_file*)second)->file_name);
+}
+
+static struct package_file* package_find(const char* file_name, struct package_file* package_files, size_t files_count)
+{
+    struct package_file key = { .file_name = file_name };
+
+    return (struct package_file*)bsearch(&key, package_files, files_count, sizeof(struct package_file), package_file_compare);
+}
+
+static void* package_compare_task(void* task_data)
+{
+    struct package_file* file = (struct package_file*)task_data;
+    uint32_t file_crc = (uint32_t)crc32(0, file->file_data, (uInt)file->file_size);
+
+    file->file_unchanged = file_crc == file->base_entry->entry_crc32;
+    return NULL;
+}
+
+/* Pairs the files with the entries of the base archive, the CRCs of the candidates are computed by the pool */
+static void package_compare(const zip_archive_t* base_archive, struct package_file* package_files, size_t files_count, tpool_t* thread_pool)
+{
+    tpool_group_t compare_group;
+    tpool_group_init(&compare_group);
+
+    for (size_t entry_cur = 0; entry_cur < base_archive->entries_count; entry_cur++)
+    {
+        const zip_entry_t* base_entry = &base_archive->entries[entry_cur];
+        struct package_file* file = package_find(base_entry->entry_name, package_files, files_count);
+
+        if (file == NULL || file->base_entry != NULL || file->file_size != base_entry->uncompressed_size || file->file_size > UINT32_MAX)
+        {
+            continue;
+        }
+        file->base_entry = base_entry;
+
+        if (tpool_group_execute(package_compare_task, file, &compare_group, thread_pool) == false)
+        {
+            package_compare_task(file);
+        }
+    }
+    tpool_group_wait(&compare_group, thread_pool);
+    tpool_group_destroy(&compare_group);
+}
+
+static bool package_add(const zip_archive_t* base_archive, struct package_file* file, size_t* reused_count, zip_writer_t* writer)
+{
+    file->file_added = true;
+
+    if (file->file_unchanged && zipw_add_raw(file->file_name, file->base_entry, base_archive, writer))
+    {
+        (*reused_count)++;
+        return true;
+    }
+    return zipw_add(file->file_name, file->file_data, file->file_size, zipw_method_for(file->file_name), writer);
+}
+
+static bool package_map(const char* build_dir, struct package_file* file)
+{
+    char file_path[PACKAGE_PATH_MAX];
+    snprintf(file_path, sizeof(file_path), "%s/%s", build_dir, file->file_name);
+
+    int file_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat file_stat;
+    bool map_ret = fstat(file_fd, &file_stat) == 0;
+    file->file_size = map_ret ? (size_t)file_stat.st_size : 0;
+
+    if (map_ret && file->file_size != 0)
+    {
+        void* file_data = mmap(NULL, file->file_size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+        map_ret = file_data != MAP_FAILED;
+        file->file_data = map_ret ? (uint8_t*)file_data : NULL;
+    }
+    close(file_fd);
+
+    return map_ret;
+}
+
+static const char* package_archive_path(const char* build_dir, const droidcat_args_t* main_args, char* path_buffer, size_t buffer_size)
+{
+    if (main_args->output_dir != NULL)
+    {
+        return main_args->output_dir;
+    }
+
+    size_t dir_length = strlen(build_dir);
+    while (dir_length > 1 && build_dir[dir_length - 1] == '/')
+    {
+        dir_length--;
+    }
+    int path_length = snprintf(path_buffer, buffer_size, "%.*s.apk", (int)dir_length, build_dir);
+
+    return path_length > 0 && (size_t)path_length < buffer_size ? path_buffer : NULL;
+}
+
+bool package_build(output_buffer_t* report_output, output_buffer_t* error_output, droidcat_ctx_t* droidcat_ctx)
+{
+    const char* build_dir = droidcat_ctx->main_args->build_dir;
+    char path_buffer[PACKAGE_PATH_MAX];
+    const char* archive_path = package_archive_path(build_dir, droidcat_ctx->main_args, path_buffer, sizeof(path_buffer));
+
+    uint64_t build_start = package_monotonic_nanos();
+
+    struct package_files files = { .names_arena = arena_create(0) };
+    char walk_path[PACKAGE_PATH_MAX];
+    size_t dir_length = strlen(build_dir);
+
+    bool build_ret = archive_path != NULL && files.names_arena != NULL && outbuf_init(0, NULL, NULL, &files.files_list) &&
+        dir_length + 1 < sizeof(walk_path);
+    if (build_ret)
+    {
+        memcpy(walk_path, build_dir, dir_length + 1);
+        build_ret = package_walk(walk_path, dir_length, dir_length + 1, &files);
+    }
+
+    if (build_ret == false)
+    {
+        outbuf_format(error_output, "The build directory %s can't be read\n", build_dir);
+    }
+
+    struct package_file* package_files = (struct package_file*)files.files_list.buffer_data;
+    size_t files_count = build_ret ? outbuf_length(&files.files_list) / sizeof(struct package_file) : 0;
+    uint64_t bytes_total = 0;
+
+    /* The archive doesn't depend on the order of readdir */
+    if (files_count != 0)
+    {
+        qsort(package_files, files_count, sizeof(struct package_file), package_file_compare);
+    }
+
+    for (size_t file_cur = 0; build_ret && file_cur < files_count; file_cur++)
+    {
+        build_ret = package_map(build_dir, &package_files[file_cur]);
+        bytes_total += package_files[file_cur].file_size;
+
+        if (build_ret == false)
+        {
+            outbuf_format(error_output, "%s/%s can't be read\n", build_dir, package_files[file_cur].file_name);
+        }
+    }
+
+    /* With an input, the build reuses what didn't change in it */
+    zip_archive_t base_archive = { .archive_fd = -1 };
+    bool base_opened = false;
+    const char* base_path = droidcat_ctx->main_args->inputs_count != 0 ? droidcat_ctx->main_args->input_files[0] : NULL;
+
+    if (build_ret && base_path != NULL)
+    {
+        build_ret = base_opened = zip_open(base_path, &base_archive);
+        if (build_ret == false)
+        {
+            outbuf_format(error_output, "The base archive %s can't be opened\n", base_path);
+        }
+    }
+    if (base_opened)
+    {
+        package_compare(&base_archive, package_files, files_count, droidcat_ctx->main_thread_pool);
+    }
+
+    zip_writer_t writer;
+    size_t reused_count = 0;
+    build_ret = zipw_init(PACKAGE_COMPRESSION_LEVEL, &writer) && build_ret;
+
+    /* The entries kept from the base are in its order, the new ones follow by name */
+    for (size_t entry_cur = 0; build_ret && base_opened && entry_cur < base_archive.entries_count; entry_cur++)
+    {
+        struct package_file* file = package_find(base_archive.entries[entry_cur].entry_name, package_files, files_count);
+        if (file != NULL && file->file_added == false)
+        {
+            build_ret = package_add(&base_archive, file, &reused_count, &writer);
+        }
+    }
+    for (size_t file_cur = 0; build_ret && file_cur < files_count; file_cur++)
+    {
+        if (package_files[file_cur].file_added == false)
+        {
+            build_ret = package_add(&base_archive, &package_files[file_cur], &reused_count, &writer);
+        }
+    }
+
+    if (build_ret)
+    {
+        build_ret = zipw_write(archive_path, droidcat_ctx->main_thread_pool, &writer);
+        if (build_ret == false)
+        {
+            outbuf_format(error_output, "The archive %s can't be written\n", archive_path);
+        }
+    }
+
+    if (build_ret)
+    {
+        uint64_t build_nanos = package_monotonic_nanos() - build_start;
+        outbuf_format(report_output, "%s: %zu entries (%zu reused), %lu bytes packed in %lu ms\n", archive_path, files_count,
+            reused_count, (unsigned long)bytes_total, (unsigned long)(build_nanos / 1000000));
+    }
+
+    zipw_deinit(&writer);
+    if (base_opened)
+    {
+        zip_close(&base_archive);
+    }
+    for (size_t file_cur = 0; file_cur < files_count; file_cur++)
+    {
+        if (package_files[file_cur].file_data != NULL)
+        {
+            munmap(package_files[file_cur].file_data, package_files[file_cur].file_size);
+        }
+    }
+    outbuf_deinit(&files.files_list);
+    if (files.names_arena != NULL)
+    {
+        arena_destroy(files.names_arena);
+    }
+
+    return build_ret;
+}
@@ -0,0 +1,18 @@
+#ifndef PACKAGE_BUILD_H
+#define PACKAGE_BUILD_H
+
+#include "Core_Context.h"
+#include "data/Output_Buffer.h"
+
+/* Deflate level of the built archives, the one aapt uses */
+#define PACKAGE_COMPRESSION_LEVEL 9
+
+/* -build: packs the files of the build directory (in the order of their names) into the
+ * -output archive, or "<directory>.apk" without it. The entries are compressed by the main
+ * pool, see zip/Zip_Writer. With an input, it's the archive the directory was unpacked from:
+ * its order is kept and the files with the size and CRC of their entry are copied compressed
+ * from it instead of being deflated again. One line with the totals is written in `report_output`
+*/
+bool package_build(output_buffer_t* report_output, output_buffer_t* error_output, droidcat_ctx_t* droidcat_ctx);
+
+#endif
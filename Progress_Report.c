@@ -0,0 +1,386 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "Progress_Report.h"
+
+#define PROGRESS_SIMPLE_NANO 250000000 /* 250 milliseconds */
+#define PROGRESS_REPORT_NANO 1000000000 /* 1 second */
+
+/* Weight of the last interval in the smoothed throughput */
+#define PROGRESS_RATE_WEIGHT 0.3
+
+#define PROGRESS_OUTPUT_SIZE 4096
+
+static const char* progress_stage_names[] = { "unpack", "decode", "disas" };
+
+static atomic_uint progress_next_id;
+
+static _Thread_local progress_shard_t* progress_local_shard;
+static _Thread_local uint32_t progress_local_id;
+
+static int64_t progress_nano(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void progress_add(enum progress_stage stage, enum progress_unit unit, uint64_t value, progress_t* progress)
+{
+    if (progress == NULL)
+    {
+        return;
+    }
+
+    if (progress_local_id != progress->progress_id)
+    {
+        /* First count of this thread for this report */
+        unsigned shard_index = atomic_fetch_add(&progress->shards_used, 1);
+
+        progress_local_shard = &progress->shards[shard_index < PROGRESS_SHARDS_MAX ? shard_index : PROGRESS_SHARDS_MAX - 1];
+        progress_local_id = progress->progress_id;
+    }
+
+    atomic_uint_fast64_t* counter = &progress_local_shard->shard_counters[stage][unit];
+
+    if (progress_local_shard == &progress->shards[PROGRESS_SHARDS_MAX - 1])
+    {
+        atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+        return;
+    }
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void progress_expect(enum progress_stage stage, uint64_t entries, uint64_t bytes, progress_t* progress)
+{
+    if (progress == NULL)
+    {
+        return;
+    }
+    atomic_fetch_add_explicit(&progress->expected[stage][PROGRESS_ENTRIES], entries, memory_order_relaxed);
+    atomic_fetch_add_explicit(&progress->expected[stage][PROGRESS_BYTES], bytes, memory_order_relaxed);
+}
+
+static void progress_sum(const progress_t* progress, uint64_t counters[PROGRESS_STAGES][PROGRESS_UNITS])
+{
+    unsigned shards_used = atomic_load(&progress->shards_used);
+    if (shards_used > PROGRESS_SHARDS_MAX)
+    {
+        shards_used = PROGRESS_SHARDS_MAX;
+    }
+
+    memset(counters, 0, sizeof(uint64_t) * PROGRESS_STAGES * PROGRESS_UNITS);
+
+    /* The shared shard may have been used before shards_used reached it */
+    for (unsigned shard_cur = 0; shard_cur < PROGRESS_SHARDS_MAX; shard_cur++)
+    {
+        if (shard_cur >= shards_used && shard_cur != PROGRESS_SHARDS_MAX - 1)
+        {
+            continue;
+        }
+        for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES; stage_cur++)
+        {
+            for (size_t unit_cur = 0; unit_cur < PROGRESS_UNITS; unit_cur++)
+            {
+                counters[stage_cur][unit_cur] += atomic_load_explicit(&progress->shards[shard_cur].shard_counters[stage_cur][unit_cur],
+                    memory_order_relaxed);
+            }
+        }
+    }
+}
+
+/* -1 when the stage size or the throughput isn't known */
+static int64_t progress_eta_ms(uint64_t bytes_done, uint64_t bytes_expected, double bytes_rate)
+{
+    if (bytes_expected == 0 || bytes_rate < 1.0)
+    {
+        return -1;
+    }
+    if (bytes_done >= bytes_expected)
+    {
+        return 0;
+    }
+    return (int64_t)((double)(bytes_expected - bytes_done) / bytes_rate * 1000.0);
+}
+
+static void progress_render_simple(uint64_t counters[PROGRESS_STAGES][PROGRESS_UNITS], uint64_t expected[PROGRESS_STAGES][PROGRESS_UNITS],
+    bool final_report, progress_t* progress)
+{
+    output_buffer_t* output = &progress->report_output;
+    size_t line_begin = outbuf_length(output);
+    bool stage_shown = false;
+
+    outbuf_putc('\r', output);
+
+    for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES; stage_cur++)
+    {
+        const uint64_t* done = counters[stage_cur];
+        if (done[PROGRESS_ENTRIES] == 0 && expected[stage_cur][PROGRESS_ENTRIES] == 0)
+        {
+            continue;
+        }
+
+        outbuf_format(output, "%s%s %llu", stage_shown ? " | " : "", progress_stage_names[stage_cur], (unsigned long long)done[PROGRESS_ENTRIES]);
+        stage_shown = true;
+
+        if (expected[stage_cur][PROGRESS_ENTRIES] != 0)
+        {
+            uint64_t bytes_expected = expected[stage_cur][PROGRESS_BYTES];
+            outbuf_format(output, "/%llu %.0f%%", (unsigned long long)expected[stage_cur][PROGRESS_ENTRIES],
+                bytes_expected != 0 ? 100.0 * (double)done[PROGRESS_BYTES] / (double)bytes_expected :
+                100.0 * (double)done[PROGRESS_ENTRIES] / (double)expected[stage_cur][PROGRESS_ENTRIES]);
+        }
+        if (done[PROGRESS_CLASSES] != 0)
+        {
+            outbuf_format(output, " %llu classes", (unsigned long long)done[PROGRESS_CLASSES]);
+        }
+        outbuf_format(output, " %.1f MB/s", progress->bytes_rate[stage_cur] / 1e6);
+
+        int64_t eta_ms = progress_eta_ms(done[PROGRESS_BYTES], expected[stage_cur][PROGRESS_BYTES], progress->bytes_rate[stage_cur]);
+        if (final_report == false && eta_ms > 0)
+        {
+            outbuf_format(output, " ETA %llds", (long long)(eta_ms + 999) / 1000);
+        }
+    }
+
+    /* Covers what is left of a longer previous line */
+    size_t line_length = outbuf_length(output) - line_begin;
+    for (size_t pad_cur = line_length; pad_cur < progress->simple_length; pad_cur++)
+    {
+        outbuf_putc(' ', output);
+    }
+    progress->simple_length = final_report ? 0 : line_length;
+
+    if (final_report)
+    {
+        outbuf_putc('\n', output);
+    }
+}
+
+static void progress_render_verbose(uint64_t counters[PROGRESS_STAGES][PROGRESS_UNITS], uint64_t expected[PROGRESS_STAGES][PROGRESS_UNITS],
+    double elapsed, progress_t* progress)
+{
+    output_buffer_t* output = &progress->report_output;
+
+    for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES; stage_cur++)
+    {
+        const uint64_t* done = counters[stage_cur];
+        if (done[PROGRESS_ENTRIES] == 0 && expected[stage_cur][PROGRESS_ENTRIES] == 0)
+        {
+            continue;
+        }
+
+        outbuf_format(output, "[%8.2fs] %s: %llu/%llu entries, %.2f/%.2f MB, %llu classes, %.1f MB/s", elapsed, progress_stage_names[stage_cur],
+            (unsigned long long)done[PROGRESS_ENTRIES], (unsigned long long)expected[stage_cur][PROGRESS_ENTRIES],
+            (double)done[PROGRESS_BYTES] / 1e6, (double)expected[stage_cur][PROGRESS_BYTES] / 1e6,
+            (unsigned long long)done[PROGRESS_CLASSES], progress->bytes_rate[stage_cur] / 1e6);
+
+        int64_t eta_ms = progress_eta_ms(done[PROGRESS_BYTES], expected[stage_cur][PROGRESS_BYTES], progress->bytes_rate[stage_cur]);
+        if (eta_ms >= 0)
+        {
+            outbuf_format(output, ", ETA %.1fs", (double)eta_ms / 1000.0);
+        }
+        outbuf_putc('\n', output);
+    }
+}
+
+static void progress_render_json(uint64_t counters[PROGRESS_STAGES][PROGRESS_UNITS], uint64_t expected[PROGRESS_STAGES][PROGRESS_UNITS],
+    double elapsed, bool final_report, progress_t* progress)
+{
+    output_buffer_t* output = &progress->report_output;
+
+    outbuf_format(output, "{\"elapsed_ms\":%lld,\"final\":%s", (long long)(elapsed * 1000.0), final_report ? "true" : "false");
+
+    for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES; stage_cur++)
+    {
+        const uint64_t* done = counters[stage_cur];
+        int64_t eta_ms = progress_eta_ms(done[PROGRESS_BYTES], expected[stage_cur][PROGRESS_BYTES], progress->bytes_rate[stage_cur]);
+
+        outbuf_format(output, ",\"%s\":{\"entries\":%llu,\"entries_total\":%llu,\"bytes\":%llu,\"bytes_total\":%llu,\"classes\":%llu,"
+            "\"bytes_per_second\":%.0f,\"eta_ms\":", progress_stage_names[stage_cur],
+            (unsigned long long)done[PROGRESS_ENTRIES], (unsigned long long)expected[stage_cur][PROGRESS_ENTRIES],
+            (unsigned long long)done[PROGRESS_BYTES], (unsigned long long)expected[stage_cur][PROGRESS_BYTES],
+            (unsigned long long)done[PROGRESS_CLASSES], progress->bytes_rate[stage_cur]);
+        if (eta_ms >= 0)
+        {
+            outbuf_format(output, "%lld}", (long long)eta_ms);
+        }
+        else
+        {
+            outbuf_puts("null}", output);
+        }
+    }
+    outbuf_puts("}\n", output);
+}
+
+static void progress_report(bool final_report, progress_t* progress)
+{
+    uint64_t counters[PROGRESS_STAGES][PROGRESS_UNITS];
+    uint64_t expected[PROGRESS_STAGES][PROGRESS_UNITS];
+    int64_t now_nano = progress_nano();
+
+    progress_sum(progress, counters);
+    for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES; stage_cur++)
+    {
+        for (size_t unit_cur = 0; unit_cur < PROGRESS_UNITS; unit_cur++)
+        {
+            expected[stage_cur][unit_cur] = atomic_load_explicit(&progress->expected[stage_cur][unit_cur], memory_order_relaxed);
+        }
+    }
+
+    /* The last interval smoothed with the previous ones, the final report uses the whole run */
+    double interval = (double)(now_nano - progress->last_nano) / 1e9;
+    double elapsed = (double)(now_nano - ((int64_t)progress->start_time.tv_sec * 1000000000 + progress->start_time.tv_nsec)) / 1e9;
+
+    for (size_t stage_cur = 0; stage_cur < PROGRESS_STAGES && interval > 0; stage_cur++)
+    {
+        double interval_rate = (double)(counters[stage_cur][PROGRESS_BYTES] - progress->last_bytes[stage_cur]) / interval;
+
+        if (final_report)
+        {
+            progress->bytes_rate[stage_cur] = elapsed > 0 ? (double)counters[stage_cur][PROGRESS_BYTES] / elapsed : 0;
+        }
+        else if (progress->last_nano == 0 || progress->bytes_rate[stage_cur] == 0)
+        {
+            progress->bytes_rate[stage_cur] = interval_rate;
+        }
+        else
+        {
+            progress->bytes_rate[stage_cur] = PROGRESS_RATE_WEIGHT * interval_rate + (1 - PROGRESS_RATE_WEIGHT) * progress->bytes_rate[stage_cur];
+        }
+        progress->last_bytes[stage_cur] = counters[stage_cur][PROGRESS_BYTES];
+    }
+    progress->last_nano = now_nano;
+
+    switch (progress->progress_mode)
+    {
+    case PROGRESS_SIMPLE: progress_render_simple(counters, expected, final_report, progress); break;
+    case PROGRESS_VERBOSE: progress_render_verbose(counters, expected, elapsed, progress); break;
+    case PROGRESS_JSON: progress_render_json(counters, expected, elapsed, final_report, progress); break;
+    default: break;
+    }
+
+    outbuf_flush(&progress->report_output);
+}
+
+static void* progress_reporter(void* reporter_data)
+{
+    progress_t* progress = (progress_t*)reporter_data;
+    long report_nano = progress->progress_mode == PROGRESS_SIMPLE ? PROGRESS_SIMPLE_NANO : PROGRESS_REPORT_NANO;
+    sigset_t blocked_signals;
+
+    /* Signals belong to the main thread */
+    sigfillset(&blocked_signals);
+    pthread_sigmask(SIG_BLOCK, &blocked_signals, NULL);
+
+    pthread_mutex_lock(&progress->reporter_lock);
+    for (;;)
+    {
+        struct timespec wake_time;
+        clock_gettime(CLOCK_REALTIME, &wake_time);
+        wake_time.tv_nsec += report_nano;
+        if (wake_time.tv_nsec >= 1000000000)
+        {
+            wake_time.tv_sec++;
+            wake_time.tv_nsec -= 1000000000;
+        }
+
+        while (atomic_load(&progress->reporter_run) &&
+            pthread_cond_timedwait(&progress->reporter_wake, &progress->reporter_lock, &wake_time) == 0) {}
+
+        if (atomic_load(&progress->reporter_run) == false)
+        {
+            break;
+        }
+        progress_report(false, progress);
+    }
+    pthread_mutex_unlock(&progress->reporter_lock);
+
+    progress_report(true, progress);
+
+    return NULL;
+}
+
+bool progress_start(progress_mode_t progress_mode, output_flush_t flush_callback, void* flush_context, progress_t* progress)
+{
+    memset(progress, 0, sizeof(*progress));
+
+    progress->progress_mode = progress_mode;
+    progress->progress_id = atomic_fetch_add(&progress_next_id, 1) + 1;
+    progress->shards = (progress_shard_t*) aligned_alloc(_Alignof(progress_shard_t), sizeof(progress_shard_t) * PROGRESS_SHARDS_MAX);
+
+    if (progress->shards == NULL)
+    {
+        return false;
+    }
+    memset(progress->shards, 0, sizeof(progress_shard_t) * PROGRESS_SHARDS_MAX);
+
+    if (outbuf_init(PROGRESS_OUTPUT_SIZE, flush_callback, flush_context, &progress->report_output) == false)
+    {
+        free((void*)progress->shards);
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &progress->start_time);
+    progress->last_nano = progress_nano();
+
+    pthread_mutex_init(&progress->reporter_lock, NULL);
+    pthread_cond_init(&progress->reporter_wake, NULL);
+    atomic_store(&progress->reporter_run, true);
+
+    if (pthread_create(&progress->reporter, NULL, progress_reporter, progress) != 0)
+    {
+        pthread_cond_destroy(&progress->reporter_wake);
+        pthread_mutex_destroy(&progress->reporter_lock);
+        outbuf_deinit(&progress->report_output);
+        free((void*)progress->shards);
+        return false;
+    }
+
+    return true;
+}
+
+bool progress_finish(progress_t* progress)
+{
+    pthread_mutex_lock(&progress->reporter_lock);
+    atomic_store(&progress->reporter_run, false);
+    pthread_cond_signal(&progress->reporter_wake);
+    pthread_mutex_unlock(&progress->reporter_lock);
+
+    pthread_join(progress->reporter, NULL);
+
+    bool finish_ret = progress->report_output.buffer_failed == false;
+
+    outbuf_deinit(&progress->report_output);
+    pthread_cond_destroy(&progress->reporter_wake);
+    pthread_mutex_destroy(&progress->reporter_lock);
+    free((void*)progress->shards);
+    progress->shards = NULL;
+
+    return finish_ret;
+}
+
+bool progress_parse_mode(const char* mode_name, progress_mode_t* progress_mode)
+{
+    if (strcmp(mode_name, "simple") == 0)
+    {
+        *progress_mode = PROGRESS_SIMPLE;
+    }
+    else if (strcmp(mode_name, "verbose") == 0)
+    {
+        *progress_mode = PROGRESS_VERBOSE;
+    }
+    else if (strcmp(mode_name, "json") == 0)
+    {
+        *progress_mode = PROGRESS_JSON;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,105 @@
+#ifndef PROGRESS_REPORT_H
+#define PROGRESS_REPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "data/Output_Buffer.h"
+
+/* Threads beyond it share the last shard with atomic additions */
+#define PROGRESS_SHARDS_MAX 64
+
+typedef enum progress_mode
+{
+    PROGRESS_NONE,
+    /* One line rewritten in place */
+    PROGRESS_SIMPLE,
+    /* A line by stage at each report */
+    PROGRESS_VERBOSE,
+    /* A JSON object by line at each report */
+    PROGRESS_JSON
+} progress_mode_t;
+
+enum progress_stage
+{
+    PROGRESS_UNPACK,
+    PROGRESS_DECODE,
+    PROGRESS_DISAS,
+    PROGRESS_STAGES
+};
+
+enum progress_unit
+{
+    PROGRESS_ENTRIES,
+    PROGRESS_BYTES,
+    /* DEX classes, only for the disassembly */
+    PROGRESS_CLASSES,
+    PROGRESS_UNITS
+};
+
+/* Written by a single thread, read by the reporter, in his own cache lines */
+typedef struct progress_shard
+{
+    _Alignas(64) atomic_uint_fast64_t shard_counters[PROGRESS_STAGES][PROGRESS_UNITS];
+
+} progress_shard_t;
+
+typedef struct progress
+{
+    progress_mode_t progress_mode;
+
+    /* Unique for each started report, the threads cache their shard by it */
+    uint32_t progress_id;
+
+    progress_shard_t* shards;
+
+    atomic_uint shards_used;
+
+    /* 0 when the stage size isn't known in advance */
+    atomic_uint_fast64_t expected[PROGRESS_STAGES][PROGRESS_UNITS];
+
+    /* Where the reports are flushed, the same place as the errors */
+    output_buffer_t report_output;
+
+    pthread_t reporter;
+
+    atomic_bool reporter_run;
+
+    pthread_mutex_t reporter_lock;
+
+    pthread_cond_t reporter_wake;
+
+    struct timespec start_time;
+
+    /* Owned by the reporter, used for the throughput */
+    uint64_t last_bytes[PROGRESS_STAGES];
+
+    int64_t last_nano;
+
+    double bytes_rate[PROGRESS_STAGES];
+
+    /* Length of the last simple line */
+    size_t simple_length;
+
+} progress_t;
+
+/* Starts the reporter thread, the reports go to `flush_callback` from the reporter thread only */
+bool progress_start(progress_mode_t progress_mode, output_flush_t flush_callback, void* flush_context, progress_t* progress);
+
+/* Stops the reporter after a last report with the final counters */
+bool progress_finish(progress_t* progress);
+
+/* "simple", "verbose" or "json" */
+bool progress_parse_mode(const char* mode_name, progress_mode_t* progress_mode);
+
+void progress_expect(enum progress_stage stage, uint64_t entries, uint64_t bytes, progress_t* progress);
+
+/* The hot path: a plain load and store into the shard of the calling thread, no locks and no
+ * atomic read-modify-write. `progress` may be NULL
+*/
+void progress_add(enum progress_stage stage, enum progress_unit unit, uint64_t value, progress_t* progress);
+
+#endif
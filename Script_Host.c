@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "Script_Host.h"
+#include "decode/Dex_Listing.h"
+#include "decode/Elf_Listing.h"
+#include "vfs/Output_File.h"
+
+#define SCRIPT_PATH_MAX 4096
+#define SCRIPT_LISTING_BUFFER (64 * 1024)
+
+static bool script_copy_value(const char* value, char* output, size_t output_size)
+{
+    size_t value_length = strlen(value);
+
+    if (value_length >= output_size)
+    {
+        return false;
+    }
+    memcpy(output, value, value_length + 1);
+    return true;
+}
+
+static bool script_builtin_input(const char* qualifier, char* value, size_t value_size, void* run_data)
+{
+    (void)qualifier;
+    return script_copy_value(((script_run_t*)run_data)->input_path, value, value_size);
+}
+
+static bool script_builtin_input_name(const char* qualifier, char* value, size_t value_size, void* run_data)
+{
+    const char* input_path = ((script_run_t*)run_data)->input_path;
+    const char* base_name = strrchr(input_path, '/');
+    base_name = base_name != NULL ? base_name + 1 : input_path;
+
+    const char* extension = strrchr(base_name, '.');
+    size_t name_length = extension != NULL && extension != base_name ? (size_t)(extension - base_name) : strlen(base_name);
+
+    (void)qualifier;
+    if (name_length >= value_size)
+    {
+        return false;
+    }
+    memcpy(value, base_name, name_length);
+    value[name_length] = '\0';
+
+    return true;
+}
+
+static bool script_builtin_output(const char* qualifier, char* value, size_t value_size, void* run_data)
+{
+    const char* output_path = ((script_run_t*)run_data)->output_path;
+
+    bool qualifier_numeric = qualifier != NULL && *qualifier != '\0';
+    for (const char* digit = qualifier; qualifier_numeric && *digit != '\0'; digit++)
+    {
+        qualifier_numeric = isdigit((unsigned char)*digit) != 0;
+    }
+
+    if (qualifier == NULL || qualifier_numeric)
+    {
+        return script_copy_value(output_path, value, value_size);
+    }
+
+    int value_length = snprintf(value, value_size, "%s/%s", output_path, qualifier);
+    return value_length > 0 && (size_t)value_length < value_size;
+}
+
+static bool script_unpack(size_t args_count, char* const* args, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+
+    /* The entries are unpacked by the batch before the script runs */
+    return args_count == 3 && strcmp(args[0], "into") == 0 && strcmp(args[1], script_run->input_path) == 0;
+}
+
+static bool script_disas(size_t args_count, char* const* args, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+    memfs_t* output_tree = script_run->droidcat_ctx->output_tree;
+
+    if (args_count == 0)
+    {
+        return false;
+    }
+
+    bool (*list_file)(const uint8_t*, size_t, output_buffer_t*);
+    if (strcmp(args[0], "dex") == 0)
+    {
+        list_file = dex_list;
+    }
+    else if (strcmp(args[0], "elf") == 0)
+    {
+        list_file = elf_list;
+    }
+    else
+    {
+        return false;
+    }
+
+    bool disas_ret = true;
+
+    for (size_t arg_cur = 1; disas_ret && arg_cur < args_count; arg_cur++)
+    {
+        char listing_path[SCRIPT_PATH_MAX];
+        size_t file_size;
+        uint8_t* file_data = outfile_load(args[arg_cur], &file_size, output_tree);
+
+        int path_length = snprintf(listing_path, sizeof(listing_path), "%s.txt", args[arg_cur]);
+        if (file_data == NULL || path_length <= 0 || (size_t)path_length >= sizeof(listing_path))
+        {
+            free((void*)file_data);
+            return false;
+        }
+
+        output_file_t listing_file;
+        output_buffer_t listing;
+
+        disas_ret = outfile_create(listing_path, output_tree, &listing_file);
+        if (disas_ret)
+        {
+            outbuf_init(SCRIPT_LISTING_BUFFER, outfile_flush, &listing_file, &listing);
+
+            disas_ret = list_file(file_data, file_size, &listing);
+            disas_ret &= outbuf_flush(&listing);
+            outbuf_deinit(&listing);
+            disas_ret &= outfile_close(&listing_file);
+        }
+
+        progress_t* progress = script_run->droidcat_ctx->main_progress;
+        if (disas_ret && progress != NULL)
+        {
+            progress_add(PROGRESS_DISAS, PROGRESS_ENTRIES, 1, progress);
+            progress_add(PROGRESS_DISAS, PROGRESS_BYTES, file_size, progress);
+            if (list_file == dex_list)
+            {
+                progress_add(PROGRESS_DISAS, PROGRESS_CLASSES, dex_classes_count(file_data, file_size), progress);
+            }
+        }
+        free((void*)file_data);
+    }
+
+    return disas_ret;
+}
+
+static bool script_copy(size_t args_count, char* const* args, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+    memfs_t* output_tree = script_run->droidcat_ctx->output_tree;
+    char destination_path[SCRIPT_PATH_MAX];
+
+    if (args_count != 2)
+    {
+        return false;
+    }
+
+    const char* destination = args[1];
+    size_t destination_length = strlen(destination);
+    const char* source_name = strrchr(args[0], '/');
+    source_name = source_name != NULL ? source_name + 1 : args[0];
+
+    int path_length = destination_length != 0 && destination[destination_length - 1] == '/' ?
+        snprintf(destination_path, sizeof(destination_path), "%s%s", destination, source_name) :
+        snprintf(destination_path, sizeof(destination_path), "%s", destination);
+
+    if (path_length <= 0 || (size_t)path_length >= sizeof(destination_path))
+    {
+        return false;
+    }
+
+    if (output_tree != NULL)
+    {
+        return memfs_copy(args[0], destination_path, output_tree);
+    }
+
+    size_t file_size;
+    uint8_t* file_data = outfile_load(args[0], &file_size, NULL);
+    if (file_data == NULL)
+    {
+        return false;
+    }
+
+    output_file_t destination_file;
+    bool copy_ret = outfile_create(destination_path, NULL, &destination_file);
+    if (copy_ret)
+    {
+        copy_ret = outfile_write(file_data, file_size, &destination_file);
+        copy_ret &= outfile_close(&destination_file);
+    }
+    free((void*)file_data);
+
+    return copy_ret;
+}
+
+struct script_lookup
+{
+    const zip_archive_t* input_archive;
+
+    const char* entry_name;
+
+    size_t name_length;
+
+    bool name_found;
+};
+
+/* The index also holds DEX classes, only the names of the entries themselves are paths */
+static bool script_is_entry(uint32_t key_index, uint32_t entry_index, const zip_archive_t* archive, const name_index_t* input_index)
+{
+    size_t key_length;
+    const char* key = index_key(key_index, &key_length, input_index);
+    const char* entry_name = archive->entries[entry_index].entry_name;
+
+    return strncmp(entry_name, key, key_length) == 0 && entry_name[key_length] == '\0';
+}
+
+static bool script_found(uint32_t key_index, uint32_t entry_index, void* lookup_data)
+{
+    struct script_lookup* lookup = (struct script_lookup*)lookup_data;
+    const char* entry_name = lookup->input_archive->entries[entry_index].entry_name;
+
+    (void)key_index;
+    lookup->name_found = strncmp(entry_name, lookup->entry_name, lookup->name_length) == 0 &&
+        (entry_name[lookup->name_length] == '\0' || entry_name[lookup->name_length] == '/');
+    return lookup->name_found == false;
+}
+
+/* "$input/lib" refers to the lib directory inside the archive */
+static bool script_exist(const char* path, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+    size_t input_length = strlen(script_run->input_path);
+
+    if (strncmp(path, script_run->input_path, input_length) != 0 || path[input_length] != '/')
+    {
+        return outfile_exist(path, script_run->droidcat_ctx->output_tree);
+    }
+
+    const char* entry_name = path + input_length + 1;
+    size_t name_length = strlen(entry_name);
+    while (name_length != 0 && entry_name[name_length - 1] == '/')
+    {
+        name_length--;
+    }
+
+    /* The entry itself, or a directory: an entry starting with "<name>/" */
+    if (script_run->input_index != NULL)
+    {
+        struct script_lookup lookup = {
+            .input_archive = script_run->input_archive,
+            .entry_name = entry_name,
+            .name_length = name_length
+        };
+
+        index_prefix(entry_name, name_length, script_found, &lookup, script_run->input_index);
+        return lookup.name_found;
+    }
+
+    const zip_archive_t* archive = script_run->input_archive;
+    for (size_t entry_cur = 0; entry_cur < archive->entries_count; entry_cur++)
+    {
+        const char* candidate = archive->entries[entry_cur].entry_name;
+
+        if (strncmp(candidate, entry_name, name_length) == 0 && (candidate[name_length] == '\0' || candidate[name_length] == '/'))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct script_entries
+{
+    dsc_match_fn on_match;
+
+    void* match_data;
+
+    const zip_archive_t* input_archive;
+
+    const name_index_t* input_index;
+
+    /* "<input>/" followed by the entry name */
+    char entry_path[SCRIPT_PATH_MAX];
+
+    size_t input_length;
+
+    /* Entries with the same name are reported once */
+    uint32_t last_key;
+};
+
+static bool script_entry_match(uint32_t key_index, uint32_t entry_index, void* match_data)
+{
+    struct script_entries* entries = (struct script_entries*)match_data;
+    size_t key_length;
+
+    if (key_index == entries->last_key || script_is_entry(key_index, entry_index, entries->input_archive, entries->input_index) == false)
+    {
+        return true;
+    }
+    entries->last_key = key_index;
+
+    const char* key = index_key(key_index, &key_length, entries->input_index);
+    if (entries->input_length + 1 + key_length >= sizeof(entries->entry_path))
+    {
+        return true;
+    }
+    memcpy(entries->entry_path + entries->input_length + 1, key, key_length + 1);
+
+    return entries->on_match(entries->entry_path, entries->match_data);
+}
+
+/* "$input/res/<pattern>" is expanded from the entries of the archive */
+static bool script_glob(const char* pattern, dsc_match_fn on_match, void* match_data, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+    size_t input_length = strlen(script_run->input_path);
+
+    if (script_run->input_index == NULL || strncmp(pattern, script_run->input_path, input_length) != 0 || pattern[input_length] != '/')
+    {
+        return outfile_glob(pattern, on_match, match_data, script_run->droidcat_ctx->output_tree);
+    }
+
+    struct script_entries* entries = malloc(sizeof(struct script_entries));
+    if (entries == NULL)
+    {
+        return false;
+    }
+    entries->on_match = on_match;
+    entries->match_data = match_data;
+    entries->input_archive = script_run->input_archive;
+    entries->input_index = script_run->input_index;
+    entries->input_length = input_length;
+    entries->last_key = UINT32_MAX;
+    memcpy(entries->entry_path, pattern, input_length + 1);
+
+    bool glob_ret = index_glob(pattern + input_length + 1, script_entry_match, entries, script_run->input_index);
+    free((void*)entries);
+
+    return glob_ret;
+}
+
+static size_t script_size(const char* path, void* run_data)
+{
+    script_run_t* script_run = (script_run_t*)run_data;
+    return outfile_size(path, script_run->droidcat_ctx->output_tree);
+}
+
+/* The listings of each file are independent, `disas <kind>` fans out by file */
+static const dsc_directive_t script_directives[] = {
+    { "unpack", script_unpack },
+    { "disas", script_disas, .directive_fanout = true, .fixed_args = 1, .output_suffix = ".txt" },
+    { "copy", script_copy },
+};
+
+static const dsc_builtin_t script_builtins[] = {
+    { "input", script_builtin_input },
+    { "input_name", script_builtin_input_name },
+    { "output", script_builtin_output },
+};
+
+const dsc_host_t script_host = {
+    .host_directives = script_directives,
+    .directives_count = sizeof(script_directives) / sizeof(*script_directives),
+    .host_builtins = script_builtins,
+    .builtins_count = sizeof(script_builtins) / sizeof(*script_builtins),
+    .host_glob = script_glob,
+    .host_exist = script_exist,
+    .host_size = script_size
+};
+
+dsc_program_t* script_load(const char* script_path, output_buffer_t* error_output, dsc_cache_t* script_cache)
+{
+    FILE* script_file = fopen(script_path, "rb");
+    if (script_file == NULL)
+    {
+        outbuf_format(error_output, "Can't open the script %s\n", script_path);
+        return NULL;
+    }
+
+    output_buffer_t script_source;
+    char read_buffer[4096];
+    size_t read_size;
+
+    outbuf_init(sizeof(read_buffer), NULL, NULL, &script_source);
+    while ((read_size = fread(read_buffer, 1, sizeof(read_buffer), script_file)) != 0)
+    {
+        outbuf_append(read_buffer, read_size, &script_source);
+    }
+    fclose(script_file);
+
+    dsc_error_t script_error;
+    dsc_program_t* program = NULL;
+
+    if (script_source.buffer_failed == false)
+    {
+        program = dsc_compile_cached(script_source.buffer_data, outbuf_length(&script_source), &script_host, &script_error, script_cache);
+        if (program == NULL)
+        {
+            outbuf_format(error_output, "%s:%zu: %s\n", script_path, script_error.error_line, script_error.error_message);
+        }
+    }
+    outbuf_deinit(&script_source);
+
+    return program;
+}
@@ -0,0 +1,45 @@
+#ifndef SCRIPT_HOST_H
+#define SCRIPT_HOST_H
+
+#include "Core_Context.h"
+#include "script/Dsc_VM.h"
+#include "zip/Zip_Archive.h"
+#include "data/Output_Buffer.h"
+#include "data/Name_Index.h"
+
+/* The state of a script execution over one input */
+typedef struct script_run
+{
+    droidcat_ctx_t* droidcat_ctx;
+
+    const char* input_path;
+
+    const zip_archive_t* input_archive;
+
+    /* The entry names of the input, NULL when it couldn't be built */
+    const name_index_t* input_index;
+
+    /* Where the input has been unpacked */
+    const char* output_path;
+
+} script_run_t;
+
+/* Builtins:
+ * - $input: the input file
+ * - $input_name: the input file name without the extension
+ * - $output: the output directory of the input, $output:<dir> is a sub directory of it,
+ *   a numeric qualifier ($output:1) means the output directory itself
+ * Directives:
+ * - %unpack% into <input> <output>: the batch already unpacked, only checks the arguments
+ * - %disas% dex|elf <files...>: writes a listing of each file into <file>.txt
+ * - %copy% <source> <destination>: copies an output file, a destination ending with '/' is a directory
+ * Paths inside the input ($input/lib) are checked against the archive entries by "if exist",
+ * patterns inside it ($input/res/layout_*.xml) are expanded from the entry names
+*/
+extern const dsc_host_t script_host;
+
+/* Reads and compiles (once for each content) a -script file, the errors are written into `error_output` */
+dsc_program_t* script_load(const char* script_path, output_buffer_t* error_output, dsc_cache_t* script_cache);
+
+#endif
+
@@ -2,11 +2,20 @@
 #include <assert.h>
 #include <string.h>
 #include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
 
 #include "Thread_Pool.h"
 #include "cpu/CPU_Time.h"
+#include "cpu/Hardware_Info.h"
+#include "cpu/Sample_Profiler.h"
 
 #define TPOOL_SYNC_NANO 5e+6 /* 5 milliseconds */
+#define TPOOL_GROUP_WAIT_NANO 1000000 /* 1 millisecond */
+
+#define TPOOL_SCRATCH_BLOCK (1024 * 1024)
+/* A task that needed more gives the memory back after him */
+#define TPOOL_SCRATCH_KEEP (8 * 1024 * 1024)
 
 struct thread_task
 {
@@ -23,12 +32,31 @@ struct thread_task
     pthread_cond_t task_finished;
 
     function_task_t task_function;
+
+    /* When not NULL, the task belongs to a group and must notify it when done */
+    tpool_group_t* task_group;
+
+    /* Current while the task runs, a task whose scope has stopped before it starts is dropped */
+    tpool_scope_t task_scope;
+
+    bool task_ran;
+
+    /* Handles only: one reference for the queue and one for the submitter, the task is claimed
+     * once, by a worker or by tpool_task_join and tpool_cancel_task
+    */
+    _Atomic uint_least8_t task_refs;
+
+    _Atomic uint_least8_t task_claimed;
 };
 
+/* The scope of the task (or of the group) the thread is running */
+static _Thread_local tpool_scope_t* tpool_thread_scope;
+
 static void tpool_task_init(function_task_t task_operation, void* task_data, struct thread_task* task)
 {
     task->task_function = task_operation;
     task->task_data = task_data;
+    task->task_scope.scope_parent = tpool_thread_scope;
 
     pthread_mutex_init(&task->task_mutex, NULL);
     pthread_cond_init(&task->task_finished , NULL);
@@ -51,7 +79,8 @@ worker_thread_t* tpool_retrieve(pthread_t thread_native_id, tpool_t* thread_pool
 
     worker_thread_t* worker_data = NULL;
 
-    for (size_t worker_cur = 0; worker_cur < thread_pool->worker_cnt; worker_cur++)
+    /* worker_cnt drops as the workers leave, the ones still starting are after them */
+    for (size_t worker_cur = 0; worker_cur < thread_pool->workers_planned; worker_cur++)
     {
         if (thread_pool->worker_threads[worker_cur].worker_sched == thread_native_id)
         {
@@ -70,7 +99,19 @@ static worker_thread_t* tpool_retrieve_self(tpool_t* thread_pool)
     return tpool_retrieve(pthread_self(), thread_pool);
 }
 
-static struct timespec __wait_time_limit = { .tv_nsec = TPOOL_SYNC_NANO, .tv_sec = 0 };
+static const struct timespec __wait_time_limit = { .tv_nsec = TPOOL_SYNC_NANO, .tv_sec = 0 };
+
+/* The timed waits want an absolute time */
+static void tpool_wait_limit(long wait_nanos, struct timespec* wait_limit)
+{
+    timespec_get(wait_limit, TIME_UTC);
+    wait_limit->tv_nsec += wait_nanos;
+    if (wait_limit->tv_nsec >= 1000000000)
+    {
+        wait_limit->tv_sec++;
+        wait_limit->tv_nsec -= 1000000000;
+    }
+}
 
 static void __force_worker_execution(tpool_t* thread_pool)
 {
@@ -79,11 +120,209 @@ static void __force_worker_execution(tpool_t* thread_pool)
     pthread_mutex_unlock(&thread_pool->workers_lock);
 }
 
+static void tpool_group_leave(tpool_group_t* task_group)
+{
+    pthread_mutex_lock(&task_group->group_lock);
+    if (--task_group->tasks_pending == 0)
+    {
+        pthread_cond_broadcast(&task_group->group_done);
+    }
+    pthread_mutex_unlock(&task_group->group_lock);
+}
+
+void tpool_scope_init(uint64_t deadline_nanos, tpool_scope_t* scope)
+{
+    scope->scope_cancelled = 0;
+    scope->scope_deadline = deadline_nanos != 0 ? cpu_ticks() + cpu_nanos_to_ticks(deadline_nanos) : 0;
+    scope->scope_parent = tpool_thread_scope;
+}
+
+tpool_scope_t* tpool_scope_enter(tpool_scope_t* scope)
+{
+    tpool_scope_t* previous_scope = tpool_thread_scope;
+    tpool_thread_scope = scope;
+
+    return previous_scope;
+}
+
+void tpool_scope_leave(tpool_scope_t* previous_scope)
+{
+    tpool_thread_scope = previous_scope;
+}
+
+void tpool_scope_cancel(tpool_scope_t* scope)
+{
+    scope->scope_cancelled = 1;
+}
+
+bool tpool_scope_stopped(const tpool_scope_t* scope)
+{
+    uint64_t now_ticks = 0;
+
+    /* The chains are short, a task into a group into the task that opened it */
+    for (; scope != NULL; scope = scope->scope_parent)
+    {
+        if (scope->scope_cancelled)
+        {
+            return true;
+        }
+        if (scope->scope_deadline != 0)
+        {
+            if (now_ticks == 0)
+            {
+                now_ticks = cpu_ticks();
+            }
+            if (now_ticks >= scope->scope_deadline)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool tpool_should_stop(void)
+{
+    return tpool_scope_stopped(tpool_thread_scope);
+}
+
+/* Calls the function into the scope of the task, unless it has already stopped. The task
+ * mutex must be locked
+*/
+static void* tpool_task_call(struct thread_task* task)
+{
+    task->task_ran = tpool_scope_stopped(&task->task_scope) == false;
+    if (task->task_ran == false)
+    {
+        return NULL;
+    }
+
+    tpool_scope_t* previous_scope = tpool_scope_enter(&task->task_scope);
+    prof_task_t previous_task = prof_task((prof_task_t)task->task_function);
+    void* task_result = task->task_function(task->task_data);
+    prof_task(previous_task);
+    tpool_scope_leave(previous_scope);
+
+    return task_result;
+}
+
+static void tpool_task_release(struct thread_task* task)
+{
+    if (atomic_fetch_sub(&task->task_refs, 1) == 1)
+    {
+        tpool_task_deinit(task);
+        free((void*)task);
+    }
+}
+
+/* Executes a dequeued task and delivers his result, can be called from a worker or from 
+ * a thread that is helping the pool while waits for a group 
+*/
+static void tpool_run_task(struct thread_task* acquired_task)
+{
+    bool task_handle = acquired_task->task_refs != 0;
+
+    /* Joined or cancelled before a worker took it, only the reference of the queue is left */
+    if (task_handle && atomic_exchange(&acquired_task->task_claimed, 1) != 0)
+    {
+        tpool_task_release(acquired_task);
+        return;
+    }
+
+    /* The task mutex must be locked */
+    pthread_mutex_lock(&acquired_task->task_mutex);
+    void* acquired_result = tpool_task_call(acquired_task);
+    
+    /* This copy is done here, because after unlock, the task may be destroyed if its resides on the stack,
+     * the ownership will be transferred to the thread how created this task!
+    */
+    bool will_wait = acquired_task->task_in_wait;
+
+    if (will_wait || task_handle)
+    {
+        acquired_task->task_result = acquired_result;
+        acquired_task->task_completed = 1;
+        pthread_cond_signal(&acquired_task->task_finished);
+        pthread_mutex_unlock(&acquired_task->task_mutex);
+
+        if (task_handle)
+        {
+            tpool_task_release(acquired_task);
+        }
+    }
+    else
+    {
+        tpool_group_t* task_group = acquired_task->task_group;
+
+        pthread_mutex_unlock(&acquired_task->task_mutex);
+        tpool_task_deinit(acquired_task);
+        free((void*)acquired_task);
+
+        if (task_group != NULL)
+        {
+            tpool_group_leave(task_group);
+        }
+    }
+}
+
+/* Keeps the worker on the cores of his node, his scratch memory is placed there */
+static void tpool_worker_place(worker_thread_t* worker_content)
+{
+    if (worker_content->worker_node >= 0)
+    {
+        cpu_set_t node_cpus;
+        if (cpu_numa_cpus(worker_content->worker_node, &node_cpus))
+        {
+            pthread_setaffinity_np(pthread_self(), sizeof(node_cpus), &node_cpus);
+        }
+    }
+
+    worker_content->worker_scratch = arena_create_on_node(TPOOL_SCRATCH_BLOCK, worker_content->worker_node);
+    arena_scratch_set(worker_content->worker_scratch);
+}
+
+static void tpool_worker_leave(worker_thread_t* worker_content)
+{
+    arena_scratch_set(NULL);
+    if (worker_content->worker_scratch != NULL)
+    {
+        arena_destroy(worker_content->worker_scratch);
+        worker_content->worker_scratch = NULL;
+    }
+}
+
+/* O(1) between two tasks, unless the last one has kept too much memory */
+static void tpool_scratch_rewind(memory_arena_t* scratch)
+{
+    if (scratch == NULL)
+    {
+        return;
+    }
+
+    if (arena_allocated(scratch) > TPOOL_SCRATCH_KEEP)
+    {
+        arena_reset(scratch);
+    }
+    else
+    {
+        arena_rewind(scratch);
+    }
+}
+
 static void* tpool_worker_routine(void* tpool)
 {
     tpool_t* thread_pool = (tpool_t*)tpool;
+
+    /* tpool_spawn holds the lock until the ids of all workers are stored */
+    pthread_mutex_lock(&thread_pool->tpool_lock);
+    pthread_mutex_unlock(&thread_pool->tpool_lock);
     
     worker_thread_t* worker_content = tpool_retrieve_self(thread_pool);
+    cpu_time_stats_t* task_times = cpu_time_local(CPU_TIME_TASK);
+
+    tpool_worker_place(worker_content);
+
+    prof_thread_begin("worker", (int)worker_content->worker_id);
 
     while (1)
     {
@@ -94,6 +333,8 @@ static void* tpool_worker_routine(void* tpool)
         #if TPOOL_USES_DETACHED
         if (thread_pool->pool_begin_destroyed)
         {
+            tpool_worker_leave(worker_content);
+            prof_thread_end();
             thread_pool->worker_cnt--;
             pthread_mutex_unlock(&thread_pool->tpool_lock);
             pthread_exit(NULL);
@@ -107,21 +348,18 @@ static void* tpool_worker_routine(void* tpool)
         #endif
         pthread_mutex_unlock(&thread_pool->tpool_lock);
 
-        if (thread_pool->__wait != NULL)
-        {
-            /* Worker thread is waiting for a broadcast signal */
-            pthread_mutex_lock(&thread_pool->workers_lock);
-            pthread_cond_timedwait(&thread_pool->tpool_sync_tasks, &thread_pool->workers_lock, thread_pool->__wait);
-            pthread_mutex_unlock(&thread_pool->workers_lock);
-        }
-        else
+        /* The submitters broadcast with workers_lock after queuing, a task queued before the
+         * check isn't missed, the limit is only a safety net
+        */
+        pthread_mutex_lock(&thread_pool->workers_lock);
+        if (queue_empty(thread_pool->task_queue_safe))
         {
-            #if TPOOL_USES_DETACHED
-            continue;
-            #else
-            break;
-            #endif
+            struct timespec wait_limit;
+            tpool_wait_limit(thread_pool->__wait->tv_nsec, &wait_limit);
+
+            pthread_cond_timedwait(&thread_pool->tpool_sync_tasks, &thread_pool->workers_lock, &wait_limit);
         }
+        pthread_mutex_unlock(&thread_pool->workers_lock);
 
         pthread_mutex_lock(&thread_pool->tpool_lock);
         thread_pool->workers_in_waiting--;
@@ -129,38 +367,24 @@ static void* tpool_worker_routine(void* tpool)
         worker_content->can_cancel = 0;
         pthread_mutex_unlock(&thread_pool->tpool_lock);
 
-        struct thread_task* acquired_task = queue_dequeue(thread_pool->task_queue_safe);
-
         /* From this stage, the worker thread can't be canceled */
+        struct thread_task* acquired_task = queue_dequeue(thread_pool->task_queue_safe);
 
-        if (acquired_task == NULL) continue;
-
-        /* The task mutex must be locked */
-        pthread_mutex_lock(&acquired_task->task_mutex);
-        void* acquired_result = acquired_task->task_function(acquired_task->task_data);
-        
-        /* This copy is done here, because after unlock, the task may be destroyed if its resides on the stack,
-         * the ownership will be transferred to the thread how created this task!
-        */
-        bool will_wait = acquired_task->task_in_wait;
-
-        if (will_wait)
+        if (acquired_task != NULL)
         {
-            acquired_task->task_result = acquired_result;
-            acquired_task->task_completed = 1;
-            pthread_cond_signal(&acquired_task->task_finished);
-            pthread_mutex_unlock(&acquired_task->task_mutex);
-        }
-        else
-        {
-            pthread_mutex_unlock(&acquired_task->task_mutex);
-            tpool_task_deinit(acquired_task);
-            free((void*)acquired_task);
+            cpu_timer_t task_timer = cpu_timer_start(task_times);
+            tpool_run_task(acquired_task);
+            cpu_timer_stop(&task_timer);
+
+            tpool_scratch_rewind(worker_content->worker_scratch);
         }
 
-        /* Worker routine has finished the actual task, waiting for another */
+        /* Worker routine has finished the actual task (or found none), waiting for another */
         pthread_mutex_lock(&thread_pool->tpool_lock);
-        thread_pool->workers_running--;
+        if (--thread_pool->workers_running == 0)
+        {
+            pthread_cond_broadcast(&thread_pool->tpool_idle);
+        }
         pthread_mutex_unlock(&thread_pool->tpool_lock);
     }
 
@@ -169,8 +393,17 @@ static void* tpool_worker_routine(void* tpool)
 #endif
 }
 
+static uint64_t tpool_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
 /* Will lock the caller thread for wait until the task 'task_operation' is finished 
  * result code from task_operation will be delivery for the caller as result!
+ * No thread is created here, a run that never submits a task doesn't pay for them
 */
 bool tpool_init(int worker_count, tpool_t* thread_pool) 
 {
@@ -178,15 +411,23 @@ bool tpool_init(int worker_count, tpool_t* thread_pool)
     
     thread_pool->__wait = &__wait_time_limit;
     
-    thread_pool->worker_threads = calloc((int8_t)worker_count, sizeof(*thread_pool->worker_threads));
+    if (worker_count <= 0 || worker_count > TPOOL_WORKERS_MAX)
+    {
+        return false;
+    }
+    thread_pool->worker_threads = calloc((size_t)worker_count, sizeof(*thread_pool->worker_threads));
+    if (thread_pool->worker_threads == NULL)
+    {
+        return false;
+    }
 
-    thread_pool->worker_cnt = worker_count;
+    thread_pool->workers_planned = (size_t)worker_count;
 
     pthread_mutex_init(&thread_pool->tpool_lock, NULL);
     pthread_mutex_init(&thread_pool->workers_lock, NULL);
 
-    pthread_mutex_lock(&thread_pool->tpool_lock);
     pthread_cond_init(&thread_pool->tpool_sync_tasks, NULL);
+    pthread_cond_init(&thread_pool->tpool_idle, NULL);
 
     /* Preallocate all needed tasks */
     thread_pool->task_queue_safe = queue_create(worker_count);
@@ -195,21 +436,53 @@ bool tpool_init(int worker_count, tpool_t* thread_pool)
 
     /* Enable the safe-lock into the queue, every enqueue/dequeue operation will have a valid mutex */ 
     queue_safe_lock(thread_pool->task_queue_safe);
-    if (thread_pool->worker_threads == NULL) {}
 
+    thread_pool->thread_pool_run = 1;
+
+    return true;
+}
+
+/* Creates the workers at the first submission, the next ones only check the flag */
+static void tpool_spawn(tpool_t* thread_pool)
+{
+    if (thread_pool->workers_started)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&thread_pool->tpool_lock);
+    if (thread_pool->workers_started)
+    {
+        pthread_mutex_unlock(&thread_pool->tpool_lock);
+        return;
+    }
+
+    uint64_t spawn_start = tpool_monotonic_nanos();
     worker_thread_t* worker_cur = thread_pool->worker_threads;
 
-    for (uint8_t worker_index = 0; worker_index != worker_count; worker_index++)
+    /* The workers are spread over the nodes, the scratch memory of each one is local to him */
+    int numa_nodes[CPU_NUMA_NODES_MAX];
+    int nodes_count = cpu_numa_nodes(numa_nodes, CPU_NUMA_NODES_MAX);
+
+    /* Set before the threads exist, they look for themselves into the array */
+    thread_pool->worker_cnt = thread_pool->workers_planned;
+
+    size_t worker_index;
+    for (worker_index = 0; worker_index != thread_pool->workers_planned; worker_index++)
     {
-        worker_cur[worker_index].worker_id = worker_index;
+        worker_cur[worker_index].worker_id = (uint32_t)worker_index;
         
         worker_cur[worker_index].can_cancel = 1;
 
+        worker_cur[worker_index].worker_node = nodes_count > 1 ? numa_nodes[worker_index % nodes_count] : -1;
+
         pthread_t* thread_posix = &worker_cur[worker_index].worker_sched;
         
         int posix_result = pthread_create(thread_posix, NULL, tpool_worker_routine, (void*)thread_pool);
-
-        if (posix_result != 0) {}
+        if (posix_result != 0)
+        {
+            break;
+        }
         #if TPOOL_USES_DETACHED
         /* Detach the thread when his has done */
         int detach_ret = pthread_detach(*thread_posix);
@@ -217,25 +490,31 @@ bool tpool_init(int worker_count, tpool_t* thread_pool)
         #endif
     }
 
-    thread_pool->thread_pool_run = 1;
+    /* Only the threads that exist are counted, none of them has looked into the array yet */
+    if (worker_index != thread_pool->workers_planned)
+    {
+        pthread_mutex_lock(&thread_pool->workers_lock);
+        thread_pool->workers_planned = worker_index;
+        thread_pool->worker_cnt = worker_index;
+        pthread_mutex_unlock(&thread_pool->workers_lock);
+    }
 
-    pthread_mutex_unlock(&thread_pool->tpool_lock);
-    tpool_sync(thread_pool);
+    thread_pool->spawn_nanos = tpool_monotonic_nanos() - spawn_start;
+    thread_pool->workers_started = 1;
 
-    return true;
+    pthread_mutex_unlock(&thread_pool->tpool_lock);
 }
 
 bool tpool_stop(tpool_t* thread_pool)
 {
     pthread_mutex_t* mutex_lock = &thread_pool->tpool_lock;
 
+    /* A submission checks the flag with the same lock, a task queued after this point can't exist */
     pthread_mutex_lock(mutex_lock);
     thread_pool->thread_pool_run = 0;
-    
-    thread_pool->__wait = NULL;
-
     pthread_mutex_unlock(mutex_lock);
 
+    /* The workers keep running until tpool_finalize, the tasks already queued are done */
     bool sync_ret = tpool_sync(thread_pool);
 
     return sync_ret;
@@ -243,7 +522,23 @@ bool tpool_stop(tpool_t* thread_pool)
 
 size_t tpool_workers(const tpool_t* thread_pool)
 {
-    return thread_pool->worker_cnt;
+    /* Without threads the tasks run inline, one at a time */
+    return thread_pool->workers_planned != 0 ? thread_pool->workers_planned : 1;
+}
+
+bool tpool_started(const tpool_t* thread_pool)
+{
+    return thread_pool->workers_started != 0;
+}
+
+tpool_t* tpool_for_tasks(size_t tasks_count, tpool_t* thread_pool)
+{
+    if (thread_pool == NULL || (thread_pool->workers_started == 0 && tasks_count < TPOOL_INLINE_TASKS) ||
+        (thread_pool->workers_started != 0 && thread_pool->workers_planned == 0))
+    {
+        return NULL;
+    }
+    return thread_pool;
 }
 
 size_t tpool_running_now(const tpool_t* thread_pool)
@@ -259,10 +554,16 @@ static int tpool_cancel(tpool_t* thread_pool)
 
     #if TPOOL_USES_DETACHED
     
-    while (tpool_workers(thread_pool) != 0)
+    /* Each worker leaves at his next wake up, worker_cnt is changed with the lock held */
+    pthread_mutex_lock(&thread_pool->tpool_lock);
+    while (thread_pool->worker_cnt != 0)
     {
+        pthread_mutex_unlock(&thread_pool->tpool_lock);
         __force_worker_execution(thread_pool);
+        sched_yield();
+        pthread_mutex_lock(&thread_pool->tpool_lock);
     }
+    pthread_mutex_unlock(&thread_pool->tpool_lock);
     workers_total = worker_cur = 0;
     
     #else    
@@ -276,7 +577,7 @@ static int tpool_cancel(tpool_t* thread_pool)
         thread_pool->worker_cnt--;
     }
     pthread_mutex_unlock(&thread_pool->tpool_lock);
-    workers_total = tpool_workers(thread_pool);
+    workers_total = thread_pool->worker_cnt;
     
     #endif
     
@@ -297,13 +598,14 @@ bool tpool_finalize(tpool_t* thread_pool)
     int cancel_ret = tpool_cancel(thread_pool);
 
     /* This must be equal to 1, because shouldn't exist any workers alive */
-    assert(cancel_ret == tpool_workers(thread_pool));
+    assert(cancel_ret == thread_pool->worker_cnt);
 
     pthread_mutex_destroy(&thread_pool->tpool_lock);
 
     pthread_mutex_destroy(&thread_pool->workers_lock);
 
     pthread_cond_destroy(&thread_pool->tpool_sync_tasks);
+    pthread_cond_destroy(&thread_pool->tpool_idle);
 
     free((void*)thread_pool->worker_threads);
 
@@ -327,25 +629,64 @@ int tpool_wait_ava(tpool_t* thread_pool)
         waiting_var = thread_pool->worker_cnt - thread_pool->workers_running;
         pthread_mutex_unlock(&thread_pool->tpool_lock);
         pthread_mutex_unlock(&thread_pool->workers_lock);
-        /* Sleep until a task is ready for receive a broadcast signal */
 
-        cpu_sleep_nano(TPOOL_SYNC_NANO);
+        /* Sleep until a task is ready for receive a broadcast signal */
+        if (waiting_var == 0)
+        {
+            cpu_sleep_nano(TPOOL_SYNC_NANO);
+        }
     }
 
     return waiting_var;
 }
 
-static bool tpool_add(struct thread_task* task, tpool_t* thread_pool)
+/* Queues the task unless the pool is stopped, the flag is read with tpool_lock held, so
+ * tpool_stop either sees the task into the queue or the submission fails
+*/
+static bool tpool_enqueue(struct thread_task* task, tpool_t* thread_pool)
 {
-    assert(tpool_wait_ava(thread_pool) != 0);
+    pthread_mutex_lock(&thread_pool->tpool_lock);
+    if (thread_pool->thread_pool_run == 0)
+    {
+        pthread_mutex_unlock(&thread_pool->tpool_lock);
+        return false;
+    }
+
     int enqueue_ret = queue_enqueue((void*)task, thread_pool->task_queue_safe);
     assert(enqueue_ret != false);
+    (void)enqueue_ret;
 
+    pthread_mutex_unlock(&thread_pool->tpool_lock);
     return true;
 }
 
-bool tpool_evaluate(struct thread_task* task, tpool_t* thread_pool)
+static bool tpool_add(struct thread_task* task, tpool_t* thread_pool)
+{
+    tpool_spawn(thread_pool);
+    /* No thread could be started, nobody would take the task */
+    if (thread_pool->workers_planned == 0)
+    {
+        return false;
+    }
+    int workers_idle = tpool_wait_ava(thread_pool);
+    assert(workers_idle != 0);
+    (void)workers_idle;
+
+    return tpool_enqueue(task, thread_pool);
+}
+
+/* A task that was never queued, his mutex is still held by tpool_task_init */
+static void tpool_task_discard(struct thread_task* task)
+{
+    pthread_mutex_unlock(&task->task_mutex);
+    tpool_task_deinit(task);
+}
+
+/* Returns the result of a waited task, it's read before the task is cleared */
+static void* tpool_evaluate(struct thread_task* task, tpool_t* thread_pool)
 {
+    void* task_result = NULL;
+
     /* Notify all workers that there's a task to be done */    
     /* It's know that there's one or more threads waiting for a task, so on we can notify they */
     /* The workers_lock must be acquired by tpool_wait_ava */
@@ -354,13 +695,18 @@ bool tpool_evaluate(struct thread_task* task, tpool_t* thread_pool)
     
     if (will_wait != 0)
     {
-        pthread_cond_wait(&task->task_finished, &task->task_mutex);
+        /* A wake up may be spurious */
+        while (task->task_completed == 0)
+        {
+            pthread_cond_wait(&task->task_finished, &task->task_mutex);
+        }
         pthread_mutex_unlock(&task->task_mutex);
         /* For avoid: stack based errors, because after the evaluate has finished, the function that creates 
          * the task at stack, maybe returns, before the acquired thread executes the last unlock against 
          * the mutex. */
         sched_yield();
         assert(task->task_completed != 0);
+        task_result = task->task_result;
         /* After this point, we can delete mutex without any problems */
         tpool_task_deinit(task);
     } else
@@ -368,7 +714,7 @@ bool tpool_evaluate(struct thread_task* task, tpool_t* thread_pool)
         pthread_mutex_unlock(&task->task_mutex);
     }
 
-    return true;
+    return task_result;
 }
 
 void* tpool_wait_for_result(function_task_t task_operation, void* task_data, tpool_t* thread_pool)
@@ -380,13 +726,14 @@ void* tpool_wait_for_result(function_task_t task_operation, void* task_data, tpo
 
     struct thread_task new_task_stack = { .task_in_wait = 1 };
     tpool_task_init(task_operation, task_data, &new_task_stack);
-    tpool_add(&new_task_stack, thread_pool);
+    if (tpool_add(&new_task_stack, thread_pool) == false)
+    {
+        tpool_task_discard(&new_task_stack);
+        return NULL;
+    }
 
     /* Wait until some worker finished our task */
-    tpool_evaluate(&new_task_stack, thread_pool);
-
-    void* result_data = new_task_stack.task_result;
-    return result_data;
+    return tpool_evaluate(&new_task_stack, thread_pool);
 }
 
 bool tpool_execute(function_task_t task_operation, void* task_data, tpool_t* thread_pool)
@@ -397,44 +744,257 @@ bool tpool_execute(function_task_t task_operation, void* task_data, tpool_t* thr
     }
 
     struct thread_task* new_task = calloc(1, sizeof(struct thread_task));
-    if (new_task == NULL) {}
+    if (new_task == NULL)
+    {
+        return false;
+    }
     tpool_task_init(task_operation, task_data, new_task);
+    /* Nobody waits for it, the scope of the caller may be gone when it runs */
+    new_task->task_scope.scope_parent = NULL;
 
-    bool add_red = tpool_add(new_task, thread_pool);
+    if (tpool_add(new_task, thread_pool) == false)
+    {
+        tpool_task_discard(new_task);
+        free((void*)new_task);
+        return false;
+    }
     tpool_evaluate(new_task, thread_pool);
 
     /* The task will be freed inside the worker code */
 
-    return add_red;
+    return true;
 }
 
 /* Wait for all tasks being finished */
 bool tpool_sync(tpool_t* thread_pool)
 {
-    bool sync_done = false;
+    pthread_mutex_lock(&thread_pool->tpool_lock);
 
-    while (sync_done == false)
+    /* A worker takes a task only after counting himself as running, an empty queue with no
+     * worker running means that every task is done. The last worker to finish signals us, the
+     * limit covers the tasks queued while all workers were sleeping
+    */
+    while (queue_empty(thread_pool->task_queue_safe) == false || thread_pool->workers_running != 0)
     {
-        pthread_mutex_lock(&thread_pool->tpool_lock);
-        if (queue_empty(thread_pool->task_queue_safe))
+        struct timespec wait_limit;
+        tpool_wait_limit(TPOOL_SYNC_NANO, &wait_limit);
+
+        pthread_cond_timedwait(&thread_pool->tpool_idle, &thread_pool->tpool_lock, &wait_limit);
+    }
+    pthread_mutex_unlock(&thread_pool->tpool_lock);
+
+    return true;
+}
+
+bool tpool_group_init(tpool_group_t* task_group)
+{
+    task_group->tasks_pending = 0;
+    tpool_scope_init(0, &task_group->group_scope);
+
+    pthread_mutex_init(&task_group->group_lock, NULL);
+    pthread_cond_init(&task_group->group_done, NULL);
+
+    return true;
+}
+
+/* Submits a task without blocking the caller, even when all workers are busy, this makes 
+ * possible to submit tasks from inside another task. When there's no pool, the task runs inline 
+*/
+bool tpool_group_execute(function_task_t task_operation, void* task_data, tpool_group_t* task_group, tpool_t* thread_pool)
+{
+    if (thread_pool != NULL && thread_pool->thread_pool_run == 0)
+    {
+        return false;
+    }
+    if (thread_pool != NULL)
+    {
+        tpool_spawn(thread_pool);
+    }
+
+    /* A pool whose threads couldn't be started runs the tasks as no pool */
+    if (thread_pool == NULL || thread_pool->workers_planned == 0)
+    {
+        if (tpool_scope_stopped(&task_group->group_scope) == false)
         {
-            sync_done = true;
+            tpool_scope_t* previous_scope = tpool_scope_enter(&task_group->group_scope);
+            task_operation(task_data);
+            tpool_scope_leave(previous_scope);
         }
-        pthread_mutex_unlock(&thread_pool->tpool_lock);
+        return true;
+    }
 
-        cpu_sleep_nano(TPOOL_SYNC_NANO);
+    struct thread_task* new_task = calloc(1, sizeof(struct thread_task));
+    if (new_task == NULL)
+    {
+        return false;
     }
+    tpool_task_init(task_operation, task_data, new_task);
+    new_task->task_group = task_group;
+    new_task->task_scope.scope_parent = &task_group->group_scope;
 
-    for (size_t worker_cur = 0; sync_done && worker_cur < thread_pool->worker_cnt; )
+    /* Counted before a worker can finish it */
+    pthread_mutex_lock(&task_group->group_lock);
+    task_group->tasks_pending++;
+    pthread_mutex_unlock(&task_group->group_lock);
+
+    if (tpool_enqueue(new_task, thread_pool) == false)
     {
-        /* Wait until we can cancel the thread */
-        if (thread_pool->worker_threads[worker_cur].can_cancel == 1)
+        tpool_task_discard(new_task);
+        free((void*)new_task);
+        tpool_group_leave(task_group);
+        return false;
+    }
+
+    pthread_mutex_unlock(&new_task->task_mutex);
+    __force_worker_execution(thread_pool);
+
+    return true;
+}
+
+/* Waits until all tasks from the group has finished, while waiting, the caller thread
+ * executes pending tasks from the queue, so a worker waiting for his own sub-tasks
+ * can't starve the pool 
+*/
+bool tpool_group_wait(tpool_group_t* task_group, tpool_t* thread_pool)
+{
+    pthread_mutex_lock(&task_group->group_lock);
+
+    while (task_group->tasks_pending != 0)
+    {
+        pthread_mutex_unlock(&task_group->group_lock);
+
+        struct thread_task* pending_task = NULL;
+        if (thread_pool != NULL)
+        {
+            pending_task = queue_dequeue(thread_pool->task_queue_safe);
+        }
+
+        pthread_mutex_lock(&task_group->group_lock);
+        if (pending_task != NULL)
         {
-            worker_cur++;
+            pthread_mutex_unlock(&task_group->group_lock);
+            tpool_run_task(pending_task);
+            pthread_mutex_lock(&task_group->group_lock);
+            continue;
         }
-        /* At this moment, the thead is waiting until the next task begins pushed */
+
+        if (task_group->tasks_pending == 0)
+        {
+            break;
+        }
+
+        struct timespec wait_limit;
+        tpool_wait_limit(TPOOL_GROUP_WAIT_NANO, &wait_limit);
+        pthread_cond_timedwait(&task_group->group_done, &task_group->group_lock, &wait_limit);
     }
 
-    return sync_done;
+    pthread_mutex_unlock(&task_group->group_lock);
+
+    return true;
+}
+
+bool tpool_group_destroy(tpool_group_t* task_group)
+{
+    assert(task_group->tasks_pending == 0);
+
+    /* Same as tasks, the last notifier may still be releasing the lock */
+    pthread_mutex_lock(&task_group->group_lock);
+    pthread_mutex_unlock(&task_group->group_lock);
+
+    pthread_cond_destroy(&task_group->group_done);
+    pthread_mutex_destroy(&task_group->group_lock);
+
+    return true;
+}
+
+bool tpool_group_cancel(tpool_group_t* task_group)
+{
+    tpool_scope_cancel(&task_group->group_scope);
+
+    return true;
 }
 
+tpool_task_t* tpool_submit(function_task_t task_operation, void* task_data, uint64_t deadline_nanos, tpool_t* thread_pool)
+{
+    if (thread_pool->thread_pool_run == 0)
+    {
+        return NULL;
+    }
+
+    tpool_spawn(thread_pool);
+    if (thread_pool->workers_planned == 0)
+    {
+        return NULL;
+    }
+
+    struct thread_task* new_task = calloc(1, sizeof(struct thread_task));
+    if (new_task == NULL)
+    {
+        return NULL;
+    }
+    tpool_task_init(task_operation, task_data, new_task);
+    /* Joined by the submitter, the task may outlive the scope it was submitted from */
+    tpool_scope_init(deadline_nanos, &new_task->task_scope);
+    new_task->task_scope.scope_parent = NULL;
+    new_task->task_refs = 2;
+
+    if (tpool_enqueue(new_task, thread_pool) == false)
+    {
+        tpool_task_discard(new_task);
+        free((void*)new_task);
+        return NULL;
+    }
+
+    pthread_mutex_unlock(&new_task->task_mutex);
+    __force_worker_execution(thread_pool);
+
+    return new_task;
+}
+
+bool tpool_cancel_task(tpool_task_t* task)
+{
+    tpool_scope_cancel(&task->task_scope);
+
+    /* Running or done already */
+    if (atomic_exchange(&task->task_claimed, 1) != 0)
+    {
+        return false;
+    }
+
+    /* The worker that dequeues it only drops his reference */
+    pthread_mutex_lock(&task->task_mutex);
+    task->task_ran = false;
+    task->task_completed = 1;
+    pthread_cond_signal(&task->task_finished);
+    pthread_mutex_unlock(&task->task_mutex);
+
+    return true;
+}
+
+bool tpool_task_join(void** task_result, tpool_task_t* task)
+{
+    pthread_mutex_lock(&task->task_mutex);
+
+    /* Still queued, waiting behind the queue would only add his latency */
+    if (atomic_exchange(&task->task_claimed, 1) == 0)
+    {
+        task->task_result = tpool_task_call(task);
+        task->task_completed = 1;
+    }
+
+    while (task->task_completed == 0)
+    {
+        pthread_cond_wait(&task->task_finished, &task->task_mutex);
+    }
+
+    bool task_ran = task->task_ran;
+    if (task_result != NULL)
+    {
+        *task_result = task->task_result;
+    }
+    pthread_mutex_unlock(&task->task_mutex);
+
+    tpool_task_release(task);
+
+    return task_ran;
+}
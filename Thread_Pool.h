@@ -1,12 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
 #include <stdint.h>
 #include <pthread.h>
 
 #include "data/FIFO_Queue.h"
+#include "data/Memory_Arena.h"
 
 #define TPOOL_USES_DETACHED 1
 
+/* The most workers a pool takes, -max-thread and settings.toml are held to it */
+#define TPOOL_WORKERS_MAX 255
+
 typedef void* (*function_task_t)(void* task_data);
 
+/* What tpool_should_stop looks at. A scope stops when it's cancelled, when his deadline has
+ * passed or when the scope current at his creation stops: a group opened by a task stops with
+ * the task, and so do the tasks of the group
+*/
+typedef struct tpool_scope
+{
+    _Atomic uint_least8_t scope_cancelled;
+
+    /* In cpu_ticks(), 0 without a deadline */
+    uint64_t scope_deadline;
+
+    const struct tpool_scope* scope_parent;
+
+} tpool_scope_t;
+
+/* A task submitted by tpool_submit, valid until tpool_task_join */
+typedef struct thread_task tpool_task_t;
+
 typedef struct worker_thread
 {
     /* Worker thread id, used for maintenance and identification purposes
@@ -19,13 +44,30 @@ typedef struct worker_thread
 
     _Atomic uint_least8_t can_cancel;
 
+    /* The NUMA node the worker is kept on, -1 when the host has a single one */
+    int worker_node;
+
+    /* Memory of the tasks on the node of the worker, they reach it with arena_scratch() */
+    memory_arena_t* worker_scratch;
+
 } worker_thread_t;
 
 typedef struct tpool 
 {
+    /* Workers alive, 0 until the first task is submitted */
     size_t worker_cnt;
+
+    /* The count given to tpool_init, the threads are created by the first submission. Lowered
+     * to the threads that could be created, 0 when none could */
+    size_t workers_planned;
+
+    _Atomic uint_least8_t workers_started;
+
+    /* Time spent creating the workers, reported by --startup-trace */
+    uint64_t spawn_nanos;
+
     /* Store the count of workers actually running a task */
-    size_t workers_running;
+    _Atomic size_t workers_running;
 
     size_t workers_in_waiting;
 
@@ -36,28 +78,115 @@ typedef struct tpool
 
     pthread_cond_t tpool_sync_tasks;
 
+    /* Signaled with tpool_lock when the last running worker is done, tpool_sync waits on it */
+    pthread_cond_t tpool_idle;
+
     _Atomic uint_fast8_t thread_pool_run;
 
     #if TPOOL_USES_DETACHED
     _Atomic uint_least8_t pool_begin_destroyed;
     #endif
 
-    struct timespec* __wait;
+    /* How long an idle worker sleeps between two looks at the queue, set by tpool_init and
+     * never changed, the workers read it without a lock
+    */
+    const struct timespec* __wait;
     FIFO_queue_t* task_queue_safe;
 } tpool_t;
 
+/* A set of tasks that can be waited as a whole, the caller submits as many tasks as it
+ * wants and joins them all at once, the tasks results are discarded!
+*/
+typedef struct tpool_group
+{
+    /* Count of submitted tasks that hasn't been finished yet */
+    _Atomic size_t tasks_pending;
+
+    pthread_mutex_t group_lock;
+
+    pthread_cond_t group_done;
+
+    /* The tasks of the group run into it, the queued ones are dropped once it has stopped */
+    tpool_scope_t group_scope;
+
+} tpool_group_t;
+
+/* Below this count of tasks, a pool without workers yet runs them on the caller thread, it's
+ * cheaper than starting the threads for them
+*/
+#define TPOOL_INLINE_TASKS 8
+
+/* Waits until the queue is empty and no worker runs a task */
 bool tpool_sync(tpool_t* thread_pool);
 
 bool tpool_init(int worker_count, tpool_t* thread_pool);
 
+/* The tasks queued before are still run, the submissions after it fail (tpool_execute and
+ * tpool_group_execute return false, tpool_wait_for_result NULL), it can be called from any
+ * thread and more than once
+*/
 bool tpool_stop(tpool_t* thread_pool);
 
 bool tpool_finalize(tpool_t* thread_pool);
 
+/* The planned count, the workers may not be started yet */
 size_t tpool_workers(const tpool_t* thread_pool);
 
+bool tpool_started(const tpool_t* thread_pool);
+
+/* The pool to give to tpool_group_execute for `tasks_count` tasks: NULL (inline) when they are
+ * few and the workers weren't needed until now, or when no worker could be started
+*/
+tpool_t* tpool_for_tasks(size_t tasks_count, tpool_t* thread_pool);
+
 int tpool_wait_ava(tpool_t* thread_pool);
 
+/* Both wait until a worker is idle, a task that submits other tasks must use a group */
 bool tpool_execute(function_task_t task_operation, void* task_data, tpool_t* thread_pool);
 
 void* tpool_wait_for_result(function_task_t task_operation, void* task_data, tpool_t* thread_pool);
+
+bool tpool_group_init(tpool_group_t* task_group);
+
+bool tpool_group_execute(function_task_t task_operation, void* task_data, tpool_group_t* task_group, tpool_t* thread_pool);
+
+bool tpool_group_wait(tpool_group_t* task_group, tpool_t* thread_pool);
+
+bool tpool_group_destroy(tpool_group_t* task_group);
+
+/* The tasks of the group not started yet are dropped, the running ones see tpool_should_stop */
+bool tpool_group_cancel(tpool_group_t* task_group);
+
+/* The deadline is relative, 0 for none, the scope is chained to the one current on the caller */
+void tpool_scope_init(uint64_t deadline_nanos, tpool_scope_t* scope);
+
+/* The calling thread runs into `scope` until tpool_scope_leave, the previous scope is returned
+ * for it
+*/
+tpool_scope_t* tpool_scope_enter(tpool_scope_t* scope);
+
+void tpool_scope_leave(tpool_scope_t* previous_scope);
+
+void tpool_scope_cancel(tpool_scope_t* scope);
+
+bool tpool_scope_stopped(const tpool_scope_t* scope);
+
+/* Cheap enough for the loops of a long task (an atomic load and a read of the fast clock by
+ * scope), true when the work done by the calling thread isn't wanted anymore
+*/
+bool tpool_should_stop(void);
+
+/* Submits a task without waiting for an idle worker, with a deadline in nanoseconds (0 for none):
+ * a task that didn't start before it is dropped. The handle must be joined, once
+*/
+tpool_task_t* tpool_submit(function_task_t task_operation, void* task_data, uint64_t deadline_nanos, tpool_t* thread_pool);
+
+/* True when the task won't run, a running task is only told through tpool_should_stop */
+bool tpool_cancel_task(tpool_task_t* task);
+
+/* Waits for the task and releases the handle, a task still queued is run by the caller. False
+ * when the task was dropped, the result is NULL then
+*/
+bool tpool_task_join(void** task_result, tpool_task_t* task);
+
+#endif
@@ -0,0 +1,566 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Settings.h"
+#include "Thread_Pool.h"
+
+enum settings_type
+{
+    SETTINGS_STRING,
+    SETTINGS_INTEGER,
+    SETTINGS_BOOLEAN,
+    SETTINGS_STRINGS
+};
+
+struct settings_field
+{
+    const char* field_table;
+
+    const char* field_key;
+
+    enum settings_type field_type;
+
+    size_t field_offset;
+};
+
+static const struct settings_field settings_fields[] = {
+    { "droidcat", "max_thread", SETTINGS_INTEGER, offsetof(settings_t, max_thread) },
+    { "droidcat", "use_max_cpu", SETTINGS_BOOLEAN, offsetof(settings_t, use_max_cpu) },
+    { "droidcat", "config_filename", SETTINGS_STRING, offsetof(settings_t, config_filename) },
+    { "log", "filename", SETTINGS_STRING, offsetof(settings_t, log_filename) },
+    { "log", "level", SETTINGS_STRING, offsetof(settings_t, log_level) },
+    { "input", "default_input", SETTINGS_STRING, offsetof(settings_t, default_input) },
+    { "output", "unknown_output", SETTINGS_STRINGS, offsetof(settings_t, unknown_output) },
+};
+
+struct settings_parser
+{
+    const char* cursor;
+
+    const char* source_end;
+
+    size_t parser_line;
+
+    /* Points into the source, nothing is copied */
+    const char* table_name;
+
+    size_t table_length;
+
+    const char* key_name;
+
+    size_t key_length;
+
+    settings_t* settings;
+
+    settings_error_t* error;
+};
+
+static bool settings_fail(const char* message, struct settings_parser* parser)
+{
+    parser->error->error_line = parser->parser_line;
+    snprintf(parser->error->error_message, sizeof(parser->error->error_message), message,
+        (int)parser->key_length, parser->key_name != NULL ? parser->key_name : "");
+
+    return false;
+}
+
+static void settings_skip_blank(struct settings_parser* parser)
+{
+    while (parser->cursor < parser->source_end && (*parser->cursor == ' ' || *parser->cursor == '\t'))
+    {
+        parser->cursor++;
+    }
+}
+
+/* Inside arrays the values can be split over many lines */
+static void settings_skip_trivia(struct settings_parser* parser)
+{
+    for (;;)
+    {
+        settings_skip_blank(parser);
+        if (parser->cursor == parser->source_end)
+        {
+            return;
+        }
+
+        if (*parser->cursor == '#')
+        {
+            while (parser->cursor < parser->source_end && *parser->cursor != '\n')
+            {
+                parser->cursor++;
+            }
+        }
+        else if (*parser->cursor == '\n')
+        {
+            parser->cursor++;
+            parser->parser_line++;
+        }
+        else if (*parser->cursor == '\r')
+        {
+            parser->cursor++;
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+/* Blanks and a comment may follow a value or a table */
+static bool settings_end_line(struct settings_parser* parser)
+{
+    settings_skip_blank(parser);
+
+    if (parser->cursor < parser->source_end && *parser->cursor == '#')
+    {
+        while (parser->cursor < parser->source_end && *parser->cursor != '\n')
+        {
+            parser->cursor++;
+        }
+    }
+    if (parser->cursor < parser->source_end && *parser->cursor == '\r')
+    {
+        parser->cursor++;
+    }
+
+    if (parser->cursor == parser->source_end)
+    {
+        return true;
+    }
+    if (*parser->cursor != '\n')
+    {
+        return settings_fail("unexpected text after the value of %.*s", parser);
+    }
+    parser->cursor++;
+    parser->parser_line++;
+
+    return true;
+}
+
+static bool settings_is_bare(char key_char)
+{
+    return (key_char >= 'a' && key_char <= 'z') || (key_char >= 'A' && key_char <= 'Z') ||
+        (key_char >= '0' && key_char <= '9') || key_char == '_' || key_char == '-';
+}
+
+static size_t settings_bare_name(struct settings_parser* parser)
+{
+    const char* name_begin = parser->cursor;
+
+    while (parser->cursor < parser->source_end && settings_is_bare(*parser->cursor))
+    {
+        parser->cursor++;
+    }
+    return (size_t)(parser->cursor - name_begin);
+}
+
+/* Basic strings with escapes and literal strings, `value` may be NULL for unknown keys */
+static bool settings_parse_string(char* value, struct settings_parser* parser)
+{
+    char quote = *parser->cursor++;
+    size_t value_length = 0;
+
+    for (;;)
+    {
+        if (parser->cursor == parser->source_end || *parser->cursor == '\n')
+        {
+            return settings_fail("unterminated string in %.*s", parser);
+        }
+
+        char value_char = *parser->cursor++;
+        if (value_char == quote)
+        {
+            break;
+        }
+
+        if (value_char == '\\' && quote == '"')
+        {
+            switch (parser->cursor < parser->source_end ? *parser->cursor++ : '\0')
+            {
+            case '\\': value_char = '\\'; break;
+            case '"': value_char = '"'; break;
+            case 'n': value_char = '\n'; break;
+            case 't': value_char = '\t'; break;
+            default:
+                return settings_fail("invalid escape in %.*s", parser);
+            }
+        }
+
+        if (value_length + 1 == SETTINGS_STRING_MAX)
+        {
+            return settings_fail("string too long in %.*s", parser);
+        }
+        if (value != NULL)
+        {
+            value[value_length] = value_char;
+        }
+        value_length++;
+    }
+
+    if (value != NULL)
+    {
+        value[value_length] = '\0';
+    }
+    return true;
+}
+
+static bool settings_parse_value(const struct settings_field* field, struct settings_parser* parser)
+{
+    uint8_t* field_data = field != NULL ? (uint8_t*)parser->settings + field->field_offset : NULL;
+    char value_char = parser->cursor < parser->source_end ? *parser->cursor : '\0';
+
+    if (value_char == '"' || value_char == '\'')
+    {
+        if (field != NULL && field->field_type != SETTINGS_STRING)
+        {
+            return settings_fail("%.*s doesn't take a string", parser);
+        }
+        return settings_parse_string((char*)field_data, parser);
+    }
+
+    if (value_char == '[')
+    {
+        if (field != NULL && field->field_type != SETTINGS_STRINGS)
+        {
+            return settings_fail("%.*s doesn't take an array", parser);
+        }
+
+        size_t* values_count = field != NULL ? &parser->settings->outputs_count : NULL;
+        if (values_count != NULL)
+        {
+            *values_count = 0;
+        }
+
+        parser->cursor++;
+        for (;;)
+        {
+            settings_skip_trivia(parser);
+            if (parser->cursor == parser->source_end)
+            {
+                return settings_fail("unterminated array in %.*s", parser);
+            }
+            if (*parser->cursor == ']')
+            {
+                parser->cursor++;
+                return true;
+            }
+
+            if (field == NULL)
+            {
+                if (settings_parse_value(NULL, parser) == false)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                if (*parser->cursor != '"' && *parser->cursor != '\'')
+                {
+                    return settings_fail("%.*s takes only strings", parser);
+                }
+                if (*values_count == SETTINGS_OUTPUTS_MAX)
+                {
+                    return settings_fail("too many values in %.*s", parser);
+                }
+                char (*values)[SETTINGS_STRING_MAX] = (char (*)[SETTINGS_STRING_MAX])field_data;
+                if (settings_parse_string(values[(*values_count)++], parser) == false)
+                {
+                    return false;
+                }
+            }
+
+            settings_skip_trivia(parser);
+            if (parser->cursor < parser->source_end && *parser->cursor == ',')
+            {
+                parser->cursor++;
+            }
+            else if (parser->cursor == parser->source_end || *parser->cursor != ']')
+            {
+                return settings_fail("expected ',' or ']' in %.*s", parser);
+            }
+        }
+    }
+
+    size_t word_length = settings_bare_name(parser);
+    const char* word = parser->cursor - word_length;
+
+    if ((word_length == 4 && memcmp(word, "true", 4) == 0) || (word_length == 5 && memcmp(word, "false", 5) == 0))
+    {
+        if (field != NULL && field->field_type != SETTINGS_BOOLEAN)
+        {
+            return settings_fail("%.*s doesn't take a boolean", parser);
+        }
+        if (field != NULL)
+        {
+            *(bool*)field_data = word_length == 4;
+        }
+        return true;
+    }
+
+    /* The sign isn't a bare character */
+    bool negative = false;
+    if (word_length == 0 && (value_char == '-' || value_char == '+'))
+    {
+        negative = value_char == '-';
+        parser->cursor++;
+        word_length = settings_bare_name(parser);
+        word = parser->cursor - word_length;
+    }
+
+    long long integer = 0;
+    size_t digit_cur = 0;
+    for (; digit_cur < word_length && integer < 1000000000; digit_cur++)
+    {
+        if ((word[digit_cur] < '0' || word[digit_cur] > '9') && word[digit_cur] != '_')
+        {
+            break;
+        }
+        if (word[digit_cur] != '_')
+        {
+            integer = integer * 10 + (word[digit_cur] - '0');
+        }
+    }
+    if (word_length == 0 || digit_cur != word_length)
+    {
+        return settings_fail("invalid value for %.*s", parser);
+    }
+
+    if (field != NULL)
+    {
+        if (field->field_type != SETTINGS_INTEGER)
+        {
+            return settings_fail("%.*s doesn't take an integer", parser);
+        }
+        /* Same limits as -max-thread */
+        if (negative || integer <= 0 || integer > TPOOL_WORKERS_MAX)
+        {
+            return settings_fail("%.*s is out of range", parser);
+        }
+        *(int*)field_data = (int)integer;
+    }
+    return true;
+}
+
+static const struct settings_field* settings_find(const struct settings_parser* parser)
+{
+    for (size_t field_cur = 0; field_cur < sizeof(settings_fields) / sizeof(*settings_fields); field_cur++)
+    {
+        const struct settings_field* field = &settings_fields[field_cur];
+
+        if (strlen(field->field_table) == parser->table_length && memcmp(field->field_table, parser->table_name, parser->table_length) == 0 &&
+            strlen(field->field_key) == parser->key_length && memcmp(field->field_key, parser->key_name, parser->key_length) == 0)
+        {
+            return field;
+        }
+    }
+    return NULL;
+}
+
+void settings_defaults(settings_t* settings)
+{
+    memset(settings, 0, sizeof(*settings));
+
+    strcpy(settings->config_filename, SETTINGS_DEFAULT_FILE);
+    strcpy(settings->log_filename, "droidcat.log");
+    strcpy(settings->log_level, "warn");
+}
+
+bool settings_parse(const char* source, size_t source_size, settings_t* settings, settings_error_t* error)
+{
+    struct settings_parser parser = {
+        .cursor = source,
+        .source_end = source + source_size,
+        .parser_line = 1,
+        .settings = settings,
+        .error = error
+    };
+
+    memset(error, 0, sizeof(*error));
+
+    while (parser.cursor < parser.source_end)
+    {
+        settings_skip_blank(&parser);
+        parser.key_name = NULL;
+        parser.key_length = 0;
+
+        if (parser.cursor == parser.source_end || *parser.cursor == '#' || *parser.cursor == '\r' || *parser.cursor == '\n')
+        {
+            if (settings_end_line(&parser) == false)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (*parser.cursor == '[')
+        {
+            parser.cursor++;
+            settings_skip_blank(&parser);
+            parser.table_length = settings_bare_name(&parser);
+            parser.table_name = parser.cursor - parser.table_length;
+            settings_skip_blank(&parser);
+
+            if (parser.table_length == 0 || parser.cursor == parser.source_end || *parser.cursor != ']')
+            {
+                return settings_fail("invalid table name", &parser);
+            }
+            parser.cursor++;
+
+            if (settings_end_line(&parser) == false)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        parser.key_length = settings_bare_name(&parser);
+        parser.key_name = parser.cursor - parser.key_length;
+        if (parser.key_length == 0)
+        {
+            return settings_fail("expected a key", &parser);
+        }
+
+        settings_skip_blank(&parser);
+        if (parser.cursor == parser.source_end || *parser.cursor != '=')
+        {
+            return settings_fail("expected '=' after %.*s", &parser);
+        }
+        parser.cursor++;
+        settings_skip_blank(&parser);
+
+        if (settings_parse_value(settings_find(&parser), &parser) == false || settings_end_line(&parser) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void settings_wait_readers(size_t epoch_index, settings_store_t* store)
+{
+    while (atomic_load(&store->epoch_readers[epoch_index]) != 0)
+    {
+        sched_yield();
+    }
+}
+
+/* Readers that have loaded the old snapshot are counted in one of the two counters: the
+ * idle one is drained first (late readers there will see the new snapshot), then the epoch
+ * moves and the active one is drained
+*/
+static void settings_publish(settings_t* new_settings, settings_store_t* store)
+{
+    pthread_mutex_lock(&store->update_lock);
+
+    new_settings->settings_generation = ++store->generation;
+    settings_t* old_settings = atomic_exchange(&store->current_settings, new_settings);
+
+    size_t active_index = atomic_load(&store->store_epoch) & 1;
+    settings_wait_readers(active_index ^ 1, store);
+    atomic_fetch_add(&store->store_epoch, 1);
+    settings_wait_readers(active_index, store);
+
+    pthread_mutex_unlock(&store->update_lock);
+
+    free((void*)old_settings);
+}
+
+bool settings_store_init(settings_store_t* store)
+{
+    settings_t* settings = malloc(sizeof(settings_t));
+    if (settings == NULL)
+    {
+        return false;
+    }
+    settings_defaults(settings);
+
+    memset(store, 0, sizeof(*store));
+    pthread_mutex_init(&store->update_lock, NULL);
+
+    settings->settings_generation = ++store->generation;
+    atomic_store(&store->current_settings, settings);
+
+    return true;
+}
+
+bool settings_store_deinit(settings_store_t* store)
+{
+    free((void*)atomic_exchange(&store->current_settings, NULL));
+    pthread_mutex_destroy(&store->update_lock);
+
+    return true;
+}
+
+bool settings_load(const char* settings_path, settings_error_t* error, settings_store_t* store)
+{
+    memset(error, 0, sizeof(*error));
+
+    int settings_fd = open(settings_path, O_RDONLY | O_CLOEXEC);
+    struct stat settings_stat;
+
+    if (settings_fd < 0 || fstat(settings_fd, &settings_stat) != 0)
+    {
+        snprintf(error->error_message, sizeof(error->error_message), "can't open: %s", strerror(errno));
+        if (settings_fd >= 0)
+        {
+            close(settings_fd);
+        }
+        return false;
+    }
+
+    size_t source_size = (size_t)settings_stat.st_size;
+    const char* source = source_size != 0 ? mmap(NULL, source_size, PROT_READ, MAP_PRIVATE, settings_fd, 0) : "";
+    close(settings_fd);
+
+    settings_t* new_settings = malloc(sizeof(settings_t));
+    if (source == MAP_FAILED || new_settings == NULL)
+    {
+        snprintf(error->error_message, sizeof(error->error_message), "can't read: %s", strerror(errno));
+        if (source != MAP_FAILED && source_size != 0)
+        {
+            munmap((void*)source, source_size);
+        }
+        free((void*)new_settings);
+        return false;
+    }
+
+    settings_defaults(new_settings);
+    bool load_ret = settings_parse(source, source_size, new_settings, error);
+
+    if (source_size != 0)
+    {
+        munmap((void*)source, source_size);
+    }
+
+    if (load_ret == false)
+    {
+        free((void*)new_settings);
+        return false;
+    }
+    settings_publish(new_settings, store);
+
+    return true;
+}
+
+const settings_t* settings_acquire(size_t* read_epoch, settings_store_t* store)
+{
+    *read_epoch = atomic_load(&store->store_epoch) & 1;
+    atomic_fetch_add(&store->epoch_readers[*read_epoch], 1);
+
+    return atomic_load(&store->current_settings);
+}
+
+void settings_release(size_t read_epoch, settings_store_t* store)
+{
+    atomic_fetch_sub(&store->epoch_readers[read_epoch], 1);
+}
@@ -0,0 +1,89 @@
+#ifndef CONFIG_SETTINGS_H
+#define CONFIG_SETTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define SETTINGS_STRING_MAX 256
+#define SETTINGS_OUTPUTS_MAX 8
+
+#define SETTINGS_DEFAULT_FILE "settings.toml"
+
+/* A parsed settings.toml, never changed after being published */
+typedef struct settings
+{
+    /* [droidcat], 0 when not specified */
+    int max_thread;
+
+    bool use_max_cpu;
+
+    char config_filename[SETTINGS_STRING_MAX];
+
+    /* [log] */
+    char log_filename[SETTINGS_STRING_MAX];
+
+    /* "trace", "debug", "info", "warn", "error" or "off" */
+    char log_level[SETTINGS_STRING_MAX];
+
+    /* [input], used when the command line has no inputs */
+    char default_input[SETTINGS_STRING_MAX];
+
+    /* [output], the first one is used when the command line has no output */
+    char unknown_output[SETTINGS_OUTPUTS_MAX][SETTINGS_STRING_MAX];
+
+    size_t outputs_count;
+
+    /* Increases with each published snapshot */
+    uint64_t settings_generation;
+
+} settings_t;
+
+typedef struct settings_error
+{
+    /* 0 when the file can't be read */
+    size_t error_line;
+
+    char error_message[256];
+
+} settings_error_t;
+
+/* The current snapshot, readers never lock: they mark themselves in one of the two epoch
+ * counters and a new snapshot only waits for the counters to drain before freeing the old one
+*/
+typedef struct settings_store
+{
+    _Atomic(settings_t*) current_settings;
+
+    atomic_size_t store_epoch;
+
+    atomic_size_t epoch_readers[2];
+
+    /* Serializes the writers */
+    pthread_mutex_t update_lock;
+
+    uint64_t generation;
+
+} settings_store_t;
+
+void settings_defaults(settings_t* settings);
+
+/* A TOML subset in a single pass without allocations: tables, bare keys, strings, integers,
+ * booleans and arrays of strings. Unknown tables and keys are ignored
+*/
+bool settings_parse(const char* source, size_t source_size, settings_t* settings, settings_error_t* error);
+
+/* Starts with the defaults */
+bool settings_store_init(settings_store_t* store);
+bool settings_store_deinit(settings_store_t* store);
+
+/* Parses the file into a new snapshot and publishes it, on errors the current one stays */
+bool settings_load(const char* settings_path, settings_error_t* error, settings_store_t* store);
+
+/* The snapshot stays valid until the release, hold it only for short reads */
+const settings_t* settings_acquire(size_t* read_epoch, settings_store_t* store);
+void settings_release(size_t read_epoch, settings_store_t* store);
+
+#endif
@@ -1,4 +1,9 @@
 #include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #if _XOPEN_SOURCE >= 500
 
@@ -6,23 +11,328 @@
 
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #include "CPU_Time.h"
 
+/* The TSC frequency is final after this much time of calibration */
+#define CPU_TIME_CALIBRATION_NANO 100000000 /* 100 milliseconds */
+#define CPU_TIME_CALIBRATION_MIN_NANO 1000000 /* 1 millisecond */
+
+enum cpu_ticks_source
+{
+    CPU_TICKS_CLOCK,
+
+    CPU_TICKS_TSC,
+
+    CPU_TICKS_COUNTER,
+};
+
+static pthread_once_t cpu_ticks_once = PTHREAD_ONCE_INIT;
+static enum cpu_ticks_source cpu_ticks_from;
+
+/* The first reading of both clocks, the TSC rate is measured from them */
+static uint64_t cpu_ticks_base;
+static uint64_t cpu_nanos_base;
+
+/* Nanoseconds by tick, in 32.32 fixed point */
+static _Atomic uint64_t cpu_ticks_multiplier;
+static _Atomic uint_least8_t cpu_ticks_calibrated;
+
+/* Every accumulator ever created, threads included once they've exited */
+struct cpu_time_local
+{
+    cpu_time_stats_t local_stats[CPU_TIME_SLOTS];
+
+    /* Cleared when the owner exits, the next new thread takes the accumulator over */
+    _Atomic uint_least8_t local_owned;
+
+    struct cpu_time_local* local_next;
+};
+
+static _Thread_local struct cpu_time_local* cpu_thread_times;
+static _Atomic(struct cpu_time_local*) cpu_times_list;
+
+static pthread_once_t cpu_times_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cpu_times_key;
+
 int cpu_sleep_nano(size_t nanoseconds)
 {
     #if _POSIX_C_SOURCE >= 199309L
 
-    const struct timespec sleep_data = {
-        .tv_nsec = (long)nanoseconds, .tv_sec = 0
+    struct timespec sleep_data = {
+        .tv_sec = (time_t)(nanoseconds / 1000000000), .tv_nsec = (long)(nanoseconds % 1000000000)
     };
 
-    nanosleep(&sleep_data, NULL);
+    /* A signal handler may wake us before the time, the rest is slept */
+    while (nanosleep(&sleep_data, &sleep_data) != 0 && errno == EINTR) {}
 
     #elif _XOPEN_SOURCE >= 500
-    
-    usleep(nanoseconds * 1e-6);
+
+    usleep(nanoseconds / 1000);
 
     #endif
 
     return 0;
 }
+
+uint64_t cpu_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static inline uint64_t cpu_ticks_read(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (cpu_ticks_from == CPU_TICKS_TSC)
+    {
+        return __rdtsc();
+    }
+#elif defined(__aarch64__)
+    if (cpu_ticks_from == CPU_TICKS_COUNTER)
+    {
+        uint64_t counter;
+        __asm__ volatile ("isb; mrs %0, cntvct_el0" : "=r"(counter));
+        return counter;
+    }
+#endif
+    return cpu_nanos();
+}
+
+static void cpu_ticks_setup(void)
+{
+    cpu_ticks_from = CPU_TICKS_CLOCK;
+    atomic_store_explicit(&cpu_ticks_multiplier, (uint64_t)1 << 32, memory_order_relaxed);
+
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax, ebx, ecx, edx;
+
+    /* Only an invariant TSC ticks at the same rate on every core and frequency */
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007)
+    {
+        __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        cpu_ticks_from = edx & (1u << 8) ? CPU_TICKS_TSC : CPU_TICKS_CLOCK;
+    }
+#elif defined(__aarch64__)
+    /* The counter frequency is given by the system, nothing to calibrate */
+    uint64_t counter_frequency;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r"(counter_frequency));
+
+    if (counter_frequency != 0)
+    {
+        cpu_ticks_from = CPU_TICKS_COUNTER;
+        atomic_store_explicit(&cpu_ticks_multiplier, (uint64_t)(((unsigned __int128)1000000000 << 32) / counter_frequency), memory_order_relaxed);
+    }
+#endif
+
+    cpu_nanos_base = cpu_nanos();
+    cpu_ticks_base = cpu_ticks_read();
+
+    atomic_store_explicit(&cpu_ticks_calibrated, cpu_ticks_from != CPU_TICKS_TSC, memory_order_release);
+}
+
+uint64_t cpu_ticks(void)
+{
+    pthread_once(&cpu_ticks_once, cpu_ticks_setup);
+
+    return cpu_ticks_read();
+}
+
+static uint64_t cpu_ticks_rate(void)
+{
+    pthread_once(&cpu_ticks_once, cpu_ticks_setup);
+
+    if (atomic_load_explicit(&cpu_ticks_calibrated, memory_order_acquire))
+    {
+        return atomic_load_explicit(&cpu_ticks_multiplier, memory_order_relaxed);
+    }
+
+    uint64_t elapsed_nanos;
+    uint64_t elapsed_ticks;
+
+    do
+    {
+        elapsed_nanos = cpu_nanos() - cpu_nanos_base;
+        elapsed_ticks = cpu_ticks_read() - cpu_ticks_base;
+    } while (elapsed_nanos < CPU_TIME_CALIBRATION_MIN_NANO);
+
+    uint64_t multiplier = elapsed_ticks != 0 ? (uint64_t)(((unsigned __int128)elapsed_nanos << 32) / elapsed_ticks) : (uint64_t)1 << 32;
+    atomic_store_explicit(&cpu_ticks_multiplier, multiplier, memory_order_relaxed);
+
+    if (elapsed_nanos >= CPU_TIME_CALIBRATION_NANO)
+    {
+        atomic_store_explicit(&cpu_ticks_calibrated, 1, memory_order_release);
+    }
+    return multiplier;
+}
+
+uint64_t cpu_ticks_to_nanos(uint64_t ticks)
+{
+    return (uint64_t)(((unsigned __int128)ticks * cpu_ticks_rate()) >> 32);
+}
+
+uint64_t cpu_nanos_to_ticks(uint64_t nanos)
+{
+    uint64_t multiplier = cpu_ticks_rate();
+
+    return multiplier != 0 ? (uint64_t)(((unsigned __int128)nanos << 32) / multiplier) : nanos;
+}
+
+/* Only the owner thread writes, the relaxed atomics let the others read while it does */
+static inline void cpu_time_add(_Atomic uint64_t* counter, uint64_t value)
+{
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+void cpu_time_record(uint64_t ticks, cpu_time_stats_t* stats)
+{
+    size_t bucket = ticks != 0 ? (size_t)(63 - __builtin_clzll(ticks)) : 0;
+
+    cpu_time_add(&stats->samples_count, 1);
+    cpu_time_add(&stats->ticks_total, ticks);
+    cpu_time_add(&stats->histogram[bucket], 1);
+
+    if (ticks > atomic_load_explicit(&stats->ticks_max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&stats->ticks_max, ticks, memory_order_relaxed);
+    }
+}
+
+void cpu_time_merge(const cpu_time_stats_t* from, cpu_time_stats_t* into)
+{
+    cpu_time_add(&into->samples_count, atomic_load_explicit(&from->samples_count, memory_order_relaxed));
+    cpu_time_add(&into->ticks_total, atomic_load_explicit(&from->ticks_total, memory_order_relaxed));
+
+    for (size_t bucket_cur = 0; bucket_cur < CPU_TIME_BUCKETS; bucket_cur++)
+    {
+        cpu_time_add(&into->histogram[bucket_cur], atomic_load_explicit(&from->histogram[bucket_cur], memory_order_relaxed));
+    }
+
+    uint64_t from_max = atomic_load_explicit(&from->ticks_max, memory_order_relaxed);
+    if (from_max > atomic_load_explicit(&into->ticks_max, memory_order_relaxed))
+    {
+        atomic_store_explicit(&into->ticks_max, from_max, memory_order_relaxed);
+    }
+}
+
+uint64_t cpu_time_mean(const cpu_time_stats_t* stats)
+{
+    uint64_t samples_count = atomic_load_explicit(&stats->samples_count, memory_order_relaxed);
+
+    if (samples_count == 0)
+    {
+        return 0;
+    }
+    return cpu_ticks_to_nanos(atomic_load_explicit(&stats->ticks_total, memory_order_relaxed) / samples_count);
+}
+
+uint64_t cpu_time_percentile(double fraction, const cpu_time_stats_t* stats)
+{
+    uint64_t samples_count = atomic_load_explicit(&stats->samples_count, memory_order_relaxed);
+    uint64_t ticks_max = atomic_load_explicit(&stats->ticks_max, memory_order_relaxed);
+    uint64_t samples_wanted = (uint64_t)(fraction * (double)samples_count + 0.5);
+    uint64_t samples_seen = 0;
+
+    if (samples_count == 0)
+    {
+        return 0;
+    }
+    samples_wanted = samples_wanted == 0 ? 1 : samples_wanted;
+
+    for (size_t bucket_cur = 0; bucket_cur < CPU_TIME_BUCKETS; bucket_cur++)
+    {
+        samples_seen += atomic_load_explicit(&stats->histogram[bucket_cur], memory_order_relaxed);
+
+        if (samples_seen >= samples_wanted)
+        {
+            uint64_t bucket_end = bucket_cur == CPU_TIME_BUCKETS - 1 ? UINT64_MAX : ((uint64_t)2 << bucket_cur) - 1;
+            return cpu_ticks_to_nanos(bucket_end < ticks_max ? bucket_end : ticks_max);
+        }
+    }
+    return cpu_ticks_to_nanos(ticks_max);
+}
+
+/* The release pairs with the acquire of the next owner, he continues the sums */
+static void cpu_time_release(void* thread_times)
+{
+    atomic_store_explicit(&((struct cpu_time_local*)thread_times)->local_owned, 0, memory_order_release);
+}
+
+static void cpu_times_key_create(void)
+{
+    pthread_key_create(&cpu_times_key, cpu_time_release);
+}
+
+cpu_time_stats_t* cpu_time_local(cpu_time_slot_t time_slot)
+{
+    struct cpu_time_local* thread_times = cpu_thread_times;
+
+    if (thread_times == NULL)
+    {
+        pthread_once(&cpu_times_once, cpu_times_key_create);
+
+        /* A pool created again and again would add an accumulator by worker each time */
+        for (struct cpu_time_local* times_cur = atomic_load_explicit(&cpu_times_list, memory_order_acquire); times_cur != NULL;
+            times_cur = times_cur->local_next)
+        {
+            uint_least8_t times_owned = 0;
+            if (atomic_compare_exchange_strong_explicit(&times_cur->local_owned, &times_owned, 1,
+                memory_order_acquire, memory_order_relaxed))
+            {
+                thread_times = times_cur;
+                break;
+            }
+        }
+    }
+
+    if (thread_times == NULL)
+    {
+        thread_times = calloc(1, sizeof(*thread_times));
+        if (thread_times == NULL)
+        {
+            return NULL;
+        }
+        thread_times->local_owned = 1;
+
+        thread_times->local_next = atomic_load_explicit(&cpu_times_list, memory_order_relaxed);
+        while (atomic_compare_exchange_weak_explicit(&cpu_times_list, &thread_times->local_next, thread_times,
+            memory_order_release, memory_order_relaxed) == false) {}
+    }
+
+    if (cpu_thread_times == NULL)
+    {
+        pthread_setspecific(cpu_times_key, thread_times);
+        cpu_thread_times = thread_times;
+    }
+    return &thread_times->local_stats[time_slot];
+}
+
+void cpu_time_collect(cpu_time_slot_t time_slot, cpu_time_stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    for (struct cpu_time_local* times_cur = atomic_load_explicit(&cpu_times_list, memory_order_acquire); times_cur != NULL;
+        times_cur = times_cur->local_next)
+    {
+        cpu_time_merge(&times_cur->local_stats[time_slot], stats);
+    }
+}
+
+const char* cpu_time_slot_name(cpu_time_slot_t time_slot)
+{
+    static const char* const slot_names[CPU_TIME_SLOTS] = {
+        [CPU_TIME_TASK] = "task",
+        [CPU_TIME_INFLATE] = "inflate",
+        [CPU_TIME_DECODE_XML] = "decode-xml",
+        [CPU_TIME_DECODE_TABLE] = "decode-table",
+        [CPU_TIME_UNPACK] = "unpack"
+    };
+
+    return time_slot < CPU_TIME_SLOTS ? slot_names[time_slot] : "unknown";
+}
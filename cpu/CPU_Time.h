@@ -1,6 +1,121 @@
 #ifndef CPU_CPU_TIME_H
 #define CPU_CPU_TIME_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* One bucket by power of 2 of ticks */
+#define CPU_TIME_BUCKETS 64
+
+/* What the per-thread accumulators measure */
+typedef enum cpu_time_slot
+{
+    /* A task run by a worker of a thread pool */
+    CPU_TIME_TASK,
+
+    CPU_TIME_INFLATE,
+
+    CPU_TIME_DECODE_XML,
+
+    CPU_TIME_DECODE_TABLE,
+
+    /* An entry streamed as is into the output */
+    CPU_TIME_UNPACK,
+
+    CPU_TIME_SLOTS
+
+} cpu_time_slot_t;
+
+/* Durations in ticks, written by a single thread and readable from any other */
+typedef struct cpu_time_stats
+{
+    _Atomic uint64_t samples_count;
+
+    _Atomic uint64_t ticks_total;
+
+    _Atomic uint64_t ticks_max;
+
+    /* Bucket `n` counts the durations in [2^n, 2^(n+1)) ticks */
+    _Atomic uint64_t histogram[CPU_TIME_BUCKETS];
+
+} cpu_time_stats_t;
+
+typedef struct cpu_timer
+{
+    uint64_t timer_start;
+
+    /* NULL when the timer doesn't measure */
+    cpu_time_stats_t* timer_stats;
+
+} cpu_timer_t;
+
 int cpu_sleep_nano(size_t nanoseconds);
 
+/* CLOCK_MONOTONIC_RAW, not slewed by NTP */
+uint64_t cpu_nanos(void);
+
+/* The fast clock: the TSC when it's invariant, the virtual counter on AArch64 and the raw
+ * monotonic clock otherwise. The ticks are only meaningful as differences
+*/
+uint64_t cpu_ticks(void);
+
+/* The TSC frequency is calibrated against the raw clock since the first call of cpu_ticks,
+ * a conversion in his first millisecond waits for it
+*/
+uint64_t cpu_ticks_to_nanos(uint64_t ticks);
+
+/* The opposite, for the deadlines compared against cpu_ticks() */
+uint64_t cpu_nanos_to_ticks(uint64_t nanos);
+
+void cpu_time_record(uint64_t ticks, cpu_time_stats_t* stats);
+
+void cpu_time_merge(const cpu_time_stats_t* from, cpu_time_stats_t* into);
+
+/* In nanoseconds, the percentile is the upper bound of his bucket (at most the maximum) */
+uint64_t cpu_time_mean(const cpu_time_stats_t* stats);
+uint64_t cpu_time_percentile(double fraction, const cpu_time_stats_t* stats);
+
+/* The accumulator of the calling thread, created on his first use and kept after the thread
+ * exits (the pool workers are detached), a thread started later reuses it
+*/
+cpu_time_stats_t* cpu_time_local(cpu_time_slot_t time_slot);
+
+/* The sum of the accumulators of all threads */
+void cpu_time_collect(cpu_time_slot_t time_slot, cpu_time_stats_t* stats);
+
+const char* cpu_time_slot_name(cpu_time_slot_t time_slot);
+
+static inline cpu_timer_t cpu_timer_start(cpu_time_stats_t* stats)
+{
+    cpu_timer_t timer = { .timer_start = stats != NULL ? cpu_ticks() : 0, .timer_stats = stats };
+    return timer;
+}
+
+/* Records the duration once, returns it in ticks */
+static inline uint64_t cpu_timer_stop(cpu_timer_t* timer)
+{
+    if (timer->timer_stats == NULL)
+    {
+        return 0;
+    }
+    uint64_t ticks = cpu_ticks() - timer->timer_start;
+
+    cpu_time_record(ticks, timer->timer_stats);
+    timer->timer_stats = NULL;
+    return ticks;
+}
+
+static inline void cpu_timer_scope_end(cpu_timer_t* timer)
+{
+    cpu_timer_stop(timer);
+}
+
+#define CPU_TIMER_JOIN_(prefix, line) prefix##line
+#define CPU_TIMER_JOIN(prefix, line) CPU_TIMER_JOIN_(prefix, line)
+
+/* Measures until the end of the enclosing block, whatever the way it's left */
+#define CPU_TIMER_SCOPE(stats) \
+    cpu_timer_t CPU_TIMER_JOIN(scope_timer_, __LINE__) __attribute__((cleanup(cpu_timer_scope_end))) = cpu_timer_start(stats)
+
 #endif
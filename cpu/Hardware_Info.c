@@ -1,7 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#elif defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 #include "Hardware_Info.h"
 
+/* The features are read once, the kernels may be bound from any thread */
+static _Atomic uint_least8_t cpu_identified;
+static _Atomic uint32_t cpu_host_features;
+static _Atomic uint32_t cpu_allowed_features = UINT32_MAX;
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* XCR0, the register states the OS saves on context switches */
+static uint64_t cpu_xgetbv(void)
+{
+    uint32_t xcr_low, xcr_high;
+    __asm__ volatile ("xgetbv" : "=a"(xcr_low), "=d"(xcr_high) : "c"(0));
+
+    return (uint64_t)xcr_high << 32 | xcr_low;
+}
+
+static void cpu_identify_x86(physical_CPU_t* physical_CPU)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (__get_cpuid(0, &eax, &ebx, &ecx, &edx) == 0)
+    {
+        return;
+    }
+    unsigned int max_leaf = eax;
+
+    memcpy(physical_CPU->vendor_name, &ebx, 4);
+    memcpy(physical_CPU->vendor_name + 4, &edx, 4);
+    memcpy(physical_CPU->vendor_name + 8, &ecx, 4);
+
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+
+    physical_CPU->cpu_family = (eax >> 8) & 0xf;
+    physical_CPU->cpu_model = (eax >> 4) & 0xf;
+    if (physical_CPU->cpu_family == 0xf)
+    {
+        physical_CPU->cpu_family += (eax >> 20) & 0xff;
+    }
+    if (physical_CPU->cpu_family == 0x6 || physical_CPU->cpu_family >= 0xf)
+    {
+        physical_CPU->cpu_model |= ((eax >> 16) & 0xf) << 4;
+    }
+
+    uint32_t features = 0;
+    features |= ecx & bit_SSE4_1 ? CPU_FEATURE_SSE41 : 0;
+    features |= ecx & bit_SSE4_2 ? CPU_FEATURE_SSE42 : 0;
+    features |= ecx & bit_PCLMUL ? CPU_FEATURE_PCLMUL : 0;
+
+    /* Without OSXSAVE the upper halves of the registers may be lost, AVX can't be used */
+    uint64_t saved_states = ecx & bit_OSXSAVE ? cpu_xgetbv() : 0;
+    bool avx_usable = (ecx & bit_AVX) && (saved_states & 0x6) == 0x6;
+    bool avx512_usable = avx_usable && (saved_states & 0xe0) == 0xe0;
+
+    if (max_leaf >= 7)
+    {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+        features |= avx_usable && (ebx & bit_AVX2) ? CPU_FEATURE_AVX2 : 0;
+        features |= ebx & bit_BMI2 ? CPU_FEATURE_BMI2 : 0;
+        features |= avx512_usable && (ebx & bit_AVX512F) ? CPU_FEATURE_AVX512F : 0;
+        features |= avx512_usable && (ebx & bit_AVX512BW) ? CPU_FEATURE_AVX512BW : 0;
+        features |= ebx & bit_SHA ? CPU_FEATURE_SHA : 0;
+    }
+    physical_CPU->cpu_features = features;
+
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 || eax < 0x80000004)
+    {
+        return;
+    }
+
+    /* The brand string, 48 bytes from 3 leaves */
+    uint32_t brand[12];
+    for (unsigned int leaf_cur = 0; leaf_cur < 3; leaf_cur++)
+    {
+        __get_cpuid(0x80000002 + leaf_cur, &brand[leaf_cur * 4], &brand[leaf_cur * 4 + 1], &brand[leaf_cur * 4 + 2],
+            &brand[leaf_cur * 4 + 3]);
+    }
+    const char* brand_name = (const char*)brand;
+    size_t brand_length = strnlen(brand_name, sizeof(brand));
+
+    while (brand_length != 0 && *brand_name == ' ')
+    {
+        brand_name++;
+        brand_length--;
+    }
+    snprintf(physical_CPU->model_name, sizeof(physical_CPU->model_name), "%.*s", (int)brand_length, brand_name);
+}
+
+#elif defined(__aarch64__)
+
+static const char* cpu_arm_implementer(uint32_t implementer)
+{
+    switch (implementer)
+    {
+    case 0x41: return "ARM";
+    case 0x42: return "Broadcom";
+    case 0x48: return "HiSilicon";
+    case 0x4e: return "NVIDIA";
+    case 0x51: return "Qualcomm";
+    case 0x61: return "Apple";
+    case 0xc0: return "Ampere";
+    default: return "AArch64";
+    }
+}
+
+static void cpu_identify_arm(physical_CPU_t* physical_CPU)
+{
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    uint32_t features = 0;
+
+    features |= hwcap & HWCAP_ASIMD ? CPU_FEATURE_ASIMD : 0;
+    features |= hwcap & HWCAP_CRC32 ? CPU_FEATURE_CRC32 : 0;
+    features |= hwcap & HWCAP_PMULL ? CPU_FEATURE_PMULL : 0;
+    features |= hwcap & HWCAP_SHA2 ? CPU_FEATURE_SHA2 : 0;
+    physical_CPU->cpu_features = features;
+
+    /* MIDR_EL1 isn't readable from user space, the kernel exports it */
+    unsigned long midr = 0;
+    FILE* midr_file = fopen("/sys/devices/system/cpu/cpu0/regs/identification/midr_el1", "r");
+    if (midr_file != NULL)
+    {
+        if (fscanf(midr_file, "%lx", &midr) != 1)
+        {
+            midr = 0;
+        }
+        fclose(midr_file);
+    }
+
+    snprintf(physical_CPU->vendor_name, sizeof(physical_CPU->vendor_name), "%s", cpu_arm_implementer((midr >> 24) & 0xff));
+    physical_CPU->cpu_family = (midr >> 16) & 0xf;
+    physical_CPU->cpu_model = (midr >> 4) & 0xfff;
+}
+
+#endif
+
+void cpu_identify(physical_CPU_t* physical_CPU)
+{
+    memset(physical_CPU, 0, sizeof(*physical_CPU));
+
+#if defined(__x86_64__) || defined(__i386__)
+    cpu_identify_x86(physical_CPU);
+#elif defined(__aarch64__)
+    cpu_identify_arm(physical_CPU);
+#endif
+}
+
+uint32_t cpu_features(void)
+{
+    if (atomic_load_explicit(&cpu_identified, memory_order_acquire) == 0)
+    {
+        /* Two threads may identify at the same time, with the same result */
+        physical_CPU_t host_CPU;
+        cpu_identify(&host_CPU);
+
+        atomic_store_explicit(&cpu_host_features, host_CPU.cpu_features, memory_order_relaxed);
+        atomic_store_explicit(&cpu_identified, 1, memory_order_release);
+    }
+    return atomic_load_explicit(&cpu_host_features, memory_order_relaxed) &
+        atomic_load_explicit(&cpu_allowed_features, memory_order_relaxed);
+}
+
+void cpu_features_limit(uint32_t features_mask)
+{
+    atomic_store_explicit(&cpu_allowed_features, features_mask, memory_order_relaxed);
+}
+
+const cpu_kernel_t* cpu_dispatch(const cpu_kernel_t* kernels, size_t kernels_count)
+{
+    uint32_t host_features = cpu_features();
+
+    for (size_t kernel_cur = 0; kernel_cur + 1 < kernels_count; kernel_cur++)
+    {
+        if ((kernels[kernel_cur].kernel_features & host_features) == kernels[kernel_cur].kernel_features)
+        {
+            return &kernels[kernel_cur];
+        }
+    }
+    return &kernels[kernels_count - 1];
+}
+
 int cpu_sched_cores(const physical_CPU_t* physical_CPU)
 {
-    return 0;
+    cpu_set_t sched_set;
+
+    (void)physical_CPU;
+    /* Only the cores that we are allowed to run on */
+    if (sched_getaffinity(0, sizeof(sched_set), &sched_set) != 0)
+    {
+        return 1;
+    }
+    return CPU_COUNT(&sched_set);
+}
+
+/* A kernel list as "0-3,8-11", the ranges are added to `list_set` */
+static bool cpu_parse_list(const char* list, cpu_set_t* list_set)
+{
+    CPU_ZERO(list_set);
+
+    while (*list != '\0' && *list != '\n')
+    {
+        char* number_end;
+        unsigned long range_first = strtoul(list, &number_end, 10);
+        unsigned long range_last = range_first;
+
+        if (number_end == list)
+        {
+            return false;
+        }
+        if (*number_end == '-')
+        {
+            list = number_end + 1;
+            range_last = strtoul(list, &number_end, 10);
+            if (number_end == list)
+            {
+                return false;
+            }
+        }
+
+        for (unsigned long cpu_cur = range_first; cpu_cur <= range_last && cpu_cur < CPU_SETSIZE; cpu_cur++)
+        {
+            CPU_SET(cpu_cur, list_set);
+        }
+        list = *number_end == ',' ? number_end + 1 : number_end;
+    }
+    return true;
+}
+
+static bool cpu_read_list(const char* list_path, cpu_set_t* list_set)
+{
+    char list[1024];
+    FILE* list_file = fopen(list_path, "r");
+
+    if (list_file == NULL)
+    {
+        return false;
+    }
+    bool read_ret = fgets(list, sizeof(list), list_file) != NULL;
+    fclose(list_file);
+
+    return read_ret && cpu_parse_list(list, list_set);
+}
+
+bool cpu_numa_cpus(int numa_node, cpu_set_t* node_cpus)
+{
+    char list_path[64];
+    cpu_set_t allowed_cpus;
+
+    snprintf(list_path, sizeof(list_path), "/sys/devices/system/node/node%d/cpulist", numa_node);
+    if (cpu_read_list(list_path, node_cpus) == false)
+    {
+        return false;
+    }
+
+    /* A cpuset or taskset may keep us out of some of them */
+    if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) == 0)
+    {
+        CPU_AND(node_cpus, node_cpus, &allowed_cpus);
+    }
+    return CPU_COUNT(node_cpus) != 0;
+}
+
+int cpu_numa_nodes(int* node_ids, int ids_max)
+{
+    cpu_set_t online_nodes;
+    int nodes_count = 0;
+
+    if (cpu_read_list("/sys/devices/system/node/online", &online_nodes) == false)
+    {
+        return 0;
+    }
+
+    for (int node_cur = 0; node_cur < CPU_NUMA_NODES_MAX && nodes_count < ids_max; node_cur++)
+    {
+        cpu_set_t node_cpus;
+
+        /* The memory only nodes have no core */
+        if (CPU_ISSET(node_cur, &online_nodes) && cpu_numa_cpus(node_cur, &node_cpus))
+        {
+            node_ids[nodes_count++] = node_cur;
+        }
+    }
+    return nodes_count;
+}
+
+int cpu_numa_current(void)
+{
+    unsigned int current_cpu, current_node;
+
+    if (getcpu(&current_cpu, &current_node) != 0)
+    {
+        return -1;
+    }
+    return (int)current_node;
 }
@@ -1,20 +1,95 @@
-
 #ifndef CPU_HARDWARE_INFO_H
 #define CPU_HARDWARE_INFO_H
 
+#include <sched.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* x86-64, the AVX ones only when the OS saves the vector registers */
+#define CPU_FEATURE_SSE41 (1u << 0)
+#define CPU_FEATURE_SSE42 (1u << 1)
+#define CPU_FEATURE_PCLMUL (1u << 2)
+#define CPU_FEATURE_AVX2 (1u << 3)
+#define CPU_FEATURE_BMI2 (1u << 4)
+#define CPU_FEATURE_AVX512F (1u << 5)
+#define CPU_FEATURE_AVX512BW (1u << 6)
+#define CPU_FEATURE_SHA (1u << 7)
+
+/* AArch64 */
+#define CPU_FEATURE_ASIMD (1u << 8)
+#define CPU_FEATURE_CRC32 (1u << 9)
+#define CPU_FEATURE_PMULL (1u << 10)
+#define CPU_FEATURE_SHA2 (1u << 11)
+
 typedef struct physical_CPU
 {
-    char *vendor_name;
+    /* "GenuineIntel", "AuthenticAMD", or the implementer of an ARM core */
+    char vendor_name[16];
+
+    /* The brand string when the CPU has one, empty otherwise */
+    char model_name[64];
+
+    uint32_t cpu_family;
+
+    uint32_t cpu_model;
+
+    /* CPU_FEATURE_* */
+    uint32_t cpu_features;
 
 } physical_CPU_t;
 
+/* One implementation of a hot kernel, the tables list them from the fastest to the portable
+ * one, which needs no feature
+*/
+typedef struct cpu_kernel
+{
+    const char* kernel_name;
+
+    /* All of them are needed */
+    uint32_t kernel_features;
+
+    /* Casted back to the kernel type by its module */
+    void (*kernel_function)(void);
+
+} cpu_kernel_t;
+
 int cpu_init(physical_CPU_t* physical_CPU);
 
+/* Reads the vendor, the model and the features of the host with CPUID (or the auxiliary
+ * vector on AArch64)
+*/
+void cpu_identify(physical_CPU_t* physical_CPU);
+
+/* The features of the host, identified once for the whole process */
+uint32_t cpu_features(void);
+
+/* Hides the features out of `features_mask` from the kernels bound after the call, the tests
+ * use it to run the portable paths
+*/
+void cpu_features_limit(uint32_t features_mask);
+
+/* The first kernel of the table the host can run, the modules call it once and keep the result */
+const cpu_kernel_t* cpu_dispatch(const cpu_kernel_t* kernels, size_t kernels_count);
+
 /* Retrieves the number of existence cores in the host physical CPU */
 int cpu_sched_cores(const physical_CPU_t* physical_CPU);
 
+/* Node identifiers beyond it are ignored */
+#define CPU_NUMA_NODES_MAX 64
+
+/* The NUMA nodes with at least a core we are allowed to run on, read from
+ * /sys/devices/system/node. Returns their count, 0 when the kernel exports no topology
+*/
+int cpu_numa_nodes(int* node_ids, int ids_max);
+
+/* The cores of `numa_node` we are allowed to run on */
+bool cpu_numa_cpus(int numa_node, cpu_set_t* node_cpus);
+
+/* The node of the core running the calling thread, -1 when unknown */
+int cpu_numa_current(void);
+
 int cpu_finalize(physical_CPU_t* physical_CPU);
 
 #endif
 
-
@@ -4,7 +4,7 @@
 
 int cpu_init(physical_CPU_t* physical_CPU)
 {
-    memset(physical_CPU, 0, sizeof(*physical_CPU));
+    cpu_identify(physical_CPU);
     return 0;
 }
 
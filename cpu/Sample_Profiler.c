@@ -0,0 +1,676 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <dlfcn.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Sample_Profiler.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* A stack is dropped after this many occupied slots */
+#define PROF_TABLE_PROBES 64
+
+#define PROF_MAX_RANGES 128
+
+struct prof_sample
+{
+    uint64_t sample_hash;
+
+    uint32_t sample_count;
+
+    uint32_t frames_count;
+
+    uintptr_t task_address;
+
+    const char* stage_name;
+
+    /* From the leaf, the return addresses point inside their call */
+    uintptr_t frames[PROF_MAX_FRAMES];
+};
+
+struct prof_thread
+{
+    char thread_name[32];
+
+    timer_t thread_timer;
+
+    bool timer_created;
+
+    /* Set by prof_thread_end, the stacks of a thread still running are never freed */
+    bool thread_ended;
+
+    /* The frame pointers outside of the stack are garbage */
+    uintptr_t stack_low;
+
+    uintptr_t stack_high;
+
+    _Atomic uintptr_t task_address;
+
+    _Atomic(const char*) stage_name;
+
+    size_t samples_dropped;
+
+    struct prof_sample samples[PROF_TABLE_SLOTS];
+
+    struct prof_thread* thread_next;
+};
+
+/* The executable segments, a return address elsewhere ends the walk */
+struct prof_range
+{
+    uintptr_t range_start;
+
+    uintptr_t range_end;
+
+    bool range_main;
+};
+
+struct prof_symbol
+{
+    uintptr_t symbol_address;
+
+    size_t symbol_size;
+
+    const char* symbol_name;
+};
+
+/* The symbols of the program itself, the static functions aren't known by dladdr */
+struct prof_symbols
+{
+    struct prof_symbol* symbols;
+
+    size_t symbols_count;
+
+    void* image_data;
+
+    size_t image_size;
+};
+
+static _Atomic uint_least8_t prof_running;
+static long prof_interval_nanos;
+
+static _Thread_local struct prof_thread* prof_current;
+static _Atomic(struct prof_thread*) prof_threads;
+
+static struct prof_range prof_ranges[PROF_MAX_RANGES];
+static size_t prof_ranges_count;
+static uintptr_t prof_main_bias;
+
+static bool prof_is_code(uintptr_t address)
+{
+    for (size_t range_cur = 0; range_cur < prof_ranges_count; range_cur++)
+    {
+        if (address >= prof_ranges[range_cur].range_start && address < prof_ranges[range_cur].range_end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool prof_is_main(uintptr_t address)
+{
+    for (size_t range_cur = 0; range_cur < prof_ranges_count; range_cur++)
+    {
+        if (prof_ranges[range_cur].range_main && address >= prof_ranges[range_cur].range_start &&
+            address < prof_ranges[range_cur].range_end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int prof_collect_ranges(struct dl_phdr_info* object_info, size_t info_size, void* data)
+{
+    size_t* object_index = (size_t*)data;
+    (void)info_size;
+
+    /* The program comes first */
+    if (*object_index == 0)
+    {
+        prof_main_bias = (uintptr_t)object_info->dlpi_addr;
+    }
+
+    for (size_t header_cur = 0; header_cur < object_info->dlpi_phnum && prof_ranges_count < PROF_MAX_RANGES; header_cur++)
+    {
+        const ElfW(Phdr)* segment = &object_info->dlpi_phdr[header_cur];
+
+        if (segment->p_type == PT_LOAD && (segment->p_flags & PF_X))
+        {
+            struct prof_range* range = &prof_ranges[prof_ranges_count++];
+            range->range_start = (uintptr_t)object_info->dlpi_addr + segment->p_vaddr;
+            range->range_end = range->range_start + segment->p_memsz;
+            range->range_main = *object_index == 0;
+        }
+    }
+    (*object_index)++;
+
+    return 0;
+}
+
+static void prof_record(struct prof_thread* thread, const uintptr_t* frames, uint32_t frames_count, uint32_t sample_weight)
+{
+    uintptr_t task_address = atomic_load_explicit(&thread->task_address, memory_order_relaxed);
+    const char* stage_name = atomic_load_explicit(&thread->stage_name, memory_order_relaxed);
+
+    /* FNV-1a over the addresses and the tags */
+    uint64_t sample_hash = 14695981039346656037ull;
+    for (uint32_t frame_cur = 0; frame_cur < frames_count; frame_cur++)
+    {
+        sample_hash = (sample_hash ^ frames[frame_cur]) * 1099511628211ull;
+    }
+    sample_hash = (sample_hash ^ task_address) * 1099511628211ull;
+    sample_hash = (sample_hash ^ (uintptr_t)stage_name) * 1099511628211ull;
+
+    size_t slot = (size_t)sample_hash & (PROF_TABLE_SLOTS - 1);
+
+    for (size_t probe_cur = 0; probe_cur < PROF_TABLE_PROBES; probe_cur++, slot = (slot + 1) & (PROF_TABLE_SLOTS - 1))
+    {
+        struct prof_sample* sample = &thread->samples[slot];
+
+        if (sample->sample_count == 0)
+        {
+            sample->sample_hash = sample_hash;
+            sample->frames_count = frames_count;
+            sample->task_address = task_address;
+            sample->stage_name = stage_name;
+            memcpy(sample->frames, frames, frames_count * sizeof(*frames));
+            sample->sample_count = sample_weight;
+            return;
+        }
+        if (sample->sample_hash == sample_hash && sample->frames_count == frames_count && sample->task_address == task_address &&
+            sample->stage_name == stage_name && memcmp(sample->frames, frames, frames_count * sizeof(*frames)) == 0)
+        {
+            sample->sample_count += sample_weight;
+            return;
+        }
+    }
+    thread->samples_dropped += sample_weight;
+}
+
+/* Runs on the sampled thread itself, only reads his own stack */
+static void prof_signal(int signal_number, siginfo_t* signal_info, void* signal_context)
+{
+    (void)signal_number;
+
+    if (atomic_load_explicit(&prof_running, memory_order_relaxed) == 0 || prof_current == NULL)
+    {
+        return;
+    }
+    struct prof_thread* thread = prof_current;
+    const ucontext_t* context = (const ucontext_t*)signal_context;
+    int saved_errno = errno;
+
+    uintptr_t frames[PROF_MAX_FRAMES];
+    uint32_t frames_count = 0;
+    uintptr_t frame_pointer;
+
+#if defined(__x86_64__)
+    frames[frames_count++] = (uintptr_t)context->uc_mcontext.gregs[REG_RIP];
+    frame_pointer = (uintptr_t)context->uc_mcontext.gregs[REG_RBP];
+#elif defined(__aarch64__)
+    frames[frames_count++] = (uintptr_t)context->uc_mcontext.pc;
+    frame_pointer = (uintptr_t)context->uc_mcontext.regs[29];
+#else
+    (void)context;
+    errno = saved_errno;
+    return;
+#endif
+
+    /* Each frame starts with the caller frame pointer, followed by the return address */
+    while (frames_count < PROF_MAX_FRAMES && (frame_pointer & (sizeof(uintptr_t) - 1)) == 0 &&
+        frame_pointer >= thread->stack_low && frame_pointer + 2 * sizeof(uintptr_t) <= thread->stack_high)
+    {
+        const uintptr_t* frame_record = (const uintptr_t*)frame_pointer;
+        uintptr_t return_address = frame_record[1];
+
+        if (prof_is_code(return_address) == false)
+        {
+            break;
+        }
+        frames[frames_count++] = return_address - 1;
+
+        /* The stack grows down, the callers are above */
+        if (frame_record[0] <= frame_pointer)
+        {
+            break;
+        }
+        frame_pointer = frame_record[0];
+    }
+
+    /* The CPU timers are checked at the scheduler ticks, slower than 1 kHz on many kernels:
+     * the periods elapsed since the previous signal are given to this sample
+    */
+    uint32_t sample_weight = signal_info->si_code == SI_TIMER && signal_info->si_overrun > 0 ? (uint32_t)signal_info->si_overrun + 1 : 1;
+
+    prof_record(thread, frames, frames_count, sample_weight);
+    errno = saved_errno;
+}
+
+bool prof_start(unsigned int sample_hz)
+{
+    if (sample_hz == 0 || atomic_load(&prof_running))
+    {
+        return false;
+    }
+    prof_interval_nanos = 1000000000L / (long)sample_hz;
+
+    size_t object_index = 0;
+    prof_ranges_count = 0;
+    dl_iterate_phdr(prof_collect_ranges, &object_index);
+
+    struct sigaction profile_action = { .sa_sigaction = prof_signal, .sa_flags = SA_SIGINFO | SA_RESTART };
+    sigemptyset(&profile_action.sa_mask);
+
+    if (sigaction(SIGPROF, &profile_action, NULL) != 0)
+    {
+        return false;
+    }
+    atomic_store(&prof_running, 1);
+
+    return true;
+}
+
+void prof_thread_begin(const char* thread_name, int thread_index)
+{
+    if (atomic_load(&prof_running) == 0 || prof_current != NULL)
+    {
+        return;
+    }
+
+    struct prof_thread* thread = calloc(1, sizeof(*thread));
+    if (thread == NULL)
+    {
+        return;
+    }
+
+    if (thread_index >= 0)
+    {
+        snprintf(thread->thread_name, sizeof(thread->thread_name), "%s-%d", thread_name, thread_index);
+    }
+    else
+    {
+        snprintf(thread->thread_name, sizeof(thread->thread_name), "%s", thread_name);
+    }
+
+    pthread_attr_t thread_attr;
+    if (pthread_getattr_np(pthread_self(), &thread_attr) == 0)
+    {
+        void* stack_address;
+        size_t stack_size;
+
+        if (pthread_attr_getstack(&thread_attr, &stack_address, &stack_size) == 0)
+        {
+            thread->stack_low = (uintptr_t)stack_address;
+            thread->stack_high = (uintptr_t)stack_address + stack_size;
+        }
+        pthread_attr_destroy(&thread_attr);
+    }
+
+    thread->thread_next = atomic_load(&prof_threads);
+    while (atomic_compare_exchange_weak(&prof_threads, &thread->thread_next, thread) == false) {}
+
+    prof_current = thread;
+
+    /* The timer counts the CPU time of this thread only and signals him, not the process */
+    struct sigevent timer_event = { .sigev_notify = SIGEV_THREAD_ID, .sigev_signo = SIGPROF };
+    timer_event.sigev_notify_thread_id = gettid();
+
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &timer_event, &thread->thread_timer) == 0)
+    {
+        struct itimerspec timer_spec = {
+            .it_interval = { .tv_sec = 0, .tv_nsec = prof_interval_nanos },
+            .it_value = { .tv_sec = 0, .tv_nsec = prof_interval_nanos }
+        };
+        thread->timer_created = timer_settime(thread->thread_timer, 0, &timer_spec, NULL) == 0;
+
+        if (thread->timer_created == false)
+        {
+            timer_delete(thread->thread_timer);
+        }
+    }
+}
+
+void prof_thread_end(void)
+{
+    struct prof_thread* thread = prof_current;
+
+    if (thread == NULL)
+    {
+        return;
+    }
+    if (thread->timer_created)
+    {
+        timer_delete(thread->thread_timer);
+    }
+    prof_current = NULL;
+    thread->thread_ended = true;
+}
+
+prof_task_t prof_task(prof_task_t task_function)
+{
+    struct prof_thread* thread = prof_current;
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+    return (prof_task_t)atomic_exchange_explicit(&thread->task_address, (uintptr_t)task_function, memory_order_relaxed);
+}
+
+const char* prof_stage(const char* stage_name)
+{
+    struct prof_thread* thread = prof_current;
+
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+    return atomic_exchange_explicit(&thread->stage_name, stage_name, memory_order_relaxed);
+}
+
+static int prof_symbol_compare(const void* first, const void* second)
+{
+    uintptr_t first_address = ((const struct prof_symbol*)first)->symbol_address;
+    uintptr_t second_address = ((const struct prof_symbol*)second)->symbol_address;
+
+    return first_address < second_address ? -1 : first_address > second_address;
+}
+
+/* The function symbols of .symtab (or .dynsym when the program is stripped) */
+static bool prof_load_symbols(struct prof_symbols* symbols)
+{
+    memset(symbols, 0, sizeof(*symbols));
+
+    int image_fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+    struct stat image_stat;
+
+    if (image_fd < 0)
+    {
+        return false;
+    }
+    if (fstat(image_fd, &image_stat) != 0 || (size_t)image_stat.st_size < sizeof(ElfW(Ehdr)))
+    {
+        close(image_fd);
+        return false;
+    }
+
+    void* image_data = mmap(NULL, (size_t)image_stat.st_size, PROT_READ, MAP_PRIVATE, image_fd, 0);
+    close(image_fd);
+    if (image_data == MAP_FAILED)
+    {
+        return false;
+    }
+    symbols->image_data = image_data;
+    symbols->image_size = (size_t)image_stat.st_size;
+
+    const uint8_t* image = (const uint8_t*)image_data;
+    const ElfW(Ehdr)* header = (const ElfW(Ehdr)*)image;
+
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_shentsize != sizeof(ElfW(Shdr)) ||
+        header->e_shoff > symbols->image_size || header->e_shnum > (symbols->image_size - header->e_shoff) / sizeof(ElfW(Shdr)))
+    {
+        return false;
+    }
+    const ElfW(Shdr)* sections = (const ElfW(Shdr)*)(image + header->e_shoff);
+    const ElfW(Shdr)* symbol_section = NULL;
+
+    for (size_t section_cur = 0; section_cur < header->e_shnum; section_cur++)
+    {
+        if (sections[section_cur].sh_type == SHT_SYMTAB || (symbol_section == NULL && sections[section_cur].sh_type == SHT_DYNSYM))
+        {
+            symbol_section = &sections[section_cur];
+        }
+    }
+    if (symbol_section == NULL || symbol_section->sh_link >= header->e_shnum ||
+        symbol_section->sh_offset > symbols->image_size || symbol_section->sh_size > symbols->image_size - symbol_section->sh_offset)
+    {
+        return false;
+    }
+
+    const ElfW(Shdr)* string_section = &sections[symbol_section->sh_link];
+    if (string_section->sh_offset > symbols->image_size || string_section->sh_size > symbols->image_size - string_section->sh_offset ||
+        string_section->sh_size == 0 || image[string_section->sh_offset + string_section->sh_size - 1] != '\0')
+    {
+        return false;
+    }
+    const char* strings = (const char*)image + string_section->sh_offset;
+    const ElfW(Sym)* symbol_table = (const ElfW(Sym)*)(image + symbol_section->sh_offset);
+    size_t table_count = symbol_section->sh_size / sizeof(ElfW(Sym));
+
+    symbols->symbols = calloc(table_count != 0 ? table_count : 1, sizeof(struct prof_symbol));
+    if (symbols->symbols == NULL)
+    {
+        return false;
+    }
+
+    for (size_t symbol_cur = 0; symbol_cur < table_count; symbol_cur++)
+    {
+        const ElfW(Sym)* symbol = &symbol_table[symbol_cur];
+
+        if ((symbol->st_info & 0xf) != STT_FUNC || symbol->st_value == 0 || symbol->st_name >= string_section->sh_size)
+        {
+            continue;
+        }
+        struct prof_symbol* entry = &symbols->symbols[symbols->symbols_count++];
+        entry->symbol_address = (uintptr_t)symbol->st_value;
+        entry->symbol_size = (size_t)symbol->st_size;
+        entry->symbol_name = strings + symbol->st_name;
+    }
+    qsort(symbols->symbols, symbols->symbols_count, sizeof(struct prof_symbol), prof_symbol_compare);
+
+    return true;
+}
+
+static void prof_unload_symbols(struct prof_symbols* symbols)
+{
+    free((void*)symbols->symbols);
+    if (symbols->image_data != NULL)
+    {
+        munmap(symbols->image_data, symbols->image_size);
+    }
+}
+
+static const char* prof_lookup(uintptr_t image_address, const struct prof_symbols* symbols)
+{
+    size_t low = 0;
+    size_t high = symbols->symbols_count;
+
+    /* The last symbol starting at or before the address */
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (symbols->symbols[middle].symbol_address <= image_address)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low == 0)
+    {
+        return NULL;
+    }
+
+    const struct prof_symbol* symbol = &symbols->symbols[low - 1];
+    size_t symbol_size = symbol->symbol_size != 0 ? symbol->symbol_size : 1;
+
+    return image_address < symbol->symbol_address + symbol_size ? symbol->symbol_name : NULL;
+}
+
+/* The symbol of the address, or its offset into its object */
+static void prof_frame_name(uintptr_t address, const struct prof_symbols* symbols, char* name_buffer, size_t buffer_size)
+{
+    const char* symbol_name = NULL;
+    Dl_info object_info;
+
+    if (prof_is_main(address))
+    {
+        symbol_name = prof_lookup(address - prof_main_bias, symbols);
+    }
+    if (symbol_name == NULL && dladdr((void*)address, &object_info) != 0)
+    {
+        symbol_name = object_info.dli_sname;
+
+        if (symbol_name == NULL && object_info.dli_fname != NULL)
+        {
+            const char* object_name = strrchr(object_info.dli_fname, '/');
+            snprintf(name_buffer, buffer_size, "%s+0x%lx", object_name != NULL ? object_name + 1 : object_info.dli_fname,
+                (unsigned long)(address - (uintptr_t)object_info.dli_fbase));
+            return;
+        }
+    }
+
+    if (symbol_name != NULL)
+    {
+        snprintf(name_buffer, buffer_size, "%s", symbol_name);
+    }
+    else
+    {
+        snprintf(name_buffer, buffer_size, "0x%lx", (unsigned long)address);
+    }
+}
+
+struct prof_line
+{
+    char* line_text;
+
+    uint64_t line_count;
+};
+
+static int prof_line_compare(const void* first, const void* second)
+{
+    return strcmp(((const struct prof_line*)first)->line_text, ((const struct prof_line*)second)->line_text);
+}
+
+/* "thread;task;[stage];root;...;leaf", NULL when out of memory */
+static char* prof_folded_stack(const struct prof_thread* thread, const struct prof_sample* sample, const struct prof_symbols* symbols)
+{
+    char line_text[PROF_MAX_FRAMES * 128];
+    char frame_name[256];
+    size_t line_length = (size_t)snprintf(line_text, sizeof(line_text), "%s", thread->thread_name);
+
+    if (sample->task_address != 0)
+    {
+        prof_frame_name(sample->task_address, symbols, frame_name, sizeof(frame_name));
+        line_length += (size_t)snprintf(line_text + line_length, sizeof(line_text) - line_length, ";%s", frame_name);
+    }
+    if (sample->stage_name != NULL && line_length < sizeof(line_text))
+    {
+        line_length += (size_t)snprintf(line_text + line_length, sizeof(line_text) - line_length, ";[%s]", sample->stage_name);
+    }
+    for (uint32_t frame_cur = sample->frames_count; frame_cur != 0 && line_length < sizeof(line_text); frame_cur--)
+    {
+        prof_frame_name(sample->frames[frame_cur - 1], symbols, frame_name, sizeof(frame_name));
+        line_length += (size_t)snprintf(line_text + line_length, sizeof(line_text) - line_length, ";%s", frame_name);
+    }
+    return strdup(line_text);
+}
+
+bool prof_stop(const char* folded_path)
+{
+    if (atomic_exchange(&prof_running, 0) == 0)
+    {
+        return false;
+    }
+    prof_thread_end();
+
+    /* A thread still registered may be signaled once more */
+    signal(SIGPROF, SIG_IGN);
+
+    struct prof_symbols symbols;
+    prof_load_symbols(&symbols);
+
+    /* The stacks differing only by the addresses inside the same functions are merged */
+    struct prof_line* lines = NULL;
+    size_t lines_count = 0;
+    size_t lines_capacity = 0;
+    size_t samples_dropped = 0;
+    bool stop_ret = true;
+
+    for (struct prof_thread* thread = atomic_exchange(&prof_threads, NULL); thread != NULL; )
+    {
+        for (size_t slot_cur = 0; stop_ret && slot_cur < PROF_TABLE_SLOTS; slot_cur++)
+        {
+            const struct prof_sample* sample = &thread->samples[slot_cur];
+            if (sample->sample_count == 0)
+            {
+                continue;
+            }
+
+            if (lines_count == lines_capacity)
+            {
+                size_t new_capacity = lines_capacity != 0 ? lines_capacity * 2 : 256;
+                struct prof_line* new_lines = realloc(lines, new_capacity * sizeof(*lines));
+
+                stop_ret = new_lines != NULL;
+                lines = stop_ret ? new_lines : lines;
+                lines_capacity = stop_ret ? new_capacity : lines_capacity;
+            }
+            if (stop_ret)
+            {
+                lines[lines_count].line_text = prof_folded_stack(thread, sample, &symbols);
+                lines[lines_count].line_count = sample->sample_count;
+                stop_ret = lines[lines_count++].line_text != NULL;
+            }
+        }
+        samples_dropped += thread->samples_dropped;
+
+        struct prof_thread* thread_next = thread->thread_next;
+        if (thread->thread_ended)
+        {
+            free((void*)thread);
+        }
+        thread = thread_next;
+    }
+    prof_unload_symbols(&symbols);
+
+    if (stop_ret && lines_count != 0)
+    {
+        qsort(lines, lines_count, sizeof(*lines), prof_line_compare);
+    }
+
+    FILE* folded_file = stop_ret ? fopen(folded_path, "w") : NULL;
+
+    for (size_t line_cur = 0; folded_file != NULL && line_cur < lines_count; )
+    {
+        uint64_t line_count = 0;
+        size_t same_cur = line_cur;
+
+        for (; same_cur < lines_count && strcmp(lines[same_cur].line_text, lines[line_cur].line_text) == 0; same_cur++)
+        {
+            line_count += lines[same_cur].line_count;
+        }
+        fprintf(folded_file, "%s %lu\n", lines[line_cur].line_text, (unsigned long)line_count);
+        line_cur = same_cur;
+    }
+    if (folded_file != NULL && samples_dropped != 0)
+    {
+        fprintf(folded_file, "[dropped] %zu\n", samples_dropped);
+    }
+
+    for (size_t line_cur = 0; line_cur < lines_count; line_cur++)
+    {
+        free((void*)lines[line_cur].line_text);
+    }
+    free((void*)lines);
+
+    return folded_file != NULL && fclose(folded_file) == 0;
+}
@@ -0,0 +1,52 @@
+#ifndef CPU_SAMPLE_PROFILER_H
+#define CPU_SAMPLE_PROFILER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PROF_DEFAULT_HZ 1000
+
+/* Deeper stacks are cut at their root side */
+#define PROF_MAX_FRAMES 32
+
+/* Distinct stacks by thread, a power of 2 */
+#define PROF_TABLE_SLOTS 4096
+
+/* The task a thread runs, any function casted to this type */
+typedef void (*prof_task_t)(void);
+
+/* -profile: each registered thread is interrupted by SIGPROF every 1/`sample_hz` second of his
+ * own CPU time, the handler walks the frame pointers (full stacks need -fno-omit-frame-pointer,
+ * the enable_debug build) and counts the stack with the task and the stage of the thread.
+ * Nothing is allocated by the handler, each thread owns a table of stacks
+*/
+bool prof_start(unsigned int sample_hz);
+
+/* Samples the calling thread as "<thread_name>-<thread_index>" (or the name alone with a
+ * negative index), nothing when the profiler isn't started
+*/
+void prof_thread_begin(const char* thread_name, int thread_index);
+void prof_thread_end(void);
+
+/* Tags the next samples of the calling thread, returns the previous tag to restore it */
+prof_task_t prof_task(prof_task_t task_function);
+const char* prof_stage(const char* stage_name);
+
+static inline void prof_stage_scope_end(const char** previous_stage)
+{
+    prof_stage(*previous_stage);
+}
+
+#define PROF_STAGE_JOIN_(prefix, line) prefix##line
+#define PROF_STAGE_JOIN(prefix, line) PROF_STAGE_JOIN_(prefix, line)
+
+/* The stage of the thread until the end of the enclosing block */
+#define PROF_STAGE_SCOPE(stage_name) \
+    const char* PROF_STAGE_JOIN(previous_stage_, __LINE__) __attribute__((cleanup(prof_stage_scope_end))) = prof_stage(stage_name)
+
+/* Stops the sampling and writes the stacks of all threads in the folded format of the flame
+ * graph tools: "thread;task;[stage];root;...;leaf count", one line by distinct stack
+*/
+bool prof_stop(const char* folded_path);
+
+#endif
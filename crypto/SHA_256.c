@@ -0,0 +1,417 @@
+#include <string.h>
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_X86 1
+#endif
+
+#include "SHA_256.h"
+#include "cpu/Hardware_Info.h"
+
+static const uint32_t sha256_round_keys[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t sha256_rotr(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256_compress_portable(uint32_t hash_state[8], const uint8_t* block)
+{
+    uint32_t schedule[64];
+
+    for (int word_cur = 0; word_cur < 16; word_cur++)
+    {
+        const uint8_t* word = block + word_cur * 4;
+        schedule[word_cur] = (uint32_t)word[0] << 24 | (uint32_t)word[1] << 16 | (uint32_t)word[2] << 8 | word[3];
+    }
+    for (int word_cur = 16; word_cur < 64; word_cur++)
+    {
+        uint32_t s0 = sha256_rotr(schedule[word_cur - 15], 7) ^ sha256_rotr(schedule[word_cur - 15], 18) ^ (schedule[word_cur - 15] >> 3);
+        uint32_t s1 = sha256_rotr(schedule[word_cur - 2], 17) ^ sha256_rotr(schedule[word_cur - 2], 19) ^ (schedule[word_cur - 2] >> 10);
+        schedule[word_cur] = schedule[word_cur - 16] + s0 + schedule[word_cur - 7] + s1;
+    }
+
+    uint32_t a = hash_state[0], b = hash_state[1], c = hash_state[2], d = hash_state[3];
+    uint32_t e = hash_state[4], f = hash_state[5], g = hash_state[6], h = hash_state[7];
+
+    for (int round_cur = 0; round_cur < 64; round_cur++)
+    {
+        uint32_t s1 = sha256_rotr(e, 6) ^ sha256_rotr(e, 11) ^ sha256_rotr(e, 25);
+        uint32_t choose = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choose + sha256_round_keys[round_cur] + schedule[round_cur];
+        uint32_t s0 = sha256_rotr(a, 2) ^ sha256_rotr(a, 13) ^ sha256_rotr(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+
+        h = g; g = f; f = e;
+        e = d + temp1;
+        d = c; c = b; b = a;
+        a = temp1 + temp2;
+    }
+
+    hash_state[0] += a; hash_state[1] += b; hash_state[2] += c; hash_state[3] += d;
+    hash_state[4] += e; hash_state[5] += f; hash_state[6] += g; hash_state[7] += h;
+}
+
+#if defined(SHA256_X86)
+
+/* Four rounds by sha256rnds2 pair, the message schedule runs four words ahead */
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t hash_state[8], const uint8_t* blocks, size_t blocks_count)
+{
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    /* The instructions keep the state as ABEF and CDGH */
+    __m128i state_low = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&hash_state[0]), 0xb1);
+    __m128i state_high = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&hash_state[4]), 0x1b);
+    __m128i state_abef = _mm_alignr_epi8(state_low, state_high, 8);
+    __m128i state_cdgh = _mm_blend_epi16(state_high, state_low, 0xf0);
+
+    for (; blocks_count != 0; blocks_count--, blocks += SHA256_BLOCK_SIZE)
+    {
+        __m128i saved_abef = state_abef;
+        __m128i saved_cdgh = state_cdgh;
+        __m128i message[4];
+
+        for (int quad_cur = 0; quad_cur < 4; quad_cur++)
+        {
+            message[quad_cur] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(blocks + quad_cur * 16)), byte_swap);
+        }
+
+        for (int quad_cur = 0; quad_cur < 16; quad_cur++)
+        {
+            __m128i round_input = _mm_add_epi32(message[quad_cur & 3], _mm_loadu_si128((const __m128i*)&sha256_round_keys[quad_cur * 4]));
+
+            state_cdgh = _mm_sha256rnds2_epu32(state_cdgh, state_abef, round_input);
+            state_abef = _mm_sha256rnds2_epu32(state_abef, state_cdgh, _mm_shuffle_epi32(round_input, 0x0e));
+
+            /* W[t + 16] from W[t], W[t + 4], W[t + 8] and W[t + 12] */
+            if (quad_cur < 12)
+            {
+                __m128i next_words = _mm_sha256msg1_epu32(message[quad_cur & 3], message[(quad_cur + 1) & 3]);
+                next_words = _mm_add_epi32(next_words, _mm_alignr_epi8(message[(quad_cur + 3) & 3], message[(quad_cur + 2) & 3], 4));
+                message[quad_cur & 3] = _mm_sha256msg2_epu32(next_words, message[(quad_cur + 3) & 3]);
+            }
+        }
+
+        state_abef = _mm_add_epi32(state_abef, saved_abef);
+        state_cdgh = _mm_add_epi32(state_cdgh, saved_cdgh);
+    }
+
+    state_low = _mm_shuffle_epi32(state_abef, 0x1b);
+    state_high = _mm_shuffle_epi32(state_cdgh, 0xb1);
+    _mm_storeu_si128((__m128i*)&hash_state[0], _mm_blend_epi16(state_low, state_high, 0xf0));
+    _mm_storeu_si128((__m128i*)&hash_state[4], _mm_alignr_epi8(state_high, state_low, 8));
+}
+
+#define SHA256_X8_ROTR(value, bits) _mm256_or_si256(_mm256_srli_epi32(value, bits), _mm256_slli_epi32(value, 32 - (bits)))
+
+/* Row i (8 words of the lane i) becomes the word i of the 8 lanes */
+__attribute__((target("avx2")))
+static inline void sha256_x8_transpose(__m256i rows[8])
+{
+    __m256i pairs[8], quads[8];
+
+    for (int row_cur = 0; row_cur < 8; row_cur += 2)
+    {
+        pairs[row_cur] = _mm256_unpacklo_epi32(rows[row_cur], rows[row_cur + 1]);
+        pairs[row_cur + 1] = _mm256_unpackhi_epi32(rows[row_cur], rows[row_cur + 1]);
+    }
+    for (int row_cur = 0; row_cur < 8; row_cur += 4)
+    {
+        quads[row_cur] = _mm256_unpacklo_epi64(pairs[row_cur], pairs[row_cur + 2]);
+        quads[row_cur + 1] = _mm256_unpackhi_epi64(pairs[row_cur], pairs[row_cur + 2]);
+        quads[row_cur + 2] = _mm256_unpacklo_epi64(pairs[row_cur + 1], pairs[row_cur + 3]);
+        quads[row_cur + 3] = _mm256_unpackhi_epi64(pairs[row_cur + 1], pairs[row_cur + 3]);
+    }
+    for (int word_cur = 0; word_cur < 4; word_cur++)
+    {
+        rows[word_cur] = _mm256_permute2x128_si256(quads[word_cur], quads[word_cur + 4], 0x20);
+        rows[word_cur + 4] = _mm256_permute2x128_si256(quads[word_cur], quads[word_cur + 4], 0x31);
+    }
+}
+
+/* The same count of blocks from 8 streams, each lane of the vectors is a stream */
+__attribute__((target("avx2")))
+static void sha256_blocks_x8(sha256_ctx_t* const sha_ctxs[8], const uint8_t* const data[8], size_t blocks_count)
+{
+    const __m256i byte_swap = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i state[8];
+
+    for (int word_cur = 0; word_cur < 8; word_cur++)
+    {
+        state[word_cur] = _mm256_setr_epi32((int)sha_ctxs[0]->hash_state[word_cur], (int)sha_ctxs[1]->hash_state[word_cur],
+            (int)sha_ctxs[2]->hash_state[word_cur], (int)sha_ctxs[3]->hash_state[word_cur], (int)sha_ctxs[4]->hash_state[word_cur],
+            (int)sha_ctxs[5]->hash_state[word_cur], (int)sha_ctxs[6]->hash_state[word_cur], (int)sha_ctxs[7]->hash_state[word_cur]);
+    }
+
+    for (size_t block_cur = 0; block_cur < blocks_count; block_cur++)
+    {
+        __m256i schedule[16];
+
+        for (int half_cur = 0; half_cur < 2; half_cur++)
+        {
+            for (int lane_cur = 0; lane_cur < 8; lane_cur++)
+            {
+                const uint8_t* block = data[lane_cur] + block_cur * SHA256_BLOCK_SIZE + half_cur * 32;
+                schedule[half_cur * 8 + lane_cur] = _mm256_loadu_si256((const __m256i*)block);
+            }
+            sha256_x8_transpose(&schedule[half_cur * 8]);
+        }
+        for (int word_cur = 0; word_cur < 16; word_cur++)
+        {
+            schedule[word_cur] = _mm256_shuffle_epi8(schedule[word_cur], byte_swap);
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+        for (int round_cur = 0; round_cur < 64; round_cur++)
+        {
+            __m256i word;
+
+            if (round_cur < 16)
+            {
+                word = schedule[round_cur];
+            }
+            else
+            {
+                __m256i w15 = schedule[(round_cur - 15) & 15];
+                __m256i w2 = schedule[(round_cur - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(w15, 7), SHA256_X8_ROTR(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(w2, 17), SHA256_X8_ROTR(w2, 19)), _mm256_srli_epi32(w2, 10));
+
+                word = _mm256_add_epi32(_mm256_add_epi32(schedule[round_cur & 15], s0), _mm256_add_epi32(schedule[(round_cur - 7) & 15], s1));
+                schedule[round_cur & 15] = word;
+            }
+
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(e, 6), SHA256_X8_ROTR(e, 11)), SHA256_X8_ROTR(e, 25));
+            __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i temp1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(choose,
+                _mm256_add_epi32(_mm256_set1_epi32((int)sha256_round_keys[round_cur]), word)));
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(SHA256_X8_ROTR(a, 2), SHA256_X8_ROTR(a, 13)), SHA256_X8_ROTR(a, 22));
+            __m256i majority = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+
+            h = g; g = f; f = e;
+            e = _mm256_add_epi32(d, temp1);
+            d = c; c = b; b = a;
+            a = _mm256_add_epi32(temp1, _mm256_add_epi32(s0, majority));
+        }
+
+        state[0] = _mm256_add_epi32(state[0], a); state[1] = _mm256_add_epi32(state[1], b);
+        state[2] = _mm256_add_epi32(state[2], c); state[3] = _mm256_add_epi32(state[3], d);
+        state[4] = _mm256_add_epi32(state[4], e); state[5] = _mm256_add_epi32(state[5], f);
+        state[6] = _mm256_add_epi32(state[6], g); state[7] = _mm256_add_epi32(state[7], h);
+    }
+
+    for (int word_cur = 0; word_cur < 8; word_cur++)
+    {
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, state[word_cur]);
+
+        for (int lane_cur = 0; lane_cur < 8; lane_cur++)
+        {
+            sha_ctxs[lane_cur]->hash_state[word_cur] = lanes[lane_cur];
+        }
+    }
+}
+
+#endif
+
+/* -1 until the first use picks one */
+static _Atomic int sha256_active = -1;
+
+#if defined(SHA256_X86)
+/* The CPU features each implementation needs */
+static const uint32_t sha256_features[] = {
+    [SHA256_PORTABLE] = 0,
+    [SHA256_AVX2] = CPU_FEATURE_AVX2,
+    [SHA256_SHANI] = CPU_FEATURE_SHA | CPU_FEATURE_SSE41
+};
+#endif
+
+static bool sha256_supported(sha256_impl_t sha_impl)
+{
+#if defined(SHA256_X86)
+    return (cpu_features() & sha256_features[sha_impl]) == sha256_features[sha_impl];
+#else
+    return sha_impl == SHA256_PORTABLE;
+#endif
+}
+
+sha256_impl_t sha256_implementation(void)
+{
+    int active = atomic_load_explicit(&sha256_active, memory_order_relaxed);
+
+    if (active < 0)
+    {
+        active = sha256_supported(SHA256_SHANI) ? SHA256_SHANI : sha256_supported(SHA256_AVX2) ? SHA256_AVX2 : SHA256_PORTABLE;
+        atomic_store_explicit(&sha256_active, active, memory_order_relaxed);
+    }
+    return (sha256_impl_t)active;
+}
+
+bool sha256_use(sha256_impl_t sha_impl)
+{
+    if (sha256_supported(sha_impl) == false)
+    {
+        return false;
+    }
+    atomic_store_explicit(&sha256_active, (int)sha_impl, memory_order_relaxed);
+    return true;
+}
+
+static void sha256_compress(uint32_t hash_state[8], const uint8_t* blocks, size_t blocks_count)
+{
+#if defined(SHA256_X86)
+    if (sha256_implementation() == SHA256_SHANI)
+    {
+        sha256_blocks_shani(hash_state, blocks, blocks_count);
+        return;
+    }
+#endif
+    for (; blocks_count != 0; blocks_count--, blocks += SHA256_BLOCK_SIZE)
+    {
+        sha256_compress_portable(hash_state, blocks);
+    }
+}
+
+void sha256_init(sha256_ctx_t* sha_ctx)
+{
+    static const uint32_t sha256_initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy(sha_ctx->hash_state, sha256_initial, sizeof(sha256_initial));
+    sha_ctx->message_length = 0;
+    sha_ctx->block_used = 0;
+}
+
+void sha256_update(const void* data, size_t data_size, sha256_ctx_t* sha_ctx)
+{
+    const uint8_t* input = (const uint8_t*)data;
+
+    sha_ctx->message_length += data_size;
+
+    if (sha_ctx->block_used != 0)
+    {
+        size_t block_left = SHA256_BLOCK_SIZE - sha_ctx->block_used;
+        size_t copy_size = data_size < block_left ? data_size : block_left;
+
+        memcpy(sha_ctx->block_data + sha_ctx->block_used, input, copy_size);
+        sha_ctx->block_used += copy_size;
+        input += copy_size;
+        data_size -= copy_size;
+
+        if (sha_ctx->block_used != SHA256_BLOCK_SIZE)
+        {
+            return;
+        }
+        sha256_compress(sha_ctx->hash_state, sha_ctx->block_data, 1);
+        sha_ctx->block_used = 0;
+    }
+
+    /* Full blocks are hashed directly from the input */
+    size_t blocks_count = data_size / SHA256_BLOCK_SIZE;
+    sha256_compress(sha_ctx->hash_state, input, blocks_count);
+    input += blocks_count * SHA256_BLOCK_SIZE;
+    data_size -= blocks_count * SHA256_BLOCK_SIZE;
+
+    memcpy(sha_ctx->block_data, input, data_size);
+    sha_ctx->block_used = data_size;
+}
+
+void sha256_final(uint8_t digest[SHA256_DIGEST_SIZE], sha256_ctx_t* sha_ctx)
+{
+    uint64_t message_bits = sha_ctx->message_length * 8;
+
+    sha_ctx->block_data[sha_ctx->block_used++] = 0x80;
+    if (sha_ctx->block_used > SHA256_BLOCK_SIZE - 8)
+    {
+        memset(sha_ctx->block_data + sha_ctx->block_used, 0, SHA256_BLOCK_SIZE - sha_ctx->block_used);
+        sha256_compress(sha_ctx->hash_state, sha_ctx->block_data, 1);
+        sha_ctx->block_used = 0;
+    }
+    memset(sha_ctx->block_data + sha_ctx->block_used, 0, SHA256_BLOCK_SIZE - 8 - sha_ctx->block_used);
+
+    for (int byte_cur = 0; byte_cur < 8; byte_cur++)
+    {
+        sha_ctx->block_data[SHA256_BLOCK_SIZE - 1 - byte_cur] = (uint8_t)(message_bits >> (byte_cur * 8));
+    }
+    sha256_compress(sha_ctx->hash_state, sha_ctx->block_data, 1);
+
+    for (int word_cur = 0; word_cur < 8; word_cur++)
+    {
+        digest[word_cur * 4] = (uint8_t)(sha_ctx->hash_state[word_cur] >> 24);
+        digest[word_cur * 4 + 1] = (uint8_t)(sha_ctx->hash_state[word_cur] >> 16);
+        digest[word_cur * 4 + 2] = (uint8_t)(sha_ctx->hash_state[word_cur] >> 8);
+        digest[word_cur * 4 + 3] = (uint8_t)sha_ctx->hash_state[word_cur];
+    }
+}
+
+void sha256_update_x8(const uint8_t* const data[8], size_t data_size, sha256_ctx_t* const sha_ctxs[8])
+{
+    bool same_position = true;
+
+    for (int lane_cur = 1; lane_cur < 8; lane_cur++)
+    {
+        same_position &= sha_ctxs[lane_cur]->block_used == sha_ctxs[0]->block_used;
+    }
+
+#if defined(SHA256_X86)
+    if (same_position && sha256_implementation() == SHA256_AVX2)
+    {
+        size_t head_size = (SHA256_BLOCK_SIZE - sha_ctxs[0]->block_used) % SHA256_BLOCK_SIZE;
+        if (head_size > data_size)
+        {
+            head_size = data_size;
+        }
+
+        /* Completes the pending blocks, then the whole blocks go through the lanes */
+        const uint8_t* lanes_data[8];
+        for (int lane_cur = 0; lane_cur < 8; lane_cur++)
+        {
+            sha256_update(data[lane_cur], head_size, sha_ctxs[lane_cur]);
+            lanes_data[lane_cur] = data[lane_cur] + head_size;
+        }
+
+        size_t blocks_count = (data_size - head_size) / SHA256_BLOCK_SIZE;
+        size_t tail_offset = head_size + blocks_count * SHA256_BLOCK_SIZE;
+
+        sha256_blocks_x8(sha_ctxs, lanes_data, blocks_count);
+        for (int lane_cur = 0; lane_cur < 8; lane_cur++)
+        {
+            sha_ctxs[lane_cur]->message_length += blocks_count * SHA256_BLOCK_SIZE;
+            sha256_update(data[lane_cur] + tail_offset, data_size - tail_offset, sha_ctxs[lane_cur]);
+        }
+        return;
+    }
+#endif
+    (void)same_position;
+
+    for (int lane_cur = 0; lane_cur < 8; lane_cur++)
+    {
+        sha256_update(data[lane_cur], data_size, sha_ctxs[lane_cur]);
+    }
+}
+
+void sha256_digest(const void* data, size_t data_size, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    sha256_ctx_t sha_ctx;
+
+    sha256_init(&sha_ctx);
+    sha256_update(data, data_size, &sha_ctx);
+    sha256_final(digest, &sha_ctx);
+}
+
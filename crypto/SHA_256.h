@@ -0,0 +1,55 @@
+#ifndef CRYPTO_SHA_256_H
+#define CRYPTO_SHA_256_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+typedef struct sha256_ctx
+{
+    uint32_t hash_state[8];
+
+    uint64_t message_length;
+
+    uint8_t block_data[SHA256_BLOCK_SIZE];
+
+    size_t block_used;
+
+} sha256_ctx_t;
+
+/* The block functions, the best one the CPU runs is picked at the first use */
+typedef enum sha256_impl
+{
+    SHA256_PORTABLE,
+
+    /* 8 streams at once in the lanes of the vectors, only for sha256_update_x8 */
+    SHA256_AVX2,
+
+    /* The SHA extensions, one stream at a time but faster than 8 AVX2 lanes */
+    SHA256_SHANI,
+
+} sha256_impl_t;
+
+sha256_impl_t sha256_implementation(void);
+
+/* Forces an implementation (the tests compare them), false when the CPU doesn't have it */
+bool sha256_use(sha256_impl_t sha_impl);
+
+void sha256_init(sha256_ctx_t* sha_ctx);
+void sha256_update(const void* data, size_t data_size, sha256_ctx_t* sha_ctx);
+void sha256_final(uint8_t digest[SHA256_DIGEST_SIZE], sha256_ctx_t* sha_ctx);
+
+/* Feeds `data_size` bytes into each of the 8 contexts, like 8 sha256_update calls. When the
+ * contexts are at the same block position (chunks of the same size) the AVX2 implementation
+ * hashes the 8 streams together
+*/
+void sha256_update_x8(const uint8_t* const data[8], size_t data_size, sha256_ctx_t* const sha_ctxs[8]);
+
+/* Hashes a single buffer */
+void sha256_digest(const void* data, size_t data_size, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
+
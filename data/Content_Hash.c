@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include "Content_Hash.h"
+
+#define HASH_PRIME1 11400714785074694791ULL
+#define HASH_PRIME2 14029467366897019727ULL
+#define HASH_PRIME3 1609587929392839161ULL
+#define HASH_PRIME4 9650029242287828579ULL
+#define HASH_PRIME5 2870177450012600261ULL
+
+static inline uint64_t hash_rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t hash_read64(const uint8_t* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hash_read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * HASH_PRIME2;
+    accumulator = hash_rotl(accumulator, 31);
+    return accumulator * HASH_PRIME1;
+}
+
+static inline uint64_t hash_merge(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= hash_round(0, value);
+    return accumulator * HASH_PRIME1 + HASH_PRIME4;
+}
+
+uint64_t hash_content64(const void* data, size_t data_size, uint64_t hash_seed)
+{
+    const uint8_t* input = (const uint8_t*)data;
+    const uint8_t* input_end = input + data_size;
+    uint64_t hash_value;
+
+    if (data_size >= 32)
+    {
+        /* Four independent lanes, the CPU can run them in parallel */
+        uint64_t lanes[4] = { 
+            hash_seed + HASH_PRIME1 + HASH_PRIME2, hash_seed + HASH_PRIME2, hash_seed, hash_seed - HASH_PRIME1 
+        };
+
+        do
+        {
+            lanes[0] = hash_round(lanes[0], hash_read64(input));
+            lanes[1] = hash_round(lanes[1], hash_read64(input + 8));
+            lanes[2] = hash_round(lanes[2], hash_read64(input + 16));
+            lanes[3] = hash_round(lanes[3], hash_read64(input + 24));
+            input += 32;
+        } while (input_end - input >= 32);
+
+        hash_value = hash_rotl(lanes[0], 1) + hash_rotl(lanes[1], 7) + hash_rotl(lanes[2], 12) + hash_rotl(lanes[3], 18);
+        for (int lane_cur = 0; lane_cur < 4; lane_cur++)
+        {
+            hash_value = hash_merge(hash_value, lanes[lane_cur]);
+        }
+    }
+    else
+    {
+        hash_value = hash_seed + HASH_PRIME5;
+    }
+
+    hash_value += (uint64_t)data_size;
+
+    while (input_end - input >= 8)
+    {
+        hash_value ^= hash_round(0, hash_read64(input));
+        hash_value = hash_rotl(hash_value, 27) * HASH_PRIME1 + HASH_PRIME4;
+        input += 8;
+    }
+    if (input_end - input >= 4)
+    {
+        hash_value ^= (uint64_t)hash_read32(input) * HASH_PRIME1;
+        hash_value = hash_rotl(hash_value, 23) * HASH_PRIME2 + HASH_PRIME3;
+        input += 4;
+    }
+    while (input < input_end)
+    {
+        hash_value ^= (*input++) * HASH_PRIME5;
+        hash_value = hash_rotl(hash_value, 11) * HASH_PRIME1;
+    }
+
+    hash_value ^= hash_value >> 33;
+    hash_value *= HASH_PRIME2;
+    hash_value ^= hash_value >> 29;
+    hash_value *= HASH_PRIME3;
+    hash_value ^= hash_value >> 32;
+
+    return hash_value;
+}
+
@@ -0,0 +1,13 @@
+#ifndef DATA_CONTENT_HASH_H
+#define DATA_CONTENT_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A fast, non cryptographic 64 bits hash (XXH64), used for detect identical contents,
+ * never use it where an attacker can choose the data for produce collisions
+*/
+uint64_t hash_content64(const void* data, size_t data_size, uint64_t hash_seed);
+
+#endif
+
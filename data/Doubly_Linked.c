@@ -33,7 +33,7 @@ static bool doubly_copy(doubly_node_t* dest, doubly_node_t* head_node, int64_t m
     }
 
     doubly_node_t* node_prev = NULL;
-    static int node_id;
+    int node_id;
 
     for (node_id = 0; max_size != 0 && src != NULL; max_size--)
     {
@@ -124,6 +124,10 @@ doubly_node_t* doubly_reserve(void* user_data, doubly_linked_t* doubly_ctx)
         
         reserved_node->user_data = user_data;
 
+        /* Out of the list until it's linked, a freed node still has the id 0 of the head */
+        reserved_node->doubly_id = -1;
+        reserved_node->node_next = reserved_node->node_prev = NULL;
+
         return reserved_node;
     }
      
@@ -137,7 +141,8 @@ static bool doubly_insert_at_end(doubly_node_t* node_link, void* node_info)
 {
     doubly_node_t* node_item = (doubly_node_t*)node_info;
     
-    if (node_link->node_next != NULL)
+    /* The tail, not a free node nor the one being inserted */
+    if (node_link->node_next != NULL || node_link->node_valid == 0 || node_link == node_item)
     {
         return false;
     }
@@ -165,8 +170,8 @@ static bool doubly_search_id(doubly_node_t* node_link, void* desired_node)
 
 doubly_node_t* doubly_by_id(size_t node_id, doubly_linked_t* doubly_ctx)
 {
-    static doubly_node_t desired_node_id = {};
-    desired_node_id.doubly_id = node_id;
+    /* On the stack, the lists of other threads are searched at the same time */
+    doubly_node_t desired_node_id = { .doubly_id = (int)node_id };
 
     doubly_node_t* found_node_ptr = &desired_node_id;
 
@@ -384,8 +389,10 @@ int doubly_insert(void* user_data, doubly_insert_e at, int location_opt, doubly_
 
         assert(location_opt == 0);
 
-        if (doubly_head(doubly_ctx) == selected_node)
+        if (doubly_ctx->nodes_valid_cnt == 0)
         {
+            /* The first node is the head */
+            selected_node->doubly_id = 0;
             break;
         }
 
@@ -399,11 +406,9 @@ int doubly_insert(void* user_data, doubly_insert_e at, int location_opt, doubly_
 
         doubly_node_t* node_location = doubly_head(doubly_ctx);
 
-        if (node_location == NULL) {}
-
-        if (selected_node == node_location)
+        if (node_location == NULL)
         {
-            /* Node already placed at the correct location */
+            selected_node->doubly_id = 0;
             break;
         }
 
@@ -3,17 +3,62 @@
 
 #include "FIFO_Queue.h"
 
-FIFO_queue_t* queue_create(int64_t preallocate)
+/* Takes a node from the free ones, allocates one when there's none */
+static doubly_node_t* queue_node_take(FIFO_queue_t* fifo_queue)
 {
-    FIFO_queue_t* heap_queue = (FIFO_queue_t*)calloc(1, sizeof(FIFO_queue_t));
+    doubly_node_t* queue_node = fifo_queue->node_free;
+
+    if (queue_node != NULL)
+    {
+        fifo_queue->node_free = queue_node->node_next;
+    }
+    else
+    {
+        queue_node = (doubly_node_t*)calloc(1, sizeof(doubly_node_t));
+        if (queue_node == NULL)
+        {
+            return NULL;
+        }
+        fifo_queue->queue_actual_capacity++;
+    }
+
+    queue_node->node_valid = 1;
+    queue_node->node_next = queue_node->node_prev = NULL;
+
+    return queue_node;
+}
+
+static void queue_node_give(doubly_node_t* queue_node, FIFO_queue_t* fifo_queue)
+{
+    queue_node->user_data = NULL;
+    queue_node->node_valid = 0;
 
-    if (heap_queue == NULL) {}
+    queue_node->node_prev = NULL;
+    queue_node->node_next = fifo_queue->node_free;
+    fifo_queue->node_free = queue_node;
+}
+
+static void queue_node_free_all(doubly_node_t* queue_node)
+{
+    while (queue_node != NULL)
+    {
+        doubly_node_t* node_next = queue_node->node_next;
+        free((void*)queue_node);
+        queue_node = node_next;
+    }
+}
 
-    heap_queue->doubly_context = doubly_create(preallocate);
+FIFO_queue_t* queue_create(int64_t preallocate)
+{
+    FIFO_queue_t* heap_queue = (FIFO_queue_t*)calloc(1, sizeof(FIFO_queue_t));
 
-    heap_queue->node_head = doubly_head(heap_queue->doubly_context);
+    if (heap_queue == NULL)
+    {
+        return NULL;
+    }
 
-    heap_queue->node_tail = doubly_last(heap_queue->doubly_context);
+    /* As the doubly linked list does, 2 nodes when nothing is asked */
+    queue_resize(preallocate > 0 ? preallocate : 2, heap_queue);
 
     return heap_queue;
 }
@@ -38,7 +83,7 @@ bool queue_safe_lock(FIFO_queue_t* fifo_queue)
 
     if (*queue_lock_ptr == NULL)
     {
-
+        return false;
     }
 
     pthread_mutex_init(*queue_lock_ptr, NULL);
@@ -51,24 +96,7 @@ bool queue_safe_lock(FIFO_queue_t* fifo_queue)
     return true;
 }
 
-bool queue_sync(FIFO_queue_t* fifo_queue)
-{
-    /* The mutex must be locked for does this */
-    int trylock_ret = pthread_mutex_trylock(fifo_queue->queue_lock);
-    
-    assert(trylock_ret != 0);
-    
-    fifo_queue->queue_actual_capacity = doubly_capacity(fifo_queue->doubly_context);
-    
-    fifo_queue->queue_length = doubly_count(fifo_queue->doubly_context);
-
-    fifo_queue->node_head = doubly_head(fifo_queue->doubly_context);
-
-    fifo_queue->node_tail = doubly_last(fifo_queue->doubly_context);
-
-    return true;
-}
-
+/* The head and the tail are linked directly, an operation doesn't walk the queue */
 bool queue_enqueue(void* user_data, FIFO_queue_t* fifo_queue)
 {
     if (fifo_queue->queue_lock != NULL)
@@ -76,16 +104,31 @@ bool queue_enqueue(void* user_data, FIFO_queue_t* fifo_queue)
         pthread_mutex_lock(fifo_queue->queue_lock);
     }
 
-    doubly_insert(user_data, DOUBLY_INSERT_END, 0, fifo_queue->doubly_context);
+    doubly_node_t* queue_node = queue_node_take(fifo_queue);
 
-    queue_sync(fifo_queue);
+    if (queue_node != NULL)
+    {
+        queue_node->user_data = user_data;
+        queue_node->node_prev = fifo_queue->node_tail;
+
+        if (fifo_queue->node_tail != NULL)
+        {
+            fifo_queue->node_tail->node_next = queue_node;
+        }
+        else
+        {
+            fifo_queue->node_head = queue_node;
+        }
+        fifo_queue->node_tail = queue_node;
+        fifo_queue->queue_length++;
+    }
 
     if (fifo_queue->queue_lock != NULL)
     {
         pthread_mutex_unlock(fifo_queue->queue_lock);
     }
 
-    return true;
+    return queue_node != NULL;
 }
 
 bool queue_enqueue_inverse(void* user_data, FIFO_queue_t* fifo_queue)
@@ -95,16 +138,31 @@ bool queue_enqueue_inverse(void* user_data, FIFO_queue_t* fifo_queue)
         pthread_mutex_lock(fifo_queue->queue_lock);
     }
 
-    doubly_insert(user_data, DOUBLY_INSERT_BEGIN, 0, fifo_queue->doubly_context);
+    doubly_node_t* queue_node = queue_node_take(fifo_queue);
 
-    queue_sync(fifo_queue);
+    if (queue_node != NULL)
+    {
+        queue_node->user_data = user_data;
+        queue_node->node_next = fifo_queue->node_head;
+
+        if (fifo_queue->node_head != NULL)
+        {
+            fifo_queue->node_head->node_prev = queue_node;
+        }
+        else
+        {
+            fifo_queue->node_tail = queue_node;
+        }
+        fifo_queue->node_head = queue_node;
+        fifo_queue->queue_length++;
+    }
 
     if (fifo_queue->queue_lock != NULL)
     {
         pthread_mutex_unlock(fifo_queue->queue_lock);
     }
 
-    return true;
+    return queue_node != NULL;
 }
 
 /* Dequeue the element from the queue, but doesn't deallocate
@@ -118,17 +176,28 @@ void* queue_dequeue(FIFO_queue_t* fifo_queue)
     {
         pthread_mutex_lock(fifo_queue->queue_lock);
     }
-    
+
     void* node_data = NULL;
-    
+
     doubly_node_t* node_head = fifo_queue->node_head;
-    
+
     if (node_head != NULL)
     {
-        node_data = doubly_remove(node_head, fifo_queue->doubly_context);
+        node_data = node_head->user_data;
+
+        fifo_queue->node_head = node_head->node_next;
+        if (fifo_queue->node_head != NULL)
+        {
+            fifo_queue->node_head->node_prev = NULL;
+        }
+        else
+        {
+            fifo_queue->node_tail = NULL;
+        }
+        fifo_queue->queue_length--;
+
+        queue_node_give(node_head, fifo_queue);
     }
-    
-    queue_sync(fifo_queue);
 
     if (fifo_queue->queue_lock != NULL)
     {
@@ -149,13 +218,24 @@ void* queue_dequeue_inverse(FIFO_queue_t* fifo_queue)
 
     doubly_node_t* node_tail = fifo_queue->node_tail;
 
-    if (node_tail == NULL)
+    if (node_tail != NULL)
     {
-        return NULL;
+        node_data = node_tail->user_data;
+
+        fifo_queue->node_tail = node_tail->node_prev;
+        if (fifo_queue->node_tail != NULL)
+        {
+            fifo_queue->node_tail->node_next = NULL;
+        }
+        else
+        {
+            fifo_queue->node_head = NULL;
+        }
+        fifo_queue->queue_length--;
+
+        queue_node_give(node_tail, fifo_queue);
     }
-    node_data = doubly_remove(node_tail, fifo_queue->doubly_context);
-    
-    queue_sync(fifo_queue);
+
     if (fifo_queue->queue_lock != NULL)
     {
         pthread_mutex_unlock(fifo_queue->queue_lock);
@@ -163,16 +243,26 @@ void* queue_dequeue_inverse(FIFO_queue_t* fifo_queue)
     return node_data;
 }
 
-/* Resize the capacity of the queue */
-bool queue_resize(int desired_capacity, FIFO_queue_t* fifo_queue)
+/* Allocates free nodes until the queue holds `desired_capacity` elements without allocating */
+bool queue_resize(int64_t desired_capacity, FIFO_queue_t* fifo_queue)
 {
-    return doubly_resize(desired_capacity, fifo_queue->doubly_context);
+    while (fifo_queue->queue_actual_capacity < (size_t)desired_capacity)
+    {
+        doubly_node_t* queue_node = (doubly_node_t*)calloc(1, sizeof(doubly_node_t));
+        if (queue_node == NULL)
+        {
+            return false;
+        }
+        fifo_queue->queue_actual_capacity++;
+        queue_node_give(queue_node, fifo_queue);
+    }
+    return true;
 }
 
 bool queue_destroy(FIFO_queue_t *fifo_queue)
 {
     pthread_mutex_t** queue_mutex_ptr = &fifo_queue->queue_lock;
-    
+
     if (*queue_mutex_ptr)
     {
         pthread_mutex_lock(*queue_mutex_ptr);
@@ -185,10 +275,11 @@ bool queue_destroy(FIFO_queue_t *fifo_queue)
         fifo_queue->destroy_callback(fifo_queue);
     }
 
-    doubly_destroy(fifo_queue->doubly_context);
+    queue_node_free_all(fifo_queue->node_head);
+    queue_node_free_all(fifo_queue->node_free);
 
     fifo_queue->queue_length = fifo_queue->queue_actual_capacity = 0;
-    fifo_queue->node_head = fifo_queue->node_tail = NULL;
+    fifo_queue->node_head = fifo_queue->node_tail = fifo_queue->node_free = NULL;
 
     if (*queue_mutex_ptr)
     {
@@ -223,4 +314,3 @@ bool queue_full(const FIFO_queue_t *fifo_queue)
 {
     return queue_length(fifo_queue) == queue_capacity(fifo_queue);
 }
-
@@ -11,14 +11,16 @@ typedef void (*at_FIFO_dequeue_t)(void* fifo_node);
 
 typedef struct FIFO_queue
 {
-    doubly_linked_t* doubly_context;
-
     doubly_node_t* node_head;
 
     doubly_node_t* node_tail;
 
+    /* Nodes of dequeued elements, linked by node_next, taken again by the next enqueues */
+    doubly_node_t* node_free;
+
     _Atomic size_t queue_length;
 
+    /* Nodes allocated, in the queue or free */
     _Atomic size_t queue_actual_capacity;
 
     pthread_mutex_t* queue_lock;
@@ -45,7 +47,7 @@ bool queue_enqueue(void* user_data, FIFO_queue_t* fifo_queue);
 void* queue_dequeue(FIFO_queue_t* fifo_queue);
 void* queue_dequeue_inverse(FIFO_queue_t* fifo_queue);
 
-bool queue_sync(FIFO_queue_t* fifo_queue);
+bool queue_resize(int64_t desired_capacity, FIFO_queue_t* fifo_queue);
 
 size_t queue_length(const FIFO_queue_t *fifo_queue);
 size_t queue_capacity(const FIFO_queue_t *fifo_queue);
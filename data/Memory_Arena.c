@@ -0,0 +1,275 @@
+#include <malloc.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "Memory_Arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_DEFAULT_BLOCK (64 * 1024)
+
+/* From <numaif.h>, libnuma isn't needed for a single system call */
+#define ARENA_MPOL_PREFERRED 1
+
+static _Thread_local memory_arena_t* arena_thread_scratch;
+
+/* A block bound to a node is a mapping of his own, whole pages */
+static size_t arena_mapping_size(size_t block_size)
+{
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    return (sizeof(arena_block_t) + block_size + page_size - 1) & ~(page_size - 1);
+}
+
+static arena_block_t* arena_new_block(size_t block_size, int numa_node)
+{
+    arena_block_t* new_block;
+
+    if (numa_node < 0)
+    {
+        new_block = (arena_block_t*)malloc(sizeof(arena_block_t) + block_size);
+        if (new_block == NULL)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        size_t mapping_size = arena_mapping_size(block_size);
+
+        new_block = (arena_block_t*)mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (new_block == MAP_FAILED)
+        {
+            return NULL;
+        }
+        block_size = mapping_size - sizeof(arena_block_t);
+
+        /* Nothing is placed yet, the pages go to the node when they're touched. Without the
+         * call (no NUMA in the kernel, a seccomp filter) the worker touching them is on the node
+        */
+        if (numa_node < (int)(sizeof(unsigned long) * 8))
+        {
+            unsigned long node_mask = 1UL << numa_node;
+            syscall(SYS_mbind, new_block, mapping_size, ARENA_MPOL_PREFERRED, &node_mask, sizeof(node_mask) * 8, 0);
+        }
+    }
+
+    new_block->block_next = NULL;
+    new_block->block_size = block_size;
+    new_block->block_used = 0;
+
+    return new_block;
+}
+
+static void arena_free_block(arena_block_t* block, const memory_arena_t* arena)
+{
+    if (arena->arena_node < 0)
+    {
+        free((void*)block);
+    }
+    else
+    {
+        munmap((void*)block, arena_mapping_size(block->block_size));
+    }
+}
+
+static void arena_free_list(arena_block_t* block_cur, const memory_arena_t* arena)
+{
+    while (block_cur != NULL)
+    {
+        arena_block_t* block_next = block_cur->block_next;
+        arena_free_block(block_cur, arena);
+        block_cur = block_next;
+    }
+}
+
+memory_arena_t* arena_create(size_t block_size)
+{
+    return arena_create_on_node(block_size, -1);
+}
+
+memory_arena_t* arena_create_on_node(size_t block_size, int numa_node)
+{
+    memory_arena_t* arena = (memory_arena_t*)calloc(1, sizeof(memory_arena_t));
+    if (arena == NULL)
+    {
+        return NULL;
+    }
+
+    arena->block_default_size = block_size != 0 ? block_size : ARENA_DEFAULT_BLOCK;
+    arena->arena_node = numa_node < 0 ? -1 : numa_node;
+
+    return arena;
+}
+
+bool arena_destroy(memory_arena_t* arena)
+{
+    arena_free_list(arena->arena_head, arena);
+    arena_free_list(arena->arena_spare, arena);
+
+    free((void*)arena);
+
+    return true;
+}
+
+static void arena_push_block(arena_block_t* block, memory_arena_t* arena)
+{
+    block->block_next = arena->arena_head;
+    block->block_used = 0;
+
+    if (arena->arena_head == NULL)
+    {
+        arena->arena_tail = block;
+    }
+    arena->arena_head = block;
+}
+
+void* arena_alloc(size_t alloc_size, memory_arena_t* arena)
+{
+    size_t aligned_size = (alloc_size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    arena_block_t* head_block = arena->arena_head;
+
+    if (head_block == NULL || head_block->block_size - head_block->block_used < aligned_size)
+    {
+        /* The spare blocks are few, the first one big enough is taken */
+        arena_block_t** spare_link = &arena->arena_spare;
+        while (*spare_link != NULL && (*spare_link)->block_size < aligned_size)
+        {
+            spare_link = &(*spare_link)->block_next;
+        }
+
+        if (*spare_link != NULL)
+        {
+            head_block = *spare_link;
+            *spare_link = head_block->block_next;
+        }
+        else
+        {
+            size_t block_size = arena->block_default_size;
+            if (aligned_size > block_size)
+            {
+                block_size = aligned_size;
+            }
+
+            head_block = arena_new_block(block_size, arena->arena_node);
+            if (head_block == NULL)
+            {
+                return NULL;
+            }
+            arena->arena_allocated += head_block->block_size;
+        }
+        arena_push_block(head_block, arena);
+    }
+
+    void* allocated = head_block->block_data + head_block->block_used;
+    head_block->block_used += aligned_size;
+
+    return allocated;
+}
+
+char* arena_strndup(const char* string, size_t string_length, memory_arena_t* arena)
+{
+    char* new_string = (char*)arena_alloc(string_length + 1, arena);
+    if (new_string == NULL)
+    {
+        return NULL;
+    }
+
+    memcpy(new_string, string, string_length);
+    new_string[string_length] = '\0';
+
+    return new_string;
+}
+
+void arena_reset(memory_arena_t* arena)
+{
+    while (arena->arena_spare != NULL)
+    {
+        arena_block_t* spare_block = arena->arena_spare;
+        arena->arena_spare = spare_block->block_next;
+        arena->arena_allocated -= spare_block->block_size;
+        arena_free_block(spare_block, arena);
+    }
+
+    arena_block_t* block_cur = arena->arena_head;
+    if (block_cur == NULL)
+    {
+        return;
+    }
+
+    /* Only the oldest block survives, it's the one at the end of the list */
+    while (block_cur->block_next != NULL)
+    {
+        arena_block_t* block_next = block_cur->block_next;
+        arena->arena_allocated -= block_cur->block_size;
+        arena_free_block(block_cur, arena);
+        block_cur = block_next;
+    }
+
+    block_cur->block_used = 0;
+    arena->arena_head = arena->arena_tail = block_cur;
+}
+
+void arena_rewind(memory_arena_t* arena)
+{
+    arena_block_t* head_block = arena->arena_head;
+    if (head_block == NULL)
+    {
+        return;
+    }
+
+    /* The newest block stays in use, the older ones go in front of the spare blocks */
+    if (head_block->block_next != NULL)
+    {
+        arena->arena_tail->block_next = arena->arena_spare;
+        arena->arena_spare = head_block->block_next;
+        head_block->block_next = NULL;
+        arena->arena_tail = head_block;
+    }
+    head_block->block_used = 0;
+}
+
+arena_mark_t arena_mark(const memory_arena_t* arena)
+{
+    arena_mark_t mark = {
+        .mark_block = arena->arena_head, .mark_used = arena->arena_head != NULL ? arena->arena_head->block_used : 0
+    };
+    return mark;
+}
+
+void arena_rewind_to(arena_mark_t mark, memory_arena_t* arena)
+{
+    /* The blocks pushed since the mark, most often none */
+    while (arena->arena_head != NULL && arena->arena_head != mark.mark_block)
+    {
+        arena_block_t* spare_block = arena->arena_head;
+
+        arena->arena_head = spare_block->block_next;
+        spare_block->block_next = arena->arena_spare;
+        arena->arena_spare = spare_block;
+    }
+
+    if (arena->arena_head != NULL)
+    {
+        arena->arena_head->block_used = mark.mark_used;
+    }
+    else
+    {
+        arena->arena_tail = NULL;
+    }
+}
+
+size_t arena_allocated(const memory_arena_t* arena)
+{
+    return arena->arena_allocated;
+}
+
+memory_arena_t* arena_scratch(void)
+{
+    return arena_thread_scratch;
+}
+
+void arena_scratch_set(memory_arena_t* scratch)
+{
+    arena_thread_scratch = scratch;
+}
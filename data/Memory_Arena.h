@@ -0,0 +1,83 @@
+#ifndef DATA_MEMORY_ARENA_H
+#define DATA_MEMORY_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct arena_block
+{
+    struct arena_block* block_next;
+
+    size_t block_size;
+
+    size_t block_used;
+
+    _Alignas(16) uint8_t block_data[];
+
+} arena_block_t;
+
+/* A bump allocator, all memory is released at once when the arena is reset or destroyed,
+ * the arena isn't thread safe, the caller must serialize the accesses!
+*/
+typedef struct memory_arena
+{
+    arena_block_t* arena_head;
+
+    /* The oldest block, the end of the list */
+    arena_block_t* arena_tail;
+
+    /* Blocks emptied by a rewind, used again before allocating new ones */
+    arena_block_t* arena_spare;
+
+    size_t block_default_size;
+
+    size_t arena_allocated;
+
+    /* The NUMA node the blocks are placed on, -1 for the node of the first thread touching them */
+    int arena_node;
+
+} memory_arena_t;
+
+/* A position into an arena, everything allocated after it can be released at once */
+typedef struct arena_mark
+{
+    arena_block_t* mark_block;
+
+    size_t mark_used;
+
+} arena_mark_t;
+
+memory_arena_t* arena_create(size_t block_size);
+bool arena_destroy(memory_arena_t* arena);
+
+/* The blocks are mapped apart and bound to `numa_node` (preferred, the kernel falls back on
+ * another node when it's full), a negative node gives the same arena as arena_create
+*/
+memory_arena_t* arena_create_on_node(size_t block_size, int numa_node);
+
+void* arena_alloc(size_t alloc_size, memory_arena_t* arena);
+
+char* arena_strndup(const char* string, size_t string_length, memory_arena_t* arena);
+
+/* Discards all allocations, the first block is kept for the next use */
+void arena_reset(memory_arena_t* arena);
+
+/* Discards all allocations in O(1), every block is kept for the next ones */
+void arena_rewind(memory_arena_t* arena);
+
+arena_mark_t arena_mark(const memory_arena_t* arena);
+
+/* Releases what was allocated since `mark`, the blocks are kept as arena_rewind does */
+void arena_rewind_to(arena_mark_t mark, memory_arena_t* arena);
+
+/* The scratch arena of the calling thread, each pool worker has one on his NUMA node and
+ * rewinds it between two tasks. NULL on the other threads, the callers fall back on malloc
+*/
+memory_arena_t* arena_scratch(void);
+void arena_scratch_set(memory_arena_t* scratch);
+
+size_t arena_allocated(const memory_arena_t* arena);
+
+#endif
+
@@ -0,0 +1,623 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "Name_Index.h"
+
+struct index_node
+{
+    /* The label is a piece of the first key under the node */
+    uint32_t label_offset;
+
+    uint32_t label_length;
+
+    /* The length of the name from the root until the end of the label */
+    uint32_t path_length;
+
+    uint32_t first_child;
+
+    uint32_t children_count;
+
+    uint32_t keys_first;
+
+    uint32_t keys_end;
+};
+
+struct index_pair
+{
+    uint32_t name_offset;
+
+    uint32_t name_length;
+
+    uint32_t name_id;
+};
+
+struct index_glob
+{
+    const name_index_t* name_index;
+
+    /* One byte per key under the node where the walk starts */
+    uint8_t* keys_matched;
+
+    uint32_t keys_base;
+};
+
+void index_builder_init(index_builder_t* builder)
+{
+    outbuf_init(0, NULL, NULL, &builder->builder_pairs);
+    outbuf_init(0, NULL, NULL, &builder->builder_names);
+}
+
+bool index_builder_add(const char* name, size_t name_length, uint32_t name_id, index_builder_t* builder)
+{
+    struct index_pair pair = {
+        .name_offset = (uint32_t)outbuf_length(&builder->builder_names),
+        .name_length = (uint32_t)name_length,
+        .name_id = name_id
+    };
+
+    if (name_length >= UINT32_MAX - outbuf_length(&builder->builder_names))
+    {
+        return false;
+    }
+    return outbuf_append(name, name_length, &builder->builder_names) && outbuf_append(&pair, sizeof(pair), &builder->builder_pairs);
+}
+
+static int index_pair_order(const void* left, const void* right, void* names)
+{
+    const struct index_pair* left_pair = (const struct index_pair*)left;
+    const struct index_pair* right_pair = (const struct index_pair*)right;
+    uint32_t common_length = left_pair->name_length < right_pair->name_length ? left_pair->name_length : right_pair->name_length;
+
+    int name_order = memcmp((const char*)names + left_pair->name_offset, (const char*)names + right_pair->name_offset, common_length);
+    if (name_order != 0)
+    {
+        return name_order;
+    }
+    if (left_pair->name_length != right_pair->name_length)
+    {
+        return left_pair->name_length < right_pair->name_length ? -1 : 1;
+    }
+    return left_pair->name_id < right_pair->name_id ? -1 : left_pair->name_id > right_pair->name_id;
+}
+
+static uint32_t index_key_length(uint32_t key_index, const name_index_t* name_index)
+{
+    return name_index->key_offsets[key_index + 1] - name_index->key_offsets[key_index] - 1;
+}
+
+/* The nodes are made in breadth first order, so the children of a node are contiguous. Each
+ * node is created with his keys range and the depth where his label starts (in label_length)
+*/
+static bool index_build_nodes(output_buffer_t* nodes, const name_index_t* name_index)
+{
+    struct index_node root = { .keys_end = name_index->keys_count };
+
+    if (outbuf_append(&root, sizeof(root), nodes) == false)
+    {
+        return false;
+    }
+
+    for (size_t node_cur = 0; node_cur < outbuf_length(nodes) / sizeof(struct index_node); node_cur++)
+    {
+        struct index_node* node = (struct index_node*)nodes->buffer_data + node_cur;
+        uint32_t keys_first = node->keys_first;
+        uint32_t keys_end = node->keys_end;
+        uint32_t label_begin = node->label_length;
+
+        /* The keys are sorted, the common prefix of the range is the one of the first and the last */
+        const char* first_key = name_index->keys_text + name_index->key_offsets[keys_first];
+        const char* last_key = name_index->keys_text + name_index->key_offsets[keys_end - 1];
+        uint32_t first_length = index_key_length(keys_first, name_index);
+        uint32_t path_length = label_begin;
+
+        while (path_length < first_length && first_key[path_length] == last_key[path_length])
+        {
+            path_length++;
+        }
+
+        node->label_offset = name_index->key_offsets[keys_first] + label_begin;
+        node->label_length = path_length - label_begin;
+        node->path_length = path_length;
+        node->first_child = (uint32_t)(outbuf_length(nodes) / sizeof(struct index_node));
+        node->children_count = 0;
+
+        /* A key ending here sorts before all the longer ones */
+        uint32_t child_first = first_length == path_length ? keys_first + 1 : keys_first;
+
+        while (child_first < keys_end)
+        {
+            char branch_byte = name_index->keys_text[name_index->key_offsets[child_first] + path_length];
+            uint32_t child_end = child_first + 1;
+
+            while (child_end < keys_end && name_index->keys_text[name_index->key_offsets[child_end] + path_length] == branch_byte)
+            {
+                child_end++;
+            }
+
+            struct index_node child = { .label_length = path_length, .keys_first = child_first, .keys_end = child_end };
+            if (outbuf_append(&child, sizeof(child), nodes) == false)
+            {
+                return false;
+            }
+            /* The append may have moved the nodes */
+            node = (struct index_node*)nodes->buffer_data + node_cur;
+            node->children_count++;
+            child_first = child_end;
+        }
+    }
+
+    return true;
+}
+
+bool index_build(index_builder_t* builder, name_index_t* name_index)
+{
+    struct index_pair* pairs = (struct index_pair*)builder->builder_pairs.buffer_data;
+    size_t pairs_count = outbuf_length(&builder->builder_pairs) / sizeof(struct index_pair);
+    const char* names = builder->builder_names.buffer_data;
+    bool build_ret = builder->builder_pairs.buffer_failed == false && builder->builder_names.buffer_failed == false;
+
+    memset(name_index, 0, sizeof(*name_index));
+
+    if (build_ret && pairs_count > 1)
+    {
+        qsort_r(pairs, pairs_count, sizeof(*pairs), index_pair_order, (void*)names);
+    }
+
+    uint32_t keys_count = 0;
+    size_t text_size = 0;
+    for (size_t pair_cur = 0; build_ret && pair_cur < pairs_count; pair_cur++)
+    {
+        if (pair_cur == 0 || pairs[pair_cur].name_length != pairs[pair_cur - 1].name_length ||
+            memcmp(names + pairs[pair_cur].name_offset, names + pairs[pair_cur - 1].name_offset, pairs[pair_cur].name_length) != 0)
+        {
+            keys_count++;
+            text_size += pairs[pair_cur].name_length + 1;
+        }
+    }
+    build_ret = build_ret && text_size < UINT32_MAX;
+
+    /* The keys first, the nodes are appended once their count is known */
+    size_t arrays_size = ((size_t)keys_count + 1) * 8 + pairs_count * 4;
+    size_t keys_size = arrays_size + ((text_size + 3) & ~(size_t)3);
+    uint8_t* keys_data = build_ret ? malloc(keys_size + 4) : NULL;
+    build_ret = keys_data != NULL;
+
+    if (build_ret)
+    {
+        uint32_t* key_offsets = (uint32_t*)keys_data;
+        uint32_t* key_values = key_offsets + keys_count + 1;
+        uint32_t* values = key_values + keys_count + 1;
+        char* keys_text = (char*)(values + pairs_count);
+        uint32_t key_cur = 0;
+        uint32_t text_cur = 0;
+
+        for (size_t pair_cur = 0; pair_cur < pairs_count; pair_cur++)
+        {
+            const struct index_pair* pair = &pairs[pair_cur];
+
+            if (key_cur == 0 || pair->name_length != key_offsets[key_cur] - key_offsets[key_cur - 1] - 1 ||
+                memcmp(names + pair->name_offset, keys_text + key_offsets[key_cur - 1], pair->name_length) != 0)
+            {
+                key_offsets[key_cur] = text_cur;
+                key_values[key_cur] = (uint32_t)pair_cur;
+                memcpy(keys_text + text_cur, names + pair->name_offset, pair->name_length);
+                text_cur += pair->name_length;
+                keys_text[text_cur++] = '\0';
+                key_offsets[++key_cur] = text_cur;
+            }
+            values[pair_cur] = pair->name_id;
+        }
+        key_offsets[keys_count] = text_cur;
+        key_values[keys_count] = (uint32_t)pairs_count;
+
+        name_index->key_offsets = key_offsets;
+        name_index->key_values = key_values;
+        name_index->values = values;
+        name_index->keys_text = keys_text;
+        name_index->keys_count = keys_count;
+    }
+
+    output_buffer_t nodes;
+    outbuf_init(0, NULL, NULL, &nodes);
+    if (build_ret && keys_count != 0)
+    {
+        build_ret = index_build_nodes(&nodes, name_index);
+    }
+
+    /* Everything moves into a single buffer */
+    if (build_ret)
+    {
+        size_t nodes_size = outbuf_length(&nodes);
+        uint8_t* index_data = malloc(keys_size + nodes_size + 1);
+
+        build_ret = index_data != NULL;
+        if (build_ret)
+        {
+            memcpy(index_data, keys_data, keys_size);
+            memcpy(index_data + keys_size, nodes.buffer_data, nodes_size);
+
+            name_index->index_data = index_data;
+            name_index->index_size = keys_size + nodes_size;
+            name_index->key_offsets = (const uint32_t*)index_data;
+            name_index->key_values = name_index->key_offsets + keys_count + 1;
+            name_index->values = name_index->key_values + keys_count + 1;
+            name_index->keys_text = (const char*)(name_index->values + pairs_count);
+            name_index->nodes = (const struct index_node*)(index_data + keys_size);
+            name_index->nodes_count = (uint32_t)(nodes_size / sizeof(struct index_node));
+        }
+    }
+
+    free((void*)keys_data);
+    outbuf_deinit(&nodes);
+    outbuf_deinit(&builder->builder_pairs);
+    outbuf_deinit(&builder->builder_names);
+
+    if (build_ret == false)
+    {
+        memset(name_index, 0, sizeof(*name_index));
+    }
+    return build_ret;
+}
+
+void index_release(name_index_t* name_index)
+{
+    free((void*)name_index->index_data);
+    memset(name_index, 0, sizeof(*name_index));
+}
+
+const char* index_key(uint32_t key_index, size_t* key_length, const name_index_t* name_index)
+{
+    *key_length = index_key_length(key_index, name_index);
+    return name_index->keys_text + name_index->key_offsets[key_index];
+}
+
+static bool index_report(uint32_t keys_first, uint32_t keys_end, index_match_fn on_match, void* match_data, const name_index_t* name_index)
+{
+    for (uint32_t key_cur = keys_first; key_cur < keys_end; key_cur++)
+    {
+        for (uint32_t value_cur = name_index->key_values[key_cur]; value_cur < name_index->key_values[key_cur + 1]; value_cur++)
+        {
+            if (on_match(key_cur, name_index->values[value_cur], match_data) == false)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static const struct index_node* index_child(const struct index_node* node, char branch_byte, const name_index_t* name_index)
+{
+    const struct index_node* children = name_index->nodes + node->first_child;
+    uint32_t child_low = 0;
+    uint32_t child_high = node->children_count;
+
+    /* The children are in the order of their first byte */
+    while (child_low < child_high)
+    {
+        uint32_t child_mid = (child_low + child_high) / 2;
+        unsigned char mid_byte = (unsigned char)name_index->keys_text[children[child_mid].label_offset];
+
+        if (mid_byte == (unsigned char)branch_byte)
+        {
+            return &children[child_mid];
+        }
+        if (mid_byte < (unsigned char)branch_byte)
+        {
+            child_low = child_mid + 1;
+        }
+        else
+        {
+            child_high = child_mid;
+        }
+    }
+    return NULL;
+}
+
+/* The node under which all names start with `prefix` */
+static const struct index_node* index_walk(const char* prefix, size_t prefix_length, const name_index_t* name_index)
+{
+    if (name_index->nodes_count == 0)
+    {
+        return NULL;
+    }
+
+    const struct index_node* node = name_index->nodes;
+    size_t prefix_cur = 0;
+
+    for (;;)
+    {
+        size_t label_begin = node->path_length - node->label_length;
+        size_t compare_length = node->path_length < prefix_length ? node->label_length : prefix_length - label_begin;
+
+        if (memcmp(name_index->keys_text + node->label_offset, prefix + prefix_cur, compare_length) != 0)
+        {
+            return NULL;
+        }
+        prefix_cur += compare_length;
+        if (prefix_cur == prefix_length)
+        {
+            return node;
+        }
+
+        node = index_child(node, prefix[prefix_cur], name_index);
+        if (node == NULL)
+        {
+            return NULL;
+        }
+    }
+}
+
+bool index_find(const char* name, size_t name_length, uint32_t* key_index, const name_index_t* name_index)
+{
+    const struct index_node* node = index_walk(name, name_length, name_index);
+
+    if (node == NULL || index_key_length(node->keys_first, name_index) != name_length)
+    {
+        return false;
+    }
+    *key_index = node->keys_first;
+    return true;
+}
+
+bool index_prefix(const char* prefix, size_t prefix_length, index_match_fn on_match, void* match_data, const name_index_t* name_index)
+{
+    const struct index_node* node = index_walk(prefix, prefix_length, name_index);
+
+    if (node == NULL)
+    {
+        return true;
+    }
+    return index_report(node->keys_first, node->keys_end, on_match, match_data, name_index);
+}
+
+bool index_substring(const char* needle, size_t needle_length, index_match_fn on_match, void* match_data, const name_index_t* name_index)
+{
+    const char* text = name_index->keys_text;
+    const char* text_end = text + (name_index->keys_count != 0 ? name_index->key_offsets[name_index->keys_count] : 0);
+
+    for (const char* cursor = text; cursor < text_end; )
+    {
+        /* The names are split by NULs, a needle can't match across two of them */
+        const char* found = memmem(cursor, (size_t)(text_end - cursor), needle, needle_length);
+        if (found == NULL)
+        {
+            break;
+        }
+
+        uint32_t key_low = 0;
+        uint32_t key_high = name_index->keys_count;
+        while (key_high - key_low > 1)
+        {
+            uint32_t key_mid = (key_low + key_high) / 2;
+            if (name_index->key_offsets[key_mid] <= (uint32_t)(found - text))
+            {
+                key_low = key_mid;
+            }
+            else
+            {
+                key_high = key_mid;
+            }
+        }
+
+        if (index_report(key_low, key_low + 1, on_match, match_data, name_index) == false)
+        {
+            return false;
+        }
+        cursor = text + name_index->key_offsets[key_low + 1];
+    }
+    return true;
+}
+
+bool index_is_glob(const char* pattern)
+{
+    return strpbrk(pattern, "*?[") != NULL;
+}
+
+/* Matches `name_byte` against the class starting at `pattern` ('['), sets the class end */
+static bool index_glob_class(const char* pattern, char name_byte, const char** class_end)
+{
+    const char* class_cur = pattern + 1;
+    bool class_negated = *class_cur == '!' || *class_cur == '^';
+    bool class_matched = false;
+
+    if (class_negated)
+    {
+        class_cur++;
+    }
+
+    /* A ']' right after the '[' is a member */
+    do
+    {
+        if (*class_cur == '\0')
+        {
+            /* Not a class, the '[' is a plain byte */
+            *class_end = pattern + 1;
+            return name_byte == '[';
+        }
+        if (class_cur[1] == '-' && class_cur[2] != ']' && class_cur[2] != '\0')
+        {
+            class_matched |= (unsigned char)name_byte >= (unsigned char)class_cur[0] && (unsigned char)name_byte <= (unsigned char)class_cur[2];
+            class_cur += 3;
+        }
+        else
+        {
+            class_matched |= name_byte == *class_cur;
+            class_cur++;
+        }
+    } while (*class_cur != ']');
+
+    *class_end = class_cur + 1;
+    return class_matched != class_negated && name_byte != '/';
+}
+
+static void index_glob_node(const struct index_node* node, uint32_t label_cur, const char* pattern, struct index_glob* glob_walk)
+{
+    const name_index_t* name_index = glob_walk->name_index;
+    const char* label = name_index->keys_text + node->label_offset;
+
+    for (;;)
+    {
+        /* Everything under this point matches */
+        if (pattern[0] == '*' && pattern[1] == '*' && pattern[2] == '\0')
+        {
+            memset(glob_walk->keys_matched + node->keys_first - glob_walk->keys_base, 1, node->keys_end - node->keys_first);
+            return;
+        }
+
+        if (label_cur == node->label_length)
+        {
+            const char* pattern_rest = pattern;
+            while (*pattern_rest == '*')
+            {
+                pattern_rest++;
+            }
+            if (*pattern_rest == '\0' && index_key_length(node->keys_first, name_index) == node->path_length)
+            {
+                glob_walk->keys_matched[node->keys_first - glob_walk->keys_base] = 1;
+            }
+            if (*pattern == '\0')
+            {
+                return;
+            }
+
+            for (uint32_t child_cur = 0; child_cur < node->children_count; child_cur++)
+            {
+                index_glob_node(&name_index->nodes[node->first_child + child_cur], 0, pattern, glob_walk);
+            }
+            return;
+        }
+
+        char name_byte = label[label_cur];
+        const char* class_end;
+
+        switch (*pattern)
+        {
+        case '\0':
+            return;
+
+        case '*':
+        {
+            bool star_any = pattern[1] == '*';
+            const char* pattern_next = pattern + (star_any ? 2 : 1);
+
+            /* The star matches nothing, or one more byte */
+            index_glob_node(node, label_cur, pattern_next, glob_walk);
+            if (star_any == false && name_byte == '/')
+            {
+                return;
+            }
+            label_cur++;
+            break;
+        }
+
+        case '?':
+            if (name_byte == '/')
+            {
+                return;
+            }
+            label_cur++;
+            pattern++;
+            break;
+
+        case '[':
+            if (index_glob_class(pattern, name_byte, &class_end) == false)
+            {
+                return;
+            }
+            label_cur++;
+            pattern = class_end;
+            break;
+
+        case '\\':
+            if (pattern[1] != '\0')
+            {
+                pattern++;
+            }
+            /* Fall through */
+        default:
+            if (*pattern != name_byte)
+            {
+                return;
+            }
+            label_cur++;
+            pattern++;
+            break;
+        }
+    }
+}
+
+bool index_glob(const char* pattern, index_match_fn on_match, void* match_data, const name_index_t* name_index)
+{
+    if (name_index->nodes_count == 0)
+    {
+        return true;
+    }
+
+    /* The literal prefix goes straight down the trie, the rest only looks under it */
+    size_t literal_length = strcspn(pattern, "*?[\\");
+    const struct index_node* node = index_walk(pattern, literal_length, name_index);
+
+    if (node == NULL)
+    {
+        return true;
+    }
+
+    struct index_glob glob_walk = {
+        .name_index = name_index,
+        .keys_matched = calloc(node->keys_end - node->keys_first, 1),
+        .keys_base = node->keys_first
+    };
+    if (glob_walk.keys_matched == NULL)
+    {
+        return false;
+    }
+
+    uint32_t label_begin = node->path_length - node->label_length;
+    index_glob_node(node, (uint32_t)literal_length - label_begin, pattern + literal_length, &glob_walk);
+
+    bool glob_ret = true;
+    for (uint32_t key_cur = node->keys_first; glob_ret && key_cur < node->keys_end; key_cur++)
+    {
+        if (glob_walk.keys_matched[key_cur - glob_walk.keys_base])
+        {
+            glob_ret = index_report(key_cur, key_cur + 1, on_match, match_data, name_index);
+        }
+    }
+
+    free((void*)glob_walk.keys_matched);
+    return glob_ret;
+}
+
+bool index_parse_mode(const char* mode_name, index_mode_t* index_mode)
+{
+    static const char* mode_names[] = { "auto", "prefix", "substring", "glob" };
+
+    for (size_t mode_cur = 0; mode_cur < sizeof(mode_names) / sizeof(*mode_names); mode_cur++)
+    {
+        if (strcmp(mode_name, mode_names[mode_cur]) == 0)
+        {
+            *index_mode = (index_mode_t)mode_cur;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool index_query(const char* pattern, index_mode_t index_mode, index_match_fn on_match, void* match_data, const name_index_t* name_index)
+{
+    if (index_mode == INDEX_MODE_AUTO)
+    {
+        index_mode = index_is_glob(pattern) ? INDEX_MODE_GLOB : INDEX_MODE_SUBSTRING;
+    }
+
+    switch (index_mode)
+    {
+    case INDEX_MODE_PREFIX:
+        return index_prefix(pattern, strlen(pattern), on_match, match_data, name_index);
+    case INDEX_MODE_GLOB:
+        return index_glob(pattern, on_match, match_data, name_index);
+    default:
+        return index_substring(pattern, strlen(pattern), on_match, match_data, name_index);
+    }
+}
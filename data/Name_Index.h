@@ -0,0 +1,93 @@
+#ifndef DATA_NAME_INDEX_H
+#define DATA_NAME_INDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Output_Buffer.h"
+
+struct index_node;
+
+/* How a name query is matched, the default is glob when the pattern has wildcards */
+typedef enum index_mode
+{
+    INDEX_MODE_AUTO,
+    INDEX_MODE_PREFIX,
+    INDEX_MODE_SUBSTRING,
+    INDEX_MODE_GLOB,
+} index_mode_t;
+
+/* A radix trie over names (entry paths, class descriptors...), each name has one or more ids.
+ * Everything lives in a single buffer: the sorted names, the nodes whose labels point into
+ * them and the ids in the order of the names, so the names under a node are a range
+*/
+typedef struct name_index
+{
+    uint8_t* index_data;
+
+    size_t index_size;
+
+    const struct index_node* nodes;
+
+    uint32_t nodes_count;
+
+    /* keys_count + 1 offsets into keys_text, each name is followed by a NUL */
+    const uint32_t* key_offsets;
+
+    const char* keys_text;
+
+    /* The ids of the key k are values[key_values[k]] until values[key_values[k + 1]] */
+    const uint32_t* key_values;
+
+    const uint32_t* values;
+
+    uint32_t keys_count;
+
+} name_index_t;
+
+typedef struct index_builder
+{
+    output_buffer_t builder_pairs;
+
+    output_buffer_t builder_names;
+
+} index_builder_t;
+
+/* Called in the order of the names, false stops the query */
+typedef bool (*index_match_fn)(uint32_t key_index, uint32_t name_id, void* match_data);
+
+void index_builder_init(index_builder_t* builder);
+bool index_builder_add(const char* name, size_t name_length, uint32_t name_id, index_builder_t* builder);
+
+/* Builds the index and releases the builder */
+bool index_build(index_builder_t* builder, name_index_t* name_index);
+void index_release(name_index_t* name_index);
+
+/* The key equal to `name`, false when there's none */
+bool index_find(const char* name, size_t name_length, uint32_t* key_index, const name_index_t* name_index);
+
+/* Walks the trie along the prefix, then reports the whole range under it */
+bool index_prefix(const char* prefix, size_t prefix_length, index_match_fn on_match, void* match_data, const name_index_t* name_index);
+
+/* Keys containing `needle`, it's a search over the names text, not over the trie */
+bool index_substring(const char* needle, size_t needle_length, index_match_fn on_match, void* match_data, const name_index_t* name_index);
+
+/* Shell patterns: '*' and '?' don't match '/', "**" matches anything, [a-z] and [!a] are
+ * classes. The literal prefix is walked in the trie and the branches that can't match are
+ * pruned, each key is reported once
+*/
+bool index_glob(const char* pattern, index_match_fn on_match, void* match_data, const name_index_t* name_index);
+
+/* True for patterns with '*', '?' or '[' */
+bool index_is_glob(const char* pattern);
+
+/* "prefix", "substring" or "glob" */
+bool index_parse_mode(const char* mode_name, index_mode_t* index_mode);
+
+/* Runs the query of the mode, INDEX_MODE_AUTO picks the glob or the substring query */
+bool index_query(const char* pattern, index_mode_t index_mode, index_match_fn on_match, void* match_data, const name_index_t* name_index);
+
+const char* index_key(uint32_t key_index, size_t* key_length, const name_index_t* name_index);
+
+#endif
@@ -0,0 +1,188 @@
+#include <malloc.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "Output_Buffer.h"
+
+#define OUTBUF_DEFAULT_CAPACITY 4096
+
+bool outbuf_init(size_t capacity, output_flush_t flush_callback, void* flush_context, output_buffer_t* output)
+{
+    memset(output, 0, sizeof(*output));
+
+    if (capacity == 0)
+    {
+        capacity = OUTBUF_DEFAULT_CAPACITY;
+    }
+
+    output->buffer_data = (char*)malloc(capacity);
+    if (output->buffer_data == NULL)
+    {
+        output->buffer_failed = true;
+        return false;
+    }
+
+    output->buffer_capacity = capacity;
+    output->flush_callback = flush_callback;
+    output->flush_context = flush_context;
+
+    return true;
+}
+
+void outbuf_deinit(output_buffer_t* output)
+{
+    if (output->buffer_data != NULL)
+    {
+        free((void*)output->buffer_data);
+    }
+    memset(output, 0, sizeof(*output));
+}
+
+bool outbuf_flush(output_buffer_t* output)
+{
+    if (output->flush_callback == NULL || output->buffer_length == 0)
+    {
+        return !output->buffer_failed;
+    }
+
+    if (output->buffer_failed == false)
+    {
+        output->buffer_failed = !output->flush_callback(output->buffer_data, output->buffer_length, output->flush_context);
+    }
+    output->buffer_length = 0;
+
+    return !output->buffer_failed;
+}
+
+void outbuf_reset(output_buffer_t* output)
+{
+    output->buffer_length = 0;
+    output->buffer_failed = false;
+}
+
+/* Makes room for at least `needed` bytes, flushing or growing the buffer */
+static bool outbuf_reserve(size_t needed, output_buffer_t* output)
+{
+    if (output->buffer_failed)
+    {
+        return false;
+    }
+
+    if (output->buffer_capacity - output->buffer_length >= needed)
+    {
+        return true;
+    }
+
+    if (output->flush_callback != NULL)
+    {
+        outbuf_flush(output);
+        if (output->buffer_capacity >= needed)
+        {
+            return !output->buffer_failed;
+        }
+    }
+
+    size_t new_capacity = output->buffer_capacity;
+    while (new_capacity - output->buffer_length < needed)
+    {
+        new_capacity *= 2;
+    }
+
+    char* new_data = (char*)realloc(output->buffer_data, new_capacity);
+    if (new_data == NULL)
+    {
+        output->buffer_failed = true;
+        return false;
+    }
+
+    output->buffer_data = new_data;
+    output->buffer_capacity = new_capacity;
+
+    return true;
+}
+
+bool outbuf_append(const void* data, size_t data_size, output_buffer_t* output)
+{
+    if (data_size == 0)
+    {
+        return !output->buffer_failed;
+    }
+
+    /* Huge writes over a flushable buffer goes straight to the callback */
+    if (output->flush_callback != NULL && data_size >= output->buffer_capacity)
+    {
+        if (outbuf_flush(output) == false)
+        {
+            return false;
+        }
+        output->buffer_failed = !output->flush_callback((const char*)data, data_size, output->flush_context);
+        return !output->buffer_failed;
+    }
+
+    if (outbuf_reserve(data_size, output) == false)
+    {
+        return false;
+    }
+
+    memcpy(output->buffer_data + output->buffer_length, data, data_size);
+    output->buffer_length += data_size;
+
+    return true;
+}
+
+bool outbuf_putc(char character, output_buffer_t* output)
+{
+    if (outbuf_reserve(1, output) == false)
+    {
+        return false;
+    }
+    output->buffer_data[output->buffer_length++] = character;
+
+    return true;
+}
+
+bool outbuf_puts(const char* string, output_buffer_t* output)
+{
+    return outbuf_append(string, strlen(string), output);
+}
+
+bool outbuf_format(output_buffer_t* output, const char* format, ...)
+{
+    va_list format_args;
+
+    if (output->buffer_failed)
+    {
+        return false;
+    }
+
+    va_start(format_args, format);
+    int format_size = vsnprintf(NULL, 0, format, format_args);
+    va_end(format_args);
+
+    if (format_size < 0)
+    {
+        return false;
+    }
+
+    /* vsnprintf always writes the null terminator, but it isn't accounted */
+    if (outbuf_reserve((size_t)format_size + 1, output) == false)
+    {
+        return false;
+    }
+
+    va_start(format_args, format);
+    vsnprintf(output->buffer_data + output->buffer_length, (size_t)format_size + 1, format, format_args);
+    va_end(format_args);
+
+    output->buffer_length += (size_t)format_size;
+
+    return true;
+}
+
+bool outbuf_flush_stdio(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    FILE* output_file = (FILE*)flush_context;
+
+    return fwrite(flush_data, 1, flush_size, output_file) == flush_size;
+}
+
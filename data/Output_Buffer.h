@@ -0,0 +1,55 @@
+#ifndef DATA_OUTPUT_BUFFER_H
+#define DATA_OUTPUT_BUFFER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Receives the buffered content when the buffer is full or has been flushed explicitly */
+typedef bool (*output_flush_t)(const char* flush_data, size_t flush_size, void* flush_context);
+
+typedef struct output_buffer
+{
+    char* buffer_data;
+
+    size_t buffer_length;
+
+    size_t buffer_capacity;
+
+    /* When a flush callback exist, the buffer never grows beyond his capacity,
+     * the content is handed to the callback and the memory is reused!
+    */
+    output_flush_t flush_callback;
+
+    void* flush_context;
+
+    /* Set when an allocation or a flush has failed, all next writes are discarded */
+    bool buffer_failed;
+
+} output_buffer_t;
+
+bool outbuf_init(size_t capacity, output_flush_t flush_callback, void* flush_context, output_buffer_t* output);
+void outbuf_deinit(output_buffer_t* output);
+
+bool outbuf_append(const void* data, size_t data_size, output_buffer_t* output);
+bool outbuf_putc(char character, output_buffer_t* output);
+bool outbuf_puts(const char* string, output_buffer_t* output);
+
+bool outbuf_format(output_buffer_t* output, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+/* Sends all pending content to the flush callback, does nothing for growable buffers */
+bool outbuf_flush(output_buffer_t* output);
+
+/* Discards the content but keeps the allocated memory for the next use */
+void outbuf_reset(output_buffer_t* output);
+
+static inline size_t outbuf_length(const output_buffer_t* output)
+{
+    return output->buffer_length;
+}
+
+/* Stock flush callback, writes the content into a stdio stream (flush_context must be a FILE*) */
+bool outbuf_flush_stdio(const char* flush_data, size_t flush_size, void* flush_context);
+
+#endif
+
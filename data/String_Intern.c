@@ -0,0 +1,261 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "String_Intern.h"
+#include "Content_Hash.h"
+
+#define INTERN_FIRST_SLOTS 256
+#define INTERN_ARENA_BLOCK (16 * 1024)
+/* What the pages can index, it also keeps INTERN_NONE out of the ids */
+#define INTERN_INDEX_MAX (((uint32_t)INTERN_FIRST_PAGE << INTERN_PAGES) - INTERN_FIRST_PAGE)
+
+/* Page 0 holds the first INTERN_FIRST_PAGE strings, each next page twice the previous */
+static void intern_page_of(uint32_t string_index, uint32_t* page_index, uint32_t* page_offset)
+{
+    uint32_t biased = string_index + INTERN_FIRST_PAGE;
+    uint32_t page = (uint32_t)(31 - __builtin_clz(biased)) - (uint32_t)__builtin_ctz(INTERN_FIRST_PAGE);
+
+    *page_index = page;
+    *page_offset = biased - ((uint32_t)INTERN_FIRST_PAGE << page);
+}
+
+intern_table_t* intern_create(void)
+{
+    intern_table_t* intern_table = memalign(64, sizeof(intern_table_t));
+    if (intern_table == NULL)
+    {
+        return NULL;
+    }
+    memset(intern_table, 0, sizeof(*intern_table));
+    intern_table->hash_seed = 0x9e3779b97f4a7c15;
+
+    for (size_t stripe_cur = 0; stripe_cur < INTERN_STRIPES; stripe_cur++)
+    {
+        intern_stripe_t* stripe = &intern_table->table_stripes[stripe_cur];
+
+        pthread_mutex_init(&stripe->stripe_lock, NULL);
+        stripe->slots = calloc(INTERN_FIRST_SLOTS, sizeof(struct intern_slot));
+        stripe->slots_mask = INTERN_FIRST_SLOTS - 1;
+        stripe->string_bytes = arena_create(INTERN_ARENA_BLOCK);
+
+        if (stripe->slots == NULL || stripe->string_bytes == NULL)
+        {
+            intern_destroy(intern_table);
+            return NULL;
+        }
+    }
+
+    return intern_table;
+}
+
+bool intern_destroy(intern_table_t* intern_table)
+{
+    for (size_t stripe_cur = 0; stripe_cur < INTERN_STRIPES; stripe_cur++)
+    {
+        intern_stripe_t* stripe = &intern_table->table_stripes[stripe_cur];
+
+        for (size_t page_cur = 0; page_cur < INTERN_PAGES; page_cur++)
+        {
+            free((void*)stripe->string_pages[page_cur]);
+        }
+        if (stripe->string_bytes != NULL)
+        {
+            arena_destroy(stripe->string_bytes);
+        }
+        free((void*)stripe->slots);
+        pthread_mutex_destroy(&stripe->stripe_lock);
+    }
+
+    free((void*)intern_table);
+
+    return true;
+}
+
+static struct intern_string* intern_stripe_string(uint32_t string_index, intern_stripe_t* stripe)
+{
+    uint32_t page_index, page_offset;
+    intern_page_of(string_index, &page_index, &page_offset);
+
+    struct intern_string** string_page = atomic_load_explicit(&stripe->string_pages[page_index], memory_order_acquire);
+    return string_page[page_offset];
+}
+
+/* Doubles the slots, called with the stripe locked */
+static bool intern_stripe_grow(intern_stripe_t* stripe)
+{
+    size_t new_capacity = (stripe->slots_mask + 1) * 2;
+    struct intern_slot* new_slots = calloc(new_capacity, sizeof(struct intern_slot));
+
+    if (new_slots == NULL)
+    {
+        return false;
+    }
+
+    for (size_t slot_cur = 0; slot_cur <= stripe->slots_mask; slot_cur++)
+    {
+        struct intern_slot* slot = &stripe->slots[slot_cur];
+        if (slot->slot_index == 0)
+        {
+            continue;
+        }
+
+        size_t new_index = slot->slot_hash & (new_capacity - 1);
+        while (new_slots[new_index].slot_index != 0)
+        {
+            new_index = (new_index + 1) & (new_capacity - 1);
+        }
+        new_slots[new_index] = *slot;
+    }
+
+    free((void*)stripe->slots);
+    stripe->slots = new_slots;
+    stripe->slots_mask = new_capacity - 1;
+
+    return true;
+}
+
+/* Stores a new string in the stripe, called with the stripe locked */
+static uint32_t intern_stripe_add(const char* string, size_t string_length, intern_stripe_t* stripe)
+{
+    uint32_t string_index = atomic_load_explicit(&stripe->strings_count, memory_order_relaxed);
+    uint32_t page_index, page_offset;
+
+    if (string_index == INTERN_INDEX_MAX || string_length > UINT32_MAX)
+    {
+        return INTERN_NONE;
+    }
+    intern_page_of(string_index, &page_index, &page_offset);
+
+    struct intern_string** string_page = atomic_load_explicit(&stripe->string_pages[page_index], memory_order_relaxed);
+    if (string_page == NULL)
+    {
+        string_page = calloc((size_t)INTERN_FIRST_PAGE << page_index, sizeof(struct intern_string*));
+        if (string_page == NULL)
+        {
+            return INTERN_NONE;
+        }
+        atomic_store_explicit(&stripe->string_pages[page_index], string_page, memory_order_release);
+    }
+
+    struct intern_string* new_string = arena_alloc(sizeof(*new_string) + string_length + 1, stripe->string_bytes);
+    if (new_string == NULL)
+    {
+        return INTERN_NONE;
+    }
+    new_string->string_length = (uint32_t)string_length;
+    memcpy(new_string->string_bytes, string, string_length);
+    new_string->string_bytes[string_length] = '\0';
+
+    string_page[page_offset] = new_string;
+    /* The string is visible to the lookups once the count covers his index */
+    atomic_store_explicit(&stripe->strings_count, string_index + 1, memory_order_release);
+
+    return string_index;
+}
+
+uint32_t intern_string(const char* string, size_t string_length, intern_table_t* intern_table)
+{
+    uint64_t string_hash = hash_content64(string, string_length, intern_table->hash_seed);
+    uint32_t stripe_index = (uint32_t)(string_hash >> (64 - INTERN_STRIPE_BITS));
+    uint32_t slot_hash = (uint32_t)string_hash;
+    intern_stripe_t* stripe = &intern_table->table_stripes[stripe_index];
+    uint32_t string_id = INTERN_NONE;
+
+    pthread_mutex_lock(&stripe->stripe_lock);
+
+    size_t slot_index = slot_hash & stripe->slots_mask;
+    for (;;)
+    {
+        struct intern_slot* slot = &stripe->slots[slot_index];
+
+        if (slot->slot_index == 0)
+        {
+            /* The slots couldn't grow, an empty one must always stay */
+            if (atomic_load_explicit(&stripe->strings_count, memory_order_relaxed) + 1 >= stripe->slots_mask)
+            {
+                break;
+            }
+            uint32_t string_index = intern_stripe_add(string, string_length, stripe);
+            if (string_index == INTERN_NONE)
+            {
+                break;
+            }
+            slot->slot_hash = slot_hash;
+            slot->slot_index = string_index + 1;
+            string_id = string_index << INTERN_STRIPE_BITS | stripe_index;
+
+            /* Half full at most, the probes stay short */
+            if ((size_t)(string_index + 1) * 2 > stripe->slots_mask)
+            {
+                intern_stripe_grow(stripe);
+            }
+            break;
+        }
+
+        if (slot->slot_hash == slot_hash)
+        {
+            const struct intern_string* stored = intern_stripe_string(slot->slot_index - 1, stripe);
+            if (stored->string_length == string_length && memcmp(stored->string_bytes, string, string_length) == 0)
+            {
+                string_id = (slot->slot_index - 1) << INTERN_STRIPE_BITS | stripe_index;
+                break;
+            }
+        }
+        slot_index = (slot_index + 1) & stripe->slots_mask;
+    }
+
+    pthread_mutex_unlock(&stripe->stripe_lock);
+
+    return string_id;
+}
+
+const char* intern_lookup(uint32_t string_id, size_t* string_length, intern_table_t* intern_table)
+{
+    intern_stripe_t* stripe = &intern_table->table_stripes[string_id & (INTERN_STRIPES - 1)];
+    uint32_t string_index = string_id >> INTERN_STRIPE_BITS;
+
+    if (string_id == INTERN_NONE || string_index >= atomic_load_explicit(&stripe->strings_count, memory_order_acquire))
+    {
+        return NULL;
+    }
+
+    const struct intern_string* stored = intern_stripe_string(string_index, stripe);
+    if (string_length != NULL)
+    {
+        *string_length = stored->string_length;
+    }
+    return stored->string_bytes;
+}
+
+size_t intern_count(intern_table_t* intern_table)
+{
+    size_t strings_count = 0;
+
+    for (size_t stripe_cur = 0; stripe_cur < INTERN_STRIPES; stripe_cur++)
+    {
+        strings_count += atomic_load_explicit(&intern_table->table_stripes[stripe_cur].strings_count, memory_order_relaxed);
+    }
+    return strings_count;
+}
+
+size_t intern_memory(intern_table_t* intern_table)
+{
+    size_t memory_used = 0;
+
+    for (size_t stripe_cur = 0; stripe_cur < INTERN_STRIPES; stripe_cur++)
+    {
+        intern_stripe_t* stripe = &intern_table->table_stripes[stripe_cur];
+
+        pthread_mutex_lock(&stripe->stripe_lock);
+        memory_used += arena_allocated(stripe->string_bytes) + (stripe->slots_mask + 1) * sizeof(struct intern_slot);
+        for (size_t page_cur = 0; page_cur < INTERN_PAGES; page_cur++)
+        {
+            if (stripe->string_pages[page_cur] != NULL)
+            {
+                memory_used += ((size_t)INTERN_FIRST_PAGE << page_cur) * sizeof(struct intern_string*);
+            }
+        }
+        pthread_mutex_unlock(&stripe->stripe_lock);
+    }
+    return memory_used;
+}
@@ -0,0 +1,82 @@
+#ifndef DATA_STRING_INTERN_H
+#define DATA_STRING_INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "Memory_Arena.h"
+
+/* Returned when the string can't be stored */
+#define INTERN_NONE 0xffffffff
+
+/* The id keeps the stripe in his low bits, so the stripe of an id is known without a lookup */
+#define INTERN_STRIPE_BITS 6
+#define INTERN_STRIPES (1 << INTERN_STRIPE_BITS)
+
+/* The strings of a stripe are indexed by pages of doubling sizes, a page is never moved */
+#define INTERN_PAGES 20
+#define INTERN_FIRST_PAGE 64
+
+struct intern_slot
+{
+    uint32_t slot_hash;
+
+    /* The index of the string in the stripe plus one, 0 is an empty slot */
+    uint32_t slot_index;
+};
+
+/* Each string is stored as his length followed by the bytes and a NUL */
+struct intern_string
+{
+    uint32_t string_length;
+
+    char string_bytes[];
+};
+
+typedef struct intern_stripe
+{
+    pthread_mutex_t stripe_lock;
+
+    struct intern_slot* slots;
+
+    size_t slots_mask;
+
+    memory_arena_t* string_bytes;
+
+    /* Published with a release store, the lookups read them without the lock */
+    _Atomic(struct intern_string**) string_pages[INTERN_PAGES];
+
+    _Atomic uint32_t strings_count;
+
+} intern_stripe_t;
+
+/* Gives to each distinct string a stable 32 bits id, shared by all threads. The insert path
+ * only locks the stripe of the string, the lookup of an id is lock free, the strings and their
+ * ids live until the table is destroyed
+*/
+typedef struct intern_table
+{
+    _Alignas(64) intern_stripe_t table_stripes[INTERN_STRIPES];
+
+    uint64_t hash_seed;
+
+} intern_table_t;
+
+intern_table_t* intern_create(void);
+bool intern_destroy(intern_table_t* intern_table);
+
+/* Returns the id of the string, inserting it when it's new, INTERN_NONE when there's no memory */
+uint32_t intern_string(const char* string, size_t string_length, intern_table_t* intern_table);
+
+/* The interned bytes (NUL terminated) of an id returned by intern_string, NULL otherwise */
+const char* intern_lookup(uint32_t string_id, size_t* string_length, intern_table_t* intern_table);
+
+size_t intern_count(intern_table_t* intern_table);
+
+/* Bytes held by the strings, their lengths and the slots */
+size_t intern_memory(intern_table_t* intern_table);
+
+#endif
@@ -0,0 +1,344 @@
+#include <string.h>
+
+#include "Binary_XML.h"
+#include "Resource_Chunk.h"
+#include "Resource_Value.h"
+#include "String_Pool.h"
+
+#define AXML_NODE_HEADER_SIZE 16
+#define AXML_ATTRIBUTE_SIZE 20
+#define AXML_MAX_NAMESPACES 32
+#define AXML_MAX_INDENT 64
+
+struct axml_namespace
+{
+    uint32_t prefix_index;
+
+    uint32_t uri_index;
+
+    /* Already declared as xmlns inside an element */
+    bool ns_declared;
+};
+
+struct axml_context
+{
+    string_pool_t axml_strings;
+
+    bool has_strings;
+
+    const uint8_t* resource_map;
+
+    uint32_t resource_map_count;
+
+    struct axml_namespace namespaces[AXML_MAX_NAMESPACES];
+
+    int namespaces_count;
+
+    int element_depth;
+
+    output_buffer_t* xml_output;
+};
+
+static void axml_indent(struct axml_context* axml_ctx)
+{
+    static const char spaces[AXML_MAX_INDENT + 1] = 
+        "                                                                ";
+    
+    int indent_size = axml_ctx->element_depth * 2;
+    if (indent_size > AXML_MAX_INDENT)
+    {
+        indent_size = AXML_MAX_INDENT;
+    }
+    outbuf_append(spaces, (size_t)indent_size, axml_ctx->xml_output);
+}
+
+static bool axml_write_string(uint32_t string_index, struct axml_context* axml_ctx)
+{
+    size_t string_length;
+    const char* string_value = string_pool_get(string_index, &string_length, &axml_ctx->axml_strings);
+
+    if (string_value == NULL)
+    {
+        return false;
+    }
+
+    return res_write_escaped(string_value, string_length, axml_ctx->xml_output);
+}
+
+static bool axml_string_empty(uint32_t string_index, struct axml_context* axml_ctx)
+{
+    size_t string_length = 0;
+    const char* string_value = string_pool_get(string_index, &string_length, &axml_ctx->axml_strings);
+
+    return string_value == NULL || string_length == 0;
+}
+
+/* Writes the `prefix:` of a namespaced name, searching the prefix by the namespace uri */
+static void axml_write_prefix(uint32_t uri_index, struct axml_context* axml_ctx)
+{
+    if (uri_index == STRING_POOL_NO_INDEX)
+    {
+        return;
+    }
+
+    for (int ns_cur = axml_ctx->namespaces_count - 1; ns_cur >= 0; ns_cur--)
+    {
+        if (axml_ctx->namespaces[ns_cur].uri_index == uri_index)
+        {
+            axml_write_string(axml_ctx->namespaces[ns_cur].prefix_index, axml_ctx);
+            outbuf_putc(':', axml_ctx->xml_output);
+            return;
+        }
+    }
+}
+
+static void axml_write_attribute(const uint8_t* attribute, struct axml_context* axml_ctx)
+{
+    output_buffer_t* xml_output = axml_ctx->xml_output;
+
+    uint32_t ns_index = chunk_u32(attribute);
+    uint32_t name_index = chunk_u32(attribute + 4);
+    uint32_t raw_value = chunk_u32(attribute + 8);
+    uint8_t value_type = attribute[15];
+    uint32_t value_data = chunk_u32(attribute + 16);
+
+    outbuf_putc(' ', xml_output);
+    axml_write_prefix(ns_index, axml_ctx);
+
+    /* Obfuscated packages strip the attribute names, only the resource id remains */
+    if (axml_string_empty(name_index, axml_ctx) && name_index < axml_ctx->resource_map_count)
+    {
+        outbuf_format(xml_output, "attr_0x%08x", chunk_u32(axml_ctx->resource_map + name_index * 4));
+    }
+    else
+    {
+        axml_write_string(name_index, axml_ctx);
+    }
+
+    outbuf_puts("=\"", xml_output);
+    if (raw_value != STRING_POOL_NO_INDEX)
+    {
+        axml_write_string(raw_value, axml_ctx);
+    }
+    else
+    {
+        res_write_value(value_type, value_data, &axml_ctx->axml_strings, xml_output);
+    }
+    outbuf_putc('"', xml_output);
+}
+
+static bool axml_start_element(const res_chunk_t* node, bool self_closing, struct axml_context* axml_ctx)
+{
+    output_buffer_t* xml_output = axml_ctx->xml_output;
+    const uint8_t* element = chunk_body(node);
+    
+    if (chunk_body_size(node) < 20)
+    {
+        return false;
+    }
+
+    uint32_t ns_index = chunk_u32(element);
+    uint32_t name_index = chunk_u32(element + 4);
+    uint16_t attribute_start = chunk_u16(element + 8);
+    uint16_t attribute_size = chunk_u16(element + 10);
+    uint16_t attribute_count = chunk_u16(element + 12);
+
+    if (attribute_size < AXML_ATTRIBUTE_SIZE || 
+        (size_t)attribute_start + (size_t)attribute_size * attribute_count > chunk_body_size(node))
+    {
+        return false;
+    }
+
+    axml_indent(axml_ctx);
+    outbuf_putc('<', xml_output);
+    axml_write_prefix(ns_index, axml_ctx);
+    axml_write_string(name_index, axml_ctx);
+
+    /* Declaring the namespaces started right before this element */
+    for (int ns_cur = 0; ns_cur < axml_ctx->namespaces_count; ns_cur++)
+    {
+        struct axml_namespace* namespace = &axml_ctx->namespaces[ns_cur];
+        if (namespace->ns_declared)
+        {
+            continue;
+        }
+
+        outbuf_puts(" xmlns:", xml_output);
+        axml_write_string(namespace->prefix_index, axml_ctx);
+        outbuf_puts("=\"", xml_output);
+        axml_write_string(namespace->uri_index, axml_ctx);
+        outbuf_putc('"', xml_output);
+
+        namespace->ns_declared = true;
+    }
+
+    const uint8_t* attribute = element + attribute_start;
+    for (uint16_t attribute_cur = 0; attribute_cur < attribute_count; attribute_cur++)
+    {
+        axml_write_attribute(attribute, axml_ctx);
+        attribute += attribute_size;
+    }
+
+    if (self_closing)
+    {
+        outbuf_puts("/>\n", xml_output);
+    }
+    else
+    {
+        outbuf_puts(">\n", xml_output);
+        axml_ctx->element_depth++;
+    }
+
+    return true;
+}
+
+static bool axml_end_element(const res_chunk_t* node, struct axml_context* axml_ctx)
+{
+    output_buffer_t* xml_output = axml_ctx->xml_output;
+
+    if (chunk_body_size(node) < 8)
+    {
+        return false;
+    }
+
+    if (axml_ctx->element_depth > 0)
+    {
+        axml_ctx->element_depth--;
+    }
+
+    axml_indent(axml_ctx);
+    outbuf_puts("</", xml_output);
+    axml_write_prefix(chunk_u32(chunk_body(node)), axml_ctx);
+    axml_write_string(chunk_u32(chunk_body(node) + 4), axml_ctx);
+    outbuf_puts(">\n", xml_output);
+
+    return true;
+}
+
+static bool axml_namespace(const res_chunk_t* node, struct axml_context* axml_ctx)
+{
+    if (chunk_body_size(node) < 8)
+    {
+        return false;
+    }
+
+    if (node->chunk_type == RES_XML_END_NAMESPACE_TYPE)
+    {
+        if (axml_ctx->namespaces_count > 0)
+        {
+            axml_ctx->namespaces_count--;
+        }
+        return true;
+    }
+
+    if (axml_ctx->namespaces_count == AXML_MAX_NAMESPACES)
+    {
+        return false;
+    }
+
+    struct axml_namespace* namespace = &axml_ctx->namespaces[axml_ctx->namespaces_count++];
+    namespace->prefix_index = chunk_u32(chunk_body(node));
+    namespace->uri_index = chunk_u32(chunk_body(node) + 4);
+    namespace->ns_declared = false;
+
+    return true;
+}
+
+static bool axml_cdata(const res_chunk_t* node, struct axml_context* axml_ctx)
+{
+    if (chunk_body_size(node) < 4 + RES_VALUE_SIZE)
+    {
+        return false;
+    }
+
+    axml_indent(axml_ctx);
+    axml_write_string(chunk_u32(chunk_body(node)), axml_ctx);
+    outbuf_putc('\n', axml_ctx->xml_output);
+
+    return true;
+}
+
+bool axml_decode(const uint8_t* axml_data, size_t axml_size, intern_table_t* shared_strings, output_buffer_t* xml_output)
+{
+    res_chunk_t document;
+
+    if (chunk_read(axml_data, 0, axml_size, &document) == false || document.chunk_type != RES_XML_TYPE)
+    {
+        return false;
+    }
+
+    struct axml_context axml_ctx;
+    memset(&axml_ctx, 0, sizeof(axml_ctx));
+    axml_ctx.xml_output = xml_output;
+
+    outbuf_puts("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n", xml_output);
+
+    bool decode_ret = true;
+    size_t node_offset = document.header_size;
+    
+    while (decode_ret && node_offset < document.chunk_size)
+    {
+        res_chunk_t node;
+        if (chunk_read(axml_data, node_offset, document.chunk_size, &node) == false)
+        {
+            decode_ret = false;
+            break;
+        }
+        node_offset += node.chunk_size;
+
+        switch (node.chunk_type)
+        {
+        case RES_STRING_POOL_TYPE:
+            if (axml_ctx.has_strings == false)
+            {
+                decode_ret = string_pool_init(&node, shared_strings, &axml_ctx.axml_strings);
+                axml_ctx.has_strings = decode_ret;
+            }
+            break;
+
+        case RES_XML_RESOURCE_MAP_TYPE:
+            axml_ctx.resource_map = chunk_body(&node);
+            axml_ctx.resource_map_count = (uint32_t)(chunk_body_size(&node) / 4);
+            break;
+
+        case RES_XML_START_NAMESPACE_TYPE: case RES_XML_END_NAMESPACE_TYPE:
+            decode_ret = axml_namespace(&node, &axml_ctx);
+            break;
+
+        case RES_XML_START_ELEMENT_TYPE:
+        {
+            /* Looking one node ahead, so empty elements can be closed in place */
+            res_chunk_t next_node;
+            bool self_closing = chunk_read(axml_data, node_offset, document.chunk_size, &next_node) &&
+                next_node.chunk_type == RES_XML_END_ELEMENT_TYPE;
+
+            decode_ret = axml_ctx.has_strings && axml_start_element(&node, self_closing, &axml_ctx);
+            if (self_closing)
+            {
+                node_offset += next_node.chunk_size;
+            }
+            break;
+        }
+        
+        case RES_XML_END_ELEMENT_TYPE:
+            decode_ret = axml_ctx.has_strings && axml_end_element(&node, &axml_ctx);
+            break;
+
+        case RES_XML_CDATA_TYPE:
+            decode_ret = axml_ctx.has_strings && axml_cdata(&node, &axml_ctx);
+            break;
+
+        default:
+            /* Unknown chunks are skipped, the format is extensible */
+            break;
+        }
+    }
+
+    if (axml_ctx.has_strings)
+    {
+        string_pool_deinit(&axml_ctx.axml_strings);
+    }
+
+    return decode_ret && outbuf_flush(xml_output);
+}
+
@@ -0,0 +1,15 @@
+#ifndef DECODE_BINARY_XML_H
+#define DECODE_BINARY_XML_H
+
+#include "data/Output_Buffer.h"
+#include "data/String_Intern.h"
+
+/* Decodes a compiled Android XML (AXML) document like AndroidManifest.xml into text,
+ * the chunks are walked in a single pass straight from the mapped entry, no tree is 
+ * built, and the XML text is written into `xml_output` as the nodes are found. The UTF-16
+ * strings are converted into `shared_strings` when it isn't NULL
+*/
+bool axml_decode(const uint8_t* axml_data, size_t axml_size, intern_table_t* shared_strings, output_buffer_t* xml_output);
+
+#endif
+
@@ -0,0 +1,273 @@
+#include <string.h>
+
+#include "Dex_Listing.h"
+#include "Resource_Chunk.h"
+#include "Thread_Pool.h"
+
+#define DEX_HEADER_SIZE 0x70
+#define DEX_NO_INDEX 0xffffffff
+
+#define DEX_CLASS_DEF_SIZE 32
+#define DEX_METHOD_ID_SIZE 8
+#define DEX_FIELD_ID_SIZE 8
+
+/* Classes listed between two looks at tpool_should_stop */
+#define DEX_STOP_CHECK_CLASSES 64
+
+struct dex_file
+{
+    const uint8_t* dex_data;
+
+    size_t dex_size;
+
+    uint32_t strings_count;
+
+    uint32_t strings_offset;
+
+    uint32_t types_count;
+
+    uint32_t types_offset;
+
+    uint32_t fields_count;
+
+    uint32_t fields_offset;
+
+    uint32_t methods_count;
+
+    uint32_t methods_offset;
+
+    uint32_t classes_count;
+
+    uint32_t classes_offset;
+};
+
+static bool dex_table_valid(uint32_t table_offset, uint32_t table_count, size_t item_size, const struct dex_file* dex)
+{
+    return table_offset <= dex->dex_size && (dex->dex_size - table_offset) / item_size >= table_count;
+}
+
+static bool dex_uleb128(const uint8_t** cursor, const uint8_t* data_end, uint32_t* value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 35; shift += 7)
+    {
+        if (*cursor >= data_end)
+        {
+            return false;
+        }
+        uint8_t byte = *(*cursor)++;
+        *value |= (uint32_t)(byte & 0x7f) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* The MUTF-8 data is printed as is, it's valid UTF-8 for everything but the NUL and surrogates */
+static const char* dex_string(uint32_t string_index, const struct dex_file* dex)
+{
+    if (string_index >= dex->strings_count)
+    {
+        return "<invalid string>";
+    }
+
+    uint32_t data_offset = chunk_u32(dex->dex_data + dex->strings_offset + (size_t)string_index * 4);
+    if (data_offset >= dex->dex_size)
+    {
+        return "<invalid string>";
+    }
+
+    const uint8_t* cursor = dex->dex_data + data_offset;
+    uint32_t utf16_size;
+    if (dex_uleb128(&cursor, dex->dex_data + dex->dex_size, &utf16_size) == false ||
+        memchr(cursor, '\0', (size_t)(dex->dex_data + dex->dex_size - cursor)) == NULL)
+    {
+        return "<invalid string>";
+    }
+    return (const char*)cursor;
+}
+
+static const char* dex_type(uint32_t type_index, const struct dex_file* dex)
+{
+    if (type_index >= dex->types_count)
+    {
+        return "<invalid type>";
+    }
+    return dex_string(chunk_u32(dex->dex_data + dex->types_offset + (size_t)type_index * 4), dex);
+}
+
+static bool dex_list_members(const uint8_t** cursor, uint32_t members_count, bool members_methods, const char* members_kind,
+    output_buffer_t* listing, const struct dex_file* dex)
+{
+    const uint8_t* data_end = dex->dex_data + dex->dex_size;
+    uint32_t member_index = 0;
+
+    for (uint32_t member_cur = 0; member_cur < members_count; member_cur++)
+    {
+        uint32_t index_diff, access_flags, code_offset = 0;
+
+        if (dex_uleb128(cursor, data_end, &index_diff) == false || dex_uleb128(cursor, data_end, &access_flags) == false ||
+            (members_methods && dex_uleb128(cursor, data_end, &code_offset) == false))
+        {
+            return false;
+        }
+        member_index += index_diff;
+
+        if (members_methods == false)
+        {
+            if (member_index >= dex->fields_count)
+            {
+                return false;
+            }
+            const uint8_t* field_id = dex->dex_data + dex->fields_offset + (size_t)member_index * DEX_FIELD_ID_SIZE;
+            outbuf_format(listing, "    %s field %s %s\n", members_kind, dex_type(chunk_u16(field_id + 2), dex), 
+                dex_string(chunk_u32(field_id + 4), dex));
+            continue;
+        }
+
+        if (member_index >= dex->methods_count)
+        {
+            return false;
+        }
+        const uint8_t* method_id = dex->dex_data + dex->methods_offset + (size_t)member_index * DEX_METHOD_ID_SIZE;
+        outbuf_format(listing, "    %s method %s", members_kind, dex_string(chunk_u32(method_id + 4), dex));
+
+        /* code_item::insns_size */
+        if (code_offset != 0 && code_offset <= dex->dex_size - 16)
+        {
+            outbuf_format(listing, " [%u code units]", chunk_u32(dex->dex_data + code_offset + 12));
+        }
+        outbuf_putc('\n', listing);
+    }
+
+    return true;
+}
+
+uint32_t dex_classes_count(const uint8_t* dex_data, size_t dex_size)
+{
+    if (dex_size < DEX_HEADER_SIZE || memcmp(dex_data, "dex\n", 4) != 0)
+    {
+        return 0;
+    }
+    return chunk_u32(dex_data + 0x60);
+}
+
+static bool dex_open(const uint8_t* dex_data, size_t dex_size, struct dex_file* dex)
+{
+    if (dex_size < DEX_HEADER_SIZE || memcmp(dex_data, "dex\n", 4) != 0)
+    {
+        return false;
+    }
+
+    *dex = (struct dex_file){
+        .dex_data = dex_data,
+        .dex_size = dex_size,
+        .strings_count = chunk_u32(dex_data + 0x38),
+        .strings_offset = chunk_u32(dex_data + 0x3c),
+        .types_count = chunk_u32(dex_data + 0x40),
+        .types_offset = chunk_u32(dex_data + 0x44),
+        .fields_count = chunk_u32(dex_data + 0x50),
+        .fields_offset = chunk_u32(dex_data + 0x54),
+        .methods_count = chunk_u32(dex_data + 0x58),
+        .methods_offset = chunk_u32(dex_data + 0x5c),
+        .classes_count = chunk_u32(dex_data + 0x60),
+        .classes_offset = chunk_u32(dex_data + 0x64)
+    };
+
+    return dex_table_valid(dex->strings_offset, dex->strings_count, 4, dex) &&
+        dex_table_valid(dex->types_offset, dex->types_count, 4, dex) &&
+        dex_table_valid(dex->fields_offset, dex->fields_count, DEX_FIELD_ID_SIZE, dex) &&
+        dex_table_valid(dex->methods_offset, dex->methods_count, DEX_METHOD_ID_SIZE, dex) &&
+        dex_table_valid(dex->classes_offset, dex->classes_count, DEX_CLASS_DEF_SIZE, dex);
+}
+
+bool dex_class_names(const uint8_t* dex_data, size_t dex_size, dex_class_fn on_class, void* class_data)
+{
+    struct dex_file dex;
+
+    if (dex_open(dex_data, dex_size, &dex) == false)
+    {
+        return false;
+    }
+
+    for (uint32_t class_cur = 0; class_cur < dex.classes_count; class_cur++)
+    {
+        const uint8_t* class_def = dex_data + dex.classes_offset + (size_t)class_cur * DEX_CLASS_DEF_SIZE;
+        const char* class_name = dex_type(chunk_u32(class_def), &dex);
+
+        if (on_class(class_name, strlen(class_name), class_data) == false)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool dex_list(const uint8_t* dex_data, size_t dex_size, output_buffer_t* listing)
+{
+    struct dex_file dex;
+
+    if (dex_open(dex_data, dex_size, &dex) == false)
+    {
+        return false;
+    }
+
+    outbuf_format(listing, "; DEX version %.3s, %u classes, %u methods, %u strings\n", (const char*)dex_data + 4, 
+        dex.classes_count, dex.methods_count, dex.strings_count);
+
+    for (uint32_t class_cur = 0; class_cur < dex.classes_count; class_cur++)
+    {
+        const uint8_t* class_def = dex_data + dex.classes_offset + (size_t)class_cur * DEX_CLASS_DEF_SIZE;
+        uint32_t super_index = chunk_u32(class_def + 8);
+        uint32_t data_offset = chunk_u32(class_def + 24);
+
+        /* A big DEX takes seconds, the listing isn't wanted anymore when the task has stopped */
+        if (class_cur % DEX_STOP_CHECK_CLASSES == 0 && tpool_should_stop())
+        {
+            return false;
+        }
+
+        outbuf_format(listing, "\nclass %s", dex_type(chunk_u32(class_def), &dex));
+        if (super_index != DEX_NO_INDEX)
+        {
+            outbuf_format(listing, " extends %s", dex_type(super_index, &dex));
+        }
+        outbuf_putc('\n', listing);
+
+        /* Interfaces and marker classes doesn't have data */
+        if (data_offset == 0)
+        {
+            continue;
+        }
+        if (data_offset >= dex_size)
+        {
+            return false;
+        }
+
+        const uint8_t* cursor = dex_data + data_offset;
+        uint32_t static_fields, instance_fields, direct_methods, virtual_methods;
+
+        if (dex_uleb128(&cursor, dex_data + dex_size, &static_fields) == false ||
+            dex_uleb128(&cursor, dex_data + dex_size, &instance_fields) == false ||
+            dex_uleb128(&cursor, dex_data + dex_size, &direct_methods) == false ||
+            dex_uleb128(&cursor, dex_data + dex_size, &virtual_methods) == false)
+        {
+            return false;
+        }
+
+        if (dex_list_members(&cursor, static_fields, false, "static", listing, &dex) == false ||
+            dex_list_members(&cursor, instance_fields, false, "instance", listing, &dex) == false ||
+            dex_list_members(&cursor, direct_methods, true, "direct", listing, &dex) == false ||
+            dex_list_members(&cursor, virtual_methods, true, "virtual", listing, &dex) == false)
+        {
+            return false;
+        }
+    }
+
+    return !listing->buffer_failed;
+}
+
@@ -0,0 +1,23 @@
+#ifndef DECODE_DEX_LISTING_H
+#define DECODE_DEX_LISTING_H
+
+#include "data/Output_Buffer.h"
+
+/* Lists the classes of a DEX file with their super class, fields and methods (with the
+ * code units count), it's not a full disassembly, only the structure. Fails when the task
+ * running it is told to stop (see tpool_should_stop)
+*/
+bool dex_list(const uint8_t* dex_data, size_t dex_size, output_buffer_t* listing);
+
+/* The class definitions count from the header, 0 when it isn't a DEX file */
+uint32_t dex_classes_count(const uint8_t* dex_data, size_t dex_size);
+
+/* Called with each class descriptor (Lcom/example/Name;) in the order of the class definitions,
+ * false stops the walk
+*/
+typedef bool (*dex_class_fn)(const char* class_name, size_t name_length, void* class_data);
+
+bool dex_class_names(const uint8_t* dex_data, size_t dex_size, dex_class_fn on_class, void* class_data);
+
+#endif
+
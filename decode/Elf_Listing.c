@@ -0,0 +1,210 @@
+#include <string.h>
+
+#include "Elf_Listing.h"
+#include "Resource_Chunk.h"
+
+#define ELF_CLASS_32 1
+#define ELF_CLASS_64 2
+#define ELF_DATA_LSB 1
+
+#define ELF_SECTION_DYNSYM 11
+
+struct elf_file
+{
+    const uint8_t* elf_data;
+
+    size_t elf_size;
+
+    bool elf_64;
+};
+
+static uint64_t elf_u64(const uint8_t* data)
+{
+    return (uint64_t)chunk_u32(data) | (uint64_t)chunk_u32(data + 4) << 32;
+}
+
+/* Reads a word that has 4 bytes in ELF32 and 8 in ELF64 */
+static uint64_t elf_word(const uint8_t* data, const struct elf_file* elf)
+{
+    return elf->elf_64 ? elf_u64(data) : chunk_u32(data);
+}
+
+struct elf_section
+{
+    uint32_t section_name;
+
+    uint32_t section_type;
+
+    uint64_t section_offset;
+
+    uint64_t section_size;
+
+    uint32_t section_link;
+
+    uint64_t entry_size;
+};
+
+static void elf_read_section(const uint8_t* header, struct elf_section* section, const struct elf_file* elf)
+{
+    section->section_name = chunk_u32(header);
+    section->section_type = chunk_u32(header + 4);
+
+    if (elf->elf_64)
+    {
+        section->section_offset = elf_u64(header + 24);
+        section->section_size = elf_u64(header + 32);
+        section->section_link = chunk_u32(header + 40);
+        section->entry_size = elf_u64(header + 56);
+    }
+    else
+    {
+        section->section_offset = chunk_u32(header + 16);
+        section->section_size = chunk_u32(header + 20);
+        section->section_link = chunk_u32(header + 24);
+        section->entry_size = chunk_u32(header + 36);
+    }
+}
+
+static bool elf_section_valid(const struct elf_section* section, const struct elf_file* elf)
+{
+    return section->section_offset <= elf->elf_size && elf->elf_size - section->section_offset >= section->section_size;
+}
+
+static const char* elf_string(const struct elf_section* strings, uint32_t string_offset, const struct elf_file* elf)
+{
+    if (string_offset >= strings->section_size)
+    {
+        return "<invalid>";
+    }
+
+    const char* string = (const char*)elf->elf_data + strings->section_offset + string_offset;
+    if (memchr(string, '\0', strings->section_size - string_offset) == NULL)
+    {
+        return "<invalid>";
+    }
+    return string;
+}
+
+static const char* elf_symbol_type(uint8_t symbol_info)
+{
+    static const char* const symbol_types[] = { "notype", "object", "func", "section", "file", "common", "tls" };
+    uint8_t symbol_type = symbol_info & 0x0f;
+
+    return symbol_type < sizeof(symbol_types) / sizeof(*symbol_types) ? symbol_types[symbol_type] : "other";
+}
+
+static bool elf_list_symbols(const struct elf_section* symbols, const struct elf_section* strings, output_buffer_t* listing,
+    const struct elf_file* elf)
+{
+    size_t symbol_size = elf->elf_64 ? 24 : 16;
+
+    if (symbols->entry_size != symbol_size || elf_section_valid(symbols, elf) == false || elf_section_valid(strings, elf) == false)
+    {
+        return false;
+    }
+
+    size_t symbols_count = symbols->section_size / symbol_size;
+    outbuf_format(listing, "\n; %zu dynamic symbols\n", symbols_count);
+
+    /* The first symbol is always the undefined one */
+    for (size_t symbol_cur = 1; symbol_cur < symbols_count; symbol_cur++)
+    {
+        const uint8_t* symbol = elf->elf_data + symbols->section_offset + symbol_cur * symbol_size;
+        uint64_t symbol_value, symbol_length;
+        uint8_t symbol_info;
+        uint16_t symbol_section;
+
+        if (elf->elf_64)
+        {
+            symbol_info = symbol[4];
+            symbol_section = chunk_u16(symbol + 6);
+            symbol_value = elf_u64(symbol + 8);
+            symbol_length = elf_u64(symbol + 16);
+        }
+        else
+        {
+            symbol_value = chunk_u32(symbol + 4);
+            symbol_length = chunk_u32(symbol + 8);
+            symbol_info = symbol[12];
+            symbol_section = chunk_u16(symbol + 14);
+        }
+
+        outbuf_format(listing, "%s %016llx %8llu %-7s %s\n", symbol_section == 0 ? "import" : "export",
+            (unsigned long long)symbol_value, (unsigned long long)symbol_length, elf_symbol_type(symbol_info),
+            elf_string(strings, chunk_u32(symbol), elf));
+    }
+
+    return true;
+}
+
+bool elf_list(const uint8_t* elf_data, size_t elf_size, output_buffer_t* listing)
+{
+    if (elf_size < 52 || memcmp(elf_data, "\x7f" "ELF", 4) != 0 || elf_data[5] != ELF_DATA_LSB ||
+        (elf_data[4] != ELF_CLASS_32 && elf_data[4] != ELF_CLASS_64))
+    {
+        return false;
+    }
+
+    struct elf_file elf = { .elf_data = elf_data, .elf_size = elf_size, .elf_64 = elf_data[4] == ELF_CLASS_64 };
+
+    if (elf.elf_64 && elf_size < 64)
+    {
+        return false;
+    }
+
+    uint64_t sections_offset = elf_word(elf_data + (elf.elf_64 ? 40 : 32), &elf);
+    const uint8_t* counts = elf_data + (elf.elf_64 ? 58 : 46);
+    uint16_t section_header_size = chunk_u16(counts);
+    uint16_t sections_count = chunk_u16(counts + 2);
+    uint16_t names_index = chunk_u16(counts + 4);
+
+    if (section_header_size < (elf.elf_64 ? 64 : 40) || sections_offset > elf_size ||
+        (elf_size - sections_offset) / section_header_size < sections_count || names_index >= sections_count)
+    {
+        return false;
+    }
+
+    outbuf_format(listing, "; ELF%d shared object, machine %u, %u sections\n", elf.elf_64 ? 64 : 32, 
+        chunk_u16(elf_data + 18), sections_count);
+
+    struct elf_section section_names;
+    elf_read_section(elf_data + sections_offset + (size_t)names_index * section_header_size, &section_names, &elf);
+    if (elf_section_valid(&section_names, &elf) == false)
+    {
+        return false;
+    }
+
+    struct elf_section dynamic_symbols = { .section_type = 0 };
+
+    for (uint16_t section_cur = 0; section_cur < sections_count; section_cur++)
+    {
+        struct elf_section section;
+        elf_read_section(elf_data + sections_offset + (size_t)section_cur * section_header_size, &section, &elf);
+
+        outbuf_format(listing, "section %-24s offset %08llx size %llu\n", elf_string(&section_names, section.section_name, &elf),
+            (unsigned long long)section.section_offset, (unsigned long long)section.section_size);
+
+        if (section.section_type == ELF_SECTION_DYNSYM)
+        {
+            dynamic_symbols = section;
+        }
+    }
+
+    bool list_ret = true;
+
+    /* Static executables doesn't have dynamic symbols */
+    if (dynamic_symbols.section_type == ELF_SECTION_DYNSYM)
+    {
+        if (dynamic_symbols.section_link >= sections_count)
+        {
+            return false;
+        }
+
+        struct elf_section symbol_names;
+        elf_read_section(elf_data + sections_offset + (size_t)dynamic_symbols.section_link * section_header_size, &symbol_names, &elf);
+        list_ret = elf_list_symbols(&dynamic_symbols, &symbol_names, listing, &elf);
+    }
+
+    return list_ret && !listing->buffer_failed;
+}
+
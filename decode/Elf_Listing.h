@@ -0,0 +1,12 @@
+#ifndef DECODE_ELF_LISTING_H
+#define DECODE_ELF_LISTING_H
+
+#include "data/Output_Buffer.h"
+
+/* Lists the sections and the dynamic symbols (imports and exports) of a little endian ELF
+ * shared object, 32 and 64 bits, like the native libraries from lib/<abi>/
+*/
+bool elf_list(const uint8_t* elf_data, size_t elf_size, output_buffer_t* listing);
+
+#endif
+
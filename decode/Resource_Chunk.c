@@ -0,0 +1,29 @@
+#include "Resource_Chunk.h"
+
+bool chunk_read(const uint8_t* data, size_t chunk_offset, size_t data_limit, res_chunk_t* chunk)
+{
+    if (chunk_offset > data_limit || data_limit - chunk_offset < RES_CHUNK_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    const uint8_t* chunk_begin = data + chunk_offset;
+
+    chunk->chunk_begin = chunk_begin;
+    chunk->chunk_type = chunk_u16(chunk_begin);
+    chunk->header_size = chunk_u16(chunk_begin + 2);
+    chunk->chunk_size = chunk_u32(chunk_begin + 4);
+
+    if (chunk->header_size < RES_CHUNK_HEADER_SIZE || chunk->header_size > chunk->chunk_size)
+    {
+        return false;
+    }
+
+    if (chunk->chunk_size > data_limit - chunk_offset)
+    {
+        return false;
+    }
+
+    return true;
+}
+
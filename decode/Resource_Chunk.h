@@ -0,0 +1,70 @@
+#ifndef DECODE_RESOURCE_CHUNK_H
+#define DECODE_RESOURCE_CHUNK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Chunk types used by the Android binary resources format (ResChunk_header::type) */
+#define RES_NULL_TYPE 0x0000
+#define RES_STRING_POOL_TYPE 0x0001
+#define RES_TABLE_TYPE 0x0002
+#define RES_XML_TYPE 0x0003
+
+#define RES_XML_START_NAMESPACE_TYPE 0x0100
+#define RES_XML_END_NAMESPACE_TYPE 0x0101
+#define RES_XML_START_ELEMENT_TYPE 0x0102
+#define RES_XML_END_ELEMENT_TYPE 0x0103
+#define RES_XML_CDATA_TYPE 0x0104
+#define RES_XML_RESOURCE_MAP_TYPE 0x0180
+
+#define RES_TABLE_PACKAGE_TYPE 0x0200
+#define RES_TABLE_TYPE_TYPE 0x0201
+#define RES_TABLE_TYPE_SPEC_TYPE 0x0202
+#define RES_TABLE_LIBRARY_TYPE 0x0203
+
+#define RES_CHUNK_HEADER_SIZE 8
+
+/* All values inside the chunks are stored in little endian, we never trust the alignment
+ * of a mapped entry, so every read goes byte by byte
+*/
+static inline uint16_t chunk_u16(const uint8_t* chunk_data)
+{
+    return (uint16_t)(chunk_data[0] | chunk_data[1] << 8);
+}
+
+static inline uint32_t chunk_u32(const uint8_t* chunk_data)
+{
+    return (uint32_t)chunk_data[0] | (uint32_t)chunk_data[1] << 8 | 
+        (uint32_t)chunk_data[2] << 16 | (uint32_t)chunk_data[3] << 24;
+}
+
+typedef struct res_chunk
+{
+    const uint8_t* chunk_begin;
+
+    uint16_t chunk_type;
+
+    uint16_t header_size;
+
+    uint32_t chunk_size;
+
+} res_chunk_t;
+
+/* Reads the chunk header placed at `chunk_offset`, fails when the chunk isn't entirely 
+ * inside the `data_limit` bytes
+*/
+bool chunk_read(const uint8_t* data, size_t chunk_offset, size_t data_limit, res_chunk_t* chunk);
+
+static inline const uint8_t* chunk_body(const res_chunk_t* chunk)
+{
+    return chunk->chunk_begin + chunk->header_size;
+}
+
+static inline size_t chunk_body_size(const res_chunk_t* chunk)
+{
+    return chunk->chunk_size - chunk->header_size;
+}
+
+#endif
+
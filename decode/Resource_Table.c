@@ -0,0 +1,509 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "Resource_Table.h"
+#include "Resource_Chunk.h"
+#include "Resource_Value.h"
+#include "String_Pool.h"
+
+#define ARSC_TABLE_HEADER_SIZE 12
+#define ARSC_PACKAGE_HEADER_SIZE 284
+#define ARSC_PACKAGE_NAME_UNITS 128
+#define ARSC_TYPE_HEADER_SIZE 20
+#define ARSC_NO_ENTRY 0xffffffff
+
+/* ResTable_type::flags */
+#define ARSC_TYPE_SPARSE 0x01
+#define ARSC_TYPE_OFFSET16 0x02
+
+/* ResTable_entry::flags */
+#define ARSC_ENTRY_COMPLEX 0x0001
+#define ARSC_ENTRY_COMPACT 0x0008
+
+/* How many type chunks each worker receives by window */
+#define ARSC_JOBS_PER_WORKER 2
+
+struct arsc_package
+{
+    uint32_t package_id;
+
+    string_pool_t type_strings;
+
+    string_pool_t key_strings;
+
+    string_pool_t* value_strings;
+};
+
+struct arsc_type_job
+{
+    res_chunk_t type_chunk;
+
+    struct arsc_package* package;
+
+    /* Reused between windows, holds the text of a single type chunk */
+    output_buffer_t job_output;
+};
+
+struct arsc_window
+{
+    struct arsc_type_job* jobs;
+
+    size_t jobs_capacity;
+
+    size_t jobs_count;
+
+    tpool_t* thread_pool;
+
+    output_buffer_t* output;
+
+    /* Where the pools of the packages convert their strings, may be NULL */
+    intern_table_t* shared_strings;
+};
+
+static void arsc_write_language(const uint8_t* packed, char separator, output_buffer_t* output)
+{
+    if (packed[0] == 0)
+    {
+        return;
+    }
+
+    outbuf_putc(separator, output);
+
+    /* Three letters codes are packed into 15 bits */
+    if (packed[0] & 0x80)
+    {
+        outbuf_putc((char)('a' + (packed[1] & 0x1f)), output);
+        outbuf_putc((char)('a' + ((packed[1] & 0xe0) >> 5) + ((packed[0] & 0x03) << 3)), output);
+        outbuf_putc((char)('a' + ((packed[0] & 0x7c) >> 2)), output);
+        return;
+    }
+
+    outbuf_append(packed, packed[1] != 0 ? 2 : 1, output);
+}
+
+static const char* arsc_density_name(uint16_t density)
+{
+    switch (density)
+    {
+    case 120: return "ldpi";
+    case 160: return "mdpi";
+    case 213: return "tvdpi";
+    case 240: return "hdpi";
+    case 320: return "xhdpi";
+    case 480: return "xxhdpi";
+    case 640: return "xxxhdpi";
+    case 0xfffe: return "anydpi";
+    case 0xffff: return "nodpi";
+    default: return NULL;
+    }
+}
+
+/* Writes the configuration qualifiers (like "en-rUS-land-xhdpi-v21"), only the fields 
+ * contained inside the stored configuration size are read
+*/
+static void arsc_write_config(const uint8_t* config, uint32_t config_size, output_buffer_t* output)
+{
+    size_t length_before = outbuf_length(output);
+
+    if (config_size >= 8)
+    {
+        if (chunk_u16(config + 4) != 0) outbuf_format(output, "-mcc%u", chunk_u16(config + 4));
+        if (chunk_u16(config + 6) != 0) outbuf_format(output, "-mnc%u", chunk_u16(config + 6));
+    }
+    if (config_size >= 12)
+    {
+        arsc_write_language(config + 8, '-', output);
+        if (config[10] != 0)
+        {
+            outbuf_puts("-r", output);
+            arsc_write_language(config + 10, 0, output);
+        }
+    }
+    if (config_size >= 16)
+    {
+        static const char* orientations[] = { NULL, "port", "land", "square" };
+        if (config[12] != 0 && config[12] < 4) outbuf_format(output, "-%s", orientations[config[12]]);
+
+        uint16_t density = chunk_u16(config + 14);
+        const char* density_name = arsc_density_name(density);
+        if (density_name != NULL) outbuf_format(output, "-%s", density_name);
+        else if (density != 0) outbuf_format(output, "-%udpi", density);
+    }
+    if (config_size >= 32 && chunk_u16(config + 30) != 0)
+    {
+        outbuf_format(output, "-sw%udp", chunk_u16(config + 30));
+    }
+    if (config_size >= 36)
+    {
+        if (chunk_u16(config + 32) != 0) outbuf_format(output, "-w%udp", chunk_u16(config + 32));
+        if (chunk_u16(config + 34) != 0) outbuf_format(output, "-h%udp", chunk_u16(config + 34));
+    }
+    if (config_size >= 26 && chunk_u16(config + 24) != 0)
+    {
+        outbuf_format(output, "-v%u", chunk_u16(config + 24));
+    }
+
+    if (outbuf_length(output) == length_before)
+    {
+        outbuf_puts("default", output);
+        return;
+    }
+
+    /* Removing the first separator */
+    memmove(output->buffer_data + length_before, output->buffer_data + length_before + 1, 
+        outbuf_length(output) - length_before - 1);
+    output->buffer_length--;
+}
+
+static void arsc_write_key(uint32_t key_index, struct arsc_package* package, output_buffer_t* output)
+{
+    size_t key_length;
+    const char* key_name = string_pool_get(key_index, &key_length, &package->key_strings);
+
+    if (key_name == NULL)
+    {
+        outbuf_format(output, "0x%x", key_index);
+        return;
+    }
+    res_write_escaped(key_name, key_length, output);
+}
+
+static void arsc_write_entry(uint32_t resource_id, const uint8_t* entry, const uint8_t* type_end, 
+    struct arsc_type_job* type_job)
+{
+    output_buffer_t* output = &type_job->job_output;
+    struct arsc_package* package = type_job->package;
+
+    if (type_end - entry < 8)
+    {
+        return;
+    }
+
+    uint16_t entry_size = chunk_u16(entry);
+    uint16_t entry_flags = chunk_u16(entry + 2);
+
+    if (entry_flags & ARSC_ENTRY_COMPACT)
+    {
+        /* Compact entries keeps the key index in the size field and the value inline */
+        outbuf_format(output, "    <entry id=\"0x%08x\" name=\"", resource_id);
+        arsc_write_key(entry_size, package, output);
+        outbuf_puts("\">", output);
+        res_write_value((uint8_t)(entry_flags >> 8), chunk_u32(entry + 4), package->value_strings, output);
+        outbuf_puts("</entry>\n", output);
+        return;
+    }
+
+    uint32_t key_index = chunk_u32(entry + 4);
+
+    if (entry_size < 8 || (size_t)(type_end - entry) < entry_size)
+    {
+        return;
+    }
+
+    outbuf_format(output, "    <entry id=\"0x%08x\" name=\"", resource_id);
+    arsc_write_key(key_index, package, output);
+
+    if ((entry_flags & ARSC_ENTRY_COMPLEX) == 0)
+    {
+        const uint8_t* value = entry + entry_size;
+        if (type_end - value < RES_VALUE_SIZE)
+        {
+            outbuf_puts("\"/>\n", output);
+            return;
+        }
+        outbuf_puts("\">", output);
+        res_write_value(value[3], chunk_u32(value + 4), package->value_strings, output);
+        outbuf_puts("</entry>\n", output);
+        return;
+    }
+
+    if (entry_size < 16)
+    {
+        outbuf_puts("\"/>\n", output);
+        return;
+    }
+
+    uint32_t parent_id = chunk_u32(entry + 8);
+    uint32_t map_count = chunk_u32(entry + 12);
+
+    if (parent_id != 0)
+    {
+        outbuf_format(output, "\" parent=\"0x%08x", parent_id);
+    }
+    outbuf_puts("\">\n", output);
+
+    const uint8_t* map_entry = entry + entry_size;
+    for (uint32_t map_cur = 0; map_cur < map_count && type_end - map_entry >= 4 + RES_VALUE_SIZE; map_cur++)
+    {
+        outbuf_format(output, "      <item name=\"0x%08x\">", chunk_u32(map_entry));
+        res_write_value(map_entry[7], chunk_u32(map_entry + 8), package->value_strings, output);
+        outbuf_puts("</item>\n", output);
+        map_entry += 4 + RES_VALUE_SIZE;
+    }
+    outbuf_puts("    </entry>\n", output);
+}
+
+static void* arsc_type_task(void* task_data)
+{
+    struct arsc_type_job* type_job = (struct arsc_type_job*)task_data;
+    res_chunk_t* type_chunk = &type_job->type_chunk;
+    output_buffer_t* output = &type_job->job_output;
+
+    const uint8_t* type_begin = type_chunk->chunk_begin;
+    const uint8_t* type_end = type_begin + type_chunk->chunk_size;
+
+    uint8_t type_id = type_begin[8];
+    uint8_t type_flags = type_begin[9];
+    uint32_t entry_count = chunk_u32(type_begin + 12);
+    uint32_t entries_start = chunk_u32(type_begin + 16);
+
+    const uint8_t* config = type_begin + ARSC_TYPE_HEADER_SIZE;
+    uint32_t config_size = chunk_u32(config);
+    if (config_size > type_chunk->header_size - ARSC_TYPE_HEADER_SIZE)
+    {
+        config_size = type_chunk->header_size - ARSC_TYPE_HEADER_SIZE;
+    }
+
+    size_t type_length;
+    const char* type_name = string_pool_get(type_id - 1u, &type_length, &type_job->package->type_strings);
+
+    outbuf_puts("  <type name=\"", output);
+    if (type_name != NULL) res_write_escaped(type_name, type_length, output);
+    outbuf_format(output, "\" id=\"0x%02x\" config=\"", type_id);
+    arsc_write_config(config, config_size, output);
+    outbuf_puts("\">\n", output);
+
+    const uint8_t* offsets = chunk_body(type_chunk);
+    size_t offset_size = (type_flags & (ARSC_TYPE_SPARSE | ARSC_TYPE_OFFSET16)) == ARSC_TYPE_OFFSET16 ? 2 : 4;
+    
+    /* The offsets are between the header and the entries, a start inside the header has none */
+    if (entries_start > type_chunk->chunk_size || entries_start < type_chunk->header_size ||
+        (uint64_t)entry_count * offset_size > (uint64_t)(entries_start - type_chunk->header_size))
+    {
+        entry_count = 0;
+    }
+
+    uint32_t package_type_id = type_job->package->package_id << 24 | (uint32_t)type_id << 16;
+
+    for (uint32_t entry_cur = 0; entry_cur < entry_count; entry_cur++)
+    {
+        uint32_t entry_index = entry_cur;
+        uint32_t entry_offset;
+
+        if (type_flags & ARSC_TYPE_SPARSE)
+        {
+            entry_index = chunk_u16(offsets + entry_cur * 4);
+            entry_offset = chunk_u16(offsets + entry_cur * 4 + 2) * 4u;
+        }
+        else if (offset_size == 2)
+        {
+            uint16_t short_offset = chunk_u16(offsets + entry_cur * 2);
+            entry_offset = short_offset == 0xffff ? ARSC_NO_ENTRY : short_offset * 4u;
+        }
+        else
+        {
+            entry_offset = chunk_u32(offsets + entry_cur * 4);
+        }
+
+        if (entry_offset == ARSC_NO_ENTRY || (uint64_t)entries_start + entry_offset >= type_chunk->chunk_size)
+        {
+            continue;
+        }
+
+        arsc_write_entry(package_type_id | entry_index, type_begin + entries_start + entry_offset, type_end, type_job);
+    }
+
+    outbuf_puts("  </type>\n", output);
+
+    return NULL;
+}
+
+/* Decodes all type chunks accumulated into the window and writes them in order */
+static bool arsc_window_dispatch(struct arsc_window* window)
+{
+    if (window->jobs_count == 0)
+    {
+        return true;
+    }
+
+    tpool_group_t window_group;
+    tpool_group_init(&window_group);
+
+    for (size_t job_cur = 0; job_cur < window->jobs_count; job_cur++)
+    {
+        if (tpool_group_execute(arsc_type_task, &window->jobs[job_cur], &window_group, window->thread_pool) == false)
+        {
+            arsc_type_task(&window->jobs[job_cur]);
+        }
+    }
+
+    tpool_group_wait(&window_group, window->thread_pool);
+    tpool_group_destroy(&window_group);
+
+    bool write_ret = true;
+    for (size_t job_cur = 0; job_cur < window->jobs_count; job_cur++)
+    {
+        output_buffer_t* job_output = &window->jobs[job_cur].job_output;
+        
+        write_ret &= !job_output->buffer_failed && 
+            outbuf_append(job_output->buffer_data, outbuf_length(job_output), window->output);
+        outbuf_reset(job_output);
+    }
+    window->jobs_count = 0;
+
+    return write_ret;
+}
+
+static bool arsc_decode_package(const res_chunk_t* package_chunk, string_pool_t* value_strings, struct arsc_window* window)
+{
+    const uint8_t* package_begin = package_chunk->chunk_begin;
+    output_buffer_t* output = window->output;
+
+    if (package_chunk->header_size < ARSC_PACKAGE_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    struct arsc_package package;
+    memset(&package, 0, sizeof(package));
+    package.package_id = chunk_u32(package_begin + 8);
+    package.value_strings = value_strings;
+
+    uint32_t type_strings_offset = chunk_u32(package_begin + 268);
+    uint32_t key_strings_offset = chunk_u32(package_begin + 276);
+
+    res_chunk_t pool_chunk;
+    if (chunk_read(package_begin, type_strings_offset, package_chunk->chunk_size, &pool_chunk) == false ||
+        string_pool_init(&pool_chunk, window->shared_strings, &package.type_strings) == false)
+    {
+        return false;
+    }
+    if (chunk_read(package_begin, key_strings_offset, package_chunk->chunk_size, &pool_chunk) == false ||
+        string_pool_init(&pool_chunk, window->shared_strings, &package.key_strings) == false)
+    {
+        string_pool_deinit(&package.type_strings);
+        return false;
+    }
+
+    size_t name_units = 0;
+    while (name_units < ARSC_PACKAGE_NAME_UNITS && chunk_u16(package_begin + 12 + name_units * 2) != 0)
+    {
+        name_units++;
+    }
+    char package_name[ARSC_PACKAGE_NAME_UNITS * 3 + 1];
+    size_t name_size = string_pool_utf16_to_utf8(package_begin + 12, name_units, package_name, sizeof(package_name) - 1);
+    package_name[name_size < sizeof(package_name) ? name_size : sizeof(package_name) - 1] = '\0';
+
+    outbuf_format(output, "<package id=\"0x%02x\" name=\"", package.package_id);
+    res_write_escaped(package_name, strlen(package_name), output);
+    outbuf_puts("\">\n", output);
+
+    bool decode_ret = true;
+    size_t chunk_offset = package_chunk->header_size;
+
+    while (decode_ret && chunk_offset < package_chunk->chunk_size)
+    {
+        res_chunk_t type_chunk;
+        if (chunk_read(package_begin, chunk_offset, package_chunk->chunk_size, &type_chunk) == false)
+        {
+            decode_ret = false;
+            break;
+        }
+        chunk_offset += type_chunk.chunk_size;
+
+        if (type_chunk.chunk_type != RES_TABLE_TYPE_TYPE || type_chunk.header_size < ARSC_TYPE_HEADER_SIZE + 4)
+        {
+            continue;
+        }
+
+        struct arsc_type_job* type_job = &window->jobs[window->jobs_count++];
+        type_job->type_chunk = type_chunk;
+        type_job->package = &package;
+
+        if (window->jobs_count == window->jobs_capacity)
+        {
+            decode_ret = arsc_window_dispatch(window);
+        }
+    }
+
+    /* The jobs points to the package context, it must be consumed before leaving */
+    decode_ret &= arsc_window_dispatch(window);
+
+    outbuf_puts("</package>\n", output);
+
+    string_pool_deinit(&package.key_strings);
+    string_pool_deinit(&package.type_strings);
+
+    return decode_ret;
+}
+
+bool arsc_decode(const uint8_t* arsc_data, size_t arsc_size, intern_table_t* shared_strings, output_buffer_t* output, tpool_t* thread_pool)
+{
+    res_chunk_t table_chunk;
+
+    if (chunk_read(arsc_data, 0, arsc_size, &table_chunk) == false || 
+        table_chunk.chunk_type != RES_TABLE_TYPE || table_chunk.header_size < ARSC_TABLE_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    struct arsc_window window = { .thread_pool = thread_pool, .output = output, .shared_strings = shared_strings };
+
+    window.jobs_capacity = thread_pool != NULL ? tpool_workers(thread_pool) * ARSC_JOBS_PER_WORKER : 1;
+    if (window.jobs_capacity == 0)
+    {
+        window.jobs_capacity = 1;
+    }
+    window.jobs = calloc(window.jobs_capacity, sizeof(*window.jobs));
+    if (window.jobs == NULL)
+    {
+        return false;
+    }
+    for (size_t job_cur = 0; job_cur < window.jobs_capacity; job_cur++)
+    {
+        outbuf_init(0, NULL, NULL, &window.jobs[job_cur].job_output);
+    }
+
+    string_pool_t value_strings;
+    bool has_strings = false;
+    bool decode_ret = true;
+
+    outbuf_puts("<?xml version=\"1.0\" encoding=\"utf-8\"?>\n<resources>\n", output);
+
+    size_t chunk_offset = table_chunk.header_size;
+    while (decode_ret && chunk_offset < table_chunk.chunk_size)
+    {
+        res_chunk_t chunk;
+        if (chunk_read(arsc_data, chunk_offset, table_chunk.chunk_size, &chunk) == false)
+        {
+            decode_ret = false;
+            break;
+        }
+        chunk_offset += chunk.chunk_size;
+
+        if (chunk.chunk_type == RES_STRING_POOL_TYPE && has_strings == false)
+        {
+            decode_ret = has_strings = string_pool_init(&chunk, shared_strings, &value_strings);
+        }
+        else if (chunk.chunk_type == RES_TABLE_PACKAGE_TYPE)
+        {
+            decode_ret = arsc_decode_package(&chunk, has_strings ? &value_strings : NULL, &window);
+        }
+    }
+
+    outbuf_puts("</resources>\n", output);
+
+    if (has_strings)
+    {
+        string_pool_deinit(&value_strings);
+    }
+
+    for (size_t job_cur = 0; job_cur < window.jobs_capacity; job_cur++)
+    {
+        outbuf_deinit(&window.jobs[job_cur].job_output);
+    }
+    free((void*)window.jobs);
+
+    return decode_ret && outbuf_flush(output);
+}
+
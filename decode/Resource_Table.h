@@ -0,0 +1,17 @@
+#ifndef DECODE_RESOURCE_TABLE_H
+#define DECODE_RESOURCE_TABLE_H
+
+#include "Thread_Pool.h"
+#include "data/Output_Buffer.h"
+#include "data/String_Intern.h"
+
+/* Decodes a resources.arsc table into a textual resources listing. The chunks are walked
+ * in a single pass from the mapped entry, the ResTable_type chunks are decoded in windows 
+ * by the `thread_pool` workers (inline when NULL) and written in the original order, so the
+ * memory used is bounded by the window size and not by the table size. The UTF-16 strings
+ * are converted into `shared_strings` when it isn't NULL
+*/
+bool arsc_decode(const uint8_t* arsc_data, size_t arsc_size, intern_table_t* shared_strings, output_buffer_t* output, tpool_t* thread_pool);
+
+#endif
+
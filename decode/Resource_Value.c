@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "Resource_Value.h"
+
+#define COMPLEX_UNIT_MASK 0xf
+#define COMPLEX_RADIX_SHIFT 4
+#define COMPLEX_RADIX_MASK 0x3
+#define COMPLEX_MANTISSA_SHIFT 8
+
+bool res_write_escaped(const char* text, size_t text_length, output_buffer_t* output)
+{
+    size_t plain_begin = 0;
+
+    for (size_t text_cur = 0; text_cur < text_length; text_cur++)
+    {
+        const char* escaped = NULL;
+
+        switch (text[text_cur])
+        {
+            case '<': escaped = "&lt;"; break;
+            case '>': escaped = "&gt;"; break;
+            case '&': escaped = "&amp;"; break;
+            case '"': escaped = "&quot;"; break;
+            default: continue;
+        }
+
+        /* Writing the plain text in a single piece */
+        outbuf_append(text + plain_begin, text_cur - plain_begin, output);
+        outbuf_puts(escaped, output);
+        plain_begin = text_cur + 1;
+    }
+
+    return outbuf_append(text + plain_begin, text_length - plain_begin, output);
+}
+
+static float res_complex_value(uint32_t complex_data)
+{
+    static const float radix_mults[] = {
+        1.0f / (1 << COMPLEX_MANTISSA_SHIFT), 
+        1.0f / (1 << 15), 
+        1.0f / (1 << 23), 
+        1.0f / (1u << 31)
+    };
+
+    int32_t mantissa = (int32_t)(complex_data & 0xffffff00);
+
+    return (float)mantissa * radix_mults[(complex_data >> COMPLEX_RADIX_SHIFT) & COMPLEX_RADIX_MASK];
+}
+
+bool res_write_value(uint8_t value_type, uint32_t value_data, string_pool_t* string_pool, output_buffer_t* output)
+{
+    static const char* dimension_units[] = { "px", "dp", "sp", "pt", "in", "mm" };
+    
+    switch (value_type)
+    {
+    case RES_VALUE_NULL:
+        return value_data == 1 ? outbuf_puts("@empty", output) : outbuf_puts("@null", output);
+    
+    case RES_VALUE_REFERENCE: case RES_VALUE_DYNAMIC_REFERENCE:
+        if (value_data == 0)
+        {
+            return outbuf_puts("@null", output);
+        }
+        return outbuf_format(output, "@0x%08x", value_data);
+    
+    case RES_VALUE_ATTRIBUTE: case RES_VALUE_DYNAMIC_ATTRIBUTE:
+        return outbuf_format(output, "?0x%08x", value_data);
+    
+    case RES_VALUE_STRING:
+    {
+        size_t string_length;
+        const char* string_value = string_pool != NULL ? string_pool_get(value_data, &string_length, string_pool) : NULL;
+        
+        if (string_value == NULL)
+        {
+            return outbuf_format(output, "@string/0x%x", value_data);
+        }
+        return res_write_escaped(string_value, string_length, output);
+    }
+    
+    case RES_VALUE_FLOAT:
+    {
+        float float_value;
+        memcpy(&float_value, &value_data, sizeof(float_value));
+        return outbuf_format(output, "%g", float_value);
+    }
+    
+    case RES_VALUE_DIMENSION:
+    {
+        uint32_t unit = value_data & COMPLEX_UNIT_MASK;
+        const char* unit_name = unit < sizeof(dimension_units) / sizeof(*dimension_units) ? dimension_units[unit] : "";
+        return outbuf_format(output, "%g%s", res_complex_value(value_data), unit_name);
+    }
+    
+    case RES_VALUE_FRACTION:
+        return outbuf_format(output, "%g%s", res_complex_value(value_data) * 100, 
+            (value_data & COMPLEX_UNIT_MASK) == 1 ? "%p" : "%");
+    
+    case RES_VALUE_INT_DEC:
+        return outbuf_format(output, "%d", (int32_t)value_data);
+    
+    case RES_VALUE_INT_HEX:
+        return outbuf_format(output, "0x%x", value_data);
+    
+    case RES_VALUE_INT_BOOLEAN:
+        return outbuf_puts(value_data != 0 ? "true" : "false", output);
+    
+    case RES_VALUE_INT_COLOR_ARGB8:
+        return outbuf_format(output, "#%08x", value_data);
+    case RES_VALUE_INT_COLOR_RGB8:
+        return outbuf_format(output, "#%06x", value_data & 0xffffff);
+    case RES_VALUE_INT_COLOR_ARGB4:
+        return outbuf_format(output, "#%x%x%x%x", (value_data >> 28) & 0xf, (value_data >> 20) & 0xf, 
+            (value_data >> 12) & 0xf, (value_data >> 4) & 0xf);
+    case RES_VALUE_INT_COLOR_RGB4:
+        return outbuf_format(output, "#%x%x%x", (value_data >> 20) & 0xf, (value_data >> 12) & 0xf, 
+            (value_data >> 4) & 0xf);
+    
+    default:
+        return outbuf_format(output, "0x%08x", value_data);
+    }
+}
+
@@ -0,0 +1,45 @@
+#ifndef DECODE_RESOURCE_VALUE_H
+#define DECODE_RESOURCE_VALUE_H
+
+#include "data/Output_Buffer.h"
+
+#include "String_Pool.h"
+
+/* Res_value::dataType */
+typedef enum
+{
+    RES_VALUE_NULL = 0x00,
+    RES_VALUE_REFERENCE = 0x01,
+    RES_VALUE_ATTRIBUTE = 0x02,
+    RES_VALUE_STRING = 0x03,
+    RES_VALUE_FLOAT = 0x04,
+    RES_VALUE_DIMENSION = 0x05,
+    RES_VALUE_FRACTION = 0x06,
+    RES_VALUE_DYNAMIC_REFERENCE = 0x07,
+    RES_VALUE_DYNAMIC_ATTRIBUTE = 0x08,
+    RES_VALUE_INT_DEC = 0x10,
+    RES_VALUE_INT_HEX = 0x11,
+    RES_VALUE_INT_BOOLEAN = 0x12,
+    RES_VALUE_INT_COLOR_ARGB8 = 0x1c,
+    RES_VALUE_INT_COLOR_RGB8 = 0x1d,
+    RES_VALUE_INT_COLOR_ARGB4 = 0x1e,
+    RES_VALUE_INT_COLOR_RGB4 = 0x1f
+} res_value_e;
+
+#define RES_VALUE_SIZE 8
+
+/* Must be incremented when the text produced by the decoders changes, old cached outputs
+ * are no longer used
+*/
+#define RES_DECODER_VERSION 1
+
+/* Writes the text between XML tags or inside an attribute, escaping the markup characters */
+bool res_write_escaped(const char* text, size_t text_length, output_buffer_t* output);
+
+/* Writes a typed value as the apktool-like textual representation, strings are 
+ * resolved from `string_pool` and escaped
+*/
+bool res_write_value(uint8_t value_type, uint32_t value_data, string_pool_t* string_pool, output_buffer_t* output);
+
+#endif
+
@@ -0,0 +1,334 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "String_Pool.h"
+
+#define STRING_POOL_HEADER_SIZE 28
+#define STRING_POOL_UTF8_FLAG (1 << 8)
+
+struct pool_string
+{
+    uint32_t string_length;
+
+    char string_bytes[];
+};
+
+bool string_pool_init(const res_chunk_t* pool_chunk, intern_table_t* shared_strings, string_pool_t* string_pool)
+{
+    memset(string_pool, 0, sizeof(*string_pool));
+
+    if (pool_chunk->chunk_type != RES_STRING_POOL_TYPE || pool_chunk->header_size < STRING_POOL_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    const uint8_t* chunk_begin = pool_chunk->chunk_begin;
+    
+    uint32_t string_count = chunk_u32(chunk_begin + 8);
+    uint32_t style_count = chunk_u32(chunk_begin + 12);
+    uint32_t pool_flags = chunk_u32(chunk_begin + 16);
+    uint32_t strings_start = chunk_u32(chunk_begin + 20);
+    uint32_t styles_start = chunk_u32(chunk_begin + 24);
+
+    /* The offsets array must fit between the header and the strings data */
+    uint64_t offsets_end = (uint64_t)pool_chunk->header_size + ((uint64_t)string_count + style_count) * 4;
+    if (offsets_end > pool_chunk->chunk_size)
+    {
+        return false;
+    }
+
+    if (string_count != 0 && (strings_start < offsets_end || strings_start > pool_chunk->chunk_size))
+    {
+        return false;
+    }
+
+    size_t strings_end = pool_chunk->chunk_size;
+    if (style_count != 0 && styles_start > strings_start && styles_start <= pool_chunk->chunk_size)
+    {
+        strings_end = styles_start;
+    }
+
+    string_pool->pool_chunk = chunk_begin;
+    string_pool->string_count = string_count;
+    string_pool->style_count = style_count;
+    string_pool->pool_utf8 = (pool_flags & STRING_POOL_UTF8_FLAG) != 0;
+    string_pool->string_offsets = chunk_begin + pool_chunk->header_size;
+    string_pool->strings_data = chunk_begin + strings_start;
+    string_pool->strings_size = string_count != 0 ? strings_end - strings_start : 0;
+
+    if (string_pool->pool_utf8 == false && string_count != 0 && shared_strings != NULL)
+    {
+        string_pool->shared_strings = shared_strings;
+        string_pool->pool_ids = calloc(string_count, sizeof(*string_pool->pool_ids));
+        if (string_pool->pool_ids == NULL)
+        {
+            return false;
+        }
+    }
+    else if (string_pool->pool_utf8 == false && string_count != 0)
+    {
+        string_pool->pool_interned = calloc(string_count, sizeof(*string_pool->pool_interned));
+        if (string_pool->pool_interned == NULL)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void string_pool_deinit(string_pool_t* string_pool)
+{
+    if (string_pool->pool_interned != NULL)
+    {
+        for (uint32_t string_cur = 0; string_cur < string_pool->string_count; string_cur++)
+        {
+            struct pool_string* interned = string_pool->pool_interned[string_cur];
+            if (interned != NULL)
+            {
+                free((void*)interned);
+            }
+        }
+        free((void*)string_pool->pool_interned);
+    }
+    free((void*)string_pool->pool_ids);
+
+    memset(string_pool, 0, sizeof(*string_pool));
+}
+
+static void utf8_encode(uint32_t code_point, char** output, size_t* output_left, size_t* needed)
+{
+    char encoded[4];
+    size_t encoded_size;
+
+    if (code_point < 0x80)
+    {
+        encoded[0] = (char)code_point;
+        encoded_size = 1;
+    }
+    else if (code_point < 0x800)
+    {
+        encoded[0] = (char)(0xc0 | code_point >> 6);
+        encoded[1] = (char)(0x80 | (code_point & 0x3f));
+        encoded_size = 2;
+    }
+    else if (code_point < 0x10000)
+    {
+        encoded[0] = (char)(0xe0 | code_point >> 12);
+        encoded[1] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+        encoded[2] = (char)(0x80 | (code_point & 0x3f));
+        encoded_size = 3;
+    }
+    else
+    {
+        encoded[0] = (char)(0xf0 | code_point >> 18);
+        encoded[1] = (char)(0x80 | ((code_point >> 12) & 0x3f));
+        encoded[2] = (char)(0x80 | ((code_point >> 6) & 0x3f));
+        encoded[3] = (char)(0x80 | (code_point & 0x3f));
+        encoded_size = 4;
+    }
+
+    *needed += encoded_size;
+
+    if (*output != NULL && *output_left >= encoded_size)
+    {
+        memcpy(*output, encoded, encoded_size);
+        *output += encoded_size;
+        *output_left -= encoded_size;
+    }
+    else
+    {
+        /* Stops writing, the caller will only use the needed size */
+        *output_left = 0;
+    }
+}
+
+size_t string_pool_utf16_to_utf8(const uint8_t* utf16_data, size_t units_count, char* output, size_t output_size)
+{
+    size_t needed = 0;
+
+    for (size_t unit_cur = 0; unit_cur < units_count; unit_cur++)
+    {
+        uint32_t code_point = chunk_u16(utf16_data + unit_cur * 2);
+
+        if (code_point >= 0xd800 && code_point <= 0xdbff && unit_cur + 1 < units_count)
+        {
+            uint32_t low_surrogate = chunk_u16(utf16_data + (unit_cur + 1) * 2);
+            if (low_surrogate >= 0xdc00 && low_surrogate <= 0xdfff)
+            {
+                code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low_surrogate - 0xdc00);
+                unit_cur++;
+            }
+            else
+            {
+                code_point = 0xfffd;
+            }
+        }
+        else if (code_point >= 0xd800 && code_point <= 0xdfff)
+        {
+            /* Lonely surrogate */
+            code_point = 0xfffd;
+        }
+
+        utf8_encode(code_point, &output, &output_size, &needed);
+    }
+
+    return needed;
+}
+
+/* Decodes the UTF-8 entry length, one or two bytes with the high bit used as continuation */
+static const uint8_t* utf8_length(const uint8_t* entry, const uint8_t* entry_end, size_t* length)
+{
+    if (entry >= entry_end)
+    {
+        return NULL;
+    }
+
+    if ((entry[0] & 0x80) == 0)
+    {
+        *length = entry[0];
+        return entry + 1;
+    }
+
+    if (entry + 1 >= entry_end)
+    {
+        return NULL;
+    }
+    *length = (size_t)(entry[0] & 0x7f) << 8 | entry[1];
+    return entry + 2;
+}
+
+static const uint8_t* utf16_length(const uint8_t* entry, const uint8_t* entry_end, size_t* length)
+{
+    if (entry + 2 > entry_end)
+    {
+        return NULL;
+    }
+
+    uint16_t first_unit = chunk_u16(entry);
+    if ((first_unit & 0x8000) == 0)
+    {
+        *length = first_unit;
+        return entry + 2;
+    }
+
+    if (entry + 4 > entry_end)
+    {
+        return NULL;
+    }
+    *length = (size_t)(first_unit & 0x7fff) << 16 | chunk_u16(entry + 2);
+    return entry + 4;
+}
+
+static struct pool_string* string_pool_intern(const uint8_t* entry, const uint8_t* entry_end)
+{
+    size_t units_count;
+
+    const uint8_t* units = utf16_length(entry, entry_end, &units_count);
+    if (units == NULL || units_count > (size_t)(entry_end - units) / 2)
+    {
+        return NULL;
+    }
+
+    size_t utf8_size = string_pool_utf16_to_utf8(units, units_count, NULL, 0);
+
+    struct pool_string* interned = malloc(sizeof(*interned) + utf8_size + 1);
+    if (interned == NULL)
+    {
+        return NULL;
+    }
+
+    interned->string_length = (uint32_t)utf8_size;
+    string_pool_utf16_to_utf8(units, units_count, interned->string_bytes, utf8_size);
+    interned->string_bytes[utf8_size] = '\0';
+
+    return interned;
+}
+
+/* Threads converting the same entry at the same time get the same id, any store is right */
+static const char* string_pool_shared(uint32_t string_index, const uint8_t* entry, const uint8_t* entry_end, size_t* string_length,
+    string_pool_t* string_pool)
+{
+    uint32_t string_id = atomic_load_explicit(&string_pool->pool_ids[string_index], memory_order_relaxed);
+
+    if (string_id == 0)
+    {
+        struct pool_string* converted = string_pool_intern(entry, entry_end);
+        if (converted == NULL)
+        {
+            return NULL;
+        }
+        string_id = intern_string(converted->string_bytes, converted->string_length, string_pool->shared_strings) + 1;
+        free((void*)converted);
+
+        if (string_id == 0)
+        {
+            return NULL;
+        }
+        atomic_store_explicit(&string_pool->pool_ids[string_index], string_id, memory_order_relaxed);
+    }
+
+    return intern_lookup(string_id - 1, string_length, string_pool->shared_strings);
+}
+
+const char* string_pool_get(uint32_t string_index, size_t* string_length, string_pool_t* string_pool)
+{
+    if (string_index >= string_pool->string_count)
+    {
+        return NULL;
+    }
+
+    uint32_t string_offset = chunk_u32(string_pool->string_offsets + (size_t)string_index * 4);
+    if (string_offset >= string_pool->strings_size)
+    {
+        return NULL;
+    }
+
+    const uint8_t* entry = string_pool->strings_data + string_offset;
+    const uint8_t* entry_end = string_pool->strings_data + string_pool->strings_size;
+
+    if (string_pool->pool_utf8)
+    {
+        size_t length_utf16, length_utf8;
+
+        /* The first length is the size in UTF-16 units, we only care about the second one */
+        entry = utf8_length(entry, entry_end, &length_utf16);
+        if (entry == NULL) return NULL;
+        entry = utf8_length(entry, entry_end, &length_utf8);
+        if (entry == NULL || length_utf8 > (size_t)(entry_end - entry)) return NULL;
+
+        *string_length = length_utf8;
+        return (const char*)entry;
+    }
+
+    if (string_pool->pool_ids != NULL)
+    {
+        return string_pool_shared(string_index, entry, entry_end, string_length, string_pool);
+    }
+
+    struct pool_string* interned = atomic_load_explicit(&string_pool->pool_interned[string_index], memory_order_acquire);
+
+    if (interned == NULL)
+    {
+        struct pool_string* new_interned = string_pool_intern(entry, entry_end);
+        if (new_interned == NULL)
+        {
+            return NULL;
+        }
+
+        /* Another thread may have interned the same string in the meantime, the first one wins */
+        if (atomic_compare_exchange_strong(&string_pool->pool_interned[string_index], &interned, new_interned))
+        {
+            interned = new_interned;
+            string_pool->interned_bytes += new_interned->string_length;
+        }
+        else
+        {
+            free((void*)new_interned);
+        }
+    }
+
+    *string_length = interned->string_length;
+    return interned->string_bytes;
+}
+
@@ -0,0 +1,66 @@
+#ifndef DECODE_STRING_POOL_H
+#define DECODE_STRING_POOL_H
+
+#include <stdatomic.h>
+
+#include "Resource_Chunk.h"
+#include "data/String_Intern.h"
+
+#define STRING_POOL_NO_INDEX 0xffffffff
+
+struct pool_string;
+
+typedef struct string_pool
+{
+    const uint8_t* pool_chunk;
+
+    uint32_t string_count;
+
+    uint32_t style_count;
+
+    /* Strings are stored in UTF-8 when set, otherwise in UTF-16 */
+    bool pool_utf8;
+
+    const uint8_t* string_offsets;
+
+    const uint8_t* strings_data;
+
+    size_t strings_size;
+
+    /* UTF-16 entries are converted to UTF-8 only once, in his first use, and shared
+     * between all threads decoding the same table. UTF-8 entries are used in place (zero copy)
+    */
+    _Atomic(struct pool_string*)* pool_interned;
+
+    _Atomic size_t interned_bytes;
+
+    /* With a shared table the conversions go into it instead, so the same string converted
+     * by any pool of the batch is stored once. pool_ids holds the id plus one of each entry
+    */
+    intern_table_t* shared_strings;
+
+    _Atomic uint32_t* pool_ids;
+
+} string_pool_t;
+
+/* `shared_strings` may be NULL, the conversions are then owned by the pool */
+bool string_pool_init(const res_chunk_t* pool_chunk, intern_table_t* shared_strings, string_pool_t* string_pool);
+void string_pool_deinit(string_pool_t* string_pool);
+
+/* Retrieves a string (not null terminated) in UTF-8 encoding, returns NULL when the index 
+ * is out of range or when the entry is malformed
+*/
+const char* string_pool_get(uint32_t string_index, size_t* string_length, string_pool_t* string_pool);
+
+static inline uint32_t string_pool_count(const string_pool_t* string_pool)
+{
+    return string_pool->string_count;
+}
+
+/* Converts `units_count` UTF-16LE code units into UTF-8, returns the count of bytes needed,
+ * the output is truncated when `output_size` isn't enough (output can be NULL)
+*/
+size_t string_pool_utf16_to_utf8(const uint8_t* utf16_data, size_t units_count, char* output, size_t output_size);
+
+#endif
+
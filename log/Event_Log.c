@@ -0,0 +1,580 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Event_Log.h"
+
+#define ELOG_OUTPUT_SIZE (64 * 1024)
+
+/* A string argument that didn't fit in the slot */
+#define ELOG_STRING_LOST UINT64_MAX
+
+struct elog_slot
+{
+    int64_t record_time;
+
+    const char* record_format;
+
+    const char* record_tag;
+
+    int record_level;
+
+    /* Integers, doubles (bits), pointers and for strings the offset into record_strings */
+    uint64_t record_args[ELOG_SLOT_ARGS];
+
+    char record_strings[ELOG_SLOT_STRINGS];
+};
+
+/* One producer (the owner thread) and one consumer (the flusher) */
+struct elog_ring
+{
+    atomic_size_t ring_head;
+
+    /* Records lost because the ring was full, only the owner increments it */
+    atomic_size_t ring_dropped;
+
+    /* The owner's last view of ring_tail, reloaded only when the ring looks full */
+    size_t cached_tail;
+
+    /* Kept in his own cache line, the flusher writes it */
+    _Alignas(64) atomic_size_t ring_tail;
+
+    size_t dropped_seen;
+
+    pthread_t ring_owner;
+
+    pid_t ring_tid;
+
+    struct elog_ring* ring_next;
+
+    struct elog_slot ring_slots[ELOG_RING_SLOTS];
+};
+
+enum elog_arg
+{
+    ELOG_ARG_INT,
+    ELOG_ARG_LONG,
+    ELOG_ARG_LLONG,
+    ELOG_ARG_SIZE,
+    ELOG_ARG_DOUBLE,
+    ELOG_ARG_STRING,
+    ELOG_ARG_POINTER,
+    /* "%%" */
+    ELOG_ARG_NONE,
+    /* Everything after it is written as it is */
+    ELOG_ARG_INVALID
+};
+
+struct elog_spec
+{
+    const char* spec_begin;
+
+    size_t spec_length;
+
+    enum elog_arg spec_arg;
+};
+
+static const char* elog_level_names[] = { "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "OFF" };
+
+static atomic_uint elog_next_id;
+
+static _Thread_local struct elog_ring* elog_local_ring;
+static _Thread_local uint32_t elog_local_id;
+
+/* Finds the next conversion of `format`, spec_begin is NULL when there isn't any */
+static void elog_scan(const char* format, struct elog_spec* spec)
+{
+    const char* cursor = strchr(format, '%');
+
+    spec->spec_begin = cursor;
+    if (cursor == NULL)
+    {
+        return;
+    }
+    cursor++;
+
+    while ((*cursor >= '0' && *cursor <= '9') || *cursor == '.' || *cursor == '-' || *cursor == '+' || *cursor == ' ' || *cursor == '#')
+    {
+        cursor++;
+    }
+
+    size_t longs_count = 0;
+    bool size_length = false;
+
+    if (*cursor == 'h')
+    {
+        cursor += cursor[1] == 'h' ? 2 : 1;
+    }
+    else if (*cursor == 'l')
+    {
+        longs_count = cursor[1] == 'l' ? 2 : 1;
+        cursor += longs_count;
+    }
+    else if (*cursor == 'z' || *cursor == 't')
+    {
+        size_length = true;
+        cursor++;
+    }
+    else if (*cursor == 'j')
+    {
+        longs_count = 2;
+        cursor++;
+    }
+
+    switch (*cursor)
+    {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        spec->spec_arg = size_length ? ELOG_ARG_SIZE : longs_count == 2 ? ELOG_ARG_LLONG : longs_count == 1 ? ELOG_ARG_LONG : ELOG_ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->spec_arg = ELOG_ARG_DOUBLE;
+        break;
+    case 's':
+        spec->spec_arg = ELOG_ARG_STRING;
+        break;
+    case 'p':
+        spec->spec_arg = ELOG_ARG_POINTER;
+        break;
+    case '%':
+        spec->spec_arg = ELOG_ARG_NONE;
+        break;
+    default:
+        /* `*` widths, %n, long doubles and a truncated format */
+        spec->spec_arg = ELOG_ARG_INVALID;
+        spec->spec_length = 0;
+        return;
+    }
+
+    spec->spec_length = (size_t)(cursor + 1 - spec->spec_begin);
+}
+
+static struct elog_ring* elog_thread_ring(event_log_t* log)
+{
+    if (elog_local_id == log->log_id)
+    {
+        return elog_local_ring;
+    }
+
+    /* First record of this thread or another log has been used since */
+    pthread_t thread_self = pthread_self();
+    struct elog_ring* ring = atomic_load(&log->log_rings);
+
+    for (; ring != NULL; ring = ring->ring_next)
+    {
+        if (pthread_equal(ring->ring_owner, thread_self))
+        {
+            break;
+        }
+    }
+
+    if (ring == NULL)
+    {
+        ring = (struct elog_ring*) calloc(1, sizeof(struct elog_ring));
+        if (ring == NULL)
+        {
+            return NULL;
+        }
+        ring->ring_owner = thread_self;
+        ring->ring_tid = gettid();
+
+        ring->ring_next = atomic_load(&log->log_rings);
+        while (atomic_compare_exchange_weak(&log->log_rings, &ring->ring_next, ring) == false) {}
+        atomic_fetch_add(&log->rings_count, 1);
+    }
+
+    elog_local_ring = ring;
+    elog_local_id = log->log_id;
+
+    return ring;
+}
+
+void elog_record(event_log_t* log, enum elog_level level, const char* tag, const char* format, ...)
+{
+    struct elog_ring* ring = elog_thread_ring(log);
+
+    if (ring == NULL)
+    {
+        atomic_fetch_add_explicit(&log->records_dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t ring_head = atomic_load_explicit(&ring->ring_head, memory_order_relaxed);
+
+    if (ring_head - ring->cached_tail == ELOG_RING_SLOTS)
+    {
+        ring->cached_tail = atomic_load_explicit(&ring->ring_tail, memory_order_acquire);
+    }
+    if (ring_head - ring->cached_tail == ELOG_RING_SLOTS)
+    {
+        atomic_store_explicit(&ring->ring_dropped, atomic_load_explicit(&ring->ring_dropped, memory_order_relaxed) + 1,
+            memory_order_relaxed);
+        return;
+    }
+
+    struct elog_slot* slot = &ring->ring_slots[ring_head % ELOG_RING_SLOTS];
+    struct timespec record_time;
+
+    clock_gettime(CLOCK_REALTIME, &record_time);
+
+    slot->record_time = (int64_t)record_time.tv_sec * 1000000000 + record_time.tv_nsec;
+    slot->record_format = format;
+    slot->record_tag = tag;
+    slot->record_level = level;
+
+    va_list format_args;
+    va_start(format_args, format);
+
+    struct elog_spec spec;
+    size_t args_count = 0;
+    size_t strings_size = 0;
+
+    for (elog_scan(format, &spec); spec.spec_begin != NULL && args_count < ELOG_SLOT_ARGS;
+        elog_scan(spec.spec_begin + spec.spec_length, &spec))
+    {
+        uint64_t* arg = &slot->record_args[args_count];
+
+        switch (spec.spec_arg)
+        {
+        case ELOG_ARG_INT: *arg = (uint64_t)va_arg(format_args, int); break;
+        case ELOG_ARG_LONG: *arg = (uint64_t)va_arg(format_args, long); break;
+        case ELOG_ARG_LLONG: *arg = (uint64_t)va_arg(format_args, long long); break;
+        case ELOG_ARG_SIZE: *arg = (uint64_t)va_arg(format_args, size_t); break;
+        case ELOG_ARG_POINTER: *arg = (uint64_t)(uintptr_t)va_arg(format_args, void*); break;
+        case ELOG_ARG_DOUBLE:
+        {
+            double double_arg = va_arg(format_args, double);
+            memcpy(arg, &double_arg, sizeof(double_arg));
+            break;
+        }
+        case ELOG_ARG_STRING:
+        {
+            const char* string_arg = va_arg(format_args, const char*);
+            if (string_arg == NULL)
+            {
+                string_arg = "(null)";
+            }
+
+            if (strings_size == ELOG_SLOT_STRINGS)
+            {
+                *arg = ELOG_STRING_LOST;
+                break;
+            }
+            size_t string_length = strnlen(string_arg, ELOG_SLOT_STRINGS - strings_size - 1);
+
+            memcpy(slot->record_strings + strings_size, string_arg, string_length);
+            slot->record_strings[strings_size + string_length] = '\0';
+            *arg = strings_size;
+            strings_size += string_length + 1;
+            break;
+        }
+        case ELOG_ARG_NONE:
+            continue;
+        case ELOG_ARG_INVALID:
+            break;
+        }
+
+        if (spec.spec_arg == ELOG_ARG_INVALID)
+        {
+            break;
+        }
+        args_count++;
+    }
+    va_end(format_args);
+
+    atomic_store_explicit(&ring->ring_head, ring_head + 1, memory_order_release);
+
+    /* Records come in bursts, the next slot is brought in while the caller goes on */
+    struct elog_slot* next_slot = &ring->ring_slots[(ring_head + 1) % ELOG_RING_SLOTS];
+    __builtin_prefetch(next_slot, 1);
+    __builtin_prefetch((const char*)next_slot + 64, 1);
+}
+
+static bool elog_write_fd(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    event_log_t* log = (event_log_t*)flush_context;
+
+    if (log->log_fd == -1)
+    {
+        log->log_fd = open(log->log_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (log->log_fd == -1)
+        {
+            return false;
+        }
+    }
+
+    while (flush_size != 0)
+    {
+        ssize_t written = write(log->log_fd, flush_data, flush_size);
+        if (written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        flush_data += written;
+        flush_size -= (size_t)written;
+    }
+
+    return true;
+}
+
+static void elog_stamp(int64_t record_time, event_log_t* log)
+{
+    int64_t record_second = record_time / 1000000000;
+
+    if (record_second != log->cached_second)
+    {
+        time_t stamp_time = (time_t)record_second;
+        struct tm stamp_tm;
+
+        gmtime_r(&stamp_time, &stamp_tm);
+        strftime(log->cached_stamp, sizeof(log->cached_stamp), "%Y-%m-%dT%H:%M:%S", &stamp_tm);
+        log->cached_second = record_second;
+    }
+
+    outbuf_format(&log->log_output, "%s.%06dZ ", log->cached_stamp, (int)(record_time % 1000000000 / 1000));
+}
+
+/* The format is walked again, each conversion is formatted with the argument saved for it */
+static void elog_format(const struct elog_slot* slot, const struct elog_ring* ring, event_log_t* log)
+{
+    output_buffer_t* output = &log->log_output;
+
+    elog_stamp(slot->record_time, log);
+    outbuf_format(output, "%-5s %s[%d] ", elog_level_names[slot->record_level],
+        slot->record_tag != NULL ? slot->record_tag : "droidcat", (int)ring->ring_tid);
+
+    const char* format = slot->record_format;
+    struct elog_spec spec;
+    size_t args_count = 0;
+
+    for (elog_scan(format, &spec); spec.spec_begin != NULL; elog_scan(format, &spec))
+    {
+        outbuf_append(format, (size_t)(spec.spec_begin - format), output);
+
+        if (spec.spec_arg == ELOG_ARG_INVALID || args_count == ELOG_SLOT_ARGS)
+        {
+            format = spec.spec_begin;
+            break;
+        }
+        format = spec.spec_begin + spec.spec_length;
+
+        if (spec.spec_arg == ELOG_ARG_NONE)
+        {
+            outbuf_putc('%', output);
+            continue;
+        }
+
+        char spec_text[16];
+        if (spec.spec_length >= sizeof(spec_text))
+        {
+            format = spec.spec_begin;
+            break;
+        }
+        memcpy(spec_text, spec.spec_begin, spec.spec_length);
+        spec_text[spec.spec_length] = '\0';
+
+        uint64_t arg = slot->record_args[args_count++];
+
+        switch (spec.spec_arg)
+        {
+        case ELOG_ARG_INT: outbuf_format(output, spec_text, (int)arg); break;
+        case ELOG_ARG_LONG: outbuf_format(output, spec_text, (long)arg); break;
+        case ELOG_ARG_LLONG: outbuf_format(output, spec_text, (long long)arg); break;
+        case ELOG_ARG_SIZE: outbuf_format(output, spec_text, (size_t)arg); break;
+        case ELOG_ARG_POINTER: outbuf_format(output, spec_text, (void*)(uintptr_t)arg); break;
+        case ELOG_ARG_DOUBLE:
+        {
+            double double_arg;
+            memcpy(&double_arg, &arg, sizeof(double_arg));
+            outbuf_format(output, spec_text, double_arg);
+            break;
+        }
+        case ELOG_ARG_STRING:
+            outbuf_format(output, spec_text, arg == ELOG_STRING_LOST ? "" : slot->record_strings + arg);
+            break;
+        default:
+            break;
+        }
+    }
+
+    outbuf_puts(format, output);
+    outbuf_putc('\n', output);
+}
+
+static size_t elog_drain(event_log_t* log)
+{
+    size_t records_count = 0;
+    size_t dropped_count = 0;
+
+    for (struct elog_ring* ring = atomic_load(&log->log_rings); ring != NULL; ring = ring->ring_next)
+    {
+        size_t ring_tail = atomic_load_explicit(&ring->ring_tail, memory_order_relaxed);
+        size_t ring_head = atomic_load_explicit(&ring->ring_head, memory_order_acquire);
+
+        for (; ring_tail != ring_head; ring_tail++)
+        {
+            elog_format(&ring->ring_slots[ring_tail % ELOG_RING_SLOTS], ring, log);
+            records_count++;
+        }
+        atomic_store_explicit(&ring->ring_tail, ring_tail, memory_order_release);
+
+        size_t ring_dropped = atomic_load_explicit(&ring->ring_dropped, memory_order_relaxed);
+        dropped_count += ring_dropped - ring->dropped_seen;
+        ring->dropped_seen = ring_dropped;
+    }
+
+    if (dropped_count != 0)
+    {
+        struct timespec drop_time;
+        clock_gettime(CLOCK_REALTIME, &drop_time);
+
+        elog_stamp((int64_t)drop_time.tv_sec * 1000000000 + drop_time.tv_nsec, log);
+        outbuf_format(&log->log_output, "%-5s log[%d] %zu records dropped, the rings were full\n",
+            elog_level_names[ELOG_WARN], (int)gettid(), dropped_count);
+        atomic_fetch_add(&log->records_dropped, dropped_count);
+    }
+
+    if (records_count != 0 || dropped_count != 0)
+    {
+        outbuf_flush(&log->log_output);
+        atomic_fetch_add(&log->records_written, records_count);
+    }
+
+    return records_count;
+}
+
+static void* elog_flusher(void* flusher_data)
+{
+    event_log_t* log = (event_log_t*)flusher_data;
+    sigset_t blocked_signals;
+
+    /* Signals belong to the main thread */
+    sigfillset(&blocked_signals);
+    pthread_sigmask(SIG_BLOCK, &blocked_signals, NULL);
+
+    while (atomic_load(&log->flusher_run))
+    {
+        if (elog_drain(log) != 0)
+        {
+            continue;
+        }
+
+        /* Producers never wake us, an empty pass sleeps until the next batch */
+        struct timespec wake_time;
+        clock_gettime(CLOCK_REALTIME, &wake_time);
+        wake_time.tv_nsec += ELOG_FLUSH_NANO;
+        if (wake_time.tv_nsec >= 1000000000)
+        {
+            wake_time.tv_sec++;
+            wake_time.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&log->flusher_lock);
+        if (atomic_load(&log->flusher_run))
+        {
+            pthread_cond_timedwait(&log->flusher_wake, &log->flusher_lock, &wake_time);
+        }
+        pthread_mutex_unlock(&log->flusher_lock);
+    }
+
+    elog_drain(log);
+
+    return NULL;
+}
+
+bool elog_open(const char* log_path, enum elog_level log_level, event_log_t* log)
+{
+    memset(log, 0, sizeof(*log));
+
+    if (strlen(log_path) >= sizeof(log->log_path))
+    {
+        return false;
+    }
+    strcpy(log->log_path, log_path);
+
+    log->log_fd = -1;
+    log->log_id = atomic_fetch_add(&elog_next_id, 1) + 1;
+    log->cached_second = -1;
+    atomic_store(&log->log_level, log_level);
+
+    if (outbuf_init(ELOG_OUTPUT_SIZE, elog_write_fd, log, &log->log_output) == false)
+    {
+        return false;
+    }
+
+    pthread_mutex_init(&log->flusher_lock, NULL);
+    pthread_cond_init(&log->flusher_wake, NULL);
+    atomic_store(&log->flusher_run, true);
+
+    if (pthread_create(&log->log_flusher, NULL, elog_flusher, log) != 0)
+    {
+        pthread_cond_destroy(&log->flusher_wake);
+        pthread_mutex_destroy(&log->flusher_lock);
+        outbuf_deinit(&log->log_output);
+        return false;
+    }
+
+    return true;
+}
+
+bool elog_close(event_log_t* log)
+{
+    pthread_mutex_lock(&log->flusher_lock);
+    atomic_store(&log->flusher_run, false);
+    pthread_cond_signal(&log->flusher_wake);
+    pthread_mutex_unlock(&log->flusher_lock);
+
+    pthread_join(log->log_flusher, NULL);
+
+    struct elog_ring* ring = atomic_exchange(&log->log_rings, NULL);
+    while (ring != NULL)
+    {
+        struct elog_ring* ring_next = ring->ring_next;
+        free((void*)ring);
+        ring = ring_next;
+    }
+
+    bool close_ret = log->log_output.buffer_failed == false;
+
+    outbuf_deinit(&log->log_output);
+    if (log->log_fd != -1)
+    {
+        close_ret = close(log->log_fd) == 0 && close_ret;
+        log->log_fd = -1;
+    }
+
+    pthread_cond_destroy(&log->flusher_wake);
+    pthread_mutex_destroy(&log->flusher_lock);
+
+    return close_ret;
+}
+
+void elog_set_level(enum elog_level log_level, event_log_t* log)
+{
+    atomic_store_explicit(&log->log_level, log_level, memory_order_relaxed);
+}
+
+bool elog_parse_level(const char* level_name, enum elog_level* log_level)
+{
+    static const char* level_names[] = { "trace", "debug", "info", "warn", "error", "off" };
+
+    for (size_t level_cur = 0; level_cur < sizeof(level_names) / sizeof(level_names[0]); level_cur++)
+    {
+        if (strcmp(level_name, level_names[level_cur]) == 0)
+        {
+            *log_level = (enum elog_level)level_cur;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,101 @@
+#ifndef LOG_EVENT_LOG_H
+#define LOG_EVENT_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "data/Output_Buffer.h"
+
+/* Records per thread waiting for the flusher, a full ring drops the new records */
+#define ELOG_RING_SLOTS 512
+
+#define ELOG_SLOT_ARGS 8
+
+/* Room for the strings (%s) of a record, longer strings are truncated */
+#define ELOG_SLOT_STRINGS 160
+
+#define ELOG_FLUSH_NANO 20000000 /* 20 milliseconds */
+
+enum elog_level
+{
+    ELOG_TRACE,
+    ELOG_DEBUG,
+    ELOG_INFO,
+    ELOG_WARN,
+    ELOG_ERROR,
+    ELOG_OFF
+};
+
+struct elog_ring;
+
+typedef struct event_log
+{
+    /* Records below this level are discarded before touching the ring */
+    _Atomic int log_level;
+
+    /* Unique for each opened log, the threads cache their ring by it */
+    uint32_t log_id;
+
+    /* Rings are only added while the log is open, freed by elog_close */
+    _Atomic(struct elog_ring*) log_rings;
+
+    atomic_uint rings_count;
+
+    pthread_t log_flusher;
+
+    atomic_bool flusher_run;
+
+    pthread_mutex_t flusher_lock;
+
+    pthread_cond_t flusher_wake;
+
+    /* Opened by the flusher with the first record, nothing is created for an idle log */
+    char log_path[256];
+
+    int log_fd;
+
+    output_buffer_t log_output;
+
+    /* Last whole second formatted, most records reuse it */
+    int64_t cached_second;
+
+    char cached_stamp[32];
+
+    atomic_size_t records_written;
+
+    atomic_size_t records_dropped;
+
+} event_log_t;
+
+/* Starts the flusher thread, `log_path` is appended to */
+bool elog_open(const char* log_path, enum elog_level log_level, event_log_t* log);
+
+/* Stops the flusher after writing everything that has been logged */
+bool elog_close(event_log_t* log);
+
+void elog_set_level(enum elog_level log_level, event_log_t* log);
+
+/* "trace", "debug", "info", "warn", "error" or "off" */
+bool elog_parse_level(const char* level_name, enum elog_level* log_level);
+
+/* Never blocks: the arguments are copied into the thread's ring and the flusher does the
+ * formatting. The format must live as long as the log (a literal), %s strings are copied,
+ * `*` widths aren't supported and at most ELOG_SLOT_ARGS conversions are kept
+*/
+void elog_record(event_log_t* log, enum elog_level level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/* A filtered level costs a load and a branch, `log` may be NULL */
+#define elog_write(log, level, tag, ...) \
+    do \
+    { \
+        if ((log) != NULL && (int)(level) >= atomic_load_explicit(&(log)->log_level, memory_order_relaxed)) \
+        { \
+            elog_record(log, level, tag, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#endif
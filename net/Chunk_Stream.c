@@ -0,0 +1,513 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <zlib.h>
+
+#include "Chunk_Stream.h"
+#include "data/Content_Hash.h"
+
+/* Bigger streams are refused by the receiver */
+#define CHUNK_STREAM_MAX ((uint64_t)4 << 30)
+
+/* A deflated chunk must save at least 1/32 of his size, or the raw bytes are sent */
+#define CHUNK_DEFLATE_GAIN 32
+
+struct chunk_job
+{
+    const uint8_t* job_raw;
+
+    size_t raw_size;
+
+    uint32_t chunk_index;
+
+    /* Mostly inside compressed entries, deflating again is wasted time */
+    bool job_pass;
+
+    bool job_deflated;
+
+    uint8_t* job_packed;
+
+    size_t packed_size;
+};
+
+static inline void chunk_put32(uint8_t* data, uint32_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)(value >> 16);
+    data[3] = (uint8_t)(value >> 24);
+}
+
+static inline uint32_t chunk_get32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static bool chunk_write_all(int socket_fd, const void* data, size_t data_size)
+{
+    const uint8_t* data_cursor = (const uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t sent_size = send(socket_fd, data_cursor, data_size, MSG_NOSIGNAL);
+        if (sent_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent_size <= 0)
+        {
+            return false;
+        }
+        data_cursor += sent_size;
+        data_size -= (size_t)sent_size;
+    }
+    return true;
+}
+
+static bool chunk_read_all(int socket_fd, void* data, size_t data_size)
+{
+    uint8_t* data_cursor = (uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t read_size = read(socket_fd, data_cursor, data_size);
+        if (read_size < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_size <= 0)
+        {
+            return false;
+        }
+        data_cursor += read_size;
+        data_size -= (size_t)read_size;
+    }
+    return true;
+}
+
+static bool chunk_send_frame(enum chunk_frame_type frame_type, uint8_t frame_flags, uint32_t chunk_index, uint64_t frame_value,
+    const void* payload, uint32_t payload_size, int socket_fd)
+{
+    uint8_t frame_header[CHUNK_FRAME_HEADER_SIZE] = { 0 };
+
+    chunk_put32(frame_header, CHUNK_FRAME_MAGIC);
+    frame_header[4] = (uint8_t)frame_type;
+    frame_header[5] = frame_flags;
+    chunk_put32(frame_header + 8, chunk_index);
+    chunk_put32(frame_header + 12, payload_size);
+    chunk_put32(frame_header + 16, (uint32_t)frame_value);
+    chunk_put32(frame_header + 20, (uint32_t)(frame_value >> 32));
+
+    return chunk_write_all(socket_fd, frame_header, sizeof(frame_header)) && chunk_write_all(socket_fd, payload, payload_size);
+}
+
+static void* chunk_compress_task(void* task_data)
+{
+    struct chunk_job* job = (struct chunk_job*)task_data;
+    uLongf packed_size = compressBound(CHUNK_STREAM_SIZE);
+
+    job->job_deflated = false;
+    if (job->job_pass)
+    {
+        return NULL;
+    }
+
+    if (compress2(job->job_packed, &packed_size, job->job_raw, job->raw_size, Z_BEST_SPEED) == Z_OK &&
+        packed_size < job->raw_size - job->raw_size / CHUNK_DEFLATE_GAIN)
+    {
+        job->job_deflated = true;
+        job->packed_size = packed_size;
+    }
+    return NULL;
+}
+
+/* Counts by chunk the bytes inside compressed entries and finds where the central directory begins */
+static void chunk_scan_archive(const uint8_t* data, size_t data_size, uint32_t* compressed_bytes, uint32_t* tail_first)
+{
+    zip_archive_t archive;
+
+    if (zip_open_memory(data, data_size, &archive) == false)
+    {
+        return;
+    }
+    *tail_first = (uint32_t)(archive.central_dir_offset / CHUNK_STREAM_SIZE);
+
+    for (size_t entry_cur = 0; entry_cur < archive.entries_count; entry_cur++)
+    {
+        const zip_entry_t* entry = &archive.entries[entry_cur];
+        const uint8_t* entry_raw = zip_entry_raw(entry, &archive);
+
+        if (entry->compression_method == ZIP_METHOD_STORED || entry_raw == NULL)
+        {
+            continue;
+        }
+
+        uint64_t range_begin = (uint64_t)(entry_raw - data);
+        uint64_t range_end = range_begin + entry->compressed_size;
+
+        for (uint64_t chunk_cur = range_begin / CHUNK_STREAM_SIZE; chunk_cur * CHUNK_STREAM_SIZE < range_end; chunk_cur++)
+        {
+            uint64_t chunk_begin = chunk_cur * CHUNK_STREAM_SIZE;
+            uint64_t overlap_begin = range_begin > chunk_begin ? range_begin : chunk_begin;
+            uint64_t overlap_end = range_end < chunk_begin + CHUNK_STREAM_SIZE ? range_end : chunk_begin + CHUNK_STREAM_SIZE;
+
+            compressed_bytes[chunk_cur] += (uint32_t)(overlap_end - overlap_begin);
+        }
+    }
+    zip_close(&archive);
+}
+
+static void chunk_submit_wave(struct chunk_job* jobs, size_t wave_size, size_t order_begin, size_t chunks_count, uint32_t tail_first,
+    const uint8_t* data, size_t data_size, const uint32_t* compressed_bytes, tpool_group_t* wave_group, tpool_t* thread_pool)
+{
+    size_t tail_count = chunks_count - tail_first;
+
+    for (size_t job_cur = 0; job_cur < wave_size && order_begin + job_cur < chunks_count; job_cur++)
+    {
+        struct chunk_job* job = &jobs[job_cur];
+        size_t order_cur = order_begin + job_cur;
+
+        /* The tail first, then the rest in order */
+        job->chunk_index = (uint32_t)(order_cur < tail_count ? tail_first + order_cur : order_cur - tail_count);
+        job->job_raw = data + (size_t)job->chunk_index * CHUNK_STREAM_SIZE;
+        job->raw_size = data_size - (size_t)job->chunk_index * CHUNK_STREAM_SIZE;
+        job->raw_size = job->raw_size < CHUNK_STREAM_SIZE ? job->raw_size : CHUNK_STREAM_SIZE;
+        job->job_pass = (size_t)compressed_bytes[job->chunk_index] * 2 > job->raw_size;
+
+        if (thread_pool == NULL || tpool_group_execute(chunk_compress_task, job, wave_group, thread_pool) == false)
+        {
+            chunk_compress_task(job);
+        }
+    }
+}
+
+bool chunk_send(int socket_fd, const uint8_t* data, size_t data_size, chunk_stats_t* stats, tpool_t* thread_pool)
+{
+    size_t chunks_count = (data_size + CHUNK_STREAM_SIZE - 1) / CHUNK_STREAM_SIZE;
+    uint32_t tail_first = (uint32_t)chunks_count;
+
+    /* Two waves, one being compressed while the other is written */
+    size_t wave_size = thread_pool != NULL ? tpool_workers(thread_pool) * 2 : 1;
+    wave_size = wave_size < 2 ? 2 : wave_size;
+
+    uint32_t* compressed_bytes = calloc(chunks_count + 1, sizeof(uint32_t));
+    struct chunk_job* jobs = calloc(wave_size * 2, sizeof(struct chunk_job));
+    uint8_t* packed_buffers = malloc(wave_size * 2 * compressBound(CHUNK_STREAM_SIZE));
+
+    memset(stats, 0, sizeof(*stats));
+    if (compressed_bytes == NULL || jobs == NULL || packed_buffers == NULL)
+    {
+        free((void*)compressed_bytes);
+        free((void*)jobs);
+        free((void*)packed_buffers);
+        return false;
+    }
+
+    for (size_t job_cur = 0; job_cur < wave_size * 2; job_cur++)
+    {
+        jobs[job_cur].job_packed = packed_buffers + job_cur * compressBound(CHUNK_STREAM_SIZE);
+    }
+    chunk_scan_archive(data, data_size, compressed_bytes, &tail_first);
+
+    uint8_t begin_payload[8];
+    chunk_put32(begin_payload, CHUNK_STREAM_SIZE);
+    chunk_put32(begin_payload + 4, tail_first);
+    bool send_ret = chunk_send_frame(CHUNK_FRAME_BEGIN, 0, 0, data_size, begin_payload, sizeof(begin_payload), socket_fd);
+
+    tpool_group_t wave_groups[2];
+    tpool_group_init(&wave_groups[0]);
+    tpool_group_init(&wave_groups[1]);
+
+    for (size_t wave_cur = 0; wave_cur < 2; wave_cur++)
+    {
+        chunk_submit_wave(jobs + wave_cur * wave_size, wave_size, wave_cur * wave_size, chunks_count, tail_first,
+            data, data_size, compressed_bytes, &wave_groups[wave_cur], thread_pool);
+    }
+
+    for (size_t order_begin = 0, wave_cur = 0; order_begin < chunks_count; order_begin += wave_size, wave_cur ^= 1)
+    {
+        struct chunk_job* wave_jobs = jobs + wave_cur * wave_size;
+        tpool_group_wait(&wave_groups[wave_cur], thread_pool);
+
+        for (size_t job_cur = 0; send_ret && job_cur < wave_size && order_begin + job_cur < chunks_count; job_cur++)
+        {
+            struct chunk_job* job = &wave_jobs[job_cur];
+            const void* payload = job->job_deflated ? (const void*)job->job_packed : (const void*)job->job_raw;
+            size_t payload_size = job->job_deflated ? job->packed_size : job->raw_size;
+
+            send_ret = chunk_send_frame(CHUNK_FRAME_CHUNK, job->job_deflated ? CHUNK_FLAG_DEFLATED : 0, job->chunk_index, job->raw_size,
+                payload, (uint32_t)payload_size, socket_fd);
+
+            stats->chunks_count++;
+            stats->chunks_deflated += job->job_deflated;
+            stats->chunks_passed += job->job_pass;
+            stats->bytes_raw += job->raw_size;
+            stats->bytes_sent += CHUNK_FRAME_HEADER_SIZE + payload_size;
+        }
+
+        /* The buffers of this wave are free again */
+        if (send_ret && order_begin + wave_size * 2 < chunks_count)
+        {
+            chunk_submit_wave(wave_jobs, wave_size, order_begin + wave_size * 2, chunks_count, tail_first,
+                data, data_size, compressed_bytes, &wave_groups[wave_cur], thread_pool);
+        }
+    }
+
+    tpool_group_wait(&wave_groups[0], thread_pool);
+    tpool_group_wait(&wave_groups[1], thread_pool);
+    tpool_group_destroy(&wave_groups[0]);
+    tpool_group_destroy(&wave_groups[1]);
+
+    if (send_ret)
+    {
+        send_ret = chunk_send_frame(CHUNK_FRAME_END, 0, 0, hash_content64(data, data_size, 0), NULL, 0, socket_fd);
+    }
+
+    free((void*)compressed_bytes);
+    free((void*)jobs);
+    free((void*)packed_buffers);
+
+    return send_ret;
+}
+
+struct chunk_receiver
+{
+    uint8_t* stream_data;
+
+    uint64_t stream_size;
+
+    uint32_t chunk_size;
+
+    uint32_t chunks_count;
+
+    uint32_t tail_first;
+
+    uint32_t tail_received;
+
+    /* The body chunks arrive in order, everything below is complete */
+    uint32_t next_body;
+
+    bool archive_opened;
+
+    zip_archive_t archive;
+
+    /* Entries indexes sorted by offset, and the next one to hand */
+    uint32_t* entries_order;
+
+    size_t next_entry;
+};
+
+static int chunk_compare_offset(const void* first, const void* second, void* receiver_data)
+{
+    const zip_archive_t* archive = &((struct chunk_receiver*)receiver_data)->archive;
+    uint64_t first_offset = archive->entries[*(const uint32_t*)first].local_header_offset;
+    uint64_t second_offset = archive->entries[*(const uint32_t*)second].local_header_offset;
+
+    return first_offset < second_offset ? -1 : first_offset > second_offset;
+}
+
+/* The central directory is complete once the tail has arrived */
+static void chunk_open_archive(struct chunk_receiver* receiver)
+{
+    if (zip_open_memory(receiver->stream_data, receiver->stream_size, &receiver->archive) == false)
+    {
+        return;
+    }
+
+    receiver->entries_order = malloc((receiver->archive.entries_count + 1) * sizeof(uint32_t));
+    if (receiver->entries_order == NULL)
+    {
+        zip_close(&receiver->archive);
+        return;
+    }
+    for (size_t entry_cur = 0; entry_cur < receiver->archive.entries_count; entry_cur++)
+    {
+        receiver->entries_order[entry_cur] = (uint32_t)entry_cur;
+    }
+    qsort_r(receiver->entries_order, receiver->archive.entries_count, sizeof(uint32_t), chunk_compare_offset, receiver);
+
+    receiver->archive_opened = true;
+}
+
+static bool chunk_hand_entries(chunk_entry_fn on_entry, void* entry_data, struct chunk_receiver* receiver)
+{
+    if (receiver->archive_opened == false || on_entry == NULL)
+    {
+        return true;
+    }
+
+    uint64_t tail_begin = (uint64_t)receiver->tail_first * receiver->chunk_size;
+    uint64_t complete_size = (uint64_t)receiver->next_body * receiver->chunk_size;
+
+    if (complete_size >= tail_begin && receiver->tail_received == receiver->chunks_count - receiver->tail_first)
+    {
+        complete_size = receiver->stream_size;
+    }
+    complete_size = complete_size < receiver->stream_size ? complete_size : receiver->stream_size;
+
+    while (receiver->next_entry < receiver->archive.entries_count)
+    {
+        const zip_entry_t* entry = &receiver->archive.entries[receiver->entries_order[receiver->next_entry]];
+        uint64_t header_offset = entry->local_header_offset;
+
+        if (header_offset + ZIP_LOCAL_HEADER_SIZE > complete_size)
+        {
+            break;
+        }
+
+        const uint8_t* local_header = receiver->stream_data + header_offset;
+        uint64_t entry_end = header_offset + ZIP_LOCAL_HEADER_SIZE + (local_header[26] | local_header[27] << 8) +
+            (local_header[28] | local_header[29] << 8) + entry->compressed_size;
+
+        if (entry_end > complete_size)
+        {
+            break;
+        }
+        if (on_entry(entry, &receiver->archive, entry_data) == false)
+        {
+            return false;
+        }
+        receiver->next_entry++;
+    }
+    return true;
+}
+
+static bool chunk_receive_chunk(const uint8_t* frame_header, uint8_t* packed_buffer, int socket_fd, chunk_stats_t* stats,
+    struct chunk_receiver* receiver)
+{
+    uint32_t chunk_index = chunk_get32(frame_header + 8);
+    uint32_t payload_size = chunk_get32(frame_header + 12);
+    uint64_t raw_size = chunk_get32(frame_header + 16) | (uint64_t)chunk_get32(frame_header + 20) << 32;
+
+    if (chunk_index >= receiver->chunks_count)
+    {
+        return false;
+    }
+
+    uint64_t chunk_offset = (uint64_t)chunk_index * receiver->chunk_size;
+    uint64_t expected_size = receiver->stream_size - chunk_offset;
+    expected_size = expected_size < receiver->chunk_size ? expected_size : receiver->chunk_size;
+
+    /* The tail in order first, then the body in order */
+    uint32_t tail_count = receiver->chunks_count - receiver->tail_first;
+    bool chunk_expected = receiver->tail_received != tail_count ? chunk_index == receiver->tail_first + receiver->tail_received :
+        chunk_index == receiver->next_body;
+
+    if (chunk_expected == false || raw_size != expected_size || payload_size > compressBound(receiver->chunk_size))
+    {
+        return false;
+    }
+
+    uint8_t* chunk_data = receiver->stream_data + chunk_offset;
+    if (frame_header[5] & CHUNK_FLAG_DEFLATED)
+    {
+        uLongf unpacked_size = (uLongf)raw_size;
+
+        if (chunk_read_all(socket_fd, packed_buffer, payload_size) == false ||
+            uncompress(chunk_data, &unpacked_size, packed_buffer, payload_size) != Z_OK || unpacked_size != raw_size)
+        {
+            return false;
+        }
+        stats->chunks_deflated++;
+    }
+    else if (payload_size != raw_size || chunk_read_all(socket_fd, chunk_data, payload_size) == false)
+    {
+        return false;
+    }
+
+    stats->chunks_count++;
+    stats->bytes_raw += raw_size;
+    stats->bytes_sent += CHUNK_FRAME_HEADER_SIZE + payload_size;
+
+    if (receiver->tail_received != tail_count)
+    {
+        if (++receiver->tail_received == tail_count)
+        {
+            chunk_open_archive(receiver);
+        }
+    }
+    else
+    {
+        receiver->next_body++;
+    }
+    return true;
+}
+
+bool chunk_receive(int socket_fd, chunk_entry_fn on_entry, void* entry_data, uint8_t** data, size_t* data_size, chunk_stats_t* stats)
+{
+    struct chunk_receiver receiver = { 0 };
+    uint8_t frame_header[CHUNK_FRAME_HEADER_SIZE];
+    uint8_t begin_payload[8];
+
+    memset(stats, 0, sizeof(*stats));
+    *data = NULL;
+
+    if (chunk_read_all(socket_fd, frame_header, sizeof(frame_header)) == false || chunk_get32(frame_header) != CHUNK_FRAME_MAGIC ||
+        frame_header[4] != CHUNK_FRAME_BEGIN || chunk_get32(frame_header + 12) != sizeof(begin_payload) ||
+        chunk_read_all(socket_fd, begin_payload, sizeof(begin_payload)) == false)
+    {
+        return false;
+    }
+
+    receiver.stream_size = chunk_get32(frame_header + 16) | (uint64_t)chunk_get32(frame_header + 20) << 32;
+    receiver.chunk_size = chunk_get32(begin_payload);
+    receiver.tail_first = chunk_get32(begin_payload + 4);
+
+    if (receiver.stream_size > CHUNK_STREAM_MAX || receiver.chunk_size < 4096 || receiver.chunk_size > 16 * 1024 * 1024)
+    {
+        return false;
+    }
+    receiver.chunks_count = (uint32_t)((receiver.stream_size + receiver.chunk_size - 1) / receiver.chunk_size);
+    if (receiver.tail_first > receiver.chunks_count)
+    {
+        return false;
+    }
+
+    receiver.stream_data = malloc(receiver.stream_size + 1);
+    uint8_t* packed_buffer = malloc(compressBound(receiver.chunk_size));
+    bool receive_ret = receiver.stream_data != NULL && packed_buffer != NULL;
+
+    while (receive_ret)
+    {
+        receive_ret = chunk_read_all(socket_fd, frame_header, sizeof(frame_header)) && chunk_get32(frame_header) == CHUNK_FRAME_MAGIC;
+
+        if (receive_ret && frame_header[4] == CHUNK_FRAME_END)
+        {
+            uint64_t stream_hash = chunk_get32(frame_header + 16) | (uint64_t)chunk_get32(frame_header + 20) << 32;
+
+            receive_ret = receiver.next_body == receiver.tail_first && receiver.tail_received == receiver.chunks_count - receiver.tail_first &&
+                hash_content64(receiver.stream_data, receiver.stream_size, 0) == stream_hash;
+            if (receive_ret && receiver.archive_opened == false)
+            {
+                /* Without a tail the central directory is in the body */
+                chunk_open_archive(&receiver);
+            }
+            receive_ret = receive_ret && chunk_hand_entries(on_entry, entry_data, &receiver);
+            break;
+        }
+
+        receive_ret = receive_ret && frame_header[4] == CHUNK_FRAME_CHUNK &&
+            chunk_receive_chunk(frame_header, packed_buffer, socket_fd, stats, &receiver) &&
+            chunk_hand_entries(on_entry, entry_data, &receiver);
+    }
+
+    free((void*)packed_buffer);
+    free((void*)receiver.entries_order);
+    if (receiver.archive_opened)
+    {
+        zip_close(&receiver.archive);
+    }
+
+    if (receive_ret == false)
+    {
+        free((void*)receiver.stream_data);
+        return false;
+    }
+
+    *data = receiver.stream_data;
+    *data_size = (size_t)receiver.stream_size;
+    return true;
+}
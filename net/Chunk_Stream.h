@@ -0,0 +1,64 @@
+#ifndef NET_CHUNK_STREAM_H
+#define NET_CHUNK_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Thread_Pool.h"
+#include "zip/Zip_Archive.h"
+
+#define CHUNK_STREAM_SIZE (256 * 1024)
+
+/* "DCCK" */
+#define CHUNK_FRAME_MAGIC 0x4b434344
+
+/* Every frame starts with a little endian header:
+ * magic (4), type (1), flags (1), reserved (2), chunk index (4), payload size (4), value (8)
+ * - BEGIN: value is the stream size, payload is the chunk size (4) and the first tail chunk (4)
+ * - CHUNK: value is the raw size of the chunk, payload is the raw or deflated chunk
+ * - END: value is the XXH64 of the whole stream, no payload
+*/
+#define CHUNK_FRAME_HEADER_SIZE 24
+
+enum chunk_frame_type
+{
+    CHUNK_FRAME_BEGIN = 1,
+    CHUNK_FRAME_CHUNK,
+    CHUNK_FRAME_END
+};
+
+#define CHUNK_FLAG_DEFLATED 0x1
+
+typedef struct chunk_stats
+{
+    size_t chunks_count;
+
+    size_t chunks_deflated;
+
+    /* Chunks mostly inside compressed ZIP entries, sent without trying to compress */
+    size_t chunks_passed;
+
+    uint64_t bytes_raw;
+
+    uint64_t bytes_sent;
+
+} chunk_stats_t;
+
+/* Sends `data` in CHUNK_STREAM_SIZE chunks, compressed in parallel by the pool while the
+ * previous chunks are being written. For a ZIP the chunks holding the central directory are
+ * sent first, so the receiver can index the entries during the upload
+*/
+bool chunk_send(int socket_fd, const uint8_t* data, size_t data_size, chunk_stats_t* stats, tpool_t* thread_pool);
+
+/* Called by the receiver as soon as all the bytes of an entry have arrived, in the order of
+ * the entries in the stream, `archive` only has valid data up to the end of the entry
+*/
+typedef bool (*chunk_entry_fn)(const zip_entry_t* entry, const zip_archive_t* archive, void* entry_data);
+
+/* Receives a stream into a malloc'ed buffer, `on_entry` may be NULL, the whole content is
+ * checked against the END hash
+*/
+bool chunk_receive(int socket_fd, chunk_entry_fn on_entry, void* entry_data, uint8_t** data, size_t* data_size, chunk_stats_t* stats);
+
+#endif
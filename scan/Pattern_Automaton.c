@@ -0,0 +1,934 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <stdatomic.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "Pattern_Automaton.h"
+#include "data/Output_Buffer.h"
+#include "cpu/Hardware_Info.h"
+
+/* "DCAC" */
+#define SCAN_IMAGE_MAGIC 0x43414344
+#define SCAN_IMAGE_VERSION 1
+
+#define SCAN_OUTPUT_FLAG 0x80000000u
+#define SCAN_ROW_MASK 0x7fffffffu
+
+/* The prefilter is kept when the first searches skipped a window each in average */
+#define SCAN_RARE_PROBES 256
+
+struct scan_header
+{
+    uint32_t image_magic;
+
+    uint32_t image_version;
+
+    uint32_t states_count;
+
+    uint32_t classes_count;
+
+    uint32_t patterns_count;
+
+    uint32_t categories_count;
+
+    uint32_t outputs_count;
+
+    uint32_t strings_size;
+
+    uint32_t max_length;
+
+    uint32_t rare_count;
+
+    uint32_t rare_offset;
+
+    uint8_t rare_bytes[SCAN_RARE_MAX];
+
+    /* Bytes that no pattern uses share the class 0 */
+    uint8_t byte_classes[256];
+};
+
+/* Patterns and categories while the signatures are parsed */
+struct automaton_source
+{
+    /* Category names and pattern bytes, each one followed by a NUL */
+    output_buffer_t source_strings;
+
+    output_buffer_t source_patterns;
+
+    output_buffer_t source_categories;
+
+    uint32_t category_index;
+
+    bool category_open;
+};
+
+/* The trie while it's turned into a DFA */
+struct automaton_trie
+{
+    uint32_t* gotos;
+
+    size_t states_count;
+
+    size_t states_capacity;
+
+    uint32_t classes_count;
+
+    /* Own patterns of each state, as chains into pattern_chain (index + 1, 0 ends) */
+    uint32_t* state_patterns;
+
+    uint32_t* pattern_chain;
+};
+
+static bool automaton_fail(const char* message, size_t error_line, scan_error_t* error)
+{
+    error->error_line = error_line;
+    snprintf(error->error_message, sizeof(error->error_message), "%s", message);
+    return false;
+}
+
+static int automaton_hex(char hex_char)
+{
+    if (hex_char >= '0' && hex_char <= '9')
+    {
+        return hex_char - '0';
+    }
+    if (hex_char >= 'a' && hex_char <= 'f')
+    {
+        return hex_char - 'a' + 10;
+    }
+    if (hex_char >= 'A' && hex_char <= 'F')
+    {
+        return hex_char - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool automaton_add_category(const char* name, size_t name_length, struct automaton_source* source)
+{
+    uint32_t category_offset = (uint32_t)outbuf_length(&source->source_strings);
+
+    source->category_index = (uint32_t)(outbuf_length(&source->source_categories) / sizeof(uint32_t));
+    source->category_open = true;
+
+    return outbuf_append(&category_offset, sizeof(category_offset), &source->source_categories) &&
+        outbuf_append(name, name_length, &source->source_strings) && outbuf_putc('\0', &source->source_strings);
+}
+
+static bool automaton_add_pattern(const char* line, size_t line_length, size_t line_number, scan_error_t* error,
+    struct automaton_source* source)
+{
+    uint8_t pattern[SCAN_PATTERN_MAX];
+    size_t pattern_length = 0;
+
+    for (size_t line_cur = 0; line_cur < line_length; line_cur++)
+    {
+        uint8_t pattern_byte = (uint8_t)line[line_cur];
+
+        if (pattern_byte == '\\')
+        {
+            if (line_cur + 1 < line_length && line[line_cur + 1] == '\\')
+            {
+                line_cur++;
+            }
+            else if (line_cur + 3 < line_length && line[line_cur + 1] == 'x' &&
+                automaton_hex(line[line_cur + 2]) >= 0 && automaton_hex(line[line_cur + 3]) >= 0)
+            {
+                pattern_byte = (uint8_t)(automaton_hex(line[line_cur + 2]) << 4 | automaton_hex(line[line_cur + 3]));
+                line_cur += 3;
+            }
+            else
+            {
+                return automaton_fail("invalid escape, only \\xNN and \\\\ are known", line_number, error);
+            }
+        }
+
+        if (pattern_length == SCAN_PATTERN_MAX)
+        {
+            return automaton_fail("pattern too long", line_number, error);
+        }
+        pattern[pattern_length++] = pattern_byte;
+    }
+
+    if (source->category_open == false && automaton_add_category("signature", 9, source) == false)
+    {
+        return automaton_fail("out of memory", line_number, error);
+    }
+
+    struct scan_pattern pattern_entry = {
+        .string_offset = (uint32_t)outbuf_length(&source->source_strings),
+        .pattern_length = (uint32_t)pattern_length,
+        .category_index = source->category_index
+    };
+
+    if (outbuf_append(&pattern_entry, sizeof(pattern_entry), &source->source_patterns) == false ||
+        outbuf_append(pattern, pattern_length, &source->source_strings) == false || outbuf_putc('\0', &source->source_strings) == false)
+    {
+        return automaton_fail("out of memory", line_number, error);
+    }
+    return true;
+}
+
+static bool automaton_parse(const char* signatures, size_t signatures_size, scan_error_t* error, struct automaton_source* source)
+{
+    const char* line = signatures;
+    const char* signatures_end = signatures + signatures_size;
+
+    for (size_t line_number = 1; line < signatures_end; line_number++)
+    {
+        const char* line_end = memchr(line, '\n', (size_t)(signatures_end - line));
+        const char* next_line = line_end != NULL ? line_end + 1 : signatures_end;
+        if (line_end == NULL)
+        {
+            line_end = signatures_end;
+        }
+
+        while (line < line_end && (*line == ' ' || *line == '\t'))
+        {
+            line++;
+        }
+        while (line_end > line && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r'))
+        {
+            line_end--;
+        }
+
+        size_t line_length = (size_t)(line_end - line);
+
+        if (line_length == 0 || *line == '#')
+        {
+            line = next_line;
+            continue;
+        }
+
+        if (*line == '[')
+        {
+            if (line_length < 3 || line_end[-1] != ']')
+            {
+                return automaton_fail("invalid category", line_number, error);
+            }
+            if (automaton_add_category(line + 1, line_length - 2, source) == false)
+            {
+                return automaton_fail("out of memory", line_number, error);
+            }
+        }
+        else if (automaton_add_pattern(line, line_length, line_number, error, source) == false)
+        {
+            return false;
+        }
+        line = next_line;
+    }
+
+    if (outbuf_length(&source->source_patterns) == 0)
+    {
+        return automaton_fail("no patterns", 0, error);
+    }
+    return true;
+}
+
+static uint32_t automaton_new_state(struct automaton_trie* trie)
+{
+    if (trie->states_count == trie->states_capacity)
+    {
+        size_t new_capacity = trie->states_capacity * 2;
+        uint32_t* new_gotos = realloc(trie->gotos, new_capacity * trie->classes_count * sizeof(uint32_t));
+        uint32_t* new_patterns = realloc(trie->state_patterns, new_capacity * sizeof(uint32_t));
+
+        if (new_gotos != NULL)
+        {
+            trie->gotos = new_gotos;
+        }
+        if (new_patterns != NULL)
+        {
+            trie->state_patterns = new_patterns;
+        }
+        if (new_gotos == NULL || new_patterns == NULL)
+        {
+            return 0;
+        }
+        trie->states_capacity = new_capacity;
+    }
+
+    uint32_t state = (uint32_t)trie->states_count++;
+    memset(trie->gotos + (size_t)state * trie->classes_count, 0, trie->classes_count * sizeof(uint32_t));
+    trie->state_patterns[state] = 0;
+
+    return state;
+}
+
+/* Lower is rarer, a rough order of the bytes in DEX, ELF and resource files */
+static int automaton_byte_rank(uint8_t byte)
+{
+    static const char letters_order[] = "etaoinsrlcdhumpgfbywvkxjqz";
+
+    if (byte == 0x00 || byte == 0xff)
+    {
+        return 400;
+    }
+    if (byte == '/' || byte == '.' || byte == ';' || byte == 'L' || byte == ' ' || byte == '_')
+    {
+        return 300;
+    }
+    if (byte >= 'a' && byte <= 'z')
+    {
+        return 120 + (26 - (int)(strchr(letters_order, byte) - letters_order)) * 3;
+    }
+    if (byte >= '0' && byte <= '9')
+    {
+        return 150;
+    }
+    if (byte >= 'A' && byte <= 'Z')
+    {
+        return 120;
+    }
+    if (byte < 0x20 || byte >= 0x80)
+    {
+        return 180;
+    }
+    return 100;
+}
+
+/* Greedy: a pattern reuses a rare byte already chosen when one is in his window */
+static void automaton_choose_rare(const struct scan_pattern* patterns, size_t patterns_count, const uint8_t* strings,
+    struct scan_header* header)
+{
+    uint32_t rare_count = 0;
+    uint32_t rare_offset = 0;
+
+    for (size_t pattern_cur = 0; pattern_cur < patterns_count; pattern_cur++)
+    {
+        const uint8_t* pattern = strings + patterns[pattern_cur].string_offset;
+        size_t window = patterns[pattern_cur].pattern_length < SCAN_RARE_WINDOW ? patterns[pattern_cur].pattern_length : SCAN_RARE_WINDOW;
+        size_t chosen_offset = SIZE_MAX;
+
+        for (size_t byte_cur = 0; byte_cur < window && chosen_offset == SIZE_MAX; byte_cur++)
+        {
+            if (memchr(header->rare_bytes, pattern[byte_cur], rare_count) != NULL)
+            {
+                chosen_offset = byte_cur;
+            }
+        }
+
+        if (chosen_offset == SIZE_MAX)
+        {
+            chosen_offset = 0;
+            for (size_t byte_cur = 1; byte_cur < window; byte_cur++)
+            {
+                if (automaton_byte_rank(pattern[byte_cur]) < automaton_byte_rank(pattern[chosen_offset]))
+                {
+                    chosen_offset = byte_cur;
+                }
+            }
+            if (rare_count == SCAN_RARE_MAX)
+            {
+                /* Too many different rare bytes, every position is a candidate anyway */
+                header->rare_count = 0;
+                header->rare_offset = 0;
+                return;
+            }
+            header->rare_bytes[rare_count++] = pattern[chosen_offset];
+        }
+
+        if (chosen_offset > rare_offset)
+        {
+            rare_offset = (uint32_t)chosen_offset;
+        }
+    }
+
+    header->rare_count = rare_count;
+    header->rare_offset = rare_offset;
+}
+
+static size_t automaton_align(size_t size)
+{
+    return (size + 3) & ~(size_t)3;
+}
+
+/* Points the automaton into an image, checking that every index stays inside of it */
+static bool automaton_bind(uint8_t* image_data, size_t image_size, scan_automaton_t* automaton)
+{
+    const struct scan_header* header = (const struct scan_header*)image_data;
+
+    if (image_size < sizeof(*header) || header->image_magic != SCAN_IMAGE_MAGIC || header->image_version != SCAN_IMAGE_VERSION ||
+        header->states_count == 0 || header->classes_count == 0 || header->classes_count > 256 || header->rare_count > SCAN_RARE_MAX)
+    {
+        return false;
+    }
+
+    uint64_t table_size = (uint64_t)header->states_count * header->classes_count;
+    uint64_t expected_size = sizeof(*header) + table_size * 4 + ((uint64_t)header->states_count + 1) * 4 +
+        (uint64_t)header->outputs_count * 4 + (uint64_t)header->patterns_count * sizeof(struct scan_pattern) +
+        (uint64_t)header->categories_count * 4 + automaton_align(header->strings_size);
+
+    if (table_size > SCAN_ROW_MASK || expected_size != image_size)
+    {
+        return false;
+    }
+
+    automaton->image_data = image_data;
+    automaton->image_size = image_size;
+    automaton->header = header;
+    automaton->byte_classes = header->byte_classes;
+    automaton->transitions = (const uint32_t*)(image_data + sizeof(*header));
+    automaton->state_outputs = automaton->transitions + table_size;
+    automaton->outputs = automaton->state_outputs + header->states_count + 1;
+    automaton->patterns = (const struct scan_pattern*)(automaton->outputs + header->outputs_count);
+    automaton->category_offsets = (const uint32_t*)(automaton->patterns + header->patterns_count);
+    automaton->strings = (const char*)(automaton->category_offsets + header->categories_count);
+    automaton->classes_count = header->classes_count;
+    automaton->patterns_count = header->patterns_count;
+    automaton->max_length = header->max_length;
+    automaton->rare_count = header->rare_count;
+    automaton->rare_offset = header->rare_offset;
+    memcpy(automaton->rare_bytes, header->rare_bytes, sizeof(automaton->rare_bytes));
+
+    for (size_t byte_cur = 0; byte_cur < 256; byte_cur++)
+    {
+        if (header->byte_classes[byte_cur] >= header->classes_count)
+        {
+            return false;
+        }
+    }
+    for (uint64_t entry_cur = 0; entry_cur < table_size; entry_cur++)
+    {
+        uint32_t row = automaton->transitions[entry_cur] & SCAN_ROW_MASK;
+        if (row >= table_size || row % header->classes_count != 0)
+        {
+            return false;
+        }
+    }
+    for (uint32_t state_cur = 0; state_cur < header->states_count; state_cur++)
+    {
+        if (automaton->state_outputs[state_cur] > automaton->state_outputs[state_cur + 1])
+        {
+            return false;
+        }
+    }
+    if (automaton->state_outputs[header->states_count] != header->outputs_count)
+    {
+        return false;
+    }
+    for (uint32_t output_cur = 0; output_cur < header->outputs_count; output_cur++)
+    {
+        if (automaton->outputs[output_cur] >= header->patterns_count)
+        {
+            return false;
+        }
+    }
+    for (uint32_t pattern_cur = 0; pattern_cur < header->patterns_count; pattern_cur++)
+    {
+        const struct scan_pattern* pattern = &automaton->patterns[pattern_cur];
+        if ((uint64_t)pattern->string_offset + pattern->pattern_length >= header->strings_size ||
+            pattern->category_index >= header->categories_count)
+        {
+            return false;
+        }
+    }
+    for (uint32_t category_cur = 0; category_cur < header->categories_count; category_cur++)
+    {
+        if (automaton->category_offsets[category_cur] >= header->strings_size)
+        {
+            return false;
+        }
+    }
+
+    return header->strings_size != 0 && automaton->strings[header->strings_size - 1] == '\0';
+}
+
+static bool automaton_build(struct automaton_source* source, scan_automaton_t* automaton)
+{
+    const struct scan_pattern* patterns = (const struct scan_pattern*)source->source_patterns.buffer_data;
+    size_t patterns_count = outbuf_length(&source->source_patterns) / sizeof(struct scan_pattern);
+    const uint8_t* strings = (const uint8_t*)source->source_strings.buffer_data;
+
+    struct scan_header header = {
+        .image_magic = SCAN_IMAGE_MAGIC,
+        .image_version = SCAN_IMAGE_VERSION,
+        .patterns_count = (uint32_t)patterns_count,
+        .categories_count = (uint32_t)(outbuf_length(&source->source_categories) / sizeof(uint32_t)),
+        .strings_size = (uint32_t)outbuf_length(&source->source_strings)
+    };
+
+    /* Each byte used by a pattern gets his own class */
+    uint32_t classes_count = 1;
+    for (size_t pattern_cur = 0; pattern_cur < patterns_count; pattern_cur++)
+    {
+        const uint8_t* pattern = strings + patterns[pattern_cur].string_offset;
+
+        for (size_t byte_cur = 0; byte_cur < patterns[pattern_cur].pattern_length; byte_cur++)
+        {
+            if (header.byte_classes[pattern[byte_cur]] == 0 && classes_count < 256)
+            {
+                header.byte_classes[pattern[byte_cur]] = (uint8_t)classes_count++;
+            }
+        }
+        if (patterns[pattern_cur].pattern_length > header.max_length)
+        {
+            header.max_length = patterns[pattern_cur].pattern_length;
+        }
+    }
+    header.classes_count = classes_count;
+
+    struct automaton_trie trie = {
+        .states_capacity = 64,
+        .classes_count = classes_count
+    };
+    trie.gotos = malloc(trie.states_capacity * classes_count * sizeof(uint32_t));
+    trie.state_patterns = malloc(trie.states_capacity * sizeof(uint32_t));
+    trie.pattern_chain = calloc(patterns_count, sizeof(uint32_t));
+
+    uint32_t* fail_states = NULL;
+    uint32_t* bfs_order = NULL;
+    uint32_t* outputs_count = NULL;
+    uint8_t* image_data = NULL;
+    bool build_ret = trie.gotos != NULL && trie.state_patterns != NULL && trie.pattern_chain != NULL;
+
+    if (build_ret)
+    {
+        automaton_new_state(&trie);
+    }
+
+    for (size_t pattern_cur = 0; build_ret && pattern_cur < patterns_count; pattern_cur++)
+    {
+        const uint8_t* pattern = strings + patterns[pattern_cur].string_offset;
+        uint32_t state = 0;
+
+        for (size_t byte_cur = 0; build_ret && byte_cur < patterns[pattern_cur].pattern_length; byte_cur++)
+        {
+            uint32_t* next_state = &trie.gotos[(size_t)state * classes_count + header.byte_classes[pattern[byte_cur]]];
+            if (*next_state == 0)
+            {
+                uint32_t new_state = automaton_new_state(&trie);
+                build_ret = new_state != 0;
+                /* The table may have moved */
+                next_state = &trie.gotos[(size_t)state * classes_count + header.byte_classes[pattern[byte_cur]]];
+                *next_state = new_state;
+            }
+            state = *next_state;
+        }
+
+        trie.pattern_chain[pattern_cur] = trie.state_patterns[state];
+        trie.state_patterns[state] = (uint32_t)pattern_cur + 1;
+    }
+
+    size_t states_count = trie.states_count;
+    build_ret = build_ret && (uint64_t)states_count * classes_count <= SCAN_ROW_MASK;
+
+    if (build_ret)
+    {
+        fail_states = calloc(states_count, sizeof(uint32_t));
+        bfs_order = malloc(states_count * sizeof(uint32_t));
+        outputs_count = calloc(states_count + 1, sizeof(uint32_t));
+        build_ret = fail_states != NULL && bfs_order != NULL && outputs_count != NULL;
+    }
+
+    /* Breadth first, the failure of a state is always processed before him, the missing
+     * transitions are taken from the failure so the trie becomes a DFA
+    */
+    size_t bfs_length = 0;
+    if (build_ret)
+    {
+        bfs_order[bfs_length++] = 0;
+    }
+    for (size_t bfs_cur = 0; build_ret && bfs_cur < bfs_length; bfs_cur++)
+    {
+        uint32_t state = bfs_order[bfs_cur];
+        uint32_t* state_row = &trie.gotos[(size_t)state * classes_count];
+        const uint32_t* fail_row = &trie.gotos[(size_t)fail_states[state] * classes_count];
+
+        for (uint32_t class_cur = 0; class_cur < classes_count; class_cur++)
+        {
+            uint32_t child = state_row[class_cur];
+
+            if (child != 0)
+            {
+                fail_states[child] = state == 0 ? 0 : fail_row[class_cur];
+                bfs_order[bfs_length++] = child;
+            }
+            else
+            {
+                state_row[class_cur] = state == 0 ? 0 : fail_row[class_cur];
+            }
+        }
+
+        uint32_t own_count = 0;
+        for (uint32_t pattern_link = trie.state_patterns[state]; pattern_link != 0; pattern_link = trie.pattern_chain[pattern_link - 1])
+        {
+            own_count++;
+        }
+        outputs_count[state] = own_count + (state == 0 ? 0 : outputs_count[fail_states[state]]);
+    }
+
+    uint64_t outputs_total = 0;
+    for (size_t state_cur = 0; build_ret && state_cur < states_count; state_cur++)
+    {
+        outputs_total += outputs_count[state_cur];
+    }
+    build_ret = build_ret && outputs_total < UINT32_MAX;
+
+    size_t image_size = 0;
+    if (build_ret)
+    {
+        header.states_count = (uint32_t)states_count;
+        header.outputs_count = (uint32_t)outputs_total;
+        automaton_choose_rare(patterns, patterns_count, strings, &header);
+
+        image_size = sizeof(header) + states_count * classes_count * 4 + (states_count + 1) * 4 + outputs_total * 4 +
+            patterns_count * sizeof(struct scan_pattern) + header.categories_count * 4 + automaton_align(header.strings_size);
+        image_data = calloc(1, image_size);
+        build_ret = image_data != NULL;
+    }
+
+    if (build_ret)
+    {
+        uint32_t* transitions = (uint32_t*)(image_data + sizeof(header));
+        uint32_t* state_outputs = transitions + states_count * classes_count;
+        uint32_t* outputs = state_outputs + states_count + 1;
+        uint8_t* tables = (uint8_t*)(outputs + outputs_total);
+
+        memcpy(image_data, &header, sizeof(header));
+
+        for (size_t entry_cur = 0; entry_cur < states_count * classes_count; entry_cur++)
+        {
+            uint32_t target = trie.gotos[entry_cur];
+            transitions[entry_cur] = target * classes_count | (outputs_count[target] != 0 ? SCAN_OUTPUT_FLAG : 0);
+        }
+
+        uint32_t output_offset = 0;
+        for (size_t state_cur = 0; state_cur < states_count; state_cur++)
+        {
+            state_outputs[state_cur] = output_offset;
+            output_offset += outputs_count[state_cur];
+        }
+        state_outputs[states_count] = output_offset;
+
+        /* Own patterns first, then the ones of the failure, already filled in BFS order */
+        for (size_t bfs_cur = 0; bfs_cur < bfs_length; bfs_cur++)
+        {
+            uint32_t state = bfs_order[bfs_cur];
+            uint32_t* state_output = &outputs[state_outputs[state]];
+
+            for (uint32_t pattern_link = trie.state_patterns[state]; pattern_link != 0; pattern_link = trie.pattern_chain[pattern_link - 1])
+            {
+                *state_output++ = pattern_link - 1;
+            }
+            if (state != 0)
+            {
+                memcpy(state_output, &outputs[state_outputs[fail_states[state]]], outputs_count[fail_states[state]] * sizeof(uint32_t));
+            }
+        }
+
+        memcpy(tables, patterns, patterns_count * sizeof(struct scan_pattern));
+        tables += patterns_count * sizeof(struct scan_pattern);
+        memcpy(tables, source->source_categories.buffer_data, header.categories_count * 4);
+        tables += header.categories_count * 4;
+        memcpy(tables, strings, header.strings_size);
+
+        build_ret = automaton_bind(image_data, image_size, automaton);
+        automaton->image_mapped = false;
+    }
+
+    if (build_ret == false)
+    {
+        free((void*)image_data);
+    }
+    free((void*)trie.gotos);
+    free((void*)trie.state_patterns);
+    free((void*)trie.pattern_chain);
+    free((void*)fail_states);
+    free((void*)bfs_order);
+    free((void*)outputs_count);
+
+    return build_ret;
+}
+
+bool automaton_compile(const char* signatures, size_t signatures_size, scan_error_t* error, scan_automaton_t* automaton)
+{
+    struct automaton_source source = { 0 };
+
+    memset(error, 0, sizeof(*error));
+    memset(automaton, 0, sizeof(*automaton));
+
+    outbuf_init(0, NULL, NULL, &source.source_strings);
+    outbuf_init(0, NULL, NULL, &source.source_patterns);
+    outbuf_init(0, NULL, NULL, &source.source_categories);
+
+    bool compile_ret = automaton_parse(signatures, signatures_size, error, &source);
+    if (compile_ret && automaton_build(&source, automaton) == false)
+    {
+        compile_ret = automaton_fail("out of memory or too many states", 0, error);
+    }
+
+    outbuf_deinit(&source.source_strings);
+    outbuf_deinit(&source.source_patterns);
+    outbuf_deinit(&source.source_categories);
+
+    return compile_ret;
+}
+
+bool automaton_save(const char* image_path, const scan_automaton_t* automaton)
+{
+    char temporary_path[4096];
+
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.%ld", image_path, (long)getpid()) >= (int)sizeof(temporary_path))
+    {
+        return false;
+    }
+
+    int image_fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (image_fd < 0)
+    {
+        return false;
+    }
+
+    bool save_ret = true;
+    for (size_t image_cur = 0; save_ret && image_cur < automaton->image_size; )
+    {
+        ssize_t written = write(image_fd, automaton->image_data + image_cur, automaton->image_size - image_cur);
+        save_ret = written > 0;
+        image_cur += save_ret ? (size_t)written : 0;
+    }
+    save_ret &= close(image_fd) == 0;
+
+    if (save_ret == false || rename(temporary_path, image_path) != 0)
+    {
+        unlink(temporary_path);
+        return false;
+    }
+    return true;
+}
+
+bool automaton_load(const char* image_path, scan_automaton_t* automaton)
+{
+    memset(automaton, 0, sizeof(*automaton));
+
+    int image_fd = open(image_path, O_RDONLY | O_CLOEXEC);
+    if (image_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat image_stat;
+    void* image_data = MAP_FAILED;
+
+    if (fstat(image_fd, &image_stat) == 0 && image_stat.st_size > 0)
+    {
+        image_data = mmap(NULL, (size_t)image_stat.st_size, PROT_READ, MAP_PRIVATE, image_fd, 0);
+    }
+    close(image_fd);
+
+    if (image_data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if (automaton_bind(image_data, (size_t)image_stat.st_size, automaton) == false)
+    {
+        munmap(image_data, (size_t)image_stat.st_size);
+        memset(automaton, 0, sizeof(*automaton));
+        return false;
+    }
+    automaton->image_mapped = true;
+
+    return true;
+}
+
+void automaton_release(scan_automaton_t* automaton)
+{
+    if (automaton->image_mapped)
+    {
+        munmap(automaton->image_data, automaton->image_size);
+    }
+    else
+    {
+        free((void*)automaton->image_data);
+    }
+    memset(automaton, 0, sizeof(*automaton));
+}
+
+typedef size_t (*automaton_find_fn)(const uint8_t* data, size_t data_cur, size_t data_size, const uint8_t* rare_bytes, uint32_t rare_count);
+
+/* The next position holding one of the rare bytes, or `data_size` */
+static size_t automaton_find_portable(const uint8_t* data, size_t data_cur, size_t data_size, const uint8_t* rare_bytes, uint32_t rare_count)
+{
+    for (; data_cur < data_size; data_cur++)
+    {
+        if (memchr(rare_bytes, data[data_cur], rare_count) != NULL)
+        {
+            return data_cur;
+        }
+    }
+    return data_size;
+}
+
+#if defined(__SSE2__)
+static size_t automaton_find_sse2(const uint8_t* data, size_t data_cur, size_t data_size, const uint8_t* rare_bytes, uint32_t rare_count)
+{
+    __m128i needles[SCAN_RARE_MAX];
+
+    for (uint32_t rare_cur = 0; rare_cur < rare_count; rare_cur++)
+    {
+        needles[rare_cur] = _mm_set1_epi8((char)rare_bytes[rare_cur]);
+    }
+
+    for (; data_cur + 16 <= data_size; data_cur += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + data_cur));
+        __m128i found = _mm_cmpeq_epi8(block, needles[0]);
+
+        for (uint32_t rare_cur = 1; rare_cur < rare_count; rare_cur++)
+        {
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(block, needles[rare_cur]));
+        }
+
+        int found_mask = _mm_movemask_epi8(found);
+        if (found_mask != 0)
+        {
+            return data_cur + (size_t)__builtin_ctz((unsigned)found_mask);
+        }
+    }
+    return automaton_find_portable(data, data_cur, data_size, rare_bytes, rare_count);
+}
+#endif
+
+#if defined(__x86_64__)
+/* Twice the bytes by comparison, the tail is left to SSE2 */
+__attribute__((target("avx2")))
+static size_t automaton_find_avx2(const uint8_t* data, size_t data_cur, size_t data_size, const uint8_t* rare_bytes, uint32_t rare_count)
+{
+    __m256i needles[SCAN_RARE_MAX];
+
+    for (uint32_t rare_cur = 0; rare_cur < rare_count; rare_cur++)
+    {
+        needles[rare_cur] = _mm256_set1_epi8((char)rare_bytes[rare_cur]);
+    }
+
+    for (; data_cur + 32 <= data_size; data_cur += 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + data_cur));
+        __m256i found = _mm256_cmpeq_epi8(block, needles[0]);
+
+        for (uint32_t rare_cur = 1; rare_cur < rare_count; rare_cur++)
+        {
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, needles[rare_cur]));
+        }
+
+        uint32_t found_mask = (uint32_t)_mm256_movemask_epi8(found);
+        if (found_mask != 0)
+        {
+            return data_cur + (size_t)__builtin_ctz(found_mask);
+        }
+    }
+    return automaton_find_sse2(data, data_cur, data_size, rare_bytes, rare_count);
+}
+#endif
+
+static const cpu_kernel_t automaton_find_kernels[] = {
+#if defined(__x86_64__)
+    { "avx2", CPU_FEATURE_AVX2, (void (*)(void))automaton_find_avx2 },
+#endif
+#if defined(__SSE2__)
+    { "sse2", 0, (void (*)(void))automaton_find_sse2 },
+#endif
+    { "portable", 0, (void (*)(void))automaton_find_portable }
+};
+
+/* Bound by the first scan */
+static _Atomic(automaton_find_fn) automaton_find_rare;
+
+static automaton_find_fn automaton_find_kernel(void)
+{
+    automaton_find_fn find_rare = atomic_load_explicit(&automaton_find_rare, memory_order_relaxed);
+
+    if (find_rare == NULL)
+    {
+        const cpu_kernel_t* kernel = cpu_dispatch(automaton_find_kernels, sizeof(automaton_find_kernels) / sizeof(*automaton_find_kernels));
+        find_rare = (automaton_find_fn)kernel->kernel_function;
+        atomic_store_explicit(&automaton_find_rare, find_rare, memory_order_relaxed);
+    }
+    return find_rare;
+}
+
+bool automaton_scan(const uint8_t* data, size_t data_size, size_t report_from, scan_match_fn on_match, void* match_data,
+    const scan_automaton_t* automaton)
+{
+    const uint32_t* transitions = automaton->transitions;
+    const uint8_t* byte_classes = automaton->byte_classes;
+    bool use_prefilter = automaton->rare_count != 0;
+    automaton_find_fn find_rare = use_prefilter ? automaton_find_kernel() : NULL;
+    size_t next_rare = 0;
+    uint32_t row = 0;
+
+    /* Where the rare bytes are common the searches skip nothing, they're stopped */
+    size_t rare_searches = 0;
+    size_t rare_skipped = 0;
+
+    for (size_t data_cur = 0; data_cur < data_size; data_cur++)
+    {
+        /* At the root no match is in progress: a match starts at most rare_offset bytes before
+         * his rare byte, everything before can be skipped
+        */
+        if (row == 0 && use_prefilter)
+        {
+            if (next_rare < data_cur)
+            {
+                next_rare = find_rare(data, data_cur, data_size, automaton->rare_bytes, automaton->rare_count);
+                rare_searches++;
+            }
+            if (next_rare == data_size)
+            {
+                break;
+            }
+            if (next_rare > data_cur + automaton->rare_offset)
+            {
+                rare_skipped += next_rare - automaton->rare_offset - data_cur;
+                data_cur = next_rare - automaton->rare_offset;
+            }
+            if (rare_searches == SCAN_RARE_PROBES)
+            {
+                use_prefilter = rare_skipped >= SCAN_RARE_PROBES * SCAN_RARE_WINDOW;
+                rare_searches++;
+            }
+        }
+
+        uint32_t next_row = transitions[row + byte_classes[data[data_cur]]];
+        row = next_row & SCAN_ROW_MASK;
+
+        if ((next_row & SCAN_OUTPUT_FLAG) != 0 && data_cur + 1 > report_from)
+        {
+            uint32_t state = row / automaton->classes_count;
+
+            for (uint32_t output_cur = automaton->state_outputs[state]; output_cur < automaton->state_outputs[state + 1]; output_cur++)
+            {
+                if (on_match(automaton->outputs[output_cur], data_cur + 1, match_data) == false)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+const char* automaton_pattern(uint32_t pattern_index, size_t* pattern_length, const scan_automaton_t* automaton)
+{
+    const struct scan_pattern* pattern = &automaton->patterns[pattern_index];
+
+    *pattern_length = pattern->pattern_length;
+    return automaton->strings + pattern->string_offset;
+}
+
+const char* automaton_category(uint32_t pattern_index, const scan_automaton_t* automaton)
+{
+    return automaton->strings + automaton->category_offsets[automaton->patterns[pattern_index].category_index];
+}
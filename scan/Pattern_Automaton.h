@@ -0,0 +1,104 @@
+#ifndef SCAN_PATTERN_AUTOMATON_H
+#define SCAN_PATTERN_AUTOMATON_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define SCAN_PATTERN_MAX 255
+
+/* A prefilter with more rare bytes than this costs more than it saves */
+#define SCAN_RARE_MAX 8
+
+/* The rare byte of a pattern is chosen between his first bytes */
+#define SCAN_RARE_WINDOW 16
+
+typedef struct scan_error
+{
+    size_t error_line;
+
+    char error_message[128];
+
+} scan_error_t;
+
+struct scan_header;
+
+struct scan_pattern
+{
+    uint32_t string_offset;
+
+    uint32_t pattern_length;
+
+    uint32_t category_index;
+};
+
+/* An Aho-Corasick DFA over byte classes. The whole automaton is a single flat image: built in
+ * memory by automaton_compile or mapped from a file saved by automaton_save, nothing is
+ * rebuilt when loading
+*/
+typedef struct scan_automaton
+{
+    uint8_t* image_data;
+
+    size_t image_size;
+
+    bool image_mapped;
+
+    const struct scan_header* header;
+
+    /* Each row has classes_count entries, premultiplied by it, SCAN_OUTPUT_FLAG marks the
+     * states with matches
+    */
+    const uint32_t* transitions;
+
+    const uint8_t* byte_classes;
+
+    const uint32_t* state_outputs;
+
+    const uint32_t* outputs;
+
+    const struct scan_pattern* patterns;
+
+    const uint32_t* category_offsets;
+
+    const char* strings;
+
+    uint32_t classes_count;
+
+    uint32_t patterns_count;
+
+    uint32_t max_length;
+
+    /* The prefilter, rare_count is 0 when it's disabled */
+    uint8_t rare_bytes[SCAN_RARE_MAX];
+
+    uint32_t rare_count;
+
+    uint32_t rare_offset;
+
+} scan_automaton_t;
+
+/* Called for each match in the order of the match ends, false stops the scan */
+typedef bool (*scan_match_fn)(uint32_t pattern_index, size_t match_end, void* match_data);
+
+/* The signatures text: "[Category]" lines name the category of the next patterns, each other
+ * line is a pattern (\xNN and \\ escapes), blank lines and lines starting with '#' are ignored
+*/
+bool automaton_compile(const char* signatures, size_t signatures_size, scan_error_t* error, scan_automaton_t* automaton);
+
+bool automaton_save(const char* image_path, const scan_automaton_t* automaton);
+
+/* Maps an image saved by automaton_save, the file must be a trusted local cache */
+bool automaton_load(const char* image_path, scan_automaton_t* automaton);
+
+void automaton_release(scan_automaton_t* automaton);
+
+/* Matches ending at or before `report_from` aren't reported, they belong to the previous segment */
+bool automaton_scan(const uint8_t* data, size_t data_size, size_t report_from, scan_match_fn on_match, void* match_data,
+    const scan_automaton_t* automaton);
+
+const char* automaton_pattern(uint32_t pattern_index, size_t* pattern_length, const scan_automaton_t* automaton);
+
+const char* automaton_category(uint32_t pattern_index, const scan_automaton_t* automaton);
+
+#endif
@@ -0,0 +1,458 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "Scan_Engine.h"
+
+#define SCAN_PATH_MAX 4096
+
+/* Trackers, ads and proprietary services, by their DEX class prefixes and their hosts */
+static const char antifeatures_signatures[] =
+    "[Tracking]\n"
+    "Lcom/google/firebase/analytics/\n"
+    "Lcom/google/android/gms/analytics/\n"
+    "Lcom/google/android/gms/measurement/\n"
+    "Lcom/crashlytics/\n"
+    "Lcom/google/firebase/crashlytics/\n"
+    "Lcom/flurry/\n"
+    "Lio/sentry/\n"
+    "Lcom/bugsnag/\n"
+    "Lcom/adjust/sdk/\n"
+    "Lcom/appsflyer/\n"
+    "Lcom/mixpanel/\n"
+    "Lcom/amplitude/\n"
+    "Lcom/segment/analytics/\n"
+    "Lcom/facebook/appevents/\n"
+    "Lcom/microsoft/appcenter/\n"
+    "app-measurement.com\n"
+    "google-analytics.com\n"
+    "crashlytics.com\n"
+    "app.adjust.com\n"
+    "appsflyer.com\n"
+    "\n"
+    "[Ads]\n"
+    "Lcom/google/android/gms/ads/\n"
+    "Lcom/facebook/ads/\n"
+    "Lcom/unity3d/ads/\n"
+    "Lcom/applovin/\n"
+    "Lcom/mopub/\n"
+    "Lcom/inmobi/\n"
+    "Lcom/chartboost/\n"
+    "Lcom/ironsource/\n"
+    "Lcom/vungle/\n"
+    "Lcom/startapp/\n"
+    "doubleclick.net\n"
+    "googlesyndication.com\n"
+    "\n"
+    "[NonFreeNet]\n"
+    "Lcom/google/firebase/messaging/\n"
+    "Lcom/google/android/gms/gcm/\n"
+    "Lcom/onesignal/\n"
+    "\n"
+    "[NonFreeDep]\n"
+    "Lcom/google/android/gms/\n"
+    "Lcom/google/firebase/\n"
+    "Lcom/google/android/play/core/\n"
+    "Lcom/huawei/hms/\n";
+
+/* The scan of an archive, shared by all his tasks */
+struct scan_run
+{
+    const zip_archive_t* archive;
+
+    const scan_engine_t* engines;
+
+    size_t engines_count;
+
+    /* For each engine, the hits of each pattern and the first entry where it was found */
+    _Atomic uint32_t* pattern_hits[SCAN_ENGINES_MAX];
+
+    _Atomic size_t* first_entries[SCAN_ENGINES_MAX];
+
+    /* The longest pattern of all engines, the segments overlap by it */
+    size_t max_length;
+
+    tpool_group_t scan_group;
+
+    tpool_t* thread_pool;
+
+    atomic_bool run_failed;
+};
+
+/* An inflated entry, freed by the last of his segments */
+struct scan_entry
+{
+    struct scan_run* run;
+
+    size_t entry_index;
+
+    uint8_t* entry_data;
+
+    size_t entry_size;
+
+    atomic_size_t segments_left;
+};
+
+struct scan_segment
+{
+    struct scan_entry* entry;
+
+    size_t segment_begin;
+
+    size_t segment_end;
+};
+
+struct scan_match
+{
+    _Atomic uint32_t* pattern_hits;
+
+    _Atomic size_t* first_entries;
+
+    size_t entry_index;
+};
+
+static void engine_name_of(const char* engine_path, scan_engine_t* engine)
+{
+    const char* base_name = strrchr(engine_path, '/');
+    base_name = base_name != NULL ? base_name + 1 : engine_path;
+
+    /* "spyware.sig.dca" is the image of the engine "spyware" */
+    const char* extension = strchr(base_name + 1, '.');
+    int name_length = extension != NULL ? (int)(extension - base_name) : (int)strlen(base_name);
+
+    snprintf(engine->engine_name, sizeof(engine->engine_name), "%.*s", name_length, base_name);
+}
+
+static bool engine_has_suffix(const char* engine_path, const char* suffix)
+{
+    size_t path_length = strlen(engine_path);
+    size_t suffix_length = strlen(suffix);
+
+    return path_length > suffix_length && strcmp(engine_path + path_length - suffix_length, suffix) == 0;
+}
+
+static bool engine_compile_file(const char* signatures_path, output_buffer_t* error_output, scan_engine_t* engine)
+{
+    FILE* signatures_file = fopen(signatures_path, "rb");
+    if (signatures_file == NULL)
+    {
+        outbuf_format(error_output, "Can't open the engine %s\n", signatures_path);
+        return false;
+    }
+
+    output_buffer_t signatures;
+    char read_buffer[4096];
+    size_t read_size;
+
+    outbuf_init(sizeof(read_buffer), NULL, NULL, &signatures);
+    while ((read_size = fread(read_buffer, 1, sizeof(read_buffer), signatures_file)) != 0)
+    {
+        outbuf_append(read_buffer, read_size, &signatures);
+    }
+    fclose(signatures_file);
+
+    scan_error_t scan_error;
+    bool compile_ret = signatures.buffer_failed == false &&
+        automaton_compile(signatures.buffer_data, outbuf_length(&signatures), &scan_error, &engine->engine_automaton);
+
+    if (compile_ret == false)
+    {
+        outbuf_format(error_output, "%s:%zu: %s\n", signatures_path, scan_error.error_line, scan_error.error_message);
+    }
+    outbuf_deinit(&signatures);
+
+    return compile_ret;
+}
+
+bool engine_open(const char* engine_name, output_buffer_t* error_output, scan_engine_t* engine)
+{
+    memset(engine, 0, sizeof(*engine));
+
+    if (strcmp(engine_name, SCAN_ANTIFEATURES_ENGINE) == 0)
+    {
+        scan_error_t scan_error;
+
+        snprintf(engine->engine_name, sizeof(engine->engine_name), "%s", SCAN_ANTIFEATURES_ENGINE);
+        return automaton_compile(antifeatures_signatures, sizeof(antifeatures_signatures) - 1, &scan_error, &engine->engine_automaton);
+    }
+
+    char engine_path[SCAN_PATH_MAX];
+    struct stat engine_stat;
+
+    snprintf(engine_path, sizeof(engine_path), "%s", engine_name);
+    if (stat(engine_path, &engine_stat) != 0 && strchr(engine_name, '/') == NULL)
+    {
+        snprintf(engine_path, sizeof(engine_path), "%s/%s.sig", SCAN_ENGINES_DIR, engine_name);
+    }
+    engine_name_of(engine_path, engine);
+
+    if (engine_has_suffix(engine_path, ".dca"))
+    {
+        if (automaton_load(engine_path, &engine->engine_automaton) == false)
+        {
+            outbuf_format(error_output, "The engine %s isn't a valid image\n", engine_path);
+            return false;
+        }
+        return true;
+    }
+
+    if (stat(engine_path, &engine_stat) != 0)
+    {
+        outbuf_format(error_output, "Can't find the engine %s\n", engine_name);
+        return false;
+    }
+
+    char image_path[SCAN_PATH_MAX + 8];
+    struct stat image_stat;
+
+    snprintf(image_path, sizeof(image_path), "%s.dca", engine_path);
+
+    /* The image of the same generation of the signatures maps without any work */
+    if (stat(image_path, &image_stat) == 0 && (image_stat.st_mtim.tv_sec > engine_stat.st_mtim.tv_sec ||
+        (image_stat.st_mtim.tv_sec == engine_stat.st_mtim.tv_sec && image_stat.st_mtim.tv_nsec >= engine_stat.st_mtim.tv_nsec)) &&
+        automaton_load(image_path, &engine->engine_automaton))
+    {
+        return true;
+    }
+
+    if (engine_compile_file(engine_path, error_output, engine) == false)
+    {
+        return false;
+    }
+
+    /* A read only engines directory only costs the compilation at each run */
+    automaton_save(image_path, &engine->engine_automaton);
+
+    return true;
+}
+
+void engine_close(scan_engine_t* engine)
+{
+    automaton_release(&engine->engine_automaton);
+}
+
+static bool engine_is_scanned(const zip_entry_t* entry)
+{
+    const char* entry_name = entry->entry_name;
+    size_t name_length = strlen(entry_name);
+
+    if (zip_entry_is_dir(entry) || entry->uncompressed_size == 0)
+    {
+        return false;
+    }
+    return strcmp(entry_name, "resources.arsc") == 0 || (name_length > 4 && strcmp(entry_name + name_length - 4, ".dex") == 0) ||
+        (strncmp(entry_name, "lib/", 4) == 0 && name_length > 3 && strcmp(entry_name + name_length - 3, ".so") == 0);
+}
+
+static bool engine_on_match(uint32_t pattern_index, size_t match_end, void* match_data)
+{
+    struct scan_match* match = (struct scan_match*)match_data;
+    (void)match_end;
+
+    atomic_fetch_add_explicit(&match->pattern_hits[pattern_index], 1, memory_order_relaxed);
+
+    /* The lowest entry index wins, so the report doesn't depend on the scheduling */
+    size_t first_entry = atomic_load_explicit(&match->first_entries[pattern_index], memory_order_relaxed);
+    while (match->entry_index < first_entry &&
+        !atomic_compare_exchange_weak_explicit(&match->first_entries[pattern_index], &first_entry, match->entry_index,
+            memory_order_relaxed, memory_order_relaxed));
+
+    return true;
+}
+
+static void* engine_segment_task(void* task_data)
+{
+    struct scan_segment* segment = (struct scan_segment*)task_data;
+    struct scan_entry* entry = segment->entry;
+    struct scan_run* run = entry->run;
+
+    /* The overlap only completes the matches crossing the segment start */
+    size_t overlap = segment->segment_begin < run->max_length - 1 ? segment->segment_begin : run->max_length - 1;
+    const uint8_t* segment_data = entry->entry_data + segment->segment_begin - overlap;
+    size_t segment_size = segment->segment_end - segment->segment_begin + overlap;
+
+    for (size_t engine_cur = 0; engine_cur < run->engines_count; engine_cur++)
+    {
+        struct scan_match match = {
+            .pattern_hits = run->pattern_hits[engine_cur],
+            .first_entries = run->first_entries[engine_cur],
+            .entry_index = entry->entry_index
+        };
+        automaton_scan(segment_data, segment_size, overlap, engine_on_match, &match, &run->engines[engine_cur].engine_automaton);
+    }
+
+    if (atomic_fetch_sub(&entry->segments_left, 1) == 1)
+    {
+        free((void*)entry->entry_data);
+        free((void*)entry);
+    }
+    free((void*)segment);
+
+    return NULL;
+}
+
+/* Inflates the entry and submits his segments, the first one is scanned here */
+static void* engine_entry_task(void* task_data)
+{
+    struct scan_entry* entry = (struct scan_entry*)task_data;
+    struct scan_run* run = entry->run;
+    const zip_entry_t* zip_entry = &run->archive->entries[entry->entry_index];
+
+    entry->entry_size = zip_entry->uncompressed_size;
+    entry->entry_data = malloc(entry->entry_size);
+
+    if (entry->entry_data == NULL || zip_entry_inflate(zip_entry, entry->entry_data, run->archive) == false)
+    {
+        atomic_store(&run->run_failed, true);
+        free((void*)entry->entry_data);
+        free((void*)entry);
+        return NULL;
+    }
+
+    size_t segments_count = (entry->entry_size + SCAN_SEGMENT_SIZE - 1) / SCAN_SEGMENT_SIZE;
+    atomic_store(&entry->segments_left, segments_count);
+
+    for (size_t segment_cur = segments_count; segment_cur-- > 0; )
+    {
+        struct scan_segment* segment = malloc(sizeof(*segment));
+        if (segment == NULL)
+        {
+            atomic_store(&run->run_failed, true);
+            if (atomic_fetch_sub(&entry->segments_left, 1) == 1)
+            {
+                free((void*)entry->entry_data);
+                free((void*)entry);
+            }
+            continue;
+        }
+
+        segment->entry = entry;
+        segment->segment_begin = segment_cur * SCAN_SEGMENT_SIZE;
+        segment->segment_end = segment_cur + 1 == segments_count ? entry->entry_size : (segment_cur + 1) * SCAN_SEGMENT_SIZE;
+
+        /* The entry may be freed by the last segment, it must not be touched after this */
+        if (segment_cur == 0 || tpool_group_execute(engine_segment_task, segment, &run->scan_group, run->thread_pool) == false)
+        {
+            engine_segment_task(segment);
+        }
+    }
+
+    return NULL;
+}
+
+static void engine_report(const char* input_path, const scan_engine_t* engine, size_t engine_index, const struct scan_run* run,
+    output_buffer_t* report_output)
+{
+    const scan_automaton_t* automaton = &engine->engine_automaton;
+    size_t patterns_found = 0;
+
+    for (uint32_t pattern_cur = 0; pattern_cur < automaton->patterns_count; pattern_cur++)
+    {
+        uint32_t pattern_hits = run->pattern_hits[engine_index][pattern_cur];
+        if (pattern_hits == 0)
+        {
+            continue;
+        }
+
+        size_t pattern_length;
+        const char* pattern = automaton_pattern(pattern_cur, &pattern_length, automaton);
+        const zip_entry_t* first_entry = &run->archive->entries[run->first_entries[engine_index][pattern_cur]];
+
+        /* Patterns with binary bytes are written escaped as in the signatures */
+        outbuf_format(report_output, "%s: %s [%s] ", input_path, engine->engine_name, automaton_category(pattern_cur, automaton));
+        for (size_t byte_cur = 0; byte_cur < pattern_length; byte_cur++)
+        {
+            uint8_t pattern_byte = (uint8_t)pattern[byte_cur];
+
+            if (pattern_byte < 0x20 || pattern_byte >= 0x7f || pattern_byte == '\\')
+            {
+                outbuf_format(report_output, pattern_byte == '\\' ? "\\\\" : "\\x%02x", pattern_byte);
+            }
+            else
+            {
+                outbuf_putc((char)pattern_byte, report_output);
+            }
+        }
+        outbuf_format(report_output, ", %u hits, first in %s\n", pattern_hits, first_entry->entry_name);
+        patterns_found++;
+    }
+
+    if (patterns_found == 0)
+    {
+        outbuf_format(report_output, "%s: %s found nothing\n", input_path, engine->engine_name);
+    }
+}
+
+bool engine_scan_archive(const char* input_path, const zip_archive_t* archive, const scan_engine_t* engines, size_t engines_count,
+    output_buffer_t* report_output, tpool_t* thread_pool)
+{
+    struct scan_run run = {
+        .archive = archive,
+        .engines = engines,
+        .engines_count = engines_count < SCAN_ENGINES_MAX ? engines_count : SCAN_ENGINES_MAX,
+        .max_length = 1,
+        .thread_pool = thread_pool
+    };
+    bool scan_ret = true;
+
+    for (size_t engine_cur = 0; engine_cur < run.engines_count; engine_cur++)
+    {
+        const scan_automaton_t* automaton = &engines[engine_cur].engine_automaton;
+
+        run.pattern_hits[engine_cur] = calloc(automaton->patterns_count, sizeof(_Atomic uint32_t));
+        run.first_entries[engine_cur] = malloc(automaton->patterns_count * sizeof(_Atomic size_t));
+        scan_ret &= run.pattern_hits[engine_cur] != NULL && run.first_entries[engine_cur] != NULL;
+
+        for (uint32_t pattern_cur = 0; scan_ret && pattern_cur < automaton->patterns_count; pattern_cur++)
+        {
+            atomic_init(&run.first_entries[engine_cur][pattern_cur], SIZE_MAX);
+        }
+        if (automaton->max_length > run.max_length)
+        {
+            run.max_length = automaton->max_length;
+        }
+    }
+
+    tpool_group_init(&run.scan_group);
+
+    for (size_t entry_cur = 0; scan_ret && entry_cur < archive->entries_count; entry_cur++)
+    {
+        if (engine_is_scanned(&archive->entries[entry_cur]) == false)
+        {
+            continue;
+        }
+
+        struct scan_entry* entry = calloc(1, sizeof(*entry));
+        if (entry == NULL)
+        {
+            scan_ret = false;
+            break;
+        }
+        entry->run = &run;
+        entry->entry_index = entry_cur;
+
+        if (tpool_group_execute(engine_entry_task, entry, &run.scan_group, thread_pool) == false)
+        {
+            engine_entry_task(entry);
+        }
+    }
+
+    tpool_group_wait(&run.scan_group, thread_pool);
+    tpool_group_destroy(&run.scan_group);
+
+    scan_ret &= atomic_load(&run.run_failed) == false;
+
+    for (size_t engine_cur = 0; engine_cur < run.engines_count; engine_cur++)
+    {
+        if (scan_ret)
+        {
+            engine_report(input_path, &engines[engine_cur], engine_cur, &run, report_output);
+        }
+        free((void*)run.pattern_hits[engine_cur]);
+        free((void*)run.first_entries[engine_cur]);
+    }
+
+    return scan_ret;
+}
@@ -0,0 +1,45 @@
+#ifndef SCAN_SCAN_ENGINE_H
+#define SCAN_SCAN_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Thread_Pool.h"
+#include "data/Output_Buffer.h"
+#include "zip/Zip_Archive.h"
+#include "scan/Pattern_Automaton.h"
+
+/* Engines named without a path are searched here, as "<name>.sig" */
+#define SCAN_ENGINES_DIR "engines"
+
+/* -test-for-antifeatures uses this engine, built into droidcat */
+#define SCAN_ANTIFEATURES_ENGINE "antifeatures"
+
+#define SCAN_ENGINES_MAX 8
+
+/* Big entries are split into segments scanned by different workers */
+#define SCAN_SEGMENT_SIZE (1024 * 1024)
+
+typedef struct scan_engine
+{
+    char engine_name[64];
+
+    scan_automaton_t engine_automaton;
+
+} scan_engine_t;
+
+/* `engine_name` is the builtin engine, a .dca image, a .sig signatures file or the name of
+ * a file in SCAN_ENGINES_DIR. A .sig is compiled once, the image is saved beside him as
+ * "<file>.dca" and mapped while it's newer than the signatures. Errors go to `error_output`
+*/
+bool engine_open(const char* engine_name, output_buffer_t* error_output, scan_engine_t* engine);
+void engine_close(scan_engine_t* engine);
+
+/* Scans the DEX files, the native libraries and the resource table of the archive with all
+ * engines, the entries are inflated and scanned by the pool workers. Writes a line by found
+ * pattern into `report_output`, returns false when an entry can't be read
+*/
+bool engine_scan_archive(const char* input_path, const zip_archive_t* archive, const scan_engine_t* engines, size_t engines_count,
+    output_buffer_t* report_output, tpool_t* thread_pool);
+
+#endif
@@ -0,0 +1,429 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+
+#include "Dsc_Compiler.h"
+#include "data/Content_Hash.h"
+
+#define DSC_ARENA_BLOCK (16 * 1024)
+
+struct dsc_compiler
+{
+    dsc_program_t* program;
+
+    size_t code_capacity;
+
+    size_t constants_capacity;
+
+    size_t slots_capacity;
+
+    size_t line_number;
+
+    dsc_error_t* error;
+};
+
+static uint64_t dsc_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static bool dsc_compile_error(const char* message, const char* name, struct dsc_compiler* compiler)
+{
+    compiler->error->error_line = compiler->line_number;
+    snprintf(compiler->error->error_message, sizeof(compiler->error->error_message), message, name);
+
+    return false;
+}
+
+static bool dsc_grow(void** array, size_t element_size, size_t needed, size_t* capacity)
+{
+    if (needed <= *capacity)
+    {
+        return true;
+    }
+
+    size_t new_capacity = *capacity != 0 ? *capacity * 2 : 16;
+    void* new_array = realloc(*array, new_capacity * element_size);
+    if (new_array == NULL)
+    {
+        return false;
+    }
+
+    *array = new_array;
+    *capacity = new_capacity;
+    return true;
+}
+
+/* Returns the index of the emitted instruction */
+static size_t dsc_emit(uint8_t op_code, uint8_t op_flags, uint16_t op_extra, uint32_t op_operand, struct dsc_compiler* compiler)
+{
+    dsc_program_t* program = compiler->program;
+    size_t code_capacity = compiler->code_capacity;
+    size_t lines_capacity = compiler->code_capacity;
+
+    /* Both arrays grow to the same capacity, it's kept only when both reallocs have succeeded */
+    if (dsc_grow((void**)&program->program_code, sizeof(dsc_instruction_t), program->code_count + 1, &code_capacity) == false ||
+        dsc_grow((void**)&program->code_lines, sizeof(uint32_t), program->code_count + 1, &lines_capacity) == false)
+    {
+        return SIZE_MAX;
+    }
+    compiler->code_capacity = code_capacity;
+
+    program->program_code[program->code_count] = (dsc_instruction_t){
+        .op_code = op_code, .op_flags = op_flags, .op_extra = op_extra, .op_operand = op_operand
+    };
+    program->code_lines[program->code_count] = (uint32_t)compiler->line_number;
+
+    return program->code_count++;
+}
+
+static size_t dsc_constant(const char* text, struct dsc_compiler* compiler)
+{
+    dsc_program_t* program = compiler->program;
+
+    for (size_t constant_cur = 0; constant_cur < program->constants_count; constant_cur++)
+    {
+        if (strcmp(program->program_constants[constant_cur], text) == 0)
+        {
+            return constant_cur;
+        }
+    }
+
+    if (program->constants_count >= UINT16_MAX - 1 ||
+        dsc_grow((void**)&program->program_constants, sizeof(char*), program->constants_count + 1, &compiler->constants_capacity) == false)
+    {
+        return SIZE_MAX;
+    }
+
+    /* The texts are inside the program arena already */
+    program->program_constants[program->constants_count] = text;
+    return program->constants_count++;
+}
+
+static size_t dsc_find_slot(const char* name, const dsc_program_t* program)
+{
+    for (size_t slot_cur = 0; slot_cur < program->slots_count; slot_cur++)
+    {
+        if (strcmp(program->slot_names[slot_cur], name) == 0)
+        {
+            return slot_cur;
+        }
+    }
+    return SIZE_MAX;
+}
+
+static size_t dsc_define_slot(const char* name, struct dsc_compiler* compiler)
+{
+    dsc_program_t* program = compiler->program;
+    size_t slot_index = dsc_find_slot(name, program);
+
+    if (slot_index != SIZE_MAX)
+    {
+        return slot_index;
+    }
+    if (dsc_grow((void**)&program->slot_names, sizeof(char*), program->slots_count + 1, &compiler->slots_capacity) == false)
+    {
+        return SIZE_MAX;
+    }
+
+    program->slot_names[program->slots_count] = name;
+    return program->slots_count++;
+}
+
+static bool dsc_compile_word(const dsc_word_t* word, struct dsc_compiler* compiler)
+{
+    dsc_program_t* program = compiler->program;
+    const dsc_host_t* host = program->program_host;
+
+    for (const dsc_part_t* part = word->word_parts; part != NULL; part = part->part_next)
+    {
+        if (part->part_type == DSC_PART_TEXT)
+        {
+            size_t constant_index = dsc_constant(part->part_text, compiler);
+            if (constant_index == SIZE_MAX || dsc_emit(DSC_OP_TEXT, 0, 0, (uint32_t)constant_index, compiler) == SIZE_MAX)
+            {
+                return dsc_compile_error("out of memory", NULL, compiler);
+            }
+            continue;
+        }
+
+        /* Script variables hides the builtins with the same name */
+        size_t slot_index = dsc_find_slot(part->part_text, program);
+        if (slot_index != SIZE_MAX)
+        {
+            if (part->part_qualifier != NULL)
+            {
+                return dsc_compile_error("$%s is a script variable, only builtins accept qualifiers", part->part_text, compiler);
+            }
+            if (dsc_emit(DSC_OP_LOAD, 0, 0, (uint32_t)slot_index, compiler) == SIZE_MAX)
+            {
+                return dsc_compile_error("out of memory", NULL, compiler);
+            }
+            continue;
+        }
+
+        size_t builtin_index = 0;
+        while (builtin_index < host->builtins_count && strcmp(host->host_builtins[builtin_index].builtin_name, part->part_text) != 0)
+        {
+            builtin_index++;
+        }
+        if (builtin_index == host->builtins_count)
+        {
+            return dsc_compile_error("undefined variable $%s", part->part_text, compiler);
+        }
+
+        uint16_t qualifier_extra = 0;
+        if (part->part_qualifier != NULL)
+        {
+            size_t qualifier_index = dsc_constant(part->part_qualifier, compiler);
+            qualifier_extra = qualifier_index != SIZE_MAX ? (uint16_t)(qualifier_index + 1) : 0;
+        }
+        if ((part->part_qualifier != NULL && qualifier_extra == 0) ||
+            dsc_emit(DSC_OP_BUILTIN, 0, qualifier_extra, (uint32_t)builtin_index, compiler) == SIZE_MAX)
+        {
+            return dsc_compile_error("out of memory", NULL, compiler);
+        }
+    }
+
+    if (dsc_emit(DSC_OP_WORD, word->word_glob ? DSC_WORD_GLOB : 0, 0, 0, compiler) == SIZE_MAX)
+    {
+        return dsc_compile_error("out of memory", NULL, compiler);
+    }
+    return true;
+}
+
+static bool dsc_compile_nodes(const dsc_node_t* node, struct dsc_compiler* compiler)
+{
+    dsc_program_t* program = compiler->program;
+    const dsc_host_t* host = program->program_host;
+
+    for (; node != NULL; node = node->node_next)
+    {
+        compiler->line_number = node->node_line;
+
+        for (const dsc_word_t* word = node->node_words; word != NULL; word = word->word_next)
+        {
+            if (dsc_compile_word(word, compiler) == false)
+            {
+                return false;
+            }
+        }
+
+        if (node->node_type == DSC_NODE_ASSIGN)
+        {
+            size_t slot_index = dsc_define_slot(node->node_name, compiler);
+            if (slot_index == SIZE_MAX || dsc_emit(DSC_OP_STORE, 0, 0, (uint32_t)slot_index, compiler) == SIZE_MAX)
+            {
+                return dsc_compile_error("out of memory", NULL, compiler);
+            }
+            continue;
+        }
+
+        if (node->node_type == DSC_NODE_DIRECTIVE)
+        {
+            size_t directive_index = 0;
+            while (directive_index < host->directives_count &&
+                strcmp(host->host_directives[directive_index].directive_name, node->node_name) != 0)
+            {
+                directive_index++;
+            }
+
+            if (directive_index == host->directives_count)
+            {
+                return dsc_compile_error("unknown directive %%%s%%", node->node_name, compiler);
+            }
+            if (node->words_count > UINT16_MAX)
+            {
+                return dsc_compile_error("too many arguments for %%%s%%", node->node_name, compiler);
+            }
+            if (dsc_emit(DSC_OP_CALL, 0, (uint16_t)node->words_count, (uint32_t)directive_index, compiler) == SIZE_MAX)
+            {
+                return dsc_compile_error("out of memory", NULL, compiler);
+            }
+            continue;
+        }
+
+        /* The if nodes, the jumps are patched when the targets are known */
+        size_t jump_else = SIZE_MAX;
+        if (dsc_emit(DSC_OP_EXIST, node->node_negated ? DSC_EXIST_NEGATED : 0, 0, 0, compiler) == SIZE_MAX ||
+            (jump_else = dsc_emit(DSC_OP_JUMP_FALSE, 0, 0, 0, compiler)) == SIZE_MAX)
+        {
+            return dsc_compile_error("out of memory", NULL, compiler);
+        }
+
+        if (dsc_compile_nodes(node->node_then, compiler) == false)
+        {
+            return false;
+        }
+
+        if (node->node_else != NULL)
+        {
+            size_t jump_end = dsc_emit(DSC_OP_JUMP, 0, 0, 0, compiler);
+            if (jump_end == SIZE_MAX)
+            {
+                return dsc_compile_error("out of memory", NULL, compiler);
+            }
+
+            program->program_code[jump_else].op_operand = (uint32_t)program->code_count;
+            if (dsc_compile_nodes(node->node_else, compiler) == false)
+            {
+                return false;
+            }
+            program->program_code[jump_end].op_operand = (uint32_t)program->code_count;
+        }
+        else
+        {
+            program->program_code[jump_else].op_operand = (uint32_t)program->code_count;
+        }
+    }
+
+    return true;
+}
+
+void dsc_program_free(dsc_program_t* program)
+{
+    if (program == NULL)
+    {
+        return;
+    }
+
+    free((void*)program->program_code);
+    free((void*)program->code_lines);
+    free((void*)program->program_constants);
+    free((void*)program->slot_names);
+    free((void*)program->program_source);
+
+    if (program->program_arena != NULL)
+    {
+        arena_destroy(program->program_arena);
+    }
+    free((void*)program);
+}
+
+dsc_program_t* dsc_compile(const char* source, size_t source_size, const dsc_host_t* host, dsc_error_t* error)
+{
+    uint64_t compile_begin = dsc_monotonic_nanos();
+    dsc_program_t* program = calloc(1, sizeof(dsc_program_t));
+
+    memset(error, 0, sizeof(*error));
+
+    if (program == NULL || (program->program_arena = arena_create(DSC_ARENA_BLOCK)) == NULL)
+    {
+        snprintf(error->error_message, sizeof(error->error_message), "out of memory");
+        dsc_program_free(program);
+        return NULL;
+    }
+    program->program_host = host;
+
+    /* The tree lives with the program, the constants and slot names points into it */
+    dsc_node_t* script_nodes;
+    if (dsc_parse(source, source_size, &script_nodes, error, program->program_arena) == false)
+    {
+        dsc_program_free(program);
+        return NULL;
+    }
+
+    struct dsc_compiler compiler = { .program = program, .error = error };
+
+    if (dsc_compile_nodes(script_nodes, &compiler) == false)
+    {
+        dsc_program_free(program);
+        return NULL;
+    }
+
+    compiler.line_number = 0;
+    if (dsc_emit(DSC_OP_END, 0, 0, 0, &compiler) == SIZE_MAX)
+    {
+        dsc_program_free(program);
+        return NULL;
+    }
+
+    program->compile_nanos = dsc_monotonic_nanos() - compile_begin;
+
+    return program;
+}
+
+bool dsc_cache_init(dsc_cache_t* cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    return pthread_mutex_init(&cache->cache_lock, NULL) == 0;
+}
+
+void dsc_cache_deinit(dsc_cache_t* cache)
+{
+    while (cache->cache_programs != NULL)
+    {
+        dsc_program_t* program_next = cache->cache_programs->program_next;
+        dsc_program_free(cache->cache_programs);
+        cache->cache_programs = program_next;
+    }
+    pthread_mutex_destroy(&cache->cache_lock);
+}
+
+static dsc_program_t* dsc_cache_find(uint64_t source_hash, const char* source, size_t source_size, const dsc_host_t* host,
+    dsc_cache_t* cache)
+{
+    for (dsc_program_t* program = cache->cache_programs; program != NULL; program = program->program_next)
+    {
+        if (program->source_hash == source_hash && program->source_size == source_size && program->program_host == host &&
+            memcmp(program->program_source, source, source_size) == 0)
+        {
+            return program;
+        }
+    }
+    return NULL;
+}
+
+dsc_program_t* dsc_compile_cached(const char* source, size_t source_size, const dsc_host_t* host, dsc_error_t* error, dsc_cache_t* cache)
+{
+    uint64_t source_hash = hash_content64(source, source_size, 0);
+
+    pthread_mutex_lock(&cache->cache_lock);
+    dsc_program_t* program = dsc_cache_find(source_hash, source, source_size, host, cache);
+    pthread_mutex_unlock(&cache->cache_lock);
+
+    if (program != NULL)
+    {
+        cache->cache_hits++;
+        memset(error, 0, sizeof(*error));
+        return program;
+    }
+
+    /* Compiled without the lock, another thread may compile the same script meanwhile */
+    program = dsc_compile(source, source_size, host, error);
+    if (program == NULL)
+    {
+        return NULL;
+    }
+
+    program->source_hash = source_hash;
+    program->source_size = source_size;
+    program->program_source = malloc(source_size + 1);
+    if (program->program_source == NULL)
+    {
+        dsc_program_free(program);
+        return NULL;
+    }
+    memcpy(program->program_source, source, source_size);
+    program->program_source[source_size] = '\0';
+
+    pthread_mutex_lock(&cache->cache_lock);
+    dsc_program_t* cached_program = dsc_cache_find(source_hash, source, source_size, host, cache);
+    if (cached_program == NULL)
+    {
+        program->program_next = cache->cache_programs;
+        cache->cache_programs = program;
+    }
+    pthread_mutex_unlock(&cache->cache_lock);
+
+    if (cached_program != NULL)
+    {
+        dsc_program_free(program);
+        return cached_program;
+    }
+    return program;
+}
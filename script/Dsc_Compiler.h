@@ -0,0 +1,169 @@
+#ifndef SCRIPT_DSC_COMPILER_H
+#define SCRIPT_DSC_COMPILER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "Dsc_Parser.h"
+
+/* What the script can call, names are resolved into indexes at compile time. The `run_data`
+ * is given by the caller of each execution
+*/
+typedef bool (*dsc_directive_fn)(size_t args_count, char* const* args, void* run_data);
+/* Writes the value of a builtin variable ($input, $output:1...) */
+typedef bool (*dsc_builtin_fn)(const char* qualifier, char* value, size_t value_size, void* run_data);
+
+typedef bool (*dsc_match_fn)(const char* matched_path, void* match_data);
+/* Calls `on_match` for each path matching the pattern, in a stable order */
+typedef bool (*dsc_glob_fn)(const char* pattern, dsc_match_fn on_match, void* match_data, void* run_data);
+typedef bool (*dsc_exist_fn)(const char* path, void* run_data);
+/* Returns the size of a file, used for group the tiny files of a fan out */
+typedef size_t (*dsc_size_fn)(const char* path, void* run_data);
+
+typedef struct dsc_directive
+{
+    const char* directive_name;
+
+    dsc_directive_fn directive_call;
+
+    /* A fan out directive takes `fixed_args` arguments followed by files, each file is
+     * independent from the others, so the VM calls the directive once by file (or by group
+     * of tiny files) in parallel. It must only read the files and write `<file><output_suffix>`,
+     * this is how the VM knows which later lines depends on it
+    */
+    bool directive_fanout;
+
+    size_t fixed_args;
+
+    const char* output_suffix;
+
+} dsc_directive_t;
+
+typedef struct dsc_builtin
+{
+    const char* builtin_name;
+
+    dsc_builtin_fn builtin_value;
+
+} dsc_builtin_t;
+
+typedef struct dsc_host
+{
+    const dsc_directive_t* host_directives;
+
+    size_t directives_count;
+
+    const dsc_builtin_t* host_builtins;
+
+    size_t builtins_count;
+
+    /* Both fallback to the host filesystem when NULL */
+    dsc_glob_fn host_glob;
+
+    dsc_exist_fn host_exist;
+
+    /* Fallbacks to stat when NULL */
+    dsc_size_fn host_size;
+
+} dsc_host_t;
+
+typedef enum
+{
+    /* Appends a constant into the current word */
+    DSC_OP_TEXT,
+    /* Appends a variable slot */
+    DSC_OP_LOAD,
+    /* Appends a builtin, the qualifier constant is in op_extra (plus 1, 0 for none) */
+    DSC_OP_BUILTIN,
+    /* Finishes the current word and pushes it, op_flags has DSC_WORD_GLOB */
+    DSC_OP_WORD,
+    /* Pops a word into a variable slot */
+    DSC_OP_STORE,
+    /* Pops op_extra words (globs expanded) and calls the directive */
+    DSC_OP_CALL,
+    /* Pops a path and sets the condition, op_flags has DSC_EXIST_NEGATED */
+    DSC_OP_EXIST,
+    DSC_OP_JUMP_FALSE,
+    DSC_OP_JUMP,
+    DSC_OP_END
+} dsc_opcode_e;
+
+#define DSC_WORD_GLOB 0x01
+#define DSC_EXIST_NEGATED 0x01
+
+typedef struct dsc_instruction
+{
+    uint8_t op_code;
+
+    uint8_t op_flags;
+
+    uint16_t op_extra;
+
+    uint32_t op_operand;
+
+} dsc_instruction_t;
+
+typedef struct dsc_program
+{
+    dsc_instruction_t* program_code;
+
+    /* The script line of each instruction, for the runtime errors */
+    uint32_t* code_lines;
+
+    size_t code_count;
+
+    const char** program_constants;
+
+    size_t constants_count;
+
+    /* Only for the error messages */
+    const char** slot_names;
+
+    size_t slots_count;
+
+    const dsc_host_t* program_host;
+
+    /* The parse and compile time, and the executions stats */
+    uint64_t compile_nanos;
+
+    _Atomic uint64_t runs_count;
+
+    _Atomic uint64_t runs_nanos;
+
+    _Atomic uint64_t fanout_tasks;
+
+    /* Used by the program cache */
+    uint64_t source_hash;
+
+    char* program_source;
+
+    size_t source_size;
+
+    struct dsc_program* program_next;
+
+    memory_arena_t* program_arena;
+
+} dsc_program_t;
+
+/* Scripts compiled once, shared by all inputs and the daemon requests */
+typedef struct dsc_cache
+{
+    pthread_mutex_t cache_lock;
+
+    dsc_program_t* cache_programs;
+
+    _Atomic size_t cache_hits;
+
+} dsc_cache_t;
+
+dsc_program_t* dsc_compile(const char* source, size_t source_size, const dsc_host_t* host, dsc_error_t* error);
+void dsc_program_free(dsc_program_t* program);
+
+bool dsc_cache_init(dsc_cache_t* cache);
+void dsc_cache_deinit(dsc_cache_t* cache);
+/* The program is owned by the cache */
+dsc_program_t* dsc_compile_cached(const char* source, size_t source_size, const dsc_host_t* host, dsc_error_t* error, dsc_cache_t* cache);
+
+#endif
+
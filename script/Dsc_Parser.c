@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "Dsc_Parser.h"
+
+/* Nested if blocks */
+#define DSC_MAX_DEPTH 32
+
+struct dsc_parser
+{
+    size_t line_number;
+
+    dsc_error_t* error;
+
+    memory_arena_t* arena;
+};
+
+struct dsc_block
+{
+    dsc_node_t* block_if;
+
+    /* Where the next node of this block is linked */
+    dsc_node_t** block_tail;
+
+    bool block_in_else;
+};
+
+__attribute__((format(printf, 2, 3)))
+static bool dsc_fail(struct dsc_parser* parser, const char* format, ...)
+{
+    va_list format_args;
+
+    parser->error->error_line = parser->line_number;
+
+    va_start(format_args, format);
+    vsnprintf(parser->error->error_message, sizeof(parser->error->error_message), format, format_args);
+    va_end(format_args);
+
+    return false;
+}
+
+static bool dsc_is_name(char character)
+{
+    return isalnum((unsigned char)character) || character == '_';
+}
+
+static bool dsc_is_qualifier(char character)
+{
+    return dsc_is_name(character) || character == '.' || character == '-';
+}
+
+static bool dsc_keyword(const char* text, size_t length, const char* keyword, size_t* keyword_end)
+{
+    size_t keyword_length = strlen(keyword);
+
+    if (length < keyword_length || strncmp(text, keyword, keyword_length) != 0)
+    {
+        return false;
+    }
+    if (length > keyword_length && isspace((unsigned char)text[keyword_length]) == 0)
+    {
+        return false;
+    }
+
+    *keyword_end = keyword_length;
+    while (*keyword_end < length && isspace((unsigned char)text[*keyword_end]))
+    {
+        (*keyword_end)++;
+    }
+    return true;
+}
+
+static dsc_part_t* dsc_new_part(dsc_part_e part_type, const char* text, size_t text_length, struct dsc_parser* parser)
+{
+    dsc_part_t* part = arena_alloc(sizeof(dsc_part_t), parser->arena);
+    if (part == NULL)
+    {
+        return NULL;
+    }
+
+    part->part_type = part_type;
+    part->part_text = arena_strndup(text, text_length, parser->arena);
+    part->part_qualifier = NULL;
+    part->part_next = NULL;
+
+    return part->part_text != NULL ? part : NULL;
+}
+
+/* Splits a word into literal texts and variable references */
+static dsc_word_t* dsc_parse_word(const char* text, size_t length, struct dsc_parser* parser)
+{
+    dsc_word_t* word = arena_alloc(sizeof(dsc_word_t), parser->arena);
+    if (word == NULL)
+    {
+        return NULL;
+    }
+    memset(word, 0, sizeof(*word));
+
+    dsc_part_t** part_tail = &word->word_parts;
+    size_t literal_begin = 0;
+
+    for (size_t char_cur = 0; char_cur <= length; )
+    {
+        bool is_variable = char_cur < length && text[char_cur] == '$' && char_cur + 1 < length &&
+            (dsc_is_name(text[char_cur + 1]) || text[char_cur + 1] == '{');
+
+        if (char_cur < length && is_variable == false)
+        {
+            if (text[char_cur] == '*' || text[char_cur] == '?' || text[char_cur] == '[')
+            {
+                word->word_glob = true;
+            }
+            char_cur++;
+            continue;
+        }
+
+        if (char_cur > literal_begin)
+        {
+            if ((*part_tail = dsc_new_part(DSC_PART_TEXT, text + literal_begin, char_cur - literal_begin, parser)) == NULL)
+            {
+                return NULL;
+            }
+            part_tail = &(*part_tail)->part_next;
+        }
+        if (char_cur == length)
+        {
+            break;
+        }
+
+        /* A variable reference, "$name", "${name}" and both with ":qualifier" */
+        size_t name_begin = char_cur + 1;
+        size_t name_end;
+        bool name_braced = text[name_begin] == '{';
+
+        if (name_braced)
+        {
+            name_begin++;
+            for (name_end = name_begin; name_end < length && text[name_end] != '}'; name_end++);
+            if (name_end == length || name_end == name_begin)
+            {
+                dsc_fail(parser, "unterminated variable reference");
+                return NULL;
+            }
+        }
+        else
+        {
+            for (name_end = name_begin; name_end < length && dsc_is_name(text[name_end]); name_end++);
+        }
+
+        dsc_part_t* variable = dsc_new_part(DSC_PART_VARIABLE, text + name_begin, name_end - name_begin, parser);
+        if (variable == NULL)
+        {
+            return NULL;
+        }
+        char_cur = name_end + (name_braced ? 1 : 0);
+
+        if (char_cur + 1 < length && text[char_cur] == ':' && dsc_is_qualifier(text[char_cur + 1]))
+        {
+            size_t qualifier_begin = ++char_cur;
+            while (char_cur < length && dsc_is_qualifier(text[char_cur]))
+            {
+                char_cur++;
+            }
+            variable->part_qualifier = arena_strndup(text + qualifier_begin, char_cur - qualifier_begin, parser->arena);
+        }
+
+        *part_tail = variable;
+        part_tail = &variable->part_next;
+        literal_begin = char_cur;
+    }
+
+    return word;
+}
+
+/* Removes the quotes around a whole value */
+static void dsc_unquote(const char** text, size_t* length)
+{
+    if (*length >= 2 && (*text)[0] == '"' && (*text)[*length - 1] == '"')
+    {
+        (*text)++;
+        *length -= 2;
+    }
+}
+
+/* Arguments are separated by spaces, quoted arguments can have spaces */
+static bool dsc_parse_words(const char* text, size_t length, dsc_node_t* node, struct dsc_parser* parser)
+{
+    dsc_word_t** word_tail = &node->node_words;
+
+    for (size_t char_cur = 0; char_cur < length; )
+    {
+        if (isspace((unsigned char)text[char_cur]))
+        {
+            char_cur++;
+            continue;
+        }
+
+        size_t word_begin = char_cur;
+        size_t word_end;
+
+        if (text[char_cur] == '"')
+        {
+            word_begin++;
+            for (word_end = word_begin; word_end < length && text[word_end] != '"'; word_end++);
+            if (word_end == length)
+            {
+                return dsc_fail(parser, "unterminated quoted argument");
+            }
+            char_cur = word_end + 1;
+        }
+        else
+        {
+            for (word_end = word_begin; word_end < length && isspace((unsigned char)text[word_end]) == 0; word_end++);
+            char_cur = word_end;
+        }
+
+        if ((*word_tail = dsc_parse_word(text + word_begin, word_end - word_begin, parser)) == NULL)
+        {
+            return false;
+        }
+        word_tail = &(*word_tail)->word_next;
+        node->words_count++;
+    }
+
+    return true;
+}
+
+static dsc_node_t* dsc_new_node(dsc_node_e node_type, struct dsc_parser* parser)
+{
+    dsc_node_t* node = arena_alloc(sizeof(dsc_node_t), parser->arena);
+    if (node != NULL)
+    {
+        memset(node, 0, sizeof(*node));
+        node->node_type = node_type;
+        node->node_line = parser->line_number;
+    }
+    return node;
+}
+
+/* "if [not] exist <path> then:" */
+static dsc_node_t* dsc_parse_if(const char* text, size_t length, struct dsc_parser* parser)
+{
+    dsc_node_t* node = dsc_new_node(DSC_NODE_IF, parser);
+    size_t keyword_end;
+
+    if (node == NULL)
+    {
+        return NULL;
+    }
+
+    if (dsc_keyword(text, length, "not", &keyword_end))
+    {
+        node->node_negated = true;
+        text += keyword_end;
+        length -= keyword_end;
+    }
+    if (dsc_keyword(text, length, "exist", &keyword_end) == false)
+    {
+        dsc_fail(parser, "only \"if [not] exist <path> then:\" conditions are supported");
+        return NULL;
+    }
+    text += keyword_end;
+    length -= keyword_end;
+
+    if (length < 5 || strncmp(text + length - 5, "then:", 5) != 0)
+    {
+        dsc_fail(parser, "expected \"then:\" at the end of the condition");
+        return NULL;
+    }
+    length -= 5;
+    while (length != 0 && isspace((unsigned char)text[length - 1]))
+    {
+        length--;
+    }
+    dsc_unquote(&text, &length);
+
+    if (length == 0)
+    {
+        dsc_fail(parser, "the condition has no path");
+        return NULL;
+    }
+
+    node->node_words = dsc_parse_word(text, length, parser);
+    node->words_count = 1;
+
+    return node->node_words != NULL ? node : NULL;
+}
+
+static dsc_node_t* dsc_parse_directive(const char* text, size_t length, struct dsc_parser* parser)
+{
+    const char* name_end = memchr(text + 1, '%', length - 1);
+    if (name_end == NULL || name_end == text + 1)
+    {
+        dsc_fail(parser, "malformed directive, expected %%name%%");
+        return NULL;
+    }
+
+    dsc_node_t* node = dsc_new_node(DSC_NODE_DIRECTIVE, parser);
+    if (node == NULL || (node->node_name = arena_strndup(text + 1, (size_t)(name_end - text - 1), parser->arena)) == NULL)
+    {
+        return NULL;
+    }
+
+    size_t arguments_begin = (size_t)(name_end - text) + 1;
+    if (dsc_parse_words(text + arguments_begin, length - arguments_begin, node, parser) == false)
+    {
+        return NULL;
+    }
+    return node;
+}
+
+static dsc_node_t* dsc_parse_assign(const char* text, size_t length, struct dsc_parser* parser)
+{
+    size_t name_end = 0;
+    while (name_end < length && dsc_is_name(text[name_end]))
+    {
+        name_end++;
+    }
+
+    size_t value_begin = name_end;
+    while (value_begin < length && isspace((unsigned char)text[value_begin]))
+    {
+        value_begin++;
+    }
+
+    if (name_end == 0 || isdigit((unsigned char)text[0]) || value_begin == length || text[value_begin] != '=')
+    {
+        dsc_fail(parser, "unknown statement");
+        return NULL;
+    }
+
+    for (value_begin++; value_begin < length && isspace((unsigned char)text[value_begin]); value_begin++);
+
+    dsc_node_t* node = dsc_new_node(DSC_NODE_ASSIGN, parser);
+    if (node == NULL || (node->node_name = arena_strndup(text, name_end, parser->arena)) == NULL)
+    {
+        return NULL;
+    }
+
+    const char* value = text + value_begin;
+    size_t value_length = length - value_begin;
+    dsc_unquote(&value, &value_length);
+
+    node->node_words = dsc_parse_word(value, value_length, parser);
+    node->words_count = 1;
+
+    return node->node_words != NULL ? node : NULL;
+}
+
+bool dsc_parse(const char* source, size_t source_size, dsc_node_t** script_nodes, dsc_error_t* error, memory_arena_t* arena)
+{
+    struct dsc_parser parser = { .line_number = 0, .error = error, .arena = arena };
+    struct dsc_block blocks[DSC_MAX_DEPTH];
+    size_t depth = 0;
+
+    memset(error, 0, sizeof(*error));
+    *script_nodes = NULL;
+    blocks[0] = (struct dsc_block){ .block_if = NULL, .block_tail = script_nodes };
+
+    const char* source_end = source + source_size;
+
+    for (const char* line = source; line < source_end; )
+    {
+        const char* line_end = memchr(line, '\n', (size_t)(source_end - line));
+        if (line_end == NULL)
+        {
+            line_end = source_end;
+        }
+        const char* next_line = line_end + (line_end < source_end ? 1 : 0);
+
+        parser.line_number++;
+
+        while (line < line_end && isspace((unsigned char)*line))
+        {
+            line++;
+        }
+        while (line_end > line && isspace((unsigned char)line_end[-1]))
+        {
+            line_end--;
+        }
+
+        size_t line_length = (size_t)(line_end - line);
+        size_t keyword_end;
+        dsc_node_t* node = NULL;
+
+        if (line_length == 0 || *line == ';')
+        {
+            line = next_line;
+            continue;
+        }
+
+        if (line_length == 2 && strncmp(line, "fi", 2) == 0)
+        {
+            if (depth == 0)
+            {
+                return dsc_fail(&parser, "\"fi\" without an if");
+            }
+            depth--;
+            line = next_line;
+            continue;
+        }
+
+        if (line_length == 5 && strncmp(line, "else:", 5) == 0)
+        {
+            if (depth == 0 || blocks[depth].block_in_else)
+            {
+                return dsc_fail(&parser, "\"else:\" without an if");
+            }
+            blocks[depth].block_in_else = true;
+            blocks[depth].block_tail = &blocks[depth].block_if->node_else;
+            line = next_line;
+            continue;
+        }
+
+        if (dsc_keyword(line, line_length, "if", &keyword_end))
+        {
+            node = dsc_parse_if(line + keyword_end, line_length - keyword_end, &parser);
+        }
+        else if (*line == '%')
+        {
+            node = dsc_parse_directive(line, line_length, &parser);
+        }
+        else
+        {
+            node = dsc_parse_assign(line, line_length, &parser);
+        }
+
+        if (node == NULL)
+        {
+            if (error->error_line == 0)
+            {
+                dsc_fail(&parser, "out of memory");
+            }
+            return false;
+        }
+
+        *blocks[depth].block_tail = node;
+        blocks[depth].block_tail = &node->node_next;
+
+        if (node->node_type == DSC_NODE_IF)
+        {
+            if (++depth == DSC_MAX_DEPTH)
+            {
+                return dsc_fail(&parser, "too many nested if blocks");
+            }
+            blocks[depth] = (struct dsc_block){ .block_if = node, .block_tail = &node->node_then };
+        }
+
+        line = next_line;
+    }
+
+    if (depth != 0)
+    {
+        parser.line_number = blocks[depth].block_if->node_line;
+        return dsc_fail(&parser, "if without \"fi\"");
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef SCRIPT_DSC_PARSER_H
+#define SCRIPT_DSC_PARSER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "data/Memory_Arena.h"
+
+/* A .dsc script is line based:
+ * - name = value                assigns a variable
+ * - %directive% arguments...    calls a host directive, arguments may have globs
+ * - if [not] exist path then:   ... [else: ...] fi
+ * - ; comment
+ * Values and arguments can refer variables as $name, ${name} or $name:qualifier
+*/
+
+typedef enum
+{
+    DSC_PART_TEXT,
+    DSC_PART_VARIABLE
+} dsc_part_e;
+
+typedef struct dsc_part
+{
+    dsc_part_e part_type;
+
+    /* The literal text or the variable name */
+    const char* part_text;
+
+    /* From "$name:qualifier", NULL when there's no one */
+    const char* part_qualifier;
+
+    struct dsc_part* part_next;
+
+} dsc_part_t;
+
+typedef struct dsc_word
+{
+    dsc_part_t* word_parts;
+
+    /* The literal parts have glob characters (*, ? or [) */
+    bool word_glob;
+
+    struct dsc_word* word_next;
+
+} dsc_word_t;
+
+typedef enum
+{
+    DSC_NODE_ASSIGN,
+    DSC_NODE_DIRECTIVE,
+    DSC_NODE_IF
+} dsc_node_e;
+
+typedef struct dsc_node
+{
+    dsc_node_e node_type;
+
+    size_t node_line;
+
+    /* The assigned variable or the directive name */
+    const char* node_name;
+
+    /* The assigned value, the directive arguments or the tested path */
+    dsc_word_t* node_words;
+
+    size_t words_count;
+
+    /* Only for the if nodes */
+    bool node_negated;
+
+    struct dsc_node* node_then;
+
+    struct dsc_node* node_else;
+
+    struct dsc_node* node_next;
+
+} dsc_node_t;
+
+typedef struct dsc_error
+{
+    size_t error_line;
+
+    char error_message[256];
+
+} dsc_error_t;
+
+/* All nodes are allocated inside the arena, `script_nodes` is NULL for an empty script */
+bool dsc_parse(const char* source, size_t source_size, dsc_node_t** script_nodes, dsc_error_t* error, memory_arena_t* arena);
+
+#endif
+
@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <string.h>
+#include <time.h>
+#include <glob.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#include "Dsc_VM.h"
+#include "data/Output_Buffer.h"
+
+#define DSC_VALUE_MAX 4096
+
+/* Files smaller than this are grouped in one task, up to the same total size */
+#define DSC_FANOUT_GROUP_SIZE (256 * 1024)
+#define DSC_FANOUT_GROUP_FILES 32
+
+#define DSC_PENDING_LINES 8
+
+/* A fan out line with tasks still running, it owns the arguments used by its tasks */
+struct dsc_pending_line
+{
+    const dsc_directive_t* directive;
+
+    char** line_args;
+
+    size_t args_count;
+};
+
+struct dsc_fanout_task
+{
+    struct dsc_vm* vm;
+
+    const dsc_directive_t* directive;
+
+    size_t task_line;
+
+    size_t args_count;
+
+    char* task_args[];
+};
+
+struct dsc_vm
+{
+    dsc_program_t* program;
+
+    void* run_data;
+
+    dsc_error_t* error;
+
+    size_t program_counter;
+
+    char** slot_values;
+
+    /* The word being built by the TEXT, LOAD and BUILTIN instructions */
+    output_buffer_t word_text;
+
+    char** words;
+
+    uint8_t* words_flags;
+
+    size_t words_count;
+
+    size_t words_capacity;
+
+    /* Arguments of the directive being called, after the globs expansion */
+    char** call_args;
+
+    size_t call_count;
+
+    size_t call_capacity;
+
+    bool vm_condition;
+
+    tpool_t* thread_pool;
+
+    tpool_group_t fanout_group;
+
+    struct dsc_pending_line pending_lines[DSC_PENDING_LINES];
+
+    size_t pending_count;
+
+    /* The first failed task, reported by the next join */
+    atomic_bool fanout_failed;
+
+    size_t failed_line;
+
+    const char* failed_directive;
+};
+
+static uint64_t dsc_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static bool dsc_runtime_error(const char* message, const char* name, struct dsc_vm* vm)
+{
+    vm->error->error_line = vm->program->code_lines[vm->program_counter];
+    snprintf(vm->error->error_message, sizeof(vm->error->error_message), message, name);
+
+    return false;
+}
+
+static bool dsc_push_word(char* word, uint8_t word_flags, struct dsc_vm* vm)
+{
+    if (vm->words_count == vm->words_capacity)
+    {
+        size_t new_capacity = vm->words_capacity != 0 ? vm->words_capacity * 2 : 8;
+        char** new_words = realloc(vm->words, new_capacity * sizeof(char*));
+        uint8_t* new_flags = new_words != NULL ? realloc(vm->words_flags, new_capacity) : NULL;
+
+        if (new_words != NULL)
+        {
+            vm->words = new_words;
+        }
+        if (new_flags == NULL)
+        {
+            free((void*)word);
+            return false;
+        }
+        vm->words_flags = new_flags;
+        vm->words_capacity = new_capacity;
+    }
+
+    vm->words[vm->words_count] = word;
+    vm->words_flags[vm->words_count++] = word_flags;
+
+    return true;
+}
+
+static bool dsc_add_argument(const char* argument, void* vm_data)
+{
+    struct dsc_vm* vm = (struct dsc_vm*)vm_data;
+
+    if (vm->call_count == vm->call_capacity)
+    {
+        size_t new_capacity = vm->call_capacity != 0 ? vm->call_capacity * 2 : 8;
+        char** new_args = realloc(vm->call_args, (new_capacity + 1) * sizeof(char*));
+        if (new_args == NULL)
+        {
+            return false;
+        }
+        vm->call_args = new_args;
+        vm->call_capacity = new_capacity;
+    }
+
+    if ((vm->call_args[vm->call_count] = strdup(argument)) == NULL)
+    {
+        return false;
+    }
+    vm->call_count++;
+
+    return true;
+}
+
+static void dsc_clear_arguments(struct dsc_vm* vm)
+{
+    for (size_t arg_cur = 0; arg_cur < vm->call_count; arg_cur++)
+    {
+        free((void*)vm->call_args[arg_cur]);
+    }
+    vm->call_count = 0;
+}
+
+/* Patterns without matches expands to nothing */
+static bool dsc_host_glob(const char* pattern, dsc_match_fn on_match, void* match_data)
+{
+    glob_t glob_result;
+    int glob_ret = glob(pattern, 0, NULL, &glob_result);
+
+    if (glob_ret == GLOB_NOMATCH)
+    {
+        return true;
+    }
+    if (glob_ret != 0)
+    {
+        return false;
+    }
+
+    bool expand_ret = true;
+    for (size_t match_cur = 0; expand_ret && match_cur < glob_result.gl_pathc; match_cur++)
+    {
+        expand_ret = on_match(glob_result.gl_pathv[match_cur], match_data);
+    }
+    globfree(&glob_result);
+
+    return expand_ret;
+}
+
+static void* dsc_fanout_run(void* task_data)
+{
+    struct dsc_fanout_task* task = (struct dsc_fanout_task*)task_data;
+    struct dsc_vm* vm = task->vm;
+
+    /* After a failure the remaining tasks are only dropped */
+    if (atomic_load(&vm->fanout_failed) == false &&
+        task->directive->directive_call(task->args_count, task->task_args, vm->run_data) == false)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&vm->fanout_failed, &expected, true))
+        {
+            vm->failed_line = task->task_line;
+            vm->failed_directive = task->directive->directive_name;
+        }
+    }
+    free(task_data);
+
+    return NULL;
+}
+
+/* Waits for all fan out tasks, needed before anything that may read what they write */
+static bool dsc_join(struct dsc_vm* vm)
+{
+    if (vm->pending_count == 0)
+    {
+        return true;
+    }
+    tpool_group_wait(&vm->fanout_group, vm->thread_pool);
+
+    for (size_t line_cur = 0; line_cur < vm->pending_count; line_cur++)
+    {
+        struct dsc_pending_line* line = &vm->pending_lines[line_cur];
+
+        for (size_t arg_cur = 0; arg_cur < line->args_count; arg_cur++)
+        {
+            free((void*)line->line_args[arg_cur]);
+        }
+        free((void*)line->line_args);
+    }
+    vm->pending_count = 0;
+
+    if (atomic_load(&vm->fanout_failed))
+    {
+        atomic_store(&vm->fanout_failed, false);
+
+        vm->error->error_line = vm->failed_line;
+        snprintf(vm->error->error_message, sizeof(vm->error->error_message), "%%%s%% has failed", vm->failed_directive);
+        return false;
+    }
+    return true;
+}
+
+static bool dsc_ends_with(const char* text, size_t text_length, const char* suffix, size_t suffix_length)
+{
+    return text_length >= suffix_length && memcmp(text + text_length - suffix_length, suffix, suffix_length) == 0;
+}
+
+/* If a name matched by `word` can end with `suffix`, only the literal tail after the last
+ * wildcard is known, a directive without a suffix may write anything
+*/
+static bool dsc_may_match(const char* word, bool word_glob, const char* suffix)
+{
+    const char* tail = word;
+
+    for (const char* word_char = word; word_glob && *word_char != '\0'; word_char++)
+    {
+        if (strchr("*?[]", *word_char) != NULL)
+        {
+            tail = word_char + 1;
+        }
+    }
+
+    size_t tail_length = strlen(tail);
+    size_t suffix_length = suffix != NULL ? strlen(suffix) : 0;
+    if (tail_length == 0 || suffix_length == 0)
+    {
+        return true;
+    }
+    return dsc_ends_with(tail, tail_length, suffix, suffix_length) || dsc_ends_with(suffix, suffix_length, tail, tail_length);
+}
+
+/* Before the expansion: the patterns can't see the files written by the running lines */
+static bool dsc_words_conflict(size_t words_begin, struct dsc_vm* vm)
+{
+    for (size_t line_cur = 0; line_cur < vm->pending_count; line_cur++)
+    {
+        const char* written_suffix = vm->pending_lines[line_cur].directive->output_suffix;
+
+        for (size_t word_cur = words_begin; word_cur < vm->words_count; word_cur++)
+        {
+            if (dsc_may_match(vm->words[word_cur], vm->words_flags[word_cur] & DSC_WORD_GLOB, written_suffix))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/* After the expansion: the new line can't write what the running lines reads or writes */
+static bool dsc_files_conflict(const dsc_directive_t* directive, struct dsc_vm* vm)
+{
+    for (size_t line_cur = 0; line_cur < vm->pending_count; line_cur++)
+    {
+        const struct dsc_pending_line* line = &vm->pending_lines[line_cur];
+        bool same_suffix = line->directive->output_suffix != NULL && directive->output_suffix != NULL &&
+            strcmp(line->directive->output_suffix, directive->output_suffix) == 0;
+
+        for (size_t file_cur = line->directive->fixed_args; file_cur < line->args_count; file_cur++)
+        {
+            if (dsc_may_match(line->line_args[file_cur], false, directive->output_suffix))
+            {
+                return true;
+            }
+            for (size_t arg_cur = directive->fixed_args; same_suffix && arg_cur < vm->call_count; arg_cur++)
+            {
+                if (strcmp(line->line_args[file_cur], vm->call_args[arg_cur]) == 0)
+                {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+static size_t dsc_file_size(const char* path, struct dsc_vm* vm)
+{
+    const dsc_host_t* host = vm->program->program_host;
+    struct stat file_stat;
+
+    if (host->host_size != NULL)
+    {
+        return host->host_size(path, vm->run_data);
+    }
+    /* Unknown files are not grouped */
+    return stat(path, &file_stat) == 0 ? (size_t)file_stat.st_size : DSC_FANOUT_GROUP_SIZE;
+}
+
+static bool dsc_fanout_submit(const dsc_directive_t* directive, size_t files_begin, size_t files_end, struct dsc_vm* vm)
+{
+    size_t fixed_args = directive->fixed_args;
+    size_t args_count = fixed_args + files_end - files_begin;
+    struct dsc_fanout_task* task = malloc(sizeof(*task) + (args_count + 1) * sizeof(char*));
+
+    if (task == NULL)
+    {
+        return false;
+    }
+    task->vm = vm;
+    task->directive = directive;
+    task->task_line = vm->program->code_lines[vm->program_counter];
+    task->args_count = args_count;
+
+    memcpy(task->task_args, vm->call_args, fixed_args * sizeof(char*));
+    memcpy(task->task_args + fixed_args, vm->call_args + files_begin, (files_end - files_begin) * sizeof(char*));
+    task->task_args[args_count] = NULL;
+
+    vm->program->fanout_tasks++;
+    if (tpool_group_execute(dsc_fanout_run, task, &vm->fanout_group, vm->thread_pool) == false)
+    {
+        dsc_fanout_run(task);
+    }
+    return true;
+}
+
+/* One task by file or by group of tiny files, the arguments are moved to a pending line */
+static bool dsc_fanout(const dsc_directive_t* directive, struct dsc_vm* vm)
+{
+    char** new_args = malloc((vm->call_capacity + 1) * sizeof(char*));
+    if (new_args == NULL)
+    {
+        return false;
+    }
+
+    size_t group_begin = directive->fixed_args;
+    size_t group_size = 0;
+    bool fanout_ret = true;
+
+    for (size_t file_cur = group_begin; fanout_ret && file_cur < vm->call_count; file_cur++)
+    {
+        group_size += dsc_file_size(vm->call_args[file_cur], vm);
+
+        if (group_size >= DSC_FANOUT_GROUP_SIZE || file_cur + 1 - group_begin == DSC_FANOUT_GROUP_FILES || file_cur + 1 == vm->call_count)
+        {
+            fanout_ret = dsc_fanout_submit(directive, group_begin, file_cur + 1, vm);
+            group_begin = file_cur + 1;
+            group_size = 0;
+        }
+    }
+
+    /* Submitted tasks are using the arguments even when a submit has failed */
+    struct dsc_pending_line* line = &vm->pending_lines[vm->pending_count++];
+    line->directive = directive;
+    line->line_args = vm->call_args;
+    line->args_count = vm->call_count;
+
+    vm->call_args = new_args;
+    vm->call_count = 0;
+
+    return fanout_ret;
+}
+
+static bool dsc_call(const dsc_instruction_t* instruction, struct dsc_vm* vm)
+{
+    const dsc_host_t* host = vm->program->program_host;
+    const dsc_directive_t* directive = &host->host_directives[instruction->op_operand];
+    size_t words_begin = vm->words_count - instruction->op_extra;
+    bool fanout = vm->thread_pool != NULL && directive->directive_fanout;
+    bool call_ret = true;
+
+    if (fanout == false || vm->pending_count == DSC_PENDING_LINES || dsc_words_conflict(words_begin, vm))
+    {
+        call_ret = dsc_join(vm);
+    }
+
+    for (size_t word_cur = words_begin; call_ret && word_cur < vm->words_count; word_cur++)
+    {
+        if ((vm->words_flags[word_cur] & DSC_WORD_GLOB) == 0)
+        {
+            call_ret = dsc_add_argument(vm->words[word_cur], vm);
+        }
+        else if (host->host_glob != NULL)
+        {
+            call_ret = host->host_glob(vm->words[word_cur], dsc_add_argument, vm, vm->run_data);
+        }
+        else
+        {
+            call_ret = dsc_host_glob(vm->words[word_cur], dsc_add_argument, vm);
+        }
+    }
+
+    for (size_t word_cur = words_begin; word_cur < vm->words_count; word_cur++)
+    {
+        free((void*)vm->words[word_cur]);
+    }
+    vm->words_count = words_begin;
+
+    if (call_ret == false)
+    {
+        dsc_clear_arguments(vm);
+        /* A failed join has already filled the error */
+        return vm->error->error_message[0] != '\0' ? false :
+            dsc_runtime_error("can't expand the arguments of %%%s%%", directive->directive_name, vm);
+    }
+
+    if (fanout && vm->call_count > directive->fixed_args)
+    {
+        if (dsc_files_conflict(directive, vm) && dsc_join(vm) == false)
+        {
+            dsc_clear_arguments(vm);
+            return false;
+        }
+        if (dsc_fanout(directive, vm) == false)
+        {
+            return dsc_runtime_error("can't start the tasks of %%%s%%", directive->directive_name, vm);
+        }
+        return true;
+    }
+    if (dsc_join(vm) == false)
+    {
+        dsc_clear_arguments(vm);
+        return false;
+    }
+
+    vm->call_args[vm->call_count] = NULL;
+    call_ret = directive->directive_call(vm->call_count, vm->call_args, vm->run_data);
+    dsc_clear_arguments(vm);
+
+    if (call_ret == false)
+    {
+        return dsc_runtime_error("%%%s%% has failed", directive->directive_name, vm);
+    }
+    return true;
+}
+
+static bool dsc_run(struct dsc_vm* vm)
+{
+    dsc_program_t* program = vm->program;
+    const dsc_host_t* host = program->program_host;
+    char builtin_value[DSC_VALUE_MAX];
+
+    for (vm->program_counter = 0; ; vm->program_counter++)
+    {
+        const dsc_instruction_t* instruction = &program->program_code[vm->program_counter];
+
+        switch (instruction->op_code)
+        {
+        case DSC_OP_TEXT:
+            outbuf_puts(program->program_constants[instruction->op_operand], &vm->word_text);
+            break;
+
+        case DSC_OP_LOAD:
+            /* Variables assigned only inside a not taken if are empty */
+            if (vm->slot_values[instruction->op_operand] != NULL)
+            {
+                outbuf_puts(vm->slot_values[instruction->op_operand], &vm->word_text);
+            }
+            break;
+
+        case DSC_OP_BUILTIN:
+        {
+            const dsc_builtin_t* builtin = &host->host_builtins[instruction->op_operand];
+            const char* qualifier = instruction->op_extra != 0 ? program->program_constants[instruction->op_extra - 1] : NULL;
+
+            if (builtin->builtin_value(qualifier, builtin_value, sizeof(builtin_value), vm->run_data) == false)
+            {
+                return dsc_runtime_error("can't resolve $%s", builtin->builtin_name, vm);
+            }
+            outbuf_puts(builtin_value, &vm->word_text);
+            break;
+        }
+
+        case DSC_OP_WORD:
+        {
+            if (outbuf_putc('\0', &vm->word_text) == false)
+            {
+                return dsc_runtime_error("out of memory", NULL, vm);
+            }
+            char* word = strdup(vm->word_text.buffer_data);
+            outbuf_reset(&vm->word_text);
+
+            if (word == NULL || dsc_push_word(word, instruction->op_flags, vm) == false)
+            {
+                return dsc_runtime_error("out of memory", NULL, vm);
+            }
+            break;
+        }
+
+        case DSC_OP_STORE:
+            free((void*)vm->slot_values[instruction->op_operand]);
+            vm->slot_values[instruction->op_operand] = vm->words[--vm->words_count];
+            break;
+
+        case DSC_OP_CALL:
+            if (dsc_call(instruction, vm) == false)
+            {
+                return false;
+            }
+            break;
+
+        case DSC_OP_EXIST:
+        {
+            if (dsc_join(vm) == false)
+            {
+                return false;
+            }
+            char* path = vm->words[--vm->words_count];
+
+            vm->vm_condition = host->host_exist != NULL ? host->host_exist(path, vm->run_data) : access(path, F_OK) == 0;
+            if (instruction->op_flags & DSC_EXIST_NEGATED)
+            {
+                vm->vm_condition = !vm->vm_condition;
+            }
+            free((void*)path);
+            break;
+        }
+
+        case DSC_OP_JUMP_FALSE:
+            if (vm->vm_condition == false)
+            {
+                /* The loop increments the counter */
+                vm->program_counter = instruction->op_operand - 1;
+            }
+            break;
+
+        case DSC_OP_JUMP:
+            vm->program_counter = instruction->op_operand - 1;
+            break;
+
+        case DSC_OP_END:
+            return dsc_join(vm);
+
+        default:
+            return dsc_runtime_error("invalid instruction", NULL, vm);
+        }
+    }
+}
+
+bool dsc_execute(dsc_program_t* program, void* run_data, dsc_error_t* error, tpool_t* thread_pool)
+{
+    uint64_t run_begin = dsc_monotonic_nanos();
+    struct dsc_vm vm = { .program = program, .run_data = run_data, .error = error, .thread_pool = thread_pool };
+
+    memset(error, 0, sizeof(*error));
+
+    vm.slot_values = calloc(program->slots_count + 1, sizeof(char*));
+    vm.call_capacity = 8;
+    vm.call_args = malloc((vm.call_capacity + 1) * sizeof(char*));
+
+    if (vm.slot_values == NULL || vm.call_args == NULL || outbuf_init(0, NULL, NULL, &vm.word_text) == false)
+    {
+        free((void*)vm.slot_values);
+        free((void*)vm.call_args);
+        snprintf(error->error_message, sizeof(error->error_message), "out of memory");
+        return false;
+    }
+
+    if (thread_pool != NULL && tpool_group_init(&vm.fanout_group) == false)
+    {
+        vm.thread_pool = NULL;
+    }
+
+    bool run_ret = dsc_run(&vm);
+
+    if (vm.thread_pool != NULL)
+    {
+        /* Still running when the script has stopped at an error */
+        dsc_error_t run_error = *error;
+        if (dsc_join(&vm) == false && run_ret == false)
+        {
+            *error = run_error;
+        }
+        tpool_group_destroy(&vm.fanout_group);
+    }
+
+    for (size_t slot_cur = 0; slot_cur < program->slots_count; slot_cur++)
+    {
+        free((void*)vm.slot_values[slot_cur]);
+    }
+    for (size_t word_cur = 0; word_cur < vm.words_count; word_cur++)
+    {
+        free((void*)vm.words[word_cur]);
+    }
+    dsc_clear_arguments(&vm);
+
+    free((void*)vm.slot_values);
+    free((void*)vm.words);
+    free((void*)vm.words_flags);
+    free((void*)vm.call_args);
+    outbuf_deinit(&vm.word_text);
+
+    program->runs_count++;
+    program->runs_nanos += dsc_monotonic_nanos() - run_begin;
+
+    return run_ret;
+}
+
@@ -0,0 +1,16 @@
+#ifndef SCRIPT_DSC_VM_H
+#define SCRIPT_DSC_VM_H
+
+#include "Dsc_Compiler.h"
+#include "Thread_Pool.h"
+
+/* Runs a compiled script once, many threads can run the same program at the same time,
+ * all the state of an execution is local.
+ * With a thread pool, the files of the fan out directives are processed in parallel and
+ * consecutive fan out lines that doesn't depend on each other overlaps, everything else
+ * waits for the running tasks first. Without a pool all calls are serial
+*/
+bool dsc_execute(dsc_program_t* program, void* run_data, dsc_error_t* error, tpool_t* thread_pool);
+
+#endif
+
@@ -0,0 +1,411 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Apk_Signature.h"
+
+/* The block ends with his size (again) and the magic */
+#define APKSIG_FOOTER_SIZE 24
+#define APKSIG_SECTIONS 3
+
+/* Chunked SHA-256 digests: RSA-PSS, RSA PKCS#1, ECDSA and DSA, all over SHA-256 */
+static const uint32_t apksig_sha256_algorithms[] = { 0x0101, 0x0103, 0x0201, 0x0301 };
+
+struct apksig_section
+{
+    const uint8_t* section_data;
+
+    uint64_t section_size;
+
+    uint64_t first_chunk;
+};
+
+struct apksig_contents
+{
+    struct apksig_section sections[APKSIG_SECTIONS];
+
+    uint64_t chunks_count;
+
+    /* chunks_count digests, in the order of the chunks */
+    uint8_t* chunk_digests;
+};
+
+struct apksig_task
+{
+    const struct apksig_contents* contents;
+
+    uint64_t first_chunk;
+
+    uint32_t chunks_count;
+};
+
+static uint64_t apksig_monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static uint32_t apksig_u32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static uint64_t apksig_u64(const uint8_t* data)
+{
+    return (uint64_t)apksig_u32(data) | (uint64_t)apksig_u32(data + 4) << 32;
+}
+
+static void apksig_chunk_of(uint64_t chunk_index, const struct apksig_contents* contents, const uint8_t** chunk_data, uint32_t* chunk_size)
+{
+    size_t section_cur = APKSIG_SECTIONS - 1;
+
+    while (contents->sections[section_cur].first_chunk > chunk_index)
+    {
+        section_cur--;
+    }
+
+    const struct apksig_section* section = &contents->sections[section_cur];
+    uint64_t chunk_offset = (chunk_index - section->first_chunk) * APKSIG_CHUNK_SIZE;
+    uint64_t chunk_left = section->section_size - chunk_offset;
+
+    *chunk_data = section->section_data + chunk_offset;
+    *chunk_size = (uint32_t)(chunk_left < APKSIG_CHUNK_SIZE ? chunk_left : APKSIG_CHUNK_SIZE);
+}
+
+/* Each chunk digest is SHA-256(0xa5, chunk size (LE), chunk) */
+static void* apksig_chunks_task(void* task_data)
+{
+    struct apksig_task* task = (struct apksig_task*)task_data;
+    const struct apksig_contents* contents = task->contents;
+    sha256_ctx_t chunk_ctxs[APKSIG_TASK_CHUNKS];
+    sha256_ctx_t* chunk_lanes[APKSIG_TASK_CHUNKS];
+    const uint8_t* chunks_data[APKSIG_TASK_CHUNKS];
+    uint8_t chunk_prefixes[APKSIG_TASK_CHUNKS][5];
+    const uint8_t* prefixes_data[APKSIG_TASK_CHUNKS];
+    uint32_t chunks_size[APKSIG_TASK_CHUNKS];
+    bool same_size = task->chunks_count == APKSIG_TASK_CHUNKS;
+
+    for (uint32_t chunk_cur = 0; chunk_cur < task->chunks_count; chunk_cur++)
+    {
+        apksig_chunk_of(task->first_chunk + chunk_cur, contents, &chunks_data[chunk_cur], &chunks_size[chunk_cur]);
+        same_size &= chunks_size[chunk_cur] == chunks_size[0];
+
+        chunk_prefixes[chunk_cur][0] = 0xa5;
+        for (int byte_cur = 0; byte_cur < 4; byte_cur++)
+        {
+            chunk_prefixes[chunk_cur][1 + byte_cur] = (uint8_t)(chunks_size[chunk_cur] >> (byte_cur * 8));
+        }
+        prefixes_data[chunk_cur] = chunk_prefixes[chunk_cur];
+        chunk_lanes[chunk_cur] = &chunk_ctxs[chunk_cur];
+        sha256_init(&chunk_ctxs[chunk_cur]);
+    }
+
+    /* The full chunks of a task are hashed together */
+    if (same_size)
+    {
+        sha256_update_x8(prefixes_data, sizeof(chunk_prefixes[0]), chunk_lanes);
+        sha256_update_x8(chunks_data, chunks_size[0], chunk_lanes);
+    }
+    else
+    {
+        for (uint32_t chunk_cur = 0; chunk_cur < task->chunks_count; chunk_cur++)
+        {
+            sha256_update(chunk_prefixes[chunk_cur], sizeof(chunk_prefixes[0]), &chunk_ctxs[chunk_cur]);
+            sha256_update(chunks_data[chunk_cur], chunks_size[chunk_cur], &chunk_ctxs[chunk_cur]);
+        }
+    }
+
+    for (uint32_t chunk_cur = 0; chunk_cur < task->chunks_count; chunk_cur++)
+    {
+        sha256_final(contents->chunk_digests + (task->first_chunk + chunk_cur) * SHA256_DIGEST_SIZE, &chunk_ctxs[chunk_cur]);
+    }
+
+    return NULL;
+}
+
+bool apksig_content_digest(const zip_archive_t* archive, uint64_t block_offset, uint8_t digest[SHA256_DIGEST_SIZE],
+    uint64_t* chunks_count, tpool_t* thread_pool)
+{
+    uint64_t eocd_size = archive->archive_size - archive->eocd_offset;
+
+    if (block_offset > archive->central_dir_offset || archive->central_dir_offset > archive->eocd_offset ||
+        archive->eocd_offset > archive->archive_size || eocd_size < ZIP_EOCD_SIZE || block_offset > UINT32_MAX)
+    {
+        return false;
+    }
+
+    /* The EOCD is digested as if the central directory started where the signing block starts */
+    uint8_t* eocd_copy = malloc(eocd_size);
+    if (eocd_copy == NULL)
+    {
+        return false;
+    }
+    memcpy(eocd_copy, archive->archive_data + archive->eocd_offset, eocd_size);
+    for (int byte_cur = 0; byte_cur < 4; byte_cur++)
+    {
+        eocd_copy[16 + byte_cur] = (uint8_t)(block_offset >> (byte_cur * 8));
+    }
+
+    struct apksig_contents contents = {
+        .sections = {
+            { archive->archive_data, block_offset },
+            { archive->archive_data + archive->central_dir_offset, archive->eocd_offset - archive->central_dir_offset },
+            { eocd_copy, eocd_size }
+        }
+    };
+
+    for (size_t section_cur = 0; section_cur < APKSIG_SECTIONS; section_cur++)
+    {
+        contents.sections[section_cur].first_chunk = contents.chunks_count;
+        contents.chunks_count += (contents.sections[section_cur].section_size + APKSIG_CHUNK_SIZE - 1) / APKSIG_CHUNK_SIZE;
+    }
+
+    size_t tasks_count = (contents.chunks_count + APKSIG_TASK_CHUNKS - 1) / APKSIG_TASK_CHUNKS;
+    struct apksig_task* tasks = calloc(tasks_count, sizeof(*tasks));
+    contents.chunk_digests = malloc(contents.chunks_count * SHA256_DIGEST_SIZE + 1);
+
+    bool digest_ret = tasks != NULL && contents.chunk_digests != NULL;
+    if (digest_ret)
+    {
+        tpool_group_t chunks_group;
+        tpool_group_init(&chunks_group);
+
+        for (size_t task_cur = 0; task_cur < tasks_count; task_cur++)
+        {
+            uint64_t first_chunk = (uint64_t)task_cur * APKSIG_TASK_CHUNKS;
+            uint64_t chunks_left = contents.chunks_count - first_chunk;
+
+            tasks[task_cur].contents = &contents;
+            tasks[task_cur].first_chunk = first_chunk;
+            tasks[task_cur].chunks_count = (uint32_t)(chunks_left < APKSIG_TASK_CHUNKS ? chunks_left : APKSIG_TASK_CHUNKS);
+
+            /* A stopped pool runs nothing, the task runs here */
+            if (tpool_group_execute(apksig_chunks_task, &tasks[task_cur], &chunks_group, thread_pool) == false)
+            {
+                apksig_chunks_task(&tasks[task_cur]);
+            }
+        }
+        tpool_group_wait(&chunks_group, thread_pool);
+        tpool_group_destroy(&chunks_group);
+
+        /* SHA-256(0x5a, chunks count (LE), chunk digests) */
+        uint8_t top_prefix[5] = { 0x5a };
+        sha256_ctx_t top_ctx;
+
+        for (int byte_cur = 0; byte_cur < 4; byte_cur++)
+        {
+            top_prefix[1 + byte_cur] = (uint8_t)(contents.chunks_count >> (byte_cur * 8));
+        }
+        sha256_init(&top_ctx);
+        sha256_update(top_prefix, sizeof(top_prefix), &top_ctx);
+        sha256_update(contents.chunk_digests, contents.chunks_count * SHA256_DIGEST_SIZE, &top_ctx);
+        sha256_final(digest, &top_ctx);
+
+        *chunks_count = contents.chunks_count;
+    }
+
+    free((void*)contents.chunk_digests);
+    free((void*)tasks);
+    free((void*)eocd_copy);
+
+    return digest_ret;
+}
+
+bool apksig_find_block(const zip_archive_t* archive, uint64_t* block_offset, const uint8_t** block_pairs, size_t* pairs_size)
+{
+    uint64_t footer_offset = archive->central_dir_offset;
+
+    if (footer_offset < APKSIG_FOOTER_SIZE + 8 || footer_offset > archive->archive_size ||
+        memcmp(archive->archive_data + footer_offset - 16, APKSIG_BLOCK_MAGIC, 16) != 0)
+    {
+        return false;
+    }
+
+    /* The size excludes the leading size field */
+    uint64_t block_size = apksig_u64(archive->archive_data + footer_offset - APKSIG_FOOTER_SIZE);
+    if (block_size < APKSIG_FOOTER_SIZE || block_size > footer_offset - 8 ||
+        apksig_u64(archive->archive_data + footer_offset - block_size - 8) != block_size)
+    {
+        return false;
+    }
+
+    *block_offset = footer_offset - block_size - 8;
+    *block_pairs = archive->archive_data + *block_offset + 8;
+    *pairs_size = block_size - APKSIG_FOOTER_SIZE;
+
+    return true;
+}
+
+/* The value of the pair `pair_id`, the pairs are (size: u64, id: u32, value) */
+static bool apksig_find_pair(const uint8_t* pairs, size_t pairs_size, uint32_t pair_id, const uint8_t** value, size_t* value_size)
+{
+    while (pairs_size >= 12)
+    {
+        uint64_t pair_size = apksig_u64(pairs);
+        if (pair_size < 4 || pair_size > pairs_size - 8)
+        {
+            return false;
+        }
+        if (apksig_u32(pairs + 8) == pair_id)
+        {
+            *value = pairs + 12;
+            *value_size = pair_size - 4;
+            return true;
+        }
+        pairs += 8 + pair_size;
+        pairs_size -= 8 + pair_size;
+    }
+    return false;
+}
+
+/* Reads a length prefixed (u32) item, moving the cursor after it */
+static bool apksig_item(const uint8_t** cursor, size_t* left, const uint8_t** item, size_t* item_size)
+{
+    if (*left < 4 || apksig_u32(*cursor) > *left - 4)
+    {
+        return false;
+    }
+    *item_size = apksig_u32(*cursor);
+    *item = *cursor + 4;
+    *cursor += 4 + *item_size;
+    *left -= 4 + *item_size;
+
+    return true;
+}
+
+static bool apksig_is_sha256(uint32_t algorithm_id)
+{
+    for (size_t algorithm_cur = 0; algorithm_cur < sizeof(apksig_sha256_algorithms) / sizeof(*apksig_sha256_algorithms); algorithm_cur++)
+    {
+        if (apksig_sha256_algorithms[algorithm_cur] == algorithm_id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* signers: [signer: [signed data: [digests: [algorithm, digest]...], ...], ...]...] */
+static apksig_status_t apksig_check_scheme(const uint8_t* value, size_t value_size, const uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    const uint8_t* signers;
+    size_t signers_left;
+    size_t digests_matched = 0;
+
+    if (apksig_item(&value, &value_size, &signers, &signers_left) == false || signers_left == 0)
+    {
+        return APKSIG_MALFORMED;
+    }
+
+    while (signers_left != 0)
+    {
+        const uint8_t *signer, *signed_data, *digests;
+        size_t signer_left, signed_left, digests_left;
+
+        if (apksig_item(&signers, &signers_left, &signer, &signer_left) == false ||
+            apksig_item(&signer, &signer_left, &signed_data, &signed_left) == false ||
+            apksig_item(&signed_data, &signed_left, &digests, &digests_left) == false)
+        {
+            return APKSIG_MALFORMED;
+        }
+
+        while (digests_left != 0)
+        {
+            const uint8_t *digest_item, *signed_digest;
+            size_t item_left, signed_digest_size;
+
+            if (apksig_item(&digests, &digests_left, &digest_item, &item_left) == false || item_left < 4)
+            {
+                return APKSIG_MALFORMED;
+            }
+            uint32_t algorithm_id = apksig_u32(digest_item);
+            digest_item += 4;
+            item_left -= 4;
+
+            if (apksig_item(&digest_item, &item_left, &signed_digest, &signed_digest_size) == false)
+            {
+                return APKSIG_MALFORMED;
+            }
+            if (apksig_is_sha256(algorithm_id) == false)
+            {
+                continue;
+            }
+            if (signed_digest_size != SHA256_DIGEST_SIZE || memcmp(signed_digest, digest, SHA256_DIGEST_SIZE) != 0)
+            {
+                return APKSIG_MISMATCH;
+            }
+            digests_matched++;
+        }
+    }
+
+    return digests_matched != 0 ? APKSIG_DIGEST_MATCH : APKSIG_UNSUPPORTED;
+}
+
+bool apksig_verify(const zip_archive_t* archive, apksig_report_t* report, tpool_t* thread_pool)
+{
+    static const uint32_t scheme_ids[2] = { APKSIG_V2_ID, APKSIG_V3_ID };
+    uint64_t verify_begin = apksig_monotonic_nanos();
+    uint64_t block_offset;
+    const uint8_t* block_pairs;
+    size_t pairs_size;
+
+    memset(report, 0, sizeof(*report));
+
+    if (apksig_find_block(archive, &block_offset, &block_pairs, &pairs_size) == false)
+    {
+        return true;
+    }
+
+    /* Both schemes sign the same contents digest */
+    const uint8_t* scheme_values[2];
+    size_t scheme_sizes[2];
+    bool digest_needed = false;
+
+    for (size_t scheme_cur = 0; scheme_cur < 2; scheme_cur++)
+    {
+        if (apksig_find_pair(block_pairs, pairs_size, scheme_ids[scheme_cur], &scheme_values[scheme_cur], &scheme_sizes[scheme_cur]))
+        {
+            report->scheme_status[scheme_cur] = APKSIG_MALFORMED;
+            digest_needed = true;
+        }
+    }
+    if (digest_needed == false)
+    {
+        return true;
+    }
+
+    if (apksig_content_digest(archive, block_offset, report->content_digest, &report->chunks_count, thread_pool) == false)
+    {
+        return false;
+    }
+    report->bytes_hashed = block_offset + (archive->archive_size - archive->central_dir_offset);
+
+    for (size_t scheme_cur = 0; scheme_cur < 2; scheme_cur++)
+    {
+        if (report->scheme_status[scheme_cur] != APKSIG_ABSENT)
+        {
+            report->scheme_status[scheme_cur] = apksig_check_scheme(scheme_values[scheme_cur], scheme_sizes[scheme_cur], report->content_digest);
+        }
+    }
+    report->verify_nanos = apksig_monotonic_nanos() - verify_begin;
+
+    return true;
+}
+
+void apksig_report(const char* input_path, const apksig_report_t* report, output_buffer_t* report_output)
+{
+    static const char* status_names[] = { "absent", "digest matches (signature not checked)", "digest mismatch", "malformed", "unsupported digests" };
+
+    if (report->scheme_status[0] == APKSIG_ABSENT && report->scheme_status[1] == APKSIG_ABSENT)
+    {
+        outbuf_format(report_output, "%s: no APK Signature Scheme v2/v3 block\n", input_path);
+        return;
+    }
+
+    double verify_seconds = (double)report->verify_nanos / 1e9;
+    outbuf_format(report_output, "%s: signature v2 %s, v3 %s, %llu chunks in %.1f ms (%.0f MB/s)\n", input_path,
+        status_names[report->scheme_status[0]], status_names[report->scheme_status[1]], (unsigned long long)report->chunks_count,
+        verify_seconds * 1e3, verify_seconds > 0 ? (double)report->bytes_hashed / 1e6 / verify_seconds : 0.0);
+}
@@ -0,0 +1,73 @@
+#ifndef SIGN_APK_SIGNATURE_H
+#define SIGN_APK_SIGNATURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Thread_Pool.h"
+#include "zip/Zip_Archive.h"
+#include "crypto/SHA_256.h"
+#include "data/Output_Buffer.h"
+
+#define APKSIG_BLOCK_MAGIC "APK Sig Block 42"
+
+#define APKSIG_V2_ID 0x7109871a
+#define APKSIG_V3_ID 0xf05368c0
+
+/* The contents are digested by chunks of this size, each chunk on his own */
+#define APKSIG_CHUNK_SIZE (1024 * 1024)
+
+/* Chunks hashed by a pool task, the 8 lanes of sha256_update_x8 */
+#define APKSIG_TASK_CHUNKS 8
+
+typedef enum apksig_status
+{
+    /* The signing block doesn't have this scheme */
+    APKSIG_ABSENT,
+
+    /* The contents digest is the signed one, the signature over the signed data isn't checked */
+    APKSIG_DIGEST_MATCH,
+
+    APKSIG_MISMATCH,
+
+    APKSIG_MALFORMED,
+
+    /* None of the signers has a chunked SHA-256 digest (SHA-512 and verity aren't computed) */
+    APKSIG_UNSUPPORTED,
+
+} apksig_status_t;
+
+typedef struct apksig_report
+{
+    /* v2 then v3 */
+    apksig_status_t scheme_status[2];
+
+    uint8_t content_digest[SHA256_DIGEST_SIZE];
+
+    uint64_t chunks_count;
+
+    uint64_t bytes_hashed;
+
+    uint64_t verify_nanos;
+
+} apksig_report_t;
+
+/* The digest of the v2/v3 schemes: the entries, the central directory and the EOCD (pointing
+ * to the signing block offset) split into chunks, the chunks are hashed by the pool workers,
+ * then their digests are hashed in order into the top level digest
+*/
+bool apksig_content_digest(const zip_archive_t* archive, uint64_t block_offset, uint8_t digest[SHA256_DIGEST_SIZE],
+    uint64_t* chunks_count, tpool_t* thread_pool);
+
+/* Finds the APK Signing Block before the central directory, false for unsigned (v1 only) archives */
+bool apksig_find_block(const zip_archive_t* archive, uint64_t* block_offset, const uint8_t** block_pairs, size_t* pairs_size);
+
+/* Checks the SHA-256 contents digests of the v2 and v3 signers against the archive. The
+ * signatures of the signed data aren't checked, only that the archive is the one signed
+*/
+bool apksig_verify(const zip_archive_t* archive, apksig_report_t* report, tpool_t* thread_pool);
+
+/* One line by input into `report_output` */
+void apksig_report(const char* input_path, const apksig_report_t* report, output_buffer_t* report_output);
+
+#endif
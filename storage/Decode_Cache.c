@@ -0,0 +1,769 @@
+#include <stdio.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Decode_Cache.h"
+
+#define DCACHE_INDEX_MAGIC 0x58494344 /* DCIX */
+#define DCACHE_PACK_MAGIC 0x4b504344 /* DCPK */
+#define DCACHE_RECORD_MAGIC 0x52504344 /* DCPR */
+#define DCACHE_FORMAT_VERSION 1
+
+#define DCACHE_PATH_MAX 4096
+#define DCACHE_STORE_INITIAL (16 * 1024)
+#define DCACHE_COPY_PIECE (256 * 1024)
+
+struct dcache_index_header
+{
+    uint32_t index_magic;
+
+    uint32_t index_version;
+
+    uint64_t pack_generation;
+
+    uint64_t entries_count;
+
+    uint64_t header_reserved;
+};
+
+struct dcache_index_entry
+{
+    uint8_t entry_key[SHA256_DIGEST_SIZE];
+
+    uint64_t pack_offset;
+
+    uint64_t data_size;
+
+    /* Nanoseconds since the epoch, written by any process that reads the output */
+    uint64_t last_access;
+
+    uint64_t entry_reserved;
+};
+
+struct dcache_pack_header
+{
+    uint32_t pack_magic;
+
+    uint32_t pack_version;
+
+    uint64_t pack_generation;
+};
+
+struct dcache_pack_record
+{
+    uint32_t record_magic;
+
+    uint32_t record_reserved;
+
+    uint8_t record_key[SHA256_DIGEST_SIZE];
+
+    uint64_t data_size;
+};
+
+struct dcache_slot
+{
+    const struct dcache_index_entry* slot_entry;
+};
+
+#define DCACHE_ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+static uint64_t dcache_now(void)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static bool dcache_path(const char* cache_dir, const char* file_name, char* path)
+{
+    int path_length = snprintf(path, DCACHE_PATH_MAX, "%s/%s", cache_dir, file_name);
+    return path_length > 0 && path_length < DCACHE_PATH_MAX;
+}
+
+static bool dcache_pack_path(const char* cache_dir, uint64_t pack_generation, char* path)
+{
+    char pack_name[64];
+    snprintf(pack_name, sizeof(pack_name), "decode-%llu.pack", (unsigned long long)pack_generation);
+
+    return dcache_path(cache_dir, pack_name, path);
+}
+
+static bool dcache_write_all(int file_fd, const void* data, size_t data_size, off_t file_offset)
+{
+    const uint8_t* input = (const uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t write_ret = pwrite(file_fd, input, data_size, file_offset);
+        if (write_ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (write_ret <= 0)
+        {
+            return false;
+        }
+        input += write_ret;
+        data_size -= (size_t)write_ret;
+        file_offset += write_ret;
+    }
+    return true;
+}
+
+static bool dcache_read_all(int file_fd, void* data, size_t data_size, off_t file_offset)
+{
+    uint8_t* output = (uint8_t*)data;
+
+    while (data_size != 0)
+    {
+        ssize_t read_ret = pread(file_fd, output, data_size, file_offset);
+        if (read_ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_ret <= 0)
+        {
+            return false;
+        }
+        output += read_ret;
+        data_size -= (size_t)read_ret;
+        file_offset += read_ret;
+    }
+    return true;
+}
+
+/* Writes a complete index into a temporary file and renames it over the current, must be
+ * called with the exclusive lock
+*/
+static bool dcache_publish_index(uint64_t pack_generation, const struct dcache_index_entry* entries, size_t entries_count,
+    const decode_cache_t* cache)
+{
+    char index_path[DCACHE_PATH_MAX];
+    char temporary_path[DCACHE_PATH_MAX];
+    char temporary_name[64];
+
+    snprintf(temporary_name, sizeof(temporary_name), "decode.index.%ld", (long)getpid());
+    if (dcache_path(cache->cache_dir, "decode.index", index_path) == false ||
+        dcache_path(cache->cache_dir, temporary_name, temporary_path) == false)
+    {
+        return false;
+    }
+
+    int index_fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (index_fd < 0)
+    {
+        return false;
+    }
+
+    struct dcache_index_header index_header = {
+        .index_magic = DCACHE_INDEX_MAGIC,
+        .index_version = DCACHE_FORMAT_VERSION,
+        .pack_generation = pack_generation,
+        .entries_count = entries_count
+    };
+
+    bool publish_ret = dcache_write_all(index_fd, &index_header, sizeof(index_header), 0);
+    if (entries_count != 0)
+    {
+        publish_ret &= dcache_write_all(index_fd, entries, entries_count * sizeof(*entries), sizeof(index_header));
+    }
+    publish_ret &= close(index_fd) == 0;
+
+    if (publish_ret == false || rename(temporary_path, index_path) != 0)
+    {
+        unlink(temporary_path);
+        return false;
+    }
+    return true;
+}
+
+static int dcache_create_pack(uint64_t pack_generation, const decode_cache_t* cache)
+{
+    char pack_path[DCACHE_PATH_MAX];
+
+    if (dcache_pack_path(cache->cache_dir, pack_generation, pack_path) == false)
+    {
+        return -1;
+    }
+
+    int pack_fd = open(pack_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (pack_fd < 0)
+    {
+        return -1;
+    }
+
+    struct dcache_pack_header pack_header = {
+        .pack_magic = DCACHE_PACK_MAGIC,
+        .pack_version = DCACHE_FORMAT_VERSION,
+        .pack_generation = pack_generation
+    };
+
+    if (dcache_write_all(pack_fd, &pack_header, sizeof(pack_header), 0) == false)
+    {
+        close(pack_fd);
+        unlink(pack_path);
+        return -1;
+    }
+    return pack_fd;
+}
+
+/* Starts an empty cache, also used when the files are from another format version */
+static bool dcache_create(decode_cache_t* cache)
+{
+    int pack_fd = dcache_create_pack(1, cache);
+    if (pack_fd < 0)
+    {
+        return false;
+    }
+    close(pack_fd);
+
+    return dcache_publish_index(1, NULL, 0, cache);
+}
+
+static bool dcache_header_valid(int index_fd, struct dcache_index_header* index_header)
+{
+    return dcache_read_all(index_fd, index_header, sizeof(*index_header), 0) &&
+        index_header->index_magic == DCACHE_INDEX_MAGIC && index_header->index_version == DCACHE_FORMAT_VERSION;
+}
+
+static void dcache_unmap(decode_cache_t* cache)
+{
+    if (cache->index_map != NULL)
+    {
+        munmap(cache->index_map, cache->index_map_size);
+    }
+    if (cache->pack_map != NULL)
+    {
+        munmap((void*)cache->pack_map, cache->pack_map_size);
+    }
+    if (cache->slots != NULL)
+    {
+        free((void*)cache->slots);
+    }
+    if (cache->index_fd >= 0)
+    {
+        close(cache->index_fd);
+    }
+    if (cache->pack_fd >= 0)
+    {
+        close(cache->pack_fd);
+    }
+
+    cache->index_map = NULL;
+    cache->pack_map = NULL;
+    cache->slots = NULL;
+    cache->index_fd = -1;
+    cache->pack_fd = -1;
+}
+
+static size_t dcache_slot_of(const uint8_t* key_hash, size_t slots_mask)
+{
+    uint64_t slot_hash;
+    memcpy(&slot_hash, key_hash, sizeof(slot_hash));
+
+    return (size_t)slot_hash & slots_mask;
+}
+
+/* Maps the current index and his pack, must be called with the lock held */
+static bool dcache_map(decode_cache_t* cache)
+{
+    char index_path[DCACHE_PATH_MAX];
+    char pack_path[DCACHE_PATH_MAX];
+    struct dcache_index_header index_header;
+    struct stat file_stat;
+
+    if (dcache_path(cache->cache_dir, "decode.index", index_path) == false)
+    {
+        return false;
+    }
+
+    cache->index_fd = open(index_path, O_RDWR | O_CLOEXEC);
+    if (cache->index_fd < 0 || dcache_header_valid(cache->index_fd, &index_header) == false || fstat(cache->index_fd, &file_stat) != 0)
+    {
+        return false;
+    }
+
+    cache->index_inode = file_stat.st_ino;
+    cache->pack_generation = index_header.pack_generation;
+
+    /* Entries written after the open aren't seen by this process */
+    size_t entries_count = index_header.entries_count;
+    size_t entries_capacity = ((size_t)file_stat.st_size - sizeof(index_header)) / sizeof(struct dcache_index_entry);
+    if (entries_count > entries_capacity)
+    {
+        entries_count = entries_capacity;
+    }
+
+    cache->index_map_size = sizeof(index_header) + entries_count * sizeof(struct dcache_index_entry);
+    cache->index_map = mmap(NULL, cache->index_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, cache->index_fd, 0);
+    if (cache->index_map == MAP_FAILED)
+    {
+        cache->index_map = NULL;
+        return false;
+    }
+
+    if (dcache_pack_path(cache->cache_dir, cache->pack_generation, pack_path) == false)
+    {
+        return false;
+    }
+    cache->pack_fd = open(pack_path, O_RDWR | O_CLOEXEC);
+    if (cache->pack_fd < 0 || fstat(cache->pack_fd, &file_stat) != 0)
+    {
+        return false;
+    }
+
+    cache->pack_map_size = (size_t)file_stat.st_size;
+    if (cache->pack_map_size != 0)
+    {
+        cache->pack_map = mmap(NULL, cache->pack_map_size, PROT_READ, MAP_SHARED, cache->pack_fd, 0);
+        if (cache->pack_map == MAP_FAILED)
+        {
+            cache->pack_map = NULL;
+            return false;
+        }
+    }
+
+    size_t slots_capacity = 16;
+    while (slots_capacity < entries_count * 2)
+    {
+        slots_capacity *= 2;
+    }
+    cache->slots = calloc(slots_capacity, sizeof(struct dcache_slot));
+    cache->slots_mask = slots_capacity - 1;
+    if (cache->slots == NULL)
+    {
+        return false;
+    }
+
+    const struct dcache_index_entry* entries = (const struct dcache_index_entry*)(cache->index_map + sizeof(index_header));
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        const struct dcache_index_entry* entry = &entries[entry_cur];
+        size_t slot_index = dcache_slot_of(entry->entry_key, cache->slots_mask);
+
+        /* When two processes stored the same key, the last one is used */
+        while (cache->slots[slot_index].slot_entry != NULL &&
+            memcmp(cache->slots[slot_index].slot_entry->entry_key, entry->entry_key, SHA256_DIGEST_SIZE) != 0)
+        {
+            slot_index = (slot_index + 1) & cache->slots_mask;
+        }
+        cache->slots[slot_index].slot_entry = entry;
+    }
+
+    return true;
+}
+
+bool dcache_open(const char* cache_dir, size_t size_budget, decode_cache_t* cache)
+{
+    char lock_path[DCACHE_PATH_MAX];
+
+    memset(cache, 0, sizeof(*cache));
+    cache->index_fd = -1;
+    cache->pack_fd = -1;
+    cache->lock_fd = -1;
+    cache->size_budget = size_budget;
+    pthread_mutex_init(&cache->store_lock, NULL);
+
+    cache->cache_dir = strdup(cache_dir);
+    if (cache->cache_dir == NULL || (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) ||
+        dcache_path(cache_dir, "lock", lock_path) == false)
+    {
+        goto open_failed;
+    }
+
+    cache->lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (cache->lock_fd < 0)
+    {
+        goto open_failed;
+    }
+
+    flock(cache->lock_fd, LOCK_SH);
+    bool map_ret = dcache_map(cache);
+    flock(cache->lock_fd, LOCK_UN);
+
+    if (map_ret == false)
+    {
+        /* Missing or from another version, checking again with the exclusive lock because
+         * another process may be doing the same now
+        */
+        dcache_unmap(cache);
+
+        flock(cache->lock_fd, LOCK_EX);
+        map_ret = dcache_map(cache);
+        if (map_ret == false)
+        {
+            dcache_unmap(cache);
+            map_ret = dcache_create(cache) && dcache_map(cache);
+        }
+        flock(cache->lock_fd, LOCK_UN);
+    }
+
+    if (map_ret)
+    {
+        return true;
+    }
+
+open_failed:
+    dcache_unmap(cache);
+    if (cache->lock_fd >= 0)
+    {
+        close(cache->lock_fd);
+    }
+    free((void*)cache->cache_dir);
+    pthread_mutex_destroy(&cache->store_lock);
+    memset(cache, 0, sizeof(*cache));
+
+    return false;
+}
+
+void dcache_make_key(const void* content, size_t content_size, const char* key_context, dcache_key_t* key)
+{
+    sha256_ctx_t sha_ctx;
+    uint64_t format_version = DCACHE_FORMAT_VERSION;
+
+    sha256_init(&sha_ctx);
+    sha256_update(&format_version, sizeof(format_version), &sha_ctx);
+    /* The NUL separates the context from the content */
+    sha256_update(key_context, strlen(key_context) + 1, &sha_ctx);
+    sha256_update(content, content_size, &sha_ctx);
+    sha256_final(key->key_hash, &sha_ctx);
+}
+
+bool dcache_lookup(const dcache_key_t* key, const uint8_t** output_data, size_t* output_size, decode_cache_t* cache)
+{
+    size_t slot_index = dcache_slot_of(key->key_hash, cache->slots_mask);
+    const struct dcache_index_entry* entry;
+
+    for (;;)
+    {
+        entry = cache->slots[slot_index].slot_entry;
+        if (entry == NULL)
+        {
+            cache->cache_misses++;
+            return false;
+        }
+        if (memcmp(entry->entry_key, key->key_hash, SHA256_DIGEST_SIZE) == 0)
+        {
+            break;
+        }
+        slot_index = (slot_index + 1) & cache->slots_mask;
+    }
+
+    /* The index is trusted only if the record agrees with it, a corrupt size must not wrap the
+     * bound around
+    */
+    uint64_t pack_offset = entry->pack_offset;
+    uint64_t data_size = entry->data_size;
+    if (pack_offset > cache->pack_map_size || cache->pack_map_size - pack_offset < sizeof(struct dcache_pack_record) ||
+        data_size > cache->pack_map_size - pack_offset - sizeof(struct dcache_pack_record))
+    {
+        cache->cache_misses++;
+        return false;
+    }
+
+    const struct dcache_pack_record* record = (const struct dcache_pack_record*)(cache->pack_map + pack_offset);
+    if (record->record_magic != DCACHE_RECORD_MAGIC || record->data_size != data_size ||
+        memcmp(record->record_key, key->key_hash, SHA256_DIGEST_SIZE) != 0)
+    {
+        cache->cache_misses++;
+        return false;
+    }
+
+    atomic_store_explicit((_Atomic uint64_t*)&entry->last_access, dcache_now(), memory_order_relaxed);
+
+    *output_data = (const uint8_t*)(record + 1);
+    *output_size = (size_t)data_size;
+    cache->cache_hits++;
+
+    return true;
+}
+
+void dcache_store_begin(const dcache_key_t* key, dcache_store_t* store, const decode_cache_t* cache)
+{
+    memset(store, 0, sizeof(*store));
+    store->store_key = *key;
+    store->store_limit = cache->size_budget / 8;
+}
+
+bool dcache_store_append(const void* data, size_t data_size, dcache_store_t* store)
+{
+    if (store->store_dropped)
+    {
+        return true;
+    }
+
+    if (store->store_size + data_size > store->store_limit)
+    {
+        dcache_store_abort(store);
+        store->store_dropped = true;
+        return true;
+    }
+
+    if (store->store_size + data_size > store->store_capacity)
+    {
+        size_t new_capacity = store->store_capacity != 0 ? store->store_capacity : DCACHE_STORE_INITIAL;
+        while (new_capacity < store->store_size + data_size)
+        {
+            new_capacity *= 2;
+        }
+
+        uint8_t* new_data = realloc(store->store_data, new_capacity);
+        if (new_data == NULL)
+        {
+            dcache_store_abort(store);
+            store->store_dropped = true;
+            return false;
+        }
+        store->store_data = new_data;
+        store->store_capacity = new_capacity;
+    }
+
+    memcpy(store->store_data + store->store_size, data, data_size);
+    store->store_size += data_size;
+
+    return true;
+}
+
+void dcache_store_abort(dcache_store_t* store)
+{
+    if (store->store_data != NULL)
+    {
+        free((void*)store->store_data);
+    }
+    store->store_data = NULL;
+    store->store_size = 0;
+    store->store_capacity = 0;
+}
+
+bool dcache_store_commit(dcache_store_t* store, decode_cache_t* cache)
+{
+    char index_path[DCACHE_PATH_MAX];
+    struct stat index_stat;
+    bool commit_ret = false;
+
+    if (store->store_dropped)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&cache->store_lock);
+    flock(cache->lock_fd, LOCK_EX);
+
+    /* Another process evicted while we're running, our files aren't the current anymore */
+    if (dcache_path(cache->cache_dir, "decode.index", index_path) == false || stat(index_path, &index_stat) != 0 ||
+        index_stat.st_ino != cache->index_inode)
+    {
+        goto commit_finished;
+    }
+
+    off_t pack_end = lseek(cache->pack_fd, 0, SEEK_END);
+    struct dcache_index_header index_header;
+    if (pack_end < 0 || dcache_header_valid(cache->index_fd, &index_header) == false)
+    {
+        goto commit_finished;
+    }
+
+    struct dcache_pack_record record = {
+        .record_magic = DCACHE_RECORD_MAGIC,
+        .data_size = store->store_size
+    };
+    memcpy(record.record_key, store->store_key.key_hash, SHA256_DIGEST_SIZE);
+
+    struct dcache_index_entry entry = {
+        .pack_offset = DCACHE_ALIGN((uint64_t)pack_end),
+        .data_size = store->store_size,
+        .last_access = dcache_now()
+    };
+    memcpy(entry.entry_key, store->store_key.key_hash, SHA256_DIGEST_SIZE);
+
+    /* The record must be complete before the index points to it */
+    commit_ret = dcache_write_all(cache->pack_fd, &record, sizeof(record), (off_t)entry.pack_offset);
+    if (commit_ret && store->store_size != 0)
+    {
+        commit_ret = dcache_write_all(cache->pack_fd, store->store_data, store->store_size, (off_t)(entry.pack_offset + sizeof(record)));
+    }
+
+    if (commit_ret)
+    {
+        off_t entry_offset = (off_t)(sizeof(index_header) + index_header.entries_count * sizeof(entry));
+        commit_ret = dcache_write_all(cache->index_fd, &entry, sizeof(entry), entry_offset);
+
+        index_header.entries_count++;
+        commit_ret = commit_ret && dcache_write_all(cache->index_fd, &index_header, sizeof(index_header), 0);
+    }
+
+    if (commit_ret)
+    {
+        cache->cache_stores++;
+    }
+
+commit_finished:
+    flock(cache->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&cache->store_lock);
+
+    dcache_store_abort(store);
+
+    return commit_ret;
+}
+
+static int dcache_recent_first(const void* first, const void* second)
+{
+    uint64_t first_access = ((const struct dcache_index_entry*)first)->last_access;
+    uint64_t second_access = ((const struct dcache_index_entry*)second)->last_access;
+
+    return first_access < second_access ? 1 : first_access > second_access ? -1 : 0;
+}
+
+static bool dcache_copy_record(const struct dcache_index_entry* entry, int source_fd, int pack_fd, uint64_t pack_offset, uint8_t* copy_piece)
+{
+    uint64_t record_size = sizeof(struct dcache_pack_record) + entry->data_size;
+
+    for (uint64_t copied = 0; copied < record_size; )
+    {
+        size_t piece_size = record_size - copied < DCACHE_COPY_PIECE ? (size_t)(record_size - copied) : DCACHE_COPY_PIECE;
+
+        if (dcache_read_all(source_fd, copy_piece, piece_size, (off_t)(entry->pack_offset + copied)) == false ||
+            dcache_write_all(pack_fd, copy_piece, piece_size, (off_t)(pack_offset + copied)) == false)
+        {
+            return false;
+        }
+        copied += piece_size;
+    }
+    return true;
+}
+
+/* Rewrites the pack only when his size is above `size_limit` */
+static bool dcache_trim(size_t size_limit, size_t target_size, decode_cache_t* cache)
+{
+    char index_path[DCACHE_PATH_MAX];
+    char pack_path[DCACHE_PATH_MAX];
+    struct dcache_index_header index_header;
+    struct dcache_index_entry* entries = NULL;
+    uint8_t* copy_piece = NULL;
+    int index_fd = -1;
+    int source_fd = -1;
+    int pack_fd = -1;
+    bool evict_ret = false;
+
+    pthread_mutex_lock(&cache->store_lock);
+    flock(cache->lock_fd, LOCK_EX);
+
+    /* Works over the current files, they may be newer than ours */
+    if (dcache_path(cache->cache_dir, "decode.index", index_path) == false)
+    {
+        goto evict_finished;
+    }
+    index_fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (index_fd < 0 || dcache_header_valid(index_fd, &index_header) == false)
+    {
+        goto evict_finished;
+    }
+
+    size_t entries_count = index_header.entries_count;
+    entries = malloc((entries_count + 1) * sizeof(*entries));
+    if (entries == NULL || dcache_read_all(index_fd, entries, entries_count * sizeof(*entries), sizeof(index_header)) == false)
+    {
+        goto evict_finished;
+    }
+
+    uint64_t pack_size = sizeof(struct dcache_pack_header);
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        pack_size += DCACHE_ALIGN(sizeof(struct dcache_pack_record) + entries[entry_cur].data_size);
+    }
+    if (pack_size <= size_limit)
+    {
+        evict_ret = true;
+        goto evict_finished;
+    }
+
+    if (dcache_pack_path(cache->cache_dir, index_header.pack_generation, pack_path) == false)
+    {
+        goto evict_finished;
+    }
+    copy_piece = malloc(DCACHE_COPY_PIECE);
+    source_fd = open(pack_path, O_RDONLY | O_CLOEXEC);
+    pack_fd = dcache_create_pack(index_header.pack_generation + 1, cache);
+    if (copy_piece == NULL || source_fd < 0 || pack_fd < 0)
+    {
+        goto evict_finished;
+    }
+
+    qsort(entries, entries_count, sizeof(*entries), dcache_recent_first);
+
+    uint64_t pack_offset = sizeof(struct dcache_pack_header);
+    size_t kept_count = 0;
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        struct dcache_index_entry* entry = &entries[entry_cur];
+        uint64_t record_size = DCACHE_ALIGN(sizeof(struct dcache_pack_record) + entry->data_size);
+
+        if (pack_offset + record_size > target_size)
+        {
+            break;
+        }
+        if (dcache_copy_record(entry, source_fd, pack_fd, pack_offset, copy_piece) == false)
+        {
+            goto evict_finished;
+        }
+
+        entries[kept_count] = *entry;
+        entries[kept_count++].pack_offset = pack_offset;
+        pack_offset += record_size;
+    }
+
+    evict_ret = dcache_publish_index(index_header.pack_generation + 1, entries, kept_count, cache);
+    if (evict_ret)
+    {
+        /* Processes that mapped the old pack still have it */
+        unlink(pack_path);
+    }
+
+evict_finished:
+    if (evict_ret == false && pack_fd >= 0 && dcache_pack_path(cache->cache_dir, index_header.pack_generation + 1, pack_path))
+    {
+        unlink(pack_path);
+    }
+    if (pack_fd >= 0) close(pack_fd);
+    if (source_fd >= 0) close(source_fd);
+    if (index_fd >= 0) close(index_fd);
+    free((void*)copy_piece);
+    free((void*)entries);
+
+    flock(cache->lock_fd, LOCK_UN);
+    pthread_mutex_unlock(&cache->store_lock);
+
+    return evict_ret;
+}
+
+bool dcache_evict(size_t target_size, decode_cache_t* cache)
+{
+    return dcache_trim(target_size, target_size, cache);
+}
+
+void dcache_close(decode_cache_t* cache)
+{
+    if (cache->cache_dir == NULL)
+    {
+        return;
+    }
+
+    /* Evicts a bit more than needed, so the next runs doesn't rewrite the pack again */
+    dcache_trim(cache->size_budget, cache->size_budget - cache->size_budget / 4, cache);
+
+    dcache_unmap(cache);
+    close(cache->lock_fd);
+    free((void*)cache->cache_dir);
+    pthread_mutex_destroy(&cache->store_lock);
+
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,107 @@
+#ifndef STORAGE_DECODE_CACHE_H
+#define STORAGE_DECODE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "crypto/SHA_256.h"
+
+/* The cache directory has:
+ * - lock: flock'd shared while opening and exclusive while writing
+ * - decode.index: a header and fixed size entries (key, offset, size, last access)
+ * - decode-<generation>.pack: records with the decoded outputs, append only
+ * The eviction writes a new pack generation and renames a new index over the old one,
+ * processes that already mapped the old files still read them without problems
+*/
+
+typedef struct dcache_key
+{
+    uint8_t key_hash[SHA256_DIGEST_SIZE];
+} dcache_key_t;
+
+struct dcache_slot;
+
+typedef struct decode_cache
+{
+    char* cache_dir;
+
+    size_t size_budget;
+
+    int lock_fd;
+
+    int index_fd;
+
+    int pack_fd;
+
+    ino_t index_inode;
+
+    uint64_t pack_generation;
+
+    /* Entries that exist when the cache has been opened, mapped as shared for update the
+     * access times in place
+    */
+    uint8_t* index_map;
+
+    size_t index_map_size;
+
+    const uint8_t* pack_map;
+
+    size_t pack_map_size;
+
+    /* Read only after the open, the lookups doesn't need a lock */
+    struct dcache_slot* slots;
+
+    size_t slots_mask;
+
+    pthread_mutex_t store_lock;
+
+    _Atomic size_t cache_hits;
+
+    _Atomic size_t cache_misses;
+
+    _Atomic size_t cache_stores;
+
+} decode_cache_t;
+
+/* Collects an output while it's produced, before be written into the pack */
+typedef struct dcache_store
+{
+    dcache_key_t store_key;
+
+    uint8_t* store_data;
+
+    size_t store_size;
+
+    size_t store_capacity;
+
+    /* Outputs greater than this are not worth the space */
+    size_t store_limit;
+
+    bool store_dropped;
+
+} dcache_store_t;
+
+bool dcache_open(const char* cache_dir, size_t size_budget, decode_cache_t* cache);
+/* Evicts the least recently used outputs when the cache is greater than the budget */
+void dcache_close(decode_cache_t* cache);
+
+/* The key context must have everything that changes the output: decoder version, settings... */
+void dcache_make_key(const void* content, size_t content_size, const char* key_context, dcache_key_t* key);
+
+/* Returns a pointer to the mapped pack, valid until the cache is closed */
+bool dcache_lookup(const dcache_key_t* key, const uint8_t** output_data, size_t* output_size, decode_cache_t* cache);
+
+void dcache_store_begin(const dcache_key_t* key, dcache_store_t* store, const decode_cache_t* cache);
+bool dcache_store_append(const void* data, size_t data_size, dcache_store_t* store);
+/* Both release the store buffer */
+bool dcache_store_commit(dcache_store_t* store, decode_cache_t* cache);
+void dcache_store_abort(dcache_store_t* store);
+
+/* Keeps the most recently used outputs that fits in `target_size` */
+bool dcache_evict(size_t target_size, decode_cache_t* cache);
+
+#endif
+
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "Thread_Pool.h"
+#include "sign/Apk_Signature.h"
+#include "data/Output_Buffer.h"
+
+#define TEST_BIG_ENTRY (9 * 1024 * 1024 + 12345)
+#define BENCH_ENTRY (96 * 1024 * 1024)
+
+static void put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* data, uint32_t value)
+{
+    put_u16(data, (uint16_t)value);
+    put_u16(data + 2, (uint16_t)(value >> 16));
+}
+
+static void put_u64(uint8_t* data, uint64_t value)
+{
+    put_u32(data, (uint32_t)value);
+    put_u32(data + 4, (uint32_t)(value >> 32));
+}
+
+static void append_u32(uint32_t value, output_buffer_t* output)
+{
+    uint8_t bytes[4];
+    put_u32(bytes, value);
+    outbuf_append(bytes, sizeof(bytes), output);
+}
+
+/* Stored entries, the central directory is built apart to put the signing block between */
+static void make_entries(const char* const names[], const uint8_t* const contents[], const size_t sizes[], size_t entries_count,
+    output_buffer_t* entries, output_buffer_t* central_dir)
+{
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        uint8_t header[ZIP_CENTRAL_HEADER_SIZE] = { 0 };
+        uint16_t name_length = (uint16_t)strlen(names[entry_cur]);
+        uint32_t entry_crc = (uint32_t)crc32(0, contents[entry_cur], (uInt)sizes[entry_cur]);
+        uint32_t local_offset = (uint32_t)outbuf_length(entries);
+
+        put_u32(header, ZIP_LOCAL_HEADER_MAGIC);
+        put_u16(header + 4, 10);
+        put_u32(header + 14, entry_crc);
+        put_u32(header + 18, (uint32_t)sizes[entry_cur]);
+        put_u32(header + 22, (uint32_t)sizes[entry_cur]);
+        put_u16(header + 26, name_length);
+        outbuf_append(header, ZIP_LOCAL_HEADER_SIZE, entries);
+        outbuf_append(names[entry_cur], name_length, entries);
+        outbuf_append(contents[entry_cur], sizes[entry_cur], entries);
+
+        memset(header, 0, sizeof(header));
+        put_u32(header, ZIP_CENTRAL_HEADER_MAGIC);
+        put_u16(header + 4, 20);
+        put_u16(header + 6, 10);
+        put_u32(header + 16, entry_crc);
+        put_u32(header + 20, (uint32_t)sizes[entry_cur]);
+        put_u32(header + 24, (uint32_t)sizes[entry_cur]);
+        put_u16(header + 28, name_length);
+        put_u32(header + 42, local_offset);
+        outbuf_append(header, ZIP_CENTRAL_HEADER_SIZE, central_dir);
+        outbuf_append(names[entry_cur], name_length, central_dir);
+    }
+}
+
+static void make_eocd(uint16_t entries_count, uint32_t central_size, uint32_t central_offset, uint8_t eocd[ZIP_EOCD_SIZE])
+{
+    memset(eocd, 0, ZIP_EOCD_SIZE);
+    put_u32(eocd, ZIP_EOCD_MAGIC);
+    put_u16(eocd + 8, entries_count);
+    put_u16(eocd + 10, entries_count);
+    put_u32(eocd + 12, central_size);
+    put_u32(eocd + 16, central_offset);
+}
+
+/* The digest as written by the scheme, one chunk after the other with the portable code */
+static void reference_digest(const uint8_t* sections[3], const size_t sections_size[3], uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    output_buffer_t chunk_digests;
+    uint32_t chunks_count = 0;
+    sha256_impl_t saved_impl = sha256_implementation();
+
+    assert(sha256_use(SHA256_PORTABLE));
+    outbuf_init(0, NULL, NULL, &chunk_digests);
+
+    for (size_t section_cur = 0; section_cur < 3; section_cur++)
+    {
+        for (size_t chunk_offset = 0; chunk_offset < sections_size[section_cur]; chunk_offset += APKSIG_CHUNK_SIZE)
+        {
+            size_t chunk_size = sections_size[section_cur] - chunk_offset;
+            uint8_t chunk_prefix[5] = { 0xa5 };
+            uint8_t chunk_digest[SHA256_DIGEST_SIZE];
+            sha256_ctx_t sha_ctx;
+
+            chunk_size = chunk_size < APKSIG_CHUNK_SIZE ? chunk_size : APKSIG_CHUNK_SIZE;
+            put_u32(chunk_prefix + 1, (uint32_t)chunk_size);
+            sha256_init(&sha_ctx);
+            sha256_update(chunk_prefix, sizeof(chunk_prefix), &sha_ctx);
+            sha256_update(sections[section_cur] + chunk_offset, chunk_size, &sha_ctx);
+            sha256_final(chunk_digest, &sha_ctx);
+
+            outbuf_append(chunk_digest, sizeof(chunk_digest), &chunk_digests);
+            chunks_count++;
+        }
+    }
+
+    uint8_t top_prefix[5] = { 0x5a };
+    sha256_ctx_t sha_ctx;
+
+    put_u32(top_prefix + 1, chunks_count);
+    sha256_init(&sha_ctx);
+    sha256_update(top_prefix, sizeof(top_prefix), &sha_ctx);
+    sha256_update(chunk_digests.buffer_data, outbuf_length(&chunk_digests), &sha_ctx);
+    sha256_final(digest, &sha_ctx);
+
+    outbuf_deinit(&chunk_digests);
+    sha256_use(saved_impl);
+}
+
+/* A scheme value with one signer, his signed data only has the digests */
+static void append_scheme(uint32_t scheme_id, uint32_t algorithm_id, const uint8_t digest[SHA256_DIGEST_SIZE], output_buffer_t* pairs)
+{
+    uint8_t pair_header[12];
+    const uint32_t digest_item = 4 + 4 + SHA256_DIGEST_SIZE;
+    const uint32_t signed_data = 4 + 4 + digest_item;
+    const uint32_t signer = 4 + signed_data;
+    const uint32_t signers = 4 + signer;
+
+    put_u64(pair_header, 4 + 4 + signers);
+    put_u32(pair_header + 8, scheme_id);
+    outbuf_append(pair_header, sizeof(pair_header), pairs);
+
+    append_u32(signers, pairs);
+    append_u32(signer, pairs);
+    append_u32(signed_data, pairs);
+    append_u32(4 + digest_item, pairs);
+    append_u32(digest_item, pairs);
+    append_u32(algorithm_id, pairs);
+    append_u32(SHA256_DIGEST_SIZE, pairs);
+    outbuf_append(digest, SHA256_DIGEST_SIZE, pairs);
+}
+
+/* entries | signing block | central directory | EOCD */
+static uint8_t* make_signed_apk(const output_buffer_t* entries, const output_buffer_t* central_dir, uint16_t entries_count,
+    uint32_t algorithm_id, bool corrupt_digest, size_t* apk_size)
+{
+    uint8_t eocd[ZIP_EOCD_SIZE];
+    size_t entries_size = outbuf_length(entries);
+    size_t central_size = outbuf_length(central_dir);
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    output_buffer_t pairs;
+
+    /* The digested EOCD points to the signing block */
+    make_eocd(entries_count, (uint32_t)central_size, (uint32_t)entries_size, eocd);
+    const uint8_t* sections[3] = { (const uint8_t*)entries->buffer_data, (const uint8_t*)central_dir->buffer_data, eocd };
+    const size_t sections_size[3] = { entries_size, central_size, ZIP_EOCD_SIZE };
+    reference_digest(sections, sections_size, digest);
+    digest[0] ^= corrupt_digest;
+
+    outbuf_init(0, NULL, NULL, &pairs);
+    append_scheme(APKSIG_V2_ID, algorithm_id, digest, &pairs);
+    append_scheme(APKSIG_V3_ID, algorithm_id, digest, &pairs);
+
+    size_t pairs_size = outbuf_length(&pairs);
+    size_t block_size = pairs_size + 24;
+    *apk_size = entries_size + 8 + block_size + central_size + ZIP_EOCD_SIZE;
+    uint8_t* apk_data = malloc(*apk_size);
+    uint8_t* cursor = apk_data;
+
+    memcpy(cursor, entries->buffer_data, entries_size);
+    cursor += entries_size;
+    put_u64(cursor, block_size);
+    memcpy(cursor + 8, pairs.buffer_data, pairs_size);
+    put_u64(cursor + 8 + pairs_size, block_size);
+    memcpy(cursor + 16 + pairs_size, APKSIG_BLOCK_MAGIC, 16);
+    cursor += 8 + block_size;
+    memcpy(cursor, central_dir->buffer_data, central_size);
+    cursor += central_size;
+    make_eocd(entries_count, (uint32_t)central_size, (uint32_t)(entries_size + 8 + block_size), cursor);
+
+    outbuf_deinit(&pairs);
+    return apk_data;
+}
+
+static apksig_status_t verify_memory(const uint8_t* apk_data, size_t apk_size, apksig_report_t* report, tpool_t* thread_pool)
+{
+    zip_archive_t archive;
+
+    assert(zip_open_memory(apk_data, apk_size, &archive));
+    assert(apksig_verify(&archive, report, thread_pool));
+    zip_close(&archive);
+
+    assert(report->scheme_status[0] == report->scheme_status[1]);
+    return report->scheme_status[0];
+}
+
+static double elapsed_seconds(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void check_archives(tpool_t* thread_pool)
+{
+    uint8_t* big_entry = malloc(TEST_BIG_ENTRY);
+    const char* names[] = { "classes.dex", "AndroidManifest.xml", "res/raw/blob.bin" };
+    const uint8_t* contents[] = { (const uint8_t*)"dex\n035\0", (const uint8_t*)"<manifest/>", big_entry };
+    const size_t sizes[] = { 8, 11, TEST_BIG_ENTRY };
+    output_buffer_t entries, central_dir;
+    apksig_report_t report;
+    size_t apk_size;
+
+    assert(big_entry != NULL);
+    for (size_t byte_cur = 0; byte_cur < TEST_BIG_ENTRY; byte_cur++)
+    {
+        big_entry[byte_cur] = (uint8_t)(byte_cur * 2654435761u >> 13);
+    }
+    outbuf_init(0, NULL, NULL, &entries);
+    outbuf_init(0, NULL, NULL, &central_dir);
+    make_entries(names, contents, sizes, 3, &entries, &central_dir);
+
+    uint8_t* apk_data = make_signed_apk(&entries, &central_dir, 3, 0x0103, false, &apk_size);
+
+    /* All block functions digest the same, with or without the pool */
+    uint8_t first_digest[SHA256_DIGEST_SIZE];
+    sha256_impl_t best_impl = sha256_implementation();
+    for (int impl_cur = SHA256_PORTABLE; impl_cur <= SHA256_SHANI; impl_cur++)
+    {
+        if (sha256_use((sha256_impl_t)impl_cur) == false)
+        {
+            continue;
+        }
+        assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_DIGEST_MATCH);
+        assert(verify_memory(apk_data, apk_size, &report, NULL) == APKSIG_DIGEST_MATCH);
+        if (impl_cur == SHA256_PORTABLE)
+        {
+            memcpy(first_digest, report.content_digest, SHA256_DIGEST_SIZE);
+        }
+        assert(memcmp(first_digest, report.content_digest, SHA256_DIGEST_SIZE) == 0);
+    }
+    sha256_use(best_impl);
+    assert(report.chunks_count == 10 + 1 + 1);
+
+    /* A byte changed anywhere but in the block */
+    apk_data[ZIP_LOCAL_HEADER_SIZE + 3] ^= 1;
+    assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_MISMATCH);
+    apk_data[ZIP_LOCAL_HEADER_SIZE + 3] ^= 1;
+    apk_data[TEST_BIG_ENTRY / 2] ^= 0x80;
+    assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_MISMATCH);
+    free((void*)apk_data);
+
+    apk_data = make_signed_apk(&entries, &central_dir, 3, 0x0103, true, &apk_size);
+    assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_MISMATCH);
+    free((void*)apk_data);
+
+    /* Only a SHA-512 digest */
+    apk_data = make_signed_apk(&entries, &central_dir, 3, 0x0104, false, &apk_size);
+    assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_UNSUPPORTED);
+    free((void*)apk_data);
+
+    /* Without the block */
+    uint8_t eocd[ZIP_EOCD_SIZE];
+    make_eocd(3, (uint32_t)outbuf_length(&central_dir), (uint32_t)outbuf_length(&entries), eocd);
+    outbuf_append(central_dir.buffer_data, outbuf_length(&central_dir), &entries);
+    outbuf_append(eocd, sizeof(eocd), &entries);
+    assert(verify_memory((const uint8_t*)entries.buffer_data, outbuf_length(&entries), &report, thread_pool) == APKSIG_ABSENT);
+
+    outbuf_deinit(&entries);
+    outbuf_deinit(&central_dir);
+    free((void*)big_entry);
+}
+
+static void bench_verify(tpool_t* thread_pool)
+{
+    uint8_t* bench_entry = malloc(BENCH_ENTRY);
+    const char* names[] = { "assets/ota.bin" };
+    const uint8_t* contents[] = { bench_entry };
+    const size_t sizes[] = { BENCH_ENTRY };
+    output_buffer_t entries, central_dir;
+    apksig_report_t report;
+    size_t apk_size;
+
+    assert(bench_entry != NULL);
+    memset(bench_entry, 0x3c, BENCH_ENTRY);
+    outbuf_init(0, NULL, NULL, &entries);
+    outbuf_init(0, NULL, NULL, &central_dir);
+    make_entries(names, contents, sizes, 1, &entries, &central_dir);
+
+    uint8_t* apk_data = make_signed_apk(&entries, &central_dir, 1, 0x0201, false, &apk_size);
+    sha256_impl_t best_impl = sha256_implementation();
+    static const char* impl_names[] = { "portable", "avx2 x8", "sha-ni" };
+
+    for (int impl_cur = SHA256_PORTABLE; impl_cur <= SHA256_SHANI; impl_cur++)
+    {
+        struct timespec start;
+
+        if (sha256_use((sha256_impl_t)impl_cur) == false)
+        {
+            continue;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        assert(verify_memory(apk_data, apk_size, &report, thread_pool) == APKSIG_DIGEST_MATCH);
+        printf("%s: %zu MB digested at %.0f MB/s\n", impl_names[impl_cur], apk_size >> 20, (double)apk_size / 1e6 / elapsed_seconds(&start));
+    }
+    sha256_use(best_impl);
+
+    free((void*)apk_data);
+    outbuf_deinit(&entries);
+    outbuf_deinit(&central_dir);
+    free((void*)bench_entry);
+}
+
+int main(void)
+{
+    tpool_t thread_pool;
+    assert(tpool_init(4, &thread_pool));
+
+    check_archives(&thread_pool);
+    bench_verify(&thread_pool);
+
+    tpool_stop(&thread_pool);
+    tpool_finalize(&thread_pool);
+
+    puts("APK signature test passed");
+    return 0;
+}
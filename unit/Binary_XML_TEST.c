@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Thread_Pool.h"
+#include "decode/Binary_XML.h"
+#include "decode/Resource_Table.h"
+
+#define WORKERS_COUNT 2
+
+/* A tiny little endian writer, used for build the binary documents in memory */
+static uint8_t doc_buffer[4096];
+static size_t doc_size;
+
+static size_t put16(uint16_t value)
+{
+    size_t offset = doc_size;
+    doc_buffer[doc_size++] = value & 0xff;
+    doc_buffer[doc_size++] = value >> 8;
+    return offset;
+}
+
+static size_t put32(uint32_t value)
+{
+    size_t offset = put16(value & 0xffff);
+    put16(value >> 16);
+    return offset;
+}
+
+static void patch32(size_t offset, uint32_t value)
+{
+    doc_buffer[offset] = value & 0xff;
+    doc_buffer[offset + 1] = (value >> 8) & 0xff;
+    doc_buffer[offset + 2] = (value >> 16) & 0xff;
+    doc_buffer[offset + 3] = value >> 24;
+}
+
+/* Returns the chunk offset, the size must be patched with chunk_end */
+static size_t chunk_begin(uint16_t type, uint16_t header_size)
+{
+    size_t offset = put16(type);
+    put16(header_size);
+    put32(0);
+    return offset;
+}
+
+static void chunk_end(size_t chunk_offset)
+{
+    while (doc_size % 4) doc_buffer[doc_size++] = 0;
+    patch32(chunk_offset + 4, (uint32_t)(doc_size - chunk_offset));
+}
+
+static void put_pool(const char** strings, uint32_t count, bool utf8)
+{
+    size_t pool = chunk_begin(0x0001, 28);
+    put32(count);
+    put32(0);
+    put32(utf8 ? 1 << 8 : 0);
+    size_t strings_start = put32(0);
+    put32(0);
+
+    size_t offsets = doc_size;
+    for (uint32_t cur = 0; cur < count; cur++) put32(0);
+    patch32(strings_start, (uint32_t)(doc_size - pool));
+
+    size_t data_begin = doc_size;
+    for (uint32_t cur = 0; cur < count; cur++)
+    {
+        size_t length = strlen(strings[cur]);
+        patch32(offsets + cur * 4, (uint32_t)(doc_size - data_begin));
+        if (utf8)
+        {
+            doc_buffer[doc_size++] = (uint8_t)length;
+            doc_buffer[doc_size++] = (uint8_t)length;
+            memcpy(doc_buffer + doc_size, strings[cur], length + 1);
+            doc_size += length + 1;
+        }
+        else
+        {
+            put16((uint16_t)length);
+            for (size_t char_cur = 0; char_cur <= length; char_cur++) put16((uint8_t)strings[cur][char_cur]);
+        }
+    }
+    chunk_end(pool);
+}
+
+static bool collect_output(const char* data, size_t size, void* context)
+{
+    char* text = (char*)context;
+    strncat(text, data, size);
+    return true;
+}
+
+static void axml_test(intern_table_t* shared_strings)
+{
+    static const char* strings[] = { 
+        "android", "http://schemas.android.com/apk/res/android", "manifest", "package", 
+        "org.example", "versionCode", "uses-sdk", "a<b", "label"
+    };
+
+    doc_size = 0;
+    size_t document = chunk_begin(0x0003, 8);
+    put_pool(strings, 9, false);
+
+    size_t start_ns = chunk_begin(0x0100, 16);
+    put32(1); put32(0xffffffff); put32(0); put32(1);
+    chunk_end(start_ns);
+
+    size_t manifest = chunk_begin(0x0102, 16);
+    put32(1); put32(0xffffffff);
+    put32(0xffffffff); put32(2);
+    put16(20); put16(20); put16(3); put16(0); put16(0); put16(0);
+    /* package="org.example" */
+    put32(0xffffffff); put32(3); put32(4); put16(8); doc_buffer[doc_size++] = 0; doc_buffer[doc_size++] = 3; put32(4);
+    /* android:versionCode="7" */
+    put32(1); put32(5); put32(0xffffffff); put16(8); doc_buffer[doc_size++] = 0; doc_buffer[doc_size++] = 0x10; put32(7);
+    /* android:label="a<b" */
+    put32(1); put32(8); put32(7); put16(8); doc_buffer[doc_size++] = 0; doc_buffer[doc_size++] = 3; put32(7);
+    chunk_end(manifest);
+
+    size_t uses_sdk = chunk_begin(0x0102, 16);
+    put32(1); put32(0xffffffff);
+    put32(0xffffffff); put32(6);
+    put16(20); put16(20); put16(0); put16(0); put16(0); put16(0);
+    chunk_end(uses_sdk);
+    size_t uses_sdk_end = chunk_begin(0x0103, 16);
+    put32(1); put32(0xffffffff); put32(0xffffffff); put32(6);
+    chunk_end(uses_sdk_end);
+
+    size_t manifest_end = chunk_begin(0x0103, 16);
+    put32(1); put32(0xffffffff); put32(0xffffffff); put32(2);
+    chunk_end(manifest_end);
+
+    chunk_end(document);
+
+    static char xml_text[2048];
+    output_buffer_t xml_output;
+    /* A very small buffer, so the flush path is exercised */
+    outbuf_init(16, collect_output, xml_text, &xml_output);
+
+    assert(axml_decode(doc_buffer, doc_size, shared_strings, &xml_output));
+    printf("%s", xml_text);
+
+    assert(strstr(xml_text, "<manifest xmlns:android=\"http://schemas.android.com/apk/res/android\"") != NULL);
+    assert(strstr(xml_text, " package=\"org.example\"") != NULL);
+    assert(strstr(xml_text, " android:versionCode=\"7\"") != NULL);
+    assert(strstr(xml_text, " android:label=\"a&lt;b\"") != NULL);
+    assert(strstr(xml_text, "  <uses-sdk/>\n</manifest>\n") != NULL);
+
+    /* Truncated documents must be rejected */
+    outbuf_reset(&xml_output);
+    assert(axml_decode(doc_buffer, doc_size - 4, shared_strings, &xml_output) == false);
+
+    outbuf_deinit(&xml_output);
+}
+
+static void arsc_test(intern_table_t* shared_strings, tpool_t* thread_pool)
+{
+    static const char* values[] = { "Hello" };
+    static const char* types[] = { "string", "dimen" };
+    static const char* keys[] = { "app_name", "margin" };
+
+    doc_size = 0;
+    size_t table = chunk_begin(0x0002, 12);
+    put32(1);
+    put_pool(values, 1, true);
+
+    size_t package = chunk_begin(0x0200, 288);
+    put32(0x7f);
+    const char* package_name = "org.example";
+    for (int char_cur = 0; char_cur < 128; char_cur++) 
+    {
+        put16(char_cur < (int)strlen(package_name) ? (uint8_t)package_name[char_cur] : 0);
+    }
+    size_t type_strings = put32(0); put32(0);
+    size_t key_strings = put32(0); put32(0); put32(0);
+
+    patch32(type_strings, (uint32_t)(doc_size - package));
+    put_pool(types, 2, true);
+    patch32(key_strings, (uint32_t)(doc_size - package));
+    put_pool(keys, 2, false);
+
+    size_t first_type = doc_size;
+    for (uint8_t type_id = 1; type_id <= 2; type_id++)
+    {
+        /* Header: 20 bytes + 36 bytes of configuration */
+        size_t type = chunk_begin(0x0201, 56);
+        doc_buffer[doc_size++] = type_id; doc_buffer[doc_size++] = 0; put16(0);
+        put32(2);
+        size_t entries_start = put32(0);
+        put32(36);
+        for (int config_cur = 0; config_cur < 8; config_cur++) put32(0);
+        if (type_id == 2)
+        {
+            /* sdkVersion = 21 */
+            doc_buffer[type + 20 + 24] = 21;
+        }
+        put32(0); put32(0xffffffff);
+        patch32(entries_start, (uint32_t)(doc_size - type));
+        put16(8); put16(0); put32(type_id - 1u);
+        put16(8); doc_buffer[doc_size++] = 0; doc_buffer[doc_size++] = type_id == 1 ? 0x03 : 0x05; 
+        put32(type_id == 1 ? 0 : (16 << 8 | 1));
+        chunk_end(type);
+    }
+    chunk_end(package);
+    chunk_end(table);
+
+    static char arsc_text[4096];
+    arsc_text[0] = '\0';
+    output_buffer_t arsc_output;
+    outbuf_init(64, collect_output, arsc_text, &arsc_output);
+
+    assert(arsc_decode(doc_buffer, doc_size, shared_strings, &arsc_output, thread_pool));
+    printf("%s", arsc_text);
+
+    assert(strstr(arsc_text, "<package id=\"0x7f\" name=\"org.example\">") != NULL);
+    assert(strstr(arsc_text, "<type name=\"string\" id=\"0x01\" config=\"default\">\n"
+        "    <entry id=\"0x7f010000\" name=\"app_name\">Hello</entry>\n  </type>") != NULL);
+    assert(strstr(arsc_text, "<type name=\"dimen\" id=\"0x02\" config=\"v21\">\n"
+        "    <entry id=\"0x7f020000\" name=\"margin\">16dp</entry>") != NULL);
+
+    /* entries_start (8) below header_size (56): the offsets bound must not wrap and read past the chunk */
+    patch32(first_type + 12, 0x10000000);
+    patch32(first_type + 16, 8);
+    arsc_text[0] = '\0';
+    assert(arsc_decode(doc_buffer, doc_size, shared_strings, &arsc_output, thread_pool));
+    outbuf_flush(&arsc_output);
+    assert(strstr(arsc_text, "name=\"app_name\"") == NULL && strstr(arsc_text, "name=\"margin\"") != NULL);
+
+    outbuf_deinit(&arsc_output);
+}
+
+int main()
+{
+    tpool_t stack_pool;
+
+    axml_test(NULL);
+
+    /* Decoding inline and with the pool must produce the same text */
+    arsc_test(NULL, NULL);
+
+    tpool_init(WORKERS_COUNT, &stack_pool);
+    arsc_test(NULL, &stack_pool);
+
+    /* The same text with the UTF-16 strings converted into a shared table, each string once */
+    intern_table_t* shared_strings = intern_create();
+    axml_test(shared_strings);
+    size_t axml_strings = intern_count(shared_strings);
+    assert(axml_strings != 0);
+    axml_test(shared_strings);
+    assert(intern_count(shared_strings) == axml_strings);
+
+    arsc_test(shared_strings, &stack_pool);
+    assert(intern_count(shared_strings) == axml_strings + 2);
+    size_t key_length;
+    assert(strcmp(intern_lookup(intern_string("margin", 6, shared_strings), &key_length, shared_strings), "margin") == 0);
+    assert(intern_count(shared_strings) == axml_strings + 2);
+    intern_destroy(shared_strings);
+
+    tpool_stop(&stack_pool);
+    tpool_finalize(&stack_pool);
+
+    return 0;
+}
+
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "cpu/CPU_Time.h"
+
+#define THREADS_COUNT 4
+#define SAMPLES_BY_THREAD 1000
+
+static void* record_samples(void* data)
+{
+    (void)data;
+    cpu_time_stats_t* task_times = cpu_time_local(CPU_TIME_TASK);
+
+    for (int sample_cur = 0; sample_cur < SAMPLES_BY_THREAD; sample_cur++)
+    {
+        cpu_time_record((uint64_t)sample_cur + 1, task_times);
+    }
+    return NULL;
+}
+
+/* The scoped timer records when the block is left, a return included */
+static int scoped_work(cpu_time_stats_t* stats, int work_count)
+{
+    CPU_TIMER_SCOPE(stats);
+
+    volatile int work_sum = 0;
+    for (int work_cur = 0; work_cur < work_count; work_cur++)
+    {
+        if (work_cur == 1000)
+        {
+            return work_sum;
+        }
+        work_sum += work_cur;
+    }
+    return work_sum;
+}
+
+int main()
+{
+    /* The sleeps of one second or more were truncated to their nanoseconds */
+    uint64_t sleep_start = cpu_nanos();
+    cpu_sleep_nano(1020000000);
+    uint64_t slept = cpu_nanos() - sleep_start;
+    assert(slept >= 1020000000);
+
+    /* The fast clock agrees with the raw clock once calibrated */
+    uint64_t nanos_start = cpu_nanos();
+    uint64_t ticks_start = cpu_ticks();
+    while (cpu_nanos() - nanos_start < 150000000) {}
+    uint64_t nanos_elapsed = cpu_nanos() - nanos_start;
+    uint64_t ticks_nanos = cpu_ticks_to_nanos(cpu_ticks() - ticks_start);
+
+    printf("150ms: %lu ns by the raw clock, %lu ns by the ticks\n", (unsigned long)nanos_elapsed, (unsigned long)ticks_nanos);
+    assert(ticks_nanos > nanos_elapsed - nanos_elapsed / 50 && ticks_nanos < nanos_elapsed + nanos_elapsed / 50);
+
+    /* Histogram buckets are powers of 2 of ticks */
+    cpu_time_stats_t stats = { 0 };
+    for (uint64_t ticks = 1; ticks <= 1024; ticks++)
+    {
+        cpu_time_record(ticks, &stats);
+    }
+    assert(stats.samples_count == 1024 && stats.ticks_max == 1024);
+    assert(stats.histogram[0] == 1 && stats.histogram[9] == 512 && stats.histogram[10] == 1);
+    assert(cpu_time_percentile(0.5, &stats) <= cpu_time_percentile(0.99, &stats));
+    assert(cpu_time_percentile(1.0, &stats) == cpu_ticks_to_nanos(1024));
+
+    cpu_time_stats_t merged = { 0 };
+    cpu_time_merge(&stats, &merged);
+    cpu_time_merge(&stats, &merged);
+    assert(merged.samples_count == 2048 && merged.ticks_max == 1024 && merged.histogram[9] == 1024);
+
+    cpu_time_stats_t scoped = { 0 };
+    scoped_work(&scoped, 10);
+    scoped_work(&scoped, 5000);
+    assert(scoped.samples_count == 2);
+
+    /* The accumulators of each thread are collected after they've exited */
+    pthread_t threads[THREADS_COUNT];
+    for (int thread_cur = 0; thread_cur < THREADS_COUNT; thread_cur++)
+    {
+        assert(pthread_create(&threads[thread_cur], NULL, record_samples, NULL) == 0);
+    }
+    for (int thread_cur = 0; thread_cur < THREADS_COUNT; thread_cur++)
+    {
+        pthread_join(threads[thread_cur], NULL);
+    }
+    record_samples(NULL);
+
+    cpu_time_stats_t collected;
+    cpu_time_collect(CPU_TIME_TASK, &collected);
+    assert(collected.samples_count == (THREADS_COUNT + 1) * SAMPLES_BY_THREAD);
+    assert(collected.ticks_max == SAMPLES_BY_THREAD);
+    assert(cpu_time_local(CPU_TIME_TASK) == cpu_time_local(CPU_TIME_TASK));
+
+    return 0;
+}
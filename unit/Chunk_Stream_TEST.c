@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "net/Chunk_Stream.h"
+
+#define ZIP_CAPACITY (16 * 1024 * 1024)
+
+struct test_zip
+{
+    uint8_t* zip_data;
+
+    size_t zip_size;
+
+    uint8_t central_dir[4096];
+
+    size_t central_size;
+
+    uint16_t entries_count;
+};
+
+struct test_send
+{
+    int socket_fd;
+
+    const uint8_t* data;
+
+    size_t data_size;
+
+    chunk_stats_t stats;
+
+    tpool_t* thread_pool;
+
+    atomic_bool send_done;
+};
+
+struct test_entries
+{
+    char names[8][64];
+
+    size_t entries_count;
+
+    /* The first entry must be handed while the upload is still running */
+    bool early_entry;
+
+    struct test_send* send;
+};
+
+static uint32_t test_random;
+
+static uint8_t test_next_random(void)
+{
+    test_random = test_random * 1103515245 + 12345;
+    return (uint8_t)(test_random >> 16);
+}
+
+static void put16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t* data, uint32_t value)
+{
+    put16(data, (uint16_t)value);
+    put16(data + 2, (uint16_t)(value >> 16));
+}
+
+static void zip_add(const char* name, const uint8_t* content, size_t content_size, bool deflated, struct test_zip* zip)
+{
+    uint8_t* stored = (uint8_t*)content;
+    size_t stored_size = content_size;
+
+    if (deflated)
+    {
+        z_stream deflate_stream = { 0 };
+        stored = malloc(compressBound(content_size));
+        assert(deflateInit2(&deflate_stream, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+        deflate_stream.next_in = (uint8_t*)content;
+        deflate_stream.avail_in = (uInt)content_size;
+        deflate_stream.next_out = stored;
+        deflate_stream.avail_out = (uInt)compressBound(content_size);
+        assert(deflate(&deflate_stream, Z_FINISH) == Z_STREAM_END);
+        stored_size = deflate_stream.total_out;
+        deflateEnd(&deflate_stream);
+    }
+
+    uint32_t content_crc = (uint32_t)crc32(0, content, (uInt)content_size);
+    size_t name_length = strlen(name);
+    uint8_t* local = zip->zip_data + zip->zip_size;
+    uint8_t* central = zip->central_dir + zip->central_size;
+
+    memset(local, 0, 30);
+    put32(local, ZIP_LOCAL_HEADER_MAGIC);
+    put16(local + 8, deflated ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED);
+    put32(local + 14, content_crc);
+    put32(local + 18, (uint32_t)stored_size);
+    put32(local + 22, (uint32_t)content_size);
+    put16(local + 26, (uint16_t)name_length);
+    memcpy(local + 30, name, name_length);
+    memcpy(local + 30 + name_length, stored, stored_size);
+
+    memset(central, 0, 46);
+    put32(central, ZIP_CENTRAL_HEADER_MAGIC);
+    put16(central + 10, deflated ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED);
+    put32(central + 16, content_crc);
+    put32(central + 20, (uint32_t)stored_size);
+    put32(central + 24, (uint32_t)content_size);
+    put16(central + 28, (uint16_t)name_length);
+    put32(central + 42, (uint32_t)zip->zip_size);
+    memcpy(central + 46, name, name_length);
+
+    zip->zip_size += 30 + name_length + stored_size;
+    zip->central_size += 46 + name_length;
+    zip->entries_count++;
+
+    if (stored != content)
+    {
+        free((void*)stored);
+    }
+}
+
+static void zip_finish(struct test_zip* zip)
+{
+    uint8_t* eocd = zip->zip_data + zip->zip_size + zip->central_size;
+
+    memcpy(zip->zip_data + zip->zip_size, zip->central_dir, zip->central_size);
+    memset(eocd, 0, ZIP_EOCD_SIZE);
+    put32(eocd, ZIP_EOCD_MAGIC);
+    put16(eocd + 8, zip->entries_count);
+    put16(eocd + 10, zip->entries_count);
+    put32(eocd + 12, (uint32_t)zip->central_size);
+    put32(eocd + 16, (uint32_t)zip->zip_size);
+
+    zip->zip_size += zip->central_size + ZIP_EOCD_SIZE;
+}
+
+static void* test_sender(void* thread_data)
+{
+    struct test_send* send = (struct test_send*)thread_data;
+
+    assert(chunk_send(send->socket_fd, send->data, send->data_size, &send->stats, send->thread_pool));
+    send->send_done = true;
+
+    return NULL;
+}
+
+static bool test_entry(const zip_entry_t* entry, const zip_archive_t* archive, void* entry_data)
+{
+    struct test_entries* entries = (struct test_entries*)entry_data;
+    uint8_t* content = malloc(entry->uncompressed_size + 1);
+
+    if (entries->entries_count == 0)
+    {
+        entries->early_entry = entries->send->send_done == false;
+    }
+    strcpy(entries->names[entries->entries_count++], entry->entry_name);
+
+    /* All the bytes of the entry are already there, the CRC is checked */
+    bool inflate_ret = zip_entry_inflate(entry, content, archive);
+    free((void*)content);
+
+    return inflate_ret;
+}
+
+static double test_transfer(const uint8_t* data, size_t data_size, struct test_entries* entries, tpool_t* thread_pool, chunk_stats_t* stats)
+{
+    int sockets[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+
+    struct test_send send = { .socket_fd = sockets[0], .data = data, .data_size = data_size, .thread_pool = thread_pool };
+    struct timespec transfer_begin;
+    struct timespec transfer_end;
+    pthread_t sender;
+
+    if (entries != NULL)
+    {
+        entries->send = &send;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &transfer_begin);
+    pthread_create(&sender, NULL, test_sender, &send);
+
+    uint8_t* received;
+    size_t received_size;
+    assert(chunk_receive(sockets[1], entries != NULL ? test_entry : NULL, entries, &received, &received_size, stats));
+
+    pthread_join(sender, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &transfer_end);
+
+    assert(received_size == data_size && memcmp(received, data, data_size) == 0);
+    assert(stats->bytes_sent == send.stats.bytes_sent && stats->chunks_count == send.stats.chunks_count);
+    *stats = send.stats;
+
+    free((void*)received);
+    close(sockets[0]);
+    close(sockets[1]);
+
+    return (double)(transfer_end.tv_sec - transfer_begin.tv_sec) + (double)(transfer_end.tv_nsec - transfer_begin.tv_nsec) / 1e9;
+}
+
+int main()
+{
+    struct test_zip zip = { .zip_data = malloc(ZIP_CAPACITY) };
+    size_t text_size = 3 * 1024 * 1024;
+    uint8_t* text = malloc(text_size);
+    uint8_t* noise = malloc(1024 * 1024);
+
+    /* Words from a small dictionary, deflate gets about 3 to 1 */
+    static const char* words[] = { "class ", "method ", "Landroid/", "invoke-virtual ", "const-string ", "return-void\n", "v0, ", "p1, " };
+    for (size_t text_cur = 0; text_cur < text_size; )
+    {
+        const char* word = words[test_next_random() % 8];
+        for (; *word != '\0' && text_cur < text_size; word++)
+        {
+            text[text_cur++] = (uint8_t)*word;
+        }
+    }
+    for (size_t noise_cur = 0; noise_cur < 1024 * 1024; noise_cur++)
+    {
+        noise[noise_cur] = test_next_random();
+    }
+
+    zip_add("AndroidManifest.xml", text, 2048, false, &zip);
+    zip_add("classes.dex", text, text_size, true, &zip);
+    zip_add("assets/noise.bin", noise, 1024 * 1024, true, &zip);
+    zip_add("res/raw/words.txt", text, 2 * 1024 * 1024, false, &zip);
+    zip_add("lib/x86_64/libnoise.so", noise, 1024 * 1024, false, &zip);
+    zip_finish(&zip);
+
+    tpool_t thread_pool;
+    assert(tpool_init(2, &thread_pool));
+
+    chunk_stats_t stats;
+    struct test_entries entries = { 0 };
+    double transfer_time = test_transfer(zip.zip_data, zip.zip_size, &entries, &thread_pool, &stats);
+
+    /* Handed by offset while the upload was running */
+    assert(entries.entries_count == 5 && entries.early_entry);
+    assert(strcmp(entries.names[0], "AndroidManifest.xml") == 0 && strcmp(entries.names[4], "lib/x86_64/libnoise.so") == 0);
+
+    /* The deflated entries are passed through, the text is deflated, the noise is sent raw */
+    assert(stats.chunks_passed >= 4 && stats.chunks_deflated >= 8);
+    assert(stats.chunks_count == (zip.zip_size + CHUNK_STREAM_SIZE - 1) / CHUNK_STREAM_SIZE);
+    assert(stats.bytes_sent < stats.bytes_raw);
+
+    printf("zip: %zu bytes, %zu chunks (%zu deflated, %zu passed), %.1f%% on the wire, %.1f MB/s\n", zip.zip_size,
+        stats.chunks_count, stats.chunks_deflated, stats.chunks_passed, 100.0 * (double)stats.bytes_sent / (double)stats.bytes_raw,
+        (double)zip.zip_size / transfer_time / 1e6);
+
+    /* Not a zip, tiny and empty streams, without the pool */
+    test_transfer(noise, 1000, NULL, NULL, &stats);
+    assert(stats.chunks_count == 1 && stats.chunks_deflated == 0);
+    test_transfer(text, 0, NULL, NULL, &stats);
+    assert(stats.chunks_count == 0);
+
+    transfer_time = test_transfer(text, text_size, NULL, &thread_pool, &stats);
+    printf("text: %zu bytes, %.1f%% on the wire, %.1f MB/s\n", text_size,
+        100.0 * (double)stats.bytes_sent / (double)stats.bytes_raw, (double)text_size / transfer_time / 1e6);
+
+    tpool_stop(&thread_pool);
+    tpool_finalize(&thread_pool);
+
+    free((void*)zip.zip_data);
+    free((void*)text);
+    free((void*)noise);
+
+    return 0;
+}
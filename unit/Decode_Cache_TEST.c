@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "crypto/SHA_256.h"
+#include "storage/Decode_Cache.h"
+
+#define OUTPUT_SIZE 3000
+#define CACHE_BUDGET (64 * 1024)
+
+static void check_digest(const char* message, size_t repeat, const char* expected_hex)
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char digest_hex[SHA256_DIGEST_SIZE * 2 + 1];
+    sha256_ctx_t sha_ctx;
+
+    sha256_init(&sha_ctx);
+    for (size_t repeat_cur = 0; repeat_cur < repeat; repeat_cur++)
+    {
+        sha256_update(message, strlen(message), &sha_ctx);
+    }
+    sha256_final(digest, &sha_ctx);
+
+    for (int byte_cur = 0; byte_cur < SHA256_DIGEST_SIZE; byte_cur++)
+    {
+        sprintf(digest_hex + byte_cur * 2, "%02x", digest[byte_cur]);
+    }
+    assert(strcmp(digest_hex, expected_hex) == 0);
+}
+
+static void make_output(int output_id, uint8_t* output)
+{
+    for (size_t byte_cur = 0; byte_cur < OUTPUT_SIZE; byte_cur++)
+    {
+        output[byte_cur] = (uint8_t)(output_id * 13 + byte_cur);
+    }
+}
+
+static void make_key(int output_id, dcache_key_t* key)
+{
+    char content[32];
+    snprintf(content, sizeof(content), "entry %d", output_id);
+    dcache_make_key(content, strlen(content), "axml:1:res=yes", key);
+}
+
+static bool has_output(int output_id, decode_cache_t* cache)
+{
+    uint8_t expected[OUTPUT_SIZE];
+    const uint8_t* cached_data;
+    size_t cached_size;
+    dcache_key_t key;
+
+    make_key(output_id, &key);
+    if (dcache_lookup(&key, &cached_data, &cached_size, cache) == false)
+    {
+        return false;
+    }
+    make_output(output_id, expected);
+    assert(cached_size == OUTPUT_SIZE && memcmp(cached_data, expected, OUTPUT_SIZE) == 0);
+
+    return true;
+}
+
+static void store_output(int output_id, decode_cache_t* cache)
+{
+    uint8_t output[OUTPUT_SIZE];
+    dcache_store_t store;
+    dcache_key_t key;
+
+    make_key(output_id, &key);
+    make_output(output_id, output);
+
+    dcache_store_begin(&key, &store, cache);
+    /* In pieces, like the decoders flushing */
+    assert(dcache_store_append(output, 1000, &store));
+    assert(dcache_store_append(output + 1000, OUTPUT_SIZE - 1000, &store));
+    assert(dcache_store_commit(&store, cache));
+}
+
+int main()
+{
+    check_digest("", 1, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    check_digest("abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    check_digest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1, 
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    check_digest("a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    char cache_dir[] = "/tmp/droidcat_cache_XXXXXX";
+    assert(mkdtemp(cache_dir) != NULL);
+
+    decode_cache_t cache;
+    assert(dcache_open(cache_dir, CACHE_BUDGET, &cache));
+    assert(has_output(1, &cache) == false);
+
+    store_output(1, &cache);
+    store_output(2, &cache);
+    dcache_close(&cache);
+
+    /* A warm run sees the previous outputs */
+    assert(dcache_open(cache_dir, CACHE_BUDGET, &cache));
+    assert(has_output(1, &cache) && has_output(2, &cache));
+    assert(has_output(3, &cache) == false);
+
+    /* Another process reads and writes at the same time */
+    pid_t reader_pid = fork();
+    if (reader_pid == 0)
+    {
+        decode_cache_t child_cache;
+        bool child_ret = dcache_open(cache_dir, CACHE_BUDGET, &child_cache) && has_output(2, &child_cache);
+
+        store_output(100, &child_cache);
+        dcache_close(&child_cache);
+        _exit(child_ret ? 0 : 1);
+    }
+    int reader_status;
+    assert(waitpid(reader_pid, &reader_status, 0) == reader_pid);
+    assert(WIFEXITED(reader_status) && WEXITSTATUS(reader_status) == 0);
+
+    store_output(3, &cache);
+    dcache_close(&cache);
+
+    assert(dcache_open(cache_dir, CACHE_BUDGET, &cache));
+    assert(has_output(3, &cache) && has_output(100, &cache));
+
+    /* Many more outputs than the budget, the oldest ones are evicted */
+    for (int output_id = 10; output_id < 60; output_id++)
+    {
+        store_output(output_id, &cache);
+    }
+    dcache_close(&cache);
+
+    assert(dcache_open(cache_dir, CACHE_BUDGET, &cache));
+    assert(has_output(10, &cache) == false);
+    assert(has_output(59, &cache));
+
+    /* Reading an old output makes it the most recently used */
+    assert(has_output(50, &cache));
+    dcache_evict(OUTPUT_SIZE * 6, &cache);
+    dcache_close(&cache);
+
+    assert(dcache_open(cache_dir, CACHE_BUDGET, &cache));
+    int outputs_kept = 0;
+    for (int output_id = 0; output_id < 110; output_id++)
+    {
+        outputs_kept += has_output(output_id, &cache);
+    }
+    assert(outputs_kept == 5);
+    assert(has_output(50, &cache) && has_output(51, &cache) == false);
+    dcache_close(&cache);
+
+    char remove_command[64];
+    snprintf(remove_command, sizeof(remove_command), "rm -rf %s", cache_dir);
+    assert(system(remove_command) == 0);
+
+    return 0;
+}
+
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+
+#include "script/Dsc_VM.h"
+
+#define CALLS_MAX 16
+
+#define TINY_FILES 40
+#define BIG_FILES 3
+
+static atomic_size_t scanned_files;
+static atomic_size_t scan_calls;
+
+/* Each directive call is recorded as a single line */
+struct test_run
+{
+    const char* input_path;
+
+    char calls[CALLS_MAX][256];
+
+    size_t calls_count;
+};
+
+static bool test_record(size_t args_count, char* const* args, void* run_data)
+{
+    struct test_run* run = (struct test_run*)run_data;
+    char* call = run->calls[run->calls_count++];
+
+    call[0] = '\0';
+    for (size_t arg_cur = 0; arg_cur < args_count; arg_cur++)
+    {
+        strcat(call, arg_cur != 0 ? " " : "");
+        strcat(call, args[arg_cur]);
+    }
+    return true;
+}
+
+static bool test_fail(size_t args_count, char* const* args, void* run_data)
+{
+    (void)args_count; (void)args; (void)run_data;
+    return false;
+}
+
+static bool test_input(const char* qualifier, char* value, size_t value_size, void* run_data)
+{
+    snprintf(value, value_size, "%s", ((struct test_run*)run_data)->input_path);
+    return qualifier == NULL;
+}
+
+static bool test_output(const char* qualifier, char* value, size_t value_size, void* run_data)
+{
+    (void)run_data;
+    snprintf(value, value_size, "out%s%s", qualifier != NULL ? "/" : "", qualifier != NULL ? qualifier : "");
+    return true;
+}
+
+static bool test_exist(const char* path, void* run_data)
+{
+    (void)run_data;
+    return strcmp(path, "a.apk/lib") == 0;
+}
+
+/* Called from the pool workers, one file or a group of tiny files by call */
+static bool test_scan(size_t args_count, char* const* args, void* run_data)
+{
+    (void)run_data;
+    scanned_files += args_count - 1;
+    scan_calls++;
+
+    return strcmp(args[0], "bad") != 0;
+}
+
+/* Runs after the fan out lines, they must be done */
+static bool test_check(size_t args_count, char* const* args, void* run_data)
+{
+    return test_record(args_count, args, run_data) && (size_t)atoi(args[0]) == scanned_files;
+}
+
+static size_t test_size(const char* path, void* run_data)
+{
+    (void)run_data;
+    return strncmp(path, "big/", 4) == 0 ? 1024 * 1024 : 10;
+}
+
+static bool test_glob(const char* pattern, dsc_match_fn on_match, void* match_data, void* run_data)
+{
+    char match[64];
+    bool glob_ret = true;
+
+    (void)run_data;
+    for (int file_cur = 0; strcmp(pattern, "many/*.bin") == 0 && glob_ret && file_cur < TINY_FILES; file_cur++)
+    {
+        snprintf(match, sizeof(match), "many/file%d.bin", file_cur);
+        glob_ret = on_match(match, match_data);
+    }
+    for (int file_cur = 0; strcmp(pattern, "big/*.so") == 0 && glob_ret && file_cur < BIG_FILES; file_cur++)
+    {
+        snprintf(match, sizeof(match), "big/lib%d.so", file_cur);
+        glob_ret = on_match(match, match_data);
+    }
+    if (strcmp(pattern, "out/*.dex") != 0)
+    {
+        return true;
+    }
+    return on_match("out/classes.dex", match_data) && on_match("out/classes2.dex", match_data);
+}
+
+static const dsc_directive_t test_directives[] = {
+    { "record", test_record },
+    { "fail", test_fail },
+    { "scan", test_scan, .directive_fanout = true, .fixed_args = 1, .output_suffix = ".txt" },
+    { "check", test_check },
+};
+
+static const dsc_builtin_t test_builtins[] = {
+    { "input", test_input },
+    { "output", test_output },
+};
+
+static const dsc_host_t test_host = {
+    .host_directives = test_directives,
+    .directives_count = 4,
+    .host_builtins = test_builtins,
+    .builtins_count = 2,
+    .host_glob = test_glob,
+    .host_exist = test_exist,
+    .host_size = test_size
+};
+
+static const char test_script[] =
+    "input_filename = $input\n"
+    "output_filename = $output\n"
+    "\n"
+    "; Comments and blank lines are ignored\n"
+    "%record% into $input_filename ${output_filename}\n"
+    "%record% dex $output_filename/*.dex\n"
+    "%record% \"quoted argument\" $output:lib/x\n"
+    "if exist $input_filename/lib then:\n"
+    "    %record% has lib\n"
+    "    if not exist $input_filename/assets then:\n"
+    "        %record% no assets\n"
+    "    fi\n"
+    "else:\n"
+    "    %record% no lib\n"
+    "fi\n"
+    "if exist $input_filename/res then:\n"
+    "    %record% has res\n"
+    "fi\n";
+
+static const char fanout_script[] =
+    "%scan% bin many/*.bin\n"
+    "%scan% so big/*.so\n"
+    "%check% 43\n";
+
+static void check_fanout(tpool_t* thread_pool)
+{
+    dsc_error_t error;
+    dsc_program_t* program = dsc_compile(fanout_script, strlen(fanout_script), &test_host, &error);
+    struct test_run run = { .input_path = "a.apk" };
+
+    assert(program != NULL);
+
+    /* Without a pool each line is a single call */
+    assert(dsc_execute(program, &run, &error, NULL));
+    assert(scan_calls == 2 && program->fanout_tasks == 0);
+
+    /* The tiny files are grouped by 32, the big ones have a task each */
+    scanned_files = 0;
+    scan_calls = 0;
+    run.calls_count = 0;
+    assert(dsc_execute(program, &run, &error, thread_pool));
+    assert(scan_calls == 5 && program->fanout_tasks == 5);
+    assert(run.calls_count == 1 && strcmp(run.calls[0], "43") == 0);
+    dsc_program_free(program);
+
+    /* A failed task is reported with the line of its directive, after the join */
+    const char failing_script[] = "%scan% bin many/*.bin\n%scan% bad big/*.so\n%check% 43\n";
+    program = dsc_compile(failing_script, strlen(failing_script), &test_host, &error);
+    run.calls_count = 0;
+    assert(dsc_execute(program, &run, &error, thread_pool) == false);
+    assert(error.error_line == 2 && run.calls_count == 0);
+    dsc_program_free(program);
+}
+
+static void check_error(const char* source, size_t error_line)
+{
+    dsc_error_t error;
+
+    assert(dsc_compile(source, strlen(source), &test_host, &error) == NULL);
+    assert(error.error_line == error_line);
+    assert(error.error_message[0] != '\0');
+}
+
+int main()
+{
+    dsc_error_t error;
+    dsc_cache_t cache;
+
+    assert(dsc_cache_init(&cache));
+
+    dsc_program_t* program = dsc_compile_cached(test_script, strlen(test_script), &test_host, &error, &cache);
+    assert(program != NULL);
+    /* Two user variables, the builtins doesn't take slots */
+    assert(program->slots_count == 2);
+    assert(dsc_compile_cached(test_script, strlen(test_script), &test_host, &error, &cache) == program);
+    assert(cache.cache_hits == 1);
+
+    /* The same program for many inputs */
+    for (int run_cur = 0; run_cur < 2; run_cur++)
+    {
+        struct test_run run = { .input_path = "a.apk" };
+
+        assert(dsc_execute(program, &run, &error, NULL));
+        assert(run.calls_count == 5);
+        assert(strcmp(run.calls[0], "into a.apk out") == 0);
+        assert(strcmp(run.calls[1], "dex out/classes.dex out/classes2.dex") == 0);
+        assert(strcmp(run.calls[2], "quoted argument out/lib/x") == 0);
+        assert(strcmp(run.calls[3], "has lib") == 0);
+        assert(strcmp(run.calls[4], "no assets") == 0);
+    }
+    assert(program->runs_count == 2);
+
+    struct test_run other_run = { .input_path = "b.apk" };
+    assert(dsc_execute(program, &other_run, &error, NULL));
+    assert(other_run.calls_count == 4 && strcmp(other_run.calls[3], "no lib") == 0);
+
+    /* Runtime errors point to the line */
+    const char failing_script[] = "x = 1\n\n%record% $x\n%fail% now\n";
+    dsc_program_t* failing = dsc_compile(failing_script, strlen(failing_script), &test_host, &error);
+    struct test_run failing_run = { .input_path = "a.apk" };
+    assert(failing != NULL);
+    assert(dsc_execute(failing, &failing_run, &error, NULL) == false);
+    assert(error.error_line == 4 && failing_run.calls_count == 1);
+    dsc_program_free(failing);
+
+    check_error("a = $undefined\n", 1);
+    check_error("\n%unknown% x\n", 2);
+    check_error("x = 1\nif exist $x then:\n%record% a\n", 2);
+    check_error("fi\n", 1);
+    check_error("%record% \"open\n", 1);
+    check_error("if $x then:\nfi\n", 1);
+    check_error("x = 1\n%record% $x:qualifier\n", 2);
+    check_error("just words\n", 1);
+
+    tpool_t thread_pool;
+    assert(tpool_init(2, &thread_pool));
+    check_fanout(&thread_pool);
+    tpool_stop(&thread_pool);
+    tpool_finalize(&thread_pool);
+
+    dsc_cache_deinit(&cache);
+
+    return 0;
+}
+
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "log/Event_Log.h"
+
+#define TEST_THREADS 4
+#define TEST_RECORDS 300
+#define BENCH_RECORDS 200000
+#define BENCH_BURSTS 20
+
+struct test_thread
+{
+    event_log_t* log;
+
+    int thread_index;
+};
+
+static char* read_log(const char* log_path, size_t* lines_count)
+{
+    FILE* log_file = fopen(log_path, "r");
+    assert(log_file != NULL);
+
+    fseek(log_file, 0, SEEK_END);
+    long log_size = ftell(log_file);
+    fseek(log_file, 0, SEEK_SET);
+
+    char* log_text = calloc(1, (size_t)log_size + 1);
+    assert(fread(log_text, 1, (size_t)log_size, log_file) == (size_t)log_size);
+    fclose(log_file);
+
+    *lines_count = 0;
+    for (const char* line = strchr(log_text, '\n'); line != NULL; line = strchr(line + 1, '\n'))
+    {
+        (*lines_count)++;
+    }
+    return log_text;
+}
+
+static void* test_logger(void* thread_data)
+{
+    struct test_thread* thread = (struct test_thread*)thread_data;
+    char name[16];
+
+    snprintf(name, sizeof(name), "thread-%d", thread->thread_index);
+
+    for (int record_cur = 0; record_cur < TEST_RECORDS; record_cur++)
+    {
+        elog_write(thread->log, ELOG_INFO, "test", "%s record %d size=%zu ratio=%.2f done=%u%%", name, record_cur,
+            (size_t)record_cur * 2, 0.5, 100u);
+        elog_write(thread->log, ELOG_TRACE, "test", "filtered %d", record_cur);
+
+        /* Leaves time to the flusher, nothing must be dropped here */
+        if (record_cur % 64 == 63)
+        {
+            usleep(30000);
+        }
+    }
+
+    return NULL;
+}
+
+static double elapsed_ns(clockid_t clock_id, const struct timespec* begin)
+{
+    struct timespec end;
+    clock_gettime(clock_id, &end);
+
+    return (double)(end.tv_sec - begin->tv_sec) * 1e9 + (double)(end.tv_nsec - begin->tv_nsec);
+}
+
+int main()
+{
+    char log_dir[] = "/tmp/droidcat-log-XXXXXX";
+    assert(mkdtemp(log_dir) != NULL);
+
+    char log_path[64];
+    snprintf(log_path, sizeof(log_path), "%s/droidcat.log", log_dir);
+
+    enum elog_level log_level;
+    assert(elog_parse_level("debug", &log_level) && log_level == ELOG_DEBUG);
+    assert(elog_parse_level("off", &log_level) && log_level == ELOG_OFF);
+    assert(elog_parse_level("verbose", &log_level) == false);
+
+    event_log_t log;
+    assert(elog_open(log_path, ELOG_DEBUG, &log));
+
+    /* Nothing is created while nothing has been logged */
+    usleep(50000);
+    assert(access(log_path, F_OK) != 0);
+
+    pthread_t threads[TEST_THREADS];
+    struct test_thread threads_data[TEST_THREADS];
+
+    for (int thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        threads_data[thread_cur] = (struct test_thread){ .log = &log, .thread_index = thread_cur };
+        pthread_create(&threads[thread_cur], NULL, test_logger, &threads_data[thread_cur]);
+    }
+    for (int thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        pthread_join(threads[thread_cur], NULL);
+    }
+
+    char long_string[300];
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    long_string[sizeof(long_string) - 1] = '\0';
+
+    elog_write(&log, ELOG_ERROR, NULL, "long=%s|%s|", long_string, "lost");
+    elog_write(&log, ELOG_WARN, "test", "pointer %p and %lld", (void*)0x1234, -5LL);
+
+    assert(elog_close(&log));
+    assert(log.records_written == TEST_THREADS * TEST_RECORDS + 2 && log.records_dropped == 0);
+
+    size_t lines_count;
+    char* log_text = read_log(log_path, &lines_count);
+
+    assert(lines_count == TEST_THREADS * TEST_RECORDS + 2);
+    assert(strstr(log_text, "filtered") == NULL);
+    assert(strstr(log_text, " INFO  test[") != NULL);
+    assert(strstr(log_text, "] thread-2 record 217 size=434 ratio=0.50 done=100%\n") != NULL);
+    assert(strstr(log_text, "] pointer 0x1234 and -5\n") != NULL);
+
+    /* The first string fills the slot, the next one is empty */
+    const char* long_line = strstr(log_text, "ERROR droidcat[");
+    assert(long_line != NULL);
+    long_line = strstr(long_line, "long=");
+    assert(strncmp(long_line + 5 + ELOG_SLOT_STRINGS - 1, "||\n", 3) == 0);
+
+    /* The timestamp is UTC with microseconds */
+    assert(log_text[4] == '-' && log_text[10] == 'T' && log_text[19] == '.' && log_text[26] == 'Z');
+    free((void*)log_text);
+
+    /* Bursts that fit in the ring, the flusher catches up between them */
+    unlink(log_path);
+    assert(elog_open(log_path, ELOG_INFO, &log));
+
+    /* The thread's CPU time, the flusher may run in the middle of a burst */
+    double enabled_ns = 0;
+    double best_ns = 1e9;
+    for (int burst_cur = 0; burst_cur < BENCH_BURSTS; burst_cur++)
+    {
+        struct timespec bench_begin;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &bench_begin);
+        for (int record_cur = 0; record_cur < ELOG_RING_SLOTS / 2; record_cur++)
+        {
+            elog_write(&log, ELOG_INFO, "bench", "record %d of %s", record_cur, "bench");
+        }
+        double burst_ns = elapsed_ns(CLOCK_THREAD_CPUTIME_ID, &bench_begin) / (ELOG_RING_SLOTS / 2);
+
+        enabled_ns += burst_ns / BENCH_BURSTS;
+        best_ns = burst_ns < best_ns ? burst_ns : best_ns;
+        usleep(25000);
+    }
+    assert(log.records_dropped == 0);
+
+    struct timespec bench_begin;
+    clock_gettime(CLOCK_MONOTONIC, &bench_begin);
+    for (int record_cur = 0; record_cur < BENCH_RECORDS; record_cur++)
+    {
+        elog_write(&log, ELOG_DEBUG, "bench", "record %d of %s", record_cur, "bench");
+    }
+    double filtered_ns = elapsed_ns(CLOCK_MONOTONIC, &bench_begin) / BENCH_RECORDS;
+
+    /* A flood fills the ring faster than the flusher empties it, every record is either
+     * written or counted as dropped, never waited for
+    */
+    for (int record_cur = 0; record_cur < BENCH_RECORDS; record_cur++)
+    {
+        elog_write(&log, ELOG_INFO, "flood", "record %d", record_cur);
+    }
+
+    assert(elog_close(&log));
+    assert(log.records_written + log.records_dropped == BENCH_BURSTS * (ELOG_RING_SLOTS / 2) + BENCH_RECORDS);
+
+    log_text = read_log(log_path, &lines_count);
+    assert(lines_count >= log.records_written);
+    assert((log.records_dropped != 0) == (strstr(log_text, "records dropped") != NULL));
+    free((void*)log_text);
+
+    printf("enabled: %.1f ns by record (best burst %.1f ns), filtered: %.1f ns, %zu written, %zu dropped\n", enabled_ns, best_ns, filtered_ns,
+        (size_t)log.records_written, (size_t)log.records_dropped);
+
+    unlink(log_path);
+    rmdir(log_dir);
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+#include "cpu/Hardware_Info.h"
+
+static void kernel_a(void) {}
+static void kernel_b(void) {}
+static void kernel_portable(void) {}
+
+int main()
+{
+    physical_CPU_t host_CPU;
+    cpu_init(&host_CPU);
+
+    printf("%s %s, family %u model %u, features %#x\n", host_CPU.vendor_name, host_CPU.model_name,
+        (unsigned)host_CPU.cpu_family, (unsigned)host_CPU.cpu_model, (unsigned)host_CPU.cpu_features);
+
+#if defined(__x86_64__)
+    /* Every x86-64 CPU answers CPUID with a vendor */
+    assert(strlen(host_CPU.vendor_name) == 12);
+#endif
+    /* AVX-512BW is never without the foundation */
+    assert((host_CPU.cpu_features & CPU_FEATURE_AVX512BW) == 0 || (host_CPU.cpu_features & CPU_FEATURE_AVX512F) != 0);
+    assert(cpu_features() == host_CPU.cpu_features);
+
+    const cpu_kernel_t kernels[] = {
+        { "a", CPU_FEATURE_AVX2 | CPU_FEATURE_BMI2, kernel_a },
+        { "b", CPU_FEATURE_SSE42, kernel_b },
+        { "portable", 0, kernel_portable }
+    };
+    const size_t kernels_count = sizeof(kernels) / sizeof(*kernels);
+
+    /* The first kernel whose features are all there */
+    cpu_features_limit(CPU_FEATURE_AVX2 | CPU_FEATURE_SSE42);
+    const cpu_kernel_t* kernel = cpu_dispatch(kernels, kernels_count);
+    assert(kernel->kernel_function == ((host_CPU.cpu_features & CPU_FEATURE_SSE42) ? kernel_b : kernel_portable));
+
+    cpu_features_limit(0);
+    assert(cpu_features() == 0);
+    assert(cpu_dispatch(kernels, kernels_count)->kernel_function == kernel_portable);
+
+    cpu_features_limit(UINT32_MAX);
+    uint32_t both = CPU_FEATURE_AVX2 | CPU_FEATURE_BMI2;
+    if ((host_CPU.cpu_features & both) == both)
+    {
+        assert(cpu_dispatch(kernels, kernels_count)->kernel_function == kernel_a);
+    }
+
+    cpu_finalize(&host_CPU);
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "Thread_Pool.h"
+#include "cpu/Hardware_Info.h"
+#include "data/Memory_Arena.h"
+
+#define ARENA_TEST_BLOCK 4096
+
+static void* scratch_task(void* task_data)
+{
+    memory_arena_t* scratch = arena_scratch();
+    (void)task_data;
+
+    if (scratch == NULL)
+    {
+        return NULL;
+    }
+    /* Bigger than a block, the rewind after the task must keep it for the next one */
+    uint8_t* scratch_data = arena_alloc(3 * 1024 * 1024, scratch);
+    memset(scratch_data, 0x5a, 3 * 1024 * 1024);
+    return scratch_data;
+}
+
+int main()
+{
+    memory_arena_t* arena = arena_create(ARENA_TEST_BLOCK);
+
+    /* The reset frees all but the oldest block */
+    void* first_data = arena_alloc(ARENA_TEST_BLOCK, arena);
+    arena_alloc(ARENA_TEST_BLOCK, arena);
+    arena_reset(arena);
+    assert(arena_allocated(arena) == ARENA_TEST_BLOCK);
+    assert(arena_alloc(16, arena) == first_data);
+
+    /* Three blocks, the rewind keeps them all and the allocations after it reuse them */
+    arena_alloc(ARENA_TEST_BLOCK, arena);
+    arena_alloc(3 * ARENA_TEST_BLOCK, arena);
+    size_t allocated = arena_allocated(arena);
+    assert(allocated == 5 * ARENA_TEST_BLOCK);
+
+    arena_rewind(arena);
+    for (int alloc_cur = 0; alloc_cur < 5; alloc_cur++)
+    {
+        assert(arena_alloc(ARENA_TEST_BLOCK, arena) != NULL);
+    }
+    assert(arena_allocated(arena) == allocated);
+
+    /* Everything after the mark is released, the blocks pushed since too */
+    arena_rewind(arena);
+    arena_alloc(100, arena);
+    arena_mark_t mark = arena_mark(arena);
+    void* marked_data = arena_alloc(100, arena);
+    arena_alloc(2 * ARENA_TEST_BLOCK, arena);
+    arena_rewind_to(mark, arena);
+    assert(arena_alloc(100, arena) == marked_data);
+    assert(arena_allocated(arena) == allocated);
+
+    /* The spare blocks are freed by a reset too */
+    arena_reset(arena);
+    assert(arena_allocated(arena) < allocated);
+    arena_destroy(arena);
+
+    int numa_nodes[CPU_NUMA_NODES_MAX];
+    int nodes_count = cpu_numa_nodes(numa_nodes, CPU_NUMA_NODES_MAX);
+    int current_node = cpu_numa_current();
+    printf("NUMA nodes %d, running on %d\n", nodes_count, current_node);
+
+    for (int node_cur = 0; node_cur < nodes_count; node_cur++)
+    {
+        cpu_set_t node_cpus;
+        assert(cpu_numa_cpus(numa_nodes[node_cur], &node_cpus) && CPU_COUNT(&node_cpus) > 0);
+    }
+
+    /* Bound to a node, the blocks are mappings of whole pages */
+    memory_arena_t* node_arena = arena_create_on_node(ARENA_TEST_BLOCK, nodes_count > 0 ? numa_nodes[0] : 0);
+    uint8_t* node_data = arena_alloc(ARENA_TEST_BLOCK * 2, node_arena);
+    memset(node_data, 0xa5, ARENA_TEST_BLOCK * 2);
+    assert(((uintptr_t)node_data & 15) == 0 && arena_allocated(node_arena) >= ARENA_TEST_BLOCK * 2);
+    arena_rewind(node_arena);
+    assert(arena_alloc(ARENA_TEST_BLOCK * 2, node_arena) == node_data);
+    arena_destroy(node_arena);
+
+    /* Only the workers have a scratch arena, rewound between two tasks */
+    tpool_t scratch_pool;
+    tpool_init(1, &scratch_pool);
+    assert(arena_scratch() == NULL);
+
+    void* first_scratch = tpool_wait_for_result(scratch_task, NULL, &scratch_pool);
+    void* second_scratch = tpool_wait_for_result(scratch_task, NULL, &scratch_pool);
+    assert(first_scratch != NULL && first_scratch == second_scratch);
+
+    tpool_stop(&scratch_pool);
+    tpool_finalize(&scratch_pool);
+
+    return 0;
+}
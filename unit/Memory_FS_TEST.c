@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "vfs/Memory_FS.h"
+
+#define WRITERS_COUNT 4
+#define WRITE_PIECE 1000
+#define FILE_SIZE (150 * WRITE_PIECE)
+
+static memfs_t* memory_tree;
+
+static uint8_t expected_byte(int file_id, size_t offset)
+{
+    return (uint8_t)(file_id * 31 + offset * 7);
+}
+
+static void* writer_thread(void* data)
+{
+    int file_id = (int)(intptr_t)data;
+    char file_path[64];
+    uint8_t piece[WRITE_PIECE];
+
+    snprintf(file_path, sizeof(file_path), "out/lib/file_%d.so", file_id);
+    memfs_file_t* file = memfs_open(file_path, true, memory_tree);
+    assert(file != NULL);
+
+    for (size_t offset = 0; offset < FILE_SIZE; offset += WRITE_PIECE)
+    {
+        for (size_t byte_cur = 0; byte_cur < WRITE_PIECE; byte_cur++)
+        {
+            piece[byte_cur] = expected_byte(file_id, offset + byte_cur);
+        }
+        assert(memfs_append(piece, WRITE_PIECE, file, memory_tree));
+    }
+
+    return NULL;
+}
+
+static void check_content(memfs_file_t* file, int file_id, size_t file_size)
+{
+    static uint8_t content[FILE_SIZE + WRITE_PIECE];
+
+    assert(memfs_size(file) == file_size);
+    assert(memfs_read(0, content, sizeof(content), file, memory_tree) == file_size);
+
+    for (size_t offset = 0; offset < file_size; offset++)
+    {
+        assert(content[offset] == expected_byte(file_id, offset));
+    }
+}
+
+static bool count_files(const char* file_path, memfs_file_t* file, void* call_data)
+{
+    (void)file_path; (void)file;
+    (*(int*)call_data)++;
+    return false;
+}
+
+int main()
+{
+    pthread_t writers[WRITERS_COUNT];
+
+    /* Without budget, nothing is spilled and copies share the memory */
+    memory_tree = memfs_create(0, NULL);
+
+    for (int writer_cur = 0; writer_cur < WRITERS_COUNT; writer_cur++)
+    {
+        pthread_create(&writers[writer_cur], NULL, writer_thread, (void*)(intptr_t)writer_cur);
+    }
+    for (int writer_cur = 0; writer_cur < WRITERS_COUNT; writer_cur++)
+    {
+        pthread_join(writers[writer_cur], NULL);
+    }
+
+    for (int file_cur = 0; file_cur < WRITERS_COUNT; file_cur++)
+    {
+        char file_path[64];
+        snprintf(file_path, sizeof(file_path), "/out/./lib/file_%d.so", file_cur);
+        check_content(memfs_open(file_path, false, memory_tree), file_cur, FILE_SIZE);
+    }
+
+    size_t used_before = memfs_memory_used(memory_tree);
+    assert(memfs_copy("out/lib/file_0.so", "out/copy.so", memory_tree));
+    assert(memfs_memory_used(memory_tree) == used_before);
+
+    /* Writing into the copy duplicates only the shared tail */
+    memfs_file_t* copy_file = memfs_open("out/copy.so", false, memory_tree);
+    uint8_t extra[WRITE_PIECE];
+    for (size_t byte_cur = 0; byte_cur < WRITE_PIECE; byte_cur++)
+    {
+        extra[byte_cur] = expected_byte(0, FILE_SIZE + byte_cur);
+    }
+    assert(memfs_append(extra, WRITE_PIECE, copy_file, memory_tree));
+    assert(memfs_memory_used(memory_tree) == used_before + MEMFS_CHUNK_SIZE);
+    check_content(copy_file, 0, FILE_SIZE + WRITE_PIECE);
+    check_content(memfs_open("out/lib/file_0.so", false, memory_tree), 0, FILE_SIZE);
+
+    int files_count = 0;
+    assert(memfs_foreach("out/lib/", count_files, &files_count, memory_tree) == WRITERS_COUNT);
+    assert(files_count == WRITERS_COUNT);
+    assert(memfs_exist("out/lib", memory_tree));
+    assert(memfs_exist("out/nothing", memory_tree) == false);
+
+    memfs_destroy(memory_tree);
+
+    /* With a budget of 4 chunks, the old files must go for the disk */
+    memory_tree = memfs_create(4 * MEMFS_CHUNK_SIZE, NULL);
+
+    for (int writer_cur = 0; writer_cur < WRITERS_COUNT; writer_cur++)
+    {
+        pthread_create(&writers[writer_cur], NULL, writer_thread, (void*)(intptr_t)writer_cur);
+    }
+    for (int writer_cur = 0; writer_cur < WRITERS_COUNT; writer_cur++)
+    {
+        pthread_join(writers[writer_cur], NULL);
+    }
+
+    assert(memory_tree->files_spilled != 0);
+    assert(memfs_memory_used(memory_tree) <= 4 * MEMFS_CHUNK_SIZE);
+
+    for (int file_cur = 0; file_cur < WRITERS_COUNT; file_cur++)
+    {
+        char file_path[64];
+        snprintf(file_path, sizeof(file_path), "out/lib/file_%d.so", file_cur);
+        check_content(memfs_open(file_path, false, memory_tree), file_cur, FILE_SIZE);
+    }
+
+    /* Copying a spilled file */
+    assert(memfs_copy("out/lib/file_1.so", "out/copy.so", memory_tree));
+    check_content(memfs_open("out/copy.so", false, memory_tree), 1, FILE_SIZE);
+
+    printf("Memory used %zu bytes, %zu files spilled\n", memfs_memory_used(memory_tree), (size_t)memory_tree->files_spilled);
+
+    memfs_destroy(memory_tree);
+
+    return 0;
+}
+
@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <fnmatch.h>
+
+#include "data/Name_Index.h"
+
+#define TEST_NAMES 4000
+#define BENCH_NAMES 200000
+#define BENCH_QUERIES 2000
+
+struct match_list
+{
+    uint32_t matched[TEST_NAMES * 2];
+
+    size_t matched_count;
+
+    uint32_t last_key;
+};
+
+static bool collect_match(uint32_t key_index, uint32_t name_id, void* match_data)
+{
+    struct match_list* list = (struct match_list*)match_data;
+
+    /* The keys come in order */
+    assert(list->matched_count == 0 || key_index >= list->last_key);
+    list->last_key = key_index;
+    list->matched[list->matched_count++] = name_id;
+    return true;
+}
+
+static bool count_match(uint32_t key_index, uint32_t name_id, void* match_data)
+{
+    (void)key_index;
+    (void)name_id;
+    (*(size_t*)match_data)++;
+    return true;
+}
+
+/* APK like paths, a few names are added twice with other ids */
+static void make_names(char (*names)[64], size_t names_count)
+{
+    static const char* folders[] = { "res/layout/", "res/drawable-hdpi/", "assets/web/", "lib/arm64-v8a/", "", "META-INF/" };
+    static const char* suffixes[] = { ".xml", ".png", ".so", ".dex", ".js", "" };
+
+    for (size_t name_cur = 0; name_cur < names_count; name_cur++)
+    {
+        size_t folder = name_cur % 6;
+        snprintf(names[name_cur], 64, "%sitem_%zu%s", folders[folder], (name_cur * 7919) % (names_count / 2 + 1), suffixes[(name_cur / 6) % 6]);
+    }
+}
+
+static size_t reference_count(char (*names)[64], size_t names_count, const char* pattern, int mode)
+{
+    size_t matched_count = 0;
+
+    for (size_t name_cur = 0; name_cur < names_count; name_cur++)
+    {
+        const char* name = names[name_cur];
+        bool matched = false;
+
+        if (mode == 0)
+        {
+            matched = strncmp(name, pattern, strlen(pattern)) == 0;
+        }
+        else if (mode == 1)
+        {
+            matched = strstr(name, pattern) != NULL;
+        }
+        else
+        {
+            /* fnmatch has no "**", the patterns tested with it don't use one */
+            matched = fnmatch(pattern, name, FNM_PATHNAME) == 0;
+        }
+        matched_count += matched;
+    }
+    return matched_count;
+}
+
+static void check_against_reference(char (*names)[64], size_t names_count, const name_index_t* name_index)
+{
+    static const char* prefixes[] = { "", "res/", "res/layout/item_1", "lib/arm64-v8a/item_", "item_", "zzz", "META-INF/item_99" };
+    static const char* needles[] = { "", "item_1", ".png", "/item_2", "v8a", "nothing" };
+    static const char* globs[] = { "*", "res/*/*.xml", "res/*", "*.dex", "item_?.png", "lib/*/item_[1-3]*.so", "assets/web/item_[!0-4]*",
+        "res/layout/*_1?.*", "META-INF/*", "*/*", "item_1*", "[a-m]*/*" };
+    static struct match_list list;
+
+    for (size_t query_cur = 0; query_cur < sizeof(prefixes) / sizeof(prefixes[0]); query_cur++)
+    {
+        list.matched_count = 0;
+        assert(index_prefix(prefixes[query_cur], strlen(prefixes[query_cur]), collect_match, &list, name_index));
+        assert(list.matched_count == reference_count(names, names_count, prefixes[query_cur], 0));
+    }
+    for (size_t query_cur = 0; query_cur < sizeof(needles) / sizeof(needles[0]); query_cur++)
+    {
+        list.matched_count = 0;
+        assert(index_substring(needles[query_cur], strlen(needles[query_cur]), collect_match, &list, name_index));
+        assert(list.matched_count == reference_count(names, names_count, needles[query_cur], 1));
+    }
+    for (size_t query_cur = 0; query_cur < sizeof(globs) / sizeof(globs[0]); query_cur++)
+    {
+        list.matched_count = 0;
+        assert(index_glob(globs[query_cur], collect_match, &list, name_index));
+        assert(list.matched_count == reference_count(names, names_count, globs[query_cur], 2));
+    }
+}
+
+static void check_small(void)
+{
+    static const char* names[] = { "classes.dex", "classes2.dex", "res/a.xml", "res/b/c.xml", "res", "lib/x86/libz.so", "classes.dex" };
+    index_builder_t builder;
+    name_index_t name_index;
+    struct match_list list = {};
+    uint32_t key_index;
+    size_t key_length;
+
+    index_builder_init(&builder);
+    for (size_t name_cur = 0; name_cur < sizeof(names) / sizeof(names[0]); name_cur++)
+    {
+        assert(index_builder_add(names[name_cur], strlen(names[name_cur]), (uint32_t)name_cur, &builder));
+    }
+    assert(index_build(&builder, &name_index));
+    assert(name_index.keys_count == 6);
+
+    assert(index_find("res", 3, &key_index, &name_index));
+    assert(strcmp(index_key(key_index, &key_length, &name_index), "res") == 0 && key_length == 3);
+    assert(index_find("re", 2, &key_index, &name_index) == false);
+    assert(index_find("res/a", 5, &key_index, &name_index) == false);
+    assert(index_find("classes.dexx", 12, &key_index, &name_index) == false);
+
+    /* Both ids of the duplicated name */
+    assert(index_find("classes.dex", 11, &key_index, &name_index));
+    list.matched_count = 0;
+    assert(index_prefix("classes.dex", 11, collect_match, &list, &name_index));
+    assert(list.matched_count == 2 && list.matched[0] == 0 && list.matched[1] == 6);
+
+    list.matched_count = 0;
+    assert(index_glob("res/**", collect_match, &list, &name_index));
+    assert(list.matched_count == 2);
+    list.matched_count = 0;
+    assert(index_glob("**.xml", collect_match, &list, &name_index));
+    assert(list.matched_count == 2);
+    list.matched_count = 0;
+    assert(index_glob("res*", collect_match, &list, &name_index));
+    assert(list.matched_count == 1 && list.matched[0] == 4);
+    list.matched_count = 0;
+    assert(index_glob("classes?.dex", collect_match, &list, &name_index));
+    assert(list.matched_count == 1 && list.matched[0] == 1);
+    list.matched_count = 0;
+    assert(index_glob("**", collect_match, &list, &name_index));
+    assert(list.matched_count == 7);
+
+    assert(index_is_glob("res/*.xml") && index_is_glob("res/[ab].xml") && index_is_glob("res/a.xml") == false);
+    index_release(&name_index);
+
+    /* An empty index answers nothing */
+    index_builder_init(&builder);
+    assert(index_build(&builder, &name_index));
+    assert(index_find("", 0, &key_index, &name_index) == false);
+    list.matched_count = 0;
+    assert(index_prefix("", 0, collect_match, &list, &name_index) && index_glob("*", collect_match, &list, &name_index));
+    assert(list.matched_count == 0);
+    index_release(&name_index);
+}
+
+static double elapsed_seconds(const struct timespec* start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* A lookup per query against the index, then against a scan of all names */
+static void bench_lookups(void)
+{
+    char (*names)[64] = malloc(sizeof(*names) * BENCH_NAMES);
+    index_builder_t builder;
+    name_index_t name_index;
+    struct timespec start;
+    size_t found_count = 0;
+
+    assert(names != NULL);
+    for (size_t name_cur = 0; name_cur < BENCH_NAMES; name_cur++)
+    {
+        snprintf(names[name_cur], 64, "Lcom/example/pkg%zu/Class%zu;", name_cur % 97, name_cur);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    index_builder_init(&builder);
+    for (size_t name_cur = 0; name_cur < BENCH_NAMES; name_cur++)
+    {
+        assert(index_builder_add(names[name_cur], strlen(names[name_cur]), (uint32_t)name_cur, &builder));
+    }
+    assert(index_build(&builder, &name_index));
+    double build_time = elapsed_seconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t query_cur = 0; query_cur < BENCH_QUERIES; query_cur++)
+    {
+        const char* name = names[(query_cur * 7919) % BENCH_NAMES];
+        uint32_t key_index;
+        found_count += index_find(name, strlen(name), &key_index, &name_index);
+        assert(index_glob("Lcom/example/pkg1/Class1?;", count_match, &found_count, &name_index));
+    }
+    double index_time = elapsed_seconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t query_cur = 0; query_cur < BENCH_QUERIES / 20; query_cur++)
+    {
+        const char* name = names[(query_cur * 7919) % BENCH_NAMES];
+        for (size_t name_cur = 0; name_cur < BENCH_NAMES; name_cur++)
+        {
+            found_count += strcmp(names[name_cur], name) == 0;
+        }
+    }
+    double scan_time = elapsed_seconds(&start) * 20;
+
+    printf("%d names: build %.1f ms, %zu nodes, %zu KB\n", BENCH_NAMES, build_time * 1e3, (size_t)name_index.nodes_count, name_index.index_size / 1024);
+    printf("%d queries: index %.2f ms, linear scan %.1f ms (%zu found)\n", BENCH_QUERIES, index_time * 1e3, scan_time * 1e3, found_count);
+
+    index_release(&name_index);
+    free((void*)names);
+}
+
+int main(void)
+{
+    static char names[TEST_NAMES][64];
+    index_builder_t builder;
+    name_index_t name_index;
+
+    check_small();
+
+    make_names(names, TEST_NAMES);
+    index_builder_init(&builder);
+    for (size_t name_cur = 0; name_cur < TEST_NAMES; name_cur++)
+    {
+        assert(index_builder_add(names[name_cur], strlen(names[name_cur]), (uint32_t)name_cur, &builder));
+    }
+    assert(index_build(&builder, &name_index));
+
+    /* Every name is found, his key spells it back */
+    for (size_t name_cur = 0; name_cur < TEST_NAMES; name_cur++)
+    {
+        uint32_t key_index;
+        size_t key_length;
+        assert(index_find(names[name_cur], strlen(names[name_cur]), &key_index, &name_index));
+        assert(strcmp(index_key(key_index, &key_length, &name_index), names[name_cur]) == 0);
+    }
+    check_against_reference(names, TEST_NAMES, &name_index);
+    index_release(&name_index);
+
+    bench_lookups();
+
+    puts("Name index test passed");
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "scan/Pattern_Automaton.h"
+#include "data/Output_Buffer.h"
+
+#define RANDOM_PATTERNS 1000
+#define RANDOM_DATA (4 * 1024 * 1024)
+#define SEGMENT_SIZE (64 * 1024)
+#define BENCH_DATA (64 * 1024 * 1024)
+
+struct match_list
+{
+    uint64_t match_hash;
+
+    size_t matches_count;
+
+    size_t last_end;
+
+    uint32_t* pattern_hits;
+
+    /* Added to the ends, segments report them relative to their own start */
+    size_t end_base;
+};
+
+static bool collect_match(uint32_t pattern_index, size_t match_end, void* match_data)
+{
+    struct match_list* matches = (struct match_list*)match_data;
+
+    /* Order independent inside of a position, the outputs of a state aren't sorted */
+    match_end += matches->end_base;
+    matches->match_hash += ((uint64_t)pattern_index + 1) * 0x9e3779b97f4a7c15 ^ (uint64_t)match_end * 0xff51afd7ed558ccd;
+    matches->matches_count++;
+    matches->last_end = match_end;
+    if (matches->pattern_hits != NULL)
+    {
+        matches->pattern_hits[pattern_index]++;
+    }
+    return true;
+}
+
+static struct match_list naive_scan(const uint8_t* data, size_t data_size, uint8_t (*patterns)[16], size_t* lengths, size_t count)
+{
+    struct match_list matches = { 0 };
+
+    for (size_t data_cur = 0; data_cur < data_size; data_cur++)
+    {
+        for (size_t pattern_cur = 0; pattern_cur < count; pattern_cur++)
+        {
+            if (data_cur + 1 >= lengths[pattern_cur] && memcmp(data + data_cur + 1 - lengths[pattern_cur], patterns[pattern_cur], lengths[pattern_cur]) == 0)
+            {
+                collect_match((uint32_t)pattern_cur, data_cur + 1, &matches);
+            }
+        }
+    }
+    return matches;
+}
+
+static double bench_scan(const uint8_t* data, size_t data_size, const scan_automaton_t* automaton, size_t* matches_count)
+{
+    struct match_list matches = { 0 };
+    struct timespec bench_begin;
+    struct timespec bench_end;
+
+    clock_gettime(CLOCK_MONOTONIC, &bench_begin);
+    assert(automaton_scan(data, data_size, 0, collect_match, &matches, automaton));
+    clock_gettime(CLOCK_MONOTONIC, &bench_end);
+
+    *matches_count = matches.matches_count;
+    return (double)data_size / ((double)(bench_end.tv_sec - bench_begin.tv_sec) * 1e9 + (double)(bench_end.tv_nsec - bench_begin.tv_nsec));
+}
+
+static void bench_report(const char* data_name, uint8_t* data, scan_automaton_t* automaton)
+{
+    size_t prefilter_matches;
+    size_t plain_matches;
+
+    memcpy(data + BENCH_DATA / 2, "Lcom/crashlytics/", 17);
+    double prefilter_rate = bench_scan(data, BENCH_DATA, automaton, &prefilter_matches);
+
+    uint32_t rare_count = automaton->rare_count;
+    automaton->rare_count = 0;
+    double plain_rate = bench_scan(data, BENCH_DATA, automaton, &plain_matches);
+    automaton->rare_count = rare_count;
+
+    assert(prefilter_matches == plain_matches && plain_matches >= 1);
+    printf("%s: %.2f GB/s with the prefilter (%u rare bytes), %.2f GB/s without\n", data_name, prefilter_rate, rare_count, plain_rate);
+}
+
+int main()
+{
+    scan_automaton_t automaton;
+    scan_error_t error;
+
+    /* The classic set, with nested outputs through the failure links */
+    const char classic[] = "# comment\n[Words]\nhe\nshe\nhis\nhers\n\n[Binary]\n\\x00\\xffA\nback\\\\slash\n";
+    assert(automaton_compile(classic, sizeof(classic) - 1, &error, &automaton));
+    assert(automaton.patterns_count == 6 && automaton.max_length == 10);
+
+    uint32_t hits[6] = { 0 };
+    struct match_list matches = { .pattern_hits = hits };
+    const char text[] = "ushers and his \x00\xff" "A back\\slash";
+    assert(automaton_scan((const uint8_t*)text, sizeof(text) - 1, 0, collect_match, &matches, &automaton));
+    assert(hits[0] == 1 && hits[1] == 1 && hits[2] == 1 && hits[3] == 1 && hits[4] == 1 && hits[5] == 1);
+
+    size_t pattern_length;
+    const char* pattern = automaton_pattern(3, &pattern_length, &automaton);
+    assert(pattern_length == 4 && memcmp(pattern, "hers", 4) == 0);
+    assert(strcmp(automaton_category(3, &automaton), "Words") == 0 && strcmp(automaton_category(4, &automaton), "Binary") == 0);
+    automaton_release(&automaton);
+
+    /* Errors carry the line */
+    const char invalid[] = "[Ok]\nfine\nbad\\q\n";
+    assert(automaton_compile(invalid, sizeof(invalid) - 1, &error, &automaton) == false && error.error_line == 3);
+    assert(automaton_compile("# nothing\n", 10, &error, &automaton) == false);
+
+    /* Random patterns over a small alphabet against a naive search */
+    srand(37);
+    static uint8_t patterns[RANDOM_PATTERNS][16];
+    size_t lengths[RANDOM_PATTERNS];
+    output_buffer_t signatures;
+    outbuf_init(0, NULL, NULL, &signatures);
+    outbuf_puts("[Random]\n", &signatures);
+
+    for (size_t pattern_cur = 0; pattern_cur < RANDOM_PATTERNS; pattern_cur++)
+    {
+        lengths[pattern_cur] = 3 + (size_t)rand() % 6;
+        for (size_t byte_cur = 0; byte_cur < lengths[pattern_cur]; byte_cur++)
+        {
+            patterns[pattern_cur][byte_cur] = (uint8_t)"abcdefgh\x01\xfe"[rand() % 10];
+            outbuf_format(&signatures, "\\x%02x", patterns[pattern_cur][byte_cur]);
+        }
+        outbuf_putc('\n', &signatures);
+    }
+    assert(automaton_compile(signatures.buffer_data, outbuf_length(&signatures), &error, &automaton));
+
+    uint8_t* data = malloc(RANDOM_DATA);
+    for (size_t data_cur = 0; data_cur < RANDOM_DATA; data_cur++)
+    {
+        data[data_cur] = (uint8_t)"abcdefghijklmnop\x01\xfe"[rand() % 18];
+    }
+
+    size_t check_size = RANDOM_DATA / 16;
+    struct match_list expected = naive_scan(data, check_size, patterns, lengths, RANDOM_PATTERNS);
+    struct match_list serial = { 0 };
+    assert(automaton_scan(data, check_size, 0, collect_match, &serial, &automaton));
+    assert(expected.matches_count != 0 && serial.matches_count == expected.matches_count && serial.match_hash == expected.match_hash);
+
+    /* Segments overlapping by max_length - 1 see every match exactly once */
+    struct match_list segmented = { 0 };
+    for (size_t segment_begin = 0; segment_begin < check_size; segment_begin += SEGMENT_SIZE)
+    {
+        size_t overlap = segment_begin == 0 ? 0 : automaton.max_length - 1;
+        size_t segment_end = segment_begin + SEGMENT_SIZE < check_size ? segment_begin + SEGMENT_SIZE : check_size;
+
+        segmented.end_base = segment_begin - overlap;
+        assert(automaton_scan(data + segment_begin - overlap, segment_end - segment_begin + overlap, overlap, collect_match, &segmented, &automaton));
+    }
+    assert(segmented.matches_count == expected.matches_count && segmented.match_hash == expected.match_hash);
+
+    /* The image round trips through a file and maps without rebuilding */
+    char image_path[64];
+    snprintf(image_path, sizeof(image_path), "/tmp/pattern_automaton_%d.dca", (int)getpid());
+    assert(automaton_save(image_path, &automaton));
+
+    scan_automaton_t loaded;
+    assert(automaton_load(image_path, &loaded) && loaded.image_mapped);
+    struct match_list reloaded = { 0 };
+    assert(automaton_scan(data, check_size, 0, collect_match, &reloaded, &loaded));
+    assert(reloaded.match_hash == expected.match_hash);
+    automaton_release(&loaded);
+
+    /* A damaged image is refused */
+    FILE* image_file = fopen(image_path, "r+b");
+    fseek(image_file, 400, SEEK_SET);
+    fputc(0x7f, image_file);
+    fseek(image_file, 401, SEEK_SET);
+    fputc(0x7f, image_file);
+    fclose(image_file);
+    truncate(image_path, (off_t)automaton.image_size - 4);
+    assert(automaton_load(image_path, &loaded) == false);
+    unlink(image_path);
+
+    automaton_release(&automaton);
+    outbuf_deinit(&signatures);
+    free(data);
+
+    /* Throughput over DEX like data: identifiers and paths with few hits */
+    const char trackers[] = "[Tracking]\nLcom/google/firebase/analytics/\nLcom/crashlytics/\nLcom/flurry/\nLio/sentry/\n"
+        "app-measurement.com\ngoogle-analytics.com\n[Ads]\nLcom/google/android/gms/ads/\nLcom/facebook/ads/\n"
+        "Lcom/unity3d/ads/\nLcom/applovin/\ndoubleclick.net\n";
+    assert(automaton_compile(trackers, sizeof(trackers) - 1, &error, &automaton));
+    assert(automaton.rare_count != 0);
+
+    uint8_t* bench = malloc(BENCH_DATA);
+    const char* words[] = { "Landroid/app/Activity;", "getString", "onCreate", "Ljava/lang/Object;", "\x00\x01\x12", "value",
+        "Lorg/example/app/MainActivity;", "<init>", "toString", "\x0e\x00\x00\x00" };
+    for (size_t bench_cur = 0; bench_cur < BENCH_DATA; )
+    {
+        const char* word = words[rand() % 10];
+        size_t word_length = strlen(word) + 1;
+        if (bench_cur + word_length > BENCH_DATA)
+        {
+            word_length = BENCH_DATA - bench_cur;
+        }
+        memcpy(bench + bench_cur, word, word_length);
+        bench_cur += word_length;
+    }
+    bench_report("identifiers", bench, &automaton);
+
+    /* Native code and packed data, where most blocks hold no rare byte */
+    for (size_t bench_cur = 0; bench_cur < BENCH_DATA; bench_cur++)
+    {
+        bench[bench_cur] = (uint8_t)rand();
+    }
+    bench_report("binary", bench, &automaton);
+
+    automaton_release(&automaton);
+    free(bench);
+
+    return 0;
+}
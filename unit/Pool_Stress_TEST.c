@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <malloc.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "Thread_Pool.h"
+#include "cpu/CPU_Time.h"
+#include "data/FIFO_Queue.h"
+
+/* Runs rounds of: a pool of a random size, submitters hammering it with every kind of
+ * submission and a stop coming at a random moment (from the main thread or from one of the
+ * submitters), then the count of runs of each task is checked and the pool finalized.
+ * The argument is the duration in seconds, a few by default, minutes for a soak
+*/
+#define STRESS_DEFAULT_SECONDS 3
+
+#define STRESS_WORKERS_MAX 8
+#define STRESS_SUBMITTERS_MAX 6
+
+/* Task identifiers by round, a round ends earlier when it has used all of them */
+#define STRESS_TASK_IDS (1 << 16)
+
+#define STRESS_GROUP_MAX 16
+
+#define STRESS_QUEUE_PRODUCERS 3
+#define STRESS_QUEUE_CONSUMERS 3
+#define STRESS_QUEUE_ITEMS 20000
+
+/* Memory still in use after the first second that the soak tolerates */
+#define STRESS_LEAK_BYTES (2 * 1024 * 1024)
+
+#define STRESS_RESULT(task_id) ((void*)((uintptr_t)(task_id) * 7 + 3))
+
+typedef struct stress_round
+{
+    tpool_t round_pool;
+
+    uint64_t round_deadline;
+
+    /* One of the submitters stops the pool, when the main thread doesn't */
+    int submitter_stopping;
+
+    _Atomic uint32_t next_task_id;
+
+    /* Written before the task can run or after it returns, read once the round is over */
+    _Atomic uint8_t task_expected[STRESS_TASK_IDS];
+
+    _Atomic uint32_t task_runs[STRESS_TASK_IDS];
+
+} stress_round_t;
+
+typedef struct stress_submitter
+{
+    stress_round_t* submitter_round;
+
+    int submitter_index;
+
+    unsigned int random_seed;
+
+    pthread_t submitter_thread;
+
+} stress_submitter_t;
+
+static stress_round_t stress_current;
+
+static _Atomic uint64_t tasks_done;
+
+static _Thread_local unsigned int task_seed = 1;
+
+/* Lengthens a few tasks, the ordering between threads changes every round */
+static void stress_jitter(unsigned int* random_seed)
+{
+    unsigned int jitter = rand_r(random_seed) % 64;
+
+    if (jitter == 0)
+    {
+        cpu_sleep_nano(20000 + rand_r(random_seed) % 80000);
+    }
+    else if (jitter < 8)
+    {
+        sched_yield();
+    }
+}
+
+static uint32_t stress_task_id(stress_round_t* round)
+{
+    uint32_t task_id = atomic_fetch_add(&round->next_task_id, 1);
+    return task_id < STRESS_TASK_IDS ? task_id : UINT32_MAX;
+}
+
+static void* stress_task(void* task_data)
+{
+    uint32_t task_id = (uint32_t)(uintptr_t)task_data - 1;
+
+    atomic_fetch_add(&stress_current.task_runs[task_id], 1);
+    atomic_fetch_add(&tasks_done, 1);
+    stress_jitter(&task_seed);
+
+    return STRESS_RESULT(task_id);
+}
+
+/* Submitted groups run inline when the pool is stopped, each task runs exactly once either way */
+static void stress_group(stress_round_t* round, int group_size)
+{
+    tpool_group_t task_group;
+    tpool_group_init(&task_group);
+
+    for (int task_cur = 0; task_cur < group_size; task_cur++)
+    {
+        uint32_t task_id = stress_task_id(round);
+        if (task_id == UINT32_MAX)
+        {
+            break;
+        }
+        round->task_expected[task_id] = 1;
+
+        void* task_data = (void*)(uintptr_t)(task_id + 1);
+        if (tpool_group_execute(stress_task, task_data, &task_group, &round->round_pool) == false)
+        {
+            stress_task(task_data);
+        }
+    }
+    tpool_group_wait(&task_group, &round->round_pool);
+    tpool_group_destroy(&task_group);
+}
+
+/* A task splitting himself into a group, it helps the workers while it waits */
+static void* stress_nested_task(void* task_data)
+{
+    stress_round_t* round = (stress_round_t*)task_data;
+
+    stress_group(round, 1 + rand_r(&task_seed) % STRESS_GROUP_MAX);
+    return round;
+}
+
+static void* stress_submitter_routine(void* submitter_data)
+{
+    stress_submitter_t* submitter = (stress_submitter_t*)submitter_data;
+    stress_round_t* round = submitter->submitter_round;
+    tpool_t* round_pool = &round->round_pool;
+
+    task_seed = submitter->random_seed;
+
+    while (cpu_nanos() < round->round_deadline)
+    {
+        uint32_t task_id;
+        void* task_result;
+
+        switch (rand_r(&submitter->random_seed) % 5)
+        {
+        case 0:
+            if ((task_id = stress_task_id(round)) == UINT32_MAX)
+            {
+                return NULL;
+            }
+            /* Marked first, a fast worker may run it before tpool_execute returns */
+            round->task_expected[task_id] = 1;
+            if (tpool_execute(stress_task, (void*)(uintptr_t)(task_id + 1), round_pool) == false)
+            {
+                round->task_expected[task_id] = 0;
+            }
+            break;
+        case 1:
+            if ((task_id = stress_task_id(round)) == UINT32_MAX)
+            {
+                return NULL;
+            }
+            round->task_expected[task_id] = 1;
+            task_result = tpool_wait_for_result(stress_task, (void*)(uintptr_t)(task_id + 1), round_pool);
+            if (task_result == NULL)
+            {
+                round->task_expected[task_id] = 0;
+            }
+            else
+            {
+                assert(task_result == STRESS_RESULT(task_id));
+            }
+            break;
+        case 2:
+            stress_group(round, 1 + rand_r(&submitter->random_seed) % STRESS_GROUP_MAX);
+            break;
+        case 3:
+            task_result = tpool_wait_for_result(stress_nested_task, round, round_pool);
+            assert(task_result == NULL || task_result == round);
+            break;
+        default:
+            if (submitter->submitter_index == round->submitter_stopping && rand_r(&submitter->random_seed) % 256 == 0)
+            {
+                tpool_stop(round_pool);
+            }
+            stress_jitter(&submitter->random_seed);
+        }
+    }
+    return NULL;
+}
+
+static size_t stress_memory_in_use(void)
+{
+    struct mallinfo2 heap_info = mallinfo2();
+    return heap_info.uordblks + heap_info.hblkhd;
+}
+
+static void stress_pool_round(unsigned int* random_seed)
+{
+    stress_round_t* round = &stress_current;
+    stress_submitter_t submitters[STRESS_SUBMITTERS_MAX];
+
+    int workers_count = 1 + rand_r(random_seed) % STRESS_WORKERS_MAX;
+    int submitters_count = 1 + rand_r(random_seed) % STRESS_SUBMITTERS_MAX;
+    uint64_t round_nanos = 20000000 + rand_r(random_seed) % 80000000;
+
+    uint32_t ids_used = atomic_load(&round->next_task_id);
+    ids_used = ids_used < STRESS_TASK_IDS ? ids_used : STRESS_TASK_IDS;
+    for (uint32_t task_id = 0; task_id < ids_used; task_id++)
+    {
+        round->task_expected[task_id] = 0;
+        round->task_runs[task_id] = 0;
+    }
+    round->next_task_id = 0;
+    round->round_deadline = cpu_nanos() + round_nanos;
+    /* -1: the main thread stops the pool, while the submitters run or after them */
+    round->submitter_stopping = (int)(rand_r(random_seed) % (submitters_count + 2)) - 2;
+
+    tpool_init(workers_count, &round->round_pool);
+
+    for (int submitter_cur = 0; submitter_cur < submitters_count; submitter_cur++)
+    {
+        submitters[submitter_cur].submitter_round = round;
+        submitters[submitter_cur].submitter_index = submitter_cur;
+        submitters[submitter_cur].random_seed = rand_r(random_seed);
+        pthread_create(&submitters[submitter_cur].submitter_thread, NULL, stress_submitter_routine, &submitters[submitter_cur]);
+    }
+
+    if (round->submitter_stopping == -1)
+    {
+        cpu_sleep_nano(rand_r(random_seed) % round_nanos);
+        tpool_stop(&round->round_pool);
+    }
+
+    for (int submitter_cur = 0; submitter_cur < submitters_count; submitter_cur++)
+    {
+        pthread_join(submitters[submitter_cur].submitter_thread, NULL);
+    }
+    tpool_stop(&round->round_pool);
+
+    /* Every accepted task was run once, the refused ones never */
+    uint32_t ids_checked = atomic_load(&round->next_task_id);
+    ids_checked = ids_checked < STRESS_TASK_IDS ? ids_checked : STRESS_TASK_IDS;
+    for (uint32_t task_id = 0; task_id < ids_checked; task_id++)
+    {
+        if (round->task_runs[task_id] != round->task_expected[task_id])
+        {
+            fprintf(stderr, "task %u ran %u times, expected %u\n", task_id, (unsigned int)round->task_runs[task_id],
+                (unsigned int)round->task_expected[task_id]);
+        }
+        assert(round->task_runs[task_id] == round->task_expected[task_id]);
+    }
+
+    /* Stopped, nothing is taken anymore */
+    assert(tpool_execute(stress_task, (void*)1, &round->round_pool) == false);
+    assert(tpool_wait_for_result(stress_task, (void*)1, &round->round_pool) == NULL);
+
+    tpool_finalize(&round->round_pool);
+}
+
+typedef struct stress_queue
+{
+    FIFO_queue_t* queue_safe;
+
+    _Atomic uint32_t items_produced;
+
+    _Atomic uint32_t items_consumed;
+
+    _Atomic uint8_t item_seen[STRESS_QUEUE_PRODUCERS * STRESS_QUEUE_ITEMS];
+
+} stress_queue_t;
+
+static stress_queue_t stress_fifo;
+
+static void* stress_producer_routine(void* producer_data)
+{
+    uintptr_t producer_index = (uintptr_t)producer_data;
+    unsigned int random_seed = (unsigned int)producer_index + 1;
+
+    for (uint32_t item_cur = 0; item_cur < STRESS_QUEUE_ITEMS; item_cur++)
+    {
+        uintptr_t item = producer_index * STRESS_QUEUE_ITEMS + item_cur + 1;
+        bool enqueue_ret = queue_enqueue((void*)item, stress_fifo.queue_safe);
+        assert(enqueue_ret);
+        atomic_fetch_add(&stress_fifo.items_produced, 1);
+
+        if (rand_r(&random_seed) % 1024 == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+/* Each consumer sees the items of a producer in the order they were queued */
+static void* stress_consumer_routine(void* consumer_data)
+{
+    uintptr_t last_item[STRESS_QUEUE_PRODUCERS] = {0};
+    (void)consumer_data;
+
+    while (atomic_load(&stress_fifo.items_consumed) != STRESS_QUEUE_PRODUCERS * STRESS_QUEUE_ITEMS)
+    {
+        uintptr_t item = (uintptr_t)queue_dequeue(stress_fifo.queue_safe);
+        if (item == 0)
+        {
+            sched_yield();
+            continue;
+        }
+        size_t producer_index = (item - 1) / STRESS_QUEUE_ITEMS;
+
+        assert(item > last_item[producer_index]);
+        last_item[producer_index] = item;
+
+        uint8_t item_seen = atomic_fetch_add(&stress_fifo.item_seen[item - 1], 1);
+        assert(item_seen == 0);
+        atomic_fetch_add(&stress_fifo.items_consumed, 1);
+    }
+    return NULL;
+}
+
+static void stress_queue_round(void)
+{
+    pthread_t producers[STRESS_QUEUE_PRODUCERS];
+    pthread_t consumers[STRESS_QUEUE_CONSUMERS];
+
+    stress_fifo.queue_safe = queue_create(16);
+    queue_safe_lock(stress_fifo.queue_safe);
+    stress_fifo.items_produced = stress_fifo.items_consumed = 0;
+    for (size_t item_cur = 0; item_cur < STRESS_QUEUE_PRODUCERS * STRESS_QUEUE_ITEMS; item_cur++)
+    {
+        stress_fifo.item_seen[item_cur] = 0;
+    }
+
+    for (uintptr_t thread_cur = 0; thread_cur < STRESS_QUEUE_CONSUMERS; thread_cur++)
+    {
+        pthread_create(&consumers[thread_cur], NULL, stress_consumer_routine, (void*)thread_cur);
+    }
+    for (uintptr_t thread_cur = 0; thread_cur < STRESS_QUEUE_PRODUCERS; thread_cur++)
+    {
+        pthread_create(&producers[thread_cur], NULL, stress_producer_routine, (void*)thread_cur);
+    }
+
+    for (size_t thread_cur = 0; thread_cur < STRESS_QUEUE_PRODUCERS; thread_cur++)
+    {
+        pthread_join(producers[thread_cur], NULL);
+    }
+    for (size_t thread_cur = 0; thread_cur < STRESS_QUEUE_CONSUMERS; thread_cur++)
+    {
+        pthread_join(consumers[thread_cur], NULL);
+    }
+
+    assert(queue_empty(stress_fifo.queue_safe));
+    assert(stress_fifo.items_produced == STRESS_QUEUE_PRODUCERS * STRESS_QUEUE_ITEMS);
+    queue_destroy(stress_fifo.queue_safe);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int stress_seconds = argc > 1 ? (unsigned int)strtoul(argv[1], NULL, 10) : STRESS_DEFAULT_SECONDS;
+    unsigned int random_seed = argc > 2 ? (unsigned int)strtoul(argv[2], NULL, 10) : (unsigned int)cpu_nanos();
+
+    printf("stress: %u seconds, seed %u\n", stress_seconds, random_seed);
+
+    uint64_t stress_start = cpu_nanos();
+    uint64_t stress_end = stress_start + (uint64_t)stress_seconds * 1000000000;
+    uint64_t window_start = stress_start;
+    uint64_t window_tasks = 0;
+    unsigned int rounds_count = 0;
+    size_t memory_base = 0;
+
+    /* One line by second: throughput that drops or memory that grows over the run are the
+     * slowdowns and the leaks
+    */
+    do
+    {
+        stress_pool_round(&random_seed);
+        stress_queue_round();
+        rounds_count++;
+
+        uint64_t now = cpu_nanos();
+        if (now - window_start >= 1000000000 || now >= stress_end)
+        {
+            uint64_t tasks_now = atomic_load(&tasks_done);
+            size_t memory_now = stress_memory_in_use();
+
+            printf("stress: %5.1fs %10.0f tasks/s %8zu KB in use %6u rounds\n", (double)(now - stress_start) / 1e9,
+                (double)(tasks_now - window_tasks) * 1e9 / (double)(now - window_start), memory_now / 1024, rounds_count);
+
+            if (memory_base == 0)
+            {
+                memory_base = memory_now;
+            }
+            else
+            {
+                assert(memory_now < memory_base + STRESS_LEAK_BYTES);
+            }
+            window_start = now;
+            window_tasks = tasks_now;
+        }
+    } while (cpu_nanos() < stress_end);
+
+    printf("stress: %u rounds, %llu tasks\n", rounds_count, (unsigned long long)atomic_load(&tasks_done));
+
+    return 0;
+}
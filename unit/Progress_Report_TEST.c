@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "Progress_Report.h"
+
+#define TEST_THREADS 80
+#define TEST_ENTRIES 2000
+#define BENCH_ADDS 10000000
+
+static bool capture_report(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    return outbuf_append(flush_data, flush_size, (output_buffer_t*)flush_context);
+}
+
+static void* test_worker(void* thread_data)
+{
+    progress_t* progress = (progress_t*)thread_data;
+
+    for (int entry_cur = 0; entry_cur < TEST_ENTRIES; entry_cur++)
+    {
+        progress_add(PROGRESS_UNPACK, PROGRESS_ENTRIES, 1, progress);
+        progress_add(PROGRESS_UNPACK, PROGRESS_BYTES, 512, progress);
+        if (entry_cur % 100 == 0)
+        {
+            progress_add(PROGRESS_DISAS, PROGRESS_CLASSES, 7, progress);
+        }
+    }
+
+    return NULL;
+}
+
+/* The last line is the final report */
+static const char* last_line(output_buffer_t* captured)
+{
+    outbuf_putc('\0', captured);
+
+    char* text = captured->buffer_data;
+    size_t text_length = strlen(text);
+
+    assert(text_length != 0 && text[text_length - 1] == '\n');
+    text[text_length - 1] = '\0';
+
+    const char* line = strrchr(text, '\n');
+    return line != NULL ? line + 1 : text;
+}
+
+int main()
+{
+    progress_mode_t progress_mode;
+    assert(progress_parse_mode("json", &progress_mode) && progress_mode == PROGRESS_JSON);
+    assert(progress_parse_mode("simple", &progress_mode) && progress_mode == PROGRESS_SIMPLE);
+    assert(progress_parse_mode("fancy", &progress_mode) == false);
+
+    /* More threads than shards, the last ones share a shard */
+    output_buffer_t captured;
+    progress_t progress;
+    outbuf_init(0, NULL, NULL, &captured);
+    assert(progress_start(PROGRESS_JSON, capture_report, &captured, &progress));
+
+    progress_expect(PROGRESS_UNPACK, TEST_THREADS * TEST_ENTRIES, (uint64_t)TEST_THREADS * TEST_ENTRIES * 512, &progress);
+
+    pthread_t threads[TEST_THREADS];
+    for (int thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        pthread_create(&threads[thread_cur], NULL, test_worker, &progress);
+    }
+    for (int thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        pthread_join(threads[thread_cur], NULL);
+    }
+
+    assert(progress_finish(&progress));
+
+    const char* final_line = last_line(&captured);
+    char expected[256];
+    snprintf(expected, sizeof(expected), "\"unpack\":{\"entries\":%d,\"entries_total\":%d,\"bytes\":%d,\"bytes_total\":%d,\"classes\":0,",
+        TEST_THREADS * TEST_ENTRIES, TEST_THREADS * TEST_ENTRIES, TEST_THREADS * TEST_ENTRIES * 512, TEST_THREADS * TEST_ENTRIES * 512);
+
+    assert(strncmp(final_line, "{\"elapsed_ms\":", 14) == 0 && strstr(final_line, "\"final\":true") != NULL);
+    assert(strstr(final_line, expected) != NULL);
+    assert(strstr(final_line, "\"eta_ms\":0}") != NULL);
+
+    snprintf(expected, sizeof(expected), "\"disas\":{\"entries\":0,\"entries_total\":0,\"bytes\":0,\"bytes_total\":0,\"classes\":%d,",
+        TEST_THREADS * (TEST_ENTRIES / 100) * 7);
+    assert(strstr(final_line, expected) != NULL);
+
+    /* The simple mode rewrites one line and ends it with the final report */
+    outbuf_reset(&captured);
+    assert(progress_start(PROGRESS_SIMPLE, capture_report, &captured, &progress));
+    progress_expect(PROGRESS_DECODE, 10, 10000, &progress);
+
+    for (int entry_cur = 0; entry_cur < 10; entry_cur++)
+    {
+        progress_add(PROGRESS_DECODE, PROGRESS_ENTRIES, 1, &progress);
+        progress_add(PROGRESS_DECODE, PROGRESS_BYTES, 1000, &progress);
+        usleep(60000);
+    }
+    assert(progress_finish(&progress));
+
+    outbuf_putc('\0', &captured);
+    assert(captured.buffer_data[0] == '\r' && strstr(captured.buffer_data, "decode 10/10 100%") != NULL);
+    assert(strchr(captured.buffer_data, '\n') == captured.buffer_data + strlen(captured.buffer_data) - 1);
+
+    /* The hot path cost with the reporter running */
+    outbuf_reset(&captured);
+    assert(progress_start(PROGRESS_VERBOSE, capture_report, &captured, &progress));
+
+    struct timespec bench_begin;
+    struct timespec bench_end;
+    clock_gettime(CLOCK_MONOTONIC, &bench_begin);
+    for (int add_cur = 0; add_cur < BENCH_ADDS; add_cur++)
+    {
+        progress_add(PROGRESS_UNPACK, PROGRESS_BYTES, 1, &progress);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &bench_end);
+    assert(progress_finish(&progress));
+
+    printf("progress_add: %.2f ns\n", ((double)(bench_end.tv_sec - bench_begin.tv_sec) * 1e9 +
+        (double)(bench_end.tv_nsec - bench_begin.tv_nsec)) / BENCH_ADDS);
+
+    outbuf_deinit(&captured);
+
+    return 0;
+}
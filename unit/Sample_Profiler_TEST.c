@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "cpu/Sample_Profiler.h"
+
+/* The callers are only found through the frame pointers */
+#pragma GCC optimize ("no-omit-frame-pointer")
+
+#define SPIN_NANO 300000000 /* 300 milliseconds of CPU */
+
+static volatile uint64_t spin_sink;
+
+static uint64_t thread_cpu_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+/* Burns this much CPU time, whatever the count of cores */
+__attribute__((noinline))
+static void profile_spin(uint64_t spin_nanos)
+{
+    uint64_t spin_start = thread_cpu_nanos();
+
+    while (thread_cpu_nanos() - spin_start < spin_nanos)
+    {
+        for (int round_cur = 0; round_cur < 1000; round_cur++)
+        {
+            spin_sink = spin_sink * 31 + (uint64_t)round_cur;
+        }
+    }
+}
+
+__attribute__((noinline))
+static void profile_task(void)
+{
+    PROF_STAGE_SCOPE("spin");
+    profile_spin(SPIN_NANO);
+}
+
+static void* profile_worker(void* data)
+{
+    (void)data;
+    prof_thread_begin("worker", 1);
+
+    prof_task_t previous_task = prof_task((prof_task_t)profile_task);
+    profile_task();
+    prof_task(previous_task);
+
+    prof_thread_end();
+    return NULL;
+}
+
+/* Sums the counts of the lines containing all the words */
+static unsigned long count_samples(const char* folded, const char* first_word, const char* second_word)
+{
+    unsigned long samples_count = 0;
+
+    for (const char* line = folded; *line != '\0'; )
+    {
+        const char* line_end = strchr(line, '\n');
+        size_t line_length = line_end != NULL ? (size_t)(line_end - line) : strlen(line);
+        char line_copy[4096];
+
+        snprintf(line_copy, sizeof(line_copy), "%.*s", (int)line_length, line);
+        if (strstr(line_copy, first_word) != NULL && (second_word == NULL || strstr(line_copy, second_word) != NULL))
+        {
+            const char* count = strrchr(line_copy, ' ');
+            assert(count != NULL);
+            samples_count += strtoul(count + 1, NULL, 10);
+        }
+        line = line_end != NULL ? line_end + 1 : line + line_length;
+    }
+    return samples_count;
+}
+
+int main()
+{
+    char folded_path[] = "/tmp/droidcat_profile_XXXXXX";
+    int folded_fd = mkstemp(folded_path);
+    assert(folded_fd >= 0);
+    close(folded_fd);
+
+    /* Not started, the tags are ignored */
+    prof_thread_begin("main", -1);
+    assert(prof_stage("nothing") == NULL);
+
+    assert(prof_start(PROF_DEFAULT_HZ));
+    prof_thread_begin("main", -1);
+
+    pthread_t worker;
+    assert(pthread_create(&worker, NULL, profile_worker, NULL) == 0);
+    profile_spin(SPIN_NANO);
+    pthread_join(worker, NULL);
+
+    assert(prof_stop(folded_path));
+    assert(prof_stop(folded_path) == false);
+
+    FILE* folded_file = fopen(folded_path, "r");
+    assert(folded_file != NULL);
+    char* folded = calloc(1, 1 << 20);
+    size_t folded_size = fread(folded, 1, (1 << 20) - 1, folded_file);
+    folded[folded_size] = '\0';
+    fclose(folded_file);
+    unlink(folded_path);
+
+    fprintf(stderr, "%s", folded);
+
+    /* 300ms of CPU at 1 kHz, by each thread */
+    unsigned long main_samples = count_samples(folded, "main;", NULL);
+    unsigned long worker_samples = count_samples(folded, "worker-1;profile_task;[spin];", NULL);
+    printf("main: %lu samples, worker: %lu samples\n", main_samples, worker_samples);
+
+    assert(main_samples >= 150 && main_samples <= 450);
+    assert(worker_samples >= 150 && worker_samples <= 450);
+
+    /* The leaf is resolved with the symbols of the program, the caller with the frame pointers */
+    assert(count_samples(folded, "main;", "profile_spin") >= main_samples / 2);
+    assert(count_samples(folded, "[spin];", "profile_task;profile_spin") >= worker_samples / 2);
+
+    free(folded);
+    return 0;
+}
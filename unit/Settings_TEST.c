@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "config/Settings.h"
+
+#define RELOADS_COUNT 200
+
+static const char test_settings[] =
+    "# droidcat settings\n"
+    "[log]\n"
+    "filename=\"droidcat.log\"\n"
+    "level=\"debug\"\n"
+    "[droidcat]\n"
+    "max_thread = 6  # comment after a value\n"
+    "use_max_cpu=true\n"
+    "config_filename='settings.toml'\n"
+    "\n"
+    "[input]\n"
+    "default_input=\"F-Droid.apk\"\n"
+    "\n"
+    "[output]\n"
+    "unknown_output=[\"app-out\", \"out\",\n"
+    "    \"pack\\\"age\", # multiline arrays\n"
+    "]\n"
+    "\n"
+    "[plugins]\n"
+    "future_key = [1, [true, 'x'], \"y\"]\n"
+    "[modules]\n";
+
+static void check_error(const char* source, size_t error_line)
+{
+    settings_t settings;
+    settings_error_t error;
+
+    settings_defaults(&settings);
+    assert(settings_parse(source, strlen(source), &settings, &error) == false);
+    assert(error.error_line == error_line);
+    assert(error.error_message[0] != '\0');
+}
+
+static settings_store_t test_store;
+static volatile int reloads_done;
+
+/* The reload N publishes the generation N + 2 with max_thread derived from N, a freed
+ * snapshot would break the relation
+*/
+static void* test_reader(void* thread_data)
+{
+    uint64_t last_generation = 0;
+
+    (void)thread_data;
+    while (reloads_done == 0)
+    {
+        size_t read_epoch;
+        const settings_t* settings = settings_acquire(&read_epoch, &test_store);
+        uint64_t generation = settings->settings_generation;
+
+        assert(generation >= last_generation);
+        last_generation = generation;
+        if (generation != 1)
+        {
+            assert(strcmp(settings->log_filename, "reload.log") == 0);
+            assert(settings->max_thread == (int)((generation - 2) % 100 + 1));
+        }
+
+        settings_release(read_epoch, &test_store);
+    }
+    return NULL;
+}
+
+int main()
+{
+    settings_t settings;
+    settings_error_t error;
+
+    settings_defaults(&settings);
+    assert(settings_parse(test_settings, strlen(test_settings), &settings, &error));
+    assert(settings.max_thread == 6 && settings.use_max_cpu);
+    assert(strcmp(settings.log_filename, "droidcat.log") == 0 && strcmp(settings.log_level, "debug") == 0);
+    assert(strcmp(settings.config_filename, "settings.toml") == 0);
+    assert(strcmp(settings.default_input, "F-Droid.apk") == 0);
+    assert(settings.outputs_count == 3);
+    assert(strcmp(settings.unknown_output[0], "app-out") == 0);
+    assert(strcmp(settings.unknown_output[2], "pack\"age") == 0);
+
+    check_error("[droidcat]\nmax_thread = \"four\"\n", 2);
+    check_error("[droidcat]\n\nmax_thread = 0\n", 3);
+    check_error("[log]\nfilename = \"open\n", 2);
+    check_error("[log\n", 1);
+    check_error("key value\n", 1);
+    check_error("[output]\nunknown_output = [\"a\" \"b\"]\n", 2);
+    check_error("[output]\nunknown_output = [1]\n", 2);
+    check_error("[droidcat]\nuse_max_cpu = true false\n", 2);
+
+    /* Reloads while readers are running */
+    char settings_path[] = "/tmp/droidcat-settings-XXXXXX";
+    int settings_fd = mkstemp(settings_path);
+    assert(settings_fd >= 0);
+
+    assert(settings_store_init(&test_store));
+
+    pthread_t readers[2];
+    for (int reader_cur = 0; reader_cur < 2; reader_cur++)
+    {
+        pthread_create(&readers[reader_cur], NULL, test_reader, NULL);
+    }
+
+    for (int reload_cur = 0; reload_cur < RELOADS_COUNT; reload_cur++)
+    {
+        char settings_text[128];
+        int text_length = snprintf(settings_text, sizeof(settings_text), "[log]\nfilename=\"reload.log\"\n[droidcat]\nmax_thread=%d\n", reload_cur % 100 + 1);
+
+        assert(pwrite(settings_fd, settings_text, (size_t)text_length, 0) == text_length);
+        assert(ftruncate(settings_fd, text_length) == 0);
+        assert(settings_load(settings_path, &error, &test_store));
+    }
+    reloads_done = 1;
+
+    for (int reader_cur = 0; reader_cur < 2; reader_cur++)
+    {
+        pthread_join(readers[reader_cur], NULL);
+    }
+
+    /* A broken file keeps the current snapshot */
+    assert(pwrite(settings_fd, "[droidcat\n", 10, 0) == 10);
+    assert(ftruncate(settings_fd, 10) == 0);
+    assert(settings_load(settings_path, &error, &test_store) == false && error.error_line == 1);
+
+    size_t read_epoch;
+    const settings_t* current = settings_acquire(&read_epoch, &test_store);
+    assert(current->settings_generation == RELOADS_COUNT + 1);
+    assert(current->max_thread == (RELOADS_COUNT - 1) % 100 + 1);
+    settings_release(read_epoch, &test_store);
+
+    settings_store_deinit(&test_store);
+    close(settings_fd);
+    unlink(settings_path);
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "data/String_Intern.h"
+
+#define TEST_THREADS 16
+#define TEST_STRINGS 20000
+#define BENCH_STRINGS 200000
+#define BENCH_ROUNDS 4
+
+struct intern_worker
+{
+    intern_table_t* intern_table;
+
+    char (*strings)[48];
+
+    size_t strings_count;
+
+    /* Each worker starts at a different place, the same strings race between them */
+    size_t first_string;
+
+    uint32_t* string_ids;
+
+    size_t rounds_count;
+};
+
+static void* intern_worker(void* worker_data)
+{
+    struct intern_worker* worker = (struct intern_worker*)worker_data;
+
+    for (size_t round_cur = 0; round_cur < worker->rounds_count; round_cur++)
+    {
+        for (size_t string_cur = 0; string_cur < worker->strings_count; string_cur++)
+        {
+            size_t string_index = (worker->first_string + string_cur) % worker->strings_count;
+            const char* string = worker->strings[string_index];
+
+            uint32_t string_id = intern_string(string, strlen(string), worker->intern_table);
+            assert(string_id != INTERN_NONE);
+            if (worker->string_ids != NULL)
+            {
+                worker->string_ids[string_index] = string_id;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* DEX like names: a few packages, many classes and members */
+static void make_strings(char (*strings)[48], size_t strings_count)
+{
+    static const char* packages[] = { "Landroid/app/", "Ljava/lang/", "Lcom/example/ui/", "Landroidx/core/view/" };
+
+    for (size_t string_cur = 0; string_cur < strings_count; string_cur++)
+    {
+        snprintf(strings[string_cur], sizeof(strings[string_cur]), "%sClass%zu;", packages[string_cur % 4], string_cur);
+    }
+}
+
+static double bench_threads(size_t threads_count, char (*strings)[48])
+{
+    intern_table_t* intern_table = intern_create();
+    pthread_t threads[64];
+    struct intern_worker workers[64];
+    struct timespec bench_begin;
+    struct timespec bench_end;
+
+    clock_gettime(CLOCK_MONOTONIC, &bench_begin);
+    for (size_t thread_cur = 0; thread_cur < threads_count; thread_cur++)
+    {
+        workers[thread_cur] = (struct intern_worker){ .intern_table = intern_table, .strings = strings, .strings_count = BENCH_STRINGS,
+            .first_string = thread_cur * (BENCH_STRINGS / threads_count), .rounds_count = BENCH_ROUNDS };
+        pthread_create(&threads[thread_cur], NULL, intern_worker, &workers[thread_cur]);
+    }
+    for (size_t thread_cur = 0; thread_cur < threads_count; thread_cur++)
+    {
+        pthread_join(threads[thread_cur], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &bench_end);
+
+    assert(intern_count(intern_table) == BENCH_STRINGS);
+    intern_destroy(intern_table);
+
+    double elapsed_nano = (double)(bench_end.tv_sec - bench_begin.tv_sec) * 1e9 + (double)(bench_end.tv_nsec - bench_begin.tv_nsec);
+    return (double)threads_count * BENCH_STRINGS * BENCH_ROUNDS / elapsed_nano * 1e3;
+}
+
+int main()
+{
+    intern_table_t* intern_table = intern_create();
+    assert(intern_table != NULL);
+
+    /* Same bytes, same id, NUL bytes and empty strings are valid strings */
+    uint32_t object_id = intern_string("Ljava/lang/Object;", 18, intern_table);
+    uint32_t string_id = intern_string("Ljava/lang/String;", 18, intern_table);
+    uint32_t prefix_id = intern_string("Ljava/lang/Object;", 17, intern_table);
+    uint32_t empty_id = intern_string("", 0, intern_table);
+    uint32_t binary_id = intern_string("a\0b", 3, intern_table);
+
+    assert(object_id != string_id && object_id != prefix_id && empty_id != binary_id);
+    assert(intern_string("Ljava/lang/Object;", 18, intern_table) == object_id);
+    assert(intern_string("a\0b", 3, intern_table) == binary_id && intern_string("a\0c", 3, intern_table) != binary_id);
+
+    size_t string_length;
+    assert(strcmp(intern_lookup(object_id, &string_length, intern_table), "Ljava/lang/Object;") == 0 && string_length == 18);
+    assert(intern_lookup(empty_id, &string_length, intern_table)[0] == '\0' && string_length == 0);
+    assert(memcmp(intern_lookup(binary_id, &string_length, intern_table), "a\0b", 4) == 0 && string_length == 3);
+    assert(intern_lookup(INTERN_NONE, &string_length, intern_table) == NULL);
+    assert(intern_count(intern_table) == 6);
+    intern_destroy(intern_table);
+
+    /* Many threads racing on the same strings agree on every id, the ids are distinct */
+    char (*strings)[48] = malloc(sizeof(*strings) * BENCH_STRINGS);
+    make_strings(strings, BENCH_STRINGS);
+
+    intern_table = intern_create();
+    pthread_t threads[TEST_THREADS];
+    struct intern_worker workers[TEST_THREADS];
+    uint32_t* thread_ids = malloc(sizeof(uint32_t) * TEST_THREADS * TEST_STRINGS);
+
+    for (size_t thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        workers[thread_cur] = (struct intern_worker){ .intern_table = intern_table, .strings = strings, .strings_count = TEST_STRINGS,
+            .first_string = thread_cur * 997, .string_ids = thread_ids + thread_cur * TEST_STRINGS, .rounds_count = 1 };
+        pthread_create(&threads[thread_cur], NULL, intern_worker, &workers[thread_cur]);
+    }
+    for (size_t thread_cur = 0; thread_cur < TEST_THREADS; thread_cur++)
+    {
+        pthread_join(threads[thread_cur], NULL);
+    }
+
+    assert(intern_count(intern_table) == TEST_STRINGS);
+    for (size_t string_cur = 0; string_cur < TEST_STRINGS; string_cur++)
+    {
+        for (size_t thread_cur = 1; thread_cur < TEST_THREADS; thread_cur++)
+        {
+            assert(thread_ids[thread_cur * TEST_STRINGS + string_cur] == thread_ids[string_cur]);
+        }
+        assert(strcmp(intern_lookup(thread_ids[string_cur], NULL, intern_table), strings[string_cur]) == 0);
+    }
+
+    printf("intern: %d strings in %zu bytes\n", TEST_STRINGS, intern_memory(intern_table));
+    intern_destroy(intern_table);
+    free(thread_ids);
+
+    /* Scaling up to all cores, each thread interns the whole set from his own start */
+    long cores_count = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long threads_count = 1; ; threads_count *= 2)
+    {
+        if (threads_count > cores_count)
+        {
+            threads_count = cores_count;
+        }
+        printf("intern: %ld threads, %.2f M strings/s\n", threads_count, bench_threads((size_t)threads_count, strings));
+        if (threads_count == cores_count || threads_count >= 64)
+        {
+            break;
+        }
+    }
+
+    free(strings);
+
+    return 0;
+}
@@ -1,8 +1,11 @@
 #include <stdio.h>
+#include <sched.h>
 #include <assert.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #include "Thread_Pool.h"
+#include "cpu/CPU_Time.h"
 
 #define WORKERS_COUNT 8
 
@@ -21,9 +24,124 @@ void* thread_inc_x(void* data)
     printf("[%ld] Thread in use\n", pthread_self());
     printf("The thread %ld is incrementing x... - x old value %d\n", pthread_self(), x_sync_value);
     /* This thread must be synchronous with who invoke him */
-    x_sync_value += 1;
+    int x_value = ++x_sync_value;
     pthread_mutex_unlock(&inc_mutex);
-    return (void*)RANDOM_POINTER_VALUE + x_sync_value;
+    return (void*)RANDOM_POINTER_VALUE + x_value;
+}
+
+_Atomic int tasks_counter = 0;
+_Atomic int stop_task_started = 0;
+
+tpool_t* cancel_pool;
+
+void* count_task(void* data)
+{
+    tasks_counter++;
+    return data;
+}
+
+void* self_task(void* data)
+{
+    *(pthread_t*)data = pthread_self();
+    return data;
+}
+
+/* Runs until it's told to stop */
+void* stop_wait_task(void* data)
+{
+    stop_task_started = 1;
+    while (tpool_should_stop() == false)
+    {
+        sched_yield();
+    }
+    return data;
+}
+
+/* His group stops with him, the sub-tasks too */
+void* nested_group_task(void* data)
+{
+    tpool_group_t nested_group;
+    tpool_group_init(&nested_group);
+
+    tpool_group_execute(stop_wait_task, NULL, &nested_group, cancel_pool);
+    tpool_group_execute(count_task, NULL, &nested_group, cancel_pool);
+    tpool_group_wait(&nested_group, cancel_pool);
+    tpool_group_destroy(&nested_group);
+
+    return data;
+}
+
+static void wait_stop_task_start(void)
+{
+    while (stop_task_started == 0)
+    {
+        sched_yield();
+    }
+    stop_task_started = 0;
+}
+
+static void test_cancellation(void)
+{
+    tpool_t single_pool;
+    tpool_init(1, &single_pool);
+    cancel_pool = &single_pool;
+
+    void* task_result = NULL;
+
+    /* The only worker is busy, everything else waits into the queue */
+    tpool_task_t* blocker_task = tpool_submit(stop_wait_task, (void*)1, 0, &single_pool);
+    wait_stop_task_start();
+
+    /* A queued task is dropped without running */
+    tpool_task_t* queued_task = tpool_submit(count_task, (void*)2, 0, &single_pool);
+    assert(tpool_cancel_task(queued_task));
+    assert(tpool_task_join(&task_result, queued_task) == false && task_result == NULL);
+
+    /* The caller joining a task still queued runs it himself */
+    pthread_t runner_thread = 0;
+    tpool_task_t* inline_task = tpool_submit(self_task, &runner_thread, 0, &single_pool);
+    assert(tpool_task_join(&task_result, inline_task) && task_result == &runner_thread);
+    assert(pthread_equal(runner_thread, pthread_self()));
+
+    /* Not started before his deadline */
+    tpool_task_t* expired_task = tpool_submit(count_task, (void*)3, 1000, &single_pool);
+    cpu_sleep_nano(1000000);
+    assert(tpool_task_join(&task_result, expired_task) == false);
+
+    /* The queued tasks of a cancelled group are dropped */
+    tpool_group_t cancel_group;
+    tpool_group_init(&cancel_group);
+    for (int task_cur = 0; task_cur < 4; task_cur++)
+    {
+        assert(tpool_group_execute(count_task, NULL, &cancel_group, &single_pool));
+    }
+    tpool_group_cancel(&cancel_group);
+    tpool_group_wait(&cancel_group, &single_pool);
+    tpool_group_destroy(&cancel_group);
+    assert(tasks_counter == 0);
+
+    /* A running task is only told */
+    assert(tpool_cancel_task(blocker_task) == false);
+    assert(tpool_task_join(&task_result, blocker_task) && task_result == (void*)1);
+
+    /* The deadline stops a running task too */
+    uint64_t deadline_start = cpu_nanos();
+    tpool_task_t* deadline_task = tpool_submit(stop_wait_task, (void*)4, 20000000, &single_pool);
+    assert(tpool_task_join(&task_result, deadline_task) && task_result == (void*)4);
+    assert(cpu_nanos() - deadline_start >= 20000000);
+    /* Clears the start of this one, the next wait must see the inner task of the nested one */
+    wait_stop_task_start();
+
+    /* Cancelling a task stops the groups he has opened */
+    tpool_task_t* nested_task = tpool_submit(nested_group_task, (void*)5, 0, &single_pool);
+    wait_stop_task_start();
+    tpool_cancel_task(nested_task);
+    assert(tpool_task_join(&task_result, nested_task) && task_result == (void*)5);
+    assert(tasks_counter == 0);
+
+    tpool_stop(&single_pool);
+    assert(tpool_submit(count_task, NULL, 0, &single_pool) == NULL);
+    tpool_finalize(&single_pool);
 }
 
 int main()
@@ -36,28 +154,45 @@ int main()
     tpool_t stack_pool;
 
     tpool_init(WORKERS_COUNT, &stack_pool);
+
+    /* The workers are created by the first task, a few tasks before it run inline */
+    assert(tpool_started(&stack_pool) == false && tpool_workers(&stack_pool) == WORKERS_COUNT);
+    assert(tpool_for_tasks(TPOOL_INLINE_TASKS - 1, &stack_pool) == NULL);
+    assert(tpool_for_tasks(TPOOL_INLINE_TASKS, &stack_pool) == &stack_pool);
     
-    //void* result_value = NULL;
+    void* result_value = NULL;
 
     for (int index_cur = 0; index_cur != 50; index_cur+=5)
     {
-        tpool_wait_for_result(thread_inc_x, NULL, &stack_pool);
+        /* The result is the value of x the task has made, at least the waited increments before,
+         * the executed ones may still be queued
+        */
+        int waited_before = index_cur / 5 * 2;
+        result_value = tpool_wait_for_result(thread_inc_x, NULL, &stack_pool);
+        assert(result_value >= (void*)RANDOM_POINTER_VALUE + waited_before + 1 && result_value <= (void*)RANDOM_POINTER_VALUE + EXPECTED_X_VALUE);
         tpool_execute(thread_inc_x, NULL, &stack_pool);
         tpool_execute(thread_inc_x, NULL, &stack_pool);
-        tpool_wait_for_result(thread_inc_x, NULL, &stack_pool);
+        result_value = tpool_wait_for_result(thread_inc_x, NULL, &stack_pool);
+        assert(result_value >= (void*)RANDOM_POINTER_VALUE + waited_before + 2 && result_value <= (void*)RANDOM_POINTER_VALUE + EXPECTED_X_VALUE);
         tpool_execute(thread_inc_x, NULL, &stack_pool);
     }
 
-    //result_value = (void*)x_sync_value;
+    assert(tpool_started(&stack_pool) && tpool_for_tasks(1, &stack_pool) == &stack_pool);
 
+    /* Every task queued before the stop is done when it returns, none is taken after it */
     tpool_stop(&stack_pool);
 
     printf("X final value %d - expected value %d\n", x_sync_value, EXPECTED_X_VALUE);
 
-    //assert(result_value == (void*)RANDOM_POINTER_VALUE + EXPECTED_X_VALUE);
+    assert(x_sync_value == EXPECTED_X_VALUE);
+    assert(tpool_execute(thread_inc_x, NULL, &stack_pool) == false);
+    assert(tpool_wait_for_result(thread_inc_x, NULL, &stack_pool) == NULL);
+    assert(x_sync_value == EXPECTED_X_VALUE);
 
     tpool_finalize(&stack_pool);
 
+    test_cancellation();
+
     return 0;
 }
 
@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "zip/Zip_Stream.h"
+#include "zip/Zip_Writer.h"
+#include "data/Output_Buffer.h"
+
+#define TEXT_SIZE (700 * 1024 + 5)
+#define MAX_ENTRIES 16
+
+struct test_entry
+{
+    const char* name;
+
+    uint8_t* data;
+
+    size_t size;
+};
+
+/* What the handler received */
+struct test_sink
+{
+    size_t begin_count;
+
+    size_t valid_count;
+
+    size_t invalid_count;
+
+    output_buffer_t entries_data[MAX_ENTRIES];
+
+    char entries_names[MAX_ENTRIES][64];
+};
+
+struct test_feed
+{
+    const uint8_t* data;
+
+    size_t size;
+
+    int write_fd;
+};
+
+static void put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* data, uint32_t value)
+{
+    put_u16(data, (uint16_t)value);
+    put_u16(data + 2, (uint16_t)(value >> 16));
+}
+
+static uint8_t* make_text(size_t size, uint32_t seed)
+{
+    uint8_t* text = malloc(size);
+    assert(text != NULL);
+
+    for (size_t text_cur = 0; text_cur < size; text_cur++)
+    {
+        seed = seed * 1103515245 + 12345;
+        text[text_cur] = (uint8_t)"abcdefgh \n"[(seed >> 16) % 10];
+    }
+    return text;
+}
+
+/* Pieces of odd sizes, so headers and descriptors are split between reads */
+static void* feed_thread(void* thread_data)
+{
+    struct test_feed* feed = (struct test_feed*)thread_data;
+    size_t piece_size = 1;
+
+    for (size_t fed = 0; fed < feed->size; )
+    {
+        size_t write_size = feed->size - fed < piece_size ? feed->size - fed : piece_size;
+        ssize_t write_ret = write(feed->write_fd, feed->data + fed, write_size);
+        assert(write_ret > 0);
+        fed += (size_t)write_ret;
+        piece_size = piece_size * 7 % 65521 + 3;
+    }
+    close(feed->write_fd);
+    return NULL;
+}
+
+static bool sink_begin(const zip_entry_t* entry, void* handler_data)
+{
+    struct test_sink* sink = (struct test_sink*)handler_data;
+    assert(sink->begin_count < MAX_ENTRIES);
+
+    snprintf(sink->entries_names[sink->begin_count], sizeof(sink->entries_names[0]), "%s", entry->entry_name);
+    outbuf_init(0, NULL, NULL, &sink->entries_data[sink->begin_count]);
+    sink->begin_count++;
+
+    return true;
+}
+
+static bool sink_data(const uint8_t* data, size_t data_size, void* handler_data)
+{
+    struct test_sink* sink = (struct test_sink*)handler_data;
+
+    return outbuf_append(data, data_size, &sink->entries_data[sink->begin_count - 1]);
+}
+
+static void sink_end(const zip_entry_t* entry, bool entry_valid, void* handler_data)
+{
+    struct test_sink* sink = (struct test_sink*)handler_data;
+    assert(strcmp(entry->entry_name, sink->entries_names[sink->begin_count - 1]) == 0);
+
+    if (entry_valid)
+    {
+        assert(outbuf_length(&sink->entries_data[sink->begin_count - 1]) == entry->uncompressed_size);
+        sink->valid_count++;
+    }
+    else
+    {
+        sink->invalid_count++;
+    }
+}
+
+static bool stream_archive(const uint8_t* archive_data, size_t archive_size, struct test_sink* sink, zips_report_t* report)
+{
+    int pipe_fds[2];
+    assert(pipe(pipe_fds) == 0);
+
+    struct test_feed feed = { .data = archive_data, .size = archive_size, .write_fd = pipe_fds[1] };
+    pthread_t feeder;
+    assert(pthread_create(&feeder, NULL, feed_thread, &feed) == 0);
+
+    memset(sink, 0, sizeof(*sink));
+    zips_handler_t handler = { .entry_begin = sink_begin, .entry_data = sink_data, .entry_end = sink_end, .handler_data = sink };
+    bool read_ret = zips_read(pipe_fds[0], &handler, report);
+
+    /* The feeder must not block on a full pipe */
+    uint8_t drain[4096];
+    while (read(pipe_fds[0], drain, sizeof(drain)) > 0);
+
+    pthread_join(feeder, NULL);
+    close(pipe_fds[0]);
+
+    return read_ret;
+}
+
+static void sink_release(struct test_sink* sink)
+{
+    for (size_t entry_cur = 0; entry_cur < sink->begin_count; entry_cur++)
+    {
+        outbuf_deinit(&sink->entries_data[entry_cur]);
+    }
+}
+
+static uint8_t* read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* data = malloc(*size + 64);
+    assert(data != NULL && fread(data, 1, *size, file) == *size);
+    fclose(file);
+
+    return data;
+}
+
+static size_t find_magic(const uint8_t* data, size_t size, uint32_t magic, size_t skip)
+{
+    for (size_t data_cur = 0; data_cur + 4 <= size; data_cur++)
+    {
+        if ((data[data_cur] | data[data_cur + 1] << 8 | data[data_cur + 2] << 16 | (uint32_t)data[data_cur + 3] << 24) == magic && skip-- == 0)
+        {
+            return data_cur;
+        }
+    }
+    return size;
+}
+
+/* Archives from the writer: aligned, deflated by blocks and stored */
+static void check_written(void)
+{
+    struct test_entry entries[] = {
+        { "AndroidManifest.xml", make_text(3000, 1), 3000 },
+        { "classes.dex", make_text(TEXT_SIZE, 2), TEXT_SIZE },
+        { "assets/empty", NULL, 0 },
+        { "lib/x86/libfoo.so", make_text(20000, 3), 20000 },
+    };
+    size_t entries_count = sizeof(entries) / sizeof(*entries);
+    char archive_path[64];
+    snprintf(archive_path, sizeof(archive_path), "/tmp/zips_test_%d.apk", (int)getpid());
+
+    zip_writer_t writer;
+    assert(zipw_init(6, &writer));
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        assert(zipw_add(entries[entry_cur].name, entries[entry_cur].data, entries[entry_cur].size, zipw_method_for(entries[entry_cur].name), &writer));
+    }
+    assert(zipw_write(archive_path, NULL, &writer));
+    zipw_deinit(&writer);
+
+    size_t archive_size;
+    uint8_t* archive_data = read_file(archive_path, &archive_size);
+    unlink(archive_path);
+
+    struct test_sink sink;
+    zips_report_t report;
+    assert(stream_archive(archive_data, archive_size, &sink, &report));
+    assert(report.central_found && report.entries_count == entries_count && report.central_count == entries_count);
+    assert(report.mismatched_count == 0 && report.bytes_read == archive_size);
+    assert(sink.valid_count == entries_count && sink.invalid_count == 0);
+
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        assert(strcmp(sink.entries_names[entry_cur], entries[entry_cur].name) == 0);
+        assert(outbuf_length(&sink.entries_data[entry_cur]) == entries[entry_cur].size);
+        assert(entries[entry_cur].size == 0 || memcmp(sink.entries_data[entry_cur].buffer_data, entries[entry_cur].data, entries[entry_cur].size) == 0);
+    }
+    sink_release(&sink);
+
+    /* The central directory says another CRC */
+    size_t central_offset = find_magic(archive_data, archive_size, ZIP_CENTRAL_HEADER_MAGIC, 1);
+    archive_data[central_offset + 16] ^= 0x01;
+    assert(stream_archive(archive_data, archive_size, &sink, &report));
+    assert(report.mismatched_count == 1);
+    sink_release(&sink);
+    archive_data[central_offset + 16] ^= 0x01;
+
+    /* The deflated data is damaged, the next entries are still read */
+    size_t dex_offset = find_magic(archive_data, archive_size, ZIP_LOCAL_HEADER_MAGIC, 1);
+    archive_data[dex_offset + 5000] ^= 0x5a;
+    assert(stream_archive(archive_data, archive_size, &sink, &report));
+    assert(sink.invalid_count == 1 && sink.valid_count == entries_count - 1);
+    sink_release(&sink);
+    archive_data[dex_offset + 5000] ^= 0x5a;
+
+    /* Cut before the end of the central directory */
+    assert(stream_archive(archive_data, archive_size - 10, &sink, &report) == false);
+    assert(report.central_found == false);
+    sink_release(&sink);
+
+    free(archive_data);
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        free(entries[entry_cur].data);
+    }
+}
+
+static size_t raw_deflate(const uint8_t* data, size_t size, uint8_t* output, size_t output_size)
+{
+    z_stream deflate_stream;
+    memset(&deflate_stream, 0, sizeof(deflate_stream));
+    assert(deflateInit2(&deflate_stream, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+
+    deflate_stream.next_in = (Bytef*)data;
+    deflate_stream.avail_in = (uInt)size;
+    deflate_stream.next_out = output;
+    deflate_stream.avail_out = (uInt)output_size;
+    assert(deflate(&deflate_stream, Z_FINISH) == Z_STREAM_END);
+    deflateEnd(&deflate_stream);
+
+    return output_size - deflate_stream.avail_out;
+}
+
+/* Local headers without sizes, the data descriptors follow the data (as streaming zippers write),
+ * then a signing block is before the central directory
+*/
+static void check_descriptors(void)
+{
+    uint8_t stored_data[3000];
+    for (size_t data_cur = 0; data_cur < sizeof(stored_data); data_cur++)
+    {
+        stored_data[data_cur] = (uint8_t)(data_cur * 31);
+    }
+    /* Fake descriptors inside the stored data */
+    memcpy(stored_data + 100, "PK\x07\x08", 4);
+    memcpy(stored_data + 2995, "PK\x07\x08", 4);
+
+    uint8_t* text = make_text(100000, 9);
+    uint8_t* deflated = malloc(200000);
+    size_t deflated_size = raw_deflate(text, 100000, deflated, 200000);
+
+    struct
+    {
+        const char* name;
+
+        uint16_t method;
+
+        const uint8_t* data;
+
+        size_t size;
+
+        const uint8_t* stored;
+
+        size_t stored_size;
+
+        bool descriptor_magic;
+    } entries[] = {
+        { "res/text.xml", ZIP_METHOD_DEFLATED, text, 100000, deflated, deflated_size, true },
+        { "stored.bin", ZIP_METHOD_STORED, stored_data, sizeof(stored_data), stored_data, sizeof(stored_data), false },
+    };
+
+    output_buffer_t archive, central_dir;
+    outbuf_init(0, NULL, NULL, &archive);
+    outbuf_init(0, NULL, NULL, &central_dir);
+
+    for (size_t entry_cur = 0; entry_cur < 2; entry_cur++)
+    {
+        uint8_t header[ZIP_CENTRAL_HEADER_SIZE] = { 0 };
+        uint16_t name_length = (uint16_t)strlen(entries[entry_cur].name);
+        uint32_t entry_crc = (uint32_t)crc32(0, entries[entry_cur].data, (uInt)entries[entry_cur].size);
+        uint32_t local_offset = (uint32_t)outbuf_length(&archive);
+
+        put_u32(header, ZIP_LOCAL_HEADER_MAGIC);
+        put_u16(header + 4, 20);
+        put_u16(header + 6, 0x0008);
+        put_u16(header + 8, entries[entry_cur].method);
+        put_u16(header + 26, name_length);
+        outbuf_append(header, ZIP_LOCAL_HEADER_SIZE, &archive);
+        outbuf_append(entries[entry_cur].name, name_length, &archive);
+        outbuf_append(entries[entry_cur].stored, entries[entry_cur].stored_size, &archive);
+
+        uint8_t descriptor[16];
+        put_u32(descriptor, ZIPS_DESCRIPTOR_MAGIC);
+        put_u32(descriptor + 4, entry_crc);
+        put_u32(descriptor + 8, (uint32_t)entries[entry_cur].stored_size);
+        put_u32(descriptor + 12, (uint32_t)entries[entry_cur].size);
+        if (entries[entry_cur].descriptor_magic)
+        {
+            outbuf_append(descriptor, 16, &archive);
+        }
+        else
+        {
+            outbuf_append(descriptor + 4, 12, &archive);
+        }
+
+        memset(header, 0, sizeof(header));
+        put_u32(header, ZIP_CENTRAL_HEADER_MAGIC);
+        put_u16(header + 6, 20);
+        put_u16(header + 8, 0x0008);
+        put_u16(header + 10, entries[entry_cur].method);
+        put_u32(header + 16, entry_crc);
+        put_u32(header + 20, (uint32_t)entries[entry_cur].stored_size);
+        put_u32(header + 24, (uint32_t)entries[entry_cur].size);
+        put_u16(header + 28, name_length);
+        put_u32(header + 42, local_offset);
+        outbuf_append(header, ZIP_CENTRAL_HEADER_SIZE, &central_dir);
+        outbuf_append(entries[entry_cur].name, name_length, &central_dir);
+    }
+
+    /* Size, one pair, size, magic */
+    uint8_t signing_block[8 + 12 + 8 + 16] = { 0 };
+    put_u32(signing_block, sizeof(signing_block) - 8);
+    put_u32(signing_block + 8, 4);
+    put_u32(signing_block + 16, 0x7109871a);
+    put_u32(signing_block + 20, sizeof(signing_block) - 8);
+    memcpy(signing_block + 28, "APK Sig Block 42", 16);
+    outbuf_append(signing_block, sizeof(signing_block), &archive);
+
+    uint32_t central_offset = (uint32_t)outbuf_length(&archive);
+    outbuf_append(central_dir.buffer_data, outbuf_length(&central_dir), &archive);
+
+    uint8_t eocd[ZIP_EOCD_SIZE] = { 0 };
+    put_u32(eocd, ZIP_EOCD_MAGIC);
+    put_u16(eocd + 8, 2);
+    put_u16(eocd + 10, 2);
+    put_u32(eocd + 12, (uint32_t)outbuf_length(&central_dir));
+    put_u32(eocd + 16, central_offset);
+    outbuf_append(eocd, sizeof(eocd), &archive);
+
+    struct test_sink sink;
+    zips_report_t report;
+    assert(stream_archive((const uint8_t*)archive.buffer_data, outbuf_length(&archive), &sink, &report));
+    assert(report.entries_count == 2 && report.central_count == 2 && report.mismatched_count == 0 && report.central_found);
+    assert(sink.valid_count == 2);
+    assert(memcmp(sink.entries_data[0].buffer_data, text, 100000) == 0);
+    assert(outbuf_length(&sink.entries_data[1]) == sizeof(stored_data) && memcmp(sink.entries_data[1].buffer_data, stored_data, sizeof(stored_data)) == 0);
+    sink_release(&sink);
+
+    outbuf_deinit(&archive);
+    outbuf_deinit(&central_dir);
+    free(deflated);
+    free(text);
+}
+
+int main(void)
+{
+    check_written();
+    check_descriptors();
+
+    puts("ZIP stream test passed");
+    return 0;
+}
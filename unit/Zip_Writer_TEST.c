@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "Thread_Pool.h"
+#include "zip/Zip_Writer.h"
+#include "zip/Zip_Archive.h"
+
+#define TEXT_SIZE (1300 * 1024 + 77)
+#define NOISE_SIZE (300 * 1024)
+#define LIBRARY_SIZE (200 * 1024 + 3)
+#define BENCH_SIZE (16 * 1024 * 1024)
+
+struct test_entry
+{
+    const char* name;
+
+    uint8_t* data;
+
+    size_t size;
+};
+
+static uint64_t monotonic_nanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
+static uint8_t* make_text(size_t size, uint32_t seed)
+{
+    static const char* words[] = { "android", "activity", "intent", "layout", "manifest", "resource", "string", "view" };
+    uint8_t* text = malloc(size);
+    assert(text != NULL);
+
+    for (size_t text_cur = 0; text_cur < size; )
+    {
+        seed = seed * 1103515245 + 12345;
+        const char* word = words[(seed >> 16) % 8];
+        for (size_t word_cur = 0; word[word_cur] != '\0' && text_cur < size; word_cur++)
+        {
+            text[text_cur++] = (uint8_t)word[word_cur];
+        }
+        if (text_cur < size)
+        {
+            text[text_cur++] = (seed >> 24) % 5 == 0 ? '\n' : ' ';
+        }
+    }
+    return text;
+}
+
+static uint8_t* make_noise(size_t size, uint32_t seed)
+{
+    uint8_t* noise = malloc(size);
+    assert(noise != NULL);
+
+    for (size_t noise_cur = 0; noise_cur < size; noise_cur++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        noise[noise_cur] = (uint8_t)seed;
+    }
+    return noise;
+}
+
+static uint8_t* read_file(const char* path, size_t* size)
+{
+    FILE* file = fopen(path, "rb");
+    assert(file != NULL);
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint8_t* data = malloc(*size + 1);
+    assert(data != NULL && fread(data, 1, *size, file) == *size);
+    fclose(file);
+
+    return data;
+}
+
+static void write_archive(const char* path, const struct test_entry* entries, size_t entries_count, tpool_t* thread_pool)
+{
+    zip_writer_t writer;
+    assert(zipw_init(9, &writer));
+
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        const struct test_entry* entry = &entries[entry_cur];
+        assert(zipw_add(entry->name, entry->data, entry->size, zipw_method_for(entry->name), &writer));
+    }
+    assert(zipw_write(path, thread_pool, &writer));
+    zipw_deinit(&writer);
+}
+
+static void check_archive(const uint8_t* archive_data, size_t archive_size, const struct test_entry* entries, size_t entries_count)
+{
+    zip_archive_t archive;
+    assert(zip_open_memory(archive_data, archive_size, &archive));
+    assert(archive.entries_count == entries_count);
+
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        const zip_entry_t* entry = &archive.entries[entry_cur];
+        assert(strcmp(entry->entry_name, entries[entry_cur].name) == 0);
+        assert(entry->uncompressed_size == entries[entry_cur].size);
+        assert(entry->entry_crc32 == (uint32_t)crc32(0, entries[entry_cur].data, (uInt)entries[entry_cur].size));
+
+        uint8_t* inflated = malloc(entry->uncompressed_size + 1);
+        assert(zip_entry_inflate(entry, inflated, &archive));
+        assert(memcmp(inflated, entries[entry_cur].data, entries[entry_cur].size) == 0);
+        free(inflated);
+
+        if (entry->compression_method == ZIP_METHOD_STORED)
+        {
+            const uint8_t* local_header = archive_data + entry->local_header_offset;
+            uint64_t data_offset = entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + (local_header[26] | local_header[27] << 8) +
+                (local_header[28] | local_header[29] << 8);
+            size_t alignment = strstr(entry->entry_name, ".so") != NULL ? ZIPW_LIBRARY_ALIGNMENT : ZIPW_STORED_ALIGNMENT;
+
+            assert(entry->uncompressed_size == 0 || data_offset % alignment == 0);
+        }
+    }
+    zip_close(&archive);
+}
+
+static void check_writer(tpool_t* thread_pool)
+{
+    struct test_entry entries[] = {
+        { "AndroidManifest.xml", make_text(5000, 1), 5000 },
+        { "classes.dex", make_text(TEXT_SIZE, 2), TEXT_SIZE },
+        { "assets/empty.txt", NULL, 0 },
+        { "assets/noise.bin", make_noise(NOISE_SIZE, 3), NOISE_SIZE },
+        { "lib/x86_64/libfoo.so", make_noise(LIBRARY_SIZE, 4), LIBRARY_SIZE },
+        { "res/drawable/icon.png", make_noise(999, 5), 999 },
+        { "resources.arsc", make_text(7001, 6), 7001 },
+    };
+    size_t entries_count = sizeof(entries) / sizeof(*entries);
+    char serial_path[64], parallel_path[64];
+
+    snprintf(serial_path, sizeof(serial_path), "/tmp/zipw_serial_%d.apk", (int)getpid());
+    snprintf(parallel_path, sizeof(parallel_path), "/tmp/zipw_parallel_%d.apk", (int)getpid());
+
+    assert(zipw_method_for("lib/arm64-v8a/libc++_shared.so") == ZIP_METHOD_STORED);
+    assert(zipw_method_for("res/raw/song.MP3") == ZIP_METHOD_STORED);
+    assert(zipw_method_for("classes2.dex") == ZIP_METHOD_DEFLATED);
+
+    write_archive(serial_path, entries, entries_count, NULL);
+    write_archive(parallel_path, entries, entries_count, thread_pool);
+
+    size_t serial_size, parallel_size;
+    uint8_t* serial_data = read_file(serial_path, &serial_size);
+    uint8_t* parallel_data = read_file(parallel_path, &parallel_size);
+
+    /* The thread count doesn't change a byte */
+    assert(serial_size == parallel_size && memcmp(serial_data, parallel_data, serial_size) == 0);
+    check_archive(parallel_data, parallel_size, entries, entries_count);
+
+    zip_archive_t archive;
+    assert(zip_open_memory(parallel_data, parallel_size, &archive));
+    assert(zip_find("classes.dex", &archive)->compression_method == ZIP_METHOD_DEFLATED);
+    assert(zip_find("classes.dex", &archive)->compressed_size < TEXT_SIZE / 2);
+    /* Deflate doesn't shrink the noise, it's stored */
+    assert(zip_find("assets/noise.bin", &archive)->compression_method == ZIP_METHOD_STORED);
+    assert(zip_find("lib/x86_64/libfoo.so", &archive)->compression_method == ZIP_METHOD_STORED);
+    zip_close(&archive);
+
+    /* An archive rebuilt from its own entries is the same, the data is copied from the file */
+    char reused_path[64];
+    snprintf(reused_path, sizeof(reused_path), "/tmp/zipw_reused_%d.apk", (int)getpid());
+
+    zip_archive_t base_archive;
+    zip_writer_t reuse_writer;
+    assert(zip_open(parallel_path, &base_archive));
+    assert(zipw_init(9, &reuse_writer));
+    for (size_t entry_cur = 0; entry_cur < base_archive.entries_count; entry_cur++)
+    {
+        const zip_entry_t* base_entry = &base_archive.entries[entry_cur];
+        assert(zipw_add_raw(base_entry->entry_name, base_entry, &base_archive, &reuse_writer));
+    }
+    assert(zipw_write(reused_path, thread_pool, &reuse_writer));
+    zipw_deinit(&reuse_writer);
+    zip_close(&base_archive);
+
+    size_t reused_size;
+    uint8_t* reused_data = read_file(reused_path, &reused_size);
+    assert(reused_size == parallel_size && memcmp(reused_data, parallel_data, reused_size) == 0);
+    unlink(reused_path);
+    free(reused_data);
+
+    /* Nothing is left when the archive can't be written */
+    zip_writer_t writer;
+    assert(zipw_init(6, &writer));
+    assert(zipw_add("a.txt", entries[0].data, entries[0].size, ZIP_METHOD_DEFLATED, &writer));
+    assert(zipw_write("/tmp/zipw_missing_dir/out.apk", thread_pool, &writer) == false);
+    zipw_deinit(&writer);
+
+    unlink(serial_path);
+    unlink(parallel_path);
+    free(serial_data);
+    free(parallel_data);
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        free(entries[entry_cur].data);
+    }
+}
+
+static void put_le(uint8_t* data, uint64_t value, size_t size)
+{
+    for (size_t byte_cur = 0; byte_cur < size; byte_cur++)
+    {
+        data[byte_cur] = (uint8_t)(value >> byte_cur * 8);
+    }
+}
+
+/* A ZIP64 locator whose offset wraps around when the record size is added */
+static void check_zip64_locator(void)
+{
+    uint8_t archive_data[106] = { 0 };
+    uint8_t* locator = archive_data + 64;
+    uint8_t* eocd = locator + 20;
+
+    put_le(locator, 0x07064b50, 4);
+    put_le(locator + 8, 0xFFFFFFFFFFFFFFF0, 8);
+    put_le(locator + 16, 1, 4);
+    put_le(eocd, 0x06054b50, 4);
+
+    zip_archive_t archive;
+    assert(zip_open_memory(archive_data, sizeof(archive_data), &archive) == false);
+}
+
+static void bench_writer(tpool_t* thread_pool)
+{
+    struct test_entry entry = { "classes.dex", make_text(BENCH_SIZE, 7), BENCH_SIZE };
+    char bench_path[64];
+    snprintf(bench_path, sizeof(bench_path), "/tmp/zipw_bench_%d.apk", (int)getpid());
+
+    uint64_t serial_start = monotonic_nanos();
+    write_archive(bench_path, &entry, 1, NULL);
+    uint64_t serial_nanos = monotonic_nanos() - serial_start;
+
+    uint64_t parallel_start = monotonic_nanos();
+    write_archive(bench_path, &entry, 1, thread_pool);
+    uint64_t parallel_nanos = monotonic_nanos() - parallel_start;
+
+    printf("%u MB deflated: %lu ms inline, %lu ms with %zu workers\n", BENCH_SIZE >> 20, (unsigned long)(serial_nanos / 1000000),
+        (unsigned long)(parallel_nanos / 1000000), tpool_workers(thread_pool));
+
+    /* The rebuild without changes only copies */
+    char rebuild_path[64];
+    snprintf(rebuild_path, sizeof(rebuild_path), "/tmp/zipw_rebuild_%d.apk", (int)getpid());
+
+    uint64_t rebuild_start = monotonic_nanos();
+    zip_archive_t base_archive;
+    zip_writer_t writer;
+    assert(zip_open(bench_path, &base_archive) && zipw_init(9, &writer));
+    assert(base_archive.entries[0].entry_crc32 == (uint32_t)crc32(0, entry.data, (uInt)entry.size));
+    assert(zipw_add_raw(entry.name, &base_archive.entries[0], &base_archive, &writer));
+    assert(zipw_write(rebuild_path, thread_pool, &writer));
+    zipw_deinit(&writer);
+    zip_close(&base_archive);
+
+    printf("%u MB rebuilt from the previous archive: %lu ms\n", BENCH_SIZE >> 20, (unsigned long)((monotonic_nanos() - rebuild_start) / 1000000));
+
+    unlink(rebuild_path);
+    unlink(bench_path);
+    free(entry.data);
+}
+
+int main(void)
+{
+    tpool_t thread_pool;
+    assert(tpool_init(4, &thread_pool));
+
+    check_writer(&thread_pool);
+    check_zip64_locator();
+    bench_writer(&thread_pool);
+
+    tpool_stop(&thread_pool);
+    tpool_finalize(&thread_pool);
+
+    puts("ZIP writer test passed");
+    return 0;
+}
@@ -0,0 +1,671 @@
+#include <malloc.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Memory_FS.h"
+
+#define MEMFS_CHUNKS_BY_SLAB 16
+#define MEMFS_TREE_BLOCK (16 * 1024)
+
+/* When spilling, the memory goes down to 7/8 of the budget, so we don't spill again
+ * at every new chunk
+*/
+#define MEMFS_SPILL_TARGET(budget) ((budget) - (budget) / 8)
+
+memfs_t* memfs_create(size_t memory_budget, const char* spill_parent)
+{
+    memfs_t* memfs = (memfs_t*)calloc(1, sizeof(memfs_t));
+    if (memfs == NULL)
+    {
+        return NULL;
+    }
+
+    memfs->tree_arena = arena_create(MEMFS_TREE_BLOCK);
+    memfs->chunks_arena = arena_create(sizeof(memfs_chunk_t) * MEMFS_CHUNKS_BY_SLAB);
+
+    if (memfs->tree_arena == NULL || memfs->chunks_arena == NULL)
+    {
+        if (memfs->tree_arena) arena_destroy(memfs->tree_arena);
+        if (memfs->chunks_arena) arena_destroy(memfs->chunks_arena);
+        free((void*)memfs);
+        return NULL;
+    }
+
+    memfs->tree_root.node_name = "";
+    memfs->memory_budget = memory_budget;
+
+    if (spill_parent == NULL)
+    {
+        spill_parent = getenv("TMPDIR");
+    }
+    if (spill_parent == NULL || *spill_parent == '\0')
+    {
+        spill_parent = "/tmp";
+    }
+    snprintf(memfs->spill_dir, sizeof(memfs->spill_dir), "%s/droidcat-spill-XXXXXX", spill_parent);
+
+    pthread_rwlock_init(&memfs->tree_lock, NULL);
+    pthread_mutex_init(&memfs->chunks_lock, NULL);
+    pthread_mutex_init(&memfs->spill_lock, NULL);
+
+    return memfs;
+}
+
+static void memfs_chunk_release(memfs_chunk_t* chunk, memfs_t* memfs)
+{
+    if (atomic_fetch_sub(&chunk->chunk_refs, 1) != 1)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&memfs->chunks_lock);
+    chunk->chunk_free_next = memfs->chunks_free;
+    memfs->chunks_free = chunk;
+    pthread_mutex_unlock(&memfs->chunks_lock);
+
+    memfs->memory_used -= MEMFS_CHUNK_SIZE;
+}
+
+/* The file lock must be held */
+static void memfs_truncate_locked(memfs_file_t* file, memfs_t* memfs)
+{
+    for (size_t chunk_cur = 0; chunk_cur < file->chunks_count; chunk_cur++)
+    {
+        memfs_chunk_release(file->file_chunks[chunk_cur], memfs);
+    }
+    file->chunks_count = 0;
+
+    if (file->file_spilled)
+    {
+        close(file->spill_fd);
+        file->spill_fd = -1;
+        file->file_spilled = false;
+        memfs->files_spilled--;
+    }
+
+    file->file_size = 0;
+}
+
+bool memfs_destroy(memfs_t* memfs)
+{
+    for (memfs_file_t* file = memfs->files_list; file != NULL; file = file->file_next)
+    {
+        pthread_mutex_lock(&file->file_lock);
+        memfs_truncate_locked(file, memfs);
+        pthread_mutex_unlock(&file->file_lock);
+
+        free((void*)file->file_chunks);
+        pthread_mutex_destroy(&file->file_lock);
+    }
+
+    if (memfs->spill_created)
+    {
+        rmdir(memfs->spill_dir);
+    }
+
+    arena_destroy(memfs->chunks_arena);
+    arena_destroy(memfs->tree_arena);
+
+    pthread_rwlock_destroy(&memfs->tree_lock);
+    pthread_mutex_destroy(&memfs->chunks_lock);
+    pthread_mutex_destroy(&memfs->spill_lock);
+
+    free((void*)memfs);
+
+    return true;
+}
+
+static void memfs_touch(memfs_file_t* file, memfs_t* memfs)
+{
+    file->last_touch = ++memfs->touch_clock;
+}
+
+/* Moves the file content into a temporary file, the file lock must be held */
+static bool memfs_spill_file(memfs_file_t* file, memfs_t* memfs)
+{
+    if (file->file_spilled || file->chunks_count == 0)
+    {
+        return false;
+    }
+
+    if (memfs->spill_created == false)
+    {
+        if (mkdtemp(memfs->spill_dir) == NULL)
+        {
+            return false;
+        }
+        memfs->spill_created = true;
+    }
+
+    /* The spill file is unlinked right away, the kernel releases it when the descriptor is closed */
+    char spill_path[MEMFS_SPILL_PATH_MAX + 32];
+    snprintf(spill_path, sizeof(spill_path), "%s/%p", memfs->spill_dir, (void*)file);
+    
+    int spill_fd = open(spill_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (spill_fd < 0)
+    {
+        return false;
+    }
+    unlink(spill_path);
+
+    size_t spill_offset = 0;
+    for (size_t chunk_cur = 0; chunk_cur < file->chunks_count; chunk_cur++)
+    {
+        memfs_chunk_t* chunk = file->file_chunks[chunk_cur];
+        
+        if (pwrite(spill_fd, chunk->chunk_bytes, chunk->chunk_used, (off_t)spill_offset) != (ssize_t)chunk->chunk_used)
+        {
+            close(spill_fd);
+            return false;
+        }
+        spill_offset += chunk->chunk_used;
+    }
+
+    size_t file_size = file->file_size;
+    memfs_truncate_locked(file, memfs);
+
+    file->file_size = file_size;
+    file->spill_fd = spill_fd;
+    file->file_spilled = true;
+    memfs->files_spilled++;
+
+    return true;
+}
+
+static int memfs_touch_compare(const void* first, const void* second)
+{
+    uint64_t first_touch = (*(memfs_file_t* const*)first)->last_touch;
+    uint64_t second_touch = (*(memfs_file_t* const*)second)->last_touch;
+
+    return (first_touch > second_touch) - (first_touch < second_touch);
+}
+
+/* Spills the least recently touched files until the memory goes below the budget,
+ * `appending_file` is locked by the caller, so it's the last candidate
+*/
+static void memfs_spill_lru(memfs_file_t* appending_file, memfs_t* memfs)
+{
+    size_t spill_target = MEMFS_SPILL_TARGET(memfs->memory_budget);
+
+    pthread_mutex_lock(&memfs->spill_lock);
+    if (memfs->memory_used + MEMFS_CHUNK_SIZE <= memfs->memory_budget)
+    {
+        pthread_mutex_unlock(&memfs->spill_lock);
+        return;
+    }
+
+    pthread_rwlock_rdlock(&memfs->tree_lock);
+    
+    memfs_file_t** candidates = malloc(sizeof(*candidates) * (memfs->files_count + 1));
+    size_t candidates_count = 0;
+
+    for (memfs_file_t* file = memfs->files_list; candidates != NULL && file != NULL; file = file->file_next)
+    {
+        if (file != appending_file && file->file_spilled == false && file->chunks_count != 0)
+        {
+            candidates[candidates_count++] = file;
+        }
+    }
+    pthread_rwlock_unlock(&memfs->tree_lock);
+
+    if (candidates != NULL)
+    {
+        qsort(candidates, candidates_count, sizeof(*candidates), memfs_touch_compare);
+    }
+
+    for (size_t candidate_cur = 0; candidate_cur < candidates_count; candidate_cur++)
+    {
+        if (memfs->memory_used <= spill_target)
+        {
+            break;
+        }
+
+        memfs_file_t* victim = candidates[candidate_cur];
+        /* Files in use by another thread are skipped, they aren't the least used anyway */
+        if (pthread_mutex_trylock(&victim->file_lock) != 0)
+        {
+            continue;
+        }
+        memfs_spill_file(victim, memfs);
+        pthread_mutex_unlock(&victim->file_lock);
+    }
+
+    if (candidates != NULL)
+    {
+        free((void*)candidates);
+    }
+
+    /* Nothing else can be moved, the file being written goes for the disk */
+    if (memfs->memory_used + MEMFS_CHUNK_SIZE > memfs->memory_budget && appending_file != NULL)
+    {
+        memfs_spill_file(appending_file, memfs);
+    }
+
+    pthread_mutex_unlock(&memfs->spill_lock);
+}
+
+static memfs_chunk_t* memfs_chunk_new(memfs_file_t* appending_file, memfs_t* memfs)
+{
+    if (memfs->memory_budget != 0 && memfs->memory_used + MEMFS_CHUNK_SIZE > memfs->memory_budget)
+    {
+        memfs_spill_lru(appending_file, memfs);
+    }
+
+    pthread_mutex_lock(&memfs->chunks_lock);
+    memfs_chunk_t* new_chunk = memfs->chunks_free;
+    if (new_chunk != NULL)
+    {
+        memfs->chunks_free = new_chunk->chunk_free_next;
+    }
+    else
+    {
+        new_chunk = (memfs_chunk_t*)arena_alloc(sizeof(memfs_chunk_t), memfs->chunks_arena);
+    }
+    pthread_mutex_unlock(&memfs->chunks_lock);
+
+    if (new_chunk == NULL)
+    {
+        return NULL;
+    }
+
+    new_chunk->chunk_refs = 1;
+    new_chunk->chunk_used = 0;
+    new_chunk->chunk_free_next = NULL;
+    memfs->memory_used += MEMFS_CHUNK_SIZE;
+
+    return new_chunk;
+}
+
+static bool memfs_chunks_reserve(size_t chunks_needed, memfs_file_t* file)
+{
+    if (file->chunks_capacity >= chunks_needed)
+    {
+        return true;
+    }
+
+    size_t new_capacity = file->chunks_capacity != 0 ? file->chunks_capacity * 2 : 4;
+    while (new_capacity < chunks_needed)
+    {
+        new_capacity *= 2;
+    }
+
+    memfs_chunk_t** new_chunks = realloc(file->file_chunks, new_capacity * sizeof(*new_chunks));
+    if (new_chunks == NULL)
+    {
+        return false;
+    }
+
+    file->file_chunks = new_chunks;
+    file->chunks_capacity = new_capacity;
+
+    return true;
+}
+
+/* The file lock must be held */
+static bool memfs_append_locked(const uint8_t* data, size_t data_size, memfs_file_t* file, memfs_t* memfs)
+{
+    while (data_size != 0)
+    {
+        if (file->file_spilled)
+        {
+            ssize_t write_ret = pwrite(file->spill_fd, data, data_size, (off_t)file->file_size);
+            if (write_ret <= 0)
+            {
+                return false;
+            }
+            file->file_size += (size_t)write_ret;
+            data += write_ret;
+            data_size -= (size_t)write_ret;
+            continue;
+        }
+
+        memfs_chunk_t* tail_chunk = file->chunks_count != 0 ? file->file_chunks[file->chunks_count - 1] : NULL;
+
+        if (tail_chunk == NULL || tail_chunk->chunk_used == MEMFS_CHUNK_SIZE || tail_chunk->chunk_refs > 1)
+        {
+            if (memfs_chunks_reserve(file->chunks_count + 1, file) == false)
+            {
+                return false;
+            }
+
+            memfs_chunk_t* new_chunk = memfs_chunk_new(file, memfs);
+            if (new_chunk == NULL)
+            {
+                return false;
+            }
+
+            /* The allocation may have spilled this same file */
+            if (file->file_spilled)
+            {
+                memfs_chunk_release(new_chunk, memfs);
+                continue;
+            }
+
+            if (tail_chunk != NULL && tail_chunk->chunk_used != MEMFS_CHUNK_SIZE)
+            {
+                /* The tail is shared with another file, copying it before write */
+                memcpy(new_chunk->chunk_bytes, tail_chunk->chunk_bytes, tail_chunk->chunk_used);
+                new_chunk->chunk_used = tail_chunk->chunk_used;
+                memfs_chunk_release(tail_chunk, memfs);
+                file->file_chunks[file->chunks_count - 1] = new_chunk;
+            }
+            else
+            {
+                file->file_chunks[file->chunks_count++] = new_chunk;
+            }
+            tail_chunk = new_chunk;
+        }
+
+        size_t copy_size = MEMFS_CHUNK_SIZE - tail_chunk->chunk_used;
+        if (copy_size > data_size)
+        {
+            copy_size = data_size;
+        }
+
+        memcpy(tail_chunk->chunk_bytes + tail_chunk->chunk_used, data, copy_size);
+        tail_chunk->chunk_used += (uint32_t)copy_size;
+        file->file_size += copy_size;
+
+        data += copy_size;
+        data_size -= copy_size;
+    }
+
+    return true;
+}
+
+bool memfs_append(const void* data, size_t data_size, memfs_file_t* file, memfs_t* memfs)
+{
+    pthread_mutex_lock(&file->file_lock);
+    memfs_touch(file, memfs);
+    bool append_ret = memfs_append_locked((const uint8_t*)data, data_size, file, memfs);
+    pthread_mutex_unlock(&file->file_lock);
+
+    return append_ret;
+}
+
+bool memfs_truncate(memfs_file_t* file, memfs_t* memfs)
+{
+    pthread_mutex_lock(&file->file_lock);
+    memfs_touch(file, memfs);
+    memfs_truncate_locked(file, memfs);
+    pthread_mutex_unlock(&file->file_lock);
+
+    return true;
+}
+
+static size_t memfs_read_locked(size_t file_offset, void* buffer, size_t buffer_size, memfs_file_t* file)
+{
+    if (file_offset >= file->file_size)
+    {
+        return 0;
+    }
+    if (buffer_size > file->file_size - file_offset)
+    {
+        buffer_size = file->file_size - file_offset;
+    }
+
+    if (file->file_spilled)
+    {
+        ssize_t read_ret = pread(file->spill_fd, buffer, buffer_size, (off_t)file_offset);
+        return read_ret > 0 ? (size_t)read_ret : 0;
+    }
+
+    /* All chunks are full, except the last one */
+    size_t read_size = 0;
+    while (read_size < buffer_size)
+    {
+        memfs_chunk_t* chunk = file->file_chunks[file_offset / MEMFS_CHUNK_SIZE];
+        size_t chunk_offset = file_offset % MEMFS_CHUNK_SIZE;
+        size_t copy_size = chunk->chunk_used - chunk_offset;
+        
+        if (copy_size > buffer_size - read_size)
+        {
+            copy_size = buffer_size - read_size;
+        }
+
+        memcpy((uint8_t*)buffer + read_size, chunk->chunk_bytes + chunk_offset, copy_size);
+        read_size += copy_size;
+        file_offset += copy_size;
+    }
+
+    return read_size;
+}
+
+size_t memfs_read(size_t file_offset, void* buffer, size_t buffer_size, memfs_file_t* file, memfs_t* memfs)
+{
+    pthread_mutex_lock(&file->file_lock);
+    memfs_touch(file, memfs);
+    size_t read_size = memfs_read_locked(file_offset, buffer, buffer_size, file);
+    pthread_mutex_unlock(&file->file_lock);
+
+    return read_size;
+}
+
+size_t memfs_size(memfs_file_t* file)
+{
+    pthread_mutex_lock(&file->file_lock);
+    size_t file_size = file->file_size;
+    pthread_mutex_unlock(&file->file_lock);
+
+    return file_size;
+}
+
+static memfs_node_t* memfs_child(memfs_node_t* parent, const char* name, size_t name_length)
+{
+    for (memfs_node_t* child = parent->node_child; child != NULL; child = child->node_sibling)
+    {
+        if (strncmp(child->node_name, name, name_length) == 0 && child->node_name[name_length] == '\0')
+        {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+/* Walks the path components (empty and "." components are ignored), when `tree_create`
+ * is set the missing nodes are created, the tree lock must be held (for write in this case)
+*/
+static memfs_node_t* memfs_walk(const char* file_path, bool tree_create, memfs_t* memfs)
+{
+    memfs_node_t* node_cur = &memfs->tree_root;
+
+    while (*file_path != '\0')
+    {
+        const char* name_end = strchr(file_path, '/');
+        size_t name_length = name_end != NULL ? (size_t)(name_end - file_path) : strlen(file_path);
+
+        if (name_length != 0 && !(name_length == 1 && file_path[0] == '.'))
+        {
+            memfs_node_t* child = memfs_child(node_cur, file_path, name_length);
+
+            if (child == NULL && tree_create)
+            {
+                child = (memfs_node_t*)arena_alloc(sizeof(memfs_node_t), memfs->tree_arena);
+                if (child == NULL)
+                {
+                    return NULL;
+                }
+                memset(child, 0, sizeof(*child));
+                child->node_name = arena_strndup(file_path, name_length, memfs->tree_arena);
+                child->node_sibling = node_cur->node_child;
+                node_cur->node_child = child;
+            }
+            if (child == NULL)
+            {
+                return NULL;
+            }
+            node_cur = child;
+        }
+
+        file_path += name_length;
+        if (*file_path == '/')
+        {
+            file_path++;
+        }
+    }
+
+    return node_cur;
+}
+
+static memfs_file_t* memfs_new_file(const char* file_path, memfs_t* memfs)
+{
+    memfs_file_t* file = (memfs_file_t*)arena_alloc(sizeof(memfs_file_t), memfs->tree_arena);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    memset(file, 0, sizeof(*file));
+    pthread_mutex_init(&file->file_lock, NULL);
+    
+    while (*file_path == '/')
+    {
+        file_path++;
+    }
+    file->file_path = arena_strndup(file_path, strlen(file_path), memfs->tree_arena);
+    file->spill_fd = -1;
+
+    file->file_next = memfs->files_list;
+    memfs->files_list = file;
+    memfs->files_count++;
+
+    return file;
+}
+
+memfs_file_t* memfs_open(const char* file_path, bool file_create, memfs_t* memfs)
+{
+    pthread_rwlock_rdlock(&memfs->tree_lock);
+    memfs_node_t* file_node = memfs_walk(file_path, false, memfs);
+    memfs_file_t* file = file_node != NULL ? file_node->node_file : NULL;
+    pthread_rwlock_unlock(&memfs->tree_lock);
+
+    if (file != NULL || file_create == false)
+    {
+        return file;
+    }
+
+    /* Another thread may have created the file between the locks, walking again */
+    pthread_rwlock_wrlock(&memfs->tree_lock);
+    file_node = memfs_walk(file_path, true, memfs);
+    if (file_node != NULL && file_node != &memfs->tree_root)
+    {
+        if (file_node->node_file == NULL)
+        {
+            file_node->node_file = memfs_new_file(file_path, memfs);
+        }
+        file = file_node->node_file;
+    }
+    pthread_rwlock_unlock(&memfs->tree_lock);
+
+    return file;
+}
+
+bool memfs_exist(const char* file_path, memfs_t* memfs)
+{
+    pthread_rwlock_rdlock(&memfs->tree_lock);
+    bool node_exist = memfs_walk(file_path, false, memfs) != NULL;
+    pthread_rwlock_unlock(&memfs->tree_lock);
+
+    return node_exist;
+}
+
+bool memfs_copy(const char* source_path, const char* dest_path, memfs_t* memfs)
+{
+    memfs_file_t* source = memfs_open(source_path, false, memfs);
+    if (source == NULL)
+    {
+        return false;
+    }
+    memfs_file_t* dest = memfs_open(dest_path, true, memfs);
+    if (dest == NULL)
+    {
+        return false;
+    }
+    if (source == dest)
+    {
+        return true;
+    }
+
+    /* Both locks are taken in the address order, two crossed copies can't deadlock */
+    memfs_file_t* first_lock = source < dest ? source : dest;
+    memfs_file_t* second_lock = source < dest ? dest : source;
+    pthread_mutex_lock(&first_lock->file_lock);
+    pthread_mutex_lock(&second_lock->file_lock);
+
+    memfs_touch(source, memfs);
+    memfs_touch(dest, memfs);
+    memfs_truncate_locked(dest, memfs);
+
+    bool copy_ret = true;
+
+    if (source->file_spilled)
+    {
+        uint8_t copy_buffer[4096];
+        size_t copy_offset = 0;
+        size_t read_size;
+
+        while (copy_ret && (read_size = memfs_read_locked(copy_offset, copy_buffer, sizeof(copy_buffer), source)) != 0)
+        {
+            copy_ret = memfs_append_locked(copy_buffer, read_size, dest, memfs);
+            copy_offset += read_size;
+        }
+    }
+    else if ((copy_ret = memfs_chunks_reserve(source->chunks_count, dest)))
+    {
+        for (size_t chunk_cur = 0; chunk_cur < source->chunks_count; chunk_cur++)
+        {
+            memfs_chunk_t* shared_chunk = source->file_chunks[chunk_cur];
+            shared_chunk->chunk_refs++;
+            dest->file_chunks[chunk_cur] = shared_chunk;
+        }
+        dest->chunks_count = source->chunks_count;
+        dest->file_size = source->file_size;
+    }
+
+    pthread_mutex_unlock(&second_lock->file_lock);
+    pthread_mutex_unlock(&first_lock->file_lock);
+
+    return copy_ret;
+}
+
+int memfs_foreach(const char* path_prefix, memfs_foreach_t callback, void* call_data, memfs_t* memfs)
+{
+    int visited_count = 0;
+    size_t prefix_length = 0;
+
+    if (path_prefix != NULL)
+    {
+        while (*path_prefix == '/')
+        {
+            path_prefix++;
+        }
+        prefix_length = strlen(path_prefix);
+    }
+
+    pthread_rwlock_rdlock(&memfs->tree_lock);
+    for (memfs_file_t* file = memfs->files_list; file != NULL; file = file->file_next)
+    {
+        if (prefix_length != 0 && strncmp(file->file_path, path_prefix, prefix_length) != 0)
+        {
+            continue;
+        }
+        visited_count++;
+
+        if (callback(file->file_path, file, call_data))
+        {
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&memfs->tree_lock);
+
+    return visited_count;
+}
+
+size_t memfs_memory_used(const memfs_t* memfs)
+{
+    return memfs->memory_used;
+}
+
@@ -0,0 +1,137 @@
+#ifndef VFS_MEMORY_FS_H
+#define VFS_MEMORY_FS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "data/Memory_Arena.h"
+
+#define MEMFS_CHUNK_SIZE (64 * 1024)
+#define MEMFS_SPILL_PATH_MAX 256
+
+/* File contents are stored in fixed size chunks, a chunk can be shared between many
+ * files (after a copy), a shared chunk is never modified, it's copied before (COW)
+*/
+typedef struct memfs_chunk
+{
+    _Atomic uint32_t chunk_refs;
+
+    uint32_t chunk_used;
+
+    struct memfs_chunk* chunk_free_next;
+
+    uint8_t chunk_bytes[MEMFS_CHUNK_SIZE];
+
+} memfs_chunk_t;
+
+typedef struct memfs_file
+{
+    pthread_mutex_t file_lock;
+
+    const char* file_path;
+
+    memfs_chunk_t** file_chunks;
+
+    size_t chunks_count;
+
+    size_t chunks_capacity;
+
+    size_t file_size;
+
+    /* Logical clock of the last access, used for select the spill victims */
+    _Atomic uint64_t last_touch;
+
+    /* When spilled, the content lives inside `spill_fd` and no chunk is kept */
+    bool file_spilled;
+
+    int spill_fd;
+
+    struct memfs_file* file_next;
+
+} memfs_file_t;
+
+typedef struct memfs_node
+{
+    const char* node_name;
+
+    struct memfs_node* node_child;
+
+    struct memfs_node* node_sibling;
+
+    memfs_file_t* node_file;
+
+} memfs_node_t;
+
+typedef struct memfs
+{
+    memfs_node_t tree_root;
+
+    /* Protects the trie shape, file contents are protected by each file lock */
+    pthread_rwlock_t tree_lock;
+
+    /* Nodes, names and files are allocated from here (tree_lock held for write) */
+    memory_arena_t* tree_arena;
+
+    memfs_file_t* files_list;
+
+    size_t files_count;
+
+    pthread_mutex_t chunks_lock;
+
+    /* Chunks are allocated in slabs and recycled, never released before the destroy */
+    memory_arena_t* chunks_arena;
+
+    memfs_chunk_t* chunks_free;
+
+    /* Bytes used by live chunks, a shared chunk is accounted only once */
+    _Atomic size_t memory_used;
+
+    size_t memory_budget;
+
+    _Atomic uint64_t touch_clock;
+
+    pthread_mutex_t spill_lock;
+
+    char spill_dir[MEMFS_SPILL_PATH_MAX];
+
+    bool spill_created;
+
+    _Atomic size_t files_spilled;
+
+} memfs_t;
+
+typedef bool (*memfs_foreach_t)(const char* file_path, memfs_file_t* file, void* call_data);
+
+/* Creates an empty tree, a `memory_budget` of 0 means unlimited memory, when the budget is 
+ * reached the least recently touched files are moved into a temporary directory created 
+ * inside `spill_parent` (or TMPDIR when NULL)
+*/
+memfs_t* memfs_create(size_t memory_budget, const char* spill_parent);
+bool memfs_destroy(memfs_t* memfs);
+
+memfs_file_t* memfs_open(const char* file_path, bool file_create, memfs_t* memfs);
+bool memfs_exist(const char* file_path, memfs_t* memfs);
+
+/* Many threads can append into different files at the same time, appends into the same
+ * file are serialized
+*/
+bool memfs_append(const void* data, size_t data_size, memfs_file_t* file, memfs_t* memfs);
+bool memfs_truncate(memfs_file_t* file, memfs_t* memfs);
+
+size_t memfs_read(size_t file_offset, void* buffer, size_t buffer_size, memfs_file_t* file, memfs_t* memfs);
+size_t memfs_size(memfs_file_t* file);
+
+/* Copies `source_path` into `dest_path` sharing all chunks, no byte is copied */
+bool memfs_copy(const char* source_path, const char* dest_path, memfs_t* memfs);
+
+/* Visits all files whose path begins with `path_prefix` (NULL for all), the callback runs
+ * with the tree locked, it can read and append, but must not create new files
+*/
+int memfs_foreach(const char* path_prefix, memfs_foreach_t callback, void* call_data, memfs_t* memfs);
+
+size_t memfs_memory_used(const memfs_t* memfs);
+
+#endif
+
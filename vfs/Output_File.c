@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Output_File.h"
+
+bool outfile_make_parents(char* file_path)
+{
+    for (char* separator = strchr(file_path + 1, '/'); separator != NULL; separator = strchr(separator + 1, '/'))
+    {
+        *separator = '\0';
+        int mkdir_ret = mkdir(file_path, 0755);
+        *separator = '/';
+
+        if (mkdir_ret != 0 && errno != EEXIST)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool outfile_create(char* file_path, memfs_t* memory_tree, output_file_t* file)
+{
+    memset(file, 0, sizeof(*file));
+    file->file_fd = -1;
+    file->memory_tree = memory_tree;
+
+    if (memory_tree != NULL)
+    {
+        file->memory_file = memfs_open(file_path, true, memory_tree);
+        return file->memory_file != NULL && memfs_truncate(file->memory_file, memory_tree);
+    }
+
+    if (outfile_make_parents(file_path) == false)
+    {
+        return false;
+    }
+    file->file_fd = open(file_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    return file->file_fd >= 0;
+}
+
+bool outfile_write(const uint8_t* data, size_t data_size, void* file_data)
+{
+    output_file_t* file = (output_file_t*)file_data;
+
+    if (file->memory_file != NULL)
+    {
+        return memfs_append(data, data_size, file->memory_file, file->memory_tree);
+    }
+
+    while (data_size != 0)
+    {
+        ssize_t write_ret = write(file->file_fd, data, data_size);
+        if (write_ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (write_ret <= 0)
+        {
+            return false;
+        }
+        data += write_ret;
+        data_size -= (size_t)write_ret;
+    }
+    return true;
+}
+
+bool outfile_flush(const char* flush_data, size_t flush_size, void* file)
+{
+    return outfile_write((const uint8_t*)flush_data, flush_size, file);
+}
+
+bool outfile_close(output_file_t* file)
+{
+    bool close_ret = true;
+
+    if (file->file_fd >= 0)
+    {
+        close_ret = close(file->file_fd) == 0;
+    }
+    file->file_fd = -1;
+    file->memory_file = NULL;
+
+    return close_ret;
+}
+
+uint8_t* outfile_load(const char* file_path, size_t* file_size, memfs_t* memory_tree)
+{
+    uint8_t* file_data = NULL;
+
+    if (memory_tree != NULL)
+    {
+        memfs_file_t* memory_file = memfs_open(file_path, false, memory_tree);
+        if (memory_file == NULL)
+        {
+            return NULL;
+        }
+
+        *file_size = memfs_size(memory_file);
+        if ((file_data = malloc(*file_size + 1)) != NULL && memfs_read(0, file_data, *file_size, memory_file, memory_tree) != *file_size)
+        {
+            free((void*)file_data);
+            file_data = NULL;
+        }
+        return file_data;
+    }
+
+    int file_fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
+
+    if (file_fd < 0)
+    {
+        return NULL;
+    }
+    if (fstat(file_fd, &file_stat) == 0 && (file_data = malloc((size_t)file_stat.st_size + 1)) != NULL)
+    {
+        *file_size = (size_t)file_stat.st_size;
+
+        for (size_t read_size = 0; read_size < *file_size; )
+        {
+            ssize_t read_ret = read(file_fd, file_data + read_size, *file_size - read_size);
+            if (read_ret < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (read_ret <= 0)
+            {
+                free((void*)file_data);
+                file_data = NULL;
+                break;
+            }
+            read_size += (size_t)read_ret;
+        }
+    }
+    close(file_fd);
+
+    return file_data;
+}
+
+static bool outfile_has_file(const char* file_path, memfs_file_t* file, void* call_data)
+{
+    (void)file_path; (void)file;
+    *(bool*)call_data = true;
+    return true;
+}
+
+bool outfile_exist(const char* file_path, memfs_t* memory_tree)
+{
+    if (memory_tree == NULL)
+    {
+        return access(file_path, F_OK) == 0;
+    }
+
+    if (memfs_exist(file_path, memory_tree))
+    {
+        return true;
+    }
+
+    /* The memory tree doesn't have directories, only files under the path */
+    size_t path_length = strlen(file_path);
+    char* directory_prefix = malloc(path_length + 2);
+    bool directory_found = false;
+
+    if (directory_prefix != NULL)
+    {
+        memcpy(directory_prefix, file_path, path_length);
+        strcpy(directory_prefix + path_length, "/");
+        memfs_foreach(directory_prefix, outfile_has_file, &directory_found, memory_tree);
+        free((void*)directory_prefix);
+    }
+    return directory_found;
+}
+
+size_t outfile_size(const char* file_path, memfs_t* memory_tree)
+{
+    if (memory_tree == NULL)
+    {
+        struct stat file_stat;
+        return stat(file_path, &file_stat) == 0 ? (size_t)file_stat.st_size : 0;
+    }
+
+    memfs_file_t* memory_file = memfs_open(file_path, false, memory_tree);
+    return memory_file != NULL ? memfs_size(memory_file) : 0;
+}
+
+struct outfile_matches
+{
+    const char* match_pattern;
+
+    char** matched_paths;
+
+    size_t matched_count;
+
+    size_t matched_capacity;
+
+    bool match_failed;
+};
+
+static bool outfile_collect(const char* file_path, memfs_file_t* file, void* call_data)
+{
+    struct outfile_matches* matches = (struct outfile_matches*)call_data;
+    (void)file;
+
+    if (fnmatch(matches->match_pattern, file_path, FNM_PATHNAME | FNM_PERIOD) != 0)
+    {
+        return false;
+    }
+
+    if (matches->matched_count == matches->matched_capacity)
+    {
+        size_t new_capacity = matches->matched_capacity != 0 ? matches->matched_capacity * 2 : 16;
+        char** new_paths = realloc(matches->matched_paths, new_capacity * sizeof(char*));
+        if (new_paths == NULL)
+        {
+            matches->match_failed = true;
+            return true;
+        }
+        matches->matched_paths = new_paths;
+        matches->matched_capacity = new_capacity;
+    }
+
+    if ((matches->matched_paths[matches->matched_count] = strdup(file_path)) == NULL)
+    {
+        matches->match_failed = true;
+        return true;
+    }
+    matches->matched_count++;
+
+    return false;
+}
+
+static int outfile_path_order(const void* first, const void* second)
+{
+    return strcmp(*(char* const*)first, *(char* const*)second);
+}
+
+bool outfile_glob(const char* pattern, outfile_match_t on_match, void* match_data, memfs_t* memory_tree)
+{
+    bool glob_ret = true;
+
+    if (memory_tree == NULL)
+    {
+        glob_t glob_result;
+        int match_ret = glob(pattern, 0, NULL, &glob_result);
+
+        if (match_ret == GLOB_NOMATCH)
+        {
+            return true;
+        }
+        if (match_ret != 0)
+        {
+            return false;
+        }
+
+        for (size_t match_cur = 0; glob_ret && match_cur < glob_result.gl_pathc; match_cur++)
+        {
+            glob_ret = on_match(glob_result.gl_pathv[match_cur], match_data);
+        }
+        globfree(&glob_result);
+
+        return glob_ret;
+    }
+
+    /* The literal part before the first wildcard limits the visited files */
+    struct outfile_matches matches = { .match_pattern = pattern };
+    size_t prefix_length = strcspn(pattern, "*?[");
+    char* path_prefix = strndup(pattern, prefix_length);
+
+    if (path_prefix == NULL)
+    {
+        return false;
+    }
+    memfs_foreach(path_prefix, outfile_collect, &matches, memory_tree);
+    free((void*)path_prefix);
+
+    if (matches.matched_count > 1)
+    {
+        qsort(matches.matched_paths, matches.matched_count, sizeof(char*), outfile_path_order);
+    }
+
+    glob_ret = !matches.match_failed;
+    for (size_t match_cur = 0; match_cur < matches.matched_count; match_cur++)
+    {
+        if (glob_ret)
+        {
+            glob_ret = on_match(matches.matched_paths[match_cur], match_data);
+        }
+        free((void*)matches.matched_paths[match_cur]);
+    }
+    free((void*)matches.matched_paths);
+
+    return glob_ret;
+}
+
@@ -0,0 +1,49 @@
+#ifndef VFS_OUTPUT_FILE_H
+#define VFS_OUTPUT_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Memory_FS.h"
+#include "data/Output_Buffer.h"
+
+/* An output file, from the disk or from the memory tree when -output-in-memory is used,
+ * all functions take the tree and use the disk when it's NULL
+*/
+typedef struct output_file
+{
+    int file_fd;
+
+    memfs_file_t* memory_file;
+
+    memfs_t* memory_tree;
+
+} output_file_t;
+
+typedef bool (*outfile_match_t)(const char* matched_path, void* match_data);
+
+/* Creates or truncates, with all parent directories */
+bool outfile_create(char* file_path, memfs_t* memory_tree, output_file_t* file);
+/* The signature is compatible with zip_stream_t */
+bool outfile_write(const uint8_t* data, size_t data_size, void* file);
+bool outfile_close(output_file_t* file);
+/* For an output_buffer_t flushing into the file */
+bool outfile_flush(const char* flush_data, size_t flush_size, void* file);
+
+/* The path is changed during the call but restored */
+bool outfile_make_parents(char* file_path);
+
+/* Reads a whole file into a malloc'ed buffer */
+uint8_t* outfile_load(const char* file_path, size_t* file_size, memfs_t* memory_tree);
+
+/* Files and directories */
+bool outfile_exist(const char* file_path, memfs_t* memory_tree);
+/* Zero when the file doesn't exist */
+size_t outfile_size(const char* file_path, memfs_t* memory_tree);
+
+/* Matches in lexicographic order, patterns without matches doesn't call `on_match` */
+bool outfile_glob(const char* pattern, outfile_match_t on_match, void* match_data, memfs_t* memory_tree);
+
+#endif
+
@@ -0,0 +1,447 @@
+#include <malloc.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "Zip_Archive.h"
+#include "data/Memory_Arena.h"
+
+#define ZIP_EOCD_SEARCH_LIMIT (ZIP_EOCD_SIZE + 0xffff)
+
+#define ZIP64_LOCATOR_MAGIC 0x07064b50
+#define ZIP64_EOCD_MAGIC 0x06064b50
+#define ZIP64_LOCATOR_SIZE 20
+#define ZIP64_EOCD_SIZE 56
+#define ZIP64_EXTRA_ID 0x0001
+
+#define ZIP_STREAM_PIECE (64 * 1024)
+
+static inline uint16_t zip_u16(const uint8_t* data)
+{
+    return (uint16_t)(data[0] | data[1] << 8);
+}
+
+static inline uint32_t zip_u32(const uint8_t* data)
+{
+    return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline uint64_t zip_u64(const uint8_t* data)
+{
+    return (uint64_t)zip_u32(data) | (uint64_t)zip_u32(data + 4) << 32;
+}
+
+static bool zip_find_eocd(zip_archive_t* archive)
+{
+    const uint8_t* archive_data = archive->archive_data;
+    size_t archive_size = archive->archive_size;
+
+    if (archive_size < ZIP_EOCD_SIZE)
+    {
+        return false;
+    }
+
+    size_t search_end = archive_size > ZIP_EOCD_SEARCH_LIMIT ? archive_size - ZIP_EOCD_SEARCH_LIMIT : 0;
+
+    /* The EOCD is followed by a variable comment, searching it backwards */
+    for (size_t eocd_cur = archive_size - ZIP_EOCD_SIZE + 1; eocd_cur-- > search_end; )
+    {
+        const uint8_t* eocd = archive_data + eocd_cur;
+
+        if (zip_u32(eocd) != ZIP_EOCD_MAGIC || eocd_cur + ZIP_EOCD_SIZE + zip_u16(eocd + 20) != archive_size)
+        {
+            continue;
+        }
+
+        archive->eocd_offset = eocd_cur;
+        archive->entries_count = zip_u16(eocd + 10);
+        archive->central_dir_size = zip_u32(eocd + 12);
+        archive->central_dir_offset = zip_u32(eocd + 16);
+
+        /* Archives bigger than 4GB or with too many entries keep the real values in the ZIP64 record */
+        if (eocd_cur >= ZIP64_LOCATOR_SIZE && zip_u32(eocd - ZIP64_LOCATOR_SIZE) == ZIP64_LOCATOR_MAGIC)
+        {
+            /* Bounded without an addition, the offset is read from the file */
+            uint64_t zip64_offset = zip_u64(eocd - ZIP64_LOCATOR_SIZE + 8);
+            if (zip64_offset > eocd_cur || eocd_cur - zip64_offset < ZIP64_EOCD_SIZE ||
+                zip_u32(archive_data + zip64_offset) != ZIP64_EOCD_MAGIC)
+            {
+                return false;
+            }
+            const uint8_t* zip64_eocd = archive_data + zip64_offset;
+            archive->entries_count = zip_u64(zip64_eocd + 32);
+            archive->central_dir_size = zip_u64(zip64_eocd + 40);
+            archive->central_dir_offset = zip_u64(zip64_eocd + 48);
+        }
+
+        return archive->central_dir_offset <= eocd_cur && archive->central_dir_size <= eocd_cur - archive->central_dir_offset;
+    }
+
+    return false;
+}
+
+static void zip_read_extra64(const uint8_t* extra, size_t extra_size, zip_entry_t* entry)
+{
+    while (extra_size >= 4)
+    {
+        uint16_t extra_id = zip_u16(extra);
+        uint16_t field_size = zip_u16(extra + 2);
+
+        if (field_size > extra_size - 4)
+        {
+            return;
+        }
+
+        if (extra_id == ZIP64_EXTRA_ID)
+        {
+            /* Only the fields saturated in the central header are present, in this order */
+            const uint8_t* field = extra + 4;
+            const uint8_t* field_end = field + field_size;
+
+            if (entry->uncompressed_size == 0xffffffff && field + 8 <= field_end)
+            {
+                entry->uncompressed_size = zip_u64(field);
+                field += 8;
+            }
+            if (entry->compressed_size == 0xffffffff && field + 8 <= field_end)
+            {
+                entry->compressed_size = zip_u64(field);
+                field += 8;
+            }
+            if (entry->local_header_offset == 0xffffffff && field + 8 <= field_end)
+            {
+                entry->local_header_offset = zip_u64(field);
+            }
+            return;
+        }
+
+        extra += 4 + field_size;
+        extra_size -= 4 + field_size;
+    }
+}
+
+static bool zip_read_central(zip_archive_t* archive)
+{
+    const uint8_t* central_cur = archive->archive_data + archive->central_dir_offset;
+    const uint8_t* central_end = central_cur + archive->central_dir_size;
+
+    /* Each header has at least 46 bytes, a bigger count is a lie */
+    if (archive->entries_count > archive->central_dir_size / ZIP_CENTRAL_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    archive->entries = calloc(archive->entries_count + 1, sizeof(zip_entry_t));
+    /* The names can't be bigger than the central directory itself */
+    archive->entries_names = malloc(archive->central_dir_size + 1);
+
+    if (archive->entries == NULL || archive->entries_names == NULL)
+    {
+        return false;
+    }
+
+    char* names_cur = archive->entries_names;
+
+    for (size_t entry_cur = 0; entry_cur < archive->entries_count; entry_cur++)
+    {
+        if (central_end - central_cur < ZIP_CENTRAL_HEADER_SIZE || zip_u32(central_cur) != ZIP_CENTRAL_HEADER_MAGIC)
+        {
+            return false;
+        }
+
+        zip_entry_t* entry = &archive->entries[entry_cur];
+
+        uint16_t name_length = zip_u16(central_cur + 28);
+        uint16_t extra_length = zip_u16(central_cur + 30);
+        uint16_t comment_length = zip_u16(central_cur + 32);
+        size_t header_size = (size_t)ZIP_CENTRAL_HEADER_SIZE + name_length + extra_length + comment_length;
+
+        if ((size_t)(central_end - central_cur) < header_size)
+        {
+            return false;
+        }
+
+        entry->entry_index = (uint32_t)entry_cur;
+        entry->entry_flags = zip_u16(central_cur + 8);
+        entry->compression_method = zip_u16(central_cur + 10);
+        entry->entry_crc32 = zip_u32(central_cur + 16);
+        entry->compressed_size = zip_u32(central_cur + 20);
+        entry->uncompressed_size = zip_u32(central_cur + 24);
+        entry->local_header_offset = zip_u32(central_cur + 42);
+
+        zip_read_extra64(central_cur + ZIP_CENTRAL_HEADER_SIZE + name_length, extra_length, entry);
+
+        /* The null terminator uses the space of the header that isn't copied */
+        memcpy(names_cur, central_cur + ZIP_CENTRAL_HEADER_SIZE, name_length);
+        names_cur[name_length] = '\0';
+        entry->entry_name = names_cur;
+        names_cur += name_length + 1;
+
+        central_cur += header_size;
+    }
+
+    return true;
+}
+
+static bool zip_load(zip_archive_t* archive)
+{
+    if (zip_find_eocd(archive) == false || zip_read_central(archive) == false)
+    {
+        zip_close(archive);
+        return false;
+    }
+
+    return true;
+}
+
+bool zip_open_memory(const uint8_t* archive_data, size_t archive_size, zip_archive_t* archive)
+{
+    memset(archive, 0, sizeof(*archive));
+    archive->archive_fd = -1;
+
+    archive->archive_data = archive_data;
+    archive->archive_size = archive_size;
+
+    return zip_load(archive);
+}
+
+bool zip_open(const char* archive_path, zip_archive_t* archive)
+{
+    memset(archive, 0, sizeof(*archive));
+    archive->archive_path = archive_path;
+
+    archive->archive_fd = open(archive_path, O_RDONLY | O_CLOEXEC);
+    if (archive->archive_fd < 0)
+    {
+        return false;
+    }
+
+    struct stat archive_stat;
+    if (fstat(archive->archive_fd, &archive_stat) != 0 || archive_stat.st_size < ZIP_EOCD_SIZE)
+    {
+        close(archive->archive_fd);
+        return false;
+    }
+
+    void* mapped = mmap(NULL, (size_t)archive_stat.st_size, PROT_READ, MAP_SHARED, archive->archive_fd, 0);
+    if (mapped == MAP_FAILED)
+    {
+        close(archive->archive_fd);
+        return false;
+    }
+
+    archive->archive_mapped = true;
+    archive->archive_data = (const uint8_t*)mapped;
+    archive->archive_size = (size_t)archive_stat.st_size;
+
+    return zip_load(archive);
+}
+
+void zip_close(zip_archive_t* archive)
+{
+    if (archive->entries != NULL)
+    {
+        free((void*)archive->entries);
+    }
+    if (archive->entries_names != NULL)
+    {
+        free((void*)archive->entries_names);
+    }
+    if (archive->archive_mapped)
+    {
+        munmap((void*)archive->archive_data, archive->archive_size);
+    }
+    if (archive->archive_fd >= 0)
+    {
+        close(archive->archive_fd);
+    }
+
+    memset(archive, 0, sizeof(*archive));
+    archive->archive_fd = -1;
+}
+
+const zip_entry_t* zip_find(const char* entry_name, const zip_archive_t* archive)
+{
+    for (size_t entry_cur = 0; entry_cur < archive->entries_count; entry_cur++)
+    {
+        if (strcmp(archive->entries[entry_cur].entry_name, entry_name) == 0)
+        {
+            return &archive->entries[entry_cur];
+        }
+    }
+    return NULL;
+}
+
+const uint8_t* zip_entry_raw(const zip_entry_t* entry, const zip_archive_t* archive)
+{
+    uint64_t header_offset = entry->local_header_offset;
+
+    if (header_offset > archive->archive_size || archive->archive_size - header_offset < ZIP_LOCAL_HEADER_SIZE)
+    {
+        return NULL;
+    }
+
+    const uint8_t* local_header = archive->archive_data + header_offset;
+    if (zip_u32(local_header) != ZIP_LOCAL_HEADER_MAGIC)
+    {
+        return NULL;
+    }
+
+    /* The local extra field can differ from the central one (alignment paddings) */
+    uint64_t data_offset = header_offset + ZIP_LOCAL_HEADER_SIZE + zip_u16(local_header + 26) + zip_u16(local_header + 28);
+
+    if (data_offset > archive->archive_size || archive->archive_size - data_offset < entry->compressed_size)
+    {
+        return NULL;
+    }
+
+    return archive->archive_data + data_offset;
+}
+
+/* zlib allocates his state and the 32 KB window for each entry, the memory is freed all at
+ * once by the rewind after inflateEnd
+*/
+static voidpf zip_scratch_alloc(voidpf scratch, uInt items_count, uInt item_size)
+{
+    return arena_alloc((size_t)items_count * item_size, (memory_arena_t*)scratch);
+}
+
+static void zip_scratch_free(voidpf scratch, voidpf address)
+{
+    (void)scratch;
+    (void)address;
+}
+
+bool zip_entry_stream(const zip_entry_t* entry, zip_stream_t callback, void* stream_data, const zip_archive_t* archive)
+{
+    const uint8_t* raw_data = zip_entry_raw(entry, archive);
+    if (raw_data == NULL)
+    {
+        return false;
+    }
+
+    if (entry->compression_method == ZIP_METHOD_STORED)
+    {
+        if (entry->compressed_size != entry->uncompressed_size ||
+            crc32_z(crc32(0, NULL, 0), raw_data, (size_t)entry->compressed_size) != entry->entry_crc32)
+        {
+            return false;
+        }
+        return entry->compressed_size == 0 || callback(raw_data, entry->compressed_size, stream_data);
+    }
+
+    if (entry->compression_method != ZIP_METHOD_DEFLATED)
+    {
+        return false;
+    }
+
+    z_stream inflate_stream;
+    memset(&inflate_stream, 0, sizeof(inflate_stream));
+
+    /* On a pool worker, the window is on his NUMA node and reused from an entry to the next */
+    memory_arena_t* scratch = arena_scratch();
+    arena_mark_t scratch_mark = { 0 };
+    if (scratch != NULL)
+    {
+        scratch_mark = arena_mark(scratch);
+        inflate_stream.zalloc = zip_scratch_alloc;
+        inflate_stream.zfree = zip_scratch_free;
+        inflate_stream.opaque = scratch;
+    }
+
+    /* Raw deflate, ZIP doesn't store the zlib header */
+    if (inflateInit2(&inflate_stream, -MAX_WBITS) != Z_OK)
+    {
+        if (scratch != NULL)
+        {
+            arena_rewind_to(scratch_mark, scratch);
+        }
+        return false;
+    }
+
+    uint8_t piece[ZIP_STREAM_PIECE];
+    uLong entry_crc = crc32(0, NULL, 0);
+    uint64_t inflated_size = 0;
+    uint64_t input_left = entry->compressed_size;
+    int inflate_ret = Z_OK;
+
+    inflate_stream.next_in = (Bytef*)raw_data;
+
+    while (inflate_ret != Z_STREAM_END)
+    {
+        if (inflate_stream.avail_in == 0)
+        {
+            /* avail_in is 32 bits only, big entries are fed in slices */
+            uInt input_slice = input_left > 0x40000000 ? 0x40000000 : (uInt)input_left;
+            inflate_stream.avail_in = input_slice;
+            input_left -= input_slice;
+        }
+
+        inflate_stream.next_out = piece;
+        inflate_stream.avail_out = sizeof(piece);
+
+        inflate_ret = inflate(&inflate_stream, Z_NO_FLUSH);
+        if (inflate_ret != Z_OK && inflate_ret != Z_STREAM_END)
+        {
+            break;
+        }
+
+        size_t piece_size = sizeof(piece) - inflate_stream.avail_out;
+        if (piece_size == 0 && inflate_ret == Z_OK && inflate_stream.avail_in == 0 && input_left == 0)
+        {
+            /* Truncated stream */
+            break;
+        }
+
+        inflated_size += piece_size;
+        if (inflated_size > entry->uncompressed_size)
+        {
+            break;
+        }
+        entry_crc = crc32(entry_crc, piece, (uInt)piece_size);
+
+        if (piece_size != 0 && callback(piece, piece_size, stream_data) == false)
+        {
+            break;
+        }
+    }
+
+    inflateEnd(&inflate_stream);
+    /* The callback mustn't keep scratch memory of his own, it's released with the window */
+    if (scratch != NULL)
+    {
+        arena_rewind_to(scratch_mark, scratch);
+    }
+
+    return inflate_ret == Z_STREAM_END && inflated_size == entry->uncompressed_size && entry_crc == entry->entry_crc32;
+}
+
+struct zip_inflate_target
+{
+    uint8_t* output;
+
+    size_t output_used;
+};
+
+static bool zip_inflate_copy(const uint8_t* data, size_t data_size, void* stream_data)
+{
+    struct zip_inflate_target* target = (struct zip_inflate_target*)stream_data;
+
+    memcpy(target->output + target->output_used, data, data_size);
+    target->output_used += data_size;
+
+    return true;
+}
+
+bool zip_entry_inflate(const zip_entry_t* entry, uint8_t* output, const zip_archive_t* archive)
+{
+    struct zip_inflate_target target = { .output = output, .output_used = 0 };
+
+    /* The stream already refuses anything bigger than the uncompressed size */
+    return zip_entry_stream(entry, zip_inflate_copy, &target, archive);
+}
+
@@ -0,0 +1,95 @@
+#ifndef ZIP_ZIP_ARCHIVE_H
+#define ZIP_ZIP_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define ZIP_METHOD_STORED 0
+#define ZIP_METHOD_DEFLATED 8
+
+#define ZIP_LOCAL_HEADER_MAGIC 0x04034b50
+#define ZIP_CENTRAL_HEADER_MAGIC 0x02014b50
+#define ZIP_EOCD_MAGIC 0x06054b50
+
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+#define ZIP_EOCD_SIZE 22
+
+typedef struct zip_entry
+{
+    /* Null terminated copy of the name stored in the central directory */
+    const char* entry_name;
+
+    uint32_t entry_index;
+
+    uint16_t compression_method;
+
+    uint16_t entry_flags;
+
+    uint32_t entry_crc32;
+
+    uint64_t compressed_size;
+
+    uint64_t uncompressed_size;
+
+    uint64_t local_header_offset;
+
+} zip_entry_t;
+
+typedef struct zip_archive
+{
+    const char* archive_path;
+
+    int archive_fd;
+
+    /* The whole archive, mapped from the file or owned by the caller */
+    const uint8_t* archive_data;
+
+    size_t archive_size;
+
+    bool archive_mapped;
+
+    zip_entry_t* entries;
+
+    size_t entries_count;
+
+    /* All entries names, in a single block */
+    char* entries_names;
+
+    uint64_t central_dir_offset;
+
+    uint64_t central_dir_size;
+
+    uint64_t eocd_offset;
+
+} zip_archive_t;
+
+/* The central directory is read in the open, the entries data is only touched on demand */
+bool zip_open(const char* archive_path, zip_archive_t* archive);
+bool zip_open_memory(const uint8_t* archive_data, size_t archive_size, zip_archive_t* archive);
+void zip_close(zip_archive_t* archive);
+
+const zip_entry_t* zip_find(const char* entry_name, const zip_archive_t* archive);
+
+/* Returns the stored bytes (compressed or not) of the entry, NULL when the local header is invalid */
+const uint8_t* zip_entry_raw(const zip_entry_t* entry, const zip_archive_t* archive);
+
+/* Inflates the whole entry into `output`, which must have `uncompressed_size` bytes, the CRC is checked */
+bool zip_entry_inflate(const zip_entry_t* entry, uint8_t* output, const zip_archive_t* archive);
+
+typedef bool (*zip_stream_t)(const uint8_t* data, size_t data_size, void* stream_data);
+
+/* Inflates the entry in small pieces, each piece is handed to `callback` */
+bool zip_entry_stream(const zip_entry_t* entry, zip_stream_t callback, void* stream_data, const zip_archive_t* archive);
+
+static inline bool zip_entry_is_dir(const zip_entry_t* entry)
+{
+    size_t name_length = strlen(entry->entry_name);
+
+    return name_length != 0 && entry->entry_name[name_length - 1] == '/';
+}
+
+#endif
+
@@ -0,0 +1,549 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "Zip_Stream.h"
+#include "data/Output_Buffer.h"
+#include "data/Content_Hash.h"
+
+#define ZIPS_PIECE_SIZE (64 * 1024)
+#define ZIPS_NAME_MAX 65535
+#define ZIPS_ZIP64_EOCD_MAGIC 0x06064b50
+#define ZIPS_ZIP64_LOCATOR_MAGIC 0x07064b50
+#define ZIPS_ZIP64_LOCATOR_SIZE 20
+#define ZIPS_SIGNING_MAGIC "APK Sig Block 42"
+#define ZIPS_SIGNING_MAX (64 * 1024 * 1024)
+
+/* What a local header said, checked against the central directory at the end */
+struct zips_record
+{
+    uint64_t name_hash;
+
+    uint64_t local_header_offset;
+
+    uint32_t entry_crc32;
+
+    uint32_t compressed_size;
+
+    uint32_t uncompressed_size;
+
+    uint16_t compression_method;
+
+    bool record_referenced;
+};
+
+struct zips_reader
+{
+    int input_fd;
+
+    uint8_t* buffer_data;
+
+    size_t buffer_start;
+
+    size_t buffer_end;
+
+    bool input_ended;
+
+    /* The archive offset of buffer_data[buffer_start] */
+    uint64_t stream_offset;
+
+    /* struct zips_record, in the archive order */
+    output_buffer_t entries_records;
+
+    char* entry_name;
+
+    uint8_t* inflate_piece;
+};
+
+struct zips_entry_state
+{
+    zip_entry_t entry;
+
+    const zips_handler_t* handler;
+
+    bool entry_delivering;
+
+    uLong data_crc32;
+
+    uint64_t data_size;
+
+    uint64_t data_consumed;
+};
+
+static uint16_t zips_u16(const uint8_t* data)
+{
+    return (uint16_t)(data[0] | data[1] << 8);
+}
+
+static uint32_t zips_u32(const uint8_t* data)
+{
+    return (uint32_t)zips_u16(data) | (uint32_t)zips_u16(data + 2) << 16;
+}
+
+static uint64_t zips_u64(const uint8_t* data)
+{
+    return (uint64_t)zips_u32(data) | (uint64_t)zips_u32(data + 4) << 32;
+}
+
+static size_t zips_available(const struct zips_reader* reader)
+{
+    return reader->buffer_end - reader->buffer_start;
+}
+
+static const uint8_t* zips_peek(const struct zips_reader* reader)
+{
+    return reader->buffer_data + reader->buffer_start;
+}
+
+static void zips_consume(size_t consumed_size, struct zips_reader* reader)
+{
+    reader->buffer_start += consumed_size;
+    reader->stream_offset += consumed_size;
+}
+
+/* Makes `need_size` bytes available, false at the end of the input before them */
+static bool zips_fill(size_t need_size, struct zips_reader* reader)
+{
+    if (zips_available(reader) >= need_size)
+    {
+        return true;
+    }
+    if (need_size > ZIPS_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    memmove(reader->buffer_data, reader->buffer_data + reader->buffer_start, zips_available(reader));
+    reader->buffer_end -= reader->buffer_start;
+    reader->buffer_start = 0;
+
+    while (zips_available(reader) < need_size && reader->input_ended == false)
+    {
+        ssize_t read_ret = read(reader->input_fd, reader->buffer_data + reader->buffer_end, ZIPS_BUFFER_SIZE - reader->buffer_end);
+        if (read_ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read_ret <= 0)
+        {
+            reader->input_ended = true;
+            break;
+        }
+        reader->buffer_end += (size_t)read_ret;
+    }
+    return zips_available(reader) >= need_size;
+}
+
+static bool zips_skip(uint64_t skip_size, struct zips_reader* reader)
+{
+    while (skip_size != 0)
+    {
+        if (zips_fill(1, reader) == false)
+        {
+            return false;
+        }
+        size_t skipped = zips_available(reader) < skip_size ? zips_available(reader) : (size_t)skip_size;
+        zips_consume(skipped, reader);
+        skip_size -= skipped;
+    }
+    return true;
+}
+
+static void zips_deliver(const uint8_t* data, size_t data_size, struct zips_entry_state* state)
+{
+    if (data_size == 0)
+    {
+        return;
+    }
+    state->data_crc32 = crc32(state->data_crc32, data, (uInt)data_size);
+    state->data_size += data_size;
+
+    if (state->entry_delivering)
+    {
+        state->entry_delivering = state->handler->entry_data(data, data_size, state->handler->handler_data);
+    }
+}
+
+/* Without a descriptor the compressed size bounds the input given to inflate */
+static bool zips_inflate(bool has_descriptor, struct zips_entry_state* state, struct zips_reader* reader)
+{
+    z_stream inflate_stream;
+    memset(&inflate_stream, 0, sizeof(inflate_stream));
+
+    if (inflateInit2(&inflate_stream, -MAX_WBITS) != Z_OK)
+    {
+        return false;
+    }
+
+    int inflate_ret = Z_OK;
+    while (inflate_ret == Z_OK && zips_fill(1, reader))
+    {
+        size_t input_size = zips_available(reader);
+        if (has_descriptor == false)
+        {
+            uint64_t input_left = state->entry.compressed_size - state->data_consumed;
+            input_size = input_left < input_size ? (size_t)input_left : input_size;
+        }
+        if (input_size == 0)
+        {
+            break;
+        }
+
+        inflate_stream.next_in = (Bytef*)zips_peek(reader);
+        inflate_stream.avail_in = (uInt)input_size;
+        inflate_stream.next_out = reader->inflate_piece;
+        inflate_stream.avail_out = ZIPS_PIECE_SIZE;
+
+        inflate_ret = inflate(&inflate_stream, Z_NO_FLUSH);
+
+        size_t input_used = input_size - inflate_stream.avail_in;
+        zips_consume(input_used, reader);
+        state->data_consumed += input_used;
+        zips_deliver(reader->inflate_piece, ZIPS_PIECE_SIZE - inflate_stream.avail_out, state);
+    }
+    inflateEnd(&inflate_stream);
+
+    return inflate_ret == Z_STREAM_END;
+}
+
+/* Stored data followed by a descriptor: its end is the first position followed by a descriptor
+ * (with or without signature) that matches the data before it
+*/
+static bool zips_descriptor_at(const uint8_t* candidate, size_t candidate_size, uint32_t data_crc, uint64_t data_size)
+{
+    if (candidate_size >= 16 && zips_u32(candidate) == ZIPS_DESCRIPTOR_MAGIC && zips_u32(candidate + 4) == data_crc &&
+        zips_u32(candidate + 8) == data_size && zips_u32(candidate + 12) == data_size)
+    {
+        return true;
+    }
+    return candidate_size >= 12 && zips_u32(candidate) == data_crc && zips_u32(candidate + 4) == data_size && zips_u32(candidate + 8) == data_size;
+}
+
+static bool zips_scan_stored(struct zips_entry_state* state, struct zips_reader* reader)
+{
+    for (;;)
+    {
+        bool input_left = zips_fill(16, reader);
+        const uint8_t* data = zips_peek(reader);
+        size_t data_size = zips_available(reader);
+        /* Until the end of the input, a candidate must have the 16 bytes available */
+        size_t scan_end = input_left ? data_size - 15 : (data_size >= 12 ? data_size - 11 : 0);
+        uLong data_crc = state->data_crc32;
+        size_t scan_cur = 0;
+
+        for (; scan_cur < scan_end; scan_cur++)
+        {
+            if (zips_descriptor_at(data + scan_cur, data_size - scan_cur, (uint32_t)data_crc, state->data_consumed + scan_cur))
+            {
+                break;
+            }
+            data_crc = crc32(data_crc, data + scan_cur, 1);
+        }
+
+        zips_deliver(data, scan_cur, state);
+        zips_consume(scan_cur, reader);
+        state->data_consumed += scan_cur;
+
+        if (scan_cur < scan_end)
+        {
+            return true;
+        }
+        if (input_left == false)
+        {
+            return false;
+        }
+    }
+}
+
+static bool zips_read_descriptor(zip_entry_t* entry, struct zips_reader* reader)
+{
+    if (zips_fill(12, reader) == false)
+    {
+        return false;
+    }
+    /* The signature is optional */
+    if (zips_u32(zips_peek(reader)) == ZIPS_DESCRIPTOR_MAGIC)
+    {
+        if (zips_fill(16, reader) == false)
+        {
+            return false;
+        }
+        zips_consume(4, reader);
+    }
+
+    const uint8_t* descriptor = zips_peek(reader);
+    entry->entry_crc32 = zips_u32(descriptor);
+    entry->compressed_size = zips_u32(descriptor + 4);
+    entry->uncompressed_size = zips_u32(descriptor + 8);
+    zips_consume(12, reader);
+
+    return true;
+}
+
+static bool zips_read_entry(const zips_handler_t* handler, zips_report_t* report, struct zips_reader* reader)
+{
+    if (zips_fill(ZIP_LOCAL_HEADER_SIZE, reader) == false)
+    {
+        return false;
+    }
+
+    const uint8_t* header = zips_peek(reader);
+    uint16_t name_length = zips_u16(header + 26);
+    uint16_t extra_length = zips_u16(header + 28);
+    struct zips_entry_state state = {
+        .entry = {
+            .entry_name = reader->entry_name,
+            .entry_index = (uint32_t)report->entries_count,
+            .entry_flags = zips_u16(header + 6),
+            .compression_method = zips_u16(header + 8),
+            .entry_crc32 = zips_u32(header + 14),
+            .compressed_size = zips_u32(header + 18),
+            .uncompressed_size = zips_u32(header + 22),
+            .local_header_offset = reader->stream_offset
+        },
+        .handler = handler,
+        .data_crc32 = crc32(0, NULL, 0)
+    };
+
+    if (zips_fill(ZIP_LOCAL_HEADER_SIZE + name_length + extra_length, reader) == false)
+    {
+        return false;
+    }
+    memcpy(reader->entry_name, zips_peek(reader) + ZIP_LOCAL_HEADER_SIZE, name_length);
+    reader->entry_name[name_length] = '\0';
+    zips_consume(ZIP_LOCAL_HEADER_SIZE + name_length + extra_length, reader);
+
+    zip_entry_t* entry = &state.entry;
+    bool has_descriptor = (entry->entry_flags & 0x0008) != 0;
+    bool data_readable = (entry->entry_flags & 0x0001) == 0 &&
+        (entry->compression_method == ZIP_METHOD_STORED || entry->compression_method == ZIP_METHOD_DEFLATED);
+
+    /* ZIP64 sizes are only in the extra field */
+    if (entry->compressed_size == UINT32_MAX || entry->uncompressed_size == UINT32_MAX)
+    {
+        return false;
+    }
+
+    /* Encrypted or unknown data can be skipped only when its size is known */
+    if (data_readable == false && has_descriptor)
+    {
+        return false;
+    }
+
+    state.entry_delivering = handler->entry_begin(entry, handler->handler_data);
+    bool data_ret = false;
+
+    if (data_readable)
+    {
+        if (entry->compression_method == ZIP_METHOD_DEFLATED)
+        {
+            data_ret = zips_inflate(has_descriptor, &state, reader);
+        }
+        else if (has_descriptor)
+        {
+            data_ret = zips_scan_stored(&state, reader);
+        }
+        else
+        {
+            data_ret = true;
+            while (data_ret && state.data_consumed < entry->compressed_size)
+            {
+                data_ret = zips_fill(1, reader);
+                uint64_t data_left = entry->compressed_size - state.data_consumed;
+                size_t data_size = zips_available(reader) < data_left ? zips_available(reader) : (size_t)data_left;
+
+                zips_deliver(zips_peek(reader), data_size, &state);
+                zips_consume(data_size, reader);
+                state.data_consumed += data_size;
+            }
+        }
+    }
+
+    /* The next header is found with the compressed size, without it the stream is lost */
+    if (has_descriptor && (data_ret == false || zips_read_descriptor(entry, reader) == false))
+    {
+        return false;
+    }
+    if (has_descriptor == false && state.data_consumed < entry->compressed_size)
+    {
+        if (zips_skip(entry->compressed_size - state.data_consumed, reader) == false)
+        {
+            return false;
+        }
+        data_ret = false;
+    }
+
+    bool entry_valid = data_ret && state.data_consumed == entry->compressed_size &&
+        state.data_size == entry->uncompressed_size && (uint32_t)state.data_crc32 == entry->entry_crc32;
+    handler->entry_end(entry, entry_valid, handler->handler_data);
+
+    struct zips_record record = {
+        .name_hash = hash_content64(reader->entry_name, name_length, 0),
+        .local_header_offset = entry->local_header_offset,
+        .entry_crc32 = entry->entry_crc32,
+        .compressed_size = (uint32_t)entry->compressed_size,
+        .uncompressed_size = (uint32_t)entry->uncompressed_size,
+        .compression_method = entry->compression_method
+    };
+    report->entries_count++;
+
+    /* Only a truncated input stops the stream, bad entries are reported by entry_end */
+    return outbuf_append(&record, sizeof(record), &reader->entries_records);
+}
+
+static int zips_record_compare(const void* key, const void* record)
+{
+    uint64_t offset = *(const uint64_t*)key;
+    uint64_t record_offset = ((const struct zips_record*)record)->local_header_offset;
+
+    return offset < record_offset ? -1 : offset > record_offset;
+}
+
+static bool zips_read_central(zips_report_t* report, struct zips_reader* reader)
+{
+    struct zips_record* records = (struct zips_record*)reader->entries_records.buffer_data;
+    size_t records_count = outbuf_length(&reader->entries_records) / sizeof(struct zips_record);
+
+    while (zips_fill(4, reader) && zips_u32(zips_peek(reader)) == ZIP_CENTRAL_HEADER_MAGIC)
+    {
+        if (zips_fill(ZIP_CENTRAL_HEADER_SIZE, reader) == false)
+        {
+            return false;
+        }
+        const uint8_t* header = zips_peek(reader);
+        size_t name_length = zips_u16(header + 28);
+        size_t header_size = ZIP_CENTRAL_HEADER_SIZE + name_length + zips_u16(header + 30) + zips_u16(header + 32);
+
+        if (zips_fill(header_size, reader) == false)
+        {
+            return false;
+        }
+        header = zips_peek(reader);
+
+        uint64_t local_offset = zips_u32(header + 42);
+        struct zips_record* record = bsearch(&local_offset, records, records_count, sizeof(struct zips_record), zips_record_compare);
+
+        /* A local entry is referenced once, an entry that differs counts once */
+        if (record == NULL || record->record_referenced)
+        {
+            report->mismatched_count++;
+        }
+        else
+        {
+            record->record_referenced = true;
+            report->mismatched_count += record->name_hash != hash_content64(header + ZIP_CENTRAL_HEADER_SIZE, name_length, 0) ||
+                record->compression_method != zips_u16(header + 10) || record->entry_crc32 != zips_u32(header + 16) ||
+                record->compressed_size != zips_u32(header + 20) || record->uncompressed_size != zips_u32(header + 24);
+        }
+        report->central_count++;
+        zips_consume(header_size, reader);
+    }
+
+    for (size_t record_cur = 0; record_cur < records_count; record_cur++)
+    {
+        report->mismatched_count += records[record_cur].record_referenced == false;
+    }
+
+    /* The ZIP64 records, if any, aren't needed */
+    if (zips_fill(4, reader) && zips_u32(zips_peek(reader)) == ZIPS_ZIP64_EOCD_MAGIC)
+    {
+        if (zips_fill(12, reader) == false || zips_skip(12 + zips_u64(zips_peek(reader) + 4), reader) == false)
+        {
+            return false;
+        }
+    }
+    if (zips_fill(4, reader) && zips_u32(zips_peek(reader)) == ZIPS_ZIP64_LOCATOR_MAGIC && zips_skip(ZIPS_ZIP64_LOCATOR_SIZE, reader) == false)
+    {
+        return false;
+    }
+
+    if (zips_fill(ZIP_EOCD_SIZE, reader) == false || zips_u32(zips_peek(reader)) != ZIP_EOCD_MAGIC)
+    {
+        return false;
+    }
+    uint16_t comment_length = zips_u16(zips_peek(reader) + 20);
+    zips_consume(ZIP_EOCD_SIZE, reader);
+    report->central_found = zips_skip(comment_length, reader);
+
+    return report->central_found;
+}
+
+/* The block size comes first and the magic last */
+static bool zips_skip_signing_block(struct zips_reader* reader)
+{
+    if (zips_fill(8, reader) == false)
+    {
+        return false;
+    }
+    uint64_t block_size = zips_u64(zips_peek(reader));
+    if (block_size < 24 || block_size > ZIPS_SIGNING_MAX)
+    {
+        return false;
+    }
+    zips_consume(8, reader);
+
+    if (zips_skip(block_size - 16, reader) == false || zips_fill(16, reader) == false ||
+        memcmp(zips_peek(reader), ZIPS_SIGNING_MAGIC, 16) != 0)
+    {
+        return false;
+    }
+    zips_consume(16, reader);
+
+    return true;
+}
+
+bool zips_read(int input_fd, const zips_handler_t* handler, zips_report_t* report)
+{
+    struct zips_reader reader = {
+        .input_fd = input_fd,
+        .buffer_data = malloc(ZIPS_BUFFER_SIZE),
+        .entry_name = malloc(ZIPS_NAME_MAX + 1),
+        .inflate_piece = malloc(ZIPS_PIECE_SIZE)
+    };
+    memset(report, 0, sizeof(*report));
+
+    bool read_ret = reader.buffer_data != NULL && reader.entry_name != NULL && reader.inflate_piece != NULL &&
+        outbuf_init(0, NULL, NULL, &reader.entries_records);
+    bool signing_skipped = false;
+
+    while (read_ret)
+    {
+        if (zips_fill(4, &reader) == false)
+        {
+            /* Truncated before the central directory */
+            read_ret = false;
+            break;
+        }
+
+        uint32_t magic = zips_u32(zips_peek(&reader));
+        if (magic == ZIP_LOCAL_HEADER_MAGIC && signing_skipped == false)
+        {
+            read_ret = zips_read_entry(handler, report, &reader);
+        }
+        else if (magic == ZIP_CENTRAL_HEADER_MAGIC || magic == ZIP_EOCD_MAGIC)
+        {
+            read_ret = zips_read_central(report, &reader);
+            break;
+        }
+        else if (signing_skipped == false)
+        {
+            read_ret = signing_skipped = zips_skip_signing_block(&reader);
+        }
+        else
+        {
+            read_ret = false;
+        }
+    }
+
+    report->bytes_read = reader.stream_offset;
+
+    outbuf_deinit(&reader.entries_records);
+    free((void*)reader.buffer_data);
+    free((void*)reader.entry_name);
+    free((void*)reader.inflate_piece);
+
+    return read_ret;
+}
@@ -0,0 +1,59 @@
+#ifndef ZIP_ZIP_STREAM_H
+#define ZIP_ZIP_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Zip_Archive.h"
+
+/* The archive is read through a buffer of this size, whatever its size */
+#define ZIPS_BUFFER_SIZE (256 * 1024)
+
+#define ZIPS_DESCRIPTOR_MAGIC 0x08074b50
+
+typedef struct zips_handler
+{
+    /* Called at each local header, the entry data is skipped when it returns false. Encrypted
+     * entries and unknown methods are skipped and always end as invalid
+    */
+    bool (*entry_begin)(const zip_entry_t* entry, void* handler_data);
+
+    /* The inflated data, by pieces. When it returns false the rest of the entry is skipped */
+    zip_stream_t entry_data;
+
+    /* The sizes and the CRC are the ones of the data descriptor when the entry has one,
+     * `entry_valid` is false when the data doesn't match them
+    */
+    void (*entry_end)(const zip_entry_t* entry, bool entry_valid, void* handler_data);
+
+    void* handler_data;
+
+} zips_handler_t;
+
+typedef struct zips_report
+{
+    /* From the local headers */
+    size_t entries_count;
+
+    size_t central_count;
+
+    /* Local entries without the same record in the central directory, and the opposite */
+    size_t mismatched_count;
+
+    uint64_t bytes_read;
+
+    /* The stream reached the end of central directory record */
+    bool central_found;
+
+} zips_report_t;
+
+/* Unpacks an archive from a pipe or any file that can't be mapped or seeked: the local headers
+ * are parsed as the data arrives (data descriptors included) and each entry is inflated into
+ * the handler right away. At the end the central directory is compared with what the local
+ * headers said, an APK Signing Block before it is skipped. Only the buffer, one inflate state
+ * and a small record by entry are kept in memory
+*/
+bool zips_read(int input_fd, const zips_handler_t* handler, zips_report_t* report);
+
+#endif
@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include "Zip_Writer.h"
+
+#define ZIPW_OUTPUT_BUFFER (256 * 1024)
+#define ZIPW_PATH_MAX 4096
+/* The extra field zipalign pads with: id, size, alignment, then zeros */
+#define ZIPW_ALIGNMENT_EXTRA_ID 0xd935
+#define ZIPW_ALIGNMENT_EXTRA_MIN 6
+/* 1980-01-01 00:00, the archives don't depend on when they're built */
+#define ZIPW_DOS_DATE 0x0021
+#define ZIPW_DOS_TIME 0x0000
+
+struct zipw_block
+{
+    const zipw_entry_t* entry;
+
+    uint64_t block_offset;
+
+    uint32_t block_size;
+
+    bool block_last;
+
+    bool block_failed;
+
+    int compression_level;
+
+    uint32_t block_crc32;
+
+    /* NULL for the stored entries, their blocks only compute the CRC */
+    uint8_t* deflated_data;
+
+    size_t deflated_size;
+};
+
+static void zipw_put16(uint8_t* data, uint16_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+}
+
+static void zipw_put32(uint8_t* data, uint32_t value)
+{
+    zipw_put16(data, (uint16_t)value);
+    zipw_put16(data + 2, (uint16_t)(value >> 16));
+}
+
+static bool zipw_flush(const char* flush_data, size_t flush_size, void* flush_context)
+{
+    zip_writer_t* writer = (zip_writer_t*)flush_context;
+
+    while (flush_size != 0)
+    {
+        ssize_t write_ret = write(writer->output_fd, flush_data, flush_size);
+        if (write_ret < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (write_ret <= 0)
+        {
+            return false;
+        }
+        flush_data += write_ret;
+        flush_size -= (size_t)write_ret;
+    }
+    return true;
+}
+
+/* Big pieces skip the buffer */
+static bool zipw_emit(const void* data, size_t data_size, zip_writer_t* writer)
+{
+    writer->output_offset += data_size;
+
+    if (data_size < ZIPW_OUTPUT_BUFFER)
+    {
+        return outbuf_append(data, data_size, &writer->output_buffer);
+    }
+    return outbuf_flush(&writer->output_buffer) && zipw_flush((const char*)data, data_size, writer);
+}
+
+/* The stored bytes of a reused entry go from file to file without passing by the process */
+static bool zipw_copy(const zipw_entry_t* entry, zip_writer_t* writer)
+{
+    uint64_t copied_size = 0;
+
+    if (entry->raw_fd >= 0 && outbuf_flush(&writer->output_buffer))
+    {
+        loff_t source_offset = (loff_t)entry->raw_offset;
+
+        while (copied_size < entry->compressed_size)
+        {
+            ssize_t copy_ret = copy_file_range(entry->raw_fd, &source_offset, writer->output_fd, NULL, entry->compressed_size - copied_size, 0);
+            if (copy_ret < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (copy_ret <= 0)
+            {
+                break;
+            }
+            copied_size += (uint64_t)copy_ret;
+        }
+        writer->output_offset += copied_size;
+    }
+
+    /* Not supported between these files (or in memory), the rest is written from the mapping */
+    return zipw_emit(entry->raw_data + copied_size, entry->compressed_size - copied_size, writer);
+}
+
+bool zipw_init(int compression_level, zip_writer_t* writer)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->compression_level = compression_level;
+    writer->output_fd = -1;
+    writer->entries_names = arena_create(0);
+
+    return outbuf_init(0, NULL, NULL, &writer->writer_entries) && writer->entries_names != NULL;
+}
+
+void zipw_deinit(zip_writer_t* writer)
+{
+    outbuf_deinit(&writer->writer_entries);
+    if (writer->entries_names != NULL)
+    {
+        arena_destroy(writer->entries_names);
+    }
+    memset(writer, 0, sizeof(*writer));
+    writer->output_fd = -1;
+}
+
+bool zipw_add(const char* entry_name, const uint8_t* entry_data, uint64_t entry_size, uint16_t compression_method, zip_writer_t* writer)
+{
+    size_t name_length = strlen(entry_name);
+    zipw_entry_t entry = {
+        .entry_name = arena_strndup(entry_name, name_length, writer->entries_names),
+        .entry_data = entry_data,
+        .entry_size = entry_size,
+        /* Nothing to deflate */
+        .compression_method = entry_size != 0 ? compression_method : ZIP_METHOD_STORED,
+        .raw_fd = -1
+    };
+
+    if (entry.entry_name == NULL || name_length > UINT16_MAX || entry_size > UINT32_MAX ||
+        (compression_method != ZIP_METHOD_STORED && compression_method != ZIP_METHOD_DEFLATED))
+    {
+        return false;
+    }
+    return outbuf_append(&entry, sizeof(entry), &writer->writer_entries);
+}
+
+bool zipw_add_raw(const char* entry_name, const zip_entry_t* entry, const zip_archive_t* archive, zip_writer_t* writer)
+{
+    size_t name_length = strlen(entry_name);
+    const uint8_t* raw_data = zip_entry_raw(entry, archive);
+    zipw_entry_t raw_entry = {
+        .entry_name = arena_strndup(entry_name, name_length, writer->entries_names),
+        .entry_size = entry->uncompressed_size,
+        .compression_method = entry->compression_method,
+        .entry_crc32 = entry->entry_crc32,
+        .compressed_size = entry->compressed_size,
+        .raw_data = raw_data,
+        .raw_fd = archive->archive_fd,
+        .raw_offset = raw_data != NULL ? (uint64_t)(raw_data - archive->archive_data) : 0
+    };
+
+    /* Encrypted entries can't be reused */
+    if (raw_entry.entry_name == NULL || raw_data == NULL || name_length > UINT16_MAX || (entry->entry_flags & 1) != 0 ||
+        entry->uncompressed_size > UINT32_MAX || entry->compressed_size > UINT32_MAX ||
+        (entry->compression_method != ZIP_METHOD_STORED && entry->compression_method != ZIP_METHOD_DEFLATED))
+    {
+        return false;
+    }
+    return outbuf_append(&raw_entry, sizeof(raw_entry), &writer->writer_entries);
+}
+
+uint16_t zipw_method_for(const char* entry_name)
+{
+    static const char* stored_suffixes[] = { ".png", ".jpg", ".jpeg", ".gif", ".webp", ".wav", ".mp2", ".mp3", ".ogg", ".aac",
+        ".mpg", ".mpeg", ".mid", ".midi", ".smf", ".jet", ".rtttl", ".imy", ".xmf", ".mp4", ".m4a", ".m4v", ".3gp", ".3gpp",
+        ".3g2", ".3gpp2", ".amr", ".awb", ".wma", ".wmv", ".webm", ".mkv", ".so", ".arsc" };
+    size_t name_length = strlen(entry_name);
+
+    for (size_t suffix_cur = 0; suffix_cur < sizeof(stored_suffixes) / sizeof(*stored_suffixes); suffix_cur++)
+    {
+        size_t suffix_length = strlen(stored_suffixes[suffix_cur]);
+
+        if (name_length >= suffix_length && strcasecmp(entry_name + name_length - suffix_length, stored_suffixes[suffix_cur]) == 0)
+        {
+            return ZIP_METHOD_STORED;
+        }
+    }
+    return ZIP_METHOD_DEFLATED;
+}
+
+static void* zipw_block_task(void* task_data)
+{
+    struct zipw_block* block = (struct zipw_block*)task_data;
+    const uint8_t* block_data = block->entry->entry_data + block->block_offset;
+    block->block_crc32 = (uint32_t)crc32(0, block_data, block->block_size);
+
+    if (block->entry->compression_method == ZIP_METHOD_STORED)
+    {
+        return NULL;
+    }
+
+    z_stream deflate_stream;
+    memset(&deflate_stream, 0, sizeof(deflate_stream));
+
+    if (deflateInit2(&deflate_stream, block->compression_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        block->block_failed = true;
+        return NULL;
+    }
+
+    /* The end of the previous block, as if the entry was deflated at once */
+    if (block->block_offset != 0)
+    {
+        size_t dictionary_size = block->block_offset < ZIPW_DICTIONARY_SIZE ? (size_t)block->block_offset : ZIPW_DICTIONARY_SIZE;
+        deflateSetDictionary(&deflate_stream, block_data - dictionary_size, (uInt)dictionary_size);
+    }
+
+    /* The sync flush ends the block on a byte boundary with an empty stored block */
+    size_t output_capacity = deflateBound(&deflate_stream, block->block_size) + 64;
+    block->deflated_data = malloc(output_capacity);
+
+    if (block->deflated_data != NULL)
+    {
+        deflate_stream.next_in = (Bytef*)block_data;
+        deflate_stream.avail_in = block->block_size;
+        deflate_stream.next_out = block->deflated_data;
+        deflate_stream.avail_out = (uInt)output_capacity;
+
+        int deflate_ret = deflate(&deflate_stream, block->block_last ? Z_FINISH : Z_SYNC_FLUSH);
+        block->block_failed = block->block_last ? deflate_ret != Z_STREAM_END : deflate_ret != Z_OK || deflate_stream.avail_out == 0;
+        block->deflated_size = output_capacity - deflate_stream.avail_out;
+    }
+    else
+    {
+        block->block_failed = true;
+    }
+    deflateEnd(&deflate_stream);
+
+    return NULL;
+}
+
+static size_t zipw_blocks_of(const zipw_entry_t* entry)
+{
+    if (entry->raw_data != NULL)
+    {
+        return 0;
+    }
+    return (size_t)((entry->entry_size + ZIPW_BLOCK_SIZE - 1) / ZIPW_BLOCK_SIZE);
+}
+
+/* The local header, padded for the alignment, then the data from the blocks */
+static bool zipw_write_entry(zipw_entry_t* entry, const struct zipw_block* blocks, size_t blocks_count, zip_writer_t* writer)
+{
+    uint64_t deflated_size = 0;
+    uint32_t entry_crc = 0;
+
+    for (size_t block_cur = 0; block_cur < blocks_count; block_cur++)
+    {
+        if (blocks[block_cur].block_failed)
+        {
+            return false;
+        }
+        entry_crc = (uint32_t)crc32_combine(entry_crc, blocks[block_cur].block_crc32, blocks[block_cur].block_size);
+        deflated_size += blocks[block_cur].deflated_size;
+    }
+
+    /* Deflate made it bigger, the data goes as is */
+    bool entry_deflated = entry->compression_method == ZIP_METHOD_DEFLATED && (entry->raw_data != NULL || deflated_size < entry->entry_size);
+    if (entry->raw_data == NULL)
+    {
+        entry->compression_method = entry_deflated ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED;
+        entry->compressed_size = entry_deflated ? deflated_size : entry->entry_size;
+        entry->entry_crc32 = entry_crc;
+    }
+    entry->local_header_offset = writer->output_offset;
+
+    size_t name_length = strlen(entry->entry_name);
+    size_t extra_length = 0;
+    uint8_t extra_data[ZIPW_ALIGNMENT_EXTRA_MIN + ZIPW_LIBRARY_ALIGNMENT] = { 0 };
+
+    if (entry_deflated == false)
+    {
+        size_t alignment = name_length > 3 && strcmp(entry->entry_name + name_length - 3, ".so") == 0 ?
+            ZIPW_LIBRARY_ALIGNMENT : ZIPW_STORED_ALIGNMENT;
+        uint64_t data_offset = writer->output_offset + ZIP_LOCAL_HEADER_SIZE + name_length + ZIPW_ALIGNMENT_EXTRA_MIN;
+
+        extra_length = ZIPW_ALIGNMENT_EXTRA_MIN + (size_t)((alignment - data_offset % alignment) % alignment);
+        zipw_put16(extra_data, ZIPW_ALIGNMENT_EXTRA_ID);
+        zipw_put16(extra_data + 2, (uint16_t)(extra_length - 4));
+        zipw_put16(extra_data + 4, (uint16_t)alignment);
+    }
+
+    uint8_t local_header[ZIP_LOCAL_HEADER_SIZE];
+    zipw_put32(local_header, ZIP_LOCAL_HEADER_MAGIC);
+    zipw_put16(local_header + 4, entry_deflated ? 20 : 10);
+    zipw_put16(local_header + 6, 0);
+    zipw_put16(local_header + 8, entry->compression_method);
+    zipw_put16(local_header + 10, ZIPW_DOS_TIME);
+    zipw_put16(local_header + 12, ZIPW_DOS_DATE);
+    zipw_put32(local_header + 14, entry->entry_crc32);
+    zipw_put32(local_header + 18, (uint32_t)entry->compressed_size);
+    zipw_put32(local_header + 22, (uint32_t)entry->entry_size);
+    zipw_put16(local_header + 26, (uint16_t)name_length);
+    zipw_put16(local_header + 28, (uint16_t)extra_length);
+
+    bool write_ret = zipw_emit(local_header, sizeof(local_header), writer) && zipw_emit(entry->entry_name, name_length, writer) &&
+        zipw_emit(extra_data, extra_length, writer);
+
+    if (entry->raw_data != NULL)
+    {
+        return write_ret && zipw_copy(entry, writer);
+    }
+    if (entry_deflated == false)
+    {
+        return write_ret && zipw_emit(entry->entry_data, entry->entry_size, writer);
+    }
+    for (size_t block_cur = 0; write_ret && block_cur < blocks_count; block_cur++)
+    {
+        write_ret = zipw_emit(blocks[block_cur].deflated_data, blocks[block_cur].deflated_size, writer);
+    }
+    return write_ret;
+}
+
+/* The blocks of a window are compressed by the pool, then the entries are written in order */
+static bool zipw_write_window(zipw_entry_t* entries, size_t entries_count, tpool_t* thread_pool, zip_writer_t* writer)
+{
+    size_t blocks_count = 0;
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        blocks_count += zipw_blocks_of(&entries[entry_cur]);
+    }
+
+    struct zipw_block* blocks = calloc(blocks_count + 1, sizeof(struct zipw_block));
+    if (blocks == NULL)
+    {
+        return false;
+    }
+
+    tpool_group_t blocks_group;
+    tpool_group_init(&blocks_group);
+
+    size_t block_cur = 0;
+    for (size_t entry_cur = 0; entry_cur < entries_count; entry_cur++)
+    {
+        const zipw_entry_t* entry = &entries[entry_cur];
+        uint64_t blocks_end = entry->raw_data == NULL ? entry->entry_size : 0;
+
+        for (uint64_t block_offset = 0; block_offset < blocks_end; block_offset += ZIPW_BLOCK_SIZE, block_cur++)
+        {
+            struct zipw_block* block = &blocks[block_cur];
+            uint64_t block_left = entry->entry_size - block_offset;
+
+            block->entry = entry;
+            block->block_offset = block_offset;
+            block->block_size = (uint32_t)(block_left < ZIPW_BLOCK_SIZE ? block_left : ZIPW_BLOCK_SIZE);
+            block->block_last = block_left <= ZIPW_BLOCK_SIZE;
+            block->compression_level = writer->compression_level;
+
+            if (tpool_group_execute(zipw_block_task, block, &blocks_group, thread_pool) == false)
+            {
+                zipw_block_task(block);
+            }
+        }
+    }
+    tpool_group_wait(&blocks_group, thread_pool);
+    tpool_group_destroy(&blocks_group);
+
+    bool window_ret = true;
+    block_cur = 0;
+    for (size_t entry_cur = 0; window_ret && entry_cur < entries_count; entry_cur++)
+    {
+        size_t entry_blocks = zipw_blocks_of(&entries[entry_cur]);
+
+        window_ret = zipw_write_entry(&entries[entry_cur], &blocks[block_cur], entry_blocks, writer);
+        block_cur += entry_blocks;
+    }
+
+    for (block_cur = 0; block_cur < blocks_count; block_cur++)
+    {
+        free((void*)blocks[block_cur].deflated_data);
+    }
+    free((void*)blocks);
+
+    return window_ret;
+}
+
+static bool zipw_write_central(const zipw_entry_t* entries, size_t entries_count, zip_writer_t* writer)
+{
+    uint64_t central_offset = writer->output_offset;
+    bool central_ret = true;
+
+    for (size_t entry_cur = 0; central_ret && entry_cur < entries_count; entry_cur++)
+    {
+        const zipw_entry_t* entry = &entries[entry_cur];
+        size_t name_length = strlen(entry->entry_name);
+        uint8_t central_header[ZIP_CENTRAL_HEADER_SIZE] = { 0 };
+
+        zipw_put32(central_header, ZIP_CENTRAL_HEADER_MAGIC);
+        zipw_put16(central_header + 4, 20);
+        zipw_put16(central_header + 6, entry->compression_method == ZIP_METHOD_DEFLATED ? 20 : 10);
+        zipw_put16(central_header + 10, entry->compression_method);
+        zipw_put16(central_header + 12, ZIPW_DOS_TIME);
+        zipw_put16(central_header + 14, ZIPW_DOS_DATE);
+        zipw_put32(central_header + 16, entry->entry_crc32);
+        zipw_put32(central_header + 20, (uint32_t)entry->compressed_size);
+        zipw_put32(central_header + 24, (uint32_t)entry->entry_size);
+        zipw_put16(central_header + 28, (uint16_t)name_length);
+        zipw_put32(central_header + 42, (uint32_t)entry->local_header_offset);
+
+        central_ret = zipw_emit(central_header, sizeof(central_header), writer) && zipw_emit(entry->entry_name, name_length, writer);
+    }
+
+    uint8_t eocd[ZIP_EOCD_SIZE] = { 0 };
+    zipw_put32(eocd, ZIP_EOCD_MAGIC);
+    zipw_put16(eocd + 8, (uint16_t)entries_count);
+    zipw_put16(eocd + 10, (uint16_t)entries_count);
+    zipw_put32(eocd + 12, (uint32_t)(writer->output_offset - central_offset));
+    zipw_put32(eocd + 16, (uint32_t)central_offset);
+
+    /* Without ZIP64 records everything must fit in 32 bits */
+    return central_ret && writer->output_offset <= UINT32_MAX && zipw_emit(eocd, sizeof(eocd), writer);
+}
+
+bool zipw_write(const char* archive_path, tpool_t* thread_pool, zip_writer_t* writer)
+{
+    zipw_entry_t* entries = (zipw_entry_t*)writer->writer_entries.buffer_data;
+    size_t entries_count = outbuf_length(&writer->writer_entries) / sizeof(zipw_entry_t);
+    char temporary_path[ZIPW_PATH_MAX];
+
+    int path_length = snprintf(temporary_path, sizeof(temporary_path), "%s.%d", archive_path, (int)getpid());
+    if (writer->writer_entries.buffer_failed || entries_count > UINT16_MAX || path_length <= 0 || (size_t)path_length >= sizeof(temporary_path))
+    {
+        return false;
+    }
+
+    writer->output_fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->output_fd < 0)
+    {
+        return false;
+    }
+    writer->output_offset = 0;
+    bool write_ret = outbuf_init(ZIPW_OUTPUT_BUFFER, zipw_flush, writer, &writer->output_buffer);
+
+    for (size_t window_first = 0; write_ret && window_first < entries_count; )
+    {
+        size_t window_end = window_first;
+        uint64_t window_bytes = 0;
+
+        while (window_end < entries_count && (window_end == window_first || window_bytes + entries[window_end].entry_size <= ZIPW_WINDOW_SIZE))
+        {
+            window_bytes += entries[window_end++].entry_size;
+        }
+
+        write_ret = zipw_write_window(entries + window_first, window_end - window_first, thread_pool, writer) &&
+            writer->output_offset <= UINT32_MAX;
+        window_first = window_end;
+    }
+
+    write_ret = write_ret && zipw_write_central(entries, entries_count, writer);
+    write_ret = outbuf_flush(&writer->output_buffer) && write_ret;
+    outbuf_deinit(&writer->output_buffer);
+
+    write_ret = close(writer->output_fd) == 0 && write_ret;
+    writer->output_fd = -1;
+
+    if (write_ret == false || rename(temporary_path, archive_path) != 0)
+    {
+        unlink(temporary_path);
+        return false;
+    }
+    return true;
+}
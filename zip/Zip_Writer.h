@@ -0,0 +1,91 @@
+#ifndef ZIP_ZIP_WRITER_H
+#define ZIP_ZIP_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "Thread_Pool.h"
+#include "Zip_Archive.h"
+#include "data/Output_Buffer.h"
+#include "data/Memory_Arena.h"
+
+/* Entries are deflated by blocks of this size, each block by his own task (as pigz does), with
+ * the end of the previous block as dictionary. The blocks only depend on the data, so the
+ * archive is the same with any count of workers
+*/
+#define ZIPW_BLOCK_SIZE (128 * 1024)
+#define ZIPW_DICTIONARY_SIZE (32 * 1024)
+
+/* The entries are compressed by windows of this many input bytes, then written in order */
+#define ZIPW_WINDOW_SIZE (64 * 1024 * 1024)
+
+/* The data of stored entries starts at a multiple of these (zipalign), .so files by page */
+#define ZIPW_STORED_ALIGNMENT 4
+#define ZIPW_LIBRARY_ALIGNMENT 4096
+
+typedef struct zipw_entry
+{
+    const char* entry_name;
+
+    /* Owned by the caller until the archive is written */
+    const uint8_t* entry_data;
+
+    uint64_t entry_size;
+
+    uint16_t compression_method;
+
+    /* Entries reused from another archive, their stored bytes are copied as is */
+    const uint8_t* raw_data;
+
+    /* The file of `raw_data` and its offset, -1 for archives in memory */
+    int raw_fd;
+
+    uint64_t raw_offset;
+
+    /* Set while writing */
+    uint32_t entry_crc32;
+
+    uint64_t compressed_size;
+
+    uint64_t local_header_offset;
+
+} zipw_entry_t;
+
+typedef struct zip_writer
+{
+    /* zipw_entry_t, in the order of the archive */
+    output_buffer_t writer_entries;
+
+    memory_arena_t* entries_names;
+
+    int compression_level;
+
+    int output_fd;
+
+    output_buffer_t output_buffer;
+
+    uint64_t output_offset;
+
+} zip_writer_t;
+
+bool zipw_init(int compression_level, zip_writer_t* writer);
+void zipw_deinit(zip_writer_t* writer);
+
+/* ZIP_METHOD_DEFLATED entries are stored when deflate doesn't make them smaller */
+bool zipw_add(const char* entry_name, const uint8_t* entry_data, uint64_t entry_size, uint16_t compression_method, zip_writer_t* writer);
+
+/* Reuses the entry of `archive` without inflating it, the compressed bytes are copied with
+ * copy_file_range when the archive is a file. `archive` must stay open until the write
+*/
+bool zipw_add_raw(const char* entry_name, const zip_entry_t* entry, const zip_archive_t* archive, zip_writer_t* writer);
+
+/* The method aapt would pick: stored for media, native libraries and the resource table */
+uint16_t zipw_method_for(const char* entry_name);
+
+/* Compresses the entries on the pool and writes the archive into "<path>.<pid>", renamed
+ * to `archive_path` once complete. The central directory is written in a last pass
+*/
+bool zipw_write(const char* archive_path, tpool_t* thread_pool, zip_writer_t* writer);
+
+#endif